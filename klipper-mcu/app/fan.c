@@ -31,16 +31,18 @@ typedef struct {
     uint8_t pwm_enabled;        /* PWM 输出已启用 */
 } fan_state_t;
 
-/* 风扇到 PWM 通道的映射 */
+/* 风扇到 PWM 通道的映射 (config.h FAN_TABLE) */
+#define FAN_PWM_ENTRY(name, pin) PWM_CHANNEL_FAN_##name,
+
 static const pwm_channel_t s_fan_pwm_channel[FAN_COUNT] = {
-    PWM_CHANNEL_FAN_PART,       /* FAN_PART */
-    PWM_CHANNEL_FAN_HOTEND      /* FAN_HOTEND */
+    FAN_TABLE(FAN_PWM_ENTRY)
 };
 
 /* 风扇 GPIO 引脚配置 */
+#define FAN_PIN_ENTRY(name, pin) (pin),
+
 static const uint8_t s_fan_pins[FAN_COUNT] = {
-    FAN_PART_PIN,               /* FAN_PART */
-    FAN_HOTEND_PIN              /* FAN_HOTEND */
+    FAN_TABLE(FAN_PIN_ENTRY)
 };
 
 /* 风扇状态数组 */
@@ -103,7 +105,7 @@ fan_init(void)
         pwm_cfg.cycle_time = FAN_PWM_CYCLE_TIME;
         pwm_cfg.max_value = FAN_PWM_MAX_VALUE;
         pwm_cfg.invert = 0;             /* 不反相 */
-        pwm_cfg.use_hardware = 0;       /* 使用软件 PWM */
+        pwm_cfg.use_hardware = 1;       /* 定时器 PWM，无通道时退回软件 PWM */
         pwm_config(s_fan_pwm_channel[i], &pwm_cfg);
         
         /* 初始化风扇状态 */
@@ -17,15 +17,19 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include "config.h"
 
 /* ========== 风扇定义 ========== */
 
+#define FAN_ID_ENTRY(name, pin) FAN_##name,
+
 /**
  * @brief   风扇 ID 枚举
+ * 
+ * 由 config.h 的 FAN_TABLE 按顺序生成 (FAN_PART = 0，FAN_HOTEND)。
  */
 typedef enum {
-    FAN_PART = 0,               /* 模型风扇 (零件冷却风扇) */
-    FAN_HOTEND,                 /* 热端风扇 (散热风扇) */
+    FAN_TABLE(FAN_ID_ENTRY)
     FAN_COUNT
 } fan_id_t;
 
@@ -12,20 +12,30 @@
  * - M104/M109: 热端温度设置/等待
  * - M106/M107: 风扇控制
  * - M114: 位置查询
+ * - M204/M220: 加速度和速度倍率 (不等待运动完成)
+ * - M572: 压力提前设置
+ * - M20-M27: SD 卡作业 (文件行与串口行走同一条命令队列)
+ * - M990: 性能剖析统计输出 (仅 CONFIG_PROFILE 构建)
+ * - M991: 流式作业模式 (S1 进入，S0 退出)
  * 
  * @note    验收标准: 4.1.1 - 4.1.7
  */
 
 #include "gcode.h"
+#include "autoconf.h"
+#include "config.h"
+#include "toolhead.h"
+#include "sdcard.h"
+#include "src/command.h"
+#include "src/profile.h"
+#include "board/misc.h"
 #include <stddef.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <math.h>
 
-/* 条件编译: 仅在 MCU 构建时包含串口头文件 */
-#ifndef TEST_BUILD
 #include "src/stm32/serial.h"
-#endif
 
 /* ========== 私有变量 ========== */
 
@@ -41,12 +51,96 @@ static float s_pos_e = 0.0f;
 /* 当前进给速度 (mm/min) */
 static float s_feedrate = 3000.0f;
 
-/* 行缓冲区 (仅在 MCU 构建时使用) */
-#define GCODE_LINE_BUFFER_SIZE  128
+/* 流式作业模式 (M991 S1): 命令入缓冲区即应答，执行与串口链路解耦 */
+static uint8_t s_stream_mode = 0;
+
+/*
+ * 已解析待执行命令的紧凑记录，头部之后依次存放 param_mask 中各参数的值
+ * (按字母顺序)。G1 X Y E F 占 28 字节，gcode_cmd_t 约 140 字节。
+ * 记录不跨越缓冲区末尾: 放不下时写回绕标记 (cmd 为 0) 从头开始，
+ * 末尾不足一个头部时读写双方都直接回绕。
+ */
+typedef struct {
+    uint32_t param_mask;            /* 参数存在位图 */
+    uint16_t code;                  /* 命令编号 */
+    char cmd;                       /* 命令字母，0 为回绕标记 */
+    int8_t parse_ret;               /* gcode_parse_line() 返回值 */
+    uint8_t flags;                  /* GCODE_REC_* */
+    uint8_t nparams;                /* 随后的参数值个数 */
+    uint16_t reserved;
+} gcode_record_t;
+
+#define GCODE_REC_ACKED     (1u << 0)   /* 无需完成应答 (流式模式或 SD 卡行) */
+#define GCODE_REC_STR       (1u << 1)   /* 参数值之后附带 GCODE_STR_SIZE 字节字符串 */
+
+/* n 个参数的记录长度 */
+#define GCODE_REC_SIZE(n)   (sizeof(gcode_record_t) + (n) * sizeof(float))
+
+/* 记录总长度 */
+#define GCODE_REC_LEN(p_rec) \
+    (GCODE_REC_SIZE((p_rec)->nparams) \
+     + (((p_rec)->flags & GCODE_REC_STR) ? GCODE_STR_SIZE : 0))
+
+/* 命令缓冲区 (仅 CPU 访问，放在 CCM) */
+static uint32_t s_rec_buf[GCODE_STREAM_BUFFER_SIZE / sizeof(uint32_t)] __ccmram;
+static uint32_t s_rec_read = 0;     /* 读偏移 (字节) */
+static uint32_t s_rec_write = 0;    /* 写偏移 (字节) */
+static uint32_t s_rec_used = 0;     /* 已占用字节，含回绕跳过的部分 */
+static uint16_t s_queue_count = 0;  /* 缓冲区中的命令数 */
+
+/* 队首命令: 从缓冲区取出后解包，执行完成前一直保留 */
+static gcode_cmd_t s_head_cmd;
+static int8_t s_head_parse_ret = 0;
+static uint8_t s_head_flags = 0;
+static uint8_t s_head_loaded = 0;
+
+/* 队首命令已执行，正在等待其完成条件 */
+static uint8_t s_head_waiting = 0;
+
+/* 响应类型 */
+#define RSP_OK          0               /* "ok"，count 为合并的条数 */
+#define RSP_TEXT        1               /* fmt 原样输出 */
+#define RSP_FMT         2               /* fmt 按 args 渲染 */
+
+/* 格式化响应参数，按转换符解释 */
+typedef union {
+    int32_t i;                      /* %d %i %c */
+    uint32_t u;                     /* %u %x */
+    float f;                        /* %f */
+    const char *s;                  /* %s */
+} gcode_rsp_arg_t;
+
+/* 待发送响应: 只保存格式串指针和参数，渲染延后到 gcode_respond_task() */
+typedef struct {
+    const char *fmt;                /* 格式串或文本 (静态存储) */
+    uint8_t kind;                   /* RSP_* */
+    uint16_t count;                 /* RSP_OK 的合并条数 */
+    gcode_rsp_arg_t args[GCODE_RESPONSE_MAX_ARGS];
+} gcode_response_t;
+
+static gcode_response_t s_rsp_queue[GCODE_RESPONSE_QUEUE_SIZE];
+static uint8_t s_rsp_head = 0;
+static uint8_t s_rsp_count = 0;
+
 #ifndef TEST_BUILD
-static char s_line_buffer[GCODE_LINE_BUFFER_SIZE];
+/* 已渲染但发送缓冲区暂时放不下的一行 */
+static char s_rsp_line[GCODE_RESPONSE_LINE_SIZE];
+static int s_rsp_line_len = 0;
 #endif
 
+/* 分批输出的长列表 (M20/M990): 下一行和总行数 */
+static int s_list_next = 0;
+static int s_list_end = 0;
+
+#if CONFIG_PROFILE
+/* M990 输出完后是否清零统计 */
+static uint8_t s_m990_reset = 0;
+#endif
+
+/* 正在自整定的加热器及完成后是否应用结果 (M303) */
+static int s_m303_heater = 0;
+static uint8_t s_m303_apply = 0;
+
 /* ========== 弱符号声明 (后续任务实现) ========== */
 
 /*
@@ -54,26 +148,68 @@ static char s_line_buffer[GCODE_LINE_BUFFER_SIZE];
  * 实际功能将在后续任务中实现
  */
 
+#ifdef TEST_BUILD
+/* 串口行接口 (主机测试没有串口驱动，测试可提供行来源) */
+__attribute__((weak)) int serial_line_kind(void)
+{
+    return -1;  /* 默认没有待处理的行 */
+}
+
+__attribute__((weak)) const char *serial_line_peek(size_t *len)
+{
+    (void)len;
+    return NULL;
+}
+
+__attribute__((weak)) void serial_line_release(void)
+{
+}
+#endif
+
 /* Toolhead 运动接口 */
-__attribute__((weak)) int toolhead_move(float x, float y, float z, float e, float speed)
+__attribute__((weak)) int toolhead_move(const struct coord *p_end_pos, float speed)
 {
-    (void)x; (void)y; (void)z; (void)e; (void)speed;
+    (void)p_end_pos; (void)speed;
     return 0;  /* 默认返回成功 */
 }
 
+__attribute__((weak)) int toolhead_arc(const struct coord *p_end_pos,
+                                       float offset_i, float offset_j,
+                                       int clockwise, float speed)
+{
+    (void)p_end_pos; (void)offset_i; (void)offset_j;
+    (void)clockwise; (void)speed;
+    return 0;
+}
+
+__attribute__((weak)) int toolhead_home_start(uint8_t axes_mask)
+{
+    (void)axes_mask;
+    return 0;
+}
+
+__attribute__((weak)) int toolhead_home_status(void)
+{
+    return 0;  /* 默认立即完成 */
+}
+
 __attribute__((weak)) int toolhead_home(uint8_t axes_mask)
 {
     (void)axes_mask;
     return 0;  /* 默认返回成功 */
 }
 
-__attribute__((weak)) void toolhead_get_position(float *p_x, float *p_y, float *p_z, float *p_e)
+__attribute__((weak)) int toolhead_get_position(struct coord *p_pos)
 {
     /* 默认返回内部跟踪的位置 */
-    if (p_x != NULL) { *p_x = s_pos_x; }
-    if (p_y != NULL) { *p_y = s_pos_y; }
-    if (p_z != NULL) { *p_z = s_pos_z; }
-    if (p_e != NULL) { *p_e = s_pos_e; }
+    if (p_pos == NULL) {
+        return TOOLHEAD_ERR_NULL;
+    }
+    p_pos->x = s_pos_x;
+    p_pos->y = s_pos_y;
+    p_pos->z = s_pos_z;
+    p_pos->e = s_pos_e;
+    return 0;
 }
 
 __attribute__((weak)) void toolhead_wait_moves(void)
@@ -81,6 +217,52 @@ __attribute__((weak)) void toolhead_wait_moves(void)
     /* 默认空实现 */
 }
 
+__attribute__((weak)) int toolhead_moves_done(void)
+{
+    return 1;  /* 默认没有运动 */
+}
+
+__attribute__((weak)) int toolhead_can_accept_move(void)
+{
+    return 1;  /* 默认总能接收 */
+}
+
+__attribute__((weak)) int toolhead_get_queue_depth(toolhead_queue_depth_t *p_depth)
+{
+    (void)p_depth;
+    return TOOLHEAD_ERR_NULL;  /* 默认不提供队列深度 */
+}
+
+__attribute__((weak)) int toolhead_set_pressure_advance(float pressure_advance,
+                                                      float smooth_time)
+{
+    (void)pressure_advance; (void)smooth_time;
+    return 0;  /* 默认返回成功 */
+}
+
+__attribute__((weak)) int toolhead_get_config(toolhead_config_t *p_config)
+{
+    (void)p_config;
+    return TOOLHEAD_ERR_PARAM;  /* 默认没有运动配置 */
+}
+
+__attribute__((weak)) int toolhead_set_config(const toolhead_config_t *p_config)
+{
+    (void)p_config;
+    return TOOLHEAD_ERR_PARAM;
+}
+
+__attribute__((weak)) int toolhead_set_speed_factor(float factor)
+{
+    (void)factor;
+    return 0;  /* 默认返回成功 */
+}
+
+__attribute__((weak)) float toolhead_get_speed_factor(void)
+{
+    return 1.0f;
+}
+
 /* Heater 温度接口 */
 __attribute__((weak)) void heater_set_temp(int id, float temp)
 {
@@ -105,6 +287,26 @@ __attribute__((weak)) int heater_is_at_target(int id)
     return 1;  /* 默认返回已达到目标 */
 }
 
+__attribute__((weak)) int heater_autotune_start(int id, float target,
+                                              uint8_t cycles)
+{
+    (void)id; (void)target; (void)cycles;
+    return -1;  /* 默认不支持自整定 */
+}
+
+__attribute__((weak)) int heater_autotune_status(float *p_kp, float *p_ki,
+                                               float *p_kd)
+{
+    (void)p_kp; (void)p_ki; (void)p_kd;
+    return 0;  /* 默认未运行 */
+}
+
+__attribute__((weak)) int heater_set_pid(int id, float kp, float ki, float kd)
+{
+    (void)id; (void)kp; (void)ki; (void)kd;
+    return -1;
+}
+
 /* Fan 风扇接口 */
 __attribute__((weak)) void fan_set_speed(int id, float speed)
 {
@@ -117,10 +319,83 @@ __attribute__((weak)) float fan_get_speed(int id)
     return 0.0f;  /* 默认返回 0 */
 }
 
+/* 二进制命令接口 */
+__attribute__((weak)) int command_register(const cmd_desc_t *desc)
+{
+    (void)desc;
+    return 0;  /* 默认不注册 */
+}
+
+/* SD 卡接口 */
+__attribute__((weak)) int sdcard_mount(void)
+{
+    return SDCARD_ERR_NO_CARD;  /* 默认没有 SD 卡 */
+}
+
+__attribute__((weak)) int sdcard_list(void)
+{
+    return SDCARD_ERR_NO_CARD;
+}
+
+__attribute__((weak)) const sdcard_entry_t *sdcard_list_entry(int idx)
+{
+    (void)idx;
+    return NULL;
+}
+
+__attribute__((weak)) int sdcard_open(const char *name)
+{
+    (void)name;
+    return SDCARD_ERR_NO_CARD;
+}
+
+__attribute__((weak)) const sdcard_entry_t *sdcard_file(void)
+{
+    return NULL;
+}
+
+__attribute__((weak)) int sdcard_start(void)
+{
+    return SDCARD_ERR_STATE;
+}
+
+__attribute__((weak)) void sdcard_pause(void)
+{
+}
+
+__attribute__((weak)) int sdcard_is_printing(void)
+{
+    return 0;  /* 默认不在打印 */
+}
+
+__attribute__((weak)) uint32_t sdcard_get_position(void)
+{
+    return 0;
+}
+
+__attribute__((weak)) int sdcard_line_peek(const char **p_line)
+{
+    (void)p_line;
+    return SDCARD_ERR_STATE;
+}
+
+__attribute__((weak)) void sdcard_line_release(void)
+{
+}
+
 /* 加热器 ID 定义 */
 #define HEATER_HOTEND   0
 #define HEATER_BED      1
 
+/* 自整定状态 (与 heater_autotune_state_t 一致) */
+#define HEATER_AUTOTUNE_RUNNING 1
+#define HEATER_AUTOTUNE_DONE    2
+
+/* M303 默认参数 */
+#define M303_DEFAULT_CYCLES     5
+#define M303_DEFAULT_HOTEND     150.0f
+#define M303_DEFAULT_BED        60.0f
+
 /* 风扇 ID 定义 */
 #define FAN_PART        0
 #define FAN_HOTEND      1
@@ -132,11 +407,45 @@ __attribute__((weak)) float fan_get_speed(int id)
 
 /* ========== 私有函数声明 ========== */
 
-static int parse_command(const char *line, gcode_cmd_t *p_cmd);
-static int parse_parameters(const char *line, gcode_cmd_t *p_cmd);
+/* 命令处理函数类型 */
+typedef int (*gcode_handler_fn_t)(const gcode_cmd_t *p_cmd);
+
+/* 等待条件检查函数类型: 完成返回正数，等待返回 0，失败返回负数 */
+typedef int (*gcode_wait_fn_t)(void);
+
+/* 命令标志 */
+#define GCODE_FLAG_MOVE     (1u << 0)   /* 运动命令，需要前瞻/trapq 空间 */
+#define GCODE_FLAG_SYNC     (1u << 1)   /* 之前的运动全部完成后才执行 */
+#define GCODE_FLAG_STRING   (1u << 2)   /* 命令后是字符串参数 (文件名)，不按字母解析 */
+#define GCODE_FLAG_DRAIN    (1u << 3)   /* 之前的响应全部发出后才执行 */
+
+/* 命令分发表项，按 key 升序排列 */
+typedef struct {
+    uint16_t key;                   /* GCODE_KEY(字母, 编号) */
+    gcode_handler_fn_t handler;     /* 处理函数 */
+    gcode_wait_fn_t wait;           /* 执行后的等待条件，NULL 表示立即完成 */
+    uint8_t flags;                  /* GCODE_FLAG_* */
+} gcode_handler_t;
+
+/* 分发表键: M 命令置最高位，使所有 G 命令排在 M 命令之前 */
+#define GCODE_KEY(letter, code) \
+    ((uint16_t)(((letter) == 'M' ? 0x8000u : 0u) | (uint16_t)(code)))
+
 static const char *skip_whitespace(const char *str);
-static int parse_float(const char *str, float *p_value, const char **p_end);
-static int is_supported_gcode(char cmd, int code);
+static int parse_number(const char *str, float *p_value, const char **p_end);
+static void parse_string(const char *str, char *p_out);
+static const gcode_handler_t *find_handler(char cmd, int code);
+static int command_gcode_move(const cmd_args_t *args);
+#ifndef TEST_BUILD
+static int queue_free_entries(void);
+#endif
+static int command_gcode_home(const cmd_args_t *args);
+
+/* 二进制运动命令 */
+static const cmd_desc_t s_gcode_cmds[] = {
+    { CMD_ID_GCODE_MOVE, "gcode_move", command_gcode_move, 6 },
+    { CMD_ID_GCODE_HOME, "gcode_home", command_gcode_home, 1 },
+};
 
 /* ========== 公有函数实现 ========== */
 
@@ -148,6 +457,11 @@ gcode_init(void)
 {
     /* 设置默认坐标模式为绝对模式 */
     s_coord_mode = GCODE_MODE_ABSOLUTE;
+    
+    /* 注册二进制运动命令，与文本 G-code 共用执行路径 */
+    for (size_t i = 0; i < sizeof(s_gcode_cmds) / sizeof(s_gcode_cmds[0]); i++) {
+        command_register(&s_gcode_cmds[i]);
+    }
 }
 
 /**
@@ -156,8 +470,12 @@ gcode_init(void)
 int
 gcode_parse_line(const char *line, gcode_cmd_t *p_cmd)
 {
+    const gcode_handler_t *p_handler;
     const char *p_pos;
-    int ret;
+    char cmd_char;
+    char param_char;
+    int code;
+    float value;
     
     /* 参数检查 */
     if ((line == NULL) || (p_cmd == NULL)) {
@@ -180,21 +498,59 @@ gcode_parse_line(const char *line, gcode_cmd_t *p_cmd)
         return GCODE_ERR_COMMENT;
     }
     
-    /* 解析命令字母和编号 */
-    ret = parse_command(p_pos, p_cmd);
-    if (ret != GCODE_OK) {
-        return ret;
+    /* 命令字母和编号 */
+    cmd_char = (char)toupper((unsigned char)*p_pos);
+    if ((cmd_char != 'G') && (cmd_char != 'M')) {
+        return GCODE_ERR_INVALID;
+    }
+    p_pos++;
+    
+    code = 0;
+    while ((*p_pos >= '0') && (*p_pos <= '9')) {
+        code = code * 10 + (*p_pos - '0');
+        p_pos++;
     }
+    p_cmd->cmd = cmd_char;
+    p_cmd->code = code;
     
     /* 检查是否为支持的命令 */
-    if (!is_supported_gcode(p_cmd->cmd, p_cmd->code)) {
+    p_handler = find_handler(cmd_char, code);
+    if (p_handler == NULL) {
         return GCODE_ERR_UNKNOWN;
     }
     
-    /* 解析参数 */
-    ret = parse_parameters(p_pos, p_cmd);
-    if (ret != GCODE_OK) {
-        return ret;
+    /* 字符串参数: 行的其余部分即参数，不含字母参数 */
+    if (p_handler->flags & GCODE_FLAG_STRING) {
+        parse_string(p_pos, p_cmd->str);
+        return GCODE_OK;
+    }
+    
+    /* 参数: 与命令同一次扫描，遇到注释即结束，注释内容不再扫描 */
+    for (;;) {
+        p_pos = skip_whitespace(p_pos);
+        
+        if ((*p_pos == '\0') || (*p_pos == '\n') || 
+            (*p_pos == '\r') || (*p_pos == ';')) {
+            break;
+        }
+        
+        /* 获取参数字母 */
+        param_char = (char)toupper((unsigned char)*p_pos);
+        p_pos++;
+        
+        /* 解析参数值 */
+        if (parse_number(p_pos, &value, &p_pos) != 0) {
+            /* G28 X Y Z 的轴参数不带值 */
+            if ((cmd_char == 'G') && (code == 28)) {
+                value = 0.0f;
+            } else {
+                /* 跳过无效参数 */
+                continue;
+            }
+        }
+        
+        /* 存储参数值 */
+        gcode_set_param(p_cmd, param_char, value);
     }
     
     return GCODE_OK;
@@ -229,8 +585,85 @@ gcode_cmd_clear(gcode_cmd_t *p_cmd)
     }
 }
 
+/**
+ * @brief   设置命令参数
+ */
+void
+gcode_set_param(gcode_cmd_t *p_cmd, char letter, float value)
+{
+    letter = (char)toupper((unsigned char)letter);
+    if ((p_cmd == NULL) || (letter < 'A') || (letter > 'Z')) {
+        return;
+    }
+    
+    p_cmd->params[letter - 'A'] = value;
+    p_cmd->param_mask |= GCODE_PARAM_BIT(letter);
+    
+    /* 运动路径常用参数的命名字段 */
+    switch (letter) {
+        case 'X':
+            p_cmd->x = value;
+            p_cmd->has_x = 1;
+            break;
+        case 'Y':
+            p_cmd->y = value;
+            p_cmd->has_y = 1;
+            break;
+        case 'Z':
+            p_cmd->z = value;
+            p_cmd->has_z = 1;
+            break;
+        case 'E':
+            p_cmd->e = value;
+            p_cmd->has_e = 1;
+            break;
+        case 'F':
+            p_cmd->f = value;
+            p_cmd->has_f = 1;
+            break;
+        case 'S':
+            p_cmd->s = value;
+            p_cmd->has_s = 1;
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief   检查命令是否带有参数
+ */
+int
+gcode_has_param(const gcode_cmd_t *p_cmd, char letter)
+{
+    if ((p_cmd == NULL) || (letter < 'A') || (letter > 'Z')) {
+        return 0;
+    }
+    return (p_cmd->param_mask & GCODE_PARAM_BIT(letter)) ? 1 : 0;
+}
+
+/**
+ * @brief   获取命令参数
+ */
+float
+gcode_get_param(const gcode_cmd_t *p_cmd, char letter, float default_value)
+{
+    if (!gcode_has_param(p_cmd, letter)) {
+        return default_value;
+    }
+    return p_cmd->params[letter - 'A'];
+}
+
 /* ========== 私有函数实现 ========== */
 
+/* 10 的幂，用于定点小数换算 */
+static const float s_pow10[10] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f
+};
+
+/* 尾数达到该值后不再累加 (保持 9 位有效数字，不溢出 uint32_t) */
+#define PARSE_MANTISSA_LIMIT    100000000u
+
 /**
  * @brief   跳过空白字符
  * @param   str     输入字符串
@@ -246,31 +679,31 @@ skip_whitespace(const char *str)
 }
 
 /**
- * @brief   解析浮点数
+ * @brief   解析数值
  * @param   str         输入字符串
  * @param   p_value     输出浮点值
  * @param   p_end       输出解析结束位置
  * @retval  0 成功，-1 失败
  * 
- * 简单的浮点数解析，支持:
- * - 整数: 123
- * - 小数: 123.456
- * - 负数: -123.456
+ * 支持 123、123.456、-123.456、.5。整数位和小数位一起按整数累加，
+ * 最后除以 10^小数位数，"X123.456" 只需一次浮点除法。
+ * 超过 9 位有效数字的部分被截断 (整数位按 10 的幂补回)。
  */
 static int
-parse_float(const char *str, float *p_value, const char **p_end)
+parse_number(const char *str, float *p_value, const char **p_end)
 {
-    float result = 0.0f;
-    float fraction = 0.0f;
-    float divisor = 10.0f;
+    uint32_t mantissa = 0;
+    int frac_digits = 0;
+    int dropped = 0;
     int negative = 0;
     int has_digits = 0;
     int in_fraction = 0;
+    float result;
     
     /* 跳过空白 */
     str = skip_whitespace(str);
     
-    /* 检查负号 */
+    /* 检查符号 */
     if (*str == '-') {
         negative = 1;
         str++;
@@ -278,20 +711,19 @@ parse_float(const char *str, float *p_value, const char **p_end)
         str++;
     }
     
-    /* 解析数字 */
-    while (1) {
-        if ((*str >= '0') && (*str <= '9')) {
+    /* 累加数字 */
+    for (;; str++) {
+        unsigned int digit = (unsigned int)((unsigned char)*str - '0');
+        if (digit <= 9) {
             has_digits = 1;
-            if (in_fraction) {
-                fraction += (float)(*str - '0') / divisor;
-                divisor *= 10.0f;
-            } else {
-                result = result * 10.0f + (float)(*str - '0');
+            if (mantissa < PARSE_MANTISSA_LIMIT) {
+                mantissa = mantissa * 10 + digit;
+                frac_digits += in_fraction;
+            } else if (!in_fraction) {
+                dropped++;
             }
-            str++;
         } else if ((*str == '.') && (!in_fraction)) {
             in_fraction = 1;
-            str++;
         } else {
             break;
         }
@@ -302,8 +734,16 @@ parse_float(const char *str, float *p_value, const char **p_end)
         return -1;
     }
     
-    /* 合并整数和小数部分 */
-    result += fraction;
+    /* 换算定点值 */
+    result = (float)mantissa;
+    if (frac_digits > 0) {
+        result /= s_pow10[frac_digits];
+    }
+    while (dropped > 0) {
+        int n = (dropped > 9) ? 9 : dropped;
+        result *= s_pow10[n];
+        dropped -= n;
+    }
     
     /* 应用符号 */
     if (negative) {
@@ -319,216 +759,172 @@ parse_float(const char *str, float *p_value, const char **p_end)
 }
 
 /**
- * @brief   解析命令字母和编号
- * @param   line    输入行
- * @param   p_cmd   输出命令结构体
- * @retval  GCODE_OK 成功
- * @retval  GCODE_ERR_INVALID 无效命令格式
+ * @brief   解析字符串参数
+ * @param   str     命令编号之后的行内容
+ * @param   p_out   输出，GCODE_STR_SIZE 字节
+ * 
+ * 取第一个空白分隔的词，去掉开头的 '/' (上位机常带根目录前缀)，
+ * 遇到注释即结束；过长部分截断。
  */
-static int
-parse_command(const char *line, gcode_cmd_t *p_cmd)
+static void
+parse_string(const char *str, char *p_out)
 {
-    const char *p_pos = line;
-    char cmd_char;
-    int code = 0;
+    int n = 0;
     
-    /* 跳过空白 */
-    p_pos = skip_whitespace(p_pos);
+    str = skip_whitespace(str);
+    while (*str == '/') {
+        str++;
+    }
     
-    /* 获取命令字母 (G 或 M) */
-    cmd_char = (char)toupper((unsigned char)*p_pos);
-    if ((cmd_char != 'G') && (cmd_char != 'M')) {
-        return GCODE_ERR_INVALID;
+    while ((*str != '\0') && (*str != ' ') && (*str != '\t') &&
+           (*str != '\r') && (*str != '\n') && (*str != ';') &&
+           (n < GCODE_STR_SIZE - 1)) {
+        p_out[n++] = *str++;
     }
-    p_pos++;
+    p_out[n] = '\0';
+}
+
+/* ========== 命令执行函数 ========== */
+
+/**
+ * @brief   按坐标模式计算运动目标并更新进给速度
+ * @param   p_cmd   命令结构体
+ * @param   p_pos   输出目标位置
+ * @return  运动速度 (mm/s)
+ */
+static float
+calc_move_target(const gcode_cmd_t *p_cmd, struct coord *p_pos)
+{
+    float target_x, target_y, target_z, target_e;
     
-    /* 解析命令编号 */
-    while ((*p_pos >= '0') && (*p_pos <= '9')) {
-        code = code * 10 + (*p_pos - '0');
-        p_pos++;
+    /* 获取当前位置 */
+    toolhead_get_position(p_pos);
+    target_x = (float)p_pos->x;
+    target_y = (float)p_pos->y;
+    target_z = (float)p_pos->z;
+    target_e = (float)p_pos->e;
+    
+    /* 计算目标位置 */
+    if (s_coord_mode == GCODE_MODE_ABSOLUTE) {
+        /* 绝对坐标模式 */
+        if (p_cmd->has_x) { target_x = p_cmd->x; }
+        if (p_cmd->has_y) { target_y = p_cmd->y; }
+        if (p_cmd->has_z) { target_z = p_cmd->z; }
+        if (p_cmd->has_e) { target_e = p_cmd->e; }
+    } else {
+        /* 相对坐标模式 */
+        if (p_cmd->has_x) { target_x += p_cmd->x; }
+        if (p_cmd->has_y) { target_y += p_cmd->y; }
+        if (p_cmd->has_z) { target_z += p_cmd->z; }
+        if (p_cmd->has_e) { target_e += p_cmd->e; }
     }
+    p_pos->x = target_x;
+    p_pos->y = target_y;
+    p_pos->z = target_z;
+    p_pos->e = target_e;
     
-    /* 存储命令 */
-    p_cmd->cmd = cmd_char;
-    p_cmd->code = code;
+    /* 更新进给速度 (F 参数单位是 mm/min) */
+    if (p_cmd->has_f) {
+        s_feedrate = p_cmd->f;
+    }
     
-    return GCODE_OK;
+    /* 转换为 mm/s */
+    return s_feedrate / 60.0f;
+}
+
+/**
+ * @brief   更新内部位置跟踪
+ */
+static void
+update_position(const struct coord *p_pos)
+{
+    s_pos_x = (float)p_pos->x;
+    s_pos_y = (float)p_pos->y;
+    s_pos_z = (float)p_pos->z;
+    s_pos_e = (float)p_pos->e;
 }
 
 /**
- * @brief   解析命令参数
- * @param   line    输入行
- * @param   p_cmd   命令结构体 (已包含命令字母和编号)
- * @retval  GCODE_OK 成功
- * @retval  GCODE_ERR_PARAM 参数错误
+ * @brief   处理 G0/G1 直线运动命令
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * @retval  GCODE_ERR_PARAM 运动被 toolhead 拒绝 (超出限位或队列满)
  * 
- * 解析 X, Y, Z, E, F, S 参数
+ * @note    验收标准: 4.1.2 - 支持 G0/G1 (直线运动)
  */
 static int
-parse_parameters(const char *line, gcode_cmd_t *p_cmd)
+execute_g0_g1(const gcode_cmd_t *p_cmd)
 {
-    const char *p_pos = line;
-    char param_char;
-    float value;
-    
-    /* 跳过命令部分 (G/M + 数字) */
-    p_pos = skip_whitespace(p_pos);
-    if ((*p_pos == 'G') || (*p_pos == 'g') || 
-        (*p_pos == 'M') || (*p_pos == 'm')) {
-        p_pos++;
-        while ((*p_pos >= '0') && (*p_pos <= '9')) {
-            p_pos++;
-        }
-    }
-    
-    /* 解析参数 */
-    while (*p_pos != '\0') {
-        /* 跳过空白 */
-        p_pos = skip_whitespace(p_pos);
-        
-        /* 检查行尾或注释 */
-        if ((*p_pos == '\0') || (*p_pos == '\n') || 
-            (*p_pos == '\r') || (*p_pos == ';')) {
-            break;
-        }
-        
-        /* 获取参数字母 */
-        param_char = (char)toupper((unsigned char)*p_pos);
-        p_pos++;
-        
-        /* 解析参数值 */
-        if (parse_float(p_pos, &value, &p_pos) != 0) {
-            /* 某些参数可能没有值 (如 G28 X Y Z) */
-            /* 对于 G28，X/Y/Z 参数不需要值 */
-            if ((p_cmd->cmd == 'G') && (p_cmd->code == 28)) {
-                value = 0.0f;
-            } else {
-                /* 跳过无效参数 */
-                continue;
-            }
-        }
-        
-        /* 存储参数值 */
-        switch (param_char) {
-            case 'X':
-                p_cmd->x = value;
-                p_cmd->has_x = 1;
-                break;
-            case 'Y':
-                p_cmd->y = value;
-                p_cmd->has_y = 1;
-                break;
-            case 'Z':
-                p_cmd->z = value;
-                p_cmd->has_z = 1;
-                break;
-            case 'E':
-                p_cmd->e = value;
-                p_cmd->has_e = 1;
-                break;
-            case 'F':
-                p_cmd->f = value;
-                p_cmd->has_f = 1;
-                break;
-            case 'S':
-                p_cmd->s = value;
-                p_cmd->has_s = 1;
-                break;
-            default:
-                /* 忽略未知参数 */
-                break;
-        }
-    }
+    struct coord pos;
+    float speed = calc_move_target(p_cmd, &pos);
     
-    return GCODE_OK;
-}
-
-/**
- * @brief   检查是否为支持的 G-code 命令
- * @param   cmd     命令字母 (G/M)
- * @param   code    命令编号
- * @retval  1 支持，0 不支持
- */
-static int
-is_supported_gcode(char cmd, int code)
-{
-    if (cmd == 'G') {
-        switch (code) {
-            case 0:     /* G0: 快速移动 */
-            case 1:     /* G1: 直线插补 */
-            case 28:    /* G28: 归零 */
-            case 90:    /* G90: 绝对坐标 */
-            case 91:    /* G91: 相对坐标 */
-                return 1;
-            default:
-                return 0;
-        }
-    } else if (cmd == 'M') {
-        switch (code) {
-            case 104:   /* M104: 设置热端温度 */
-            case 109:   /* M109: 等待热端温度 */
-            case 106:   /* M106: 设置风扇速度 */
-            case 107:   /* M107: 关闭风扇 */
-            case 114:   /* M114: 查询位置 */
-                return 1;
-            default:
-                return 0;
-        }
+    /* 执行运动 */
+    if (toolhead_move(&pos, speed) != TOOLHEAD_OK) {
+        return GCODE_ERR_PARAM;
     }
     
+    update_position(&pos);
     return 0;
 }
 
-/* ========== 命令执行函数 ========== */
-
 /**
- * @brief   处理 G0/G1 直线运动命令
+ * @brief   处理 G2/G3 圆弧运动命令
  * @param   p_cmd   命令结构体
  * @retval  0 成功
+ * @retval  GCODE_ERR_PARAM 缺少圆心/半径、半径不足以连接两端点，
+ *                          或运动被 toolhead 拒绝
  * 
- * @note    验收标准: 4.1.2 - 支持 G0/G1 (直线运动)
+ * 圆心由 I/J (相对起点，不受 G90/G91 影响) 给出，或由半径 R 推出:
+ * R 为正取不超过 180° 的短弧，为负取长弧。分段在 toolhead 内完成。
  */
 static int
-execute_g0_g1(const gcode_cmd_t *p_cmd)
+execute_g2_g3(const gcode_cmd_t *p_cmd)
 {
-    float target_x, target_y, target_z, target_e;
-    float speed;
+    struct coord start;
+    struct coord pos;
+    int clockwise = (p_cmd->code == 2);
+    float offset_i;
+    float offset_j;
     
-    /* 获取当前位置 */
-    toolhead_get_position(&target_x, &target_y, &target_z, &target_e);
+    toolhead_get_position(&start);
+    float speed = calc_move_target(p_cmd, &pos);
     
-    /* 计算目标位置 */
-    if (s_coord_mode == GCODE_MODE_ABSOLUTE) {
-        /* 绝对坐标模式 */
-        if (p_cmd->has_x) { target_x = p_cmd->x; }
-        if (p_cmd->has_y) { target_y = p_cmd->y; }
-        if (p_cmd->has_z) { target_z = p_cmd->z; }
-        if (p_cmd->has_e) { target_e = p_cmd->e; }
+    if (gcode_has_param(p_cmd, 'I') || gcode_has_param(p_cmd, 'J')) {
+        offset_i = gcode_get_param(p_cmd, 'I', 0.0f);
+        offset_j = gcode_get_param(p_cmd, 'J', 0.0f);
+    } else if (gcode_has_param(p_cmd, 'R')) {
+        float r = gcode_get_param(p_cmd, 'R', 0.0f);
+        float dx = (float)(pos.x - start.x);
+        float dy = (float)(pos.y - start.y);
+        float d = sqrtf(dx * dx + dy * dy);
+        if (d < 0.000001f) {
+            return GCODE_ERR_PARAM;     /* R 形式无法表示整圆 */
+        }
+        
+        /* 圆心在弦中垂线上，距弦中点 h */
+        float h2 = r * r - 0.25f * d * d;
+        if (h2 < -0.0001f * r * r) {
+            return GCODE_ERR_PARAM;
+        }
+        float h = (h2 > 0.0f) ? sqrtf(h2) : 0.0f;
+        
+        /* 逆时针短弧的圆心在行进方向左侧 */
+        float side = clockwise ? -1.0f : 1.0f;
+        if (r < 0.0f) {
+            side = -side;
+        }
+        offset_i = 0.5f * dx - side * h * dy / d;
+        offset_j = 0.5f * dy + side * h * dx / d;
     } else {
-        /* 相对坐标模式 */
-        if (p_cmd->has_x) { target_x += p_cmd->x; }
-        if (p_cmd->has_y) { target_y += p_cmd->y; }
-        if (p_cmd->has_z) { target_z += p_cmd->z; }
-        if (p_cmd->has_e) { target_e += p_cmd->e; }
+        return GCODE_ERR_PARAM;
     }
     
-    /* 更新进给速度 (F 参数单位是 mm/min) */
-    if (p_cmd->has_f) {
-        s_feedrate = p_cmd->f;
+    if (toolhead_arc(&pos, offset_i, offset_j, clockwise,
+                     speed) != TOOLHEAD_OK) {
+        return GCODE_ERR_PARAM;
     }
     
-    /* 转换为 mm/s */
-    speed = s_feedrate / 60.0f;
-    
-    /* 执行运动 */
-    toolhead_move(target_x, target_y, target_z, target_e, speed);
-    
-    /* 更新内部位置跟踪 */
-    s_pos_x = target_x;
-    s_pos_y = target_y;
-    s_pos_z = target_z;
-    s_pos_e = target_e;
-    
+    update_position(&pos);
     return 0;
 }
 
@@ -560,8 +956,10 @@ execute_g28(const gcode_cmd_t *p_cmd)
         axes_mask = HOME_X_AXIS | HOME_Y_AXIS | HOME_Z_AXIS;
     }
     
-    /* 执行归零 */
-    toolhead_home(axes_mask);
+    /* 开始归零，完成由 wait_g28() 轮询 */
+    if (toolhead_home_start(axes_mask) != TOOLHEAD_OK) {
+        return GCODE_ERR_PARAM;
+    }
     
     /* 更新内部位置跟踪 */
     if (axes_mask & HOME_X_AXIS) { s_pos_x = 0.0f; }
@@ -571,6 +969,19 @@ execute_g28(const gcode_cmd_t *p_cmd)
     return 0;
 }
 
+/**
+ * @brief   G28 等待条件: 归零状态机结束
+ */
+static int
+wait_g28(void)
+{
+    int ret = toolhead_home_status();
+    if (ret == TOOLHEAD_ERR_BUSY) {
+        return 0;
+    }
+    return (ret == TOOLHEAD_OK) ? 1 : GCODE_ERR_PARAM;
+}
+
 /**
  * @brief   处理 G90 绝对坐标模式命令
  * @retval  0 成功
@@ -578,8 +989,9 @@ execute_g28(const gcode_cmd_t *p_cmd)
  * @note    验收标准: 4.1.4 - 支持 G90/G91 (坐标模式)
  */
 static int
-execute_g90(void)
+execute_g90(const gcode_cmd_t *p_cmd)
 {
+    (void)p_cmd;
     s_coord_mode = GCODE_MODE_ABSOLUTE;
     return 0;
 }
@@ -591,8 +1003,9 @@ execute_g90(void)
  * @note    验收标准: 4.1.4 - 支持 G90/G91 (坐标模式)
  */
 static int
-execute_g91(void)
+execute_g91(const gcode_cmd_t *p_cmd)
 {
+    (void)p_cmd;
     s_coord_mode = GCODE_MODE_RELATIVE;
     return 0;
 }
@@ -618,28 +1031,28 @@ execute_m104(const gcode_cmd_t *p_cmd)
  * @param   p_cmd   命令结构体
  * @retval  0 成功
  * 
+ * 只设置目标温度，等待由 wait_m109() 在主循环中轮询。
+ * 
  * @note    验收标准: 4.1.5 - 支持 M104/M109 (热端温度)
  */
 static int
 execute_m109(const gcode_cmd_t *p_cmd)
 {
-    /* 先设置目标温度 */
     if (p_cmd->has_s) {
         heater_set_temp(HEATER_HOTEND, p_cmd->s);
     }
-    
-    /* 等待温度达到目标 */
-    /* 注意: 在实际实现中，这应该是非阻塞的 */
-    /* 当前使用弱符号实现，直接返回 */
-    while (!heater_is_at_target(HEATER_HOTEND)) {
-        /* 在实际实现中，这里应该调用调度器 */
-        /* 并周期性检查温度 */
-        break;  /* 临时: 避免死循环 */
-    }
-    
     return 0;
 }
 
+/**
+ * @brief   M109 等待条件: 热端达到目标温度
+ */
+static int
+wait_m109(void)
+{
+    return heater_is_at_target(HEATER_HOTEND);
+}
+
 /**
  * @brief   处理 M106 设置风扇速度命令
  * @param   p_cmd   命令结构体
@@ -673,8 +1086,9 @@ execute_m106(const gcode_cmd_t *p_cmd)
  * @note    验收标准: 4.1.6 - 支持 M106/M107 (风扇)
  */
 static int
-execute_m107(void)
+execute_m107(const gcode_cmd_t *p_cmd)
 {
+    (void)p_cmd;
     fan_set_speed(FAN_PART, 0.0f);
     return 0;
 }
@@ -686,201 +1100,1387 @@ execute_m107(void)
  * @note    验收标准: 4.1.7 - 支持 M114 (位置查询)
  */
 static int
-execute_m114(void)
+execute_m114(const gcode_cmd_t *p_cmd)
 {
-    float x, y, z, e;
+    (void)p_cmd;
+    struct coord pos;
     
     /* 获取当前位置 */
-    toolhead_get_position(&x, &y, &z, &e);
+    toolhead_get_position(&pos);
     
-    /* 输出位置信息 */
+    /* 输出位置信息 (渲染延后到 gcode_respond_task()) */
     /* 格式: X:0.00 Y:0.00 Z:0.00 E:0.00 */
-#ifndef TEST_BUILD
-    serial_printf("X:%.2d.%02d Y:%.2d.%02d Z:%.2d.%02d E:%.2d.%02d\r\n",
-                  (int)x, (int)((x - (int)x) * 100),
-                  (int)y, (int)((y - (int)y) * 100),
-                  (int)z, (int)((z - (int)z) * 100),
-                  (int)e, (int)((e - (int)e) * 100));
-#endif
+    gcode_respond_fmt("X:%.2f Y:%.2f Z:%.2f E:%.2f",
+                      (double)pos.x, (double)pos.y,
+                      (double)pos.z, (double)pos.e);
     
     return 0;
 }
 
-/* ========== 公有函数实现 (命令执行) ========== */
-
 /**
- * @brief   执行 G-code 命令
+ * @brief   处理 M204 设置加速度命令
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * @retval  GCODE_ERR_PARAM 缺少参数或加速度无效
+ * 
+ * 格式: M204 S<加速度> 或 M204 [P<打印加速度>] [T<空驶加速度>]，
+ * 单位 mm/s²。只有一个加速度限制，P/T 取较小值 (与 Klipper 一致)；
+ * max_accel_to_decel 按原比例缩放。不等待运动完成，前瞻队列中
+ * 尚未确定的运动即按新加速度规划。
  */
-int
-gcode_execute(const gcode_cmd_t *p_cmd)
+static int
+execute_m204(const gcode_cmd_t *p_cmd)
 {
-    int ret = GCODE_OK;
+    toolhead_config_t config;
+    float accel;
     
-    /* 参数检查 */
-    if (p_cmd == NULL) {
-        return GCODE_ERR_NULL;
+    if (p_cmd->has_s) {
+        accel = p_cmd->s;
+    } else if (gcode_has_param(p_cmd, 'P') || gcode_has_param(p_cmd, 'T')) {
+        float p = gcode_get_param(p_cmd, 'P', 1e9f);
+        float t = gcode_get_param(p_cmd, 'T', 1e9f);
+        accel = (p < t) ? p : t;
+    } else {
+        return GCODE_ERR_PARAM;
     }
     
-    /* 根据命令类型分发 */
-    if (p_cmd->cmd == 'G') {
-        switch (p_cmd->code) {
-            case 0:     /* G0: 快速移动 */
-            case 1:     /* G1: 直线插补 */
-                ret = execute_g0_g1(p_cmd);
-                break;
-                
-            case 28:    /* G28: 归零 */
-                ret = execute_g28(p_cmd);
-                break;
-                
-            case 90:    /* G90: 绝对坐标 */
-                ret = execute_g90();
-                break;
-                
-            case 91:    /* G91: 相对坐标 */
-                ret = execute_g91();
-                break;
-                
-            default:
-                ret = GCODE_ERR_UNKNOWN;
-                break;
-        }
-    } else if (p_cmd->cmd == 'M') {
-        switch (p_cmd->code) {
-            case 104:   /* M104: 设置热端温度 */
-                ret = execute_m104(p_cmd);
-                break;
-                
-            case 109:   /* M109: 等待热端温度 */
-                ret = execute_m109(p_cmd);
-                break;
-                
-            case 106:   /* M106: 设置风扇速度 */
-                ret = execute_m106(p_cmd);
-                break;
-                
-            case 107:   /* M107: 关闭风扇 */
-                ret = execute_m107();
-                break;
-                
-            case 114:   /* M114: 查询位置 */
-                ret = execute_m114();
-                break;
-                
-            default:
-                ret = GCODE_ERR_UNKNOWN;
-                break;
-        }
-    } else {
-        ret = GCODE_ERR_UNKNOWN;
+    if (!(accel > 0.0f)) {
+        return GCODE_ERR_PARAM;
     }
     
-    return ret;
+    if (toolhead_get_config(&config) != TOOLHEAD_OK) {
+        return GCODE_ERR_PARAM;
+    }
+    config.max_accel_to_decel *= accel / config.max_accel;
+    config.max_accel = accel;
+    if (toolhead_set_config(&config) != TOOLHEAD_OK) {
+        return GCODE_ERR_PARAM;
+    }
+    return 0;
 }
 
 /**
- * @brief   发送响应消息
+ * @brief   处理 M220 设置速度倍率命令
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * @retval  GCODE_ERR_PARAM 倍率超出范围
+ * 
+ * 格式: M220 S<百分比>，不带 S 时回复当前倍率 "FR:<百分比>%"。
+ * 倍率作用于之后的运动和前瞻队列中尚未确定的运动，不停机。
  */
-void
-gcode_respond(const char *msg)
+static int
+execute_m220(const gcode_cmd_t *p_cmd)
 {
-    if (msg == NULL) {
-        return;
+    if (!p_cmd->has_s) {
+        gcode_respond_fmt("FR:%d%%",
+                          (int)(toolhead_get_speed_factor() * 100.0f + 0.5f));
+        return 0;
     }
     
-#ifndef TEST_BUILD
-    serial_puts(msg);
-    serial_puts("\r\n");
-#else
-    /* 测试构建时不输出 */
-    (void)msg;
-#endif
+    if (toolhead_set_speed_factor(p_cmd->s * 0.01f) != TOOLHEAD_OK) {
+        return GCODE_ERR_PARAM;
+    }
+    return 0;
 }
 
 /**
- * @brief   发送格式化响应消息
+ * @brief   处理 M303 PID 自整定命令
+ * @param   p_cmd   命令结构体
+ * @retval  0 已开始整定
+ * @retval  GCODE_ERR_PARAM 参数无效或无法开始
+ * 
+ * 格式: M303 [E<加热器>] [S<温度>] [C<周期数>] [U1]
+ * E-1 为热床，其余为热端 (与 Marlin 一致)；U1 在完成后应用结果。
+ * 完成由 wait_m303() 轮询，结果以 "Kp: Ki: Kd:" 回复。
  */
-void
-gcode_respond_fmt(const char *fmt, ...)
+static int
+execute_m303(const gcode_cmd_t *p_cmd)
 {
-    if (fmt == NULL) {
-        return;
+    int heater = (gcode_get_param(p_cmd, 'E', 0.0f) < 0.0f)
+                 ? HEATER_BED : HEATER_HOTEND;
+    float target = p_cmd->has_s ? p_cmd->s
+                   : ((heater == HEATER_BED) ? M303_DEFAULT_BED
+                                             : M303_DEFAULT_HOTEND);
+    float cycles = gcode_get_param(p_cmd, 'C', (float)M303_DEFAULT_CYCLES);
+    
+    if (cycles < 1.0f || cycles > 255.0f) {
+        return GCODE_ERR_PARAM;
+    }
+    if (heater_autotune_start(heater, target, (uint8_t)cycles) != 0) {
+        return GCODE_ERR_PARAM;
     }
     
-#ifndef TEST_BUILD
-    va_list args;
-    va_start(args, fmt);
+    s_m303_heater = heater;
+    s_m303_apply = (gcode_get_param(p_cmd, 'U', 0.0f) > 0.0f) ? 1 : 0;
+    return 0;
+}
+
+/**
+ * @brief   M303 等待条件: 自整定结束
+ */
+static int
+wait_m303(void)
+{
+    float kp = 0.0f, ki = 0.0f, kd = 0.0f;
+    int state = heater_autotune_status(&kp, &ki, &kd);
+    
+    if (state == HEATER_AUTOTUNE_RUNNING) {
+        return 0;
+    }
+    if (state != HEATER_AUTOTUNE_DONE) {
+        return GCODE_ERR_PARAM;
+    }
     
-    /* 使用简单的格式化输出 */
-    /* 注意: serial_printf 不支持 va_list，需要手动处理 */
-    /* 这里简化处理，直接输出格式字符串 */
-    serial_puts(fmt);
-    serial_puts("\r\n");
+    gcode_respond_fmt("Kp:%.3f Ki:%.3f Kd:%.3f",
+                      (double)kp, (double)ki, (double)kd);
     
-    va_end(args);
-#else
-    /* 测试构建时不输出 */
-    (void)fmt;
-#endif
+    if (s_m303_apply) {
+        heater_set_pid(s_m303_heater, kp, ki, kd);
+    }
+    return 1;
 }
 
 /**
- * @brief   处理串口输入
+ * @brief   处理 M572 设置压力提前命令
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * @retval  GCODE_ERR_PARAM 缺少 S 参数或参数无效
  * 
- * 从串口读取一行 G-code，解析并执行。
- * 非阻塞函数，如果没有完整行则立即返回。
+ * 格式: M572 S<提前量秒>，平滑窗口使用 PRESSURE_ADVANCE_SMOOTH_TIME。
+ * 会先等待运动队列清空。
  */
-void
-gcode_process(void)
+static int
+execute_m572(const gcode_cmd_t *p_cmd)
 {
-#ifndef TEST_BUILD
-    gcode_cmd_t cmd;
-    int ret;
-    int line_len;
+    if (!p_cmd->has_s || p_cmd->s < 0.0f) {
+        return GCODE_ERR_PARAM;
+    }
     
-    /* 检查是否有完整行可用 */
-    if (!serial_line_available()) {
-        return;
+    if (toolhead_set_pressure_advance(p_cmd->s,
+                                      PRESSURE_ADVANCE_SMOOTH_TIME) != 0) {
+        return GCODE_ERR_PARAM;
+    }
+    return 0;
+}
+
+/**
+ * @brief   处理 M400 等待运动完成命令
+ * @retval  0 成功
+ * 
+ * 分发表标记为 GCODE_FLAG_SYNC，执行时运动已经全部完成。
+ */
+static int
+execute_m400(const gcode_cmd_t *p_cmd)
+{
+    (void)p_cmd;
+    return 0;
+}
+
+/**
+ * @brief   处理 M20 列出 SD 卡文件
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * @retval  GCODE_ERR_PARAM 没有挂载的卡或正在打印
+ * 
+ * 输出 "Begin file list"、每个文件一行 "<文件名> <字节数>"、
+ * "End file list"。文件数可能超过响应队列，这里只输出开头，
+ * 文件行由 wait_m20() 在响应队列有空位时分批输出。
+ * 文件名引用 SD 模块的静态表，分发表标记为
+ * GCODE_FLAG_DRAIN，上一次的列表发送完之前不会重新扫描。
+ * 扫描目录同步读卡，标记 GCODE_FLAG_SYNC 等运动停止后再执行，
+ * 避免阻塞步进补充。
+ */
+static int
+execute_m20(const gcode_cmd_t *p_cmd)
+{
+    (void)p_cmd;
+    
+    int count = sdcard_list();
+    if (count < 0) {
+        return GCODE_ERR_PARAM;
     }
     
-    /* 读取一行 */
-    line_len = serial_readline(s_line_buffer, GCODE_LINE_BUFFER_SIZE);
-    if (line_len <= 0) {
-        return;
+    gcode_respond("Begin file list");
+    s_list_next = 0;
+    s_list_end = count;
+    return 0;
+}
+
+/**
+ * @brief   M20 等待条件: 文件行全部入队
+ * 
+ * 每次输出到响应队列只剩两条空位，留给 "End file list" 和 "ok"。
+ */
+static int
+wait_m20(void)
+{
+    while ((s_list_next < s_list_end) && (gcode_respond_space() > 2)) {
+        const sdcard_entry_t *p_ent = sdcard_list_entry(s_list_next++);
+        gcode_respond_fmt("%s %u", p_ent->name, (unsigned int)p_ent->size);
+    }
+    if (s_list_next < s_list_end) {
+        return 0;
     }
     
-    /* 解析 G-code */
-    ret = gcode_parse_line(s_line_buffer, &cmd);
+    gcode_respond("End file list");
+    return 1;
+}
+
+/**
+ * @brief   处理 M21 挂载 SD 卡
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * @retval  GCODE_ERR_PARAM 正在打印
+ * 
+ * 结果以 "SD card ok" / "SD init fail" 回复 (与 Marlin 一致)。
+ * 识别卡最长阻塞约 1 秒，分发表标记为 GCODE_FLAG_SYNC，运动停止后才执行。
+ */
+static int
+execute_m21(const gcode_cmd_t *p_cmd)
+{
+    (void)p_cmd;
     
-    /* 处理解析结果 */
-    switch (ret) {
-        case GCODE_OK:
-            /* 执行命令 */
-            ret = gcode_execute(&cmd);
-            if (ret == GCODE_OK) {
-                gcode_respond("ok");
-            } else {
-                gcode_respond("error: execution failed");
-            }
-            break;
-            
-        case GCODE_ERR_EMPTY:
-        case GCODE_ERR_COMMENT:
-            /* 空行或注释，发送 ok */
-            gcode_respond("ok");
-            break;
-            
-        case GCODE_ERR_UNKNOWN:
-            gcode_respond("error: unknown command");
-            break;
-            
-        case GCODE_ERR_INVALID:
-            gcode_respond("error: invalid command");
-            break;
-            
-        default:
-            gcode_respond("error: parse error");
-            break;
+    int ret = sdcard_mount();
+    if (ret == SDCARD_ERR_STATE) {
+        return GCODE_ERR_PARAM;
     }
-#endif
+    gcode_respond((ret == SDCARD_OK) ? "SD card ok" : "SD init fail");
+    return 0;
+}
+
+/**
+ * @brief   处理 M23 选择 SD 卡文件
+ * @param   p_cmd   命令结构体 (str 为文件名)
+ * @retval  0 成功
+ * @retval  GCODE_ERR_PARAM 正在打印
+ * 
+ * 格式: M23 <文件名>。成功回复 "File opened: <名字> Size: <字节数>" 和
+ * "File selected"，找不到回复 "open failed"。查找文件同步读卡，
+ * 与 M20 一样等运动停止后执行。
+ */
+static int
+execute_m23(const gcode_cmd_t *p_cmd)
+{
+    int ret = sdcard_open(p_cmd->str);
+    if (ret == SDCARD_ERR_STATE) {
+        return GCODE_ERR_PARAM;
+    }
+    
+    const sdcard_entry_t *p_file = sdcard_file();
+    if (ret != SDCARD_OK || p_file == NULL) {
+        gcode_respond("open failed");
+        return 0;
+    }
+    
+    gcode_respond_fmt("File opened: %s Size: %u",
+                      p_file->name, (unsigned int)p_file->size);
+    gcode_respond("File selected");
+    return 0;
+}
+
+/**
+ * @brief   处理 M24 开始或继续 SD 卡打印
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * @retval  GCODE_ERR_PARAM 未选择文件
+ * 
+ * 文件的行从下一次 gcode_process() 起进入命令队列。
+ */
+static int
+execute_m24(const gcode_cmd_t *p_cmd)
+{
+    (void)p_cmd;
+    return (sdcard_start() == SDCARD_OK) ? 0 : GCODE_ERR_PARAM;
+}
+
+/**
+ * @brief   处理 M25 暂停 SD 卡打印
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * 
+ * 只停止读入新行，已入队的命令照常执行。
+ */
+static int
+execute_m25(const gcode_cmd_t *p_cmd)
+{
+    (void)p_cmd;
+    sdcard_pause();
+    return 0;
+}
+
+/**
+ * @brief   处理 M27 查询 SD 卡打印进度
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ */
+static int
+execute_m27(const gcode_cmd_t *p_cmd)
+{
+    (void)p_cmd;
+    
+    const sdcard_entry_t *p_file = sdcard_file();
+    if (!sdcard_is_printing() || p_file == NULL) {
+        gcode_respond("Not SD printing");
+        return 0;
+    }
+    
+    gcode_respond_fmt("SD printing byte %u/%u",
+                      (unsigned int)sdcard_get_position(),
+                      (unsigned int)p_file->size);
+    return 0;
+}
+
+#if CONFIG_PROFILE
+/**
+ * @brief   处理 M990 输出性能剖析统计
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * 
+ * 格式: M990 [R1]，每个测点一行: 次数、最小/平均/最大 CPU 周期和
+ * 最大耗时 (微秒)，最后一行为调度器最大延迟 (定时器时钟)。
+ * R1 在输出后清零统计。各行由 wait_m990() 在响应队列有空位时
+ * 分批输出。
+ */
+static int
+execute_m990(const gcode_cmd_t *p_cmd)
+{
+    s_m990_reset = (gcode_get_param(p_cmd, 'R', 0.0f) > 0.0f);
+    s_list_next = 0;
+    s_list_end = PROFILE_SITE_COUNT;
+    return 0;
+}
+
+/**
+ * @brief   M990 等待条件: 统计行全部入队
+ * 
+ * 每次输出到响应队列只剩两条空位，留给调度器延迟行和 "ok"。
+ */
+static int
+wait_m990(void)
+{
+    const uint32_t cycles_per_us = CONFIG_CLOCK_FREQ / 1000000;
+    profile_stats_t stats;
+    profile_lateness_t late;
+    
+    while ((s_list_next < s_list_end) && (gcode_respond_space() > 2)) {
+        profile_site_t site = (profile_site_t)s_list_next++;
+        profile_get(site, &stats);
+        uint32_t avg = (stats.count > 0)
+                       ? (uint32_t)(stats.total / stats.count) : 0;
+        gcode_respond_fmt("%s: n=%u min=%u avg=%u max=%u max_us=%u",
+                          profile_site_name(site),
+                          (unsigned int)stats.count, (unsigned int)stats.min,
+                          (unsigned int)avg, (unsigned int)stats.max,
+                          (unsigned int)(stats.max / cycles_per_us));
+    }
+    if (s_list_next < s_list_end) {
+        return 0;
+    }
+    
+    profile_get_lateness(&late);
+    gcode_respond_fmt("sched_late: n=%u max=%u avg=%u",
+                      (unsigned int)late.count, (unsigned int)late.max,
+                      (unsigned int)((late.count > 0)
+                                     ? (late.total / late.count) : 0));
+    
+    if (s_m990_reset) {
+        profile_reset();
+    }
+    return 1;
+}
+#endif
+
+/**
+ * @brief   处理 M991 流式作业模式
+ * @param   p_cmd   命令结构体
+ * @retval  0 成功
+ * 
+ * 格式: M991 [S0|S1]。S1 后每行放入命令缓冲区即应答 "ok"，上位机可以
+ * 连续发送整个作业，执行失败以 "error:" 行异步报告；S0 恢复为完成后
+ * 应答。不带 S 时报告当前模式和缓冲区中的命令数。
+ */
+static int
+execute_m991(const gcode_cmd_t *p_cmd)
+{
+    if (p_cmd->has_s) {
+        s_stream_mode = (p_cmd->s > 0.0f) ? 1 : 0;
+        return 0;
+    }
+    
+    gcode_respond_fmt("stream:%u queued:%u free:%u",
+                      (unsigned int)s_stream_mode,
+                      (unsigned int)s_queue_count,
+                      (unsigned int)(GCODE_STREAM_BUFFER_SIZE - s_rec_used));
+    return 0;
+}
+
+/* ========== 命令分发表 ========== */
+
+/* 支持的命令，按 GCODE_KEY 升序 (find_handler 二分查找) */
+static const gcode_handler_t s_gcode_handlers[] = {
+    { GCODE_KEY('G', 0),   execute_g0_g1, NULL, GCODE_FLAG_MOVE },  /* G0: 快速移动 */
+    { GCODE_KEY('G', 1),   execute_g0_g1, NULL, GCODE_FLAG_MOVE },  /* G1: 直线插补 */
+    { GCODE_KEY('G', 2),   execute_g2_g3, NULL, GCODE_FLAG_MOVE },  /* G2: 顺时针圆弧 */
+    { GCODE_KEY('G', 3),   execute_g2_g3, NULL, GCODE_FLAG_MOVE },  /* G3: 逆时针圆弧 */
+    { GCODE_KEY('G', 28),  execute_g28,   wait_g28, GCODE_FLAG_SYNC },  /* G28: 归零 */
+    { GCODE_KEY('G', 90),  execute_g90,   NULL, 0 },                /* G90: 绝对坐标 */
+    { GCODE_KEY('G', 91),  execute_g91,   NULL, 0 },                /* G91: 相对坐标 */
+    { GCODE_KEY('M', 20),  execute_m20,   wait_m20,
+      GCODE_FLAG_SYNC | GCODE_FLAG_DRAIN },                         /* M20: 列出 SD 卡文件 */
+    { GCODE_KEY('M', 21),  execute_m21,   NULL, GCODE_FLAG_SYNC },  /* M21: 挂载 SD 卡 */
+    { GCODE_KEY('M', 23),  execute_m23,   NULL,
+      GCODE_FLAG_STRING | GCODE_FLAG_SYNC | GCODE_FLAG_DRAIN },     /* M23: 选择 SD 卡文件 */
+    { GCODE_KEY('M', 24),  execute_m24,   NULL, 0 },                /* M24: 开始/继续 SD 卡打印 */
+    { GCODE_KEY('M', 25),  execute_m25,   NULL, 0 },                /* M25: 暂停 SD 卡打印 */
+    { GCODE_KEY('M', 27),  execute_m27,   NULL, 0 },                /* M27: SD 卡打印进度 */
+    { GCODE_KEY('M', 104), execute_m104,  NULL, 0 },                /* M104: 设置热端温度 */
+    { GCODE_KEY('M', 106), execute_m106,  NULL, 0 },                /* M106: 设置风扇速度 */
+    { GCODE_KEY('M', 107), execute_m107,  NULL, 0 },                /* M107: 关闭风扇 */
+    { GCODE_KEY('M', 109), execute_m109,  wait_m109, 0 },           /* M109: 等待热端温度 */
+    { GCODE_KEY('M', 114), execute_m114,  NULL, 0 },                /* M114: 查询位置 */
+    { GCODE_KEY('M', 204), execute_m204,  NULL, 0 },                /* M204: 设置加速度 */
+    { GCODE_KEY('M', 220), execute_m220,  NULL, 0 },                /* M220: 速度倍率 */
+    { GCODE_KEY('M', 303), execute_m303,  wait_m303, 0 },           /* M303: PID 自整定 */
+    { GCODE_KEY('M', 400), execute_m400,  NULL, GCODE_FLAG_SYNC },  /* M400: 等待运动完成 */
+    { GCODE_KEY('M', 572), execute_m572,  NULL, GCODE_FLAG_SYNC },  /* M572: 设置压力提前 */
+#if CONFIG_PROFILE
+    { GCODE_KEY('M', 990), execute_m990,  wait_m990, 0 },           /* M990: 性能剖析统计 */
+#endif
+    { GCODE_KEY('M', 991), execute_m991,  NULL, 0 },                /* M991: 流式作业模式 */
+};
+
+#define GCODE_HANDLER_COUNT \
+    ((int)(sizeof(s_gcode_handlers) / sizeof(s_gcode_handlers[0])))
+
+/**
+ * @brief   查找命令处理函数
+ * @param   cmd     命令字母 (G/M)
+ * @param   code    命令编号
+ * @retval  分发表项，不支持返回 NULL
+ */
+static const gcode_handler_t *
+find_handler(char cmd, int code)
+{
+    if (((cmd != 'G') && (cmd != 'M')) || (code < 0) || (code > 0x7FFF)) {
+        return NULL;
+    }
+    
+    uint16_t key = GCODE_KEY(cmd, code);
+    int lo = 0;
+    int hi = GCODE_HANDLER_COUNT - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        uint16_t k = s_gcode_handlers[mid].key;
+        if (k == key) {
+            return &s_gcode_handlers[mid];
+        }
+        if (k < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    
+    return NULL;
+}
+
+/* ========== 公有函数实现 (命令执行) ========== */
+
+/**
+ * @brief   执行 G-code 命令
+ */
+int
+gcode_execute(const gcode_cmd_t *p_cmd)
+{
+    const gcode_handler_t *p_handler;
+    
+    /* 参数检查 */
+    if (p_cmd == NULL) {
+        return GCODE_ERR_NULL;
+    }
+    
+    /* 按 (字母, 编号) 分发 */
+    p_handler = find_handler(p_cmd->cmd, p_cmd->code);
+    if (p_handler == NULL) {
+        return GCODE_ERR_UNKNOWN;
+    }
+    
+    return p_handler->handler(p_cmd);
+}
+
+/**
+ * @brief   检查命令能否立即执行
+ */
+int
+gcode_can_execute(const gcode_cmd_t *p_cmd)
+{
+    if (p_cmd == NULL) {
+        return 0;
+    }
+    
+    const gcode_handler_t *p_handler = find_handler(p_cmd->cmd, p_cmd->code);
+    if (p_handler == NULL) {
+        return 1;   /* 由 gcode_execute() 报告未知命令 */
+    }
+    
+    /* 运动命令需要前瞻/trapq 空间 */
+    if (p_handler->flags & GCODE_FLAG_MOVE) {
+        return toolhead_can_accept_move();
+    }
+    
+    /* 同步命令等待运动停止，不在 toolhead_wait_moves() 中阻塞 */
+    if ((p_handler->flags & GCODE_FLAG_SYNC) && !toolhead_moves_done()) {
+        return 0;
+    }
+    
+    /* 输出引用会被本命令改写的静态数据: 等之前的响应全部渲染 */
+    if (p_handler->flags & GCODE_FLAG_DRAIN) {
+        return gcode_respond_space() == GCODE_RESPONSE_QUEUE_SIZE;
+    }
+    
+    return 1;
+}
+
+/**
+ * @brief   检查已执行命令的等待条件
+ */
+int
+gcode_wait_done(const gcode_cmd_t *p_cmd)
+{
+    if (p_cmd == NULL) {
+        return 1;
+    }
+    
+    const gcode_handler_t *p_handler = find_handler(p_cmd->cmd, p_cmd->code);
+    if (p_handler == NULL || p_handler->wait == NULL) {
+        return 1;
+    }
+    
+    int ret = p_handler->wait();
+    return (ret > 0) ? 1 : ret;
+}
+
+/* ========== 二进制命令 ========== */
+
+/**
+ * @brief   gcode_move mask x y z e f: 按 G1 执行一次运动
+ * @param   args    mask 位 0-4 对应 x/y/z/e/f；坐标为 int32 微米，
+ *                  f 为 mm/min
+ * @retval  0 成功，CMD_BUSY 运动队列满，负数 失败
+ * 
+ * 坐标模式 (G90/G91) 与文本 G-code 共用。
+ */
+static int
+command_gcode_move(const cmd_args_t *args)
+{
+    gcode_cmd_t cmd;
+    uint32_t mask = args->values[0];
+    
+    gcode_cmd_clear(&cmd);
+    cmd.cmd = 'G';
+    cmd.code = 1;
+    for (int i = 0; i < 4; i++) {
+        if (mask & (1u << i)) {
+            gcode_set_param(&cmd, "XYZE"[i],
+                            (float)(int32_t)args->values[1 + i] * 0.001f);
+        }
+    }
+    if (mask & (1u << 4)) {
+        gcode_set_param(&cmd, 'F', (float)args->values[5]);
+    }
+    
+    /* 队列满时由命令层保留消息块，稍后从本命令重试 */
+    if (!gcode_can_execute(&cmd)) {
+        return CMD_BUSY;
+    }
+    
+    return (gcode_execute(&cmd) == GCODE_OK) ? 0 : -1;
+}
+
+/**
+ * @brief   gcode_home axes_mask: 按 G28 归零
+ * @param   args    axes_mask 位 0-2 对应 X/Y/Z，0 表示全部
+ * @retval  0 成功，负数 失败
+ */
+static int
+command_gcode_home(const cmd_args_t *args)
+{
+    gcode_cmd_t cmd;
+    uint32_t mask = args->values[0];
+    
+    gcode_cmd_clear(&cmd);
+    cmd.cmd = 'G';
+    cmd.code = 28;
+    for (int i = 0; i < 3; i++) {
+        if (mask & (1u << i)) {
+            gcode_set_param(&cmd, "XYZ"[i], 0.0f);
+        }
+    }
+    
+    /* 之前的运动未完成时由命令层稍后重试 */
+    if (!gcode_can_execute(&cmd)) {
+        return CMD_BUSY;
+    }
+    
+    return (gcode_execute(&cmd) == GCODE_OK) ? 0 : -1;
+}
+
+/* ========== 响应队列 ========== */
+
+/**
+ * @brief   队列满时腾出一条
+ * 
+ * 正常情况下 gcode_process() 在执行命令前保证留有 GCODE_RESPONSE_RESERVE
+ * 条空闲，长列表也按空位分批输出，这里只兜底且不等待发送缓冲区:
+ * MCU 构建先尝试发送，仍满时合并相邻的 "ok"，否则丢弃最早的一条
+ * 文本。上位机按 "ok" 计数流控，"ok" 不丢弃。
+ */
+static void
+respond_make_room(void)
+{
+#ifndef TEST_BUILD
+    gcode_respond_task();
+    if (s_rsp_count < GCODE_RESPONSE_QUEUE_SIZE) {
+        return;
+    }
+#endif
+    int drop = 0;
+    for (int i = 0; i < s_rsp_count; i++) {
+        gcode_response_t *p_rsp =
+            &s_rsp_queue[(s_rsp_head + i) % GCODE_RESPONSE_QUEUE_SIZE];
+        if (p_rsp->kind != RSP_OK) {
+            drop = i;
+            break;
+        }
+        if (i + 1 < s_rsp_count) {
+            gcode_response_t *p_next =
+                &s_rsp_queue[(s_rsp_head + i + 1) % GCODE_RESPONSE_QUEUE_SIZE];
+            if ((p_next->kind == RSP_OK)
+                && ((uint32_t)p_rsp->count + p_next->count <= UINT16_MAX)) {
+                p_rsp->count = (uint16_t)(p_rsp->count + p_next->count);
+                drop = i + 1;
+                break;
+            }
+        }
+    }
+    
+    /* 后面的条目前移一格 */
+    for (int i = drop; i + 1 < s_rsp_count; i++) {
+        s_rsp_queue[(s_rsp_head + i) % GCODE_RESPONSE_QUEUE_SIZE] =
+            s_rsp_queue[(s_rsp_head + i + 1) % GCODE_RESPONSE_QUEUE_SIZE];
+    }
+    s_rsp_count--;
+}
+
+/**
+ * @brief   分配队尾响应
+ * @param   kind    RSP_*
+ * @param   fmt     格式串或文本
+ * @retval  响应条目
+ */
+static gcode_response_t *
+respond_push(uint8_t kind, const char *fmt)
+{
+    if (s_rsp_count >= GCODE_RESPONSE_QUEUE_SIZE) {
+        respond_make_room();
+    }
+    
+    gcode_response_t *p_rsp =
+        &s_rsp_queue[(s_rsp_head + s_rsp_count) % GCODE_RESPONSE_QUEUE_SIZE];
+    p_rsp->kind = kind;
+    p_rsp->fmt = fmt;
+    p_rsp->count = 1;
+    s_rsp_count++;
+    return p_rsp;
+}
+
+/**
+ * @brief   发送响应消息
+ */
+void
+gcode_respond(const char *msg)
+{
+    if (msg == NULL) {
+        return;
+    }
+    
+    respond_push(RSP_TEXT, msg);
+}
+
+/**
+ * @brief   发送格式化响应消息
+ * 
+ * 只扫描转换符取出参数，不做格式化。
+ */
+void
+gcode_respond_fmt(const char *fmt, ...)
+{
+    if (fmt == NULL) {
+        return;
+    }
+    
+    gcode_response_t *p_rsp = respond_push(RSP_FMT, fmt);
+    int argc = 0;
+    
+    va_list args;
+    va_start(args, fmt);
+    
+    for (const char *p = fmt; *p != '\0' && argc < GCODE_RESPONSE_MAX_ARGS; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        p++;
+        while (*p == '0' || *p == '.' || isdigit((unsigned char)*p)) {
+            p++;
+        }
+        
+        switch (*p) {
+            case 'd':
+            case 'i':
+            case 'c':
+                p_rsp->args[argc++].i = va_arg(args, int);
+                break;
+            case 'u':
+            case 'x':
+            case 'X':
+                p_rsp->args[argc++].u = va_arg(args, unsigned int);
+                break;
+            case 'f':
+                p_rsp->args[argc++].f = (float)va_arg(args, double);
+                break;
+            case 's':
+                p_rsp->args[argc++].s = va_arg(args, const char *);
+                break;
+            case '\0':
+                p--;
+                break;
+            default:
+                break;
+        }
+    }
+    
+    va_end(args);
+}
+
+/**
+ * @brief   发送 "ok" 应答
+ */
+void
+gcode_respond_ok(void)
+{
+#if CONFIG_GCODE_OK_COALESCE
+    if (s_rsp_count > 0) {
+        gcode_response_t *p_tail = &s_rsp_queue[(s_rsp_head + s_rsp_count - 1)
+                                                % GCODE_RESPONSE_QUEUE_SIZE];
+        if (p_tail->kind == RSP_OK && p_tail->count < UINT16_MAX) {
+            p_tail->count++;
+            return;
+        }
+    }
+#endif
+    respond_push(RSP_OK, NULL);
+}
+
+/**
+ * @brief   输出缓冲区写指针
+ */
+typedef struct {
+    char *p;
+    char *end;                      /* 预留 "\r\n" 后的结尾 */
+} rsp_writer_t;
+
+static void
+rsp_putc(rsp_writer_t *w, char c)
+{
+    if (w->p < w->end) {
+        *w->p++ = c;
+    }
+}
+
+static void
+rsp_puts(rsp_writer_t *w, const char *str)
+{
+    while (*str != '\0') {
+        rsp_putc(w, *str++);
+    }
+}
+
+/**
+ * @brief   输出无符号整数
+ */
+static void
+rsp_put_uint(rsp_writer_t *w, uint32_t val, unsigned int base,
+             int width, char pad)
+{
+    char digits[11];
+    int len = 0;
+    
+    do {
+        unsigned int d = val % base;
+        digits[len++] = (char)((d < 10) ? ('0' + d) : ('a' + d - 10));
+        val /= base;
+    } while (val != 0);
+    
+    while (width-- > len) {
+        rsp_putc(w, pad);
+    }
+    while (len > 0) {
+        rsp_putc(w, digits[--len]);
+    }
+}
+
+/**
+ * @brief   输出定点小数 (四舍五入到 prec 位)
+ */
+static void
+rsp_put_float(rsp_writer_t *w, float val, int prec)
+{
+    static const uint32_t s_pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    
+    if (prec > 6) {
+        prec = 6;
+    }
+    if (val < 0.0f) {
+        rsp_putc(w, '-');
+        val = -val;
+    }
+    
+    uint32_t ipart = (uint32_t)val;
+    uint32_t frac = (uint32_t)((val - (float)ipart) * (float)s_pow10[prec] + 0.5f);
+    if (frac >= s_pow10[prec]) {
+        ipart++;
+        frac -= s_pow10[prec];
+    }
+    
+    rsp_put_uint(w, ipart, 10, 0, ' ');
+    if (prec > 0) {
+        rsp_putc(w, '.');
+        rsp_put_uint(w, frac, 10, prec, '0');
+    }
+}
+
+/**
+ * @brief   按保存的参数渲染格式串
+ */
+static void
+rsp_render_fmt(rsp_writer_t *w, const gcode_response_t *p_rsp)
+{
+    int argc = 0;
+    
+    for (const char *p = p_rsp->fmt; *p != '\0'; p++) {
+        if (*p != '%') {
+            rsp_putc(w, *p);
+            continue;
+        }
+        p++;
+        
+        char pad = ' ';
+        int width = 0;
+        int prec = 6;
+        if (*p == '0') {
+            pad = '0';
+            p++;
+        }
+        while (isdigit((unsigned char)*p)) {
+            width = width * 10 + (*p++ - '0');
+        }
+        if (*p == '.') {
+            p++;
+            prec = 0;
+            while (isdigit((unsigned char)*p)) {
+                prec = prec * 10 + (*p++ - '0');
+            }
+        }
+        
+        if (*p == '\0') {
+            break;
+        }
+        if (*p == '%') {
+            rsp_putc(w, '%');
+            continue;
+        }
+        if (argc >= GCODE_RESPONSE_MAX_ARGS) {
+            continue;
+        }
+        
+        const gcode_rsp_arg_t *p_arg = &p_rsp->args[argc++];
+        switch (*p) {
+            case 'd':
+            case 'i':
+                if (p_arg->i < 0) {
+                    rsp_putc(w, '-');
+                    rsp_put_uint(w, 0u - (uint32_t)p_arg->i, 10,
+                                 (width > 0) ? width - 1 : 0, pad);
+                } else {
+                    rsp_put_uint(w, (uint32_t)p_arg->i, 10, width, pad);
+                }
+                break;
+            case 'u':
+                rsp_put_uint(w, p_arg->u, 10, width, pad);
+                break;
+            case 'x':
+            case 'X':
+                rsp_put_uint(w, p_arg->u, 16, width, pad);
+                break;
+            case 'c':
+                rsp_putc(w, (char)p_arg->i);
+                break;
+            case 's':
+                rsp_puts(w, (p_arg->s != NULL) ? p_arg->s : "(null)");
+                break;
+            case 'f':
+                rsp_put_float(w, p_arg->f, prec);
+                break;
+            default:
+                argc--;
+                break;
+        }
+    }
+}
+
+/**
+ * @brief   渲染一条 "ok" 应答
+ * 
+ * CONFIG_GCODE_ADVANCED_OK 时附带渲染时刻的队列深度 (Marlin ADVANCED_OK
+ * 格式): P 为还能接收的运动段数，B 为空闲的串口行槽数和命令队列条目数之和
+ * (流式模式下按 G1 X Y E F 记录估算命令缓冲区的剩余条数)。
+ */
+static void
+rsp_render_ok(rsp_writer_t *w)
+{
+    rsp_puts(w, "ok");
+#if CONFIG_GCODE_ADVANCED_OK && !defined(TEST_BUILD)
+    toolhead_queue_depth_t depth;
+    if (toolhead_get_queue_depth(&depth) == TOOLHEAD_OK) {
+        int free_slots = serial_line_free_slots() + queue_free_entries();
+        rsp_puts(w, " P");
+        rsp_put_uint(w, (uint32_t)depth.move_space, 10, 0, ' ');
+        rsp_puts(w, " B");
+        rsp_put_uint(w, (uint32_t)free_slots, 10, 0, ' ');
+    }
+#endif
+}
+
+/**
+ * @brief   渲染并取出最早的待发送响应
+ */
+int
+gcode_respond_take(char *buf, int size)
+{
+    if (buf == NULL || size < 3 || s_rsp_count == 0) {
+        return 0;
+    }
+    
+    gcode_response_t *p_rsp = &s_rsp_queue[s_rsp_head];
+    rsp_writer_t w = { buf, buf + size - 2 };
+    
+    if (p_rsp->kind == RSP_OK) {
+        /* 合并的 ok 渲染结果相同，放得下几条就追加几条 */
+        char line[24];
+        rsp_writer_t lw = { line, line + sizeof(line) };
+        rsp_render_ok(&lw);
+        int len = (int)(lw.p - line);
+        
+        while (p_rsp->count > 0 && (int)(w.p - buf) + len + 2 <= size) {
+            memcpy(w.p, line, (size_t)len);
+            w.p += len;
+            *w.p++ = '\r';
+            *w.p++ = '\n';
+            p_rsp->count--;
+        }
+        if (p_rsp->count > 0) {
+            return (int)(w.p - buf);
+        }
+    } else {
+        if (p_rsp->kind == RSP_TEXT) {
+            rsp_puts(&w, p_rsp->fmt);
+        } else {
+            rsp_render_fmt(&w, p_rsp);
+        }
+        w.end += 2;
+        rsp_putc(&w, '\r');
+        rsp_putc(&w, '\n');
+    }
+    
+    s_rsp_head = (uint8_t)((s_rsp_head + 1) % GCODE_RESPONSE_QUEUE_SIZE);
+    s_rsp_count--;
+    return (int)(w.p - buf);
+}
+
+/**
+ * @brief   响应队列空闲条数
+ */
+int
+gcode_respond_space(void)
+{
+    return GCODE_RESPONSE_QUEUE_SIZE - s_rsp_count;
+}
+
+/**
+ * @brief   发送待发送响应
+ */
+void
+gcode_respond_task(void)
+{
+#ifndef TEST_BUILD
+    for (;;) {
+        if (s_rsp_line_len == 0) {
+            s_rsp_line_len = gcode_respond_take(s_rsp_line, sizeof(s_rsp_line));
+            if (s_rsp_line_len == 0) {
+                return;
+            }
+        }
+        
+        /* 整行放得下才写入，serial_write() 不会等待 */
+        if (serial_tx_free() < (size_t)s_rsp_line_len) {
+            return;
+        }
+        serial_write((const uint8_t *)s_rsp_line, (size_t)s_rsp_line_len);
+        s_rsp_line_len = 0;
+    }
+#endif
+}
+
+/**
+ * @brief   应答解析失败或无需执行的行
+ * @param   parse_ret   gcode_parse_line() 返回值 (非 GCODE_OK)
+ */
+static void
+respond_parse_result(int parse_ret)
+{
+    switch (parse_ret) {
+        case GCODE_ERR_EMPTY:
+        case GCODE_ERR_COMMENT:
+            /* 空行或注释，发送 ok */
+            gcode_respond_ok();
+            break;
+            
+        case GCODE_ERR_UNKNOWN:
+            gcode_respond("error: unknown command");
+            break;
+            
+        case GCODE_ERR_INVALID:
+            gcode_respond("error: invalid command");
+            break;
+            
+        default:
+            gcode_respond("error: parse error");
+            break;
+    }
+}
+
+/**
+ * @brief   缓冲区能否再放入一条长度为 size 的记录
+ * @param   size    记录长度 (字节)
+ * @param   p_skip  输出: 写入前需跳过的末尾字节数
+ * @retval  1 放得下，0 放不下
+ */
+static int
+rec_fits(uint32_t size, uint32_t *p_skip)
+{
+    uint32_t tail_room = GCODE_STREAM_BUFFER_SIZE - s_rec_write;
+    
+    *p_skip = (tail_room < size) ? tail_room : 0;
+    return (s_rec_used + *p_skip + size <= GCODE_STREAM_BUFFER_SIZE);
+}
+
+/**
+ * @brief   命令打包入缓冲区
+ * @param   p_cmd       解析结果
+ * @param   parse_ret   gcode_parse_line() 返回值
+ * @param   flags       GCODE_REC_*
+ * @retval  0 成功，-1 缓冲区空间不足
+ */
+static int
+rec_push(const gcode_cmd_t *p_cmd, int parse_ret, uint8_t flags)
+{
+    uint32_t mask = (parse_ret == GCODE_OK) ? p_cmd->param_mask : 0;
+    uint8_t nparams = 0;
+    for (uint32_t m = mask; m != 0; m &= m - 1) {
+        nparams++;
+    }
+    if ((parse_ret == GCODE_OK) && (p_cmd->str[0] != '\0')) {
+        flags |= GCODE_REC_STR;
+    }
+    
+    uint32_t size = GCODE_REC_SIZE(nparams)
+                    + ((flags & GCODE_REC_STR) ? GCODE_STR_SIZE : 0);
+    uint32_t skip;
+    if (!rec_fits(size, &skip)) {
+        return -1;
+    }
+    
+    if (skip > 0) {
+        if (skip >= sizeof(gcode_record_t)) {
+            ((gcode_record_t *)((uint8_t *)s_rec_buf + s_rec_write))->cmd = 0;
+        }
+        s_rec_used += skip;
+        s_rec_write = 0;
+    }
+    
+    gcode_record_t *p_rec = (gcode_record_t *)((uint8_t *)s_rec_buf + s_rec_write);
+    p_rec->param_mask = mask;
+    p_rec->code = (parse_ret == GCODE_OK) ? (uint16_t)p_cmd->code : 0;
+    p_rec->cmd = (parse_ret == GCODE_OK) ? p_cmd->cmd : '?';
+    p_rec->parse_ret = (int8_t)parse_ret;
+    p_rec->flags = flags;
+    p_rec->nparams = nparams;
+    
+    float *p_val = (float *)(p_rec + 1);
+    for (int i = 0; i < GCODE_PARAM_COUNT; i++) {
+        if (mask & (1UL << i)) {
+            *p_val++ = p_cmd->params[i];
+        }
+    }
+    if (flags & GCODE_REC_STR) {
+        memcpy(p_val, p_cmd->str, GCODE_STR_SIZE);
+    }
+    
+    s_rec_write += size;
+    if (s_rec_write == GCODE_STREAM_BUFFER_SIZE) {
+        s_rec_write = 0;
+    }
+    s_rec_used += size;
+    s_queue_count++;
+    return 0;
+}
+
+/**
+ * @brief   取出最早的记录解包为队首命令
+ */
+static void
+rec_pop_head(void)
+{
+    uint32_t tail_room = GCODE_STREAM_BUFFER_SIZE - s_rec_read;
+    gcode_record_t *p_rec = (gcode_record_t *)((uint8_t *)s_rec_buf + s_rec_read);
+    
+    /* 回绕标记或末尾不足一个头部 */
+    if (tail_room < sizeof(gcode_record_t) || p_rec->cmd == 0) {
+        s_rec_used -= tail_room;
+        s_rec_read = 0;
+        p_rec = (gcode_record_t *)s_rec_buf;
+    }
+    
+    gcode_cmd_clear(&s_head_cmd);
+    s_head_cmd.cmd = p_rec->cmd;
+    s_head_cmd.code = p_rec->code;
+    
+    const float *p_val = (const float *)(p_rec + 1);
+    for (int i = 0; i < GCODE_PARAM_COUNT; i++) {
+        if (p_rec->param_mask & (1UL << i)) {
+            gcode_set_param(&s_head_cmd, (char)('A' + i), *p_val++);
+        }
+    }
+    if (p_rec->flags & GCODE_REC_STR) {
+        memcpy(s_head_cmd.str, p_val, GCODE_STR_SIZE);
+    }
+    s_head_parse_ret = p_rec->parse_ret;
+    s_head_flags = p_rec->flags;
+    s_head_loaded = 1;
+    
+    uint32_t size = GCODE_REC_LEN(p_rec);
+    s_rec_read += size;
+    if (s_rec_read == GCODE_STREAM_BUFFER_SIZE) {
+        s_rec_read = 0;
+    }
+    s_rec_used -= size;
+    s_queue_count--;
+}
+
+#ifndef TEST_BUILD
+/**
+ * @brief   命令队列还能接收的条目数 (用于 ok 的 B 值)
+ */
+static int
+queue_free_entries(void)
+{
+    if (s_stream_mode) {
+        uint32_t free_bytes = GCODE_STREAM_BUFFER_SIZE - s_rec_used;
+        return (int)(free_bytes / GCODE_REC_SIZE(4));
+    }
+    int queued = (int)s_queue_count + s_head_loaded;
+    return (queued < GCODE_QUEUE_SIZE) ? GCODE_QUEUE_SIZE - queued : 0;
+}
+#endif
+
+/**
+ * @brief   预读 SD 卡作业的行
+ * 
+ * 串口行先入队，SD 卡行补足 GCODE_QUEUE_SIZE。SD 卡行没有上位机等待
+ * 应答，入队即标记为已应答: 空行和注释直接跳过，其余解析错误和执行
+ * 失败照常以 "error:" 行报告。文件读完回复 "Done printing file"。
+ */
+static void
+queue_fill_sdcard(void)
+{
+    while (sdcard_is_printing() &&
+           (int)s_queue_count + s_head_loaded < GCODE_QUEUE_SIZE &&
+           gcode_respond_space() >= GCODE_RESPONSE_RESERVE) {
+        const char *line;
+        int ret = sdcard_line_peek(&line);
+        if (ret == SDCARD_EOF) {
+            gcode_respond("Done printing file");
+            break;
+        }
+        if (ret < 0) {
+            gcode_respond("error: SD card read failed");
+            break;
+        }
+        if (ret != SDCARD_OK) {
+            break;
+        }
+        
+        gcode_cmd_t cmd;
+        int parse_ret = gcode_parse_line(line, &cmd);
+        
+        if (parse_ret != GCODE_OK) {
+            sdcard_line_release();
+            if ((parse_ret != GCODE_ERR_EMPTY) &&
+                (parse_ret != GCODE_ERR_COMMENT)) {
+                respond_parse_result(parse_ret);
+            }
+            continue;
+        }
+        
+        if (rec_push(&cmd, parse_ret, GCODE_REC_ACKED) != 0) {
+            break;
+        }
+        sdcard_line_release();
+    }
+}
+
+/**
+ * @brief   预读串口行: 解析入队并立即归还行槽
+ * 
+ * 队首命令等待期间照常调用，后续命令在等待结束时已解析就绪。
+ * 二进制消息块留给 command_task() 处理。
+ * 
+ * 普通模式最多预读 GCODE_QUEUE_SIZE 条，完成后才应答。流式模式下命令
+ * 只要放得进缓冲区就立即应答 (解析错误也在此时应答，不入缓冲区)，
+ * 上位机据此持续发送，执行端按自己的节奏从缓冲区取命令，
+ * 不受链路抖动影响；缓冲区满时行留在行槽中，形成背压。
+ */
+static void
+queue_fill(void)
+{
+    while (serial_line_kind() == SERIAL_LINE_TEXT) {
+        if (!s_stream_mode &&
+            (int)s_queue_count + s_head_loaded >= GCODE_QUEUE_SIZE) {
+            break;
+        }
+        if (s_stream_mode && gcode_respond_space() == 0) {
+            break;
+        }
+        
+        /* 取最早的完整行 (原地访问，不拷贝) */
+        const char *line = serial_line_peek(NULL);
+        if (line == NULL) {
+            break;
+        }
+        
+        /* cmd 不引用行内容，入缓冲区后即可归还行槽 */
+        gcode_cmd_t cmd;
+        int parse_ret = gcode_parse_line(line, &cmd);
+        
+        if (s_stream_mode && parse_ret != GCODE_OK) {
+            serial_line_release();
+            respond_parse_result(parse_ret);
+            continue;
+        }
+        
+        uint8_t flags = s_stream_mode ? GCODE_REC_ACKED : 0;
+        if (rec_push(&cmd, parse_ret, flags) != 0) {
+            /* 缓冲区满: 行留在行槽中，下次重新解析 */
+            break;
+        }
+        serial_line_release();
+        
+        if (flags & GCODE_REC_ACKED) {
+            gcode_respond_ok();
+        }
+    }
+    
+    queue_fill_sdcard();
+}
+
+/**
+ * @brief   队首命令结束: 移出并应答
+ * @param   result  >0 完成，<=0 失败
+ * 
+ * 流式模式入缓冲区时已应答 "ok"，这里只报告失败。
+ */
+static void
+queue_finish(int result)
+{
+    uint8_t acked = s_head_flags & GCODE_REC_ACKED;
+    
+    s_head_loaded = 0;
+    s_head_waiting = 0;
+    
+    if (result <= 0) {
+        gcode_respond("error: execution failed");
+    } else if (!acked) {
+        gcode_respond_ok();
+    }
+}
+
+/**
+ * @brief   处理串口输入
+ * 
+ * 串口行在预读时原地解析入队并立即释放行槽，不经过额外的行缓冲拷贝。
+ * 每次调用推进队首命令一步，不在任何等待中阻塞:
+ * 
+ * - 运动队列满或同步命令的运动未完成: 命令留在队首，暂不应答
+ * - 等待类命令已执行但条件未满足: 挂起命令流，下次调用再检查
+ * 
+ * 上位机因此在命令完成前收不到 "ok"，但可以继续发送到空闲行槽。
+ * 应答只入响应队列，由 gcode_respond_task() 在发送缓冲区有空间时发出。
+ */
+void
+gcode_process(void)
+{
+    queue_fill();
+    if (!s_head_loaded) {
+        if (s_queue_count == 0) {
+            return;
+        }
+        rec_pop_head();
+    }
+    
+    /* 响应队列留出单条命令最多输出的行数，发送缓冲区满时不阻塞执行路径 */
+    if (gcode_respond_space() < GCODE_RESPONSE_RESERVE) {
+        return;
+    }
+    
+    /* 挂起中的命令: 条件满足后应答并继续 */
+    if (s_head_waiting) {
+        int done = gcode_wait_done(&s_head_cmd);
+        if (done != 0) {
+            queue_finish(done);
+        }
+        return;
+    }
+    
+    if (s_head_parse_ret != GCODE_OK) {
+        s_head_loaded = 0;
+        respond_parse_result(s_head_parse_ret);
+        return;
+    }
+    
+    /* 队列满或运动未完成时延后执行，暂不应答 */
+    if (!gcode_can_execute(&s_head_cmd)) {
+        return;
+    }
+    
+    if (gcode_execute(&s_head_cmd) != GCODE_OK) {
+        queue_finish(-1);
+        return;
+    }
+    
+    int done = gcode_wait_done(&s_head_cmd);
+    if (done == 0) {
+        s_head_waiting = 1;
+        return;
+    }
+    queue_finish(done);
 }
@@ -7,11 +7,18 @@
  * 
  * 支持的指令:
  * - G0/G1: 直线运动 (X Y Z E F)
+ * - G2/G3: 顺/逆时针圆弧 (X Y Z E F，圆心 I J 或半径 R)
  * - G28: 归零 (X Y Z 可选)
  * - G90/G91: 绝对/相对坐标模式
  * - M104/M109: 热端温度设置/等待
  * - M106/M107: 风扇控制
  * - M114: 位置查询
+ * - M204: 设置加速度 (S 或 P/T)
+ * - M220: 速度倍率 (S 百分比)
+ * - M303: PID 自整定 (E S C U)
+ * - M400: 等待运动完成
+ * - M20-M27: SD 卡作业 (列表/挂载/选择/开始/暂停/进度)
+ * - M991: 流式作业模式 (S1 进入，S0 退出)
  * 
  * @note    验收标准: 4.1.1 - 4.1.7
  */
@@ -44,11 +51,22 @@ typedef enum {
 
 /* ========== G-code 命令结构 ========== */
 
+/* 参数表大小: 每个字母 A-Z 一项 (含 I/J/P/R/T 等) */
+#define GCODE_PARAM_COUNT       26
+
+/* 参数字母在 param_mask 中的位 */
+#define GCODE_PARAM_BIT(letter) (1UL << ((letter) - 'A'))
+
+/* 字符串参数长度 (含 '\0'，4 的倍数)，够放 8.3 文件名 */
+#define GCODE_STR_SIZE          16
+
 /**
  * @brief   G-code 命令结构体
  * 
- * 存储解析后的 G-code 命令及其参数
- * 使用位域标记参数是否存在
+ * 存储解析后的 G-code 命令及其参数。
+ * 所有字母参数保存在 params[] 中，param_mask 标记是否存在；
+ * 最常用的 X/Y/Z/E/F/S 另有同值的命名字段和位域标志，
+ * 供运动路径直接访问。写参数应使用 gcode_set_param() 保持两者一致。
  */
 typedef struct {
     char cmd;                   /* 命令字母 (G/M) */
@@ -63,6 +81,9 @@ typedef struct {
     uint8_t has_f : 1;          /* F 参数存在标志 */
     uint8_t has_s : 1;          /* S 参数存在标志 */
     uint8_t reserved : 2;       /* 保留位 */
+    uint32_t param_mask;        /* 参数存在位图 (GCODE_PARAM_BIT) */
+    float params[GCODE_PARAM_COUNT];    /* 参数值，按 字母 - 'A' 索引 */
+    char str[GCODE_STR_SIZE];   /* 字符串参数 (M23 文件名)，其他命令为空 */
 } gcode_cmd_t;
 
 /* ========== 公有函数声明 ========== */
@@ -88,7 +109,7 @@ void gcode_init(void);
  * @retval  GCODE_ERR_UNKNOWN 未知命令
  * 
  * 解析 G-code 行并填充命令结构体
- * 支持的格式: G0, G1, G28, G90, G91, M104, M109, M106, M107, M114
+ * 支持的格式: G0, G1, G2, G3, G28, G90, G91, M104, M109, M106, M107, M114
  */
 int gcode_parse_line(const char *line, gcode_cmd_t *p_cmd);
 
@@ -113,11 +134,43 @@ void gcode_set_mode(gcode_mode_t mode);
  */
 void gcode_cmd_clear(gcode_cmd_t *p_cmd);
 
+/**
+ * @brief   设置命令参数
+ * @param   p_cmd   命令结构体指针
+ * @param   letter  参数字母 (大小写均可，非字母忽略)
+ * @param   value   参数值
+ * 
+ * 同时更新参数表和 X/Y/Z/E/F/S 命名字段
+ */
+void gcode_set_param(gcode_cmd_t *p_cmd, char letter, float value);
+
+/**
+ * @brief   检查命令是否带有参数
+ * @param   p_cmd   命令结构体指针
+ * @param   letter  参数字母 (大写)
+ * @retval  1 存在，0 不存在
+ */
+int gcode_has_param(const gcode_cmd_t *p_cmd, char letter);
+
+/**
+ * @brief   获取命令参数
+ * @param   p_cmd           命令结构体指针
+ * @param   letter          参数字母 (大写)
+ * @param   default_value   参数不存在时的返回值
+ * @retval  参数值
+ */
+float gcode_get_param(const gcode_cmd_t *p_cmd, char letter,
+                      float default_value);
+
 /**
  * @brief   处理串口输入 (在主循环调用)
  * 
- * 从串口读取一行 G-code，解析并执行。
- * 非阻塞函数，如果没有完整行则立即返回。
+ * 从串口读取 G-code 行，解析后放入最多 GCODE_QUEUE_SIZE 条的命令队列，
+ * 按顺序执行队首命令。命令执行完成后才应答 "ok"。
+ * 
+ * 非阻塞函数: 等待类命令 (M109、M303、M400、需要运动停止的 G28/M572) 只挂起
+ * 命令流，每次调用检查一次等待条件；其间调度器、加热器和串口接收照常
+ * 运行，后续行继续被解析入队，等待结束后立即执行。
  * 
  * @note    应在主循环中周期性调用
  */
@@ -132,33 +185,103 @@ void gcode_process(void);
  * 
  * 根据命令类型分发到相应的处理函数:
  * - G0/G1: 调用 toolhead_move()
- * - G28: 调用 toolhead_home()
+ * - G2/G3: 调用 toolhead_arc()
+ * - G28: 调用 toolhead_home_start() 启动归零即返回，gcode_wait_done()
+ *   经 wait_g28() 轮询 toolhead_home_status() 直到归零结束
  * - G90/G91: 设置坐标模式
  * - M104/M109: 调用 heater_set_temp()
  * - M106/M107: 调用 fan_set_speed()
  * - M114: 查询并输出当前位置
+ * - M303: 调用 heater_autotune_start()
+ * 
+ * 等待类命令只启动操作 (如设置目标温度) 即返回，完成条件由
+ * gcode_wait_done() 查询。
  */
 int gcode_execute(const gcode_cmd_t *p_cmd);
 
+/**
+ * @brief   检查命令能否立即执行
+ * @param   p_cmd   解析后的命令结构体指针
+ * @retval  1 可以执行
+ * @retval  0 运动队列已满，应延后执行 (不应答 "ok")
+ * 
+ * G0-G3 需要 toolhead 有空间接收新运动；G28/M400/M572 需要之前的运动
+ * 全部完成 (每次检查都会刷新运动队列)；其余命令总是可以执行。
+ */
+int gcode_can_execute(const gcode_cmd_t *p_cmd);
+
+/**
+ * @brief   检查已执行命令的等待条件
+ * @param   p_cmd   已由 gcode_execute() 执行的命令
+ * @retval  1 命令已完成，可以应答 "ok"
+ * @retval  0 仍在等待 (如 M109 未达到目标温度、G28 归零中)
+ * @retval  GCODE_ERR_PARAM 等待的操作失败 (如归零超时、自整定中止)
+ * 
+ * 非等待类命令总是返回 1。
+ */
+int gcode_wait_done(const gcode_cmd_t *p_cmd);
+
+/* ========== 响应队列 ========== */
+
+/*
+ * 响应不在命令处理中格式化和同步写串口，而是只保存格式串指针和参数，
+ * 由主循环末尾的 gcode_respond_task() 渲染，并在串口发送缓冲区有足够
+ * 空间时整行交给 DMA 发送，命令执行路径不会因发送缓冲区满而停顿。
+ * 格式串和 %s 参数只保存指针，须为静态存储 (字符串常量)。
+ */
+
 /**
  * @brief   发送响应消息
- * @param   msg     响应消息字符串 (以 '\0' 结尾)
+ * @param   msg     响应消息字符串 (以 '\0' 结尾，静态存储)
  * 
- * 通过串口发送响应消息给主机。
- * 自动添加换行符。
+ * 入队后原样输出，自动添加换行符。
  */
 void gcode_respond(const char *msg);
 
 /**
  * @brief   发送格式化响应消息
- * @param   fmt     格式字符串 (printf 风格)
+ * @param   fmt     格式字符串 (静态存储)
  * @param   ...     格式参数
  * 
- * 支持的格式: %d, %u, %x, %s, %c
- * 自动添加换行符。
+ * 入队时只按转换符取出参数，渲染延后到 gcode_respond_task()。
+ * 支持的格式: %d, %i, %u, %x, %c, %s (静态存储), %f (按 float 保存，
+ * 默认 6 位小数，可用 %.Nf 指定)，整数可带 0 填充和宽度；
+ * 最多 GCODE_RESPONSE_MAX_ARGS 个参数。自动添加换行符。
  */
 void gcode_respond_fmt(const char *fmt, ...);
 
+/**
+ * @brief   发送 "ok" 应答
+ * 
+ * CONFIG_GCODE_ADVANCED_OK 时附带渲染时刻的队列深度；
+ * CONFIG_GCODE_OK_COALESCE 时与队尾尚未发送的 "ok" 合并为一条，
+ * 连续的应答在一次渲染中批量写入发送缓冲区。
+ */
+void gcode_respond_ok(void);
+
+/**
+ * @brief   渲染并取出最早的待发送响应
+ * @param   buf     输出缓冲区
+ * @param   size    缓冲区大小 (至少 GCODE_RESPONSE_LINE_SIZE)
+ * @retval  写入的字节数 (含 "\r\n")，0 表示没有待发送响应
+ * 
+ * 合并的 "ok" 在缓冲区放得下时一次渲染多条。
+ */
+int gcode_respond_take(char *buf, int size);
+
+/**
+ * @brief   响应队列空闲条数
+ * @retval  空闲条数
+ */
+int gcode_respond_space(void);
+
+/**
+ * @brief   发送待发送响应 (主循环末尾调用)
+ * 
+ * 只在串口发送缓冲区放得下整行时写入，不会阻塞。
+ */
+void gcode_respond_task(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,19 +8,57 @@
  * 验收标准: 3.1.1 - 3.1.3 (温度读取)
  *          3.2.1 - 3.2.3 (PID 控制)
  *          3.3.1, 3.3.2 (加热器控制)
+ *
+ * 控制循环由调度器定时器驱动，不占用主循环。CONFIG_ADC_SCAN 下每
+ * HEATER_ADC_BATCHES 次 ADC 平均完成 (DMA 中断回调) 就把定时器提前到
+ * 当前时刻，PID 总在新数据到达后立即运行，周期跟随 TIM2 的硬件节拍；
+ * 定时器自身以 HEATER_WATCHDOG_TICKS 兜底，ADC 停止更新时关闭加热器。
+ * 未启用扫描时定时器按 CONFIG_TEMP_UPDATE_INTERVAL 固定周期自行重装。
+ *
+ * M303 自整定使用继电器法 (移植自 klippy/extras/pid_calibrate.py):
+ * 以最大功率做开关控制使温度在目标附近振荡，由振幅和周期按
+ * Ziegler-Nichols 规则计算 PID 参数。
  */
 
 #include "heater.h"
+#include "autoconf.h"
 #include "config.h"
+#include "sched.h"
 #include "src/stm32/adc.h"
 #include "src/pwmcmds.h"
 #include "board/gpio.h"
+#include <stddef.h>
 #include <math.h>
 
+/* ========== 控制周期 ========== */
+
+#if CONFIG_ADC_SCAN
+/* 一次 ADC 平均 (CONFIG_ADC_OVERSAMPLE 次扫描) 的时长 */
+#define HEATER_ADC_BATCH_TICKS  ((uint32_t)CONFIG_ADC_OVERSAMPLE \
+                                 * CONFIG_STEP_TIMER_FREQ / CONFIG_ADC_SCAN_FREQ)
+
+/* 每次控制间隔的 ADC 平均次数，取最接近 CONFIG_TEMP_UPDATE_INTERVAL 的整数 */
+#define HEATER_ADC_BATCHES      ((CONFIG_TEMP_UPDATE_INTERVAL * CONFIG_ADC_SCAN_FREQ \
+                                  + CONFIG_ADC_OVERSAMPLE * 500) \
+                                 / (CONFIG_ADC_OVERSAMPLE * 1000))
+
+#if HEATER_ADC_BATCHES < 1
+#error "CONFIG_TEMP_UPDATE_INTERVAL is shorter than one ADC average"
+#endif
+
+#define HEATER_CONTROL_TICKS    (HEATER_ADC_BATCHES * HEATER_ADC_BATCH_TICKS)
+#else
+#define HEATER_CONTROL_TICKS    ((uint32_t)CONFIG_TEMP_UPDATE_INTERVAL \
+                                 * (CONFIG_STEP_TIMER_FREQ / 1000))
+#endif
+
+/* 连续这么久没有新 ADC 数据时关闭加热器 */
+#define HEATER_WATCHDOG_TICKS   (3 * HEATER_CONTROL_TICKS)
+
 /* ========== PID 控制参数 ========== */
 
-/* PID 控制周期 (100ms = 0.1s) */
-#define PID_DT                  0.1f
+/* PID 控制周期 (秒)，与控制定时器周期一致 */
+#define PID_DT                  ((float)HEATER_CONTROL_TICKS / CONFIG_STEP_TIMER_FREQ)
 
 /* 积分限幅 (防止积分饱和) */
 #define PID_INTEGRAL_MAX        100.0f
@@ -28,6 +66,26 @@
 /* 目标温度变化阈值 (超过此值重置 PID 状态) */
 #define PID_TARGET_CHANGE_THRESHOLD  10.0f
 
+/* ========== 自整定参数 ========== */
+
+/* 继电器回差: 升到目标温度停止加热，降到目标 - 回差重新加热 */
+#define AUTOTUNE_DELTA          5.0f
+
+/* 开始计算参数前丢弃的峰值数 (起始升温的振荡不对称) */
+#define AUTOTUNE_SKIP_PEAKS     4
+
+/* 超过目标温度这么多时中止 */
+#define AUTOTUNE_OVERSHOOT_MAX  20.0f
+
+/* 单个半周期的最长时间 (秒)，超时视为加热器无法振荡 */
+#define AUTOTUNE_HALF_CYCLE_MAX 600.0f
+
+/* 周期数范围 */
+#define AUTOTUNE_CYCLES_MIN     3
+#define AUTOTUNE_CYCLES_MAX     20
+
+#define AUTOTUNE_PI             3.14159265f
+
 /* ========== NTC 热敏电阻参数 ========== */
 
 /*
@@ -109,6 +167,26 @@ static const ntc_table_entry_t s_ntc_table[] = {
 
 #define NTC_TABLE_SIZE          (sizeof(s_ntc_table) / sizeof(s_ntc_table[0]))
 
+/* ========== 稠密温度查表 ========== */
+
+/*
+ * heater_init() 按每种热敏电阻的曲线生成稠密查表，运行时转换为
+ * 下标 + 一次定点线性插值，无搜索、无除法:
+ *   i = adc >> LUT_SHIFT, f = adc & (LUT_STEP - 1)
+ *   T = lut[i] + (((lut[i + 1] - lut[i]) * f) >> LUT_SHIFT)
+ * 表项为温度 * THERMISTOR_TEMP_SCALE，越界部分在建表时已钳位。
+ */
+#define THERMISTOR_LUT_SHIFT    4           /* 每 16 个 ADC 码一个表项 */
+#define THERMISTOR_LUT_STEP     (1 << THERMISTOR_LUT_SHIFT)
+#define THERMISTOR_LUT_SIZE     (((ADC_MAX_VALUE + 1) >> THERMISTOR_LUT_SHIFT) + 1)
+#define THERMISTOR_TEMP_SCALE   100         /* 表项单位 0.01°C */
+
+/* 各类型热敏电阻的稠密查表 */
+static int16_t s_thermistor_lut[THERMISTOR_TYPE_COUNT][THERMISTOR_LUT_SIZE];
+
+/* 已生成查表的类型 (位掩码) */
+static uint8_t s_thermistor_lut_ready = 0;
+
 /* ========== 私有变量 ========== */
 
 /* 加热器状态 */
@@ -118,60 +196,89 @@ typedef struct {
     float prev_error;           /* 上次误差 (PID 用) */
     float integral;             /* 积分累计 (PID 用) */
     float output;               /* PWM 输出 (0-1) */
+    pid_params_t pid;           /* 当前 PID 参数 (可由自整定更新) */
     uint8_t initialized;        /* 初始化标志 */
     uint8_t pwm_enabled;        /* PWM 输出已启用 */
 } heater_state_t;
 
 /* 加热器到 PWM 通道的映射 */
+#define HEATER_PWM_ENTRY(name, adc_ch, sensor, pin, power, kp, ki, kd) \
+    PWM_CHANNEL_HEATER_##name,
+
 static const pwm_channel_t s_heater_pwm_channel[HEATER_COUNT] = {
-    PWM_CHANNEL_HEATER_HOTEND,  /* HEATER_HOTEND */
-    PWM_CHANNEL_HEATER_BED      /* HEATER_BED */
+    HEATER_TABLE(HEATER_PWM_ENTRY)
 };
 
-/* 加热器配置 */
-static const heater_config_t s_heater_config[HEATER_COUNT] = {
-    /* HEATER_HOTEND */
-    {
-        .adc_channel = TEMP_HOTEND_ADC_CH,
-        .pwm_pin = HEATER_HOTEND_PIN,
-        .max_power = 1.0f,
-        .pid = {
-            .kp = HOTEND_PID_KP,
-            .ki = HOTEND_PID_KI,
-            .kd = HOTEND_PID_KD
-        }
+/* 加热器配置 (config.h HEATER_TABLE) */
+#define HEATER_CONFIG_ENTRY(name, adc_ch, sensor, pin, power, p, i, d) \
+    {                                                                   \
+        .adc_channel = (adc_ch),                                        \
+        .sensor_type = (sensor),                                        \
+        .pwm_pin = (pin),                                               \
+        .max_power = (power),                                           \
+        .pid = { .kp = (p), .ki = (i), .kd = (d) }                      \
     },
-    /* HEATER_BED */
-    {
-        .adc_channel = TEMP_BED_ADC_CH,
-        .pwm_pin = HEATER_BED_PIN,
-        .max_power = 1.0f,
-        .pid = {
-            .kp = BED_PID_KP,
-            .ki = BED_PID_KI,
-            .kd = BED_PID_KD
-        }
-    }
+
+static const heater_config_t s_heater_config[HEATER_COUNT] = {
+    HEATER_TABLE(HEATER_CONFIG_ENTRY)
 };
 
+/* heater_task() 用 32 位掩码记录需要控制的加热器 (C99 没有 _Static_assert) */
+typedef char heater_count_check[(HEATER_COUNT <= 32) ? 1 : -1];
+
 /* 加热器状态数组 */
 static heater_state_t s_heater_state[HEATER_COUNT];
 
 /* 模块初始化标志 */
 static uint8_t s_module_initialized = 0;
 
+/* 目标温度 > 0 的加热器位图，heater_task() 只遍历这些 */
+static uint32_t s_active_mask = 0;
+
+/* 控制循环定时器 */
+static sched_timer_t s_control_timer;
+
+#if CONFIG_ADC_SCAN
+/* 距上次控制以来的 ADC 平均次数 */
+static volatile uint8_t s_adc_batches = 0;
+
+/* 定时器由 ADC 完成触发 (而非兜底超时) */
+static volatile uint8_t s_adc_fresh = 0;
+#endif
+
+/* 继电器自整定状态 (同一时刻只整定一个加热器) */
+typedef struct {
+    uint8_t state;              /* heater_autotune_state_t */
+    uint8_t id;                 /* 加热器 ID */
+    uint8_t heating;            /* 继电器当前是否加热 */
+    uint8_t peaks_needed;       /* 结束前需要的峰值数 */
+    uint8_t peak_count;         /* 已记录峰值数 */
+    float target;               /* 整定温度 */
+    float power;                /* 继电器输出 (最大功率) */
+    float time;                 /* 已运行时间 (秒) */
+    float switch_time;          /* 上次继电器切换时间 */
+    float peak;                 /* 当前半周期的极值 */
+    float peak_time;            /* 极值出现时间 */
+    float peak_temps[3];        /* 最近三个峰值 (新的在后) */
+    float peak_times[3];
+    float best_ku;              /* 最小临界增益 */
+    float best_tu;              /* 对应振荡周期 */
+} heater_autotune_t;
+
+static heater_autotune_t s_autotune;
+
 /* ========== 私有函数 ========== */
 
 /**
- * @brief   通过查表将 ADC 值转换为温度
+ * @brief   通过稀疏查表将 ADC 值转换为温度
  * @param   adc_value   ADC 读数 (0-4095)
  * @return  温度 (°C)，错误时返回 HEATER_TEMP_INVALID
  * 
- * 使用线性插值在查表中查找温度值。
+ * 使用线性插值在查表中查找温度值，仅在生成稠密查表时调用。
  * 精度要求: ±2°C
  */
 static float
-ntc_adc_to_temp(int32_t adc_value)
+ntc_table_to_temp(int32_t adc_value)
 {
     /* 检查 ADC 值有效性 */
     if (adc_value < 0 || adc_value > ADC_MAX_VALUE) {
@@ -213,22 +320,24 @@ ntc_adc_to_temp(int32_t adc_value)
 }
 
 /**
- * @brief   使用 Steinhart-Hart 公式计算温度 (备用方法)
+ * @brief   使用 Steinhart-Hart 公式计算温度
  * @param   adc_value   ADC 读数 (0-4095)
- * @return  温度 (°C)，错误时返回 HEATER_TEMP_INVALID
+ * @return  温度 (°C)，已钳位到 HEATER_TEMP_MIN..HEATER_TEMP_MAX
  * 
  * 使用简化的 Beta 公式:
  * 1/T = 1/T0 + (1/B) * ln(R/R0)
  * 
- * 注意: 此函数作为备用方法保留，当前使用查表法 (ntc_adc_to_temp)
+ * 仅在生成 THERMISTOR_NTC100K_B3950 的稠密查表时调用。
  */
-#if 0  /* 备用方法，当前未使用 */
 static float
 ntc_adc_to_temp_formula(int32_t adc_value)
 {
-    /* 检查 ADC 值有效性 */
-    if (adc_value <= 0 || adc_value >= ADC_MAX_VALUE) {
-        return HEATER_TEMP_INVALID;
+    /* 两端对应短路/开路，直接钳位 */
+    if (adc_value <= 0) {
+        return HEATER_TEMP_MAX;
+    }
+    if (adc_value >= ADC_MAX_VALUE) {
+        return HEATER_TEMP_MIN;
     }
     
     /* 计算 NTC 电阻值 */
@@ -254,7 +363,66 @@ ntc_adc_to_temp_formula(int32_t adc_value)
     
     return temp_c;
 }
-#endif  /* 备用方法 */
+
+/**
+ * @brief   生成一种热敏电阻的稠密查表
+ * @param   type    热敏电阻类型
+ */
+static void
+thermistor_lut_build(uint8_t type)
+{
+    int16_t *p_lut = s_thermistor_lut[type];
+    
+    for (uint32_t i = 0; i < THERMISTOR_LUT_SIZE; i++) {
+        int32_t adc_value = (int32_t)(i << THERMISTOR_LUT_SHIFT);
+        float temp;
+        
+        if (adc_value > ADC_MAX_VALUE) {
+            adc_value = ADC_MAX_VALUE;  /* 末项仅供插值 */
+        }
+        
+        if (type == THERMISTOR_NTC100K_B3950) {
+            temp = ntc_adc_to_temp_formula(adc_value);
+        } else {
+            temp = ntc_table_to_temp(adc_value);
+        }
+        
+        if (!(temp >= HEATER_TEMP_MIN)) {
+            temp = HEATER_TEMP_MIN;
+        } else if (temp > HEATER_TEMP_MAX) {
+            temp = HEATER_TEMP_MAX;
+        }
+        
+        p_lut[i] = (int16_t)lroundf(temp * THERMISTOR_TEMP_SCALE);
+    }
+    
+    s_thermistor_lut_ready |= (uint8_t)(1 << type);
+}
+
+/**
+ * @brief   将 ADC 值转换为温度
+ * @param   type        热敏电阻类型
+ * @param   adc_value   ADC 读数 (0-4095)
+ * @return  温度 (°C)，错误时返回 HEATER_TEMP_INVALID
+ * 
+ * 稠密查表下标 + 定点插值，O(1)。
+ */
+static float
+ntc_adc_to_temp(uint8_t type, int32_t adc_value)
+{
+    /* 检查 ADC 值有效性 */
+    if ((uint32_t)adc_value > ADC_MAX_VALUE) {
+        return HEATER_TEMP_INVALID;
+    }
+    
+    const int16_t *p_lut = s_thermistor_lut[type];
+    uint32_t i = (uint32_t)adc_value >> THERMISTOR_LUT_SHIFT;
+    int32_t frac = adc_value & (THERMISTOR_LUT_STEP - 1);
+    int32_t t0 = p_lut[i];
+    int32_t fixed = t0 + (((p_lut[i + 1] - t0) * frac) >> THERMISTOR_LUT_SHIFT);
+    
+    return (float)fixed * (1.0f / THERMISTOR_TEMP_SCALE);
+}
 
 /**
  * @brief   获取 ADC 通道对应的 GPIO 引脚
@@ -371,6 +539,157 @@ heater_set_pwm(heater_id_t id, float duty)
     pwm_set_duty(pwm_ch, duty);
 }
 
+/**
+ * @brief   自整定: 记录一个峰值并评估最近一个周期
+ * @param   at      自整定状态
+ * 
+ * 与 pid_calibrate.py 相同: 振幅取最近两个相反峰值之差的一半，
+ * 周期取相隔一个峰值的两个同向峰值的时间差，保留临界增益最小的一组。
+ */
+static void
+autotune_check_peaks(heater_autotune_t *at)
+{
+    at->peak_temps[0] = at->peak_temps[1];
+    at->peak_times[0] = at->peak_times[1];
+    at->peak_temps[1] = at->peak_temps[2];
+    at->peak_times[1] = at->peak_times[2];
+    at->peak_temps[2] = at->peak;
+    at->peak_times[2] = at->peak_time;
+    at->peak_count++;
+    
+    if (at->peak_count <= AUTOTUNE_SKIP_PEAKS) {
+        return;
+    }
+    
+    float amplitude = 0.5f * fabsf(at->peak_temps[2] - at->peak_temps[1]);
+    float tu = at->peak_times[2] - at->peak_times[0];
+    if (amplitude <= 0.0f || tu <= 0.0f) {
+        return;
+    }
+    
+    /* 继电器幅值 d、振幅 a 时的临界增益 Ku = 4d / (pi * a) */
+    float ku = 4.0f * at->power / (AUTOTUNE_PI * amplitude);
+    if (at->best_ku <= 0.0f || ku < at->best_ku) {
+        at->best_ku = ku;
+        at->best_tu = tu;
+    }
+}
+
+/**
+ * @brief   自整定: 执行一个控制周期的继电器控制
+ * @param   at      自整定状态
+ * @param   temp    当前温度
+ * @param   dt      控制周期 (秒)
+ * @return  PWM 输出 (0.0 或最大功率)
+ * 
+ * 整定结束 (成功或失败) 后 at->state 离开 HEATER_AUTOTUNE_RUNNING。
+ */
+static float
+autotune_update(heater_autotune_t *at, float temp, float dt)
+{
+    at->time += dt;
+    
+    /* 过冲或长时间不切换: 中止 */
+    if (temp > at->target + AUTOTUNE_OVERSHOOT_MAX
+        || at->time - at->switch_time > AUTOTUNE_HALF_CYCLE_MAX) {
+        at->state = HEATER_AUTOTUNE_FAILED;
+        return 0.0f;
+    }
+    
+    /* 继电器切换，切换前的极值即为一个峰值 */
+    if (at->heating && temp >= at->target) {
+        at->heating = 0;
+        autotune_check_peaks(at);
+        at->peak = temp;
+        at->peak_time = at->time;
+        at->switch_time = at->time;
+    } else if (!at->heating && temp <= at->target - AUTOTUNE_DELTA) {
+        at->heating = 1;
+        autotune_check_peaks(at);
+        at->peak = temp;
+        at->peak_time = at->time;
+        at->switch_time = at->time;
+    }
+    
+    /* 加热段温度先继续下降找谷值，停热段先继续上升找峰值 */
+    if (at->heating ? (temp < at->peak) : (temp > at->peak)) {
+        at->peak = temp;
+        at->peak_time = at->time;
+    }
+    
+    if (at->peak_count >= at->peaks_needed) {
+        at->state = (at->best_ku > 0.0f) ? HEATER_AUTOTUNE_DONE
+                                         : HEATER_AUTOTUNE_FAILED;
+        return 0.0f;
+    }
+    
+    return at->heating ? at->power : 0.0f;
+}
+
+/**
+ * @brief   关闭所有加热器输出 (保留目标温度)
+ */
+static void
+heater_outputs_off(void)
+{
+    for (uint8_t i = 0; i < HEATER_COUNT; i++) {
+        s_heater_state[i].output = 0.0f;
+        heater_set_pwm((heater_id_t)i, 0.0f);
+    }
+}
+
+/**
+ * @brief   控制循环定时器回调
+ * @param   waketime    本次唤醒时间
+ * @return  下次唤醒时间
+ */
+static sched_time_t
+heater_control_event(sched_time_t waketime)
+{
+#if CONFIG_ADC_SCAN
+    if (!s_adc_fresh) {
+        /* 兜底超时: ADC 已停止更新，温度不可信 */
+        if (s_autotune.state == HEATER_AUTOTUNE_RUNNING) {
+            s_autotune.state = HEATER_AUTOTUNE_FAILED;
+        }
+        heater_outputs_off();
+        return waketime + HEATER_WATCHDOG_TICKS;
+    }
+    s_adc_fresh = 0;
+    heater_task();
+    
+    /* 正常情况下下一次由 heater_adc_ready() 提前唤醒 */
+    return waketime + HEATER_WATCHDOG_TICKS;
+#else
+    heater_task();
+    return waketime + HEATER_CONTROL_TICKS;
+#endif
+}
+
+#if CONFIG_ADC_SCAN
+/**
+ * @brief   ADC 平均完成回调 (DMA 中断上下文)
+ * @param   time    新数据写入时的调度器时钟
+ * 
+ * 每 HEATER_ADC_BATCHES 次把控制定时器提前到当前时刻。
+ */
+static void
+heater_adc_ready(uint32_t time)
+{
+    if (++s_adc_batches < HEATER_ADC_BATCHES) {
+        return;
+    }
+    
+    /* 关中断: 避免兜底超时在置位后、重排前看到 s_adc_fresh */
+    uint32_t flag = sched_irq_save();
+    s_adc_batches = 0;
+    s_adc_fresh = 1;
+    s_control_timer.waketime = time;
+    sched_add_timer(&s_control_timer);
+    sched_irq_restore(flag);
+}
+#endif
+
 /* ========== 公共函数 ========== */
 
 /**
@@ -394,6 +713,12 @@ heater_init(void)
     /* 配置每个加热器的 ADC 通道和 PWM 输出 */
     for (uint8_t i = 0; i < HEATER_COUNT; i++) {
         uint8_t gpio = get_adc_gpio(s_heater_config[i].adc_channel);
+        uint8_t type = s_heater_config[i].sensor_type;
+        
+        /* 生成用到的热敏电阻查表 */
+        if (!(s_thermistor_lut_ready & (1 << type))) {
+            thermistor_lut_build(type);
+        }
         
         if (gpio != GPIO_INVALID) {
             /* 配置 ADC 通道，使用较长的采样时间以提高精度 */
@@ -405,7 +730,7 @@ heater_init(void)
         pwm_cfg.cycle_time = 1000;      /* 1kHz PWM 频率 */
         pwm_cfg.max_value = 255;        /* 8 位分辨率 */
         pwm_cfg.invert = 0;             /* 不反相 */
-        pwm_cfg.use_hardware = 0;       /* 使用软件 PWM */
+        pwm_cfg.use_hardware = 1;       /* 定时器 PWM，无通道时退回软件 PWM */
         pwm_config(s_heater_pwm_channel[i], &pwm_cfg);
         
         /* 初始化加热器状态 */
@@ -414,11 +739,25 @@ heater_init(void)
         s_heater_state[i].prev_error = 0.0f;
         s_heater_state[i].integral = 0.0f;
         s_heater_state[i].output = 0.0f;
+        s_heater_state[i].pid = s_heater_config[i].pid;
         s_heater_state[i].initialized = 1;
         s_heater_state[i].pwm_enabled = 0;
     }
     
+    s_autotune.state = HEATER_AUTOTUNE_IDLE;
     s_module_initialized = 1;
+    
+    /* 启动控制循环 */
+    s_control_timer.func = heater_control_event;
+#if CONFIG_ADC_SCAN
+    s_adc_batches = 0;
+    s_adc_fresh = 0;
+    s_control_timer.waketime = sched_get_time() + HEATER_WATCHDOG_TICKS;
+    adc_scan_set_callback(heater_adc_ready);
+#else
+    s_control_timer.waketime = sched_get_time() + HEATER_CONTROL_TICKS;
+#endif
+    sched_add_timer(&s_control_timer);
 }
 
 /**
@@ -443,6 +782,14 @@ heater_set_temp(heater_id_t id, float target)
         target = HEATER_TEMP_MAX;
     }
     
+    /* 控制循环在定时器中断中运行，修改状态期间关中断 */
+    uint32_t flag = sched_irq_save();
+    
+    /* 手动设置温度会中断该加热器的自整定 */
+    if (s_autotune.state == HEATER_AUTOTUNE_RUNNING && s_autotune.id == id) {
+        s_autotune.state = HEATER_AUTOTUNE_IDLE;
+    }
+    
     /* 保存旧目标温度 */
     old_target = s_heater_state[id].target_temp;
     
@@ -471,13 +818,18 @@ heater_set_temp(heater_id_t id, float target)
         heater_set_pwm(id, 0.0f);
         pwm_enable(s_heater_pwm_channel[id], 0);
         s_heater_state[id].pwm_enabled = 0;
+        s_active_mask &= ~(1UL << id);
     } else {
+        s_active_mask |= 1UL << id;
+        
         /* 启用 PWM 输出 */
         if (!s_heater_state[id].pwm_enabled) {
             pwm_enable(s_heater_pwm_channel[id], 1);
             s_heater_state[id].pwm_enabled = 1;
         }
     }
+    
+    sched_irq_restore(flag);
 }
 
 /**
@@ -511,7 +863,7 @@ heater_get_temp(heater_id_t id)
     }
     
     /* 使用查表法转换为温度 */
-    float temp = ntc_adc_to_temp(adc_value);
+    float temp = ntc_adc_to_temp(s_heater_config[id].sensor_type, adc_value);
     
     /* 更新当前温度状态 */
     if (temp != HEATER_TEMP_INVALID) {
@@ -564,8 +916,8 @@ heater_is_at_target(heater_id_t id)
 /**
  * @brief   温度控制周期任务
  * 
- * 执行 PID 计算和 PWM 输出更新。
- * 应在主循环中以 100ms 间隔调用。
+ * 执行 PID (或自整定继电器) 计算和 PWM 输出更新。
+ * 由 heater_init() 启动的控制定时器以 PID_DT 为周期调用。
  * 
  * 验收标准: 3.2.1 - 移植 klippy/extras/heaters.py 的 ControlPID 类
  *          3.2.3 - 温度稳定后波动 < ±3°C
@@ -580,8 +932,12 @@ heater_task(void)
         return;
     }
     
-    /* 遍历所有加热器 */
-    for (uint8_t i = 0; i < HEATER_COUNT; i++) {
+    /* 只遍历有目标温度的加热器，空闲加热器的输出已由 heater_set_temp() 关闭 */
+    uint32_t mask = s_active_mask;
+    while (mask) {
+        uint8_t i = (uint8_t)__builtin_ctz(mask);
+        mask &= mask - 1;
+        
         /* 读取当前温度 */
         current_temp = heater_get_temp((heater_id_t)i);
         
@@ -592,16 +948,21 @@ heater_task(void)
             continue;
         }
         
-        /* 如果目标温度为 0，跳过 PID 计算 */
-        if (s_heater_state[i].target_temp <= 0.0f) {
-            s_heater_state[i].output = 0.0f;
-            heater_set_pwm((heater_id_t)i, 0.0f);
+        /* 自整定中: 继电器控制代替 PID */
+        if (s_autotune.state == HEATER_AUTOTUNE_RUNNING && s_autotune.id == i) {
+            output = autotune_update(&s_autotune, current_temp, PID_DT);
+            if (s_autotune.state != HEATER_AUTOTUNE_RUNNING) {
+                heater_set_temp((heater_id_t)i, 0.0f);
+                continue;
+            }
+            s_heater_state[i].output = output;
+            heater_set_pwm((heater_id_t)i, output);
             continue;
         }
         
         /* 执行 PID 计算 */
         output = pid_update(&s_heater_state[i], 
-                           &s_heater_config[i].pid,
+                           &s_heater_state[i].pid,
                            current_temp, 
                            PID_DT);
         
@@ -610,6 +971,122 @@ heater_task(void)
     }
 }
 
+/**
+ * @brief   开始继电器自整定
+ * 
+ * 验收标准: M303 - PID 自整定
+ */
+int
+heater_autotune_start(heater_id_t id, float target, uint8_t cycles)
+{
+    if (id >= HEATER_COUNT || target <= AUTOTUNE_DELTA
+        || target > HEATER_TEMP_MAX) {
+        return -1;
+    }
+    if (!s_module_initialized) {
+        heater_init();
+    }
+    if (s_autotune.state == HEATER_AUTOTUNE_RUNNING) {
+        return -1;
+    }
+    
+    float temp = heater_get_temp(id);
+    if (temp == HEATER_TEMP_INVALID || temp >= target) {
+        return -1;          /* 必须从目标温度以下开始升温 */
+    }
+    
+    if (cycles < AUTOTUNE_CYCLES_MIN) {
+        cycles = AUTOTUNE_CYCLES_MIN;
+    } else if (cycles > AUTOTUNE_CYCLES_MAX) {
+        cycles = AUTOTUNE_CYCLES_MAX;
+    }
+    
+    /* 使能 PWM 并显示目标温度，PID 在整定期间不运行 */
+    heater_set_temp(id, target);
+    
+    uint32_t flag = sched_irq_save();
+    s_autotune.id = (uint8_t)id;
+    s_autotune.heating = 1;
+    s_autotune.peaks_needed = AUTOTUNE_SKIP_PEAKS + 2 * cycles;
+    s_autotune.peak_count = 0;
+    s_autotune.target = target;
+    s_autotune.power = s_heater_config[id].max_power;
+    s_autotune.time = 0.0f;
+    s_autotune.switch_time = 0.0f;
+    s_autotune.peak = temp;
+    s_autotune.peak_time = 0.0f;
+    for (uint8_t i = 0; i < 3; i++) {
+        s_autotune.peak_temps[i] = temp;
+        s_autotune.peak_times[i] = 0.0f;
+    }
+    s_autotune.best_ku = 0.0f;
+    s_autotune.best_tu = 0.0f;
+    s_autotune.state = HEATER_AUTOTUNE_RUNNING;
+    sched_irq_restore(flag);
+    
+    return 0;
+}
+
+/**
+ * @brief   查询自整定状态和结果
+ */
+int
+heater_autotune_status(float *p_kp, float *p_ki, float *p_kd)
+{
+    uint32_t flag = sched_irq_save();
+    int state = s_autotune.state;
+    float ku = s_autotune.best_ku;
+    float tu = s_autotune.best_tu;
+    sched_irq_restore(flag);
+    
+    if (state == HEATER_AUTOTUNE_DONE) {
+        /* Ziegler-Nichols: Kp = 0.6Ku, Ti = Tu/2, Td = Tu/8 */
+        float kp = 0.6f * ku;
+        float ti = 0.5f * tu;
+        float td = 0.125f * tu;
+        if (p_kp != NULL) { *p_kp = kp; }
+        if (p_ki != NULL) { *p_ki = kp / ti; }
+        if (p_kd != NULL) { *p_kd = kp * td; }
+    }
+    
+    return state;
+}
+
+/**
+ * @brief   设置 PID 参数
+ */
+int
+heater_set_pid(heater_id_t id, float kp, float ki, float kd)
+{
+    if (id >= HEATER_COUNT || kp < 0.0f || ki < 0.0f || kd < 0.0f) {
+        return -1;
+    }
+    
+    uint32_t flag = sched_irq_save();
+    s_heater_state[id].pid.kp = kp;
+    s_heater_state[id].pid.ki = ki;
+    s_heater_state[id].pid.kd = kd;
+    s_heater_state[id].integral = 0.0f;
+    s_heater_state[id].prev_error = 0.0f;
+    sched_irq_restore(flag);
+    
+    return 0;
+}
+
+/**
+ * @brief   获取当前 PID 参数
+ */
+int
+heater_get_pid(heater_id_t id, pid_params_t *p_pid)
+{
+    if (id >= HEATER_COUNT || p_pid == NULL) {
+        return -1;
+    }
+    
+    *p_pid = s_heater_state[id].pid;
+    return 0;
+}
+
 /**
  * @brief   获取当前 PID 输出
  * @param   id      加热器 ID
@@ -645,5 +1122,12 @@ heater_reset_for_test(void)
         s_heater_state[i].initialized = 0;
         s_heater_state[i].pwm_enabled = 0;
     }
+    
+    s_autotune.state = HEATER_AUTOTUNE_IDLE;
+    s_active_mask = 0;
+#if CONFIG_ADC_SCAN
+    s_adc_batches = 0;
+    s_adc_fresh = 0;
+#endif
 }
 #endif /* TEST_BUILD */
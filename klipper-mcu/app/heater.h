@@ -14,15 +14,20 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include "config.h"
 
 /* ========== 加热器定义 ========== */
 
+#define HEATER_ID_ENTRY(name, adc_ch, sensor, pin, power, kp, ki, kd) \
+    HEATER_##name,
+
 /**
  * @brief   加热器 ID 枚举
+ * 
+ * 由 config.h 的 HEATER_TABLE 按顺序生成 (HEATER_HOTEND = 0，HEATER_BED)。
  */
 typedef enum {
-    HEATER_HOTEND = 0,          /* 热端 */
-    HEATER_BED,                 /* 热床 */
+    HEATER_TABLE(HEATER_ID_ENTRY)
     HEATER_COUNT
 } heater_id_t;
 
@@ -35,16 +40,36 @@ typedef struct {
     float kd;                   /* 微分系数 */
 } pid_params_t;
 
+/**
+ * @brief   热敏电阻类型
+ */
+typedef enum {
+    THERMISTOR_NTC100K_TABLE = 0,   /* 100K NTC，实测曲线查表 */
+    THERMISTOR_NTC100K_B3950,       /* 100K NTC，Beta=3950 公式 */
+    THERMISTOR_TYPE_COUNT
+} thermistor_type_t;
+
 /**
  * @brief   加热器配置结构体
  */
 typedef struct {
     uint8_t adc_channel;        /* ADC 通道 */
+    uint8_t sensor_type;        /* 热敏电阻类型 (thermistor_type_t) */
     uint8_t pwm_pin;            /* PWM 引脚 */
     float max_power;            /* 最大功率 0-1 */
     pid_params_t pid;           /* PID 参数 */
 } heater_config_t;
 
+/**
+ * @brief   PID 自整定状态
+ */
+typedef enum {
+    HEATER_AUTOTUNE_IDLE = 0,   /* 未运行 (或被 heater_set_temp 中断) */
+    HEATER_AUTOTUNE_RUNNING,    /* 继电器振荡中 */
+    HEATER_AUTOTUNE_DONE,       /* 完成，结果可读 */
+    HEATER_AUTOTUNE_FAILED      /* 过冲、超时或 ADC 停止更新 */
+} heater_autotune_state_t;
+
 /* ========== 温度常量 ========== */
 
 /* 温度范围限制 */
@@ -60,7 +85,7 @@ typedef struct {
 /**
  * @brief   初始化加热器模块
  * 
- * 初始化 ADC 通道用于温度传感器读取。
+ * 初始化 ADC 通道用于温度传感器读取，并启动控制循环定时器。
  * 必须在使用其他加热器函数之前调用。
  */
 void heater_init(void);
@@ -101,11 +126,52 @@ int heater_is_at_target(heater_id_t id);
 /**
  * @brief   温度控制周期任务
  * 
- * 执行 PID 计算和 PWM 输出更新。
- * 应在主循环中以 100ms 间隔调用。
+ * 执行 PID 计算和 PWM 输出更新。由 heater_init() 启动的调度器定时器
+ * 调用: CONFIG_ADC_SCAN 下紧跟 ADC 平均完成，每约
+ * CONFIG_TEMP_UPDATE_INTERVAL 毫秒一次，主循环无需调用。
  */
 void heater_task(void);
 
+/**
+ * @brief   开始 PID 自整定 (M303，继电器法)
+ * @param   id      加热器 ID
+ * @param   target  整定温度 (°C)
+ * @param   cycles  测量的振荡周期数 (限制在 3-20)
+ * @retval  0 已开始
+ * @retval  -1 参数无效、已在整定或当前温度不低于目标
+ * 
+ * 加热器以最大功率在 target 与 target - 5°C 之间开关振荡，结束后
+ * 关闭加热器。结果为本控制器 (输出 0-1) 单位下的 PID 参数，
+ * 不会自动应用。
+ */
+int heater_autotune_start(heater_id_t id, float target, uint8_t cycles);
+
+/**
+ * @brief   查询自整定状态
+ * @param   p_kp    输出 Kp (可为 NULL)，仅 DONE 时写入
+ * @param   p_ki    输出 Ki (可为 NULL)
+ * @param   p_kd    输出 Kd (可为 NULL)
+ * @return  heater_autotune_state_t
+ */
+int heater_autotune_status(float *p_kp, float *p_ki, float *p_kd);
+
+/**
+ * @brief   设置 PID 参数
+ * @param   id      加热器 ID
+ * @retval  0 成功，-1 参数无效
+ * 
+ * 同时清除积分和微分状态。
+ */
+int heater_set_pid(heater_id_t id, float kp, float ki, float kd);
+
+/**
+ * @brief   获取当前 PID 参数
+ * @param   id      加热器 ID
+ * @param   p_pid   输出参数
+ * @retval  0 成功，-1 参数无效
+ */
+int heater_get_pid(heater_id_t id, pid_params_t *p_pid);
+
 /**
  * @brief   获取当前 PID 输出
  * @param   id      加热器 ID
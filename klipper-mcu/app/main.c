@@ -14,6 +14,8 @@
 #include "autoconf.h"
 #include "config.h"
 #include "src/sched.h"
+#include "src/profile.h"
+#include "src/trace.h"
 #include "src/stm32/internal.h"
 #include "src/stm32/serial.h"
 #include "board/irq.h"
@@ -24,9 +26,18 @@
 /* 模块初始化函数 (后续任务实现) */
 extern void gcode_init(void) __attribute__((weak));
 extern void gcode_process(void) __attribute__((weak));
+extern void gcode_respond_task(void) __attribute__((weak));
 extern void toolhead_init(void) __attribute__((weak));
+extern void toolhead_task(void) __attribute__((weak));
 extern void heater_init(void) __attribute__((weak));
 extern void fan_init(void) __attribute__((weak));
+extern int command_init(void) __attribute__((weak));
+extern void command_task(void) __attribute__((weak));
+extern void mcu_link_init(void) __attribute__((weak));
+extern void mcu_link_task(void) __attribute__((weak));
+extern int stepper_init(void) __attribute__((weak));
+extern int sdcard_init(void) __attribute__((weak));
+extern void sdcard_task(void) __attribute__((weak));
 
 /* ========== 私有变量 ========== */
 
@@ -70,25 +81,39 @@ nvic_set_priority(uint8_t irq, uint8_t priority)
 }
 
 /**
- * @brief   清除 NVIC 中断挂起标志
- * @param   irq     中断号
+ * @brief   按优先级规划初始化 NVIC 和系统异常优先级
+ * 
+ * 全部优先级位用作抢占优先级；SysTick 为 IRQ_PRIO_HOUSEKEEPING，
+ * PendSV 和所有外设中断先设为 IRQ_PRIO_LOWEST，由各驱动自行提升。
  */
 void
-nvic_clear_pending(uint8_t irq)
+nvic_priority_init(void)
 {
-    volatile uint32_t* p_icpr = (volatile uint32_t*)(NVIC_ICPR);
-    p_icpr[irq / 32] = (1UL << (irq % 32));
+    volatile uint32_t* p_aircr = (volatile uint32_t*)(SCB_AIRCR);
+    volatile uint32_t* p_shpr3 = (volatile uint32_t*)(SCB_SHPR3);
+    
+    *p_aircr = (*p_aircr & ~(SCB_AIRCR_VECTKEY_MASK | SCB_AIRCR_PRIGROUP_MASK))
+               | SCB_AIRCR_VECTKEY | SCB_AIRCR_PRIGROUP_4;
+    
+    /* SHPR3: [31:24] SysTick，[23:16] PendSV */
+    *p_shpr3 = (*p_shpr3 & 0x0000FFFFUL)
+               | ((uint32_t)IRQ_PRIO_HOUSEKEEPING << 24)
+               | ((uint32_t)IRQ_PRIO_LOWEST << 16);
+    
+    for (int irq = 0; irq < IRQ_COUNT; irq++) {
+        nvic_set_priority((uint8_t)irq, IRQ_PRIO_LOWEST);
+    }
 }
 
 /**
- * @brief   保存中断状态并禁用中断
- * @retval  之前的中断状态
- * @note    供 sched.c 使用
+ * @brief   清除 NVIC 中断挂起标志
+ * @param   irq     中断号
  */
-uint32_t
-irq_save(void)
+void
+nvic_clear_pending(uint8_t irq)
 {
-    return irq_disable();
+    volatile uint32_t* p_icpr = (volatile uint32_t*)(NVIC_ICPR);
+    p_icpr[irq / 32] = (1UL << (irq % 32));
 }
 
 /* ========== 中断向量表 ========== */
@@ -306,21 +331,33 @@ const uint32_t g_vector_table[] = {
 
 /**
  * @brief   初始化 BSS 段 (清零)
+ * 
+ * 包括主 SRAM 的 .bss 和 CCM RAM 的 .ccmbss (__ccmram 数据)。
  */
 static void
 bss_init(void)
 {
     extern uint32_t _sbss;
     extern uint32_t _ebss;
+    extern uint32_t _sccmbss;
+    extern uint32_t _eccmbss;
     
     uint32_t* p_dst = &_sbss;
     while (p_dst < &_ebss) {
         *p_dst++ = 0;
     }
+    
+    p_dst = &_sccmbss;
+    while (p_dst < &_eccmbss) {
+        *p_dst++ = 0;
+    }
 }
 
 /**
  * @brief   初始化 DATA 段 (从 Flash 复制到 RAM)
+ * 
+ * .data 中包含 __ramfunc 代码 (.RamFunc)，复制后即可在 SRAM 中执行；
+ * CCM RAM 的已初始化数据 (.ccmram) 同样在此复制。
  */
 static void
 data_init(void)
@@ -328,6 +365,9 @@ data_init(void)
     extern uint32_t _sidata;
     extern uint32_t _sdata;
     extern uint32_t _edata;
+    extern uint32_t _siccmram;
+    extern uint32_t _sccmram;
+    extern uint32_t _eccmram;
     
     uint32_t* p_src = &_sidata;
     uint32_t* p_dst = &_sdata;
@@ -335,6 +375,12 @@ data_init(void)
     while (p_dst < &_edata) {
         *p_dst++ = *p_src++;
     }
+    
+    p_src = &_siccmram;
+    p_dst = &_sccmram;
+    while (p_dst < &_eccmram) {
+        *p_dst++ = *p_src++;
+    }
 }
 
 /**
@@ -369,6 +415,9 @@ fpu_enable(void)
 int
 board_init(void)
 {
+    /* 中断优先级规划，须在任何中断使能之前 */
+    nvic_priority_init();
+    
     /* 系统初始化 (时钟、GPIO) */
     system_init();
     
@@ -461,8 +510,23 @@ main(void)
     
     /* 调度器初始化 */
     sched_init();
+    profile_init();
     serial_puts("Scheduler initialized.\r\n");
     
+    /* 二进制命令表须先于各模块的命令注册初始化 */
+    if (command_init) {
+        command_init();
+    }
+    trace_init();
+    
+    if (stepper_init) {
+        stepper_init();
+    }
+    
+    if (mcu_link_init) {
+        mcu_link_init();
+    }
+    
     /* 模块初始化 (弱符号，后续任务实现) */
     if (toolhead_init) {
         toolhead_init();
@@ -484,6 +548,11 @@ main(void)
         serial_puts("G-code parser initialized.\r\n");
     }
     
+    /* 没有卡时不报错，插卡后可用 M21 挂载 */
+    if (sdcard_init && sdcard_init() == 0) {
+        serial_puts("SD card mounted.\r\n");
+    }
+    
     /* 系统就绪 */
     s_system_ready = 1;
     serial_puts("\r\nSystem ready. Entering main loop...\r\n");
@@ -491,7 +560,8 @@ main(void)
     
     /* 主循环 */
     for (;;) {
-        /* 调度器主循环 - 处理定时器回调 */
+        /* 调度器主循环 - 轮询模式下处理定时器回调，
+         * CONFIG_SCHED_HW_TIMER 模式下定时器由 TIM5 中断执行 */
         sched_main();
         
         /* 处理 G-code 输入 (弱符号，后续任务实现) */
@@ -499,6 +569,34 @@ main(void)
             gcode_process();
         }
         
+        /* SD 卡作业预读 (无文件时为空操作) */
+        if (sdcard_task) {
+            sdcard_task();
+        }
+        
+        /* 处理二进制消息块 */
+        if (command_task) {
+            command_task();
+        }
+        
+        /* 从 MCU 时钟同步 (未连接链路时为空操作) */
+        if (mcu_link_task) {
+            mcu_link_task();
+        }
+        
+        /* 导出运动轨迹 (未请求 trace_dump 时为空操作) */
+        trace_task();
+        
+        /* 补充步进队列并回收运动段，为延后的命令腾出空间 */
+        if (toolhead_task) {
+            toolhead_task();
+        }
+        
+        /* 渲染并发送排队的 G-code 响应 (只在发送缓冲区有空间时写入) */
+        if (gcode_respond_task) {
+            gcode_respond_task();
+        }
+        
         /* 检查系统是否关闭 */
         if (sched_is_shutdown()) {
             serial_puts("\r\n!!! System shutdown !!!\r\n");
@@ -4,6 +4,11 @@
  * 
  * 用于在 Linux/macOS 上使用 GCC 编译验证代码
  * 不包含 STM32 特有的中断向量表和启动代码
+ *
+ * 用法:
+ *   klipper-mcu-host.elf                   运行 10 次主循环后退出
+ *   klipper-mcu-host.elf --replay <file.gcode> [--trace <steps.bin>]
+ *                                          回放 G-code 并输出步进轨迹和统计
  */
 
 #include <stdio.h>
@@ -12,11 +17,15 @@
 #include <string.h>
 #include <signal.h>
 
+#include "replay_host.h"
+
 /* ========== 外部函数声明 ========== */
 
 extern void gcode_init(void);
 extern void gcode_process(void);
+extern void gcode_respond_task(void);
 extern void toolhead_init(void);
+extern void toolhead_task(void);
 extern void heater_init(void);
 extern void heater_task(void);
 extern void fan_init(void);
@@ -70,9 +79,21 @@ main(int argc, char* argv[])
 {
     int loop_count = 0;
     int max_loops = 10;  /* 默认运行 10 次循环后退出 */
+    const char* replay_path = NULL;
+    const char* trace_path = NULL;
     
-    (void)argc;
-    (void)argv;
+    /* 解析命令行参数 */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--replay file.gcode [--trace steps.bin]]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
     
     /* 设置信号处理 */
     signal(SIGINT, signal_handler);
@@ -98,6 +119,12 @@ main(int argc, char* argv[])
     gcode_init();
     printf("G-code parser initialized.\n");
     
+    /* 回放模式 */
+    if (replay_path != NULL) {
+        printf("\nReplaying %s...\n", replay_path);
+        return (replay_run(replay_path, trace_path) == 0) ? 0 : 1;
+    }
+    
     /* 系统就绪 */
     printf("\nSystem ready. Running %d loop iterations...\n", max_loops);
     printf("ok\n");
@@ -110,9 +137,15 @@ main(int argc, char* argv[])
         /* 处理 G-code 输入 */
         gcode_process();
         
+        /* 运动规划后台任务 */
+        toolhead_task();
+        
         /* 温度控制任务 */
         heater_task();
         
+        /* 发送排队的 G-code 响应 */
+        gcode_respond_task();
+        
         loop_count++;
     }
     
@@ -0,0 +1,599 @@
+/**
+ * @file    replay_host.c
+ * @brief   主机 G-code 回放实现
+ *
+ * 仅用于主机编译 (Makefile.host)，替代 host_stubs.c 中的调度器、步进驱动
+ * 和限位开关桩:
+ * - 调度器: 虚拟时钟，每次 sched_main() 前进 REPLAY_TICK 并执行到期定时器，
+ *   toolhead 的刷新定时器因此与固件一样周期触发
+ * - 步进驱动: 按 src/stepper.c 的规则展开 (interval, count, add) 运动段，
+ *   虚拟时钟走到哪一步就"执行"哪一步，记入统计和轨迹；队列深度与驱动相同
+ * - 限位开关: 归零开始 REPLAY_ENDSTOP_DELAY 后触发，归零流程照常完成
+ *
+ * 回放不运行 heater_task()，统计的主机耗时只包含 G-code 解析和运动规划。
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "replay_host.h"
+#include "gcode.h"
+#include "toolhead.h"
+#include "autoconf.h"
+#include "src/sched.h"
+#include "src/stepper.h"
+#include "src/endstop.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* ========== 回放参数 ========== */
+
+/* 每次 sched_main() 推进的虚拟时间 (1ms) */
+#define REPLAY_TICK             (CONFIG_STEP_TIMER_FREQ / 1000)
+
+/* 等待类命令的虚拟时间上限 (秒)，超过后放弃等待继续回放 */
+#define REPLAY_WAIT_TIMEOUT     60
+
+/* 归零开始到限位触发的虚拟时间 */
+#define REPLAY_ENDSTOP_DELAY    (CONFIG_STEP_TIMER_FREQ / 10)
+
+/* 与 src/stepper.c 的驱动队列一致 */
+#define REPLAY_STEPPER_QUEUE    STEPPER_QUEUE_SIZE
+
+#define REPLAY_MAX_TIMERS       8
+#define REPLAY_ENDSTOP_COUNT    3
+
+/* ========== 私有类型 ========== */
+
+/* 模拟的步进驱动状态和每轴统计 */
+typedef struct {
+    stepper_move_t queue[REPLAY_STEPPER_QUEUE];
+    uint8_t queue_head;
+    uint8_t queue_count;
+    uint32_t count;             /* 当前段剩余步数 */
+    uint32_t interval;
+    int32_t add;
+    int8_t dir;
+    sched_time_t next_step_time;
+    sched_time_t last_step_time;
+
+    uint64_t steps;             /* 已执行步数 */
+    int32_t position;           /* 净步数 (正向 +1) */
+    uint32_t dir_changes;       /* 换向次数 */
+    uint32_t min_interval;      /* 相邻两步的最小间隔 (时钟) */
+    sched_time_t trace_clock;   /* 同轴上一步的时钟 (轨迹差分基准) */
+    uint8_t has_step;
+    int8_t last_dir;
+} replay_stepper_t;
+
+/* 回放统计 */
+typedef struct {
+    uint32_t lines;             /* 读取的行数 */
+    uint32_t commands;          /* 执行的命令数 */
+    uint32_t moves;             /* G0-G3 命令数 */
+    uint32_t errors;            /* 解析或执行失败的行数 */
+    uint32_t stalls;            /* 超过 REPLAY_WAIT_TIMEOUT 的等待 */
+    double host_total;          /* 主机耗时 (秒) */
+    double line_max;            /* 单行最长主机耗时 (秒) */
+    uint32_t line_max_no;       /* 最长耗时所在行号 */
+} replay_stats_t;
+
+/* ========== 私有变量 ========== */
+
+static sched_time_t s_sim_time;
+static uint32_t s_sim_time_high;    /* s_sim_time 的回绕次数 */
+static sched_timer_t *s_sim_timers[REPLAY_MAX_TIMERS];
+
+static replay_stepper_t s_sim_steppers[STEPPER_COUNT];
+static uint32_t s_sim_refill_mask;          /* 降到低水位的电机位图 */
+
+static uint8_t s_endstop_homing;            /* 归零窗口内的限位位图 */
+static sched_time_t s_endstop_trigger[REPLAY_ENDSTOP_COUNT];
+
+static FILE *s_trace;
+static sched_time_t s_start_clock;
+
+/* ========== 轨迹输出 ========== */
+
+static void
+trace_put_u32(uint32_t v)
+{
+    uint8_t buf[4] = { (uint8_t)v, (uint8_t)(v >> 8),
+                       (uint8_t)(v >> 16), (uint8_t)(v >> 24) };
+    fwrite(buf, 1, sizeof(buf), s_trace);
+}
+
+static void
+trace_write_header(void)
+{
+    uint8_t head[4] = { REPLAY_TRACE_VERSION, STEPPER_COUNT, 0, 0 };
+    fwrite(REPLAY_TRACE_MAGIC, 1, 4, s_trace);
+    fwrite(head, 1, sizeof(head), s_trace);
+    trace_put_u32(CONFIG_STEP_TIMER_FREQ);
+    trace_put_u32(s_start_clock);
+}
+
+static void
+trace_write_step(int id, int8_t dir, uint32_t delta)
+{
+    uint8_t buf[6];
+    int len = 0;
+
+    buf[len++] = (uint8_t)(id | (dir < 0 ? REPLAY_TRACE_DIR_BIT : 0));
+    do {
+        uint8_t b = delta & 0x7F;
+        delta >>= 7;
+        buf[len++] = delta ? (uint8_t)(b | 0x80) : b;
+    } while (delta);
+    fwrite(buf, 1, (size_t)len, s_trace);
+}
+
+/* ========== 步进驱动模拟 ========== */
+
+/**
+ * @brief   记录一步
+ */
+static void
+sim_record_step(int id, replay_stepper_t *st)
+{
+    sched_time_t clock = st->next_step_time;
+    uint32_t delta = clock - st->trace_clock;
+
+    if (st->has_step) {
+        if (delta < st->min_interval) {
+            st->min_interval = delta;
+        }
+        if (st->dir != st->last_dir) {
+            st->dir_changes++;
+        }
+    }
+    if (s_trace != NULL) {
+        trace_write_step(id, st->dir, delta);
+    }
+
+    st->trace_clock = clock;
+    st->has_step = 1;
+    st->last_dir = st->dir;
+    st->position += (st->dir >= 0) ? 1 : -1;
+    st->steps++;
+}
+
+/**
+ * @brief   装载下一运动段 (同 src/stepper.c stepper_load_next)
+ * @retval  1 已装载，0 队列为空
+ */
+static int
+sim_load_next(int id, replay_stepper_t *st)
+{
+    const stepper_move_t *move;
+
+    do {
+        if (st->queue_count == 0) {
+            return 0;
+        }
+        move = &st->queue[st->queue_head];
+        st->queue_head = (st->queue_head + 1) % REPLAY_STEPPER_QUEUE;
+        st->queue_count--;
+    } while (move->count == 0);
+
+    if (st->queue_count <= STEPPER_LOW_WATER) {
+        s_sim_refill_mask |= 1u << id;
+    }
+
+    st->dir = (move->dir >= 0) ? 1 : -1;
+    st->interval = move->interval;
+    st->count = move->count;
+    st->add = move->add;
+    st->next_step_time = st->last_step_time + move->interval;
+    return 1;
+}
+
+/**
+ * @brief   执行到期的步进
+ */
+static void
+sim_run_steppers(sched_time_t now)
+{
+    for (int id = 0; id < STEPPER_COUNT; id++) {
+        replay_stepper_t *st = &s_sim_steppers[id];
+
+        while (st->count > 0 && sched_time_diff(st->next_step_time, now) <= 0) {
+            sim_record_step(id, st);
+            st->last_step_time = st->next_step_time;
+            if (--st->count > 0) {
+                st->interval += st->add;
+                st->next_step_time += st->interval;
+            } else {
+                sim_load_next(id, st);
+            }
+        }
+    }
+}
+
+int
+stepper_queue_move(stepper_id_t id, const stepper_move_t *move)
+{
+    if (id >= STEPPER_COUNT || move == NULL) {
+        return -1;
+    }
+
+    replay_stepper_t *st = &s_sim_steppers[id];
+    if (st->queue_count >= REPLAY_STEPPER_QUEUE) {
+        return -2;
+    }
+    st->queue[(st->queue_head + st->queue_count) % REPLAY_STEPPER_QUEUE] = *move;
+    st->queue_count++;
+
+    if (st->count == 0) {
+        sim_load_next(id, st);
+    }
+    return 0;
+}
+
+int
+stepper_queue_want(stepper_id_t id)
+{
+    if (id >= STEPPER_COUNT || s_sim_steppers[id].queue_count >= STEPPER_HIGH_WATER) {
+        return 0;
+    }
+    return STEPPER_HIGH_WATER - s_sim_steppers[id].queue_count;
+}
+
+uint32_t
+stepper_take_refill_mask(void)
+{
+    uint32_t mask = s_sim_refill_mask;
+    s_sim_refill_mask = 0;
+    return mask;
+}
+
+void
+stepper_reset_step_clock(stepper_id_t id, sched_time_t clock)
+{
+    if (id < STEPPER_COUNT) {
+        s_sim_steppers[id].last_step_time = clock;
+    }
+}
+
+int
+stepper_is_moving(stepper_id_t id)
+{
+    if (id >= STEPPER_COUNT) {
+        return 0;
+    }
+    return s_sim_steppers[id].count > 0 || s_sim_steppers[id].queue_count > 0;
+}
+
+void
+stepper_stop(stepper_id_t id)
+{
+    if (id < STEPPER_COUNT) {
+        s_sim_steppers[id].count = 0;
+        s_sim_steppers[id].queue_count = 0;
+    }
+}
+
+void
+stepper_stop_all(void)
+{
+    for (int id = 0; id < STEPPER_COUNT; id++) {
+        stepper_stop((stepper_id_t)id);
+    }
+}
+
+/* ========== 限位开关模拟 ========== */
+
+int
+endstop_is_triggered(endstop_id_t id)
+{
+    if ((unsigned int)id >= REPLAY_ENDSTOP_COUNT ||
+        !(s_endstop_homing & (1u << id))) {
+        return 0;
+    }
+    return sched_time_diff(s_sim_time, s_endstop_trigger[id]) >= 0;
+}
+
+sched_time_t
+endstop_get_trigger_clock(endstop_id_t id)
+{
+    return ((unsigned int)id < REPLAY_ENDSTOP_COUNT) ? s_endstop_trigger[id] : 0;
+}
+
+void
+endstop_home_start(endstop_id_t id)
+{
+    if ((unsigned int)id < REPLAY_ENDSTOP_COUNT) {
+        s_endstop_homing |= (uint8_t)(1u << id);
+        s_endstop_trigger[id] = s_sim_time + REPLAY_ENDSTOP_DELAY;
+    }
+}
+
+void
+endstop_home_end(endstop_id_t id)
+{
+    if ((unsigned int)id < REPLAY_ENDSTOP_COUNT) {
+        s_endstop_homing &= (uint8_t)~(1u << id);
+    }
+}
+
+void
+endstop_set_callback(endstop_id_t id, endstop_callback_fn_t callback, void *arg)
+{
+    /* 触发由 toolhead 的轮询路径检测 */
+    (void)id;
+    (void)callback;
+    (void)arg;
+}
+
+/* ========== 虚拟调度器 ========== */
+
+sched_time_t
+sched_get_time(void)
+{
+    return s_sim_time;
+}
+
+sched_time64_t
+sched_get_time64(void)
+{
+    return ((sched_time64_t)s_sim_time_high << 32) | s_sim_time;
+}
+
+void
+sched_add_timer(sched_timer_t *timer)
+{
+    if (timer->heap_pos == 0) {
+        for (int i = 0; i < REPLAY_MAX_TIMERS; i++) {
+            if (s_sim_timers[i] == NULL) {
+                s_sim_timers[i] = timer;
+                timer->heap_pos = (uint16_t)(i + 1);
+                break;
+            }
+        }
+    }
+}
+
+void
+sched_del_timer(sched_timer_t *timer)
+{
+    if (timer->heap_pos != 0) {
+        s_sim_timers[timer->heap_pos - 1] = NULL;
+        timer->heap_pos = 0;
+    }
+}
+
+/**
+ * @brief   推进虚拟时钟一个 REPLAY_TICK，执行到期的步进和定时器
+ */
+void
+sched_main(void)
+{
+    s_sim_time += REPLAY_TICK;
+    if (s_sim_time < REPLAY_TICK) {
+        s_sim_time_high++;
+    }
+    sim_run_steppers(s_sim_time);
+
+    for (int i = 0; i < REPLAY_MAX_TIMERS; i++) {
+        sched_timer_t *timer = s_sim_timers[i];
+        while (timer != NULL && s_sim_timers[i] == timer &&
+               sched_time_diff(timer->waketime, s_sim_time) <= 0) {
+            sched_time_t next = timer->func(timer->waketime);
+            if (next == 0) {
+                sched_del_timer(timer);
+            } else {
+                timer->waketime = next;
+            }
+        }
+    }
+}
+
+/* ========== 回放 ========== */
+
+static double
+host_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief   主循环空转一次 (虚拟时间前进 REPLAY_TICK)
+ */
+static void
+replay_idle(void)
+{
+    sched_main();
+    toolhead_task();
+}
+
+/**
+ * @brief   空转直到命令可执行
+ * @retval  0 可以执行，-1 超时
+ */
+static int
+replay_wait_can_execute(const gcode_cmd_t *p_cmd)
+{
+    sched_time_t start = s_sim_time;
+
+    while (!gcode_can_execute(p_cmd)) {
+        if (s_sim_time - start >= REPLAY_WAIT_TIMEOUT * CONFIG_STEP_TIMER_FREQ) {
+            return -1;
+        }
+        replay_idle();
+    }
+    return 0;
+}
+
+/**
+ * @brief   空转直到命令完成
+ * @retval  1 完成，0 超时，负数 失败
+ */
+static int
+replay_wait_done(const gcode_cmd_t *p_cmd)
+{
+    sched_time_t start = s_sim_time;
+    int ret;
+
+    while ((ret = gcode_wait_done(p_cmd)) == 0) {
+        if (s_sim_time - start >= REPLAY_WAIT_TIMEOUT * CONFIG_STEP_TIMER_FREQ) {
+            return 0;
+        }
+        replay_idle();
+    }
+    return ret;
+}
+
+/**
+ * @brief   回放一行 G-code
+ */
+static void
+replay_line(const char *line, replay_stats_t *p_stats)
+{
+    gcode_cmd_t cmd;
+    int ret = gcode_parse_line(line, &cmd);
+
+    if (ret == GCODE_ERR_EMPTY || ret == GCODE_ERR_COMMENT) {
+        return;
+    }
+    if (ret != GCODE_OK) {
+        p_stats->errors++;
+        return;
+    }
+
+    if (replay_wait_can_execute(&cmd) != 0) {
+        p_stats->stalls++;
+        return;
+    }
+    if (gcode_execute(&cmd) != GCODE_OK) {
+        p_stats->errors++;
+        return;
+    }
+    p_stats->commands++;
+    if (cmd.cmd == 'G' && cmd.code >= 0 && cmd.code <= 3) {
+        p_stats->moves++;
+    }
+
+    ret = replay_wait_done(&cmd);
+    if (ret == 0) {
+        p_stats->stalls++;
+    } else if (ret < 0) {
+        p_stats->errors++;
+    }
+}
+
+/**
+ * @brief   输出回放统计
+ */
+static void
+replay_report(const replay_stats_t *p_stats)
+{
+    static const char axis_names[] = "XYZE";
+    double sim_time = (double)(s_sim_time - s_start_clock) / CONFIG_STEP_TIMER_FREQ;
+    uint64_t total_steps = 0;
+
+    printf("\n========== Replay statistics ==========\n");
+    printf("lines: %lu  commands: %lu  moves: %lu  errors: %lu  stalls: %lu\n",
+           (unsigned long)p_stats->lines, (unsigned long)p_stats->commands,
+           (unsigned long)p_stats->moves, (unsigned long)p_stats->errors,
+           (unsigned long)p_stats->stalls);
+    printf("simulated time: %.3f s\n", sim_time);
+
+    for (int id = 0; id < STEPPER_COUNT; id++) {
+        const replay_stepper_t *st = &s_sim_steppers[id];
+        char name = (id < (int)sizeof(axis_names) - 1) ? axis_names[id] : '?';
+        total_steps += st->steps;
+        if (st->steps < 2) {
+            printf("axis %c: steps %llu  position %ld\n", name,
+                   (unsigned long long)st->steps, (long)st->position);
+            continue;
+        }
+        printf("axis %c: steps %llu  position %ld  dir changes %lu  "
+               "min interval %lu (%.0f steps/s)\n", name,
+               (unsigned long long)st->steps, (long)st->position,
+               (unsigned long)st->dir_changes, (unsigned long)st->min_interval,
+               (double)CONFIG_STEP_TIMER_FREQ / st->min_interval);
+    }
+
+    printf("host time: %.3f ms total", p_stats->host_total * 1e3);
+    if (p_stats->lines > 0) {
+        printf(", %.2f us/line avg, %.2f us max (line %lu)",
+               p_stats->host_total * 1e6 / p_stats->lines,
+               p_stats->line_max * 1e6, (unsigned long)p_stats->line_max_no);
+    }
+    printf("\n");
+    if (p_stats->host_total > 0.0) {
+        printf("throughput: %.0f steps/s host, %.1fx realtime\n",
+               (double)total_steps / p_stats->host_total,
+               sim_time / p_stats->host_total);
+    }
+}
+
+int
+replay_run(const char *gcode_path, const char *trace_path)
+{
+    char line[CONFIG_GCODE_LINE_SIZE];
+    replay_stats_t stats;
+    FILE *fp = fopen(gcode_path, "r");
+
+    if (fp == NULL) {
+        fprintf(stderr, "replay: cannot open %s\n", gcode_path);
+        return -1;
+    }
+    if (trace_path != NULL) {
+        s_trace = fopen(trace_path, "wb");
+        if (s_trace == NULL) {
+            fprintf(stderr, "replay: cannot create %s\n", trace_path);
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    s_start_clock = s_sim_time;
+    for (int id = 0; id < STEPPER_COUNT; id++) {
+        s_sim_steppers[id].trace_clock = s_start_clock;
+        s_sim_steppers[id].min_interval = UINT32_MAX;
+    }
+    if (s_trace != NULL) {
+        trace_write_header();
+    }
+
+    double start = host_time();
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strlen(line);
+        if (len > 0 && line[len - 1] != '\n' && !feof(fp)) {
+            /* 超长行: 丢弃余下部分，按错误计 */
+            int c;
+            while ((c = fgetc(fp)) != EOF && c != '\n') {
+            }
+            stats.lines++;
+            stats.errors++;
+            continue;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        stats.lines++;
+
+        double t0 = host_time();
+        replay_line(line, &stats);
+        double dt = host_time() - t0;
+        if (dt > stats.line_max) {
+            stats.line_max = dt;
+            stats.line_max_no = stats.lines;
+        }
+    }
+
+    /* 执行完剩余运动 */
+    toolhead_wait_moves();
+    stats.host_total = host_time() - start;
+
+    fclose(fp);
+    if (s_trace != NULL) {
+        fclose(s_trace);
+        s_trace = NULL;
+    }
+
+    replay_report(&stats);
+    return 0;
+}
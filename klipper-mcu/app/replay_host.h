@@ -0,0 +1,42 @@
+/**
+ * @file    replay_host.h
+ * @brief   主机 G-code 回放接口
+ *
+ * 仅用于主机编译 (Makefile.host)。按行读取 .gcode 文件，走与固件相同的
+ * gcode_parse_line → gcode_execute → toolhead → itersolve 路径，
+ * 在虚拟时钟下执行，把每个步进时刻写入二进制轨迹并输出耗时统计，
+ * 用于离线评测规划器和验证优化。
+ *
+ * 轨迹文件格式 (小端):
+ * - 文件头 16 字节:
+ *   magic "KSTP" | version u8 | axis_count u8 | reserved u16 |
+ *   clock_freq u32 (步进时钟 Hz) | start_clock u32 (回放开始时的时钟)
+ * - 之后每步一条记录:
+ *   tag u8 (bit0-6 轴号 STEPPER_*，bit7 置位表示反向) |
+ *   delta varint (LEB128，与同轴上一步的时钟差，首步相对 start_clock)
+ */
+
+#ifndef REPLAY_HOST_H
+#define REPLAY_HOST_H
+
+/* ========== 轨迹格式 ========== */
+
+#define REPLAY_TRACE_MAGIC      "KSTP"
+#define REPLAY_TRACE_VERSION    1
+#define REPLAY_TRACE_DIR_BIT    0x80        /* tag 中的反向标志 */
+
+/* ========== 公有函数声明 ========== */
+
+/**
+ * @brief   回放 G-code 文件
+ * @param   gcode_path  输入 .gcode 文件
+ * @param   trace_path  步进轨迹输出文件，NULL 表示不写轨迹
+ * @retval  0 成功 (统计已输出到 stdout)
+ * @retval  -1 文件无法打开
+ *
+ * 调用前应已完成 toolhead/gcode 等模块初始化。解析或执行失败的行
+ * 计入统计后继续回放；等待类命令 (如 M109) 超过虚拟时间上限后放弃等待。
+ */
+int replay_run(const char *gcode_path, const char *trace_path);
+
+#endif /* REPLAY_HOST_H */
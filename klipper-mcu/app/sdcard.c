@@ -0,0 +1,790 @@
+/**
+ * @file    sdcard.c
+ * @brief   SD 卡作业源实现
+ *
+ * 只读 FAT32: 识别 MBR 分区表或无分区表的卷，扫描根目录的 8.3 短文件名，
+ * 按簇链顺序读取文件。
+ *
+ * 打印时文件内容经 SDIO DMA 读入两个交替使用的流式缓冲区: 一个正在
+ * 被拆成行送进命令队列，另一个同时在后台读取下一段。换簇时读 FAT
+ * 扇区同样是异步的，主循环从不等待卡。SDIO 的 DMA 由外设控制流量，
+ * 不能使用 DMA 硬件双缓冲模式，所以双缓冲由软件轮换。
+ *
+ * 挂载、列目录和选择文件 (M20/M21/M23) 不在打印期间执行，
+ * 使用阻塞读。
+ */
+
+#include "sdcard.h"
+#include "autoconf.h"
+#include "config.h"
+
+#if CONFIG_HAVE_SDCARD
+
+#include "src/stm32/sdio.h"
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+
+/* ========== 私有定义 ========== */
+
+#define SECTOR_SIZE             SDIO_BLOCK_SIZE
+
+/* 单个流式缓冲区的字节数 */
+#define SDCARD_BUFFER_SIZE      (SDCARD_BUFFER_BLOCKS * SECTOR_SIZE)
+
+/* 读扇区失败后的重试次数 */
+#define SDCARD_READ_RETRIES     2
+
+/* FAT32 簇号 */
+#define FAT32_MASK              0x0FFFFFFFUL
+#define FAT32_EOC               0x0FFFFFF8UL    /* >= 为簇链结束 */
+#define FAT32_PER_SECTOR        (SECTOR_SIZE / 4)
+
+/* 目录项 */
+#define DIR_ENTRY_SIZE          32
+#define DIR_FREE                0xE5            /* 已删除 */
+#define DIR_ATTR_VOLUME         0x08            /* 卷标，长文件名项也带此位 */
+#define DIR_ATTR_DIR            0x10            /* 子目录 */
+
+/* 流式缓冲区状态 */
+#define BUF_EMPTY               0
+#define BUF_READY               1
+
+/* 后台读取 */
+#define IO_IDLE                 0
+#define IO_DATA                 1               /* 文件数据读入流式缓冲区 */
+#define IO_FAT                  2               /* FAT 扇区读入扇区缓存 */
+
+/* 无效扇区号 (扇区缓存为空) */
+#define LBA_NONE                0xFFFFFFFFUL
+
+/* 卷参数 */
+typedef struct {
+    uint32_t fat_start;             /* 第一个 FAT 的扇区 */
+    uint32_t data_start;            /* 簇 2 的扇区 */
+    uint32_t root_cluster;          /* 根目录首簇 */
+    uint32_t cluster_count;         /* 数据簇数，用于簇号检查 */
+    uint8_t sec_per_clus;           /* 每簇扇区数 */
+} fat_volume_t;
+
+/* ========== 私有变量 ========== */
+
+static uint8_t s_mounted = 0;
+static fat_volume_t s_vol;
+
+/* M20 扫描结果 */
+static sdcard_entry_t s_list[SDCARD_LIST_MAX];
+static int s_list_count = 0;
+
+/* 选择的文件 */
+static sdcard_entry_t s_file;
+static uint32_t s_file_cluster = 0;     /* 首簇 */
+static uint8_t s_file_open = 0;
+static uint8_t s_printing = 0;
+
+/* 预读进度 */
+static uint32_t s_read_cluster = 0;     /* 下一次读取所在的簇 */
+static uint8_t s_read_sector = 0;       /* 簇内扇区 */
+static uint32_t s_read_pos = 0;         /* 已发起读取的文件字节数 */
+static uint32_t s_consume_pos = 0;      /* 已拆成行的文件字节数 */
+
+/* 流式缓冲区 (DMA 目标，必须在主 SRAM) */
+static uint32_t s_buf[2][SDCARD_BUFFER_SIZE / sizeof(uint32_t)];
+static uint16_t s_buf_len[2];           /* 有效字节数 */
+static uint8_t s_buf_state[2];          /* BUF_* */
+static uint16_t s_buf_pos = 0;          /* 正在拆行的缓冲区的读偏移 */
+static uint8_t s_buf_consume = 0;       /* 正在拆行的缓冲区 */
+static uint8_t s_buf_fill = 0;          /* 下一个要读入的缓冲区 */
+
+/* 后台读取状态 */
+static uint8_t s_io = IO_IDLE;
+static uint8_t s_io_count = 0;          /* IO_DATA 的扇区数 */
+static uint8_t s_io_retries = 0;
+static uint32_t s_io_lba = 0;           /* IO_FAT 的扇区号 */
+static int8_t s_io_error = 0;           /* 作业中止原因，0 为正常 */
+
+/* 扇区缓存: FAT 查找和目录扫描共用 */
+static uint32_t s_sector[SECTOR_SIZE / sizeof(uint32_t)];
+static uint32_t s_sector_lba = LBA_NONE;
+
+/* 行组装 */
+static char s_line[CONFIG_GCODE_LINE_SIZE];
+static uint16_t s_line_len = 0;
+static uint8_t s_line_ready = 0;
+static uint8_t s_line_overflow = 0;
+
+/* ========== 私有函数 ========== */
+
+/**
+ * @brief   读小端 16 位
+ */
+static uint16_t
+rd16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/**
+ * @brief   读小端 32 位
+ */
+static uint32_t
+rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+           | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * @brief   簇号转扇区号
+ */
+static uint32_t
+cluster_lba(uint32_t cluster)
+{
+    return s_vol.data_start + (cluster - 2) * s_vol.sec_per_clus;
+}
+
+/**
+ * @brief   簇号是否指向数据区
+ */
+static int
+cluster_valid(uint32_t cluster)
+{
+    return (cluster >= 2) && (cluster < s_vol.cluster_count + 2);
+}
+
+/**
+ * @brief   SDIO 返回值转换
+ */
+static int
+sdio_error(int ret)
+{
+    return (ret == SDIO_ERR_NO_CARD) ? SDCARD_ERR_NO_CARD : SDCARD_ERR_IO;
+}
+
+/**
+ * @brief   阻塞读一个扇区到扇区缓存
+ * @param   lba     扇区号
+ * @retval  SDCARD_OK 成功，负数 失败
+ */
+static int
+sector_read(uint32_t lba)
+{
+    if (lba == s_sector_lba) {
+        return SDCARD_OK;
+    }
+    
+    s_sector_lba = LBA_NONE;
+    int ret = SDIO_OK;
+    for (int i = 0; i <= SDCARD_READ_RETRIES; i++) {
+        ret = sdio_read(lba, s_sector, 1);
+        if (ret == SDIO_OK) {
+            s_sector_lba = lba;
+            return SDCARD_OK;
+        }
+    }
+    return sdio_error(ret);
+}
+
+/**
+ * @brief   阻塞查找下一簇
+ * @param   cluster 当前簇
+ * @param   p_next  输出: 下一簇 (>= FAT32_EOC 为结束)
+ * @retval  SDCARD_OK 成功，负数 失败
+ */
+static int
+fat_next(uint32_t cluster, uint32_t *p_next)
+{
+    int ret = sector_read(s_vol.fat_start + cluster / FAT32_PER_SECTOR);
+    if (ret != SDCARD_OK) {
+        return ret;
+    }
+    *p_next = rd32((const uint8_t *)s_sector
+                   + (cluster % FAT32_PER_SECTOR) * 4) & FAT32_MASK;
+    return SDCARD_OK;
+}
+
+/**
+ * @brief   扇区缓存中是否为 FAT32 引导扇区
+ */
+static int
+is_fat32_vbr(const uint8_t *p)
+{
+    uint8_t spc = p[0x0D];
+    
+    return (p[0] == 0xEB || p[0] == 0xE9)
+           && rd16(p + 0x0B) == SECTOR_SIZE
+           && spc != 0 && (spc & (spc - 1)) == 0
+           && p[0x10] != 0                      /* FAT 个数 */
+           && rd16(p + 0x16) == 0               /* FAT12/16 的 FAT 扇区数 */
+           && rd32(p + 0x24) != 0;              /* FAT32 的 FAT 扇区数 */
+}
+
+/**
+ * @brief   目录项转 "NAME.EXT"
+ * @param   ent     32 字节目录项
+ * @param   name    输出，SDCARD_NAME_SIZE 字节
+ */
+static void
+entry_name(const uint8_t *ent, char *name)
+{
+    int n = 0;
+    
+    for (int i = 0; i < 8 && ent[i] != ' '; i++) {
+        name[n++] = (char)ent[i];
+    }
+    if (ent[8] != ' ') {
+        name[n++] = '.';
+        for (int i = 8; i < 11 && ent[i] != ' '; i++) {
+            name[n++] = (char)ent[i];
+        }
+    }
+    name[n] = '\0';
+    
+    /* 0x05 代表首字节 0xE5 */
+    if ((uint8_t)name[0] == 0x05) {
+        name[0] = (char)0xE5;
+    }
+}
+
+/* 目录扫描回调: 返回非 0 停止扫描 */
+typedef int (*dir_fn_t)(const uint8_t *ent, void *arg);
+
+/**
+ * @brief   遍历根目录中的文件 (跳过子目录、卷标和长文件名项)
+ * @param   fn      回调
+ * @param   arg     回调参数
+ * @retval  SDCARD_OK 成功，负数 失败
+ */
+static int
+dir_scan(dir_fn_t fn, void *arg)
+{
+    uint32_t cluster = s_vol.root_cluster;
+    uint32_t hops = 0;
+    
+    while (cluster < FAT32_EOC) {
+        if (!cluster_valid(cluster) || ++hops > s_vol.cluster_count) {
+            return SDCARD_ERR_FS;
+        }
+        
+        for (uint8_t sec = 0; sec < s_vol.sec_per_clus; sec++) {
+            int ret = sector_read(cluster_lba(cluster) + sec);
+            if (ret != SDCARD_OK) {
+                return ret;
+            }
+            
+            for (int i = 0; i < SECTOR_SIZE; i += DIR_ENTRY_SIZE) {
+                const uint8_t *ent = (const uint8_t *)s_sector + i;
+                if (ent[0] == 0x00) {
+                    return SDCARD_OK;   /* 目录结束 */
+                }
+                if (ent[0] == DIR_FREE
+                    || (ent[11] & (DIR_ATTR_VOLUME | DIR_ATTR_DIR))) {
+                    continue;
+                }
+                if (fn(ent, arg)) {
+                    return SDCARD_OK;
+                }
+            }
+        }
+        
+        int ret = fat_next(cluster, &cluster);
+        if (ret != SDCARD_OK) {
+            return ret;
+        }
+    }
+    return SDCARD_OK;
+}
+
+/**
+ * @brief   M20 扫描回调: 加入文件表
+ */
+static int
+list_add(const uint8_t *ent, void *arg)
+{
+    (void)arg;
+    
+    sdcard_entry_t *p_ent = &s_list[s_list_count++];
+    entry_name(ent, p_ent->name);
+    p_ent->size = rd32(ent + 28);
+    return s_list_count >= SDCARD_LIST_MAX;
+}
+
+/* M23 查找参数 */
+typedef struct {
+    const char *name;
+    uint8_t found;
+} dir_find_t;
+
+/**
+ * @brief   M23 扫描回调: 按名字查找 (不区分大小写)
+ */
+static int
+find_match(const uint8_t *ent, void *arg)
+{
+    dir_find_t *p_find = (dir_find_t *)arg;
+    char name[SDCARD_NAME_SIZE];
+    
+    entry_name(ent, name);
+    for (int i = 0; ; i++) {
+        if (toupper((unsigned char)name[i])
+            != toupper((unsigned char)p_find->name[i])) {
+            return 0;
+        }
+        if (name[i] == '\0') {
+            break;
+        }
+    }
+    
+    memcpy(s_file.name, name, sizeof(s_file.name));
+    s_file.size = rd32(ent + 28);
+    s_file_cluster = ((uint32_t)rd16(ent + 20) << 16) | rd16(ent + 26);
+    p_find->found = 1;
+    return 1;
+}
+
+/**
+ * @brief   推进后台读取: 收取已完成的读取，缓冲区有空时发起下一次
+ */
+static void
+io_advance(void)
+{
+    if (s_io != IO_IDLE) {
+        int ret = sdio_read_poll();
+        if (ret == SDIO_BUSY) {
+            return;
+        }
+        
+        uint8_t io = s_io;
+        s_io = IO_IDLE;
+        if (ret != SDIO_OK) {
+            /* 预读进度未推进，下面重新发起同一次读取 */
+            if (++s_io_retries > SDCARD_READ_RETRIES) {
+                s_io_error = (int8_t)sdio_error(ret);
+                return;
+            }
+        } else if (io == IO_FAT) {
+            s_io_retries = 0;
+            s_sector_lba = s_io_lba;
+        } else {
+            s_io_retries = 0;
+            uint32_t len = (uint32_t)s_io_count * SECTOR_SIZE;
+            if (len > s_file.size - s_read_pos) {
+                len = s_file.size - s_read_pos;
+            }
+            s_buf_len[s_buf_fill] = (uint16_t)len;
+            s_buf_state[s_buf_fill] = BUF_READY;
+            s_buf_fill ^= 1;
+            s_read_pos += len;
+            s_read_sector += s_io_count;
+        }
+    }
+    
+    if (s_io_error != 0 || !s_file_open || s_read_pos >= s_file.size
+        || s_buf_state[s_buf_fill] != BUF_EMPTY) {
+        return;
+    }
+    
+    /* 当前簇读完: 查 FAT 取下一簇，FAT 扇区不在缓存时先异步读入 */
+    if (s_read_sector >= s_vol.sec_per_clus) {
+        uint32_t lba = s_vol.fat_start + s_read_cluster / FAT32_PER_SECTOR;
+        if (lba != s_sector_lba) {
+            s_sector_lba = LBA_NONE;
+            s_io_lba = lba;
+            if (sdio_read_start(lba, s_sector, 1) == SDIO_OK) {
+                s_io = IO_FAT;
+            } else if (++s_io_retries > SDCARD_READ_RETRIES) {
+                s_io_error = SDCARD_ERR_IO;
+            }
+            return;
+        }
+        
+        uint32_t next = rd32((const uint8_t *)s_sector
+                             + (s_read_cluster % FAT32_PER_SECTOR) * 4)
+                        & FAT32_MASK;
+        if (!cluster_valid(next)) {
+            s_io_error = SDCARD_ERR_FS;   /* 簇链比文件长度短 */
+            return;
+        }
+        s_read_cluster = next;
+        s_read_sector = 0;
+    }
+    
+    /* 不跨簇，不超过文件末尾 */
+    uint32_t count = s_vol.sec_per_clus - s_read_sector;
+    uint32_t left = (s_file.size - s_read_pos + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    if (count > SDCARD_BUFFER_BLOCKS) {
+        count = SDCARD_BUFFER_BLOCKS;
+    }
+    if (count > left) {
+        count = left;
+    }
+    
+    s_io_count = (uint8_t)count;
+    if (sdio_read_start(cluster_lba(s_read_cluster) + s_read_sector,
+                        s_buf[s_buf_fill], count) == SDIO_OK) {
+        s_io = IO_DATA;
+    } else if (++s_io_retries > SDCARD_READ_RETRIES) {
+        s_io_error = SDCARD_ERR_IO;
+    }
+}
+
+/**
+ * @brief   等待进行中的后台读取结束 (阻塞操作前调用)
+ */
+static void
+io_wait(void)
+{
+    while (s_io != IO_IDLE) {
+        int ret = sdio_read_poll();
+        if (ret != SDIO_BUSY) {
+            s_io = IO_IDLE;
+            s_sector_lba = LBA_NONE;
+        }
+    }
+}
+
+/**
+ * @brief   从文件开头重新预读
+ */
+static void
+stream_reset(void)
+{
+    io_wait();
+    
+    s_read_cluster = s_file_cluster;
+    s_read_sector = 0;
+    s_read_pos = 0;
+    s_consume_pos = 0;
+    s_buf_state[0] = BUF_EMPTY;
+    s_buf_state[1] = BUF_EMPTY;
+    s_buf_pos = 0;
+    s_buf_consume = 0;
+    s_buf_fill = 0;
+    s_io_retries = 0;
+    s_io_error = 0;
+    s_line_len = 0;
+    s_line_ready = 0;
+    s_line_overflow = 0;
+    
+    /* 空文件没有簇 */
+    if (s_file.size > 0 && !cluster_valid(s_file_cluster)) {
+        s_io_error = SDCARD_ERR_FS;
+    }
+}
+
+/**
+ * @brief   结束当前行 (过长的行整行丢弃)
+ */
+static void
+line_finish(void)
+{
+    if (s_line_overflow) {
+        s_line_overflow = 0;
+        s_line_len = 0;
+        return;
+    }
+    s_line[s_line_len] = '\0';
+    s_line_ready = 1;
+}
+
+/**
+ * @brief   从流式缓冲区拆出下一行
+ */
+static void
+line_assemble(void)
+{
+    while (!s_line_ready) {
+        uint8_t b = s_buf_consume;
+        if (s_buf_state[b] != BUF_READY) {
+            /* 文件末尾没有换行符的最后一行 */
+            if (s_consume_pos >= s_file.size && s_line_len > 0) {
+                line_finish();
+                s_line_len = 0;
+            }
+            return;
+        }
+        
+        const char *p = (const char *)s_buf[b];
+        while (s_buf_pos < s_buf_len[b]) {
+            char c = p[s_buf_pos++];
+            s_consume_pos++;
+            if (c == '\n') {
+                line_finish();
+                break;
+            }
+            if (c == '\r') {
+                continue;
+            }
+            if (s_line_len < sizeof(s_line) - 1) {
+                s_line[s_line_len++] = c;
+            } else {
+                s_line_overflow = 1;
+            }
+        }
+        
+        /* 缓冲区用完立即交给后台重新读入 */
+        if (s_buf_pos >= s_buf_len[b]) {
+            s_buf_state[b] = BUF_EMPTY;
+            s_buf_pos = 0;
+            s_buf_consume ^= 1;
+            io_advance();
+        }
+    }
+}
+
+/* ========== 公有函数实现 ========== */
+
+/**
+ * @brief   初始化 SD 卡模块并尝试挂载
+ */
+int
+sdcard_init(void)
+{
+    s_mounted = 0;
+    s_file_open = 0;
+    s_printing = 0;
+    s_list_count = 0;
+    
+    return sdcard_mount();
+}
+
+/**
+ * @brief   后台任务: 推进异步扇区读取
+ */
+void
+sdcard_task(void)
+{
+    if (s_file_open) {
+        io_advance();
+    }
+}
+
+/**
+ * @brief   重新识别卡并挂载 FAT32 卷
+ */
+int
+sdcard_mount(void)
+{
+    if (s_printing) {
+        return SDCARD_ERR_STATE;
+    }
+    
+    io_wait();
+    s_mounted = 0;
+    s_file_open = 0;
+    s_list_count = 0;
+    s_sector_lba = LBA_NONE;
+    
+    int ret = sdio_init();
+    if (ret != SDIO_OK) {
+        return sdio_error(ret);
+    }
+    
+    /* 扇区 0: 无分区表的卷直接是引导扇区，否则取第一个 FAT32 分区 */
+    uint32_t part = 0;
+    const uint8_t *p = (const uint8_t *)s_sector;
+    ret = sector_read(0);
+    if (ret != SDCARD_OK) {
+        return ret;
+    }
+    if (rd16(p + 510) != 0xAA55) {
+        return SDCARD_ERR_FS;
+    }
+    if (!is_fat32_vbr(p)) {
+        uint8_t type = p[0x1BE + 4];
+        if (type != 0x0B && type != 0x0C) {
+            return SDCARD_ERR_FS;
+        }
+        part = rd32(p + 0x1BE + 8);
+        ret = sector_read(part);
+        if (ret != SDCARD_OK) {
+            return ret;
+        }
+        if (rd16(p + 510) != 0xAA55 || !is_fat32_vbr(p)) {
+            return SDCARD_ERR_FS;
+        }
+    }
+    
+    uint32_t fat_size = rd32(p + 0x24);
+    uint32_t total = rd16(p + 0x13) ? rd16(p + 0x13) : rd32(p + 0x20);
+    s_vol.sec_per_clus = p[0x0D];
+    s_vol.fat_start = part + rd16(p + 0x0E);
+    s_vol.data_start = s_vol.fat_start + p[0x10] * fat_size;
+    s_vol.root_cluster = rd32(p + 0x2C);
+    if (total <= s_vol.data_start - part) {
+        return SDCARD_ERR_FS;
+    }
+    s_vol.cluster_count = (total - (s_vol.data_start - part)) / s_vol.sec_per_clus;
+    if (!cluster_valid(s_vol.root_cluster)) {
+        return SDCARD_ERR_FS;
+    }
+    
+    s_mounted = 1;
+    return SDCARD_OK;
+}
+
+/**
+ * @brief   扫描根目录
+ */
+int
+sdcard_list(void)
+{
+    if (!s_mounted) {
+        return SDCARD_ERR_NO_CARD;
+    }
+    if (s_printing) {
+        return SDCARD_ERR_STATE;
+    }
+    
+    io_wait();
+    s_list_count = 0;
+    int ret = dir_scan(list_add, NULL);
+    return (ret == SDCARD_OK) ? s_list_count : ret;
+}
+
+/**
+ * @brief   读取扫描结果
+ */
+const sdcard_entry_t *
+sdcard_list_entry(int idx)
+{
+    if (idx < 0 || idx >= s_list_count) {
+        return NULL;
+    }
+    return &s_list[idx];
+}
+
+/**
+ * @brief   选择要打印的文件
+ */
+int
+sdcard_open(const char *name)
+{
+    if (!s_mounted) {
+        return SDCARD_ERR_NO_CARD;
+    }
+    if (s_printing) {
+        return SDCARD_ERR_STATE;
+    }
+    if (name == NULL || name[0] == '\0') {
+        return SDCARD_ERR_NOT_FOUND;
+    }
+    
+    io_wait();
+    s_file_open = 0;
+    
+    dir_find_t find = { name, 0 };
+    int ret = dir_scan(find_match, &find);
+    if (ret != SDCARD_OK) {
+        return ret;
+    }
+    if (!find.found) {
+        return SDCARD_ERR_NOT_FOUND;
+    }
+    
+    stream_reset();
+    s_file_open = 1;
+    return SDCARD_OK;
+}
+
+/**
+ * @brief   当前选择的文件
+ */
+const sdcard_entry_t *
+sdcard_file(void)
+{
+    return s_file_open ? &s_file : NULL;
+}
+
+/**
+ * @brief   开始或继续打印
+ */
+int
+sdcard_start(void)
+{
+    if (!s_file_open) {
+        return SDCARD_ERR_STATE;
+    }
+    
+    /* 上一次作业已读完: 从头开始 */
+    if (s_consume_pos >= s_file.size && !s_line_ready && s_line_len == 0) {
+        stream_reset();
+    }
+    
+    /* 读取失败中止的作业: 预读进度未推进，从失败处重试 */
+    s_io_error = 0;
+    s_io_retries = 0;
+    
+    s_printing = 1;
+    io_advance();
+    return SDCARD_OK;
+}
+
+/**
+ * @brief   暂停打印
+ */
+void
+sdcard_pause(void)
+{
+    s_printing = 0;
+}
+
+/**
+ * @brief   是否正在打印
+ */
+int
+sdcard_is_printing(void)
+{
+    return s_printing;
+}
+
+/**
+ * @brief   已送出的文件字节数
+ */
+uint32_t
+sdcard_get_position(void)
+{
+    return s_consume_pos;
+}
+
+/**
+ * @brief   取下一行
+ */
+int
+sdcard_line_peek(const char **p_line)
+{
+    if (!s_printing) {
+        return SDCARD_ERR_STATE;
+    }
+    
+    if (!s_line_ready) {
+        io_advance();
+        line_assemble();
+    }
+    if (s_line_ready) {
+        *p_line = s_line;
+        return SDCARD_OK;
+    }
+    
+    if (s_io_error != 0) {
+        s_printing = 0;
+        return s_io_error;
+    }
+    if (s_consume_pos >= s_file.size) {
+        s_printing = 0;
+        return SDCARD_EOF;
+    }
+    return SDCARD_BUSY;
+}
+
+/**
+ * @brief   归还 sdcard_line_peek() 取得的行
+ */
+void
+sdcard_line_release(void)
+{
+    s_line_ready = 0;
+    s_line_len = 0;
+}
+
+#endif /* CONFIG_HAVE_SDCARD */
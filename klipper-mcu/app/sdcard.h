@@ -0,0 +1,145 @@
+/**
+ * @file    sdcard.h
+ * @brief   SD 卡作业源接口
+ *
+ * 从 SDIO 接口的 SD 卡读取 G-code 文件，按行交给 gcode.c 的命令队列，
+ * 与串口行走同一解析和执行路径。作业完全在 MCU 上运行，不受串口
+ * 链路带宽限制，上位机重启也不会中断打印。
+ *
+ * 文件系统只读、只支持 FAT32 根目录下的 8.3 短文件名。
+ * 对应的 G-code: M20 列表、M21 挂载、M23 选择、M24 开始/继续、
+ * M25 暂停、M27 进度。
+ */
+
+#ifndef SDCARD_H
+#define SDCARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* ========== 返回值定义 ========== */
+
+#define SDCARD_OK               0       /* 成功 / 行已就绪 */
+#define SDCARD_BUSY             1       /* 行未就绪，数据读取中 */
+#define SDCARD_EOF              2       /* 文件已读完，作业结束 */
+#define SDCARD_ERR_NO_CARD      (-1)    /* 没有卡或卡无响应 */
+#define SDCARD_ERR_IO           (-2)    /* 读扇区失败 */
+#define SDCARD_ERR_FS           (-3)    /* 不是 FAT32 或文件系统损坏 */
+#define SDCARD_ERR_NOT_FOUND    (-4)    /* 文件不存在 */
+#define SDCARD_ERR_STATE        (-5)    /* 未挂载、未选择文件或作业进行中 */
+
+/* 8.3 文件名长度 (含 '.' 和结尾 '\0') */
+#define SDCARD_NAME_SIZE        13
+
+/* 文件信息 */
+typedef struct {
+    char name[SDCARD_NAME_SIZE];    /* "NAME.EXT" */
+    uint32_t size;                  /* 字节数 */
+} sdcard_entry_t;
+
+/* ========== 公有函数声明 ========== */
+
+/**
+ * @brief   初始化 SD 卡模块并尝试挂载
+ * @retval  SDCARD_OK 已挂载，负数 没有可用的卡 (之后可用 M21 重试)
+ */
+int sdcard_init(void);
+
+/**
+ * @brief   后台任务: 推进异步扇区读取
+ *
+ * 在主循环中调用，保持两个流式缓冲区预读满。
+ */
+void sdcard_task(void);
+
+/**
+ * @brief   重新识别卡并挂载 FAT32 卷 (M21)
+ * @retval  SDCARD_OK 成功，负数 失败
+ *
+ * 会关闭已选择的文件。作业进行中返回 SDCARD_ERR_STATE。
+ */
+int sdcard_mount(void);
+
+/**
+ * @brief   扫描根目录 (M20)
+ * @retval  文件数 (最多 SDCARD_LIST_MAX)，负数 失败
+ *
+ * 结果保存在模块内的静态表中，由 sdcard_list_entry() 读取，
+ * 直到下一次扫描前保持不变。
+ */
+int sdcard_list(void);
+
+/**
+ * @brief   读取扫描结果
+ * @param   idx     序号 (0 到 sdcard_list() 返回值 - 1)
+ * @retval  文件信息，越界返回 NULL
+ */
+const sdcard_entry_t *sdcard_list_entry(int idx);
+
+/**
+ * @brief   选择要打印的文件 (M23)
+ * @param   name    8.3 文件名，不区分大小写
+ * @retval  SDCARD_OK 成功，负数 失败
+ *
+ * 从文件开头开始预读。作业进行中返回 SDCARD_ERR_STATE。
+ */
+int sdcard_open(const char *name);
+
+/**
+ * @brief   当前选择的文件
+ * @retval  文件信息 (静态存储)，未选择返回 NULL
+ */
+const sdcard_entry_t *sdcard_file(void);
+
+/**
+ * @brief   开始或继续打印 (M24)
+ * @retval  SDCARD_OK 成功，SDCARD_ERR_STATE 未选择文件
+ *
+ * 上一次作业已读完时从文件开头重新开始。
+ */
+int sdcard_start(void);
+
+/**
+ * @brief   暂停打印 (M25)
+ *
+ * 停止向命令队列送行，已入队的命令照常执行。
+ */
+void sdcard_pause(void);
+
+/**
+ * @brief   是否正在打印
+ * @retval  1 是，0 否
+ */
+int sdcard_is_printing(void);
+
+/**
+ * @brief   已送出的文件字节数 (M27)
+ * @retval  文件内偏移
+ */
+uint32_t sdcard_get_position(void);
+
+/**
+ * @brief   取下一行 (原地访问，不拷贝)
+ * @param   p_line  输出: 以 '\0' 结尾的行，不含换行符
+ * @retval  SDCARD_OK 行已就绪，用完后调用 sdcard_line_release()
+ * @retval  SDCARD_BUSY 数据读取中，稍后重试
+ * @retval  SDCARD_EOF 文件读完，作业结束 (只返回一次)
+ * @retval  负数 读取失败，作业中止 (只返回一次)
+ *
+ * 超过 CONFIG_GCODE_LINE_SIZE 的行整行丢弃。
+ */
+int sdcard_line_peek(const char **p_line);
+
+/**
+ * @brief   归还 sdcard_line_peek() 取得的行
+ */
+void sdcard_line_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDCARD_H */
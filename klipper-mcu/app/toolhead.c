@@ -15,19 +15,30 @@
  */
 
 #include "toolhead.h"
+#include "autoconf.h"
 #include "config.h"
 #include "chelper/trapq.h"
+#include "chelper/mem_pool.h"
 #include "chelper/itersolve.h"
+#include "chelper/kin_cartesian.h"
+#include "chelper/kin_corexy.h"
+#include "chelper/kin_delta.h"
+#include "chelper/kin_shaper.h"
+#include "chelper/kin_extruder.h"
+#include "chelper/stepcompress.h"
 #include "src/endstop.h"
 #include "src/stepper.h"
 #include "src/sched.h"
+#include "src/profile.h"
+#include "src/trace.h"
+#include "board/misc.h"
 #include <string.h>
 #include <math.h>
 
 /* ========== 常量定义 ========== */
 
 /** 最小运动距离 (mm) */
-#define MIN_MOVE_DISTANCE       0.000001
+#define MIN_MOVE_DISTANCE       MOTION_C(0.000001)
 
 /** 最小运动时间 (秒) */
 #define MIN_MOVE_TIME           0.000001
@@ -35,38 +46,147 @@
 /** 归零速度 (mm/s) */
 #define HOMING_SPEED            10.0
 
+/** 二次慢速归零速度 (mm/s) */
+#define HOMING_SLOW_SPEED       2.5
+
 /** 归零回退距离 (mm) */
 #define HOMING_RETRACT          5.0
 
+/** 快速归零越过行程端点的距离 (mm) */
+#define HOMING_OVERTRAVEL       10.0
+
 /** 归零超时 (秒) */
 #define HOMING_TIMEOUT          30.0
 
-/** 前瞻队列大小 */
-#define LOOKAHEAD_SIZE          16
+/** 累计这么长的运动时间后才进行一次惰性规划 (秒) */
+#define LOOKAHEAD_FLUSH_TIME    MOTION_C(0.25)
+
+/** 队列满且无法确定任何运动时保留的运动段数 */
+#define LOOKAHEAD_KEEP          2
 
 /** 轴数量 */
 #define NUM_AXES                4
 
+/** 可输入整形的轴数量 (X, Y) */
+#define NUM_SHAPER_AXES         2
+
+/** 挤出机轴索引 */
+#define AXIS_E                  3
+
+/** 步进时钟频率 (Hz)，与 sched_get_time() 计数单位一致 */
+#define STEP_CLOCK_FREQ         CONFIG_STEP_TIMER_FREQ
+
+/** 空闲后首段运动的调度提前量 (秒) */
+#define MOVE_LEAD_TIME          0.1
+
+/** 定时刷新周期 (系统时钟) */
+#define MOVE_FLUSH_TICKS        ((sched_time_t)(MOVE_FLUSH_PERIOD * STEP_CLOCK_FREQ))
+
+/** trapq 满时等待步进执行释放运动段的最大轮询次数 */
+#define MOVE_RECLAIM_TRIES      100000
+
+/** 圆周率 */
+#define ARC_PI                  3.14159265358979323846
+
+/** 判定起点与终点同角度 (整圆) 的角度容差 (弧度) */
+#define ARC_ANGLE_EPSILON       0.000001
+
+/** 允许的最小圆弧半径 (mm) */
+#define ARC_MIN_RADIUS          0.001
+
+/** 速度倍率 (M220) 允许范围 */
+#define SPEED_FACTOR_MIN        0.01f
+#define SPEED_FACTOR_MAX        10.0f
+
 /* ========== 私有类型定义 ========== */
 
 /**
- * @brief   前瞻运动段
+ * @brief   前瞻队列 (结构数组环形缓冲)
+ * 
+ * 规划的反向遍历只读写速度平方相关的数组，连续存放以减少访存；
+ * 位置和方向只在入队和提交时使用。方向和与前一段的夹角余弦
+ * 在入队时计算一次。速度和加速度限制随运动段保存，修改配置时
+ * 只重算尚未确定的运动段 (见 lookahead_replan())。
+ */
+typedef struct {
+    /* 规划输入 (速度平方) */
+    motion_t max_cruise_v2[LOOKAHEAD_SIZE];     /* 最大巡航速度平方 */
+    motion_t max_start_v2[LOOKAHEAD_SIZE];      /* 结点限制的最大起始速度平方 */
+    motion_t max_smoothed_v2[LOOKAHEAD_SIZE];   /* 平滑加速度下的最大起始速度平方 */
+    motion_t delta_v2[LOOKAHEAD_SIZE];          /* 全程加速的速度平方增量 2*a*d */
+    motion_t smooth_delta_v2[LOOKAHEAD_SIZE];   /* 平滑加速度的速度平方增量 */
+    
+    /* 运动限制 */
+    motion_t req_v[LOOKAHEAD_SIZE];             /* 请求速度 (未乘速度倍率) */
+    motion_t accel[LOOKAHEAD_SIZE];             /* 规划使用的加速度 */
+    
+    /* 规划结果 */
+    motion_t start_v[LOOKAHEAD_SIZE];           /* 实际起始速度 */
+    motion_t cruise_v[LOOKAHEAD_SIZE];          /* 实际巡航速度 */
+    motion_t end_v[LOOKAHEAD_SIZE];             /* 实际结束速度 */
+    
+    /* 几何 */
+    motion_t distance[LOOKAHEAD_SIZE];          /* 运动距离 */
+    motion_t junction_cos[LOOKAHEAD_SIZE];      /* 与前一段方向的夹角余弦 */
+    struct coord axes_r[LOOKAHEAD_SIZE];        /* 单位方向向量 */
+    struct coord start_pos[LOOKAHEAD_SIZE];     /* 起始位置 */
+    struct coord end_pos[LOOKAHEAD_SIZE];       /* 结束位置 */
+} lookahead_queue_t;
+
+/**
+ * @brief   细小线段合并缓冲
+ * 
+ * 切片软件输出的亚毫米线段先在此累积: 只要每个被合并掉的中间顶点
+ * 到合并弦的距离不超过 COALESCE_TOLERANCE、挤出比与首段一致，
+ * 就延长为一段后再进入前瞻队列。
+ */
+typedef struct {
+    struct coord start_pos;                     /* 合并段起始位置 */
+    struct coord end_pos;                       /* 合并段结束位置 */
+    struct coord points[COALESCE_MAX_POINTS];   /* 被合并掉的中间顶点 */
+    int num_points;                             /* 中间顶点数 */
+    motion_t max_v;                             /* 请求速度 */
+    motion_t e_ratio;                           /* 首段挤出比 dE / d(XYZ) */
+    uint8_t pending;                            /* 有待入队的线段 */
+} coalesce_t;
+
+/**
+ * @brief   圆弧分段计划
  * 
- * 用于前瞻队列中存储待处理的运动
+ * 起点相对圆心的向量每段乘一次固定的旋转矩阵 (cos_t, sin_t)，
+ * 不必逐段计算三角函数；每 ARC_CORRECTION_SEGMENTS 段按精确角度
+ * 重算一次以消除累积误差。
  */
 typedef struct {
     struct coord start_pos;     /* 起始位置 */
     struct coord end_pos;       /* 结束位置 */
-    double distance;            /* 运动距离 */
-    double max_velocity;        /* 最大速度 */
-    double max_start_v;         /* 最大起始速度 */
-    double max_cruise_v;        /* 最大巡航速度 */
-    double max_end_v;           /* 最大结束速度 */
-    double start_v;             /* 实际起始速度 */
-    double cruise_v;            /* 实际巡航速度 */
-    double end_v;               /* 实际结束速度 */
-    uint8_t valid;              /* 有效标志 */
-} lookahead_move_t;
+    double center_x;            /* 圆心 X */
+    double center_y;            /* 圆心 Y */
+    double radius;              /* 半径 */
+    double start_angle;         /* 起点相对圆心的极角 */
+    double seg_angle;           /* 每段转角 (顺时针为负) */
+    motion_t r0_x;              /* 起点相对圆心的向量 */
+    motion_t r0_y;
+    motion_t cos_t;             /* 每段旋转矩阵 */
+    motion_t sin_t;
+    int segments;               /* 分段数 */
+} arc_plan_t;
+
+/**
+ * @brief   圆弧分段游标
+ * 
+ * 一段圆弧的分段数 (最多 ARC_MAX_SEGMENTS) 可能超过 trapq 内存池，
+ * 分段按 trapq 空间陆续入队，游标记录下一个分段的位置。
+ */
+typedef struct {
+    arc_plan_t plan;            /* 圆弧计划 */
+    struct coord prev;          /* 上一个分段端点 */
+    motion_t r_x;               /* 上一个端点相对圆心的向量 */
+    motion_t r_y;
+    motion_t max_v;             /* 请求速度 */
+    int next;                   /* 下一个分段序号 (1 ~ segments) */
+    uint8_t active;             /* 还有分段未入队 */
+} arc_cursor_t;
 
 /**
  * @brief   归零状态
@@ -76,18 +196,28 @@ typedef enum {
     HOME_STATE_FAST,            /* 快速归零 */
     HOME_STATE_RETRACT,         /* 回退 */
     HOME_STATE_SLOW,            /* 慢速归零 */
+    HOME_STATE_FINISH,          /* 慢速触发后回退到归零位置 */
     HOME_STATE_DONE,            /* 完成 */
     HOME_STATE_ERROR            /* 错误 */
 } home_state_t;
 
 /**
  * @brief   归零上下文
+ * 
+ * triggered/halted/timed_out 由限位回调和超时定时器在中断中置位，
+ * 其余字段只在主循环中修改。
  */
 typedef struct {
-    home_state_t state;         /* 当前状态 */
-    uint8_t axis_mask;          /* 归零轴掩码 */
-    double start_time;          /* 开始时间 */
-    uint8_t triggered;          /* 触发标志 */
+    home_state_t state;             /* 当前状态 */
+    uint8_t axis_mask;              /* 尚未完成的归零轴 */
+    uint8_t group_mask;             /* 本组并行归零的轴 */
+    volatile uint8_t triggered;     /* 已触发限位的轴 */
+    volatile uint8_t halted;        /* 已停止的步进电机 */
+    volatile uint8_t timed_out;     /* 超时标志 */
+    sched_time_t trigger_clock[3];  /* 各轴限位触发时刻 */
+    double phase_time;              /* 本阶段运动的起始打印时间 */
+    double saved_min[NUM_AXES];     /* 归零期间放开的限位 */
+    double saved_max[NUM_AXES];
 } home_context_t;
 
 /* ========== 私有变量 ========== */
@@ -107,21 +237,64 @@ static double s_print_time = 0.0;
 /** 运动配置参数 */
 static toolhead_config_t s_config;
 
+/** 速度倍率 (M220)，乘在请求速度上 */
+static float s_speed_factor = 1.0f;
+
 /** 初始化完成标志 */
 static uint8_t s_initialized = 0;
 
 /** 前瞻队列 */
-static lookahead_move_t s_lookahead[LOOKAHEAD_SIZE];
+static lookahead_queue_t s_lookahead;
 static int s_lookahead_head = 0;
 static int s_lookahead_tail = 0;
 static int s_lookahead_count = 0;
 
-/** 步进运动学 */
+/** 队尾运动段仍在运动中 (下一段需要计算结点速度) */
+static uint8_t s_has_prev_move = 0;
+
+/** 距下次惰性规划剩余的运动时间 (秒) */
+static motion_t s_junction_flush = MOTION_C(0.0);
+
+/** 细小线段合并缓冲 */
+static coalesce_t s_coalesce;
+
+/** 正在入队的圆弧 */
+static arc_cursor_t s_arc;
+
+/** 步进运动学 (参与步进生成的，整形时为整形包装) */
 static struct stepper_kinematics *s_steppers[NUM_AXES];
 
+/** 各轴未整形的步进运动学 */
+static struct stepper_kinematics *s_kin_steppers[NUM_AXES];
+
+/** 输入整形包装 (按需分配) */
+static struct stepper_kinematics *s_shaper_steppers[NUM_SHAPER_AXES];
+
+/** 步进位置依赖其后多长时间的运动 (秒)，步进生成需滞后这么久 */
+static double s_kin_flush_delay = 0.0;
+
+/** 运动结束后步进仍可能运动的时间 (秒) */
+static double s_kin_post_delay = 0.0;
+
+/** 每轴步进时间队列 (itersolve 输出，待送入步进驱动) */
+static struct step_queue s_step_queues[NUM_AXES] __ccmram;
+
+/** 每轴最后一个已送入步进驱动的步进时钟 */
+static sched_time_t s_last_step_clock[NUM_AXES];
+
+/** 打印时间 0 对应的系统时钟 (64 位，长时间任务不回绕) */
+static sched_time64_t s_clock_base = 0;
+
 /** 归零上下文 */
 static home_context_t s_home_ctx;
 
+/** 归零超时定时器 */
+static sched_timer_t s_home_timer;
+
+/** 定时刷新定时器及其待处理标志 (中断中置位，toolhead_task 中处理) */
+static sched_timer_t s_flush_timer;
+static volatile uint8_t s_flush_pending = 0;
+
 /** 运动完成回调 */
 static toolhead_callback_fn_t s_move_complete_cb = NULL;
 static void *s_move_complete_arg = NULL;
@@ -133,36 +306,96 @@ static double s_max_pos[NUM_AXES];
 /** steps_per_mm 配置 */
 static double s_steps_per_mm[NUM_AXES];
 
-/* ========== 外部函数声明 ========== */
+/* ========== 内存预算检查 ========== */
+
+/** 编译期断言 (C99 没有 _Static_assert) */
+#define TOOLHEAD_BUILD_ASSERT(cond, name) \
+    typedef char toolhead_assert_##name[(cond) ? 1 : -1]
 
-/* 笛卡尔运动学设置函数 */
-extern void cartesian_stepper_setup(struct stepper_kinematics *sk, int axis,
-                                    double steps_per_mm);
-extern double cartesian_calc_direction(const struct coord *start,
-                                       const struct coord *end,
-                                       struct coord *axes_r);
+/** 主 SRAM 中的运动缓冲区和内存池 (字节)，对应 RAM_BUDGET_BYTES */
+#define TOOLHEAD_RAM_BYTES \
+    (sizeof(lookahead_queue_t) + TRAPQ_POOL_RAM_BYTES + \
+     MEM_POOL_TOTAL_SIZE + MEM_POOL_SMALL_COUNT + \
+     MEM_POOL_MEDIUM_COUNT + MEM_POOL_LARGE_COUNT)
+
+/** 全部 __ccmram 数据 (字节)，对应 CCM_BUDGET_BYTES */
+#define FIRMWARE_CCM_BYTES \
+    (NUM_AXES * sizeof(struct step_queue) + GCODE_STREAM_BUFFER_SIZE + \
+     STEPPER_CCM_BYTES + SCHED_CCM_BYTES + TRACE_CCM_BYTES)
+
+TOOLHEAD_BUILD_ASSERT(TOOLHEAD_RAM_BYTES <= RAM_BUDGET_BYTES, ram_budget);
+TOOLHEAD_BUILD_ASSERT(FIRMWARE_CCM_BYTES <= CCM_BUDGET_BYTES, ccm_budget);
+
+/* 惰性刷新可能一次提交整个前瞻队列 */
+TOOLHEAD_BUILD_ASSERT(TRAPQ_MAX_MOVES > LOOKAHEAD_SIZE, trapq_depth);
 
 /* ========== 私有函数声明 ========== */
 
 static void config_init_defaults(void);
 static void coord_clear(struct coord *p_pos);
 static void coord_copy(struct coord *p_dst, const struct coord *p_src);
-static double calc_move_distance(const struct coord *start,
-                                 const struct coord *end);
-static void calc_trapezoidal_profile(double distance, double start_v,
-                                     double cruise_v, double end_v,
-                                     double accel,
-                                     double *accel_t, double *cruise_t,
-                                     double *decel_t);
-static int lookahead_push(const lookahead_move_t *move);
-static int lookahead_pop(lookahead_move_t *move);
-static void lookahead_flush(void);
-static void lookahead_process(void);
-static double calc_junction_velocity(const struct coord *prev_dir,
-                                     const struct coord *next_dir,
-                                     double max_v);
+static motion_t calc_move_distance(const struct coord *start,
+                                   const struct coord *end);
+static void calc_trapezoidal_profile(motion_t distance, motion_t start_v,
+                                     motion_t cruise_v, motion_t end_v,
+                                     motion_t accel,
+                                     motion_t *accel_t, motion_t *cruise_t,
+                                     motion_t *decel_t);
+static int lookahead_push(const struct coord *start_pos,
+                          const struct coord *end_pos,
+                          motion_t distance, motion_t max_v);
+static int lookahead_at(int i);
+static void lookahead_set_limits(int slot);
+static void lookahead_calc_junction(int slot);
+static void lookahead_replan(void);
+static int lookahead_plan(int lazy);
+static int lookahead_commit_count(int count);
+static int lookahead_flush_lazy(void);
+static int lookahead_flush(void);
+static int lookahead_commit(int slot);
+static int trapq_reclaim(void);
+static int move_queue(const struct coord *start_pos,
+                      const struct coord *end_pos,
+                      motion_t distance, motion_t max_v);
+static motion_t coalesce_deviation2(const struct coord *p,
+                                    const struct coord *a,
+                                    const struct coord *b);
+static int coalesce_start(const struct coord *start_pos,
+                          const struct coord *end_pos, motion_t max_v);
+static int coalesce_try_merge(const struct coord *end_pos, motion_t max_v);
+static int coalesce_flush(void);
+static motion_t clamp_velocity(float speed);
+static int arc_plan_init(arc_plan_t *p_arc, double offset_i, double offset_j,
+                         int clockwise);
+static void arc_cursor_start(arc_cursor_t *p_cur, const arc_plan_t *p_arc,
+                             motion_t max_v);
+static void arc_cursor_next(arc_cursor_t *p_cur, struct coord *p_pos);
+static int arc_check_limits(const arc_plan_t *p_arc);
+static int arc_emit(void);
+static int arc_finish(void);
+static int move_space_available(void);
+static motion_t calc_junction_velocity(motion_t junction_cos, motion_t max_v);
+static sched_time64_t print_time_to_clock64(double print_time);
+static sched_time_t print_time_to_clock(double print_time);
+static void sync_print_time(void);
+static int step_queue_drain(int axis);
 static void generate_steps(double flush_time);
+static void refill_steps(uint32_t mask);
+static void discard_steps(void);
+static sched_time_t flush_timer_event(sched_time_t waketime);
+static void flush_handler(void);
+static double clock_to_print_time(sched_time_t clock);
+static void kin_stepper_setup(int i, struct stepper_kinematics *sk);
+static double kin_calc_stepper_pos(int i, const struct coord *p_pos);
+static int kin_check_limits(const struct coord *p_pos);
+static void stepper_switch_kinematics(int axis, struct stepper_kinematics *sk);
+static void update_kin_flush_delay(void);
+static int shaper_apply(int axis, int type, double freq, double damping_ratio);
 static void home_endstop_callback(endstop_id_t id, void *arg);
+static sched_time_t home_timeout_event(sched_time_t waketime);
+static int home_active(void);
+static void home_task(void);
+static int steppers_idle(void);
 
 /* ========== 私有函数实现 ========== */
 
@@ -176,6 +409,7 @@ config_init_defaults(void)
     s_config.max_accel = MAX_ACCEL;
     s_config.max_accel_to_decel = MAX_ACCEL * 0.5f;
     s_config.square_corner_velocity = 5.0f;
+    s_speed_factor = 1.0f;
     
     /* 初始化轴限位 */
     s_min_pos[0] = X_MIN;
@@ -225,15 +459,15 @@ coord_copy(struct coord *p_dst, const struct coord *p_src)
  * @param   end     结束位置
  * @return  运动距离 (mm)
  */
-static double
+static motion_t
 calc_move_distance(const struct coord *start, const struct coord *end)
 {
-    double dx = end->x - start->x;
-    double dy = end->y - start->y;
-    double dz = end->z - start->z;
-    double de = end->e - start->e;
+    motion_t dx = end->x - start->x;
+    motion_t dy = end->y - start->y;
+    motion_t dz = end->z - start->z;
+    motion_t de = end->e - start->e;
     
-    return sqrt(dx * dx + dy * dy + dz * dz + de * de);
+    return motion_sqrt(dx * dx + dy * dy + dz * dz + de * de);
 }
 
 /**
@@ -254,39 +488,40 @@ calc_move_distance(const struct coord *start, const struct coord *end)
  * @param   decel_t     输出: 减速时间
  */
 static void
-calc_trapezoidal_profile(double distance, double start_v, double cruise_v,
-                         double end_v, double accel,
-                         double *accel_t, double *cruise_t, double *decel_t)
+calc_trapezoidal_profile(motion_t distance, motion_t start_v,
+                         motion_t cruise_v, motion_t end_v, motion_t accel,
+                         motion_t *accel_t, motion_t *cruise_t,
+                         motion_t *decel_t)
 {
     /* 计算加速和减速距离 */
-    double accel_dist = 0.0;
-    double decel_dist = 0.0;
+    motion_t accel_dist = MOTION_C(0.0);
+    motion_t decel_dist = MOTION_C(0.0);
     
     if (cruise_v > start_v) {
         /* 需要加速 */
         *accel_t = (cruise_v - start_v) / accel;
-        accel_dist = (start_v + cruise_v) * 0.5 * (*accel_t);
+        accel_dist = (start_v + cruise_v) * MOTION_C(0.5) * (*accel_t);
     } else {
-        *accel_t = 0.0;
+        *accel_t = MOTION_C(0.0);
     }
     
     if (cruise_v > end_v) {
         /* 需要减速 */
         *decel_t = (cruise_v - end_v) / accel;
-        decel_dist = (cruise_v + end_v) * 0.5 * (*decel_t);
+        decel_dist = (cruise_v + end_v) * MOTION_C(0.5) * (*decel_t);
     } else {
-        *decel_t = 0.0;
+        *decel_t = MOTION_C(0.0);
     }
     
     /* 检查是否有足够距离达到巡航速度 */
-    double cruise_dist = distance - accel_dist - decel_dist;
+    motion_t cruise_dist = distance - accel_dist - decel_dist;
     
-    if (cruise_dist < 0.0) {
+    if (cruise_dist < MOTION_C(0.0)) {
         /* 距离不够，需要降低巡航速度 */
         /* 使用公式: v^2 = v0^2 + 2*a*d 求解峰值速度 */
-        double peak_v_sq = (start_v * start_v + end_v * end_v) * 0.5 +
-                          accel * distance;
-        double peak_v = sqrt(peak_v_sq);
+        motion_t peak_v_sq = (start_v * start_v + end_v * end_v) * MOTION_C(0.5)
+                             + accel * distance;
+        motion_t peak_v = motion_sqrt(peak_v_sq);
         
         if (peak_v < start_v) {
             peak_v = start_v;
@@ -299,16 +534,16 @@ calc_trapezoidal_profile(double distance, double start_v, double cruise_v,
         if (peak_v > start_v) {
             *accel_t = (peak_v - start_v) / accel;
         } else {
-            *accel_t = 0.0;
+            *accel_t = MOTION_C(0.0);
         }
         
         if (peak_v > end_v) {
             *decel_t = (peak_v - end_v) / accel;
         } else {
-            *decel_t = 0.0;
+            *decel_t = MOTION_C(0.0);
         }
         
-        *cruise_t = 0.0;
+        *cruise_t = MOTION_C(0.0);
     } else {
         /* 有匀速阶段 */
         *cruise_t = cruise_dist / cruise_v;
@@ -321,43 +556,39 @@ calc_trapezoidal_profile(double distance, double start_v, double cruise_v,
  * 根据两个运动段的方向变化计算允许的最大结点速度。
  * 方向变化越大，结点速度越低。
  * 
- * @param   prev_dir    前一段运动方向 (归一化)
- * @param   next_dir    下一段运动方向 (归一化)
- * @param   max_v       最大允许速度
+ * @param   junction_cos    前后两段方向的点积 (夹角余弦)
+ * @param   max_v           最大允许速度
  * @return  结点速度
  */
-static double
-calc_junction_velocity(const struct coord *prev_dir,
-                       const struct coord *next_dir,
-                       double max_v)
+static motion_t
+calc_junction_velocity(motion_t junction_cos, motion_t max_v)
 {
-    /* 计算方向向量的点积 */
-    double dot = prev_dir->x * next_dir->x +
-                 prev_dir->y * next_dir->y +
-                 prev_dir->z * next_dir->z;
+    motion_t dot = junction_cos;
     
     /* 点积范围 [-1, 1]，1 表示同向，-1 表示反向 */
-    if (dot < -0.999) {
+    if (dot < -MOTION_C(0.999)) {
         /* 几乎反向，需要完全停止 */
-        return 0.0;
+        return MOTION_C(0.0);
     }
     
-    if (dot > 0.999) {
+    if (dot > MOTION_C(0.999)) {
         /* 几乎同向，可以保持最大速度 */
         return max_v;
     }
     
     /* 计算转角的一半的正弦值 */
     /* sin(theta/2) = sqrt((1 - cos(theta)) / 2) */
-    double sin_half_theta = sqrt((1.0 - dot) * 0.5);
+    motion_t sin_half_theta = motion_sqrt((MOTION_C(1.0) - dot)
+                                          * MOTION_C(0.5));
     
     /* 使用拐角速度公式 */
     /* v_junction = sqrt(accel * deviation / sin(theta/2)) */
     /* 其中 deviation 是允许的偏差距离 */
-    double deviation = s_config.square_corner_velocity * 
-                       s_config.square_corner_velocity / s_config.max_accel;
+    motion_t deviation = s_config.square_corner_velocity * 
+                         s_config.square_corner_velocity / s_config.max_accel;
     
-    double junction_v = sqrt(s_config.max_accel * deviation / sin_half_theta);
+    motion_t junction_v = motion_sqrt(s_config.max_accel * deviation
+                                      / sin_half_theta);
     
     if (junction_v > max_v) {
         junction_v = max_v;
@@ -368,585 +599,2046 @@ calc_junction_velocity(const struct coord *prev_dir,
 
 /**
  * @brief   向前瞻队列添加运动
+ * @param   start_pos   起始位置
+ * @param   end_pos     结束位置
+ * @param   distance    运动距离
+ * @param   max_v       请求速度
+ * @return  新运动段的槽位，队列满返回 -1
+ * 
+ * 方向向量、夹角余弦和结点限制在此计算一次并缓存。
  */
 static int
-lookahead_push(const lookahead_move_t *move)
+lookahead_push(const struct coord *start_pos, const struct coord *end_pos,
+               motion_t distance, motion_t max_v)
 {
     if (s_lookahead_count >= LOOKAHEAD_SIZE) {
         return -1;  /* 队列满 */
     }
     
-    s_lookahead[s_lookahead_tail] = *move;
+    lookahead_queue_t *q = &s_lookahead;
+    int slot = s_lookahead_tail;
+    coord_copy(&q->start_pos[slot], start_pos);
+    coord_copy(&q->end_pos[slot], end_pos);
+    cartesian_calc_direction(start_pos, end_pos, &q->axes_r[slot]);
+    q->distance[slot] = distance;
+    q->req_v[slot] = max_v;
+    q->start_v[slot] = MOTION_C(0.0);
+    q->end_v[slot] = MOTION_C(0.0);
+    
+    /* 前一段已停止 (或没有前一段) 时记为 -1，从零速起步 */
+    q->junction_cos[slot] = MOTION_C(-1.0);
+    if (s_has_prev_move) {
+        int prev = (slot - 1 + LOOKAHEAD_SIZE) % LOOKAHEAD_SIZE;
+        const struct coord *pd = &q->axes_r[prev];
+        const struct coord *nd = &q->axes_r[slot];
+        q->junction_cos[slot] = pd->x * nd->x + pd->y * nd->y + pd->z * nd->z;
+    }
+    
+    lookahead_set_limits(slot);
+    lookahead_calc_junction(slot);
+    
     s_lookahead_tail = (s_lookahead_tail + 1) % LOOKAHEAD_SIZE;
     s_lookahead_count++;
+    s_has_prev_move = 1;
     
-    return 0;
+    return slot;
 }
 
 /**
- * @brief   从前瞻队列取出运动
+ * @brief   按队首偏移取前瞻队列槽位
+ * @param   i   距队首的偏移 (0 为最早的运动)
  */
 static int
-lookahead_pop(lookahead_move_t *move)
+lookahead_at(int i)
 {
-    if (s_lookahead_count == 0) {
-        return -1;  /* 队列空 */
-    }
+    return (s_lookahead_head + i) % LOOKAHEAD_SIZE;
+}
+
+/**
+ * @brief   按当前配置设置运动段的速度和加速度限制
+ * @param   slot    运动段槽位 (已填写距离和请求速度)
+ * 
+ * 巡航速度上限为请求速度乘以速度倍率，不超过 max_velocity；
+ * 归零运动不乘速度倍率。
+ */
+static void
+lookahead_set_limits(int slot)
+{
+    lookahead_queue_t *q = &s_lookahead;
     
-    *move = s_lookahead[s_lookahead_head];
-    s_lookahead_head = (s_lookahead_head + 1) % LOOKAHEAD_SIZE;
-    s_lookahead_count--;
+    motion_t max_v = q->req_v[slot];
+    if (!home_active()) {
+        max_v *= (motion_t)s_speed_factor;
+    }
+    if (max_v > s_config.max_velocity) {
+        max_v = s_config.max_velocity;
+    }
     
-    return 0;
+    q->max_cruise_v2[slot] = max_v * max_v;
+    q->cruise_v[slot] = max_v;
+    q->accel[slot] = s_config.max_accel;
+    q->delta_v2[slot] = MOTION_C(2.0) * q->distance[slot] * s_config.max_accel;
+    q->smooth_delta_v2[slot] = MOTION_C(2.0) * q->distance[slot]
+                               * s_config.max_accel_to_decel;
 }
 
 /**
- * @brief   处理前瞻队列
+ * @brief   计算运动段的结点限制
+ * @param   slot    运动段槽位 (已填写夹角余弦和速度限制)
  * 
- * 实现前瞻算法:
- * 1. 反向遍历，计算每段运动的最大结束速度
- * 2. 正向遍历，计算每段运动的实际速度
- * 3. 将处理好的运动添加到 trapq
+ * 移植自 klippy/toolhead.py Move.calc_junction()。
+ * 只依赖前一段运动 (提交后槽位仍保留)，入队时计算，
+ * 之后仅在 lookahead_replan() 中重算。
  */
 static void
-lookahead_process(void)
+lookahead_calc_junction(int slot)
 {
-    if (s_lookahead_count == 0) {
-        return;
-    }
+    lookahead_queue_t *q = &s_lookahead;
     
-    /* 反向遍历: 计算最大结束速度 */
-    /* 最后一段运动的结束速度为 0 (或下一段的起始速度) */
-    int idx = (s_lookahead_tail - 1 + LOOKAHEAD_SIZE) % LOOKAHEAD_SIZE;
-    s_lookahead[idx].max_end_v = 0.0;
+    q->max_start_v2[slot] = MOTION_C(0.0);
+    q->max_smoothed_v2[slot] = MOTION_C(0.0);
     
-    for (int i = s_lookahead_count - 1; i > 0; i--) {
-        int prev_idx = (idx - 1 + LOOKAHEAD_SIZE) % LOOKAHEAD_SIZE;
-        lookahead_move_t *curr = &s_lookahead[idx];
-        lookahead_move_t *prev = &s_lookahead[prev_idx];
-        
-        /* 计算从当前段结束速度反推的最大起始速度 */
-        /* v_start^2 = v_end^2 + 2 * a * d */
-        double max_start_v_sq = curr->max_end_v * curr->max_end_v +
-                                2.0 * s_config.max_accel * curr->distance;
-        double max_start_v = sqrt(max_start_v_sq);
-        
-        if (max_start_v > curr->max_cruise_v) {
-            max_start_v = curr->max_cruise_v;
-        }
-        
-        curr->max_start_v = max_start_v;
-        
-        /* 计算结点速度 */
-        struct coord prev_dir, curr_dir;
-        cartesian_calc_direction(&prev->start_pos, &prev->end_pos, &prev_dir);
-        cartesian_calc_direction(&curr->start_pos, &curr->end_pos, &curr_dir);
-        
-        double junction_v = calc_junction_velocity(&prev_dir, &curr_dir,
-                                                   max_start_v);
-        
-        if (junction_v < max_start_v) {
-            curr->max_start_v = junction_v;
-        }
-        
-        prev->max_end_v = curr->max_start_v;
-        
-        idx = prev_idx;
+    /* 前一段已停止 (或没有前一段)，从零速起步 */
+    if (q->junction_cos[slot] <= MOTION_C(-1.0)) {
+        return;
     }
     
-    /* 正向遍历: 计算实际速度并添加到 trapq */
-    idx = s_lookahead_head;
-    double prev_end_v = 0.0;
+    int prev = (slot - 1 + LOOKAHEAD_SIZE) % LOOKAHEAD_SIZE;
+    motion_t junction_v = calc_junction_velocity(q->junction_cos[slot],
+                              motion_sqrt(q->max_cruise_v2[slot]));
+    motion_t max_start_v2 = junction_v * junction_v;
     
-    for (int i = 0; i < s_lookahead_count; i++) {
-        lookahead_move_t *move = &s_lookahead[idx];
-        
-        /* 起始速度 = 前一段的结束速度 */
-        move->start_v = prev_end_v;
-        
-        /* 检查是否能达到巡航速度 */
-        /* v_cruise^2 = v_start^2 + 2 * a * d_accel */
-        double max_cruise_v_sq = move->start_v * move->start_v +
-                                 2.0 * s_config.max_accel * move->distance;
-        double max_cruise_v = sqrt(max_cruise_v_sq);
-        
-        if (max_cruise_v > move->max_cruise_v) {
-            max_cruise_v = move->max_cruise_v;
-        }
-        
-        move->cruise_v = max_cruise_v;
-        
-        /* 计算结束速度 */
-        /* v_end^2 = v_cruise^2 - 2 * a * d_decel */
-        double max_end_v_sq = move->cruise_v * move->cruise_v -
-                              2.0 * s_config.max_accel_to_decel * move->distance;
-        double max_end_v = (max_end_v_sq > 0.0) ? sqrt(max_end_v_sq) : 0.0;
-        
-        if (max_end_v > move->max_end_v) {
-            max_end_v = move->max_end_v;
-        }
-        
-        move->end_v = max_end_v;
-        prev_end_v = move->end_v;
-        
-        idx = (idx + 1) % LOOKAHEAD_SIZE;
+    if (max_start_v2 > q->max_cruise_v2[prev]) {
+        max_start_v2 = q->max_cruise_v2[prev];
     }
+    if (max_start_v2 > q->max_start_v2[prev] + q->delta_v2[prev]) {
+        max_start_v2 = q->max_start_v2[prev] + q->delta_v2[prev];
+    }
+    q->max_start_v2[slot] = max_start_v2;
+    
+    motion_t max_smoothed_v2 = q->max_smoothed_v2[prev]
+                               + q->smooth_delta_v2[prev];
+    q->max_smoothed_v2[slot] = (max_start_v2 < max_smoothed_v2)
+                               ? max_start_v2 : max_smoothed_v2;
 }
 
 /**
- * @brief   刷新前瞻队列到 trapq
+ * @brief   按当前配置重算前瞻队列中尚未确定的运动段
  * 
- * 将前瞻队列中的运动转换为 trapq 运动段
+ * 已提交到 trapq 的运动不变，也不等待队列排空。队首的起始速度
+ * 已由提交的运动确定，之前的规划依赖队首若干段能从该速度刹停:
+ * 这些运动段保留原来的限制，其后的运动段按新的速度倍率和加速度
+ * 重算限制和结点速度，下次规划即按新限制执行。
  */
 static void
-lookahead_flush(void)
+lookahead_replan(void)
 {
-    lookahead_move_t move;
+    lookahead_queue_t *q = &s_lookahead;
     
-    while (lookahead_pop(&move) == 0) {
-        /* 计算梯形曲线参数 */
-        double accel_t, cruise_t, decel_t;
-        calc_trapezoidal_profile(move.distance, move.start_v, move.cruise_v,
-                                 move.end_v, s_config.max_accel,
-                                 &accel_t, &cruise_t, &decel_t);
-        
-        /* 计算方向向量 */
-        struct coord axes_r;
-        cartesian_calc_direction(&move.start_pos, &move.end_pos, &axes_r);
-        
-        /* 添加到 trapq */
-        trapq_append(s_p_trapq, s_print_time,
-                     accel_t, cruise_t, decel_t,
-                     &move.start_pos, &axes_r,
-                     move.start_v, move.cruise_v, s_config.max_accel);
-        
-        /* 更新打印时间 */
-        s_print_time += accel_t + cruise_t + decel_t;
-        
-        /* 更新当前位置 */
-        coord_copy(&s_current_pos, &move.end_pos);
+    if (s_lookahead_count == 0) {
+        return;
+    }
+    
+    /* 跳过从已确定的起始速度刹停所需的运动段 */
+    motion_t brake_v2 = q->max_start_v2[lookahead_at(0)];
+    int i = 0;
+    while (i < s_lookahead_count && brake_v2 > MOTION_C(0.0)) {
+        brake_v2 -= q->delta_v2[lookahead_at(i)];
+        i++;
+    }
+    
+    /* 队首从零速起步: 起始限制已由提交固定，只更新速度和加速度 */
+    if (i == 0) {
+        lookahead_set_limits(lookahead_at(0));
+        i = 1;
+    }
+    
+    for (; i < s_lookahead_count; i++) {
+        int slot = lookahead_at(i);
+        lookahead_set_limits(slot);
+        lookahead_calc_junction(slot);
     }
 }
 
 /**
- * @brief   生成步进时序
- * @param   flush_time  刷新时间
+ * @brief   设置运动段的规划速度
  */
 static void
-generate_steps(double flush_time)
+lookahead_set_junction(int slot, motion_t start_v2,
+                       motion_t cruise_v2, motion_t end_v2)
 {
-    for (int i = 0; i < NUM_AXES; i++) {
-        if (s_steppers[i] != NULL) {
-            itersolve_generate_steps(s_steppers[i], flush_time);
-        }
-    }
+    s_lookahead.start_v[slot] = motion_sqrt(start_v2);
+    s_lookahead.cruise_v[slot] = motion_sqrt(cruise_v2);
+    s_lookahead.end_v[slot] = motion_sqrt(end_v2);
 }
 
 /**
- * @brief   归零限位开关回调
+ * @brief   前瞻规划
+ * @param   lazy    1: 只确定以后不会再变化的运动;
+ *                  0: 假设最后一段后停止，确定全部运动
+ * @return  从队首起已确定速度、可以提交的运动段数
+ * 
+ * 移植自 klippy/toolhead.py LookAheadQueue.flush()。
+ * 从队尾向队首反向遍历一次，假设最后一段结束时停止。
+ * 遇到可以减速的运动段后，在它之前的运动无论后续追加什么都不会
+ * 再改变，惰性模式下只提交这部分，其余运动留待下次规划。
+ * 整段减速的运动要等确定前面的峰值巡航速度后再计算 (delayed)。
  */
-static void
-home_endstop_callback(endstop_id_t id, void *arg)
+static int
+lookahead_plan_pass(int lazy)
 {
-    (void)arg;
+    const lookahead_queue_t *q = &s_lookahead;
+    int update_flush_count = lazy;
+    int flush_count = s_lookahead_count;
+    int delayed[LOOKAHEAD_SIZE];
+    motion_t delayed_start_v2[LOOKAHEAD_SIZE];
+    motion_t delayed_end_v2[LOOKAHEAD_SIZE];
+    int num_delayed = 0;
+    motion_t next_end_v2 = MOTION_C(0.0);
+    motion_t next_smoothed_v2 = MOTION_C(0.0);
+    motion_t peak_cruise_v2 = MOTION_C(0.0);
+    
+    for (int i = s_lookahead_count - 1; i >= 0; i--) {
+        int slot = lookahead_at(i);
+        
+        motion_t reachable_start_v2 = next_end_v2 + q->delta_v2[slot];
+        motion_t start_v2 = (q->max_start_v2[slot] < reachable_start_v2)
+                            ? q->max_start_v2[slot] : reachable_start_v2;
+        motion_t reachable_smoothed_v2 = next_smoothed_v2
+                                         + q->smooth_delta_v2[slot];
+        motion_t smoothed_v2 =
+            (q->max_smoothed_v2[slot] < reachable_smoothed_v2)
+            ? q->max_smoothed_v2[slot] : reachable_smoothed_v2;
+        
+        if (smoothed_v2 < reachable_smoothed_v2) {
+            /* 本段可以加速 */
+            if (smoothed_v2 + q->smooth_delta_v2[slot] > next_smoothed_v2 ||
+                num_delayed > 0) {
+                /* 本段可以减速，或是整段减速之后的整段加速 */
+                if (update_flush_count && peak_cruise_v2 > MOTION_C(0.0)) {
+                    flush_count = i;
+                    update_flush_count = 0;
+                }
+                peak_cruise_v2 = (smoothed_v2 + reachable_smoothed_v2)
+                                 * MOTION_C(0.5);
+                if (peak_cruise_v2 > q->max_cruise_v2[slot]) {
+                    peak_cruise_v2 = q->max_cruise_v2[slot];
+                }
+                
+                /* 将峰值巡航速度传给延后计算的运动 */
+                if (!update_flush_count && i < flush_count) {
+                    motion_t mc_v2 = peak_cruise_v2;
+                    for (int k = num_delayed - 1; k >= 0; k--) {
+                        if (delayed_start_v2[k] < mc_v2) {
+                            mc_v2 = delayed_start_v2[k];
+                        }
+                        lookahead_set_junction(lookahead_at(delayed[k]),
+                                               mc_v2, mc_v2,
+                                               (delayed_end_v2[k] < mc_v2)
+                                               ? delayed_end_v2[k] : mc_v2);
+                    }
+                }
+                num_delayed = 0;
+            }
+            
+            if (!update_flush_count && i < flush_count) {
+                motion_t cruise_v2 = (start_v2 + reachable_start_v2)
+                                     * MOTION_C(0.5);
+                if (cruise_v2 > q->max_cruise_v2[slot]) {
+                    cruise_v2 = q->max_cruise_v2[slot];
+                }
+                if (cruise_v2 > peak_cruise_v2) {
+                    cruise_v2 = peak_cruise_v2;
+                }
+                lookahead_set_junction(slot,
+                                       (start_v2 < cruise_v2)
+                                       ? start_v2 : cruise_v2,
+                                       cruise_v2,
+                                       (next_end_v2 < cruise_v2)
+                                       ? next_end_v2 : cruise_v2);
+            }
+        } else {
+            /* 整段减速，等确定峰值巡航速度后再计算 */
+            delayed[num_delayed] = i;
+            delayed_start_v2[num_delayed] = start_v2;
+            delayed_end_v2[num_delayed] = next_end_v2;
+            num_delayed++;
+        }
+        
+        next_end_v2 = start_v2;
+        next_smoothed_v2 = smoothed_v2;
+    }
     
-    /* 标记触发 */
-    s_home_ctx.triggered = 1;
+    if (update_flush_count) {
+        return 0;
+    }
     
-    /* 停止对应的步进电机 */
-    switch (id) {
-    case ENDSTOP_X:
-        stepper_stop(STEPPER_X);
-        break;
-    case ENDSTOP_Y:
-        stepper_stop(STEPPER_Y);
-        break;
-    case ENDSTOP_Z:
-        stepper_stop(STEPPER_Z);
-        break;
-    default:
-        break;
+    /* 队首的整段减速运动没有更早的峰值，以各自起始速度巡航 */
+    motion_t mc_v2 = (num_delayed > 0) ? delayed_start_v2[num_delayed - 1]
+                                       : MOTION_C(0.0);
+    for (int k = num_delayed - 1; k >= 0; k--) {
+        if (delayed_start_v2[k] < mc_v2) {
+            mc_v2 = delayed_start_v2[k];
+        }
+        lookahead_set_junction(lookahead_at(delayed[k]), mc_v2, mc_v2,
+                               (delayed_end_v2[k] < mc_v2)
+                               ? delayed_end_v2[k] : mc_v2);
     }
+    
+    return flush_count;
 }
 
-/* ========== 公有函数实现 ========== */
+/**
+ * @brief   前瞻规划 (带性能剖析)
+ * @param   lazy    同 lookahead_plan_pass()
+ * @return  从队首起已确定速度、可以提交的运动段数
+ * 
+ * CONFIG_PROFILE 下统计每次规划的 CPU 周期 (PROFILE_LOOKAHEAD)。
+ */
+static int
+lookahead_plan(int lazy)
+{
+    uint32_t prof_start = profile_start();
+    int count = lookahead_plan_pass(lazy);
+    profile_stop(PROFILE_LOOKAHEAD, prof_start);
+    return count;
+}
 
-void
-toolhead_init(void)
+/**
+ * @brief   回收已生成步进的 trapq 运动段
+ * @return  释放的运动段数量
+ * 
+ * 所有轴的 itersolve 都已越过的运动段不再被访问，移入历史后释放。
+ */
+static int
+trapq_reclaim(void)
 {
-    /* 防止重复初始化 */
-    if (s_initialized) {
-        return;
-    }
-    
-    /* 初始化 trapq 内存池 */
-    trapq_pool_init();
-    
-    /* 初始化 itersolve 内存池 */
-    itersolve_pool_init();
-    
-    /* 分配运动队列 */
-    s_p_trapq = trapq_alloc();
-    if (s_p_trapq == NULL) {
-        /* 内存池分配失败 - 严重错误 */
-        return;
-    }
-    
-    /* 初始化默认配置 */
-    config_init_defaults();
+    trapq_pool_stats_t stats;
+    double done_time = s_print_time;
     
-    /* 分配并配置步进运动学 */
     for (int i = 0; i < NUM_AXES; i++) {
-        s_steppers[i] = itersolve_alloc();
-        if (s_steppers[i] != NULL) {
-            cartesian_stepper_setup(s_steppers[i], i, s_steps_per_mm[i]);
-            itersolve_set_trapq(s_steppers[i], s_p_trapq);
+        if (s_steppers[i] != NULL &&
+            s_steppers[i]->last_flush_time < done_time) {
+            done_time = s_steppers[i]->last_flush_time;
         }
     }
     
-    /* 初始化位置为零 */
-    coord_clear(&s_current_pos);
-    coord_clear(&s_commanded_pos);
-    
-    /* 初始化打印时间 */
-    s_print_time = 0.0;
+    /* 整形的步进位置还要回看这么久之前的运动 */
+    done_time -= s_kin_post_delay;
     
-    /* 初始化前瞻队列 */
-    s_lookahead_head = 0;
-    s_lookahead_tail = 0;
-    s_lookahead_count = 0;
+    trapq_pool_get_stats(&stats);
+    uint32_t frees = stats.total_frees;
     
-    /* 初始化归零上下文 */
-    s_home_ctx.state = HOME_STATE_IDLE;
-    s_home_ctx.axis_mask = 0;
-    s_home_ctx.triggered = 0;
+    trapq_finalize_moves(s_p_trapq, done_time);
+    trapq_free_moves(s_p_trapq, done_time);
     
-    /* 标记初始化完成 */
-    s_initialized = 1;
+    trapq_pool_get_stats(&stats);
+    return (int)(stats.total_frees - frees);
 }
 
-int
-toolhead_get_position(struct coord *p_pos)
+/**
+ * @brief   将队首运动段提交到 trapq 并出队
+ * @param   slot    队首运动段槽位
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_QUEUE 运动段内存池耗尽且无法回收
+ * 
+ * 内存池满时先回收已完成的运动段；仍无空间则推进步进生成，
+ * 等待步进电机消耗队列后重试，保证运动段不会被静默丢弃。
+ */
+static int
+lookahead_commit(int slot)
 {
-    /* 参数检查 */
-    if (p_pos == NULL) {
-        return TOOLHEAD_ERR_NULL;
+    const lookahead_queue_t *q = &s_lookahead;
+    
+    /* 计算梯形曲线参数 */
+    motion_t accel_t, cruise_t, decel_t;
+    calc_trapezoidal_profile(q->distance[slot], q->start_v[slot],
+                             q->cruise_v[slot], q->end_v[slot],
+                             q->accel[slot],
+                             &accel_t, &cruise_t, &decel_t);
+    
+    /* 添加到 trapq，内存池满时回收后重试 */
+    uint32_t tries = 0;
+    while (trapq_append(s_p_trapq, s_print_time,
+                        accel_t, cruise_t, decel_t,
+                        &q->start_pos[slot], &q->axes_r[slot],
+                        q->start_v[slot], q->cruise_v[slot],
+                        q->accel[slot]) != 0) {
+        if (trapq_reclaim() > 0) {
+            continue;
+        }
+        if (++tries > MOVE_RECLAIM_TRIES) {
+            return TOOLHEAD_ERR_QUEUE;
+        }
+        generate_steps(s_print_time);
+        sched_main();
     }
     
-    /* 复制命令位置 */
-    coord_copy(p_pos, &s_commanded_pos);
+    /* 更新打印时间 */
+    s_print_time += accel_t + cruise_t + decel_t;
+    
+    /* 更新当前位置 */
+    coord_copy(&s_current_pos, &q->end_pos[slot]);
+    
+    /* 出队 */
+    s_lookahead_head = (s_lookahead_head + 1) % LOOKAHEAD_SIZE;
+    s_lookahead_count--;
     
     return TOOLHEAD_OK;
 }
 
-int
-toolhead_set_position(const struct coord *p_pos)
+/**
+ * @brief   将队首若干运动段提交到 trapq
+ * @param   count   提交的运动段数
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_QUEUE 运动段内存池耗尽
+ * 
+ * 提交后新的队首起始速度已被确定，把它作为结点上限，
+ * 并只沿队列向后更新受其影响的加速可达上限。
+ */
+static int
+lookahead_commit_count(int count)
 {
-    /* 参数检查 */
-    if (p_pos == NULL) {
-        return TOOLHEAD_ERR_NULL;
+    lookahead_queue_t *q = &s_lookahead;
+    motion_t end_v = MOTION_C(0.0);
+    
+    for (int i = 0; i < count && s_lookahead_count > 0; i++) {
+        int slot = lookahead_at(0);
+        end_v = q->end_v[slot];
+        int ret = lookahead_commit(slot);
+        if (ret != TOOLHEAD_OK) {
+            return ret;
+        }
     }
     
-    /* 设置当前位置和命令位置 */
-    coord_copy(&s_current_pos, p_pos);
-    coord_copy(&s_commanded_pos, p_pos);
+    if (count <= 0 || s_lookahead_count == 0) {
+        return TOOLHEAD_OK;
+    }
     
-    /* 更新步进运动学位置 */
-    for (int i = 0; i < NUM_AXES; i++) {
-        if (s_steppers[i] != NULL) {
-            double pos = 0.0;
-            switch (i) {
-            case 0: pos = p_pos->x * s_steps_per_mm[0]; break;
-            case 1: pos = p_pos->y * s_steps_per_mm[1]; break;
-            case 2: pos = p_pos->z * s_steps_per_mm[2]; break;
-            case 3: pos = p_pos->e * s_steps_per_mm[3]; break;
-            }
-            itersolve_set_position(s_steppers[i], pos);
+    /* 固定新队首的起始速度为已提交运动的结束速度 */
+    motion_t end_v2 = end_v * end_v;
+    int prev = lookahead_at(0);
+    if (q->max_start_v2[prev] > end_v2) {
+        q->max_start_v2[prev] = end_v2;
+    }
+    if (q->max_smoothed_v2[prev] > end_v2) {
+        q->max_smoothed_v2[prev] = end_v2;
+    }
+    
+    for (int i = 1; i < s_lookahead_count; i++) {
+        int curr = lookahead_at(i);
+        motion_t start_v2 = q->max_start_v2[prev] + q->delta_v2[prev];
+        motion_t smoothed_v2 = q->max_smoothed_v2[prev]
+                               + q->smooth_delta_v2[prev];
+        if (q->max_start_v2[curr] <= start_v2 &&
+            q->max_smoothed_v2[curr] <= smoothed_v2) {
+            break;  /* 后续限制不受影响 */
         }
+        if (q->max_start_v2[curr] > start_v2) {
+            q->max_start_v2[curr] = start_v2;
+        }
+        if (q->max_smoothed_v2[curr] > smoothed_v2) {
+            q->max_smoothed_v2[curr] = smoothed_v2;
+        }
+        prev = curr;
     }
     
     return TOOLHEAD_OK;
 }
 
-int
-toolhead_move(const struct coord *p_end_pos, float speed)
+/**
+ * @brief   惰性刷新前瞻队列
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_QUEUE 运动段内存池耗尽
+ * 
+ * 只提交速度已经确定的运动段，不强制在队尾停止。
+ * 队列接近满而没有可确定的运动时，按队尾停止规划，
+ * 提交除最后 LOOKAHEAD_KEEP 段之外的运动。
+ */
+static int
+lookahead_flush_lazy(void)
 {
-    /* 参数检查 */
-    if (p_end_pos == NULL) {
-        return TOOLHEAD_ERR_NULL;
-    }
+    s_junction_flush = LOOKAHEAD_FLUSH_TIME;
     
-    if (s_p_trapq == NULL) {
-        return TOOLHEAD_ERR_QUEUE;
+    int count = lookahead_plan(1);
+    if (count == 0 && s_lookahead_count >= LOOKAHEAD_SIZE - LOOKAHEAD_KEEP) {
+        lookahead_plan(0);
+        count = s_lookahead_count - LOOKAHEAD_KEEP;
     }
     
-    /* 计算运动距离 */
-    double distance = calc_move_distance(&s_commanded_pos, p_end_pos);
-    
-    /* 忽略零距离运动 */
-    if (distance < MIN_MOVE_DISTANCE) {
+    return lookahead_commit_count(count);
+}
+
+/**
+ * @brief   刷新前瞻队列到 trapq
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_QUEUE 运动段内存池耗尽
+ * 
+ * 将前瞻队列中的运动全部转换为 trapq 运动段，最后一段结束时停止。
+ */
+static int
+lookahead_flush(void)
+{
+    s_junction_flush = LOOKAHEAD_FLUSH_TIME;
+    s_has_prev_move = 0;
+    
+    int count = lookahead_plan(0);
+    
+    for (int i = 0; i < count && s_lookahead_count > 0; i++) {
+        int ret = lookahead_commit(lookahead_at(0));
+        if (ret != TOOLHEAD_OK) {
+            return ret;
+        }
+    }
+    
+    /*
+     * 运动停止在队尾。留出整形的前后活动时间，使之后的步进可以
+     * 生成到停止后为止，而下一段运动不会改变已生成的步进。
+     */
+    if (count > 0) {
+        s_print_time += s_kin_flush_delay + s_kin_post_delay;
+    }
+    
+    return TOOLHEAD_OK;
+}
+
+/**
+ * @brief   打印时间转换为 64 位系统时钟
+ * @param   print_time  打印时间 (秒)
+ * @return  64 位系统时钟
+ */
+static sched_time64_t
+print_time_to_clock64(double print_time)
+{
+    return s_clock_base +
+           (sched_time64_t)(print_time * STEP_CLOCK_FREQ + 0.5);
+}
+
+/**
+ * @brief   打印时间转换为系统时钟
+ * @param   print_time  打印时间 (秒)
+ * @return  系统时钟 (允许回绕)
+ */
+static sched_time_t
+print_time_to_clock(double print_time)
+{
+    return (sched_time_t)print_time_to_clock64(print_time);
+}
+
+/**
+ * @brief   空闲时同步打印时间与系统时钟
+ * 
+ * 所有步进都已执行完毕时，若当前打印时间已落后于系统时钟，
+ * 则重新对齐时钟基准，使下一段运动从 "现在 + 提前量" 开始；
+ * 同时把各电机的步进基准时钟设为当前打印时间。
+ */
+static void
+sync_print_time(void)
+{
+    if (s_lookahead_count > 0) {
+        return;
+    }
+    
+    for (int i = 0; i < NUM_AXES; i++) {
+        if (!step_queue_empty(&s_step_queues[i]) ||
+            stepper_is_moving((stepper_id_t)i)) {
+            return;
+        }
+    }
+    
+    /* 64 位比较: 空闲超过半个 32 位周期后也能正确判断落后 */
+    sched_time64_t min_clock = sched_get_time64() +
+                               (sched_time64_t)(MOVE_LEAD_TIME * STEP_CLOCK_FREQ);
+    sched_time64_t clock = print_time_to_clock64(s_print_time);
+    
+    if (clock < min_clock) {
+        s_clock_base += min_clock - clock;
+        clock = min_clock;
+    }
+    
+    for (int i = 0; i < NUM_AXES; i++) {
+        s_last_step_clock[i] = (sched_time_t)clock;
+        stepper_reset_step_clock((stepper_id_t)i, (sched_time_t)clock);
+    }
+}
+
+/**
+ * @brief   将步进时间队列压缩后送入步进驱动
+ * @param   axis    轴索引
+ * @return  送入的步数
+ * 
+ * 同方向的连续步进压缩为 (interval, count, add) 运动段，
+ * 每步误差不超过 CONFIG_STEPCOMPRESS_MAX_ERROR 个时钟周期。
+ * 驱动队列满时停止，剩余步进保留到下次调用。
+ */
+static int
+step_queue_drain(int axis)
+{
+    struct step_queue *sq = &s_step_queues[axis];
+    uint32_t clocks[STEPCOMPRESS_WINDOW];
+    struct step_time step;
+    int count = 0;
+    
+    while (step_queue_peek(sq, &step) == 0) {
+        /* 收集同方向的步进时钟 */
+        int8_t dir = step.dir;
+        int num = 0;
+        while (num < STEPCOMPRESS_WINDOW &&
+               step_queue_peek_at(sq, num, &step) == 0 && step.dir == dir) {
+            clocks[num++] = print_time_to_clock(step.time);
+        }
+        
+        struct step_segment seg;
+        stepcompress_fit(clocks, num, s_last_step_clock[axis],
+                         CONFIG_STEPCOMPRESS_MAX_ERROR, &seg);
+        
+        stepper_move_t move;
+        move.position = 0;
+        move.target = 0;
+        move.interval = seg.interval;
+        move.count = seg.count;
+        move.add = seg.add;
+        move.dir = dir;
+        
+        if (stepper_queue_move((stepper_id_t)axis, &move) != 0) {
+            break;
+        }
+        
+        for (uint32_t i = 0; i < seg.count; i++) {
+            step_queue_pop(sq, &step);
+        }
+        s_last_step_clock[axis] = stepcompress_end_clock(s_last_step_clock[axis],
+                                                         &seg);
+        count += (int)seg.count;
+    }
+    
+    return count;
+}
+
+/**
+ * @brief   生成步进时序
+ * @param   flush_time  刷新时间
+ * 
+ * itersolve 生成的步进时间先进入每轴步进时间队列，再送入步进驱动；
+ * 队列满时 itersolve 在最后入队的步进处暂停，下次调用时继续。
+ * 输入整形的步进位置依赖之后的运动，只生成到 flush_time 之前
+ * s_kin_flush_delay 处。
+ */
+static void
+generate_steps(double flush_time)
+{
+    flush_time -= s_kin_flush_delay;
+    
+    for (int i = 0; i < NUM_AXES; i++) {
+        /* 归零时已被限位停止的电机不再接收步进 */
+        if (s_steppers[i] == NULL || (s_home_ctx.halted & (1u << i))) {
+            continue;
+        }
+        
+        step_queue_drain(i);
+        while (itersolve_generate_steps(s_steppers[i], flush_time) > 0) {
+            if (step_queue_drain(i) == 0) {
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief   按水位补充步进驱动队列
+ * @param   mask    待补充的轴位图 (bit = 轴索引)
+ * 
+ * 每轴只生成到驱动队列达到高水位为止，其余留在 trapq 中，等驱动
+ * 取段降到低水位 (stepper_take_refill_mask()) 时再小批量生成，
+ * 每次的工作量由队列深度而不是提交的运动量决定。
+ */
+static void
+refill_steps(uint32_t mask)
+{
+    double flush_time = s_print_time - s_kin_flush_delay;
+    
+    for (int i = 0; i < NUM_AXES; i++) {
+        if (!(mask & (1u << i)) || s_steppers[i] == NULL ||
+            (s_home_ctx.halted & (1u << i))) {
+            continue;
+        }
+        
+        step_queue_drain(i);
+        while (stepper_queue_want((stepper_id_t)i) > 0 &&
+               itersolve_generate_steps(s_steppers[i], flush_time) > 0) {
+            if (step_queue_drain(i) == 0) {
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief   丢弃所有未执行的步进
+ * 
+ * 用于运动被中止 (如归零触发限位) 后，清空步进时间队列并让
+ * itersolve 跳过已规划运动的剩余部分。
+ */
+static void
+discard_steps(void)
+{
+    for (int i = 0; i < NUM_AXES; i++) {
+        step_queue_init(&s_step_queues[i]);
+        if (s_steppers[i] != NULL) {
+            itersolve_set_flush_time(s_steppers[i], s_print_time);
+        }
+    }
+}
+
+/**
+ * @brief   定时刷新定时器回调 (中断上下文)
+ * 
+ * 步进生成不能在中断中进行，这里只置位标志，由 toolhead_task 处理。
+ */
+static sched_time_t
+flush_timer_event(sched_time_t waketime)
+{
+    s_flush_pending = 1;
+    return waketime + MOVE_FLUSH_TICKS;
+}
+
+/**
+ * @brief   定时刷新 (对应 Klipper toolhead._flush_handler)
+ * 
+ * 已提交的运动不足 BUFFER_TIME_LOW 时，前瞻队列中的运动不再等待
+ * 后续命令，按队尾停止全部提交。空闲后的第一条命令因此最多等待
+ * MOVE_LEAD_TIME - BUFFER_TIME_LOW 加一个刷新周期即开始运动。
+ * 然后把低于高水位的驱动队列补满并回收已执行的运动段: 空闲后
+ * 开始运动的轴还没有取段事件，由这里启动。
+ */
+static void
+flush_handler(void)
+{
+    double now = clock_to_print_time(sched_get_time());
+    
+    if (s_lookahead_count > 0 && s_print_time - now < BUFFER_TIME_LOW) {
+        lookahead_flush();
+    }
+    
+    refill_steps(~0u);
+    trapq_reclaim();
+}
+
+/**
+ * @brief   按 KINEMATICS 配置一个 X/Y/Z 步进电机的运动学
+ * @param   i   步进电机索引 (0~2)
+ * @param   sk  待配置的步进运动学
+ * 
+ * CoreXY 的 X/Y 电机分别是 A (x+y) / B (x-y)；三角洲的 X/Y/Z 电机
+ * 依次对应 A/B/C 塔。
+ */
+static void
+kin_stepper_setup(int i, struct stepper_kinematics *sk)
+{
+    switch (KINEMATICS) {
+    case KINEMATICS_COREXY:
+        if (i == 0 || i == 1) {
+            corexy_stepper_setup(sk, (i == 0) ? '+' : '-', s_steps_per_mm[i]);
+        } else {
+            cartesian_stepper_setup(sk, i, s_steps_per_mm[i]);
+        }
+        break;
+    case KINEMATICS_DELTA: {
+        double tower_x, tower_y;
+        double arm = DELTA_ARM_LENGTH;
+        delta_tower_position(i, DELTA_RADIUS, &tower_x, &tower_y);
+        delta_stepper_setup(sk, arm * arm, tower_x, tower_y,
+                            s_steps_per_mm[i]);
+        break;
+    }
+    default:
+        cartesian_stepper_setup(sk, i, s_steps_per_mm[i]);
+        break;
+    }
+}
+
+/**
+ * @brief   计算工具头位于某坐标时步进电机的位置
+ * @param   i       步进电机索引
+ * @param   p_pos   工具头坐标
+ * @return  步进位置 (步)
+ * 
+ * X/Y/Z 通过未整形的运动学回调在一个静止运动段上求值，因此对所有
+ * 运动学通用；挤出机直接按步数换算 (压力提前回调会遍历 trapq)。
+ */
+static double
+kin_calc_stepper_pos(int i, const struct coord *p_pos)
+{
+    struct stepper_kinematics *sk = s_kin_steppers[i];
+    
+    if (i == AXIS_E) {
+        return p_pos->e * s_steps_per_mm[AXIS_E];
+    }
+    if (sk == NULL) {
+        return 0.0;
+    }
+    
+    struct move m;
+    memset(&m, 0, sizeof(m));
+    coord_copy(&m.start_pos, p_pos);
+    return sk->calc_position_cb(sk, &m, MOTION_C(0.0));
+}
+
+/**
+ * @brief   检查目标位置是否在运动学的可达范围内
+ * @retval  TOOLHEAD_OK 可达
+ * @retval  TOOLHEAD_ERR_LIMIT 超出限位
+ */
+static int
+kin_check_limits(const struct coord *p_pos)
+{
+    if (KINEMATICS == KINEMATICS_DELTA) {
+        if (delta_check_limits(p_pos, DELTA_PRINT_RADIUS,
+                               s_min_pos[2], s_max_pos[2]) != 0) {
+            return TOOLHEAD_ERR_LIMIT;
+        }
         return TOOLHEAD_OK;
     }
     
-    /* 限制速度 */
-    double max_v = (double)speed;
-    if (max_v > s_config.max_velocity) {
-        max_v = s_config.max_velocity;
-    }
-    if (max_v < 0.001) {
-        max_v = s_config.max_velocity;
-    }
+    if (p_pos->x < s_min_pos[0] || p_pos->x > s_max_pos[0] ||
+        p_pos->y < s_min_pos[1] || p_pos->y > s_max_pos[1] ||
+        p_pos->z < s_min_pos[2] || p_pos->z > s_max_pos[2]) {
+        return TOOLHEAD_ERR_LIMIT;
+    }
+    return TOOLHEAD_OK;
+}
+
+/**
+ * @brief   切换某轴参与步进生成的运动学
+ * @param   axis    轴索引
+ * @param   sk      新的步进运动学
+ * 
+ * 步进位置和已刷新时间随之转移，切换前后步进连续。
+ */
+static void
+stepper_switch_kinematics(int axis, struct stepper_kinematics *sk)
+{
+    struct stepper_kinematics *cur = s_steppers[axis];
+    
+    if (cur == sk) {
+        return;
+    }
+    sk->commanded_pos = cur->commanded_pos;
+    sk->step_pos = cur->step_pos;
+    sk->last_flush_time = cur->last_flush_time;
+    sk->last_move_time = cur->last_move_time;
+    s_steppers[axis] = sk;
+}
+
+/**
+ * @brief   根据各轴运动学更新步进生成的前后活动时间
+ */
+static void
+update_kin_flush_delay(void)
+{
+    s_kin_flush_delay = 0.0;
+    s_kin_post_delay = 0.0;
+    
+    for (int i = 0; i < NUM_AXES; i++) {
+        if (s_steppers[i] == NULL) {
+            continue;
+        }
+        if (s_steppers[i]->gen_steps_pre_active > s_kin_flush_delay) {
+            s_kin_flush_delay = s_steppers[i]->gen_steps_pre_active;
+        }
+        if (s_steppers[i]->gen_steps_post_active > s_kin_post_delay) {
+            s_kin_post_delay = s_steppers[i]->gen_steps_post_active;
+        }
+    }
+}
+
+/**
+ * @brief   为某轴配置输入整形
+ * @param   axis            轴索引 (0=X, 1=Y)
+ * @param   type            INPUT_SHAPER_* 类型
+ * @param   freq            共振频率 (Hz)
+ * @param   damping_ratio   阻尼比
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_PARAM 参数无效
+ * @retval  TOOLHEAD_ERR_QUEUE 整形内存池耗尽
+ * 
+ * 调用前运动队列必须为空。
+ */
+static int
+shaper_apply(int axis, int type, double freq, double damping_ratio)
+{
+    struct stepper_kinematics *kin = s_kin_steppers[axis];
+    if (kin == NULL) {
+        return TOOLHEAD_ERR_QUEUE;
+    }
+    
+    /* 先把步进状态移回未整形的运动学 */
+    stepper_switch_kinematics(axis, kin);
+    
+    if (type != INPUT_SHAPER_NONE) {
+        if (s_shaper_steppers[axis] == NULL) {
+            s_shaper_steppers[axis] = input_shaper_alloc();
+            if (s_shaper_steppers[axis] == NULL) {
+                update_kin_flush_delay();
+                return TOOLHEAD_ERR_QUEUE;
+            }
+        }
+        
+        struct stepper_kinematics *sk = s_shaper_steppers[axis];
+        input_shaper_set_sk(sk, kin);
+        if (input_shaper_set_shaper(sk, type, freq, damping_ratio) != 0) {
+            update_kin_flush_delay();
+            return TOOLHEAD_ERR_PARAM;
+        }
+        s_steppers[axis] = sk;
+    }
+    
+    update_kin_flush_delay();
+    return TOOLHEAD_OK;
+}
+
+/**
+ * @brief   归零限位开关回调
+ */
+static void
+home_endstop_callback(endstop_id_t id, void *arg)
+{
+    (void)arg;
+    
+    uint8_t bit = (uint8_t)(1u << id);
+    if ((unsigned int)id >= 3 || !(s_home_ctx.group_mask & bit) ||
+        (s_home_ctx.triggered & bit)) {
+        return;
+    }
+    
+    /* 锁存触发时刻，主循环据此求出触发时的精确位置 */
+    s_home_ctx.trigger_clock[id] = endstop_get_trigger_clock(id);
+    
+    /* 停止对应的步进电机，同组其余轴继续运动 */
+    switch (id) {
+    case ENDSTOP_X:
+    case ENDSTOP_Y:
+        if (KINEMATICS == KINEMATICS_COREXY) {
+            /* CoreXY 的 X/Y 运动都由两个电机合成 */
+            stepper_stop(STEPPER_X);
+            stepper_stop(STEPPER_Y);
+            s_home_ctx.halted |= (1u << STEPPER_X) | (1u << STEPPER_Y);
+        } else {
+            stepper_id_t stepper = (id == ENDSTOP_X) ? STEPPER_X : STEPPER_Y;
+            stepper_stop(stepper);
+            s_home_ctx.halted |= (uint8_t)(1u << stepper);
+        }
+        break;
+    case ENDSTOP_Z:
+        stepper_stop(STEPPER_Z);
+        s_home_ctx.halted |= (1u << STEPPER_Z);
+        break;
+    default:
+        break;
+    }
+    
+    s_home_ctx.triggered |= bit;
+    trace_record(TRACE_ENDSTOP, (uint8_t)id, s_home_ctx.halted,
+                 s_home_ctx.trigger_clock[id], 0);
+}
+
+/**
+ * @brief   归零超时定时器回调 (中断上下文)
+ * @param   waketime    唤醒时间
+ * @return  0 (不再调度)
+ * 
+ * 到时仍有轴未触发限位时停止所有电机，由主循环报告归零失败。
+ */
+static sched_time_t
+home_timeout_event(sched_time_t waketime)
+{
+    (void)waketime;
+    stepper_stop_all();
+    s_home_ctx.halted = (1u << NUM_AXES) - 1;
+    s_home_ctx.timed_out = 1;
+    return 0;
+}
+
+/* ========== 细小线段合并 ========== */
+
+/**
+ * @brief   将一段运动加入前瞻队列
+ * @param   start_pos   起始位置
+ * @param   end_pos     结束位置
+ * @param   distance    运动距离
+ * @param   max_v       最大速度
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_QUEUE 队列满
+ * 
+ * 累计足够运动时间或队列接近满时进行惰性规划并生成步进。
+ */
+static int
+move_queue(const struct coord *start_pos, const struct coord *end_pos,
+           motion_t distance, motion_t max_v)
+{
+    /* 空闲后重新对齐打印时间 */
+    sync_print_time();
+    
+    /* 添加到前瞻队列 */
+    int slot = lookahead_push(start_pos, end_pos, distance, max_v);
+    if (slot < 0) {
+        /* 队列满，先刷新后从停止状态重试 */
+        if (lookahead_flush() != TOOLHEAD_OK) {
+            return TOOLHEAD_ERR_QUEUE;
+        }
+        slot = lookahead_push(start_pos, end_pos, distance, max_v);
+        if (slot < 0) {
+            return TOOLHEAD_ERR_QUEUE;
+        }
+    }
+    
+    /* 累计足够运动时间或队列接近满时，提交已确定的运动。
+     * 按已乘速度倍率并限幅的巡航速度计时，与规划一致 */
+    s_junction_flush -= distance / s_lookahead.cruise_v[slot];
+    if (s_junction_flush <= MOTION_C(0.0) ||
+        s_lookahead_count >= LOOKAHEAD_SIZE - LOOKAHEAD_KEEP) {
+        if (lookahead_flush_lazy() != TOOLHEAD_OK) {
+            return TOOLHEAD_ERR_QUEUE;
+        }
+        
+        /* 生成步进时序 (高水位以外留给取段事件) */
+        refill_steps(~0u);
+    }
+    
+    return TOOLHEAD_OK;
+}
+
+/**
+ * @brief   计算点到线段的距离平方 (仅 XYZ)
+ * @param   p   点
+ * @param   a   线段起点
+ * @param   b   线段终点
+ * @return  距离平方 (mm²)
+ */
+static motion_t
+coalesce_deviation2(const struct coord *p, const struct coord *a,
+                    const struct coord *b)
+{
+    motion_t abx = b->x - a->x;
+    motion_t aby = b->y - a->y;
+    motion_t abz = b->z - a->z;
+    motion_t apx = p->x - a->x;
+    motion_t apy = p->y - a->y;
+    motion_t apz = p->z - a->z;
+    
+    /* 投影参数限制在线段内，折返的顶点因此不会被当作共线 */
+    motion_t len2 = abx * abx + aby * aby + abz * abz;
+    motion_t t = MOTION_C(0.0);
+    if (len2 > MOTION_C(0.0)) {
+        t = (apx * abx + apy * aby + apz * abz) / len2;
+        if (t < MOTION_C(0.0)) {
+            t = MOTION_C(0.0);
+        } else if (t > MOTION_C(1.0)) {
+            t = MOTION_C(1.0);
+        }
+    }
+    
+    motion_t dx = apx - t * abx;
+    motion_t dy = apy - t * aby;
+    motion_t dz = apz - t * abz;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+/**
+ * @brief   以一段细小运动开始新的合并段
+ * @param   start_pos   起始位置
+ * @param   end_pos     结束位置
+ * @param   max_v       最大速度
+ * @retval  1 已放入合并缓冲
+ * @retval  0 不是细小线段 (或纯挤出运动)，应直接入队
+ */
+static int
+coalesce_start(const struct coord *start_pos, const struct coord *end_pos,
+               motion_t max_v)
+{
+    if (!CONFIG_MOVE_COALESCE) {
+        return 0;
+    }
+    
+    motion_t dx = end_pos->x - start_pos->x;
+    motion_t dy = end_pos->y - start_pos->y;
+    motion_t dz = end_pos->z - start_pos->z;
+    motion_t xyz = motion_sqrt(dx * dx + dy * dy + dz * dz);
+    if (xyz < MIN_MOVE_DISTANCE || xyz > (motion_t)COALESCE_MAX_SEGMENT) {
+        return 0;
+    }
+    
+    coord_copy(&s_coalesce.start_pos, start_pos);
+    coord_copy(&s_coalesce.end_pos, end_pos);
+    s_coalesce.num_points = 0;
+    s_coalesce.max_v = max_v;
+    s_coalesce.e_ratio = (end_pos->e - start_pos->e) / xyz;
+    s_coalesce.pending = 1;
+    
+    return 1;
+}
+
+/**
+ * @brief   尝试把一段细小运动并入合并缓冲
+ * @param   end_pos     新线段的结束位置 (起点为当前合并段终点)
+ * @param   max_v       最大速度
+ * @retval  1 已合并
+ * @retval  0 不满足合并条件
+ * 
+ * 条件: 新线段足够短、速度相同、挤出比与首段相差不超过
+ * COALESCE_E_RATIO_TOL，并且合并后弦长不超过 COALESCE_MAX_LENGTH，
+ * 所有中间顶点到新弦的距离不超过 COALESCE_TOLERANCE。
+ */
+static int
+coalesce_try_merge(const struct coord *end_pos, motion_t max_v)
+{
+    coalesce_t *c = &s_coalesce;
+    
+    if (!c->pending || c->num_points >= COALESCE_MAX_POINTS ||
+        max_v != c->max_v) {
+        return 0;
+    }
+    
+    motion_t dx = end_pos->x - c->end_pos.x;
+    motion_t dy = end_pos->y - c->end_pos.y;
+    motion_t dz = end_pos->z - c->end_pos.z;
+    motion_t xyz = motion_sqrt(dx * dx + dy * dy + dz * dz);
+    if (xyz < MIN_MOVE_DISTANCE || xyz > (motion_t)COALESCE_MAX_SEGMENT) {
+        return 0;
+    }
+    
+    /* 与首段比较，避免逐段漂移 */
+    motion_t e_ratio = (end_pos->e - c->end_pos.e) / xyz;
+    if (motion_fabs(e_ratio - c->e_ratio) >
+        (motion_t)COALESCE_E_RATIO_TOL * motion_fabs(c->e_ratio)) {
+        return 0;
+    }
+    
+    dx = end_pos->x - c->start_pos.x;
+    dy = end_pos->y - c->start_pos.y;
+    dz = end_pos->z - c->start_pos.z;
+    if (dx * dx + dy * dy + dz * dz >
+        (motion_t)COALESCE_MAX_LENGTH * (motion_t)COALESCE_MAX_LENGTH) {
+        return 0;
+    }
+    
+    /* 当前终点和之前合并掉的顶点都必须贴近新弦 */
+    motion_t tol2 = (motion_t)COALESCE_TOLERANCE * (motion_t)COALESCE_TOLERANCE;
+    if (coalesce_deviation2(&c->end_pos, &c->start_pos, end_pos) > tol2) {
+        return 0;
+    }
+    for (int i = 0; i < c->num_points; i++) {
+        if (coalesce_deviation2(&c->points[i], &c->start_pos, end_pos) > tol2) {
+            return 0;
+        }
+    }
+    
+    coord_copy(&c->points[c->num_points++], &c->end_pos);
+    coord_copy(&c->end_pos, end_pos);
+    
+    return 1;
+}
+
+/**
+ * @brief   将合并缓冲中的线段加入前瞻队列
+ * @retval  TOOLHEAD_OK 成功 (或缓冲为空)
+ * @retval  TOOLHEAD_ERR_QUEUE 队列满
+ */
+static int
+coalesce_flush(void)
+{
+    if (!s_coalesce.pending) {
+        return TOOLHEAD_OK;
+    }
+    s_coalesce.pending = 0;
+    
+    motion_t distance = calc_move_distance(&s_coalesce.start_pos,
+                                           &s_coalesce.end_pos);
+    return move_queue(&s_coalesce.start_pos, &s_coalesce.end_pos,
+                      distance, s_coalesce.max_v);
+}
+
+/**
+ * @brief   检查 trapq 能否再接收一个运动段
+ * @retval  1 下一次惰性刷新不会等待 trapq 内存池
+ * 
+ * 一次惰性刷新最多提交整个前瞻队列 (含合并缓冲中的一段)。
+ */
+static int
+move_space_available(void)
+{
+    return trapq_pool_available() >=
+           (uint32_t)(s_lookahead_count + s_coalesce.pending + 1);
+}
+
+/**
+ * @brief   将请求速度限制在允许范围内
+ * @param   speed   请求速度 (mm/s)，过小时取最大速度
+ * @return  限制后的速度 (mm/s)
+ */
+static motion_t
+clamp_velocity(float speed)
+{
+    motion_t max_v = (motion_t)speed;
+    if (max_v > s_config.max_velocity) {
+        max_v = s_config.max_velocity;
+    }
+    if (max_v < MOTION_C(0.001)) {
+        max_v = s_config.max_velocity;
+    }
+    return max_v;
+}
+
+/* ========== 圆弧分段 ========== */
+
+/**
+ * @brief   计算圆弧的分段计划
+ * @param   p_arc       圆弧计划 (start_pos/end_pos 已填写)
+ * @param   offset_i    圆心相对起点的 X 偏移
+ * @param   offset_j    圆心相对起点的 Y 偏移
+ * @param   clockwise   1 顺时针
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_PARAM 半径过小
+ * 
+ * 弦偏差为 tol 时每段最大转角为 2*acos(1 - tol/r)。
+ * 终点与起点同角度时按整圆处理。
+ */
+static int
+arc_plan_init(arc_plan_t *p_arc, double offset_i, double offset_j,
+              int clockwise)
+{
+    double r0_x = -offset_i;
+    double r0_y = -offset_j;
+    double radius = sqrt(r0_x * r0_x + r0_y * r0_y);
+    if (radius < ARC_MIN_RADIUS) {
+        return TOOLHEAD_ERR_PARAM;
+    }
+    
+    p_arc->center_x = (double)p_arc->start_pos.x + offset_i;
+    p_arc->center_y = (double)p_arc->start_pos.y + offset_j;
+    double r1_x = (double)p_arc->end_pos.x - p_arc->center_x;
+    double r1_y = (double)p_arc->end_pos.y - p_arc->center_y;
+    
+    /* 有符号转角，按方向展开到 (-2π, 0) 或 (0, 2π] */
+    double angle = atan2(r0_x * r1_y - r0_y * r1_x, r0_x * r1_x + r0_y * r1_y);
+    if (clockwise) {
+        if (angle >= -ARC_ANGLE_EPSILON) {
+            angle -= 2.0 * ARC_PI;
+        }
+    } else if (angle <= ARC_ANGLE_EPSILON) {
+        angle += 2.0 * ARC_PI;
+    }
+    
+    /* 由弦偏差确定分段数 */
+    double max_seg_angle = ARC_PI / 2.0;
+    if ((double)ARC_TOLERANCE < radius) {
+        double seg = 2.0 * acos(1.0 - (double)ARC_TOLERANCE / radius);
+        if (seg < max_seg_angle) {
+            max_seg_angle = seg;
+        }
+    }
+    int segments = (int)ceil(fabs(angle) / max_seg_angle);
+    if (segments < 1) {
+        segments = 1;
+    }
+    if (segments > ARC_MAX_SEGMENTS) {
+        segments = ARC_MAX_SEGMENTS;
+    }
+    
+    p_arc->radius = radius;
+    p_arc->start_angle = atan2(r0_y, r0_x);
+    p_arc->seg_angle = angle / segments;
+    p_arc->r0_x = (motion_t)r0_x;
+    p_arc->r0_y = (motion_t)r0_y;
+    p_arc->cos_t = (motion_t)cos(p_arc->seg_angle);
+    p_arc->sin_t = (motion_t)sin(p_arc->seg_angle);
+    p_arc->segments = segments;
+    return TOOLHEAD_OK;
+}
+
+/**
+ * @brief   游标指向圆弧起点
+ * @param   p_cur   游标
+ * @param   p_arc   圆弧计划
+ * @param   max_v   请求速度
+ */
+static void
+arc_cursor_start(arc_cursor_t *p_cur, const arc_plan_t *p_arc, motion_t max_v)
+{
+    p_cur->plan = *p_arc;
+    coord_copy(&p_cur->prev, &p_arc->start_pos);
+    p_cur->r_x = p_arc->r0_x;
+    p_cur->r_y = p_arc->r0_y;
+    p_cur->max_v = max_v;
+    p_cur->next = 1;
+    p_cur->active = 1;
+}
+
+/**
+ * @brief   生成下一个分段端点并前移游标
+ * @param   p_cur   游标 (next 不超过 segments)
+ * @param   p_pos   输出分段端点
+ * 
+ * 最后一点取精确的终点。
+ */
+static void
+arc_cursor_next(arc_cursor_t *p_cur, struct coord *p_pos)
+{
+    const arc_plan_t *p_arc = &p_cur->plan;
+    int k = p_cur->next++;
+    
+    if (k == p_arc->segments) {
+        coord_copy(p_pos, &p_arc->end_pos);
+        return;
+    }
+    
+    if (k % ARC_CORRECTION_SEGMENTS == 0) {
+        double a = p_arc->start_angle + k * p_arc->seg_angle;
+        p_cur->r_x = (motion_t)(p_arc->radius * cos(a));
+        p_cur->r_y = (motion_t)(p_arc->radius * sin(a));
+    } else {
+        motion_t t = p_cur->r_x * p_arc->cos_t - p_cur->r_y * p_arc->sin_t;
+        p_cur->r_y = p_cur->r_x * p_arc->sin_t + p_cur->r_y * p_arc->cos_t;
+        p_cur->r_x = t;
+    }
+    
+    motion_t frac = (motion_t)k / (motion_t)p_arc->segments;
+    p_pos->x = (motion_t)p_arc->center_x + p_cur->r_x;
+    p_pos->y = (motion_t)p_arc->center_y + p_cur->r_y;
+    p_pos->z = p_arc->start_pos.z
+               + (p_arc->end_pos.z - p_arc->start_pos.z) * frac;
+    p_pos->e = p_arc->start_pos.e
+               + (p_arc->end_pos.e - p_arc->start_pos.e) * frac;
+}
+
+/**
+ * @brief   检查圆弧所有分段端点都在限位内
+ * @param   p_arc   圆弧计划
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_LIMIT 分段端点超出限位
+ * 
+ * 与入队时生成相同的点序列，超限时不留下半段圆弧。
+ */
+static int
+arc_check_limits(const arc_plan_t *p_arc)
+{
+    arc_cursor_t cur;
+    struct coord pos;
+    
+    arc_cursor_start(&cur, p_arc, MOTION_C(0.0));
+    while (cur.next <= p_arc->segments) {
+        arc_cursor_next(&cur, &pos);
+        if (kin_check_limits(&pos) != TOOLHEAD_OK) {
+            return TOOLHEAD_ERR_LIMIT;
+        }
+    }
+    
+    return TOOLHEAD_OK;
+}
+
+/**
+ * @brief   在 trapq 空间允许的范围内入队圆弧分段
+ * @retval  TOOLHEAD_OK 成功 (可能还有分段未入队)
+ * @retval  TOOLHEAD_ERR_QUEUE 入队失败，剩余分段丢弃
+ * 
+ * 每段入队前确认惰性刷新能提交整个前瞻队列，不会在
+ * lookahead_commit() 中等待内存池。剩余分段由 toolhead_task()
+ * 和 toolhead_moves_done() 在释放运动段后继续入队。
+ */
+static int
+arc_emit(void)
+{
+    arc_cursor_t *p_cur = &s_arc;
+    struct coord pos;
+    
+    while (p_cur->active && move_space_available()) {
+        if (p_cur->next > p_cur->plan.segments) {
+            p_cur->active = 0;
+            break;
+        }
+        
+        arc_cursor_next(p_cur, &pos);
+        motion_t distance = calc_move_distance(&p_cur->prev, &pos);
+        if (distance < MIN_MOVE_DISTANCE) {
+            continue;
+        }
+        if (move_queue(&p_cur->prev, &pos, distance,
+                       p_cur->max_v) != TOOLHEAD_OK) {
+            /* 命令位置退回到最后入队的端点 */
+            p_cur->active = 0;
+            coord_copy(&s_commanded_pos, &p_cur->prev);
+            return TOOLHEAD_ERR_QUEUE;
+        }
+        coord_copy(&p_cur->prev, &pos);
+    }
+    
+    if (p_cur->active && p_cur->next > p_cur->plan.segments) {
+        p_cur->active = 0;
+    }
+    
+    return TOOLHEAD_OK;
+}
+
+/**
+ * @brief   入队圆弧的全部剩余分段 (阻塞)
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_QUEUE 入队失败
+ * 
+ * 新运动或位置设置之前调用，保持运动顺序。G-code 层按
+ * toolhead_can_accept_move() 推迟命令时不会在此等待。
+ */
+static int
+arc_finish(void)
+{
+    while (s_arc.active) {
+        if (arc_emit() != TOOLHEAD_OK) {
+            return TOOLHEAD_ERR_QUEUE;
+        }
+        if (s_arc.active) {
+            generate_steps(s_print_time);
+            trapq_reclaim();
+            sched_main();
+        }
+    }
+    
+    return TOOLHEAD_OK;
+}
+
+/* ========== 归零状态机 ========== */
+
+/**
+ * @brief   轴在 coord 中的分量
+ */
+static motion_t *
+coord_axis(struct coord *p_pos, int axis)
+{
+    return (axis == 0) ? &p_pos->x : (axis == 1) ? &p_pos->y : &p_pos->z;
+}
+
+/**
+ * @brief   检查是否正在归零
+ */
+static int
+home_active(void)
+{
+    return s_home_ctx.state != HOME_STATE_IDLE &&
+           s_home_ctx.state != HOME_STATE_DONE &&
+           s_home_ctx.state != HOME_STATE_ERROR;
+}
+
+/**
+ * @brief   检查所有步进电机是否已停止
+ */
+static int
+steppers_idle(void)
+{
+    return !stepper_is_moving(STEPPER_X) &&
+           !stepper_is_moving(STEPPER_Y) &&
+           !stepper_is_moving(STEPPER_Z) &&
+           !stepper_is_moving(STEPPER_E);
+}
+
+/**
+ * @brief   选出下一组可以并行归零的轴
+ * @param   remaining   尚未归零的轴
+ * @return  轴掩码，0 表示全部完成
+ * 
+ * 笛卡尔的 X/Y 由独立电机驱动，一起归零后再归零 Z；CoreXY 的 X/Y
+ * 共用两个电机，只能逐轴归零；三角洲的三个塔总是一起归零。
+ */
+static uint8_t
+home_next_group(uint8_t remaining)
+{
+    if (remaining == 0 || KINEMATICS == KINEMATICS_DELTA) {
+        return remaining;
+    }
+    
+    uint8_t xy = remaining & (AXIS_X_MASK | AXIS_Y_MASK);
+    if (xy == 0) {
+        return remaining & AXIS_Z_MASK;
+    }
+    if (KINEMATICS == KINEMATICS_COREXY) {
+        return (xy & AXIS_X_MASK) ? AXIS_X_MASK : AXIS_Y_MASK;
+    }
+    return xy;
+}
+
+/**
+ * @brief   轴的归零位置 (限位开关所在坐标)
+ */
+static double
+home_axis_pos(int axis)
+{
+    if (KINEMATICS == KINEMATICS_DELTA) {
+        return s_home_ctx.saved_max[2];
+    }
+    return s_home_ctx.saved_min[axis];
+}
+
+/**
+ * @brief   打印时间对应的系统时钟换算为打印时间
+ * @param   clock   系统时钟 (允许回绕)
+ * @return  打印时间 (秒)
+ */
+static double
+clock_to_print_time(sched_time_t clock)
+{
+    sched_time_t now = print_time_to_clock(s_print_time);
+    return s_print_time +
+           (double)sched_time_diff(clock, now) / (double)STEP_CLOCK_FREQ;
+}
+
+/**
+ * @brief   丢弃被中止的归零运动
+ * @param   stop_time   电机停止时的打印时间
+ * 
+ * trapq 中的剩余运动全部释放，打印时间回到停止时刻，
+ * 之后的运动从这里接续 (已落后于时钟时由 sync_print_time 对齐)。
+ */
+static void
+home_abort_moves(double stop_time)
+{
+    sched_del_timer(&s_home_timer);
+    stepper_stop_all();
+    
+    trapq_finalize_moves(s_p_trapq, s_print_time);
+    trapq_free_moves(s_p_trapq, s_print_time + 1.0);
+    s_print_time = stop_time;
+    discard_steps();
+    s_home_ctx.halted = 0;
+}
+
+/**
+ * @brief   结束本组的归零模式
+ */
+static void
+home_end_endstops(void)
+{
+    for (int i = 0; i < 3; i++) {
+        if (s_home_ctx.group_mask & (1u << i)) {
+            endstop_home_end((endstop_id_t)i);
+        }
+    }
+}
+
+/**
+ * @brief   恢复归零期间放开的限位
+ */
+static void
+home_restore_limits(void)
+{
+    for (int i = 0; i < NUM_AXES; i++) {
+        s_min_pos[i] = s_home_ctx.saved_min[i];
+        s_max_pos[i] = s_home_ctx.saved_max[i];
+    }
+}
+
+/**
+ * @brief   开始一个归零阶段
+ * @param   state   HOME_STATE_FAST / RETRACT / SLOW / FINISH
+ * 
+ * 本组各轴同时运动: FAST/SLOW 向限位开关运动直到触发，
+ * RETRACT/FINISH 从开关处回退 HOMING_RETRACT。
+ * 运动立即刷新到 trapq，由主循环补充步进。
+ */
+static void
+home_phase_start(home_state_t state)
+{
+    uint8_t group = s_home_ctx.group_mask;
+    double sign = (KINEMATICS == KINEMATICS_DELTA) ? 1.0 : -1.0;
+    double offset;
+    double speed;
+    
+    switch (state) {
+    case HOME_STATE_FAST:
+        offset = HOMING_OVERTRAVEL;
+        speed = HOMING_SPEED * 2.0;
+        break;
+    case HOME_STATE_SLOW:
+        offset = HOMING_RETRACT;
+        speed = HOMING_SLOW_SPEED;
+        break;
+    default:
+        offset = -HOMING_RETRACT;
+        speed = HOMING_SPEED;
+        break;
+    }
+    
+    struct coord target;
+    coord_copy(&target, &s_commanded_pos);
+    for (int i = 0; i < 3; i++) {
+        /* 三角洲: 滑车同速移向顶部限位，喷头只有 Z 运动 */
+        if ((group & (1u << i)) &&
+            (KINEMATICS != KINEMATICS_DELTA || i == 2)) {
+            *coord_axis(&target, i) = (motion_t)(home_axis_pos(i) +
+                                                 sign * offset);
+        }
+    }
+    
+    s_home_ctx.state = state;
+    s_home_ctx.triggered = 0;
+    s_home_ctx.halted = 0;
+    s_home_ctx.timed_out = 0;
+    
+    if (state == HOME_STATE_FAST || state == HOME_STATE_SLOW) {
+        for (int i = 0; i < 3; i++) {
+            if (group & (1u << i)) {
+                endstop_set_callback((endstop_id_t)i, home_endstop_callback,
+                                     NULL);
+                endstop_home_start((endstop_id_t)i);
+            }
+        }
+        
+        s_home_timer.func = home_timeout_event;
+        s_home_timer.waketime = sched_get_time() +
+                                (sched_time_t)(HOMING_TIMEOUT * STEP_CLOCK_FREQ);
+        sched_add_timer(&s_home_timer);
+    }
+    
+    toolhead_move(&target, (float)speed);
+    toolhead_flush();
+    
+    struct move *m = trapq_last_move(s_p_trapq);
+    s_home_ctx.phase_time = (m != NULL) ? m->print_time : s_print_time;
+}
+
+/**
+ * @brief   本组所有限位都已触发: 按触发时刻确定位置
+ * 
+ * 各轴在各自的触发时刻停止。已归零的轴位于开关坐标；其余轴
+ * (如 CoreXY 中随之停止的另一轴) 取最后一次触发时刻的轨迹位置。
+ */
+static void
+home_phase_triggered(void)
+{
+    uint8_t group = s_home_ctx.group_mask;
+    double stop_time = s_home_ctx.phase_time;
+    
+    for (int i = 0; i < 3; i++) {
+        if (!(group & (1u << i))) {
+            continue;
+        }
+        double t = clock_to_print_time(s_home_ctx.trigger_clock[i]);
+        if (t > s_print_time) {
+            t = s_print_time;
+        }
+        if (t > stop_time) {
+            stop_time = t;
+        }
+    }
+    
+    struct coord pos;
+    struct coord trig;
+    coord_copy(&pos, &s_commanded_pos);
+    if (trapq_get_position(s_p_trapq, stop_time, &trig) == 0) {
+        pos.x = trig.x;
+        pos.y = trig.y;
+        pos.z = trig.z;
+    }
+    
+    if (KINEMATICS == KINEMATICS_DELTA) {
+        /* 滑车都在顶部限位时，喷头位于中心的最高点 */
+        pos.x = MOTION_C(0.0);
+        pos.y = MOTION_C(0.0);
+        pos.z = (motion_t)home_axis_pos(2);
+    } else {
+        for (int i = 0; i < 3; i++) {
+            if (group & (1u << i)) {
+                *coord_axis(&pos, i) = (motion_t)home_axis_pos(i);
+            }
+        }
+    }
+    
+    home_abort_moves(stop_time);
+    home_end_endstops();
+    toolhead_set_position(&pos);
+    
+    home_phase_start((s_home_ctx.state == HOME_STATE_FAST) ?
+                     HOME_STATE_RETRACT : HOME_STATE_FINISH);
+}
+
+/**
+ * @brief   推进归零状态机 (主循环)
+ */
+static void
+home_task(void)
+{
+    switch (s_home_ctx.state) {
+    case HOME_STATE_FAST:
+    case HOME_STATE_SLOW:
+        /* 轮询式限位 (无中断回调时) 在此补充检测 */
+        for (int i = 0; i < 3; i++) {
+            uint8_t bit = (uint8_t)(1u << i);
+            if ((s_home_ctx.group_mask & bit) &&
+                !(s_home_ctx.triggered & bit) &&
+                endstop_is_triggered((endstop_id_t)i)) {
+                home_endstop_callback((endstop_id_t)i, NULL);
+            }
+        }
+        
+        if ((s_home_ctx.triggered & s_home_ctx.group_mask) ==
+            s_home_ctx.group_mask) {
+            home_phase_triggered();
+        } else if (s_home_ctx.timed_out) {
+            double now = clock_to_print_time(sched_get_time());
+            home_abort_moves((now < s_print_time) ? now : s_print_time);
+            home_end_endstops();
+            home_restore_limits();
+            s_home_ctx.state = HOME_STATE_ERROR;
+        }
+        break;
+        
+    case HOME_STATE_RETRACT:
+    case HOME_STATE_FINISH:
+        generate_steps(s_print_time);
+        if (!steppers_idle()) {
+            break;
+        }
+        if (s_home_ctx.state == HOME_STATE_RETRACT) {
+            home_phase_start(HOME_STATE_SLOW);
+            break;
+        }
+        
+        /* 本组完成，开始下一组 */
+        s_home_ctx.axis_mask &= (uint8_t)~s_home_ctx.group_mask;
+        s_home_ctx.group_mask = home_next_group(s_home_ctx.axis_mask);
+        if (s_home_ctx.group_mask != 0) {
+            home_phase_start(HOME_STATE_FAST);
+        } else {
+            coord_copy(&s_current_pos, &s_commanded_pos);
+            home_restore_limits();
+            s_home_ctx.state = HOME_STATE_DONE;
+        }
+        break;
+        
+    default:
+        break;
+    }
+}
+
+/* ========== 公有函数实现 ========== */
+
+void
+toolhead_init(void)
+{
+    /* 防止重复初始化 */
+    if (s_initialized) {
+        return;
+    }
+    
+    /* 初始化 trapq 内存池 */
+    trapq_pool_init();
+    
+    /* 初始化 itersolve 内存池 */
+    itersolve_pool_init();
+    
+    /* 分配运动队列 */
+    s_p_trapq = trapq_alloc();
+    if (s_p_trapq == NULL) {
+        /* 内存池分配失败 - 严重错误 */
+        return;
+    }
+    
+    /* 初始化默认配置 */
+    config_init_defaults();
+    
+    /* 分配并配置步进运动学 */
+    for (int i = 0; i < NUM_AXES; i++) {
+        if (i == AXIS_E) {
+            /* 挤出机使用带压力提前的运动学 */
+            s_steppers[i] = extruder_stepper_alloc();
+        } else {
+            s_steppers[i] = itersolve_alloc();
+        }
+        if (s_steppers[i] != NULL) {
+            if (i == AXIS_E) {
+                extruder_stepper_setup(s_steppers[i], s_steps_per_mm[i]);
+            } else {
+                kin_stepper_setup(i, s_steppers[i]);
+            }
+            itersolve_set_trapq(s_steppers[i], s_p_trapq);
+            step_queue_init(&s_step_queues[i]);
+            itersolve_set_step_queue(s_steppers[i], &s_step_queues[i]);
+        }
+        s_kin_steppers[i] = s_steppers[i];
+    }
+    
+    /* 配置默认输入整形 */
+    shaper_apply(0, SHAPER_TYPE_X, SHAPER_FREQ_X, SHAPER_DAMPING_RATIO);
+    shaper_apply(1, SHAPER_TYPE_Y, SHAPER_FREQ_Y, SHAPER_DAMPING_RATIO);
+    
+    /* 配置默认压力提前 */
+    if (s_steppers[AXIS_E] != NULL) {
+        extruder_set_pressure_advance(s_steppers[AXIS_E], PRESSURE_ADVANCE,
+                                      PRESSURE_ADVANCE_SMOOTH_TIME);
+        update_kin_flush_delay();
+    }
+    
+    /* 初始化位置为零 */
+    coord_clear(&s_current_pos);
+    coord_clear(&s_commanded_pos);
+    
+    /* 初始化打印时间 */
+    s_print_time = 0.0;
+    s_clock_base = sched_get_time64();
+    
+    /* 初始化前瞻队列 */
+    s_lookahead_head = 0;
+    s_lookahead_tail = 0;
+    s_lookahead_count = 0;
+    s_has_prev_move = 0;
+    s_junction_flush = LOOKAHEAD_FLUSH_TIME;
+    s_coalesce.pending = 0;
+    s_arc.active = 0;
+    
+    /* 启动定时刷新 */
+    s_flush_pending = 0;
+    s_flush_timer.func = flush_timer_event;
+    s_flush_timer.waketime = sched_get_time() + MOVE_FLUSH_TICKS;
+    sched_add_timer(&s_flush_timer);
+    
+    /* 初始化归零上下文 */
+    sched_del_timer(&s_home_timer);
+    memset(&s_home_ctx, 0, sizeof(s_home_ctx));
+    s_home_ctx.state = HOME_STATE_IDLE;
     
-    /* 检查位置限位 */
-    if (p_end_pos->x < s_min_pos[0] || p_end_pos->x > s_max_pos[0] ||
-        p_end_pos->y < s_min_pos[1] || p_end_pos->y > s_max_pos[1] ||
-        p_end_pos->z < s_min_pos[2] || p_end_pos->z > s_max_pos[2]) {
-        return TOOLHEAD_ERR_LIMIT;
+    /* 标记初始化完成 */
+    s_initialized = 1;
+}
+
+int
+toolhead_get_position(struct coord *p_pos)
+{
+    /* 参数检查 */
+    if (p_pos == NULL) {
+        return TOOLHEAD_ERR_NULL;
     }
     
-    /* 创建前瞻运动段 */
-    lookahead_move_t move;
-    coord_copy(&move.start_pos, &s_commanded_pos);
-    coord_copy(&move.end_pos, p_end_pos);
-    move.distance = distance;
-    move.max_velocity = max_v;
-    move.max_cruise_v = max_v;
-    move.max_start_v = max_v;
-    move.max_end_v = max_v;
-    move.start_v = 0.0;
-    move.cruise_v = max_v;
-    move.end_v = 0.0;
-    move.valid = 1;
+    /* 复制命令位置 */
+    coord_copy(p_pos, &s_commanded_pos);
     
-    /* 添加到前瞻队列 */
-    if (lookahead_push(&move) != 0) {
-        /* 队列满，先刷新 */
-        lookahead_process();
-        lookahead_flush();
-        
-        /* 重试 */
-        if (lookahead_push(&move) != 0) {
-            return TOOLHEAD_ERR_QUEUE;
-        }
+    return TOOLHEAD_OK;
+}
+
+int
+toolhead_set_position(const struct coord *p_pos)
+{
+    /* 参数检查 */
+    if (p_pos == NULL) {
+        return TOOLHEAD_ERR_NULL;
     }
     
-    /* 更新命令位置 */
-    coord_copy(&s_commanded_pos, p_end_pos);
+    /* 合并中的线段和圆弧剩余分段按旧坐标入队 */
+    arc_finish();
+    coalesce_flush();
     
-    /* 如果队列接近满，处理前瞻 */
-    if (s_lookahead_count >= LOOKAHEAD_SIZE - 2) {
-        lookahead_process();
-        
-        /* 保留最后几个运动用于前瞻 */
-        while (s_lookahead_count > 2) {
-            lookahead_move_t m;
-            if (lookahead_pop(&m) == 0) {
-                /* 计算梯形曲线参数 */
-                double accel_t, cruise_t, decel_t;
-                calc_trapezoidal_profile(m.distance, m.start_v, m.cruise_v,
-                                         m.end_v, s_config.max_accel,
-                                         &accel_t, &cruise_t, &decel_t);
-                
-                /* 计算方向向量 */
-                struct coord axes_r;
-                cartesian_calc_direction(&m.start_pos, &m.end_pos, &axes_r);
-                
-                /* 添加到 trapq */
-                trapq_append(s_p_trapq, s_print_time,
-                             accel_t, cruise_t, decel_t,
-                             &m.start_pos, &axes_r,
-                             m.start_v, m.cruise_v, s_config.max_accel);
-                
-                /* 更新打印时间 */
-                s_print_time += accel_t + cruise_t + decel_t;
-                
-                /* 更新当前位置 */
-                coord_copy(&s_current_pos, &m.end_pos);
-            }
+    /* 设置当前位置和命令位置 */
+    coord_copy(&s_current_pos, p_pos);
+    coord_copy(&s_commanded_pos, p_pos);
+    
+    /* 更新步进运动学位置 */
+    for (int i = 0; i < NUM_AXES; i++) {
+        if (s_steppers[i] != NULL) {
+            itersolve_set_position(s_steppers[i],
+                                   kin_calc_stepper_pos(i, p_pos));
         }
-        
-        /* 生成步进时序 */
-        generate_steps(s_print_time);
     }
     
     return TOOLHEAD_OK;
 }
 
 int
-toolhead_home(uint8_t axes_mask)
+toolhead_move(const struct coord *p_end_pos, float speed)
 {
-    /* 等待当前运动完成 */
-    toolhead_wait_moves();
-    
-    /* 设置归零回调 */
-    if (axes_mask & AXIS_X_MASK) {
-        endstop_set_callback(ENDSTOP_X, home_endstop_callback, NULL);
-        endstop_home_start(ENDSTOP_X);
-    }
-    if (axes_mask & AXIS_Y_MASK) {
-        endstop_set_callback(ENDSTOP_Y, home_endstop_callback, NULL);
-        endstop_home_start(ENDSTOP_Y);
-    }
-    if (axes_mask & AXIS_Z_MASK) {
-        endstop_set_callback(ENDSTOP_Z, home_endstop_callback, NULL);
-        endstop_home_start(ENDSTOP_Z);
+    /* 参数检查 */
+    if (p_end_pos == NULL) {
+        return TOOLHEAD_ERR_NULL;
     }
     
-    /* 初始化归零上下文 */
-    s_home_ctx.state = HOME_STATE_FAST;
-    s_home_ctx.axis_mask = axes_mask;
-    s_home_ctx.triggered = 0;
-    s_home_ctx.start_time = s_print_time;
-    
-    /* 快速归零: 向负方向运动直到触发限位 */
-    struct coord home_target;
-    coord_copy(&home_target, &s_commanded_pos);
-    
-    /* 设置归零目标 (向负方向移动最大行程) */
-    if (axes_mask & AXIS_X_MASK) {
-        home_target.x = s_min_pos[0] - 10.0;  /* 超出限位一点 */
-    }
-    if (axes_mask & AXIS_Y_MASK) {
-        home_target.y = s_min_pos[1] - 10.0;
+    if (s_p_trapq == NULL) {
+        return TOOLHEAD_ERR_QUEUE;
     }
-    if (axes_mask & AXIS_Z_MASK) {
-        home_target.z = s_min_pos[2] - 10.0;
+    
+    /* 圆弧剩余分段先入队 */
+    if (arc_finish() != TOOLHEAD_OK) {
+        return TOOLHEAD_ERR_QUEUE;
     }
     
-    /* 临时禁用限位检查，执行归零运动 */
-    double saved_min[NUM_AXES];
-    for (int i = 0; i < NUM_AXES; i++) {
-        saved_min[i] = s_min_pos[i];
-        s_min_pos[i] = -1e9;
+    /* 计算运动距离 */
+    motion_t distance = calc_move_distance(&s_commanded_pos, p_end_pos);
+    
+    /* 忽略零距离运动 */
+    if (distance < MIN_MOVE_DISTANCE) {
+        return TOOLHEAD_OK;
     }
     
-    /* 执行快速归零运动 */
-    toolhead_move(&home_target, HOMING_SPEED * 2.0f);
+    /* 限制速度 */
+    motion_t max_v = clamp_velocity(speed);
     
-    /* 刷新并等待 */
-    toolhead_flush();
+    /* 检查位置限位 */
+    if (kin_check_limits(p_end_pos) != TOOLHEAD_OK) {
+        return TOOLHEAD_ERR_LIMIT;
+    }
     
-    /* 等待限位触发或超时 */
-    double timeout_time = s_print_time + HOMING_TIMEOUT;
-    while (!s_home_ctx.triggered && s_print_time < timeout_time) {
-        /* 在实际硬件上，这里会等待中断 */
-        /* 模拟环境下直接检查限位状态 */
-        if (axes_mask & AXIS_X_MASK) {
-            if (endstop_is_triggered(ENDSTOP_X)) {
-                s_home_ctx.triggered = 1;
-            }
-        }
-        if (axes_mask & AXIS_Y_MASK) {
-            if (endstop_is_triggered(ENDSTOP_Y)) {
-                s_home_ctx.triggered = 1;
-            }
+    /* 细小线段先尝试并入合并缓冲 */
+    if (!coalesce_try_merge(p_end_pos, max_v)) {
+        if (coalesce_flush() != TOOLHEAD_OK) {
+            return TOOLHEAD_ERR_QUEUE;
         }
-        if (axes_mask & AXIS_Z_MASK) {
-            if (endstop_is_triggered(ENDSTOP_Z)) {
-                s_home_ctx.triggered = 1;
-            }
+        if (!coalesce_start(&s_commanded_pos, p_end_pos, max_v) &&
+            move_queue(&s_commanded_pos, p_end_pos, distance,
+                       max_v) != TOOLHEAD_OK) {
+            return TOOLHEAD_ERR_QUEUE;
         }
-        
-        /* 短暂延时 */
-        sched_main();
     }
     
-    /* 停止所有运动 */
-    stepper_stop_all();
+    /* 更新命令位置 */
+    coord_copy(&s_commanded_pos, p_end_pos);
     
-    /* 恢复限位 */
-    for (int i = 0; i < NUM_AXES; i++) {
-        s_min_pos[i] = saved_min[i];
+    return TOOLHEAD_OK;
+}
+
+int
+toolhead_arc(const struct coord *p_end_pos, float offset_i, float offset_j,
+             int clockwise, float speed)
+{
+    /* 参数检查 */
+    if (p_end_pos == NULL) {
+        return TOOLHEAD_ERR_NULL;
     }
     
-    /* 检查是否超时 */
-    if (!s_home_ctx.triggered) {
-        s_home_ctx.state = HOME_STATE_ERROR;
-        
-        /* 结束归零模式 */
-        if (axes_mask & AXIS_X_MASK) {
-            endstop_home_end(ENDSTOP_X);
-        }
-        if (axes_mask & AXIS_Y_MASK) {
-            endstop_home_end(ENDSTOP_Y);
-        }
-        if (axes_mask & AXIS_Z_MASK) {
-            endstop_home_end(ENDSTOP_Z);
-        }
-        
-        return TOOLHEAD_ERR_HOMING;
+    if (s_p_trapq == NULL) {
+        return TOOLHEAD_ERR_QUEUE;
     }
     
-    /* 回退一小段距离 */
-    s_home_ctx.state = HOME_STATE_RETRACT;
-    s_home_ctx.triggered = 0;
+    /* 上一段圆弧先全部入队 */
+    if (arc_finish() != TOOLHEAD_OK) {
+        return TOOLHEAD_ERR_QUEUE;
+    }
+    
+    motion_t max_v = clamp_velocity(speed);
     
-    struct coord retract_target;
-    coord_copy(&retract_target, &s_commanded_pos);
+    arc_plan_t arc;
+    coord_copy(&arc.start_pos, &s_commanded_pos);
+    coord_copy(&arc.end_pos, p_end_pos);
+    int ret = arc_plan_init(&arc, offset_i, offset_j, clockwise);
+    if (ret != TOOLHEAD_OK) {
+        return ret;
+    }
     
-    if (axes_mask & AXIS_X_MASK) {
-        retract_target.x = HOMING_RETRACT;
+    /* 整段圆弧都在限位内才入队 */
+    if (arc_check_limits(&arc) != TOOLHEAD_OK) {
+        return TOOLHEAD_ERR_LIMIT;
     }
-    if (axes_mask & AXIS_Y_MASK) {
-        retract_target.y = HOMING_RETRACT;
+    
+    /* 圆弧前的合并缓冲先入队，保持运动顺序 */
+    if (coalesce_flush() != TOOLHEAD_OK) {
+        return TOOLHEAD_ERR_QUEUE;
     }
-    if (axes_mask & AXIS_Z_MASK) {
-        retract_target.z = HOMING_RETRACT;
+    
+    /* 命令位置即为终点，分段按 trapq 空间陆续入队 */
+    arc_cursor_start(&s_arc, &arc, max_v);
+    coord_copy(&s_commanded_pos, p_end_pos);
+    
+    return arc_emit();
+}
+
+int
+toolhead_home(uint8_t axes_mask)
+{
+    int ret = toolhead_home_start(axes_mask);
+    if (ret != TOOLHEAD_OK) {
+        return ret;
     }
     
-    /* 设置当前位置为 0 */
-    struct coord zero_pos;
-    coord_clear(&zero_pos);
-    if (axes_mask & AXIS_X_MASK) {
-        s_commanded_pos.x = 0.0;
-        s_current_pos.x = 0.0;
+    while ((ret = toolhead_home_status()) == TOOLHEAD_ERR_BUSY) {
+        sched_main();
+        toolhead_task();
     }
-    if (axes_mask & AXIS_Y_MASK) {
-        s_commanded_pos.y = 0.0;
-        s_current_pos.y = 0.0;
+    return ret;
+}
+
+int
+toolhead_home_start(uint8_t axes_mask)
+{
+    if (s_p_trapq == NULL) {
+        return TOOLHEAD_ERR_QUEUE;
     }
-    if (axes_mask & AXIS_Z_MASK) {
-        s_commanded_pos.z = 0.0;
-        s_current_pos.z = 0.0;
+    if (home_active()) {
+        return TOOLHEAD_ERR_BUSY;
     }
     
-    /* 执行回退运动 */
-    toolhead_move(&retract_target, HOMING_SPEED);
-    toolhead_flush();
+    /* 等待当前运动完成 (调用方已同步时立即返回) */
     toolhead_wait_moves();
     
-    /* 结束归零模式 */
-    if (axes_mask & AXIS_X_MASK) {
-        endstop_home_end(ENDSTOP_X);
+    /* 三角洲的三个塔只能一起归零 (向上) */
+    if (KINEMATICS == KINEMATICS_DELTA) {
+        axes_mask = AXIS_ALL_MASK;
     }
-    if (axes_mask & AXIS_Y_MASK) {
-        endstop_home_end(ENDSTOP_Y);
+    axes_mask &= AXIS_ALL_MASK;
+    if (axes_mask == 0) {
+        return TOOLHEAD_OK;
     }
-    if (axes_mask & AXIS_Z_MASK) {
-        endstop_home_end(ENDSTOP_Z);
+    
+    /* 归零运动越过行程端点，期间放开限位 */
+    for (int i = 0; i < NUM_AXES; i++) {
+        s_home_ctx.saved_min[i] = s_min_pos[i];
+        s_home_ctx.saved_max[i] = s_max_pos[i];
+        s_min_pos[i] = -1e9;
+        s_max_pos[i] = 1e9;
     }
     
-    s_home_ctx.state = HOME_STATE_DONE;
+    s_home_ctx.axis_mask = axes_mask;
+    s_home_ctx.group_mask = home_next_group(axes_mask);
+    home_phase_start(HOME_STATE_FAST);
     
     return TOOLHEAD_OK;
 }
 
+int
+toolhead_home_status(void)
+{
+    if (s_home_ctx.state == HOME_STATE_ERROR) {
+        return TOOLHEAD_ERR_HOMING;
+    }
+    return home_active() ? TOOLHEAD_ERR_BUSY : TOOLHEAD_OK;
+}
+
 void
 toolhead_wait_moves(void)
 {
-    /* 处理并刷新前瞻队列 */
-    lookahead_process();
+    /* 轮询期间持续补充步进队列 */
+    while (!toolhead_moves_done()) {
+        sched_main();
+    }
+}
+
+int
+toolhead_moves_done(void)
+{
+    /* 归零运动由归零状态机推进 */
+    if (home_active()) {
+        home_task();
+        return 0;
+    }
+    
+    /* 圆弧剩余分段: 生成步进释放运动段后继续入队，不在队尾停止 */
+    if (s_arc.active) {
+        generate_steps(s_print_time);
+        trapq_reclaim();
+        arc_emit();
+        return 0;
+    }
+    
+    /* 刷新合并缓冲和前瞻队列 (为空时无操作) */
+    coalesce_flush();
     lookahead_flush();
     
     /* 生成所有步进时序 */
     generate_steps(s_print_time);
     
-    /* 等待所有步进电机停止 */
-    while (stepper_is_moving(STEPPER_X) ||
-           stepper_is_moving(STEPPER_Y) ||
-           stepper_is_moving(STEPPER_Z) ||
-           stepper_is_moving(STEPPER_E)) {
-        sched_main();
+    if (!steppers_idle()) {
+        return 0;
     }
     
     /* 同步当前位置和命令位置 */
@@ -956,32 +2648,32 @@ toolhead_wait_moves(void)
     if (s_move_complete_cb != NULL) {
         s_move_complete_cb(s_move_complete_arg);
     }
+    
+    return 1;
 }
 
 void
 toolhead_flush(void)
 {
-    /* 处理前瞻队列 */
-    lookahead_process();
-    
-    /* 刷新到 trapq */
+    /* 刷新圆弧、合并缓冲和前瞻队列到 trapq */
+    arc_finish();
+    coalesce_flush();
     lookahead_flush();
     
     /* 生成步进时序 */
     generate_steps(s_print_time);
     
-    /* 清理历史运动 */
+    /* 清理步进已生成的历史运动 */
     if (s_p_trapq != NULL) {
-        trapq_finalize_moves(s_p_trapq, s_print_time);
-        trapq_free_moves(s_p_trapq, s_print_time - 1.0);
+        trapq_reclaim();
     }
 }
 
 int
 toolhead_has_moves(void)
 {
-    /* 检查前瞻队列 */
-    if (s_lookahead_count > 0) {
+    /* 检查圆弧、合并缓冲和前瞻队列 */
+    if (s_arc.active || s_coalesce.pending || s_lookahead_count > 0) {
         return 1;
     }
     
@@ -993,6 +2685,134 @@ toolhead_has_moves(void)
     return 0;
 }
 
+int
+toolhead_can_accept_move(void)
+{
+    if (s_p_trapq == NULL || home_active() || s_arc.active) {
+        return 0;
+    }
+    
+    return move_space_available();
+}
+
+int
+toolhead_get_queue_depth(toolhead_queue_depth_t *p_depth)
+{
+    if (p_depth == NULL) {
+        return TOOLHEAD_ERR_NULL;
+    }
+    
+    uint32_t trapq_free = trapq_pool_available();
+    int lookahead_free = (LOOKAHEAD_SIZE - LOOKAHEAD_KEEP - 1)
+                         - s_lookahead_count;
+    if (lookahead_free < 0) {
+        lookahead_free = 0;
+    }
+    
+    p_depth->lookahead_used = (uint16_t)s_lookahead_count;
+    p_depth->lookahead_size = LOOKAHEAD_SIZE;
+    p_depth->trapq_used = (uint16_t)(TRAPQ_MAX_MOVES - trapq_free);
+    p_depth->trapq_size = TRAPQ_MAX_MOVES;
+    
+    /* 取各轴步进时间队列的最大占用 */
+    p_depth->step_queue_used = 0;
+    for (int i = 0; i < NUM_AXES; i++) {
+        uint32_t used = spsc_ring_count(&s_step_queues[i].ring);
+        if (used > p_depth->step_queue_used) {
+            p_depth->step_queue_used = (uint16_t)used;
+        }
+    }
+    p_depth->step_queue_size = STEP_QUEUE_SIZE;
+    
+    /* 超出前瞻阈值的运动段最终各占一个 trapq 条目 */
+    p_depth->move_space = (uint16_t)(lookahead_free + (int)trapq_free);
+    
+    return TOOLHEAD_OK;
+}
+
+void
+toolhead_task(void)
+{
+    if (s_p_trapq == NULL) {
+        return;
+    }
+    
+    /* 推进归零 */
+    if (home_active()) {
+        home_task();
+    }
+    
+    /* 没有后续运动可规划时，不再让合并缓冲中的线段等待 */
+    if (s_lookahead_count == 0) {
+        coalesce_flush();
+    }
+    
+    /* 已生成的步进每轮都送入步进驱动 */
+    for (int i = 0; i < NUM_AXES; i++) {
+        if (!(s_home_ctx.halted & (1u << i))) {
+            step_queue_drain(i);
+        }
+    }
+    
+    /* 驱动队列降到低水位的轴补充步进 */
+    uint32_t refill = stepper_take_refill_mask();
+    if (refill) {
+        refill_steps(refill);
+    }
+    
+    /* 定时刷新: 提交前瞻、补充步进并释放已执行的运动段 */
+    if (s_flush_pending) {
+        s_flush_pending = 0;
+        flush_handler();
+    }
+    
+    /* 释放运动段后继续入队圆弧分段 */
+    if (s_arc.active) {
+        arc_emit();
+    }
+}
+
+int
+toolhead_set_input_shaper(int axis, int type, float freq, float damping_ratio)
+{
+    if (axis < 0 || axis >= NUM_SHAPER_AXES ||
+        type < INPUT_SHAPER_NONE || type > INPUT_SHAPER_EI) {
+        return TOOLHEAD_ERR_PARAM;
+    }
+    if (type != INPUT_SHAPER_NONE &&
+        (freq <= 0.0f || damping_ratio < 0.0f || damping_ratio >= 1.0f)) {
+        return TOOLHEAD_ERR_PARAM;
+    }
+    
+    /* 整形参数只在运动停止时切换 */
+    toolhead_wait_moves();
+    
+    return shaper_apply(axis, type, freq, damping_ratio);
+}
+
+int
+toolhead_set_pressure_advance(float pressure_advance, float smooth_time)
+{
+    if (pressure_advance < 0.0f || smooth_time < 0.0f ||
+        smooth_time > (float)EXTRUDER_MAX_SMOOTH_TIME) {
+        return TOOLHEAD_ERR_PARAM;
+    }
+    if (s_steppers[AXIS_E] == NULL) {
+        return TOOLHEAD_ERR_QUEUE;
+    }
+    
+    /* 平滑窗口会改变步进生成延迟，只在运动停止时切换 */
+    toolhead_wait_moves();
+    
+    if (extruder_set_pressure_advance(s_steppers[AXIS_E], pressure_advance,
+                                      smooth_time) != 0) {
+        return TOOLHEAD_ERR_PARAM;
+    }
+    update_kin_flush_delay();
+    
+    return TOOLHEAD_OK;
+}
+
 struct trapq *
 toolhead_get_trapq(void)
 {
@@ -1005,6 +2825,30 @@ toolhead_get_print_time(void)
     return s_print_time;
 }
 
+uint32_t
+toolhead_print_time_to_clock(double print_time)
+{
+    return print_time_to_clock(print_time);
+}
+
+double
+toolhead_clock_to_print_time(uint32_t clock)
+{
+    return clock_to_print_time(clock);
+}
+
+uint64_t
+toolhead_print_time_to_clock64(double print_time)
+{
+    return print_time_to_clock64(print_time);
+}
+
+double
+toolhead_clock64_to_print_time(uint64_t clock)
+{
+    return (double)(int64_t)(clock - s_clock_base) / (double)STEP_CLOCK_FREQ;
+}
+
 int
 toolhead_get_config(toolhead_config_t *p_config)
 {
@@ -1027,12 +2871,40 @@ toolhead_set_config(const toolhead_config_t *p_config)
         return TOOLHEAD_ERR_NULL;
     }
     
+    if (!(p_config->max_velocity > 0.0f) || !(p_config->max_accel > 0.0f) ||
+        !(p_config->max_accel_to_decel > 0.0f) ||
+        !(p_config->square_corner_velocity >= 0.0f)) {
+        return TOOLHEAD_ERR_PARAM;
+    }
+    
     /* 复制配置 */
     memcpy(&s_config, p_config, sizeof(toolhead_config_t));
     
+    /* 未确定的运动按新配置重新规划 */
+    lookahead_replan();
+    
+    return TOOLHEAD_OK;
+}
+
+int
+toolhead_set_speed_factor(float factor)
+{
+    if (!(factor >= SPEED_FACTOR_MIN && factor <= SPEED_FACTOR_MAX)) {
+        return TOOLHEAD_ERR_PARAM;
+    }
+    
+    s_speed_factor = factor;
+    lookahead_replan();
+    
     return TOOLHEAD_OK;
 }
 
+float
+toolhead_get_speed_factor(void)
+{
+    return s_speed_factor;
+}
+
 void
 toolhead_set_move_complete_callback(toolhead_callback_fn_t callback, void *arg)
 {
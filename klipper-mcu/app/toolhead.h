@@ -31,6 +31,7 @@ extern "C" {
 #define TOOLHEAD_ERR_QUEUE      (-3)    /* 队列满 */
 #define TOOLHEAD_ERR_BUSY       (-4)    /* 正在运动 */
 #define TOOLHEAD_ERR_HOMING     (-5)    /* 归零失败 */
+#define TOOLHEAD_ERR_PARAM      (-6)    /* 参数无效 */
 
 /* ========== 轴掩码定义 ========== */
 
@@ -40,6 +41,12 @@ extern "C" {
 #define AXIS_E_MASK             (1U << 3)   /* E 轴 (挤出机) */
 #define AXIS_ALL_MASK           (AXIS_X_MASK | AXIS_Y_MASK | AXIS_Z_MASK)
 
+/* ========== 运动学类型 (config.h KINEMATICS) ========== */
+
+#define KINEMATICS_CARTESIAN    0       /* 笛卡尔 */
+#define KINEMATICS_COREXY       1       /* CoreXY: X/Y 电机为 A/B 皮带 */
+#define KINEMATICS_DELTA        2       /* 线性三角洲: X/Y/Z 电机为 A/B/C 塔 */
+
 /* ========== 运动参数配置 ========== */
 
 /**
@@ -52,6 +59,23 @@ typedef struct {
     float square_corner_velocity;   /* 拐角速度 mm/s */
 } toolhead_config_t;
 
+/* ========== 队列深度 ========== */
+
+/**
+ * @brief   运动队列深度
+ * 
+ * 供上位机流控使用，反映前瞻队列、trapq 和步进时间队列的占用。
+ */
+typedef struct {
+    uint16_t lookahead_used;        /* 前瞻队列已用条目 */
+    uint16_t lookahead_size;        /* 前瞻队列容量 */
+    uint16_t trapq_used;            /* trapq 内存池已用运动段 */
+    uint16_t trapq_size;            /* trapq 内存池容量 */
+    uint16_t step_queue_used;       /* 步进时间队列最大占用 (各轴) */
+    uint16_t step_queue_size;       /* 步进时间队列容量 */
+    uint16_t move_space;            /* 估计还能接收的运动段数 */
+} toolhead_queue_depth_t;
+
 /* ========== 回调函数类型 ========== */
 
 /**
@@ -107,22 +131,73 @@ int toolhead_set_position(const struct coord *p_pos);
  * 
  * 添加从当前位置到目标位置的直线运动。
  * 自动计算梯形加速度曲线。
+ * 
+ * 开启 CONFIG_MOVE_COALESCE 时，短于 COALESCE_MAX_SEGMENT 的近共线
+ * 线段先合并为一段再进入前瞻队列 (参数见 config.h)。
  */
 int toolhead_move(const struct coord *p_end_pos, float speed);
 
 /**
- * @brief   归零指定轴
+ * @brief   添加 XY 平面圆弧运动 (G2/G3)
+ * @param   p_end_pos   目标位置
+ * @param   offset_i    圆心相对当前位置的 X 偏移 (mm)
+ * @param   offset_j    圆心相对当前位置的 Y 偏移 (mm)
+ * @param   clockwise   1 顺时针 (G2)，0 逆时针 (G3)
+ * @param   speed       运动速度 (mm/s)
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_NULL 空指针
+ * @retval  TOOLHEAD_ERR_PARAM 半径过小
+ * @retval  TOOLHEAD_ERR_LIMIT 圆弧上有点超出限位 (不入队任何线段)
+ * @retval  TOOLHEAD_ERR_QUEUE 队列满
+ *
+ * 圆弧按弦偏差 ARC_TOLERANCE 分段，各段端点用增量旋转求得，
+ * Z 和 E 沿弧长线性插值。目标点与起点重合时为整圆。
+ * 分段直接进入前瞻队列，不经过细小线段合并。
+ * 
+ * 分段数可能超过 trapq 内存池: 返回时只入队了当前空间允许的分段，
+ * 其余由 toolhead_task() 在运动段释放后继续入队，期间
+ * toolhead_can_accept_move() 返回 0。命令位置立即更新为终点。
+ */
+int toolhead_arc(const struct coord *p_end_pos, float offset_i, float offset_j,
+                 int clockwise, float speed);
+
+/**
+ * @brief   归零指定轴 (阻塞)
  * @param   axes_mask   轴掩码 (AXIS_X_MASK | AXIS_Y_MASK | AXIS_Z_MASK)
  * @retval  TOOLHEAD_OK 成功
  * @retval  TOOLHEAD_ERR_HOMING 归零失败
  * 
- * 执行归零序列:
- * 1. 向限位开关方向运动
- * 2. 检测到限位后停止
- * 3. 设置位置为 0
+ * 调用 toolhead_home_start() 后轮询到结束。
  */
 int toolhead_home(uint8_t axes_mask);
 
+/**
+ * @brief   开始归零 (非阻塞)
+ * @param   axes_mask   轴掩码 (AXIS_X_MASK | AXIS_Y_MASK | AXIS_Z_MASK)
+ * @retval  TOOLHEAD_OK 已开始 (或没有要归零的轴)
+ * @retval  TOOLHEAD_ERR_BUSY 正在归零
+ * @retval  TOOLHEAD_ERR_QUEUE 未初始化
+ * 
+ * 归零由限位回调、超时定时器和 toolhead_task() 推进。每组轴依次:
+ * 1. FAST: 向限位开关快速运动，各轴在各自触发时停止
+ * 2. RETRACT: 回退 HOMING_RETRACT
+ * 3. SLOW: 慢速再次触发，按限位中断锁存的触发时刻确定位置
+ * 4. FINISH: 回退到开关外 HOMING_RETRACT 处
+ * 
+ * 笛卡尔的 X/Y 并行归零，随后归零 Z；CoreXY 逐轴归零；三角洲三塔
+ * 一起归零。任一阶段 HOMING_TIMEOUT 内未触发则失败。
+ * 归零期间 toolhead_can_accept_move() 和 toolhead_moves_done() 返回 0。
+ */
+int toolhead_home_start(uint8_t axes_mask);
+
+/**
+ * @brief   查询归零状态
+ * @retval  TOOLHEAD_OK 空闲或已完成
+ * @retval  TOOLHEAD_ERR_BUSY 正在归零
+ * @retval  TOOLHEAD_ERR_HOMING 上次归零失败
+ */
+int toolhead_home_status(void);
+
 /**
  * @brief   等待所有运动完成
  * 
@@ -130,6 +205,16 @@ int toolhead_home(uint8_t axes_mask);
  */
 void toolhead_wait_moves(void);
 
+/**
+ * @brief   检查所有运动是否完成 (非阻塞)
+ * @retval  1 所有步进电机已停止
+ * @retval  0 仍有运动在执行
+ * 
+ * 每次调用都把合并缓冲和前瞻队列刷新到 trapq 并补充步进队列，
+ * 轮询直到返回 1 与 toolhead_wait_moves() 等效，期间主循环照常运行。
+ */
+int toolhead_moves_done(void);
+
 /**
  * @brief   刷新运动队列
  * 
@@ -145,6 +230,63 @@ void toolhead_flush(void);
  */
 int toolhead_has_moves(void);
 
+/**
+ * @brief   检查能否无阻塞地接收一个新运动
+ * @retval  1 toolhead_move() 不会等待 trapq 空间
+ * @retval  0 队列已满，应延后执行运动命令
+ * 
+ * G-code 层据此推迟 "ok" 应答，形成到上位机的反压。
+ * 圆弧还有分段未入队时返回 0。
+ */
+int toolhead_can_accept_move(void);
+
+/**
+ * @brief   获取运动队列深度
+ * @param   p_depth 输出队列深度结构体指针
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_NULL 空指针
+ */
+int toolhead_get_queue_depth(toolhead_queue_depth_t *p_depth);
+
+/**
+ * @brief   运动规划后台任务
+ * 
+ * 在主循环中调用: 每轮把已生成的步进送入步进驱动，驱动队列降到
+ * 低水位的轴 (stepper_take_refill_mask()) 补充步进到高水位；每个
+ * MOVE_FLUSH_PERIOD 定时刷新一次，已提交运动不足 BUFFER_TIME_LOW 时
+ * 提交前瞻队列，补充低于高水位的驱动队列，并释放步进已生成的
+ * trapq 运动段，使 toolhead_can_accept_move() 在运动执行过程中
+ * 恢复为可接收。
+ */
+void toolhead_task(void);
+
+/**
+ * @brief   设置输入整形
+ * @param   axis            轴索引 (0=X, 1=Y)
+ * @param   type            INPUT_SHAPER_NONE / ZV / MZV / EI (chelper/kin_shaper.h)
+ * @param   freq            共振频率 (Hz)
+ * @param   damping_ratio   阻尼比 (通常 0.1)
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_PARAM 参数无效
+ * @retval  TOOLHEAD_ERR_QUEUE 整形内存池耗尽
+ * 
+ * 先等待所有运动完成再切换。整形抵消框架共振，从而可以提高
+ * max_accel 而不产生振纹。
+ */
+int toolhead_set_input_shaper(int axis, int type, float freq,
+                              float damping_ratio);
+
+/**
+ * @brief   设置压力提前
+ * @param   pressure_advance    提前量 (秒，乘以挤出速度得到提前的长度)
+ * @param   smooth_time         平滑窗口 (秒，0 ~ 0.2)
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_PARAM 参数无效
+ * 
+ * 先等待所有运动完成再切换。提前量或平滑窗口为 0 时关闭压力提前。
+ */
+int toolhead_set_pressure_advance(float pressure_advance, float smooth_time);
+
 /**
  * @brief   获取运动队列指针
  * @return  trapq 指针，用于高级操作
@@ -159,6 +301,36 @@ struct trapq *toolhead_get_trapq(void);
  */
 double toolhead_get_print_time(void);
 
+/**
+ * @brief   打印时间换算为本机调度器时钟
+ * @param   print_time  打印时间 (秒)
+ * @return  调度器时钟 (允许回绕)
+ *
+ * @note    从 MCU 上的时刻再经 mcu_link_local_to_remote() 换算
+ */
+uint32_t toolhead_print_time_to_clock(double print_time);
+
+/**
+ * @brief   本机调度器时钟换算为打印时间
+ * @param   clock   调度器时钟 (允许回绕，须在当前时刻前后半个周期内)
+ * @return  打印时间 (秒)
+ */
+double toolhead_clock_to_print_time(uint32_t clock);
+
+/**
+ * @brief   打印时间换算为 64 位调度器时钟
+ * @param   print_time  打印时间 (秒)
+ * @return  64 位调度器时钟 (与 sched_get_time64() 同一基准)
+ */
+uint64_t toolhead_print_time_to_clock64(double print_time);
+
+/**
+ * @brief   64 位调度器时钟换算为打印时间
+ * @param   clock   64 位调度器时钟
+ * @return  打印时间 (秒)，不受 32 位回绕限制
+ */
+double toolhead_clock64_to_print_time(uint64_t clock);
+
 /**
  * @brief   获取运动配置
  * @param   p_config    输出配置结构体指针
@@ -172,9 +344,30 @@ int toolhead_get_config(toolhead_config_t *p_config);
  * @param   p_config    输入配置结构体指针
  * @retval  TOOLHEAD_OK 成功
  * @retval  TOOLHEAD_ERR_NULL 空指针
+ * @retval  TOOLHEAD_ERR_PARAM 速度或加速度不为正
+ * 
+ * 不等待运动完成: 已提交到 trapq 的运动不变，前瞻队列中尚未确定
+ * 速度的运动按新限制重新规划 (M204)。
  */
 int toolhead_set_config(const toolhead_config_t *p_config);
 
+/**
+ * @brief   设置速度倍率 (M220)
+ * @param   factor  倍率 (1.0 为原速，0.01 ~ 10)
+ * @retval  TOOLHEAD_OK 成功
+ * @retval  TOOLHEAD_ERR_PARAM 超出范围
+ * 
+ * 乘在之后各运动的请求速度上 (归零运动除外)，仍受 max_velocity
+ * 限制。与 toolhead_set_config() 一样只重新规划尚未确定的运动。
+ */
+int toolhead_set_speed_factor(float factor);
+
+/**
+ * @brief   获取速度倍率
+ * @return  当前倍率
+ */
+float toolhead_get_speed_factor(void);
+
 /**
  * @brief   设置运动完成回调
  * @param   callback    回调函数
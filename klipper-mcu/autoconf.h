@@ -56,6 +56,12 @@ extern "C" {
 /* Number of stepper motors */
 #define CONFIG_STEPPER_COUNT            4
 
+/* Step on both edges (driver must support dual-edge step, e.g. TMC dedge) */
+#define CONFIG_STEPPER_BOTH_EDGE        0
+
+/* Minimum step pulse width (step timer ticks) when not stepping on both edges */
+#define CONFIG_STEPPER_PULSE_TICKS      2
+
 /* Enable GPIO support */
 #define CONFIG_HAVE_GPIO                1
 
@@ -65,6 +71,16 @@ extern "C" {
 /* Number of ADC channels */
 #define CONFIG_ADC_CHANNEL_COUNT        16
 
+/* Convert configured channels continuously: TIM2-triggered scan into a
+ * circular DMA buffer, averaged in the DMA interrupt (0 = blocking reads) */
+#define CONFIG_ADC_SCAN                 1
+
+/* Scans per second (TIM2 update rate) */
+#define CONFIG_ADC_SCAN_FREQ            1000
+
+/* Scans averaged into each reported value (power of two) */
+#define CONFIG_ADC_OVERSAMPLE           16
+
 /* Enable PWM support */
 #define CONFIG_HAVE_PWM                 1
 
@@ -80,6 +96,9 @@ extern "C" {
 /* Enable I2C support (disabled for MVP) */
 #define CONFIG_HAVE_I2C                 0
 
+/* Run print files from an SD card on the SDIO bus (M20-M27) */
+#define CONFIG_HAVE_SDCARD              1
+
 /* ========== Serial Configuration ========== */
 
 /* Serial baud rate */
@@ -91,6 +110,25 @@ extern "C" {
 /* Serial transmit buffer size */
 #define CONFIG_SERIAL_TX_BUFFER_SIZE    256
 
+/* Use DMA with idle-line detection for USART RX/TX (0 = per-byte IRQs) */
+#define CONFIG_SERIAL_DMA               1
+
+/* Run the serial_* API over USB CDC-ACM instead of the USART
+ * (requires CONFIG_HAVE_USB) */
+#define CONFIG_SERIAL_USB               0
+
+/* Number of secondary-MCU links kept in clock sync (see src/mcu_link.h) */
+#define CONFIG_MCU_LINK_COUNT           1
+
+/* ========== Endstop Configuration ========== */
+
+/* Detect endstop edges with EXTI interrupts (0 = sample on a timer) */
+#define CONFIG_ENDSTOP_EXTI             1
+
+/* Require the pin to stay active this long after an edge before it
+ * counts as a trigger (scheduler ticks, 0 = trigger on the edge) */
+#define CONFIG_ENDSTOP_DEBOUNCE_TICKS   0
+
 /* ========== Timer Configuration ========== */
 
 /* System tick frequency (Hz) */
@@ -99,36 +137,43 @@ extern "C" {
 /* Step timer frequency (Hz) - for stepper pulse generation */
 #define CONFIG_STEP_TIMER_FREQ          1000000
 
-/* ========== Motion Configuration ========== */
+/* Dispatch scheduler timers from the TIM5 compare interrupt (0 = poll in sched_main) */
+#define CONFIG_SCHED_HW_TIMER           1
 
-/* Maximum number of moves in queue */
-#define CONFIG_MOVE_QUEUE_SIZE          32
+/* Maximum number of concurrently scheduled timers (scheduler heap size) */
+#define CONFIG_SCHED_MAX_TIMERS         16
 
-/* Motion lookahead buffer size */
-#define CONFIG_LOOKAHEAD_SIZE           16
+/* Track worst-case interrupt-off time in the scheduler (DWT cycle counter).
+ * Adds a cycle counter read to every critical section, so it is only on
+ * in profiling builds (make PROFILE=1) */
+#ifndef CONFIG_SCHED_IRQ_STATS
+#define CONFIG_SCHED_IRQ_STATS          CONFIG_PROFILE
+#endif
+
+/* ========== Motion Configuration ========== */
 
-/* Enable Cartesian kinematics */
-#define CONFIG_KINEMATICS_CARTESIAN     1
+/* Motion math scalar: 0 = double, 1 = float (runs on the single-precision FPU) */
+#ifndef CONFIG_MOTION_FLOAT
+#define CONFIG_MOTION_FLOAT             0
+#endif
 
-/* Enable CoreXY kinematics (disabled for MVP) */
-#define CONFIG_KINEMATICS_COREXY        0
+/* Merge tiny near-collinear moves before lookahead (limits in config.h) */
+#define CONFIG_MOVE_COALESCE            1
 
-/* Enable Delta kinematics (disabled for MVP) */
-#define CONFIG_KINEMATICS_DELTA         0
+/* Maximum step timing error allowed by step compression (step timer ticks) */
+#define CONFIG_STEPCOMPRESS_MAX_ERROR   25
+
+/* The kinematics (Cartesian, CoreXY or delta) is selected by KINEMATICS in config.h */
 
 /* ========== Temperature Configuration ========== */
 
 /* Enable heater support */
 #define CONFIG_HAVE_HEATER              1
 
-/* Number of heaters */
-#define CONFIG_HEATER_COUNT             2
-
 /* Enable fan support */
 #define CONFIG_HAVE_FAN                 1
 
-/* Number of fans */
-#define CONFIG_FAN_COUNT                2
+/* Heaters, fans and steppers are listed in the device tables in config.h */
 
 /* Temperature control update interval (ms) */
 #define CONFIG_TEMP_UPDATE_INTERVAL     100
@@ -141,6 +186,13 @@ extern "C" {
 /* Enable G-code checksum verification */
 #define CONFIG_GCODE_CHECKSUM           0
 
+/* Report queue depth in "ok" replies as "ok P<moves> B<commands>" */
+#define CONFIG_GCODE_ADVANCED_OK        1
+
+/* Merge consecutive queued "ok" replies into one response entry, rendered
+ * and written to the TX buffer in a single batch */
+#define CONFIG_GCODE_OK_COALESCE        1
+
 /* ========== Debug Configuration ========== */
 
 /* Enable debug output */
@@ -150,6 +202,20 @@ extern "C" {
 #define CONFIG_DEBUG                    0
 #endif
 
+/* DWT cycle profiling of ISRs and hot paths, dumped with M990 */
+#ifndef CONFIG_PROFILE
+#define CONFIG_PROFILE                  CONFIG_DEBUG
+#endif
+
+/* Binary ring of recent moves, step batches and endstop triggers,
+ * streamed out with the trace_dump command (see src/trace.h) */
+#ifndef CONFIG_MOTION_TRACE
+#define CONFIG_MOTION_TRACE             CONFIG_DEBUG
+#endif
+
+/* Motion trace ring length (records of 16 bytes, power of two) */
+#define CONFIG_MOTION_TRACE_SIZE        256
+
 /* Enable assert checks */
 #define CONFIG_ASSERT                   1
 
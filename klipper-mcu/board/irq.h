@@ -91,6 +91,81 @@ static inline void critical_exit(uint32_t flag)
     irq_restore(flag);
 }
 
+/* ========== Interrupt Priority Plan ========== */
+
+/*
+ * NVIC priorities, one table for the whole firmware. STM32F4 implements
+ * the upper 4 priority bits; all of them are preemption bits (no
+ * subpriority), lower value = more urgent.
+ *
+ *   IRQ_PRIO_STEP          TIM5 scheduler/step timer, endstop EXTI
+ *   IRQ_PRIO_COMMS         USART, serial DMA streams, USB OTG FS
+ *   IRQ_PRIO_HOUSEKEEPING  ADC DMA, SDIO, SysTick
+ *   IRQ_PRIO_LOWEST        PendSV and every interrupt not listed above
+ *
+ * Everything that touches the scheduler or the steppers runs at
+ * IRQ_PRIO_STEP, the level sched_irq_save() masks. Comms and
+ * housekeeping code masks only its own level with irq_mask_level(), so
+ * its critical sections never delay a step timer. Level 0 is left free:
+ * BASEPRI cannot mask it, so nothing there may share data with the rest.
+ */
+#define IRQ_PRIO_BITS           4
+#define IRQ_PRIO(level)         ((uint8_t)((level) << (8 - IRQ_PRIO_BITS)))
+
+#define IRQ_PRIO_STEP           IRQ_PRIO(1)
+#define IRQ_PRIO_COMMS          IRQ_PRIO(4)
+#define IRQ_PRIO_HOUSEKEEPING   IRQ_PRIO(8)
+#define IRQ_PRIO_LOWEST         IRQ_PRIO(15)
+
+/* ========== Priority Masking (BASEPRI) ========== */
+
+/**
+ * @brief   Mask interrupts at priority level prio and below
+ * @param   prio    IRQ_PRIO_* level to mask (must be non-zero)
+ * @return  Previous BASEPRI (for irq_unmask_level())
+ * 
+ * Uses BASEPRI_MAX, so a nested call never lowers an outer mask. More
+ * urgent interrupts keep running.
+ */
+static inline uint32_t irq_mask_level(uint8_t prio)
+{
+    uint32_t basepri;
+    __asm__ __volatile__(
+        "mrs %0, basepri\n"
+        "msr basepri_max, %1\n"
+        "isb\n"
+        : "=&r" (basepri)
+        : "r" ((uint32_t)prio)
+        : "memory"
+    );
+    return basepri;
+}
+
+/**
+ * @brief   Restore the priority mask
+ * @param   flag    Previous BASEPRI from irq_mask_level()
+ */
+static inline void irq_unmask_level(uint32_t flag)
+{
+    __asm__ __volatile__(
+        "msr basepri, %0\n"
+        :
+        : "r" (flag)
+        : "memory"
+    );
+}
+
+/**
+ * @brief   Check if a saved mask already covered a priority level
+ * @param   flag    Value returned by irq_mask_level()
+ * @param   prio    IRQ_PRIO_* level
+ * @return  1 if level prio was already masked, 0 otherwise
+ */
+static inline int irq_level_masked(uint32_t flag, uint8_t prio)
+{
+    return flag != 0 && flag <= prio;
+}
+
 /* ========== NVIC Functions ========== */
 
 /* NVIC base address */
@@ -107,6 +182,13 @@ static inline void critical_exit(uint32_t flag)
 #define SCB_VTOR                (SCB_BASE + 0x08)    /* Vector Table Offset */
 #define SCB_AIRCR               (SCB_BASE + 0x0C)    /* App Interrupt/Reset Control */
 #define SCB_SCR                 (SCB_BASE + 0x10)    /* System Control Register */
+#define SCB_SHPR3               (SCB_BASE + 0x20)    /* System Handler Priority 3 */
+
+/* AIRCR write key and priority grouping (4 preemption bits, no subpriority) */
+#define SCB_AIRCR_VECTKEY       (0x05FAUL << 16)
+#define SCB_AIRCR_VECTKEY_MASK  (0xFFFFUL << 16)
+#define SCB_AIRCR_PRIGROUP_MASK (7UL << 8)
+#define SCB_AIRCR_PRIGROUP_4    (3UL << 8)
 
 /* SysTick base address */
 #define SYSTICK_BASE            0xE000E010
@@ -133,6 +215,15 @@ void nvic_disable_irq(uint8_t irq);
  */
 void nvic_set_priority(uint8_t irq, uint8_t priority);
 
+/**
+ * @brief   Apply the priority plan to the NVIC and system handlers
+ * 
+ * Sets priority grouping, SysTick and PendSV priorities, and drops every
+ * peripheral interrupt to IRQ_PRIO_LOWEST. Drivers then raise their own
+ * interrupt to its IRQ_PRIO_* level. Call before any interrupt is enabled.
+ */
+void nvic_priority_init(void);
+
 /**
  * @brief   Clear pending NVIC interrupt
  * @param   irq     IRQ number
@@ -32,6 +32,27 @@
 /* Absolute value */
 #define ABS(x)                  (((x) < 0) ? -(x) : (x))
 
+/* ========== Memory Placement ========== */
+
+/*
+ * Section attributes for the step interrupt path (see linker.ld):
+ * - __ramfunc: code copied from flash to main SRAM by data_init(). Runs
+ *   without flash wait states or ART cache misses. CCM RAM is not on
+ *   the instruction bus, so code cannot live there.
+ * - __ccmram: zero-initialised data in the 64KB CCM RAM, cleared by
+ *   bss_init(). CCM is zero wait state but CPU-only: never use it for
+ *   DMA buffers.
+ * Calls between flash and SRAM code go through linker veneers. Host and
+ * test builds ignore both.
+ */
+#if defined(__arm__) || defined(__thumb__)
+#define __ramfunc               __attribute__((section(".RamFunc")))
+#define __ccmram                __attribute__((section(".ccmbss")))
+#else
+#define __ramfunc
+#define __ccmram
+#endif
+
 /* ========== Time Utilities ========== */
 
 /* Time conversion macros */
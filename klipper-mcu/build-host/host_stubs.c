@@ -17,6 +17,7 @@ int32_t adc_read(uint8_t gpio) {
     else if (port == 2 && pin <= 5) ch = 10 + pin;
     return (ch >= 0 && ch < 16) ? s_mock_adc[ch] : -1;
 }
+void adc_scan_set_callback(void (*fn)(uint32_t time)) { (void)fn; }
 
 /* ========== PWM 桩 ========== */
 typedef struct { uint8_t pin; uint32_t cycle_time; uint16_t max_value; uint8_t invert; uint8_t use_hardware; } pwm_config_t;
@@ -38,6 +39,10 @@ void serial_putc(char c) { putchar(c); }
 void serial_puts(const char* s) { printf("%s", s); }
 int serial_line_available(void) { return 0; }
 int serial_readline(char* buf, int max) { (void)buf; (void)max; return 0; }
+const char* serial_line_peek(size_t* len) { (void)len; return NULL; }
+void serial_line_release(void) { }
+int serial_line_kind(void) { return -1; }
+int serial_line_free_slots(void) { return 0; }
 
 /* ========== GPIO 桩 ========== */
 void gpio_out_setup(uint8_t pin, uint8_t val) { (void)pin; (void)val; }
@@ -47,8 +52,9 @@ void gpio_in_setup(uint8_t pin, int pull) { (void)pin; (void)pull; }
 
 /* ========== Scheduler 桩 ========== */
 void sched_init(void) { }
-void sched_main(void) { }
-uint32_t sched_get_time(void) { return 0; }
+int32_t sched_time_diff(uint32_t t1, uint32_t t2) { return (int32_t)(t1 - t2); }
+uint32_t sched_irq_save(void) { return 0; }
+void sched_irq_restore(uint32_t flag) { (void)flag; }
 
 /* ========== Stepper 桩 ========== */
 void stepper_init(void) { }
@@ -60,15 +66,6 @@ void stepper_set_next_step_time(int id, uint32_t time) { (void)id; (void)time; }
 void endstop_init(void) { }
 int endstop_config(int id, uint8_t pin, int pull) { (void)id; (void)pin; (void)pull; return 0; }
 int endstop_read(int id) { (void)id; return 0; }
-int endstop_is_triggered(int id) { (void)id; return 0; }
-void endstop_set_callback(int id, void (*cb)(int, void*), void* arg) { (void)id; (void)cb; (void)arg; }
-void endstop_home_start(int id) { (void)id; }
-void endstop_home_end(int id) { (void)id; }
-
-/* ========== Stepper 扩展桩 ========== */
-int stepper_is_moving(int id) { (void)id; return 0; }
-void stepper_stop(int id) { (void)id; }
-void stepper_stop_all(void) { }
 
 /* ========== Serial 扩展桩 ========== */
 void serial_printf(const char* fmt, ...) { (void)fmt; }
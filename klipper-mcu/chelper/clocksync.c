@@ -0,0 +1,160 @@
+/**
+ * @file    clocksync.c
+ * @brief   Clock offset and drift estimation implementation
+ *
+ * Adapted from Klipper klippy/clocksync.py for MCU use.
+ *
+ * Key adaptations:
+ * - Samples sit at the midpoint of their round trip; slow exchanges
+ *   are dropped instead of adding the fastest half round trip
+ * - Clocks are 32-bit wrapping ticks on both sides, extended internally
+ * - The regression starts from the nominal frequency ratio instead of
+ *   requiring a burst of samples before the first estimate
+ * - No malloc, C99 compatible
+ */
+
+#include "clocksync.h"
+#include <math.h>
+#include <string.h>
+
+/** Weight of each new sample in the regression */
+#define CLOCKSYNC_DECAY         (1.0 / 30.0)
+
+/** Growth of the accepted round trip per elapsed second (s/s) */
+#define CLOCKSYNC_RTT_AGE       (0.000010 / (60.0 * 60.0))
+
+/** Spread (s) of the prior that holds the nominal frequency ratio */
+#define CLOCKSYNC_PRIOR_TIME    1.0
+
+/** Predictions closer than this (s) are never treated as outliers */
+#define CLOCKSYNC_OUTLIER_MIN   0.000500
+
+/** Prediction error (s) assumed after an outlier is accepted anyway */
+#define CLOCKSYNC_RESYNC_ERROR  0.001
+
+/** Half round trips this much (s) above the fastest one are dropped */
+#define CLOCKSYNC_RTT_SLACK     0.000100
+
+/** Outliers are only dropped this long (s) after a good prediction */
+#define CLOCKSYNC_OUTLIER_HOLD  10.0
+
+/**
+ * Extend a 32-bit wrapping clock relative to a nearby 64-bit clock
+ */
+static uint64_t
+clock_extend(uint64_t ref, uint32_t clock)
+{
+    return ref + (int64_t)(int32_t)(clock - (uint32_t)ref);
+}
+
+void
+clocksync_init(struct clocksync *cs, double local_freq, double remote_freq)
+{
+    memset(cs, 0, sizeof(*cs));
+    cs->local_freq = local_freq;
+    cs->remote_freq = remote_freq;
+    cs->freq = remote_freq / local_freq;
+}
+
+int
+clocksync_add_sample(struct clocksync *cs, uint32_t sent, uint32_t received,
+                     uint32_t remote_clock)
+{
+    double half_rtt = 0.5 * (double)(int32_t)(received - sent);
+
+    if (cs->samples == 0) {
+        /* First exchange fixes the bases; the prior holds the nominal
+         * ratio until enough spread in sample times has accumulated */
+        double prior = CLOCKSYNC_PRIOR_TIME * cs->local_freq;
+        double resync = CLOCKSYNC_RESYNC_ERROR * cs->remote_freq;
+        cs->base_local = cs->last_local = sent;
+        cs->base_remote = cs->last_remote = remote_clock;
+        cs->time_avg = half_rtt;
+        cs->clock_avg = 0.0;
+        cs->time_variance = prior * prior;
+        cs->clock_covariance = prior * prior * cs->freq;
+        cs->prediction_variance = resync * resync;
+        cs->last_prediction_time = half_rtt;
+        cs->min_half_rtt = half_rtt;
+        cs->min_rtt_time = half_rtt;
+        cs->samples = 1;
+        return 0;
+    }
+
+    uint64_t local_ext = clock_extend(cs->last_local, sent);
+    uint64_t remote_ext = clock_extend(cs->last_remote, remote_clock);
+    double sample_time = (double)(int64_t)(local_ext - cs->base_local)
+                         + half_rtt;
+    double clock = (double)(int64_t)(remote_ext - cs->base_remote);
+    double hold = CLOCKSYNC_OUTLIER_HOLD * cs->local_freq;
+    int recent = sample_time < cs->last_prediction_time + hold;
+
+    /* Track the fastest round trip, letting old minimums age out */
+    double aged_rtt = (sample_time - cs->min_rtt_time) * CLOCKSYNC_RTT_AGE;
+    if (half_rtt < cs->min_half_rtt + aged_rtt) {
+        cs->min_half_rtt = half_rtt;
+        cs->min_rtt_time = sample_time;
+    } else if (recent && half_rtt > cs->min_half_rtt + aged_rtt
+               + CLOCKSYNC_RTT_SLACK * cs->local_freq) {
+        cs->rejected++;
+        return 1;
+    }
+
+    /* Filter queries that were held up before the remote read its clock */
+    double exp_clock = (sample_time - cs->time_avg) * cs->freq + cs->clock_avg;
+    double clock_diff2 = (clock - exp_clock) * (clock - exp_clock);
+    double min_err = CLOCKSYNC_OUTLIER_MIN * cs->remote_freq;
+    if (clock_diff2 > 25.0 * cs->prediction_variance
+        && clock_diff2 > min_err * min_err) {
+        if (clock > exp_clock && recent) {
+            cs->rejected++;
+            return 1;
+        }
+        double resync = CLOCKSYNC_RESYNC_ERROR * cs->remote_freq;
+        cs->prediction_variance = resync * resync;
+    } else {
+        cs->last_prediction_time = sample_time;
+        cs->prediction_variance = (1.0 - CLOCKSYNC_DECAY)
+            * (cs->prediction_variance + clock_diff2 * CLOCKSYNC_DECAY);
+    }
+
+    /* Exponentially decaying linear regression */
+    double diff_time = sample_time - cs->time_avg;
+    cs->time_avg += CLOCKSYNC_DECAY * diff_time;
+    cs->time_variance = (1.0 - CLOCKSYNC_DECAY)
+        * (cs->time_variance + diff_time * diff_time * CLOCKSYNC_DECAY);
+    double diff_clock = clock - cs->clock_avg;
+    cs->clock_avg += CLOCKSYNC_DECAY * diff_clock;
+    cs->clock_covariance = (1.0 - CLOCKSYNC_DECAY)
+        * (cs->clock_covariance + diff_time * diff_clock * CLOCKSYNC_DECAY);
+    cs->freq = cs->clock_covariance / cs->time_variance;
+
+    cs->last_local = local_ext;
+    cs->last_remote = remote_ext;
+    cs->samples++;
+    return 0;
+}
+
+uint32_t
+clocksync_local_to_remote(const struct clocksync *cs, uint32_t local)
+{
+    uint64_t local_ext = clock_extend(cs->last_local, local);
+    double t = (double)(int64_t)(local_ext - cs->base_local);
+    double clock = cs->clock_avg + (t - cs->time_avg) * cs->freq;
+    return (uint32_t)(cs->base_remote + (uint64_t)(int64_t)floor(clock + 0.5));
+}
+
+uint32_t
+clocksync_remote_to_local(const struct clocksync *cs, uint32_t remote)
+{
+    uint64_t remote_ext = clock_extend(cs->last_remote, remote);
+    double clock = (double)(int64_t)(remote_ext - cs->base_remote);
+    double t = (clock - cs->clock_avg) / cs->freq + cs->time_avg;
+    return (uint32_t)(cs->base_local + (uint64_t)(int64_t)floor(t + 0.5));
+}
+
+double
+clocksync_get_stddev(const struct clocksync *cs)
+{
+    return sqrt(cs->prediction_variance);
+}
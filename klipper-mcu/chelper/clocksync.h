@@ -0,0 +1,115 @@
+/**
+ * @file    clocksync.h
+ * @brief   Clock offset and drift estimation between two MCUs
+ *
+ * Adapted from Klipper klippy/clocksync.py for MCU use.
+ * The local MCU periodically asks a remote MCU for its clock. Each
+ * exchange yields (local send time, local receive time, remote clock).
+ * An exponentially decaying linear regression of remote clock against
+ * local time gives the remote clock's offset and its frequency relative
+ * to the local clock.
+ *
+ * Key adaptations:
+ * - Each sample is placed at the midpoint of its round trip instead of
+ *   at the send time plus the smallest half round trip, so symmetric
+ *   link jitter averages out rather than biasing the offset; exchanges
+ *   much slower than the fastest one seen are dropped instead
+ * - Clocks are 32-bit wrapping ticks on both sides, extended internally
+ * - The regression starts from the nominal frequency ratio instead of
+ *   requiring a burst of samples before the first estimate
+ * - No malloc, C99 compatible
+ */
+
+#ifndef CHELPER_CLOCKSYNC_H
+#define CHELPER_CLOCKSYNC_H
+
+#include <stdint.h>
+
+/**
+ * @brief Clock estimator state
+ *
+ * Regression sums are kept relative to the first sample's clocks so
+ * double precision stays well below one tick for days of uptime.
+ */
+struct clocksync {
+    double local_freq;          /**< Nominal local clock (Hz) */
+    double remote_freq;         /**< Nominal remote clock (Hz) */
+    uint64_t base_local;        /**< Extended local clock of first sample */
+    uint64_t base_remote;       /**< Extended remote clock of first sample */
+    uint64_t last_local;        /**< Extended local send time of last sample */
+    uint64_t last_remote;       /**< Extended remote clock of last sample */
+    double time_avg;            /**< Mean local time (ticks from base) */
+    double time_variance;       /**< Variance of local time */
+    double clock_avg;           /**< Mean remote clock (ticks from base) */
+    double clock_covariance;    /**< Covariance of local time and remote clock */
+    double prediction_variance; /**< Variance of remote clock predictions */
+    double last_prediction_time;/**< Local time of last accepted sample */
+    double min_half_rtt;        /**< Smallest half round trip (local ticks) */
+    double min_rtt_time;        /**< Local time min_half_rtt was measured */
+    double freq;                /**< Remote ticks per local tick */
+    uint32_t samples;           /**< Samples accepted */
+    uint32_t rejected;          /**< Samples dropped as outliers */
+};
+
+/**
+ * @brief Reset the estimator
+ * @param cs          Estimator
+ * @param local_freq  Nominal local clock frequency (Hz)
+ * @param remote_freq Nominal remote clock frequency (Hz)
+ */
+void clocksync_init(struct clocksync *cs, double local_freq,
+                    double remote_freq);
+
+/**
+ * @brief Add one clock exchange
+ * @param cs           Estimator
+ * @param sent         Local clock when the query was sent
+ * @param received     Local clock when the reply arrived
+ * @param remote_clock Remote clock carried by the reply
+ * @return 0 if the sample was used, 1 if it was dropped as an outlier
+ *
+ * Exchanges delayed in either direction are dropped while recent
+ * predictions are still good: a slow round trip shifts the midpoint,
+ * and a query held up before the remote read its clock reports a
+ * remote clock later than predicted.
+ */
+int clocksync_add_sample(struct clocksync *cs, uint32_t sent,
+                         uint32_t received, uint32_t remote_clock);
+
+/**
+ * @brief Check whether an estimate is available
+ * @param cs Estimator
+ * @return Non-zero after the first accepted sample
+ */
+static inline int
+clocksync_is_valid(const struct clocksync *cs)
+{
+    return cs->samples > 0;
+}
+
+/**
+ * @brief Convert a local clock to the remote clock
+ * @param cs    Estimator (must be valid)
+ * @param local Local clock, within half a wrap of the last sample
+ * @return Estimated remote clock at that instant
+ */
+uint32_t clocksync_local_to_remote(const struct clocksync *cs,
+                                   uint32_t local);
+
+/**
+ * @brief Convert a remote clock to the local clock
+ * @param cs     Estimator (must be valid)
+ * @param remote Remote clock, within half a wrap of the last sample
+ * @return Estimated local clock at that instant
+ */
+uint32_t clocksync_remote_to_local(const struct clocksync *cs,
+                                   uint32_t remote);
+
+/**
+ * @brief Standard deviation of remote clock predictions
+ * @param cs Estimator
+ * @return Remote ticks
+ */
+double clocksync_get_stddev(const struct clocksync *cs);
+
+#endif /* CHELPER_CLOCKSYNC_H */
@@ -15,6 +15,28 @@
 #include <string.h>
 #include <math.h>
 
+/* ========== Solver Parameters ========== */
+
+/*
+ * Newton convergence tolerance (steps) and finite-difference step
+ * (seconds). Single precision cannot resolve 1e-9 steps at typical
+ * positions, so float builds use a looser tolerance and a larger dt.
+ */
+#if CONFIG_MOTION_FLOAT
+#define ITERSOLVE_TOLERANCE     MOTION_C(1e-3)
+#define ITERSOLVE_DERIV_DT      MOTION_C(1e-4)
+#else
+#define ITERSOLVE_TOLERANCE     1e-9
+#define ITERSOLVE_DERIV_DT      1e-6
+#endif
+
+/*
+ * Steppers that are active outside their moves (pre/post active time)
+ * follow a position that may reverse inside one move. Their step ranges
+ * are split so each piece is monotonic to well within a step.
+ */
+#define ITERSOLVE_ACTIVE_CHUNK  MOTION_C(0.001)
+
 /* ========== Static Memory Pools ========== */
 
 static struct stepper_kinematics sk_pool[ITERSOLVE_MAX_STEPPERS];
@@ -38,6 +60,7 @@ itersolve_alloc(void)
             struct stepper_kinematics *sk = &sk_pool[i];
             memset(sk, 0, sizeof(*sk));
             sk->step_dist = 1.0;  /* Default: 1mm per step */
+            sk->active_axes = TRAPQ_AXIS_ALL;
             return sk;
         }
     }
@@ -62,6 +85,13 @@ void
 itersolve_set_trapq(struct stepper_kinematics *sk, struct trapq *tq)
 {
     sk->tq = tq;
+    sk->active_move = NULL;
+}
+
+void
+itersolve_set_step_queue(struct stepper_kinematics *sk, struct step_queue *sq)
+{
+    sk->sq = sq;
 }
 
 void
@@ -70,6 +100,12 @@ itersolve_set_calc_callback(struct stepper_kinematics *sk, sk_calc_callback cb)
     sk->calc_position_cb = cb;
 }
 
+void
+itersolve_set_solver(struct stepper_kinematics *sk, int solver)
+{
+    sk->solver = solver;
+}
+
 void
 itersolve_set_step_dist(struct stepper_kinematics *sk, double step_dist)
 {
@@ -93,23 +129,29 @@ itersolve_get_position(struct stepper_kinematics *sk)
 
 /**
  * Find the move containing the given time
+ * 
+ * Starts at the step generation cursor, which is normally next to the
+ * queried time, and steps through the trapq in time order.
  */
 static struct move *
-find_move_at_time(struct trapq *tq, double print_time)
+find_move_at_time(struct stepper_kinematics *sk, double print_time)
 {
-    if (tq == NULL) {
-        return NULL;
+    struct trapq *tq = sk->tq;
+    struct move *m = sk->active_move;
+    if (m == NULL) {
+        m = trapq_first_move(tq);
     }
     
-    struct move *m;
-    list_for_each_entry(m, &tq->moves, struct move, node) {
-        double move_end = m->print_time + m->move_t;
-        if (print_time >= m->print_time && print_time <= move_end) {
-            return m;
-        }
+    while (m != NULL && print_time < m->print_time) {
+        m = trapq_move_prev(tq, m);
     }
-    
-    return NULL;
+    while (m != NULL && print_time > m->print_time + m->move_t) {
+        m = trapq_move_next(tq, m);
+    }
+    if (m == NULL || print_time < m->print_time) {
+        return NULL;
+    }
+    return m;
 }
 
 double
@@ -119,7 +161,7 @@ itersolve_calc_position(struct stepper_kinematics *sk, double print_time)
         return sk->commanded_pos;
     }
     
-    struct move *m = find_move_at_time(sk->tq, print_time);
+    struct move *m = find_move_at_time(sk, print_time);
     if (m == NULL) {
         return sk->commanded_pos;
     }
@@ -136,46 +178,47 @@ itersolve_calc_position(struct stepper_kinematics *sk, double print_time)
  * Uses Newton-Raphson iteration to find the time when the stepper
  * position equals the target step position.
  */
-static double
+static motion_t
 itersolve_find_step_time(struct stepper_kinematics *sk, struct move *m,
-                         double target_pos, double low_time, double high_time)
+                         motion_t target_pos, motion_t low_time,
+                         motion_t high_time)
 {
     /* Newton-Raphson iteration parameters */
     const int max_iterations = 50;
-    const double tolerance = 1e-9;
+    const motion_t tolerance = ITERSOLVE_TOLERANCE;
     
-    double time = (low_time + high_time) * 0.5;
+    motion_t time = (low_time + high_time) * MOTION_C(0.5);
     
     for (int i = 0; i < max_iterations; i++) {
-        double pos = sk->calc_position_cb(sk, m, time);
-        double error = pos - target_pos;
+        motion_t pos = sk->calc_position_cb(sk, m, time);
+        motion_t error = pos - target_pos;
         
-        if (fabs(error) < tolerance) {
+        if (motion_fabs(error) < tolerance) {
             return time;
         }
         
         /* Estimate derivative using finite difference */
-        double dt = 1e-6;
-        double pos_dt = sk->calc_position_cb(sk, m, time + dt);
-        double derivative = (pos_dt - pos) / dt;
+        motion_t dt = ITERSOLVE_DERIV_DT;
+        motion_t pos_dt = sk->calc_position_cb(sk, m, time + dt);
+        motion_t derivative = (pos_dt - pos) / dt;
         
-        if (fabs(derivative) < 1e-12) {
+        if (motion_fabs(derivative) < MOTION_C(1e-12)) {
             /* Derivative too small, use bisection */
             if (error > 0) {
                 high_time = time;
             } else {
                 low_time = time;
             }
-            time = (low_time + high_time) * 0.5;
+            time = (low_time + high_time) * MOTION_C(0.5);
         } else {
             /* Newton-Raphson step */
-            double new_time = time - error / derivative;
+            motion_t new_time = time - error / derivative;
             
             /* Clamp to bounds */
             if (new_time < low_time) {
-                new_time = (low_time + time) * 0.5;
+                new_time = (low_time + time) * MOTION_C(0.5);
             } else if (new_time > high_time) {
-                new_time = (time + high_time) * 0.5;
+                new_time = (time + high_time) * MOTION_C(0.5);
             }
             
             time = new_time;
@@ -185,6 +228,270 @@ itersolve_find_step_time(struct stepper_kinematics *sk, struct move *m,
     return time;
 }
 
+/**
+ * Get one component of a coordinate by axis index
+ */
+static motion_t
+coord_get_axis(const struct coord *c, int axis)
+{
+    switch (axis) {
+    case 0: return c->x;
+    case 1: return c->y;
+    case 2: return c->z;
+    case ITERSOLVE_AXIS_X_PLUS_Y: return c->x + c->y;
+    case ITERSOLVE_AXIS_X_MINUS_Y: return c->x - c->y;
+    default: return c->e;
+    }
+}
+
+/**
+ * Solve the step time analytically for a linear (cartesian) axis
+ * 
+ * Converts the target step position to a distance along the move and
+ * inverts the trapezoid with move_get_time(). Returns a negative value
+ * when the axis does not take part in the move.
+ */
+static motion_t
+itersolve_linear_step_time(struct stepper_kinematics *sk, struct move *m,
+                           motion_t target_pos, motion_t low_time,
+                           motion_t high_time)
+{
+    motion_t axis_r = coord_get_axis(&m->axes_r, sk->axis);
+    if (motion_fabs(axis_r) < MOTION_C(1e-12) || sk->scale == MOTION_C(0.0)) {
+        return -MOTION_C(1.0);
+    }
+    
+    motion_t axis_pos = target_pos / sk->scale -
+                      coord_get_axis(&m->start_pos, sk->axis);
+    motion_t time = move_get_time(m, axis_pos / axis_r);
+    
+    if (time < low_time) {
+        time = low_time;
+    } else if (time > high_time) {
+        time = high_time;
+    }
+    
+    return time;
+}
+
+/**
+ * Solve the step time of a delta tower in closed form
+ * 
+ * With the effector on the line start_pos + axes_r * d, the carriage
+ * height h satisfies (h - z)^2 + (x - tower_x)^2 + (y - tower_y)^2 = arm2,
+ * a quadratic in the distance d. The root on the h >= z branch nearest
+ * the time range is taken. Returns a negative value if the move has no
+ * XYZ motion or no root lies within a step of the range.
+ */
+static motion_t
+itersolve_delta_step_time(struct stepper_kinematics *sk, struct move *m,
+                          motion_t target_pos, motion_t low_time,
+                          motion_t high_time)
+{
+    motion_t rx = m->axes_r.x, ry = m->axes_r.y, rz = m->axes_r.z;
+    motion_t a = rx * rx + ry * ry + rz * rz;
+    if (a < MOTION_C(1e-12) || sk->scale == MOTION_C(0.0)) {
+        return -MOTION_C(1.0);
+    }
+    
+    motion_t w = target_pos / sk->scale - m->start_pos.z;
+    motion_t ex = m->start_pos.x - sk->tower_x;
+    motion_t ey = m->start_pos.y - sk->tower_y;
+    motion_t half_b = ex * rx + ey * ry - w * rz;
+    motion_t c = w * w + ex * ex + ey * ey - sk->arm2;
+    motion_t disc = half_b * half_b - a * c;
+    if (disc < MOTION_C(0.0)) {
+        disc = MOTION_C(0.0);
+    }
+    
+    /* Numerically stable roots: q / a and c / q */
+    motion_t sq = motion_sqrt(disc);
+    motion_t q = (half_b >= MOTION_C(0.0)) ? -(half_b + sq) : (sq - half_b);
+    motion_t roots[2];
+    roots[0] = q / a;
+    roots[1] = (q != MOTION_C(0.0)) ? c / q : roots[0];
+    
+    motion_t d_lo = move_get_distance(m, low_time);
+    motion_t d_hi = move_get_distance(m, high_time);
+    motion_t best = -MOTION_C(1.0);
+    motion_t best_err = sk->step_dist;
+    for (int i = 0; i < 2; i++) {
+        motion_t d = roots[i];
+        if (w - rz * d < -sk->step_dist) {
+            continue;               /* Carriage below the effector */
+        }
+        motion_t err = (d < d_lo) ? d_lo - d : (d > d_hi) ? d - d_hi : 0;
+        if (err <= best_err) {
+            best_err = err;
+            best = d;
+        }
+    }
+    if (best_err >= sk->step_dist) {
+        return -MOTION_C(1.0);
+    }
+    
+    motion_t time = move_get_time(m, best);
+    if (time < low_time) {
+        time = low_time;
+    } else if (time > high_time) {
+        time = high_time;
+    }
+    
+    return time;
+}
+
+/**
+ * Find the move times where a delta carriage reverses
+ * 
+ * The carriage height has a stationary point where
+ * rz * sqrt(arm2 - ex^2 - ey^2) = ex * rx + ey * ry, with ex/ey the
+ * effector offset from the tower. Squared, this is a quadratic in the
+ * move distance. Extra roots only cause a harmless extra split.
+ * 
+ * @return Number of reversal times strictly inside (start, end), ascending
+ */
+static int
+itersolve_delta_turns(struct stepper_kinematics *sk, struct move *m,
+                      motion_t start_time, motion_t end_time,
+                      motion_t *turns)
+{
+    motion_t rx = m->axes_r.x, ry = m->axes_r.y, rz = m->axes_r.z;
+    motion_t k = rx * rx + ry * ry;
+    if (k < MOTION_C(1e-12)) {
+        return 0;                   /* Pure Z move: carriage is linear */
+    }
+    
+    motion_t ex = m->start_pos.x - sk->tower_x;
+    motion_t ey = m->start_pos.y - sk->tower_y;
+    motion_t g0 = ex * rx + ey * ry;
+    motion_t kz = k + rz * rz;
+    motion_t a = k * kz;
+    motion_t half_b = g0 * kz;
+    motion_t c = g0 * g0 - rz * rz * (sk->arm2 - ex * ex - ey * ey);
+    motion_t disc = half_b * half_b - a * c;
+    if (disc < MOTION_C(0.0)) {
+        disc = MOTION_C(0.0);
+    }
+    motion_t sq = motion_sqrt(disc);
+    
+    motion_t d_lo = move_get_distance(m, start_time);
+    motion_t d_hi = move_get_distance(m, end_time);
+    motion_t roots[2] = { (-half_b - sq) / a, (-half_b + sq) / a };
+    int count = 0;
+    for (int i = 0; i < 2; i++) {
+        if (roots[i] > d_lo && roots[i] < d_hi &&
+            (count == 0 || roots[i] > roots[0])) {
+            turns[count++] = move_get_time(m, roots[i]);
+        }
+    }
+    
+    return count;
+}
+
+/**
+ * Generate steps of one move between two move times
+ * 
+ * The stepper is assumed to move in one direction over the range.
+ * Returns -1 if the step queue filled; generation then resumes from the
+ * last queued step on the next call.
+ */
+static int
+itersolve_gen_steps_range(struct stepper_kinematics *sk, struct move *m,
+                          motion_t start_time, motion_t end_time,
+                          int *steps_generated)
+{
+    motion_t start_pos = sk->calc_position_cb(sk, m, start_time);
+    motion_t end_pos = sk->calc_position_cb(sk, m, end_time);
+    
+    /* Determine step direction */
+    int8_t dir = (end_pos > start_pos) ? 1 : -1;
+    
+    /* Calculate target step positions */
+    motion_t step_pos = sk->step_pos;
+    motion_t target_step = (dir > 0) ? 
+                           motion_floor(step_pos) + MOTION_C(1.0) : 
+                           motion_ceil(step_pos) - MOTION_C(1.0);
+    
+    /* Generate steps within this range */
+    while (1) {
+        /* Check if target is within move range */
+        if (dir > 0 && target_step > end_pos) {
+            break;
+        }
+        if (dir < 0 && target_step < end_pos) {
+            break;
+        }
+        
+        /* Find time when we reach target position */
+        motion_t step_time = MOTION_C(-1.0);
+        if (sk->solver == ITERSOLVE_SOLVER_LINEAR) {
+            step_time = itersolve_linear_step_time(sk, m, target_step,
+                                                   start_time, end_time);
+        } else if (sk->solver == ITERSOLVE_SOLVER_DELTA) {
+            step_time = itersolve_delta_step_time(sk, m, target_step,
+                                                  start_time, end_time);
+        }
+        if (step_time < MOTION_C(0.0)) {
+            step_time = itersolve_find_step_time(sk, m, target_step,
+                                                 start_time, end_time);
+        }
+        
+        /* Queue step; on a full queue resume from this step next time */
+        double abs_time = m->print_time + step_time;
+        if (sk->sq != NULL && step_queue_push(sk->sq, abs_time, dir) != 0) {
+            sk->commanded_pos = sk->step_pos;
+            return -1;
+        }
+        
+        (*steps_generated)++;
+        sk->last_flush_time = abs_time;
+        sk->step_pos = target_step;
+        
+        /* Move to next step */
+        target_step += dir;
+        start_time = step_time;
+    }
+    
+    return 0;
+}
+
+/**
+ * Check whether a stepper stays still over a move's range
+ * 
+ * True when neither the move nor, for kinematics that look across moves,
+ * any neighbour within the pre/post active window moves an axis the
+ * stepper follows. Such ranges produce no steps and need no solving.
+ */
+static int
+itersolve_move_idle(struct stepper_kinematics *sk, struct move *m,
+                    double range_start, double range_end)
+{
+    if (m->active_axes & sk->active_axes) {
+        return 0;
+    }
+    
+    double window = sk->gen_steps_pre_active + sk->gen_steps_post_active;
+    if (window <= 0.0) {
+        return 1;
+    }
+    
+    struct move *p = m;
+    while ((p = trapq_move_prev(sk->tq, p)) != NULL &&
+           p->print_time + p->move_t > range_start - window) {
+        if (p->active_axes & sk->active_axes) {
+            return 0;
+        }
+    }
+    p = m;
+    while ((p = trapq_move_next(sk->tq, p)) != NULL &&
+           p->print_time < range_end + window) {
+        if (p->active_axes & sk->active_axes) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
 int
 itersolve_generate_steps(struct stepper_kinematics *sk, double flush_time)
 {
@@ -192,77 +499,121 @@ itersolve_generate_steps(struct stepper_kinematics *sk, double flush_time)
         return 0;
     }
     
+    /* Already generated up to here (callers may pass a shorter horizon) */
+    if (flush_time <= sk->last_flush_time) {
+        return 0;
+    }
+    
     int steps_generated = 0;
     double current_time = sk->last_flush_time;
     
-    struct move *m;
-    list_for_each_entry(m, &sk->tq->moves, struct move, node) {
+    /* Resume where the previous call stopped */
+    struct move *m = sk->active_move;
+    if (m == NULL) {
+        m = trapq_first_move(sk->tq);
+    }
+    struct move *resume = NULL;
+    
+    for (; m != NULL; m = trapq_move_next(sk->tq, m)) {
         double move_start = m->print_time;
-        double move_end = m->print_time + m->move_t;
+        struct move *next = trapq_move_next(sk->tq, m);
+        
+        /*
+         * A move covers the time the stepper may be moving because of it,
+         * up to the start of the next move.
+         */
+        double range_start = move_start - sk->gen_steps_pre_active;
+        double range_end = move_start + m->move_t + sk->gen_steps_post_active;
+        if (next != NULL && next->print_time < range_end) {
+            range_end = next->print_time;
+        }
         
         /* Skip moves we've already processed */
-        if (move_end <= current_time) {
+        if (range_end <= current_time) {
             continue;
         }
         
         /* Stop if move is beyond flush time */
-        if (move_start >= flush_time) {
+        if (range_start >= flush_time) {
             break;
         }
         
-        /* Calculate start and end positions for this move */
-        double start_time = (current_time > move_start) ? 
-                            (current_time - move_start) : 0.0;
-        double end_time = (flush_time < move_end) ? 
-                          (flush_time - move_start) : m->move_t;
+        /* First move reaching past flush_time is where the next call resumes */
+        if (resume == NULL && range_end > flush_time) {
+            resume = m;
+        }
+        
+        /* Axes this stepper follows do not move here: nothing to solve */
+        if (itersolve_move_idle(sk, m, range_start, range_end)) {
+            current_time = range_end;
+            continue;
+        }
         
-        double start_pos = sk->calc_position_cb(sk, m, start_time);
-        double end_pos = sk->calc_position_cb(sk, m, end_time);
+        /* Time range within this move (may extend past either end) */
+        motion_t start_time = (current_time > range_start) ? 
+                              (motion_t)(current_time - move_start) :
+                              (motion_t)(range_start - move_start);
+        motion_t end_time = (flush_time < range_end) ? 
+                            (motion_t)(flush_time - move_start) :
+                            (motion_t)(range_end - move_start);
         
-        /* Determine step direction */
-        int8_t dir = (end_pos > start_pos) ? 1 : -1;
+        motion_t chunk = end_time - start_time;
+        if (sk->gen_steps_pre_active > MOTION_C(0.0) ||
+            sk->gen_steps_post_active > MOTION_C(0.0)) {
+            chunk = ITERSOLVE_ACTIVE_CHUNK;
+        }
         
-        /* Calculate target step positions */
-        double step_pos = sk->step_pos;
-        double target_step = (dir > 0) ? 
-                             floor(step_pos) + 1.0 : 
-                             ceil(step_pos) - 1.0;
+        /* Delta carriages may reverse inside one move */
+        motion_t turns[2];
+        int num_turns = 0;
+        int turn = 0;
+        if (sk->solver == ITERSOLVE_SOLVER_DELTA) {
+            num_turns = itersolve_delta_turns(sk, m, start_time, end_time,
+                                              turns);
+        }
         
-        /* Generate steps within this move */
-        while (1) {
-            /* Check if target is within move range */
-            if (dir > 0 && target_step > end_pos) {
-                break;
+        do {
+            motion_t chunk_end = start_time + chunk;
+            if (chunk_end > end_time) {
+                chunk_end = end_time;
             }
-            if (dir < 0 && target_step < end_pos) {
-                break;
+            while (turn < num_turns && turns[turn] <= start_time) {
+                turn++;
             }
-            
-            /* Find time when we reach target position */
-            double step_time = itersolve_find_step_time(sk, m, target_step,
-                                                        start_time, end_time);
-            
-            /* Record step (in real implementation, this would queue to stepper) */
-            double abs_time = m->print_time + step_time;
-            (void)abs_time;  /* TODO: Queue step to stepper driver */
-            
-            steps_generated++;
-            sk->step_pos = target_step;
-            
-            /* Move to next step */
-            target_step += dir;
-            start_time = step_time;
-        }
+            if (turn < num_turns && turns[turn] < chunk_end) {
+                chunk_end = turns[turn];
+            }
+            if (itersolve_gen_steps_range(sk, m, start_time, chunk_end,
+                                          &steps_generated) < 0) {
+                sk->active_move = (resume != NULL) ? resume : m;
+                return steps_generated;
+            }
+            start_time = chunk_end;
+        } while (start_time < end_time);
         
-        current_time = move_end;
+        current_time = range_end;
     }
     
+    /*
+     * Keep the first move not fully processed. Once all moves are done
+     * the last one may be freed before new moves arrive, so restart from
+     * the head of the (by then short) active list instead.
+     */
+    sk->active_move = (resume != NULL) ? resume : m;
     sk->last_flush_time = flush_time;
     sk->commanded_pos = sk->step_pos;
     
     return steps_generated;
 }
 
+void
+itersolve_set_flush_time(struct stepper_kinematics *sk, double flush_time)
+{
+    sk->last_flush_time = flush_time;
+    /* Moves may have been discarded along with the skipped steps */
+    sk->active_move = NULL;
+}
+
 int
 itersolve_is_active(struct stepper_kinematics *sk)
 {
@@ -274,25 +625,28 @@ itersolve_is_active(struct stepper_kinematics *sk)
 
 /* ========== Step Queue Functions ========== */
 
+#if !SPSC_RING_SIZE_OK(STEP_QUEUE_SIZE)
+#error "STEP_QUEUE_SIZE must be a power of two"
+#endif
+
 void
 step_queue_init(struct step_queue *sq)
 {
-    sq->head = 0;
-    sq->tail = 0;
-    sq->count = 0;
+    spsc_ring_init(&sq->ring);
 }
 
 int
 step_queue_push(struct step_queue *sq, double time, int8_t dir)
 {
-    if (sq->count >= STEP_QUEUE_SIZE) {
+    if (spsc_ring_free(&sq->ring, STEP_QUEUE_SIZE) == 0) {
         return -1;  /* Queue full */
     }
     
-    sq->steps[sq->tail].time = time;
-    sq->steps[sq->tail].dir = dir;
-    sq->tail = (sq->tail + 1) % STEP_QUEUE_SIZE;
-    sq->count++;
+    struct step_time *st = &sq->steps[spsc_ring_head(&sq->ring,
+                                                     STEP_QUEUE_SIZE)];
+    st->time = time;
+    st->dir = dir;
+    spsc_ring_push(&sq->ring, 1);
     
     return 0;
 }
@@ -300,13 +654,38 @@ step_queue_push(struct step_queue *sq, double time, int8_t dir)
 int
 step_queue_pop(struct step_queue *sq, struct step_time *step)
 {
-    if (sq->count == 0) {
+    if (spsc_ring_avail(&sq->ring) == 0) {
         return -1;  /* Queue empty */
     }
     
-    *step = sq->steps[sq->head];
-    sq->head = (sq->head + 1) % STEP_QUEUE_SIZE;
-    sq->count--;
+    *step = sq->steps[spsc_ring_tail(&sq->ring, STEP_QUEUE_SIZE)];
+    spsc_ring_pop(&sq->ring, 1);
+    
+    return 0;
+}
+
+int
+step_queue_peek(const struct step_queue *sq, struct step_time *step)
+{
+    if (spsc_ring_avail(&sq->ring) == 0) {
+        return -1;  /* Queue empty */
+    }
+    
+    *step = sq->steps[spsc_ring_tail(&sq->ring, STEP_QUEUE_SIZE)];
+    
+    return 0;
+}
+
+int
+step_queue_peek_at(const struct step_queue *sq, int index,
+                   struct step_time *step)
+{
+    if (index < 0 || (uint32_t)index >= spsc_ring_avail(&sq->ring)) {
+        return -1;
+    }
+    
+    *step = sq->steps[(sq->ring.tail + (uint32_t)index) &
+                      (STEP_QUEUE_SIZE - 1)];
     
     return 0;
 }
@@ -314,5 +693,5 @@ step_queue_pop(struct step_queue *sq, struct step_time *step)
 int
 step_queue_empty(const struct step_queue *sq)
 {
-    return sq->count == 0;
+    return spsc_ring_avail(&sq->ring) == 0;
 }
@@ -16,10 +16,40 @@
 #define CHELPER_ITERSOLVE_H
 
 #include <stdint.h>
+#include "config.h"
+#include "spsc_ring.h"
 #include "trapq.h"
 
 /* Forward declarations */
 struct stepper_kinematics;
+struct step_queue;
+
+/**
+ * @brief Step time solver selection
+ * 
+ * ITERSOLVE_SOLVER_LINEAR requires the stepper position to be
+ * scale * (start_pos[axis] + axes_r[axis] * distance), as for cartesian
+ * and CoreXY axes, and solves each step analytically per trapezoid
+ * phase. Moves that do not move the axis fall back to the iterative
+ * solver.
+ * 
+ * ITERSOLVE_SOLVER_DELTA requires the position of a linear delta tower,
+ * scale * (z + sqrt(arm2 - (x - tower_x)^2 - (y - tower_y)^2)). Each
+ * step is one quadratic in the move distance, and moves are split where
+ * the carriage reverses.
+ */
+#define ITERSOLVE_SOLVER_ITERATIVE  0   /**< Newton/bisection via callback */
+#define ITERSOLVE_SOLVER_LINEAR     1   /**< Closed-form per trapezoid phase */
+#define ITERSOLVE_SOLVER_DELTA      2   /**< Closed-form per delta tower */
+
+/**
+ * @brief Virtual axes for the linear solver
+ * 
+ * CoreXY motors follow x + y and x - y, which are as linear in the
+ * move distance as a cartesian axis.
+ */
+#define ITERSOLVE_AXIS_X_PLUS_Y     4
+#define ITERSOLVE_AXIS_X_MINUS_Y    5
 
 /**
  * @brief Callback type for calculating stepper position from cartesian coords
@@ -27,10 +57,10 @@ struct stepper_kinematics;
  * @param sk    Stepper kinematics context
  * @param m     Current move
  * @param time  Time offset within move
- * @return Stepper position in steps (as double for interpolation)
+ * @return Stepper position in steps (fractional for interpolation)
  */
-typedef double (*sk_calc_callback)(struct stepper_kinematics *sk,
-                                   struct move *m, double time);
+typedef motion_t (*sk_calc_callback)(struct stepper_kinematics *sk,
+                                     struct move *m, motion_t time);
 
 /**
  * @brief Stepper kinematics structure
@@ -42,25 +72,50 @@ struct stepper_kinematics {
     /* Position calculation callback */
     sk_calc_callback calc_position_cb;
     
-    /* Active move tracking */
+    /*
+     * Active move tracking: first move not yet fully turned into steps
+     * (NULL: start from the head of the active list). Only moves every
+     * stepper has passed are freed, and itersolve_set_flush_time() /
+     * itersolve_set_trapq() reset it, so it never points at a freed move.
+     */
     struct move *active_move;
     double active_move_start_time;
     
     /* Commanded position tracking */
-    double commanded_pos;       /**< Last commanded position (steps) */
+    motion_t commanded_pos;     /**< Last commanded position (steps) */
     double last_flush_time;     /**< Last time moves were flushed */
     double last_move_time;      /**< End time of last processed move */
     
     /* Step generation state */
-    double step_dist;           /**< Distance per step (mm) */
-    double step_pos;            /**< Current step position */
+    motion_t step_dist;         /**< Distance per step (mm) */
+    motion_t step_pos;          /**< Current step position */
     
     /* Associated trapq */
     struct trapq *tq;
     
+    /* Output queue for generated step times (NULL: steps are only counted) */
+    struct step_queue *sq;
+    
     /* Kinematics-specific data (e.g., axis index for cartesian) */
-    int axis;                   /**< Axis index: 0=X, 1=Y, 2=Z, 3=E */
-    double scale;               /**< Scale factor (e.g., steps_per_mm) */
+    int axis;                   /**< Axis index: 0=X, 1=Y, 2=Z, 3=E,
+                                     or ITERSOLVE_AXIS_* */
+    uint8_t active_axes;        /**< TRAPQ_AXIS_* this stepper follows;
+                                     moves touching none are skipped */
+    motion_t scale;             /**< Scale factor (e.g., steps_per_mm) */
+    int solver;                 /**< Step time solver (ITERSOLVE_SOLVER_*) */
+    
+    /* Delta tower geometry (ITERSOLVE_SOLVER_DELTA) */
+    motion_t arm2;              /**< Diagonal rod length squared (mm^2) */
+    motion_t tower_x;           /**< Tower X position (mm) */
+    motion_t tower_y;           /**< Tower Y position (mm) */
+    
+    /*
+     * Time the stepper can move before a move starts and after it ends
+     * (seconds). Non-zero for kinematics that look across moves, such
+     * as input shaping; zero for plain cartesian axes.
+     */
+    motion_t gen_steps_pre_active;
+    motion_t gen_steps_post_active;
 };
 
 /* ========== Memory Pool Configuration ========== */
@@ -98,6 +153,14 @@ void itersolve_free(struct stepper_kinematics *sk);
  */
 void itersolve_set_trapq(struct stepper_kinematics *sk, struct trapq *tq);
 
+/**
+ * @brief Set the output step queue for a stepper
+ * @param sk Stepper kinematics
+ * @param sq Step queue receiving generated step times (may be NULL)
+ */
+void itersolve_set_step_queue(struct stepper_kinematics *sk,
+                              struct step_queue *sq);
+
 /**
  * @brief Set the position calculation callback
  * @param sk Stepper kinematics
@@ -106,6 +169,13 @@ void itersolve_set_trapq(struct stepper_kinematics *sk, struct trapq *tq);
 void itersolve_set_calc_callback(struct stepper_kinematics *sk,
                                   sk_calc_callback cb);
 
+/**
+ * @brief Select the step time solver
+ * @param sk     Stepper kinematics
+ * @param solver ITERSOLVE_SOLVER_ITERATIVE or ITERSOLVE_SOLVER_LINEAR
+ */
+void itersolve_set_solver(struct stepper_kinematics *sk, int solver);
+
 /**
  * @brief Set the step distance
  * @param sk        Stepper kinematics
@@ -142,10 +212,28 @@ double itersolve_calc_position(struct stepper_kinematics *sk, double print_time)
  * @return Number of steps generated
  * 
  * This is the main function that converts motion queue entries
- * into step timing events.
+ * into step timing events. When a step queue is attached, each step
+ * is pushed as an absolute print time. If the queue fills up, generation
+ * stops after the last queued step and resumes from there on the next
+ * call, so no step is lost. Each call resumes at active_move instead of
+ * rescanning the queue, so its cost scales with the moves it covers.
  */
 int itersolve_generate_steps(struct stepper_kinematics *sk, double flush_time);
 
+/**
+ * @brief Restart step generation at the given time
+ * @param sk         Stepper kinematics
+ * @param flush_time Time before which no steps will be generated
+ * 
+ * Used after an aborted move (e.g. endstop hit while homing) so that
+ * the remainder of that move is not turned into steps later. The time
+ * may be earlier than the last flush: steps already generated past it
+ * must have been discarded by the caller, and the moves that follow
+ * start at flush_time.
+ */
+void itersolve_set_flush_time(struct stepper_kinematics *sk,
+                              double flush_time);
+
 /**
  * @brief Check if stepper is active (has pending moves)
  * @param sk Stepper kinematics
@@ -163,14 +251,14 @@ struct step_time {
 
 /**
  * @brief Step queue for generated steps
+ * 
+ * Depth (STEP_QUEUE_SIZE) is set by the memory budget in config.h and
+ * must be a power of two. Single producer (itersolve) / single consumer,
+ * see spsc_ring.h.
  */
-#define STEP_QUEUE_SIZE     256
-
 struct step_queue {
     struct step_time steps[STEP_QUEUE_SIZE];
-    int head;                   /**< Read index */
-    int tail;                   /**< Write index */
-    int count;                  /**< Number of steps in queue */
+    spsc_ring_t ring;           /**< Producer/consumer indices */
 };
 
 /**
@@ -196,6 +284,24 @@ int step_queue_push(struct step_queue *sq, double time, int8_t dir);
  */
 int step_queue_pop(struct step_queue *sq, struct step_time *step);
 
+/**
+ * @brief Look at next step without removing it
+ * @param sq   Step queue
+ * @param step Output step time entry
+ * @return 0 on success, -1 if queue empty
+ */
+int step_queue_peek(const struct step_queue *sq, struct step_time *step);
+
+/**
+ * @brief Look at a queued step without removing it
+ * @param sq    Step queue
+ * @param index Position from the head (0 = next step)
+ * @param step  Output step time entry
+ * @return 0 on success, -1 if index is beyond the queued steps
+ */
+int step_queue_peek_at(const struct step_queue *sq, int index,
+                       struct step_time *step);
+
 /**
  * @brief Check if step queue is empty
  * @param sq Step queue
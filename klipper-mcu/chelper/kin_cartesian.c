@@ -38,9 +38,9 @@
  * @param time  Time offset within move
  * @return Position in stepper units (steps)
  */
-static double
+static motion_t
 cartesian_x_calc_position(struct stepper_kinematics *sk, struct move *m,
-                          double time)
+                          motion_t time)
 {
     struct coord pos;
     move_get_coord(m, time, &pos);
@@ -50,9 +50,9 @@ cartesian_x_calc_position(struct stepper_kinematics *sk, struct move *m,
 /**
  * @brief Calculate Y axis position at given time within a move
  */
-static double
+static motion_t
 cartesian_y_calc_position(struct stepper_kinematics *sk, struct move *m,
-                          double time)
+                          motion_t time)
 {
     struct coord pos;
     move_get_coord(m, time, &pos);
@@ -62,9 +62,9 @@ cartesian_y_calc_position(struct stepper_kinematics *sk, struct move *m,
 /**
  * @brief Calculate Z axis position at given time within a move
  */
-static double
+static motion_t
 cartesian_z_calc_position(struct stepper_kinematics *sk, struct move *m,
-                          double time)
+                          motion_t time)
 {
     struct coord pos;
     move_get_coord(m, time, &pos);
@@ -74,9 +74,9 @@ cartesian_z_calc_position(struct stepper_kinematics *sk, struct move *m,
 /**
  * @brief Calculate extruder position at given time within a move
  */
-static double
+static motion_t
 cartesian_e_calc_position(struct stepper_kinematics *sk, struct move *m,
-                          double time)
+                          motion_t time)
 {
     struct coord pos;
     move_get_coord(m, time, &pos);
@@ -95,9 +95,11 @@ void
 cartesian_stepper_x_setup(struct stepper_kinematics *sk, double steps_per_mm)
 {
     sk->axis = AXIS_X;
+    sk->active_axes = TRAPQ_AXIS_X;
     sk->scale = steps_per_mm;
     sk->step_dist = 1.0 / steps_per_mm;
     sk->calc_position_cb = cartesian_x_calc_position;
+    sk->solver = ITERSOLVE_SOLVER_LINEAR;
 }
 
 /**
@@ -107,9 +109,11 @@ void
 cartesian_stepper_y_setup(struct stepper_kinematics *sk, double steps_per_mm)
 {
     sk->axis = AXIS_Y;
+    sk->active_axes = TRAPQ_AXIS_Y;
     sk->scale = steps_per_mm;
     sk->step_dist = 1.0 / steps_per_mm;
     sk->calc_position_cb = cartesian_y_calc_position;
+    sk->solver = ITERSOLVE_SOLVER_LINEAR;
 }
 
 /**
@@ -119,9 +123,11 @@ void
 cartesian_stepper_z_setup(struct stepper_kinematics *sk, double steps_per_mm)
 {
     sk->axis = AXIS_Z;
+    sk->active_axes = TRAPQ_AXIS_Z;
     sk->scale = steps_per_mm;
     sk->step_dist = 1.0 / steps_per_mm;
     sk->calc_position_cb = cartesian_z_calc_position;
+    sk->solver = ITERSOLVE_SOLVER_LINEAR;
 }
 
 /**
@@ -131,9 +137,11 @@ void
 cartesian_stepper_e_setup(struct stepper_kinematics *sk, double steps_per_mm)
 {
     sk->axis = AXIS_E;
+    sk->active_axes = TRAPQ_AXIS_E;
     sk->scale = steps_per_mm;
     sk->step_dist = 1.0 / steps_per_mm;
     sk->calc_position_cb = cartesian_e_calc_position;
+    sk->solver = ITERSOLVE_SOLVER_LINEAR;
 }
 
 /**
@@ -290,29 +298,29 @@ cartesian_move_distance(const struct coord *start, const struct coord *end)
  * @param axes_r    Output direction vector (normalized)
  * @return Move distance in mm
  */
-double
+motion_t
 cartesian_calc_direction(const struct coord *start, const struct coord *end,
                          struct coord *axes_r)
 {
-    double dx = end->x - start->x;
-    double dy = end->y - start->y;
-    double dz = end->z - start->z;
-    double de = end->e - start->e;
+    motion_t dx = end->x - start->x;
+    motion_t dy = end->y - start->y;
+    motion_t dz = end->z - start->z;
+    motion_t de = end->e - start->e;
     
     /* Calculate total distance (including extruder for normalization) */
-    double dist = sqrt(dx * dx + dy * dy + dz * dz + de * de);
+    motion_t dist = motion_sqrt(dx * dx + dy * dy + dz * dz + de * de);
     
-    if (dist < 1e-9) {
+    if (dist < MOTION_C(1e-9)) {
         /* Zero-length move */
-        axes_r->x = 0.0;
-        axes_r->y = 0.0;
-        axes_r->z = 0.0;
-        axes_r->e = 0.0;
-        return 0.0;
+        axes_r->x = MOTION_C(0.0);
+        axes_r->y = MOTION_C(0.0);
+        axes_r->z = MOTION_C(0.0);
+        axes_r->e = MOTION_C(0.0);
+        return MOTION_C(0.0);
     }
     
     /* Normalize direction vector */
-    double inv_dist = 1.0 / dist;
+    motion_t inv_dist = MOTION_C(1.0) / dist;
     axes_r->x = dx * inv_dist;
     axes_r->y = dy * inv_dist;
     axes_r->z = dz * inv_dist;
@@ -111,7 +111,8 @@ double cartesian_move_distance(const struct coord *start, const struct coord *en
  * @param axes_r    Output direction vector (normalized)
  * @return Move distance in mm
  */
-double cartesian_calc_direction(const struct coord *start, const struct coord *end,
-                                struct coord *axes_r);
+motion_t cartesian_calc_direction(const struct coord *start,
+                                  const struct coord *end,
+                                  struct coord *axes_r);
 
 #endif /* CHELPER_KIN_CARTESIAN_H */
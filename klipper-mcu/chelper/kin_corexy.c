@@ -0,0 +1,64 @@
+/**
+ * @file    kin_corexy.c
+ * @brief   CoreXY kinematics implementation
+ * 
+ * Adapted from Klipper klippy/chelper/kin_corexy.c for MCU use.
+ * 
+ * The two belts couple X and Y:
+ * - A motor -> x + y
+ * - B motor -> x - y
+ * 
+ * Key adaptations:
+ * - Setup on a stepper from the itersolve pool instead of malloc
+ * - Linear solver via ITERSOLVE_AXIS_X_PLUS_Y / ITERSOLVE_AXIS_X_MINUS_Y
+ * - Removed Python FFI markers (__visible)
+ * - C99 compatible
+ */
+
+#include "kin_corexy.h"
+#include <math.h>
+
+/* ========== Position Calculation Callbacks ========== */
+
+/**
+ * @brief Calculate A motor position (x + y) at given time within a move
+ */
+static motion_t
+corexy_stepper_plus_calc_position(struct stepper_kinematics *sk,
+                                  struct move *m, motion_t time)
+{
+    struct coord pos;
+    move_get_coord(m, time, &pos);
+    return (pos.x + pos.y) * sk->scale;
+}
+
+/**
+ * @brief Calculate B motor position (x - y) at given time within a move
+ */
+static motion_t
+corexy_stepper_minus_calc_position(struct stepper_kinematics *sk,
+                                   struct move *m, motion_t time)
+{
+    struct coord pos;
+    move_get_coord(m, time, &pos);
+    return (pos.x - pos.y) * sk->scale;
+}
+
+/* ========== Kinematics Setup Functions ========== */
+
+void
+corexy_stepper_setup(struct stepper_kinematics *sk, char type,
+                     double steps_per_mm)
+{
+    sk->scale = steps_per_mm;
+    sk->step_dist = 1.0 / steps_per_mm;
+    sk->solver = ITERSOLVE_SOLVER_LINEAR;
+    sk->active_axes = TRAPQ_AXIS_X | TRAPQ_AXIS_Y;
+    if (type == '+') {
+        sk->axis = ITERSOLVE_AXIS_X_PLUS_Y;
+        sk->calc_position_cb = corexy_stepper_plus_calc_position;
+    } else {
+        sk->axis = ITERSOLVE_AXIS_X_MINUS_Y;
+        sk->calc_position_cb = corexy_stepper_minus_calc_position;
+    }
+}
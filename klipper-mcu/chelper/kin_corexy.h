@@ -0,0 +1,30 @@
+/**
+ * @file    kin_corexy.h
+ * @brief   CoreXY kinematics interface
+ * 
+ * Adapted from Klipper klippy/chelper/kin_corexy.c for MCU use.
+ * Provides position calculation callbacks for CoreXY printers. Z and E
+ * use the cartesian callbacks.
+ */
+
+#ifndef CHELPER_KIN_COREXY_H
+#define CHELPER_KIN_COREXY_H
+
+#include "itersolve.h"
+#include "trapq.h"
+
+/* ========== Kinematics Setup Functions ========== */
+
+/**
+ * @brief Setup stepper kinematics for a CoreXY motor
+ * @param sk            Stepper kinematics to configure
+ * @param type          '+' for the A motor (x + y), '-' for B (x - y)
+ * @param steps_per_mm  Steps per millimeter of belt travel
+ * 
+ * Both motors are linear in the move distance, so the linear solver is
+ * selected.
+ */
+void corexy_stepper_setup(struct stepper_kinematics *sk, char type,
+                          double steps_per_mm);
+
+#endif /* CHELPER_KIN_COREXY_H */
@@ -0,0 +1,79 @@
+/**
+ * @file    kin_delta.c
+ * @brief   Linear delta kinematics implementation
+ * 
+ * Adapted from Klipper klippy/chelper/kin_delta.c for MCU use.
+ * 
+ * Key adaptations:
+ * - Setup on a stepper from the itersolve pool instead of malloc
+ * - Tower geometry stored in stepper_kinematics for the closed-form
+ *   delta solver in itersolve.c
+ * - Removed Python FFI markers (__visible)
+ * - C99 compatible
+ */
+
+#include "kin_delta.h"
+#include <math.h>
+
+#define DELTA_PI            3.14159265358979323846
+
+/* ========== Position Calculation Callbacks ========== */
+
+/**
+ * @brief Calculate carriage position at given time within a move
+ */
+static motion_t
+delta_stepper_calc_position(struct stepper_kinematics *sk, struct move *m,
+                            motion_t time)
+{
+    struct coord c;
+    move_get_coord(m, time, &c);
+    motion_t dx = sk->tower_x - c.x;
+    motion_t dy = sk->tower_y - c.y;
+    return (motion_sqrt(sk->arm2 - dx * dx - dy * dy) + c.z) * sk->scale;
+}
+
+/* ========== Kinematics Setup Functions ========== */
+
+void
+delta_stepper_setup(struct stepper_kinematics *sk, double arm2,
+                    double tower_x, double tower_y, double steps_per_mm)
+{
+    sk->scale = steps_per_mm;
+    sk->step_dist = 1.0 / steps_per_mm;
+    sk->arm2 = arm2;
+    sk->tower_x = tower_x;
+    sk->tower_y = tower_y;
+    sk->calc_position_cb = delta_stepper_calc_position;
+    sk->solver = ITERSOLVE_SOLVER_DELTA;
+    sk->active_axes = TRAPQ_AXIS_X | TRAPQ_AXIS_Y | TRAPQ_AXIS_Z;
+}
+
+void
+delta_tower_position(int tower, double radius,
+                     double *tower_x, double *tower_y)
+{
+    static const double angles[DELTA_NUM_TOWERS] = { 210.0, 330.0, 90.0 };
+    double a = 0.0;
+    if (tower >= 0 && tower < DELTA_NUM_TOWERS) {
+        a = angles[tower] * (DELTA_PI / 180.0);
+    }
+    *tower_x = cos(a) * radius;
+    *tower_y = sin(a) * radius;
+}
+
+/* ========== Limits Checking ========== */
+
+int
+delta_check_limits(const struct coord *pos, double print_radius,
+                   double min_z, double max_z)
+{
+    double r2 = (double)pos->x * pos->x + (double)pos->y * pos->y;
+    if (r2 > print_radius * print_radius) {
+        return -1;
+    }
+    if (pos->z < min_z || pos->z > max_z) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file    kin_delta.h
+ * @brief   Linear delta kinematics interface
+ * 
+ * Adapted from Klipper klippy/chelper/kin_delta.c for MCU use.
+ * Each tower carriage sits sqrt(arm^2 - dx^2 - dy^2) above the effector,
+ * where dx/dy is the effector's horizontal offset from the tower.
+ */
+
+#ifndef CHELPER_KIN_DELTA_H
+#define CHELPER_KIN_DELTA_H
+
+#include "itersolve.h"
+#include "trapq.h"
+
+/* ========== Tower Definitions ========== */
+
+#define DELTA_TOWER_A       0   /**< Front left (210 degrees) */
+#define DELTA_TOWER_B       1   /**< Front right (330 degrees) */
+#define DELTA_TOWER_C       2   /**< Back (90 degrees) */
+#define DELTA_NUM_TOWERS    3
+
+/* ========== Kinematics Setup Functions ========== */
+
+/**
+ * @brief Setup stepper kinematics for a delta tower
+ * @param sk            Stepper kinematics to configure
+ * @param arm2          Diagonal rod length squared (mm^2)
+ * @param tower_x       Tower X position (mm)
+ * @param tower_y       Tower Y position (mm)
+ * @param steps_per_mm  Steps per millimeter of carriage travel
+ * 
+ * Selects ITERSOLVE_SOLVER_DELTA, which solves each step time with one
+ * square root instead of Newton iterations.
+ */
+void delta_stepper_setup(struct stepper_kinematics *sk, double arm2,
+                         double tower_x, double tower_y,
+                         double steps_per_mm);
+
+/**
+ * @brief Get the position of a tower at the standard angles
+ * @param tower     DELTA_TOWER_* index
+ * @param radius    Horizontal distance from the centre (mm)
+ * @param tower_x   Output tower X position (mm)
+ * @param tower_y   Output tower Y position (mm)
+ */
+void delta_tower_position(int tower, double radius,
+                          double *tower_x, double *tower_y);
+
+/**
+ * @brief Check if an effector position is reachable
+ * @param pos           Position to check
+ * @param print_radius  Maximum horizontal distance from the centre (mm)
+ * @param min_z         Minimum Z (mm)
+ * @param max_z         Maximum Z (mm)
+ * @return 0 if reachable, -1 if out of bounds
+ */
+int delta_check_limits(const struct coord *pos, double print_radius,
+                       double min_z, double max_z);
+
+#endif /* CHELPER_KIN_DELTA_H */
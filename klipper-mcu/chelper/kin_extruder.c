@@ -0,0 +1,330 @@
+/**
+ * @file    kin_extruder.c
+ * @brief   Extruder kinematics with pressure advance
+ *
+ * Adapted from Klipper klippy/chelper/kin_extruder.c for MCU use.
+ *
+ * With pressure advance enabled the extruder position is the weighted
+ * average of
+ *
+ *     e(t) + pressure_advance * e'(t)
+ *
+ * over [t - hst, t + hst] with a triangular weight (hst = smooth_time/2).
+ * Within one trapezoid phase the integrand is a quadratic in time, so
+ * the average is integrated in closed form phase by phase. The window
+ * reaches into neighbouring moves by walking the trapq.
+ *
+ * Key adaptations:
+ * - Works on the E axis of the shared trapq (axes_r.e is the extrusion
+ *   per mm of travel) instead of a separate extruder trapq
+ * - Static memory pool instead of malloc/free
+ * - Removed Python FFI markers (__visible)
+ * - C99 compatible
+ */
+
+#include "kin_extruder.h"
+#include "kin_cartesian.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+/* ========== Types ========== */
+
+struct extruder_stepper {
+    struct stepper_kinematics sk;       /**< Must be first (container_of) */
+    motion_t pressure_advance;          /**< Advance (seconds) */
+    motion_t half_smooth_time;          /**< Half smoothing window, 0 = off */
+    motion_t inv_half_smooth_time2;     /**< 1 / half_smooth_time^2 */
+};
+
+/* ========== Static Memory Pool ========== */
+
+static struct extruder_stepper extruder_pool[EXTRUDER_MAX_STEPPERS];
+static uint8_t extruder_pool_used[EXTRUDER_MAX_STEPPERS];
+
+/**
+ * Get the extruder stepper owning sk, or NULL if sk is not from the pool
+ */
+static struct extruder_stepper *
+extruder_from_sk(struct stepper_kinematics *sk)
+{
+    if (sk == NULL) {
+        return NULL;
+    }
+    struct extruder_stepper *es = container_of(sk, struct extruder_stepper, sk);
+    int idx = es - extruder_pool;
+    if (idx < 0 || idx >= EXTRUDER_MAX_STEPPERS || !extruder_pool_used[idx]) {
+        return NULL;
+    }
+    return es;
+}
+
+/* ========== Smoothing Integrals ========== */
+
+/**
+ * Integrate (q0 + q1*v + q2*v^2) * (b0 + b1*v) over [v0, v1]
+ */
+static motion_t
+extruder_poly_integrate(motion_t q0, motion_t q1, motion_t q2,
+                        motion_t b0, motion_t b1, motion_t v0, motion_t v1)
+{
+    motion_t c0 = q0 * b0;
+    motion_t c1 = (q0 * b1 + q1 * b0) * MOTION_C(0.5);
+    motion_t c2 = (q1 * b1 + q2 * b0) * (motion_t)(1.0 / 3.0);
+    motion_t c3 = q2 * b1 * MOTION_C(0.25);
+
+    motion_t f1 = v1 * (c0 + v1 * (c1 + v1 * (c2 + v1 * c3)));
+    motion_t f0 = v0 * (c0 + v0 * (c1 + v0 * (c2 + v0 * c3)));
+    return f1 - f0;
+}
+
+/**
+ * Integrate a phase polynomial against the triangular window
+ *
+ * The polynomial (q0 + q1*v + q2*v^2) is in phase time v = t - t0. The
+ * range [a, b] is in move time and must lie within [c - hst, c + hst].
+ */
+static motion_t
+extruder_window_integrate(motion_t q0, motion_t q1, motion_t q2,
+                          motion_t t0, motion_t a, motion_t b,
+                          motion_t c, motion_t hst)
+{
+    motion_t res = MOTION_C(0.0);
+
+    /* Rising half: weight = hst - c + t */
+    motion_t hi = (b < c) ? b : c;
+    if (a < hi) {
+        res += extruder_poly_integrate(q0, q1, q2, hst - c + t0, MOTION_C(1.0),
+                                       a - t0, hi - t0);
+    }
+
+    /* Falling half: weight = hst + c - t */
+    motion_t lo = (a > c) ? a : c;
+    if (lo < b) {
+        res += extruder_poly_integrate(q0, q1, q2, hst + c - t0, -MOTION_C(1.0),
+                                       lo - t0, b - t0);
+    }
+
+    return res;
+}
+
+/**
+ * Check whether pressure advance applies to a move
+ *
+ * Only moves that extrude while travelling in XY build nozzle pressure.
+ */
+static int
+extruder_can_advance(const struct move *m)
+{
+    return m->axes_r.e > MOTION_C(0.0) &&
+           (m->axes_r.x != MOTION_C(0.0) || m->axes_r.y != MOTION_C(0.0));
+}
+
+/**
+ * Extruder position at the end of a move
+ */
+static motion_t
+extruder_move_end(const struct move *m)
+{
+    return m->start_pos.e + m->axes_r.e * move_get_distance(m, m->move_t);
+}
+
+/**
+ * Integrate the advanced position of one move over [a, b] (move time)
+ *
+ * Positions are taken relative to base to limit rounding error.
+ */
+static motion_t
+extruder_move_integrate(const struct move *m, motion_t base, motion_t pa,
+                        motion_t a, motion_t b, motion_t c, motion_t hst)
+{
+    if (a < MOTION_C(0.0)) {
+        a = MOTION_C(0.0);
+    }
+    if (b > m->move_t) {
+        b = m->move_t;
+    }
+    if (a >= b) {
+        return MOTION_C(0.0);
+    }
+
+    motion_t r = m->axes_r.e;
+    motion_t adv = extruder_can_advance(m) ? pa : MOTION_C(0.0);
+    motion_t e0 = m->start_pos.e - base;
+
+    /* Phase durations, start velocities and half accelerations */
+    const motion_t dur[3] = { m->accel_t, m->cruise_t, m->decel_t };
+    const motion_t v0[3] = { m->start_v, m->cruise_v, m->cruise_v };
+    const motion_t ha[3] = { m->half_accel, MOTION_C(0.0), -m->half_accel };
+
+    motion_t res = MOTION_C(0.0);
+    motion_t t0 = MOTION_C(0.0);
+    motion_t d0 = MOTION_C(0.0);
+    for (int i = 0; i < 3; i++) {
+        motion_t t1 = t0 + dur[i];
+        motion_t lo = (a > t0) ? a : t0;
+        motion_t hi = (b < t1) ? b : t1;
+        if (lo < hi) {
+            /* e + adv * e' as a polynomial in phase time */
+            motion_t q0 = e0 + r * (d0 + adv * v0[i]);
+            motion_t q1 = r * (v0[i] + MOTION_C(2.0) * adv * ha[i]);
+            motion_t q2 = r * ha[i];
+            res += extruder_window_integrate(q0, q1, q2, t0, lo, hi, c, hst);
+        }
+        d0 += (v0[i] + ha[i] * dur[i]) * dur[i];
+        t0 = t1;
+    }
+
+    return res;
+}
+
+/* ========== Position Calculation ========== */
+
+/**
+ * Extruder position, with smoothed pressure advance when enabled
+ */
+static motion_t
+extruder_calc_position(struct stepper_kinematics *sk, struct move *m,
+                       motion_t move_time)
+{
+    struct extruder_stepper *es = container_of(sk, struct extruder_stepper, sk);
+    motion_t hst = es->half_smooth_time;
+
+    if (hst <= MOTION_C(0.0)) {
+        motion_t dist = move_get_distance(m, move_time);
+        return (m->start_pos.e + m->axes_r.e * dist) * sk->scale;
+    }
+
+    motion_t pa = es->pressure_advance;
+    motion_t base = m->start_pos.e;
+    motion_t lo = move_time - hst;
+    motion_t hi = move_time + hst;
+    motion_t res = extruder_move_integrate(m, base, pa, lo, hi, move_time, hst);
+
+    /* Earlier moves; times are relative to m */
+    struct move *cur = m;
+    motion_t start = MOTION_C(0.0);
+    while (lo < start) {
+        struct move *prev = trapq_move_prev(sk->tq, cur);
+        if (prev == NULL) {
+            res += extruder_window_integrate(cur->start_pos.e - base,
+                                             MOTION_C(0.0), MOTION_C(0.0),
+                                             MOTION_C(0.0), lo, start,
+                                             move_time, hst);
+            break;
+        }
+        motion_t p_start = (motion_t)(prev->print_time - m->print_time);
+        motion_t p_end = p_start + prev->move_t;
+        if (p_end < start) {
+            /* Gap: hold the end position of prev */
+            res += extruder_window_integrate(extruder_move_end(prev) - base,
+                                             MOTION_C(0.0), MOTION_C(0.0),
+                                             MOTION_C(0.0),
+                                             (lo > p_end) ? lo : p_end, start,
+                                             move_time, hst);
+        }
+        res += extruder_move_integrate(prev, base, pa, lo - p_start,
+                                       start - p_start, move_time - p_start,
+                                       hst);
+        start = p_start;
+        cur = prev;
+    }
+
+    /* Later moves */
+    cur = m;
+    motion_t end = m->move_t;
+    while (hi > end) {
+        struct move *next = trapq_move_next(sk->tq, cur);
+        if (next == NULL) {
+            res += extruder_window_integrate(extruder_move_end(cur) - base,
+                                             MOTION_C(0.0), MOTION_C(0.0),
+                                             MOTION_C(0.0), end, hi,
+                                             move_time, hst);
+            break;
+        }
+        motion_t n_start = (motion_t)(next->print_time - m->print_time);
+        if (n_start > end) {
+            /* Gap: hold the end position of cur */
+            res += extruder_window_integrate(extruder_move_end(cur) - base,
+                                             MOTION_C(0.0), MOTION_C(0.0),
+                                             MOTION_C(0.0), end,
+                                             (hi < n_start) ? hi : n_start,
+                                             move_time, hst);
+        }
+        res += extruder_move_integrate(next, base, pa, end - n_start,
+                                       hi - n_start, move_time - n_start,
+                                       hst);
+        end = n_start + next->move_t;
+        cur = next;
+    }
+
+    return (base + res * es->inv_half_smooth_time2) * sk->scale;
+}
+
+/* ========== Public Functions ========== */
+
+struct stepper_kinematics *
+extruder_stepper_alloc(void)
+{
+    for (int i = 0; i < EXTRUDER_MAX_STEPPERS; i++) {
+        if (!extruder_pool_used[i]) {
+            extruder_pool_used[i] = 1;
+            struct extruder_stepper *es = &extruder_pool[i];
+            memset(es, 0, sizeof(*es));
+            es->sk.step_dist = 1.0;
+            return &es->sk;
+        }
+    }
+    return NULL;  /* Pool exhausted */
+}
+
+void
+extruder_stepper_free(struct stepper_kinematics *sk)
+{
+    struct extruder_stepper *es = extruder_from_sk(sk);
+    if (es != NULL) {
+        extruder_pool_used[es - extruder_pool] = 0;
+    }
+}
+
+void
+extruder_stepper_setup(struct stepper_kinematics *sk, double steps_per_mm)
+{
+    sk->axis = CARTESIAN_AXIS_E;
+    sk->active_axes = TRAPQ_AXIS_E;
+    sk->scale = steps_per_mm;
+    sk->step_dist = 1.0 / steps_per_mm;
+    sk->calc_position_cb = extruder_calc_position;
+    extruder_set_pressure_advance(sk, 0.0, 0.0);
+}
+
+int
+extruder_set_pressure_advance(struct stepper_kinematics *sk,
+                              double pressure_advance, double smooth_time)
+{
+    struct extruder_stepper *es = extruder_from_sk(sk);
+    if (es == NULL || pressure_advance < 0.0 || smooth_time < 0.0 ||
+        smooth_time > EXTRUDER_MAX_SMOOTH_TIME) {
+        return -1;
+    }
+
+    if (pressure_advance == 0.0 || smooth_time == 0.0) {
+        /* Plain linear axis: the closed-form solver applies */
+        es->pressure_advance = MOTION_C(0.0);
+        es->half_smooth_time = MOTION_C(0.0);
+        es->inv_half_smooth_time2 = MOTION_C(0.0);
+        sk->solver = ITERSOLVE_SOLVER_LINEAR;
+        sk->gen_steps_pre_active = MOTION_C(0.0);
+        sk->gen_steps_post_active = MOTION_C(0.0);
+        return 0;
+    }
+
+    double hst = smooth_time * 0.5;
+    es->pressure_advance = (motion_t)pressure_advance;
+    es->half_smooth_time = (motion_t)hst;
+    es->inv_half_smooth_time2 = (motion_t)(1.0 / (hst * hst));
+    sk->solver = ITERSOLVE_SOLVER_ITERATIVE;
+    sk->gen_steps_pre_active = (motion_t)hst;
+    sk->gen_steps_post_active = (motion_t)hst;
+    return 0;
+}
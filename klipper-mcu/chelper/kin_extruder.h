@@ -0,0 +1,64 @@
+/**
+ * @file    kin_extruder.h
+ * @brief   Extruder kinematics with pressure advance
+ *
+ * Adapted from Klipper klippy/chelper/kin_extruder.c for MCU use.
+ * The extruder position is advanced by pressure_advance * velocity on
+ * extruding moves, averaged over a smoothing window so the stepper
+ * never sees a velocity step.
+ */
+
+#ifndef CHELPER_KIN_EXTRUDER_H
+#define CHELPER_KIN_EXTRUDER_H
+
+#include "itersolve.h"
+#include "trapq.h"
+
+/** Number of extruder steppers in the static pool */
+#define EXTRUDER_MAX_STEPPERS   1
+
+/** Longest accepted pressure advance smoothing window (seconds) */
+#define EXTRUDER_MAX_SMOOTH_TIME    0.2
+
+/* ========== Function Prototypes ========== */
+
+/**
+ * @brief Allocate an extruder stepper from the static pool
+ * @return Stepper kinematics, or NULL if pool exhausted
+ */
+struct stepper_kinematics *extruder_stepper_alloc(void);
+
+/**
+ * @brief Return an extruder stepper to the pool
+ * @param sk Stepper kinematics from extruder_stepper_alloc()
+ */
+void extruder_stepper_free(struct stepper_kinematics *sk);
+
+/**
+ * @brief Setup an extruder stepper on the E axis of the trapq
+ * @param sk            Stepper from extruder_stepper_alloc()
+ * @param steps_per_mm  Steps per millimeter of filament
+ *
+ * Pressure advance starts disabled, which behaves exactly like
+ * cartesian_stepper_e_setup() and keeps the linear step solver.
+ */
+void extruder_stepper_setup(struct stepper_kinematics *sk,
+                            double steps_per_mm);
+
+/**
+ * @brief Set pressure advance parameters
+ * @param sk                Extruder stepper
+ * @param pressure_advance  Advance (seconds of extrusion velocity)
+ * @param smooth_time       Smoothing window (seconds)
+ * @return 0 on success, -1 on invalid parameters
+ *
+ * Advance is applied to moves that extrude while moving in XY. A zero
+ * advance or smooth_time disables the feature. While enabled the stepper
+ * looks smooth_time / 2 before and after each move, reported through
+ * gen_steps_pre_active / gen_steps_post_active.
+ */
+int extruder_set_pressure_advance(struct stepper_kinematics *sk,
+                                  double pressure_advance,
+                                  double smooth_time);
+
+#endif /* CHELPER_KIN_EXTRUDER_H */
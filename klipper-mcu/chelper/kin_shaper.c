@@ -0,0 +1,295 @@
+/**
+ * @file    kin_shaper.c
+ * @brief   Input shaping kinematics wrapper implementation
+ *
+ * Adapted from Klipper klippy/chelper/kin_shaper.c for MCU use.
+ *
+ * The shaped position is the weighted sum of the wrapped stepper's
+ * position at a few time offsets:
+ *
+ *     shaped(t) = sum(A_i * orig(t + t_i))
+ *
+ * The offsets reach into neighbouring moves, which are found by walking
+ * the trapq from the move itersolve is working on (normally zero or one
+ * hop). Amplitudes and offsets are computed once when the shaper is
+ * configured, so each position evaluation is a handful of wrapped
+ * callback calls with no transcendental math.
+ *
+ * Key adaptations:
+ * - Static memory pool instead of malloc/free
+ * - Removed Python FFI markers (__visible)
+ * - Shaper definitions (from klippy/extras/shaper_defs.py) built in
+ * - C99 compatible
+ */
+
+#include "kin_shaper.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define SHAPER_PI           3.14159265358979323846
+
+/* EI shaper vibration tolerance */
+#define SHAPER_EI_V_TOL     0.05
+
+/* ========== Types ========== */
+
+struct shaper_pulse {
+    motion_t a;                 /**< Normalized amplitude */
+    motion_t t;                 /**< Time offset (seconds) */
+};
+
+struct input_shaper {
+    struct stepper_kinematics sk;       /**< Must be first (container_of) */
+    struct stepper_kinematics *orig_sk; /**< Wrapped kinematics */
+    int num_pulses;
+    struct shaper_pulse pulses[INPUT_SHAPER_MAX_PULSES];
+};
+
+/* ========== Static Memory Pool ========== */
+
+static struct input_shaper shaper_pool[INPUT_SHAPER_MAX_STEPPERS];
+static uint8_t shaper_pool_used[INPUT_SHAPER_MAX_STEPPERS];
+
+/**
+ * Get the shaper owning sk, or NULL if sk is not from the pool
+ */
+static struct input_shaper *
+shaper_from_sk(struct stepper_kinematics *sk)
+{
+    if (sk == NULL) {
+        return NULL;
+    }
+    struct input_shaper *is = container_of(sk, struct input_shaper, sk);
+    int idx = is - shaper_pool;
+    if (idx < 0 || idx >= INPUT_SHAPER_MAX_STEPPERS || !shaper_pool_used[idx]) {
+        return NULL;
+    }
+    return is;
+}
+
+/* ========== Move Lookup ========== */
+
+/**
+ * Find the move covering a time given relative to move m
+ *
+ * On return *move_time is relative to the returned move and clamped to
+ * it, so times in a gap or beyond the known moves hold the nearest
+ * move's end position.
+ */
+static struct move *
+shaper_find_move(struct trapq *tq, struct move *m, motion_t *move_time)
+{
+    motion_t t = *move_time;
+
+    while (t < MOTION_C(0.0)) {
+        struct move *prev = trapq_move_prev(tq, m);
+        if (prev == NULL) {
+            break;
+        }
+        t += (motion_t)(m->print_time - prev->print_time);
+        m = prev;
+    }
+    while (t > m->move_t) {
+        struct move *next = trapq_move_next(tq, m);
+        if (next == NULL) {
+            break;
+        }
+        motion_t dt = (motion_t)(next->print_time - m->print_time);
+        if (t < dt) {
+            break;              /* In the gap before next */
+        }
+        t -= dt;
+        m = next;
+    }
+
+    if (t < MOTION_C(0.0)) {
+        t = MOTION_C(0.0);
+    } else if (t > m->move_t) {
+        t = m->move_t;
+    }
+    *move_time = t;
+    return m;
+}
+
+/* ========== Position Calculation ========== */
+
+/**
+ * Shaped position: weighted sum of the wrapped position at each pulse
+ */
+static motion_t
+shaper_calc_position(struct stepper_kinematics *sk, struct move *m,
+                     motion_t move_time)
+{
+    struct input_shaper *is = container_of(sk, struct input_shaper, sk);
+    struct stepper_kinematics *orig_sk = is->orig_sk;
+    motion_t pos = MOTION_C(0.0);
+
+    for (int i = 0; i < is->num_pulses; i++) {
+        motion_t t = move_time + is->pulses[i].t;
+        struct move *pm = shaper_find_move(sk->tq, m, &t);
+        pos += is->pulses[i].a * orig_sk->calc_position_cb(orig_sk, pm, t);
+    }
+
+    return pos;
+}
+
+/**
+ * Update the step generation window from the pulse offsets
+ */
+static void
+shaper_update_active(struct input_shaper *is)
+{
+    motion_t pre = MOTION_C(0.0);
+    motion_t post = MOTION_C(0.0);
+
+    for (int i = 0; i < is->num_pulses; i++) {
+        if (is->pulses[i].t > pre) {
+            pre = is->pulses[i].t;
+        }
+        if (-is->pulses[i].t > post) {
+            post = -is->pulses[i].t;
+        }
+    }
+
+    is->sk.gen_steps_pre_active = pre;
+    is->sk.gen_steps_post_active = post;
+}
+
+/* ========== Shaper Definitions ========== */
+
+/**
+ * Fill uncentred impulse amplitudes and times for a shaper type
+ * @return Number of pulses, or 0 for an unknown type
+ */
+static int
+shaper_get_pulses(int type, double freq, double damping_ratio,
+                  double *a, double *t)
+{
+    double df = sqrt(1.0 - damping_ratio * damping_ratio);
+    double t_d = 1.0 / (freq * df);
+    double k;
+
+    switch (type) {
+    case INPUT_SHAPER_ZV:
+        k = exp(-damping_ratio * SHAPER_PI / df);
+        a[0] = 1.0;
+        a[1] = k;
+        t[0] = 0.0;
+        t[1] = 0.5 * t_d;
+        return 2;
+    case INPUT_SHAPER_MZV:
+        k = exp(-0.75 * damping_ratio * SHAPER_PI / df);
+        a[0] = 1.0 - 1.0 / sqrt(2.0);
+        a[1] = (sqrt(2.0) - 1.0) * k;
+        a[2] = a[0] * k * k;
+        t[0] = 0.0;
+        t[1] = 0.375 * t_d;
+        t[2] = 0.75 * t_d;
+        return 3;
+    case INPUT_SHAPER_EI:
+        k = exp(-damping_ratio * SHAPER_PI / df);
+        a[0] = 0.25 * (1.0 + SHAPER_EI_V_TOL);
+        a[1] = 0.5 * (1.0 - SHAPER_EI_V_TOL) * k;
+        a[2] = a[0] * k * k;
+        t[0] = 0.0;
+        t[1] = 0.5 * t_d;
+        t[2] = t_d;
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+/* ========== Public Functions ========== */
+
+struct stepper_kinematics *
+input_shaper_alloc(void)
+{
+    for (int i = 0; i < INPUT_SHAPER_MAX_STEPPERS; i++) {
+        if (!shaper_pool_used[i]) {
+            shaper_pool_used[i] = 1;
+            struct input_shaper *is = &shaper_pool[i];
+            memset(is, 0, sizeof(*is));
+            is->sk.step_dist = 1.0;
+            is->num_pulses = 1;
+            is->pulses[0].a = MOTION_C(1.0);
+            return &is->sk;
+        }
+    }
+    return NULL;  /* Pool exhausted */
+}
+
+void
+input_shaper_free(struct stepper_kinematics *sk)
+{
+    struct input_shaper *is = shaper_from_sk(sk);
+    if (is != NULL) {
+        shaper_pool_used[is - shaper_pool] = 0;
+    }
+}
+
+int
+input_shaper_set_sk(struct stepper_kinematics *sk,
+                    struct stepper_kinematics *orig_sk)
+{
+    struct input_shaper *is = shaper_from_sk(sk);
+    if (is == NULL || orig_sk == NULL || orig_sk->calc_position_cb == NULL) {
+        return -1;
+    }
+
+    is->sk = *orig_sk;
+    is->sk.calc_position_cb = shaper_calc_position;
+    is->sk.solver = ITERSOLVE_SOLVER_ITERATIVE;
+    is->orig_sk = orig_sk;
+    shaper_update_active(is);
+
+    return 0;
+}
+
+int
+input_shaper_set_shaper(struct stepper_kinematics *sk, int type,
+                        double freq, double damping_ratio)
+{
+    struct input_shaper *is = shaper_from_sk(sk);
+    if (is == NULL) {
+        return -1;
+    }
+
+    if (type == INPUT_SHAPER_NONE) {
+        is->num_pulses = 1;
+        is->pulses[0].a = MOTION_C(1.0);
+        is->pulses[0].t = MOTION_C(0.0);
+        shaper_update_active(is);
+        return 0;
+    }
+
+    if (freq <= 0.0 || damping_ratio < 0.0 || damping_ratio >= 1.0) {
+        return -1;
+    }
+
+    double a[INPUT_SHAPER_MAX_PULSES];
+    double t[INPUT_SHAPER_MAX_PULSES];
+    int n = shaper_get_pulses(type, freq, damping_ratio, a, t);
+    if (n == 0) {
+        return -1;
+    }
+
+    /* Normalize amplitudes and centre times on their weighted mean */
+    double sum_a = 0.0;
+    double ts = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum_a += a[i];
+        ts += a[i] * t[i];
+    }
+    ts /= sum_a;
+
+    is->num_pulses = n;
+    for (int i = 0; i < n; i++) {
+        is->pulses[i].a = (motion_t)(a[i] / sum_a);
+        is->pulses[i].t = (motion_t)(ts - t[i]);
+    }
+    shaper_update_active(is);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file    kin_shaper.h
+ * @brief   Input shaping kinematics wrapper interface
+ *
+ * Adapted from Klipper klippy/chelper/kin_shaper.c for MCU use.
+ * A shaper stepper wraps another stepper's kinematics and convolves its
+ * position with an impulse train (ZV, MZV or EI) to cancel resonances.
+ */
+
+#ifndef CHELPER_KIN_SHAPER_H
+#define CHELPER_KIN_SHAPER_H
+
+#include "itersolve.h"
+#include "trapq.h"
+
+/* ========== Shaper Types ========== */
+
+#define INPUT_SHAPER_NONE   0   /**< No shaping */
+#define INPUT_SHAPER_ZV     1   /**< Zero vibration, 2 impulses */
+#define INPUT_SHAPER_MZV    2   /**< Modified ZV, 3 impulses */
+#define INPUT_SHAPER_EI     3   /**< Extra insensitive, 3 impulses */
+
+/** Maximum impulses of any supported shaper */
+#define INPUT_SHAPER_MAX_PULSES 3
+
+/** Number of shaper steppers in the static pool (X and Y) */
+#define INPUT_SHAPER_MAX_STEPPERS 2
+
+/* ========== Function Prototypes ========== */
+
+/**
+ * @brief Allocate a shaper stepper from the static pool
+ * @return Stepper kinematics, or NULL if pool exhausted
+ */
+struct stepper_kinematics *input_shaper_alloc(void);
+
+/**
+ * @brief Return a shaper stepper to the pool
+ * @param sk Stepper kinematics from input_shaper_alloc()
+ */
+void input_shaper_free(struct stepper_kinematics *sk);
+
+/**
+ * @brief Wrap an existing stepper's kinematics
+ * @param sk      Shaper stepper from input_shaper_alloc()
+ * @param orig_sk Stepper providing the unshaped position callback
+ * @return 0 on success, -1 if sk is not a shaper stepper
+ *
+ * Copies the configuration and step state of orig_sk, so sk can replace
+ * it in the step generation loop. The iterative solver is selected
+ * because the shaped position is not linear within a move.
+ */
+int input_shaper_set_sk(struct stepper_kinematics *sk,
+                        struct stepper_kinematics *orig_sk);
+
+/**
+ * @brief Configure the impulse train
+ * @param sk            Shaper stepper
+ * @param type          INPUT_SHAPER_* type
+ * @param freq          Resonance frequency (Hz)
+ * @param damping_ratio Resonance damping ratio (typically 0.1)
+ * @return 0 on success, -1 on invalid parameters
+ *
+ * Impulse times are centred on their weighted mean so the shaped axis
+ * stays in sync with unshaped axes, and gen_steps_pre_active /
+ * gen_steps_post_active are set to the resulting look-ahead and
+ * look-back. INPUT_SHAPER_NONE leaves a single unit impulse.
+ */
+int input_shaper_set_shaper(struct stepper_kinematics *sk, int type,
+                            double freq, double damping_ratio);
+
+#endif /* CHELPER_KIN_SHAPER_H */
@@ -11,29 +11,43 @@
  * - Medium pool: 16 blocks x 256 bytes = 4KB
  * - Large pool:  8 blocks x 512 bytes  = 4KB
  * - Total: ~9KB
+ *
+ * Free blocks of each size class are chained through their first word,
+ * so alloc pops and free pushes in O(1).
  */
 
 #include "mem_pool.h"
+#include "pool_irq.h"
 #include <string.h>
 
 /* ========== Static Memory Pools ========== */
 
+/**
+ * @brief Free block header, stored in the first word of each free block
+ */
+struct free_block {
+    struct free_block *next;
+};
+
 /**
  * @brief Small block pool (64 bytes each)
  */
-static uint8_t s_small_pool[MEM_POOL_SMALL_COUNT][MEM_POOL_BLOCK_SMALL];
+static uint8_t s_small_pool[MEM_POOL_SMALL_COUNT][MEM_POOL_BLOCK_SMALL]
+    __attribute__((aligned(8)));
 static uint8_t s_small_used[MEM_POOL_SMALL_COUNT];
 
 /**
  * @brief Medium block pool (256 bytes each)
  */
-static uint8_t s_medium_pool[MEM_POOL_MEDIUM_COUNT][MEM_POOL_BLOCK_MEDIUM];
+static uint8_t s_medium_pool[MEM_POOL_MEDIUM_COUNT][MEM_POOL_BLOCK_MEDIUM]
+    __attribute__((aligned(8)));
 static uint8_t s_medium_used[MEM_POOL_MEDIUM_COUNT];
 
 /**
  * @brief Large block pool (512 bytes each)
  */
-static uint8_t s_large_pool[MEM_POOL_LARGE_COUNT][MEM_POOL_BLOCK_LARGE];
+static uint8_t s_large_pool[MEM_POOL_LARGE_COUNT][MEM_POOL_BLOCK_LARGE]
+    __attribute__((aligned(8)));
 static uint8_t s_large_used[MEM_POOL_LARGE_COUNT];
 
 /**
@@ -41,54 +55,60 @@ static uint8_t s_large_used[MEM_POOL_LARGE_COUNT];
  */
 static mem_pool_stats_t s_stats;
 
-/* ========== Internal Helper Functions ========== */
-
 /**
- * @brief Disable interrupts and return previous state
- * @return Previous interrupt state
+ * @brief Per size class bookkeeping
+ *
+ * Each class keeps an intrusive free list so alloc and free are O(1).
+ * The used[] flags are only consulted to reject double frees.
  */
-static inline uint32_t
-irq_disable(void)
-{
-#if defined(MCU_BUILD) && (defined(__arm__) || defined(__thumb__))
-    uint32_t primask;
-    __asm volatile ("mrs %0, primask" : "=r" (primask));
-    __asm volatile ("cpsid i" ::: "memory");
-    return primask;
-#else
-    return 0;
-#endif
-}
+struct pool_class {
+    uint8_t *base;              /**< First block */
+    size_t block_size;          /**< Block size in bytes */
+    uint32_t count;             /**< Number of blocks */
+    uint8_t *used;              /**< Per block in-use flags */
+    uint32_t *stat_used;        /**< Matching s_stats *_used counter */
+    uint32_t *stat_peak;        /**< Matching s_stats *_peak counter */
+    struct free_block *free_list;
+};
 
-/**
- * @brief Restore interrupt state
- * @param state Previous interrupt state from irq_disable()
- */
-static inline void
-irq_restore(uint32_t state)
-{
-#if defined(MCU_BUILD) && (defined(__arm__) || defined(__thumb__))
-    __asm volatile ("msr primask, %0" :: "r" (state) : "memory");
-#else
-    (void)state;
-#endif
-}
+#define POOL_CLASS_COUNT        3
+
+static struct pool_class s_classes[POOL_CLASS_COUNT] = {
+    { &s_small_pool[0][0], MEM_POOL_BLOCK_SMALL, MEM_POOL_SMALL_COUNT,
+      s_small_used, &s_stats.small_used, &s_stats.small_peak, NULL },
+    { &s_medium_pool[0][0], MEM_POOL_BLOCK_MEDIUM, MEM_POOL_MEDIUM_COUNT,
+      s_medium_used, &s_stats.medium_used, &s_stats.medium_peak, NULL },
+    { &s_large_pool[0][0], MEM_POOL_BLOCK_LARGE, MEM_POOL_LARGE_COUNT,
+      s_large_used, &s_stats.large_used, &s_stats.large_peak, NULL },
+};
+
+/* ========== Internal Helper Functions ========== */
 
 /**
- * @brief Update peak usage statistics
+ * @brief Find the size class and block index of a pointer
+ * @param ptr   Pointer to look up
+ * @param index Output block index within the class
+ * @return Size class, or NULL if ptr is not the start of a pool block
  */
-static void
-update_peak_stats(void)
+static struct pool_class *
+pool_lookup(const void *ptr, uint32_t *index)
 {
-    if (s_stats.small_used > s_stats.small_peak) {
-        s_stats.small_peak = s_stats.small_used;
-    }
-    if (s_stats.medium_used > s_stats.medium_peak) {
-        s_stats.medium_peak = s_stats.medium_used;
-    }
-    if (s_stats.large_used > s_stats.large_peak) {
-        s_stats.large_peak = s_stats.large_used;
+    const uint8_t *p = (const uint8_t *)ptr;
+    
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        struct pool_class *pc = &s_classes[i];
+        const uint8_t *end = pc->base + pc->block_size * pc->count;
+        if (p < pc->base || p >= end) {
+            continue;
+        }
+        size_t offset = (size_t)(p - pc->base);
+        if (offset % pc->block_size != 0) {
+            return NULL;
+        }
+        *index = (uint32_t)(offset / pc->block_size);
+        return pc;
     }
+    return NULL;
 }
 
 /* ========== Public Functions ========== */
@@ -96,63 +116,48 @@ update_peak_stats(void)
 void
 mem_pool_init(void)
 {
-    /* Clear all usage flags */
-    memset(s_small_used, 0, sizeof(s_small_used));
-    memset(s_medium_used, 0, sizeof(s_medium_used));
-    memset(s_large_used, 0, sizeof(s_large_used));
-    
     /* Clear statistics */
     memset(&s_stats, 0, sizeof(s_stats));
+    
+    /* Rebuild free lists so the lowest block is handed out first */
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        struct pool_class *pc = &s_classes[i];
+        memset(pc->used, 0, pc->count);
+        pc->free_list = NULL;
+        for (uint32_t j = pc->count; j > 0; j--) {
+            struct free_block *fb =
+                (struct free_block *)(pc->base + (j - 1) * pc->block_size);
+            fb->next = pc->free_list;
+            pc->free_list = fb;
+        }
+    }
 }
 
 void *
 mem_pool_alloc(size_t size)
 {
-    void *ptr = NULL;
-    
     if (size == 0) {
         return NULL;
     }
     
     s_stats.total_allocs++;
     
-    /* Try small pool first */
-    if (size <= MEM_POOL_BLOCK_SMALL) {
-        for (int i = 0; i < MEM_POOL_SMALL_COUNT; i++) {
-            if (!s_small_used[i]) {
-                s_small_used[i] = 1;
-                s_stats.small_used++;
-                update_peak_stats();
-                ptr = s_small_pool[i];
-                return ptr;
-            }
-        }
-    }
-    
-    /* Try medium pool */
-    if (size <= MEM_POOL_BLOCK_MEDIUM) {
-        for (int i = 0; i < MEM_POOL_MEDIUM_COUNT; i++) {
-            if (!s_medium_used[i]) {
-                s_medium_used[i] = 1;
-                s_stats.medium_used++;
-                update_peak_stats();
-                ptr = s_medium_pool[i];
-                return ptr;
-            }
+    /* Smallest class that fits and still has a free block */
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        struct pool_class *pc = &s_classes[i];
+        if (size > pc->block_size || pc->free_list == NULL) {
+            continue;
         }
-    }
-    
-    /* Try large pool */
-    if (size <= MEM_POOL_BLOCK_LARGE) {
-        for (int i = 0; i < MEM_POOL_LARGE_COUNT; i++) {
-            if (!s_large_used[i]) {
-                s_large_used[i] = 1;
-                s_stats.large_used++;
-                update_peak_stats();
-                ptr = s_large_pool[i];
-                return ptr;
-            }
+        
+        struct free_block *fb = pc->free_list;
+        pc->free_list = fb->next;
+        pc->used[((uint8_t *)fb - pc->base) / pc->block_size] = 1;
+        
+        (*pc->stat_used)++;
+        if (*pc->stat_used > *pc->stat_peak) {
+            *pc->stat_peak = *pc->stat_used;
         }
+        return fb;
     }
     
     /* Allocation failed */
@@ -163,63 +168,43 @@ mem_pool_alloc(size_t size)
 void
 mem_pool_free(void *ptr)
 {
+    uint32_t index;
+    
     if (ptr == NULL) {
         return;
     }
     
     s_stats.total_frees++;
     
-    /* Check if pointer is in small pool */
-    for (int i = 0; i < MEM_POOL_SMALL_COUNT; i++) {
-        if (ptr == s_small_pool[i]) {
-            s_small_used[i] = 0;
-            if (s_stats.small_used > 0) {
-                s_stats.small_used--;
-            }
-            return;
-        }
-    }
-    
-    /* Check if pointer is in medium pool */
-    for (int i = 0; i < MEM_POOL_MEDIUM_COUNT; i++) {
-        if (ptr == s_medium_pool[i]) {
-            s_medium_used[i] = 0;
-            if (s_stats.medium_used > 0) {
-                s_stats.medium_used--;
-            }
-            return;
-        }
-    }
-    
-    /* Check if pointer is in large pool */
-    for (int i = 0; i < MEM_POOL_LARGE_COUNT; i++) {
-        if (ptr == s_large_pool[i]) {
-            s_large_used[i] = 0;
-            if (s_stats.large_used > 0) {
-                s_stats.large_used--;
-            }
-            return;
-        }
+    /* Foreign pointers and double frees would corrupt the free list */
+    struct pool_class *pc = pool_lookup(ptr, &index);
+    if (pc == NULL || !pc->used[index]) {
+        s_stats.invalid_frees++;
+        return;
     }
     
-    /* Pointer not from pool - ignore (could log warning in debug) */
+    pc->used[index] = 0;
+    struct free_block *fb = (struct free_block *)ptr;
+    fb->next = pc->free_list;
+    pc->free_list = fb;
+    (*pc->stat_used)--;
 }
 
 void *
 mem_pool_alloc_safe(size_t size)
 {
-    uint32_t state = irq_disable();
+    uint32_t state = pool_irq_save();
     void *ptr = mem_pool_alloc(size);
-    irq_restore(state);
+    pool_irq_restore(state);
     return ptr;
 }
 
 void
 mem_pool_free_safe(void *ptr)
 {
-    uint32_t state = irq_disable();
+    uint32_t state = pool_irq_save();
     mem_pool_free(ptr);
-    irq_restore(state);
+    pool_irq_restore(state);
 }
 
 void
@@ -256,26 +241,13 @@ mem_pool_is_from_pool(const void *ptr)
         return 0;
     }
     
-    /* Check small pool range */
+    /* Any address inside a pool region counts */
     const uint8_t *p = (const uint8_t *)ptr;
-    const uint8_t *small_start = &s_small_pool[0][0];
-    const uint8_t *small_end = &s_small_pool[MEM_POOL_SMALL_COUNT - 1][MEM_POOL_BLOCK_SMALL - 1];
-    if (p >= small_start && p <= small_end) {
-        return 1;
-    }
-    
-    /* Check medium pool range */
-    const uint8_t *medium_start = &s_medium_pool[0][0];
-    const uint8_t *medium_end = &s_medium_pool[MEM_POOL_MEDIUM_COUNT - 1][MEM_POOL_BLOCK_MEDIUM - 1];
-    if (p >= medium_start && p <= medium_end) {
-        return 1;
-    }
-    
-    /* Check large pool range */
-    const uint8_t *large_start = &s_large_pool[0][0];
-    const uint8_t *large_end = &s_large_pool[MEM_POOL_LARGE_COUNT - 1][MEM_POOL_BLOCK_LARGE - 1];
-    if (p >= large_start && p <= large_end) {
-        return 1;
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        const struct pool_class *pc = &s_classes[i];
+        if (p >= pc->base && p < pc->base + pc->block_size * pc->count) {
+            return 1;
+        }
     }
     
     return 0;
@@ -284,32 +256,14 @@ mem_pool_is_from_pool(const void *ptr)
 size_t
 mem_pool_block_size(const void *ptr)
 {
+    uint32_t index;
+    
     if (ptr == NULL) {
         return 0;
     }
     
-    /* Check small pool */
-    for (int i = 0; i < MEM_POOL_SMALL_COUNT; i++) {
-        if (ptr == s_small_pool[i]) {
-            return MEM_POOL_BLOCK_SMALL;
-        }
-    }
-    
-    /* Check medium pool */
-    for (int i = 0; i < MEM_POOL_MEDIUM_COUNT; i++) {
-        if (ptr == s_medium_pool[i]) {
-            return MEM_POOL_BLOCK_MEDIUM;
-        }
-    }
-    
-    /* Check large pool */
-    for (int i = 0; i < MEM_POOL_LARGE_COUNT; i++) {
-        if (ptr == s_large_pool[i]) {
-            return MEM_POOL_BLOCK_LARGE;
-        }
-    }
-    
-    return 0;
+    struct pool_class *pc = pool_lookup(ptr, &index);
+    return (pc != NULL) ? pc->block_size : 0;
 }
 
 uint32_t
@@ -321,30 +275,11 @@ mem_pool_available(size_t size)
         return 0;
     }
     
-    /* Count available small blocks */
-    if (size <= MEM_POOL_BLOCK_SMALL) {
-        for (int i = 0; i < MEM_POOL_SMALL_COUNT; i++) {
-            if (!s_small_used[i]) {
-                count++;
-            }
-        }
-    }
-    
-    /* Count available medium blocks */
-    if (size <= MEM_POOL_BLOCK_MEDIUM) {
-        for (int i = 0; i < MEM_POOL_MEDIUM_COUNT; i++) {
-            if (!s_medium_used[i]) {
-                count++;
-            }
-        }
-    }
-    
-    /* Count available large blocks */
-    if (size <= MEM_POOL_BLOCK_LARGE) {
-        for (int i = 0; i < MEM_POOL_LARGE_COUNT; i++) {
-            if (!s_large_used[i]) {
-                count++;
-            }
+    /* Free blocks in every class large enough */
+    for (int i = 0; i < POOL_CLASS_COUNT; i++) {
+        const struct pool_class *pc = &s_classes[i];
+        if (size <= pc->block_size) {
+            count += pc->count - *pc->stat_used;
         }
     }
     
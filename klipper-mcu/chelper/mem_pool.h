@@ -9,7 +9,8 @@
  * Key features:
  * - No dynamic memory allocation (no malloc/free)
  * - Fixed-size block pools for predictable memory usage
- * - Thread-safe with interrupt disable (optional)
+ * - O(1) alloc/free via per size class free lists
+ * - Optional step timer masking (*_safe variants)
  * - Pool statistics for debugging
  * 
  * Usage:
@@ -23,6 +24,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "config.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,13 +44,13 @@ extern "C" {
 
 /**
  * @brief Number of blocks in each pool
+ * 
+ * MEM_POOL_SMALL_COUNT, MEM_POOL_MEDIUM_COUNT and MEM_POOL_LARGE_COUNT
+ * come from the memory budget in config.h.
  */
-#define MEM_POOL_SMALL_COUNT    16      /**< 16 x 64 = 1KB */
-#define MEM_POOL_MEDIUM_COUNT   16      /**< 16 x 256 = 4KB */
-#define MEM_POOL_LARGE_COUNT    8       /**< 8 x 512 = 4KB */
 
 /**
- * @brief Total memory pool size (approximately 9KB)
+ * @brief Total memory pool size
  */
 #define MEM_POOL_TOTAL_SIZE     (MEM_POOL_BLOCK_SMALL * MEM_POOL_SMALL_COUNT + \
                                  MEM_POOL_BLOCK_MEDIUM * MEM_POOL_MEDIUM_COUNT + \
@@ -63,6 +65,7 @@ typedef struct {
     uint32_t total_allocs;      /**< Total allocation requests */
     uint32_t total_frees;       /**< Total free requests */
     uint32_t failed_allocs;     /**< Failed allocation attempts */
+    uint32_t invalid_frees;     /**< Frees of foreign or already-free blocks */
     uint32_t small_used;        /**< Small blocks currently in use */
     uint32_t medium_used;       /**< Medium blocks currently in use */
     uint32_t large_used;        /**< Large blocks currently in use */
@@ -115,7 +118,8 @@ void mem_pool_free(void *ptr);
  * @param size  Requested allocation size in bytes
  * @return Pointer to allocated memory, or NULL if pool exhausted
  * 
- * Same as mem_pool_alloc() but disables interrupts during allocation.
+ * Same as mem_pool_alloc() but masks the step timer level
+ * (IRQ_PRIO_STEP) during allocation.
  */
 void *mem_pool_alloc_safe(size_t size);
 
@@ -124,7 +128,8 @@ void *mem_pool_alloc_safe(size_t size);
  * 
  * @param ptr   Pointer to memory previously allocated
  * 
- * Same as mem_pool_free() but disables interrupts during deallocation.
+ * Same as mem_pool_free() but masks the step timer level
+ * (IRQ_PRIO_STEP) during deallocation.
  */
 void mem_pool_free_safe(void *ptr);
 
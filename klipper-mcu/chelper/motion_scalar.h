@@ -0,0 +1,45 @@
+/**
+ * @file    motion_scalar.h
+ * @brief   Scalar type used by the motion hot path
+ * 
+ * Positions, velocities and move-relative times in trapq, itersolve,
+ * kin_cartesian and the toolhead lookahead use motion_t. With
+ * CONFIG_MOTION_FLOAT set it is float, which the Cortex-M4F FPU
+ * (-mfpu=fpv4-sp-d16) executes in hardware; otherwise it is double and
+ * every operation goes through libgcc soft-float.
+ * 
+ * Absolute print times (struct move print_time, step times, flush times)
+ * stay double in both modes: a float print time would lose 1us
+ * resolution after about 16 seconds of printing.
+ */
+
+#ifndef CHELPER_MOTION_SCALAR_H
+#define CHELPER_MOTION_SCALAR_H
+
+#include <math.h>
+#include "autoconf.h"
+
+#if CONFIG_MOTION_FLOAT
+
+typedef float motion_t;
+
+/** Literal of motion_t type (avoids promotion to double) */
+#define MOTION_C(x)         (x##f)
+#define motion_sqrt(x)      sqrtf(x)
+#define motion_fabs(x)      fabsf(x)
+#define motion_floor(x)     floorf(x)
+#define motion_ceil(x)      ceilf(x)
+
+#else
+
+typedef double motion_t;
+
+#define MOTION_C(x)         (x)
+#define motion_sqrt(x)      sqrt(x)
+#define motion_fabs(x)      fabs(x)
+#define motion_floor(x)     floor(x)
+#define motion_ceil(x)      ceil(x)
+
+#endif /* CONFIG_MOTION_FLOAT */
+
+#endif /* CHELPER_MOTION_SCALAR_H */
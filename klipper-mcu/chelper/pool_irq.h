@@ -0,0 +1,52 @@
+/**
+ * @file    pool_irq.h
+ * @brief   Interrupt masking for mem_pool_alloc_safe()/mem_pool_free_safe()
+ *
+ * The firmware only allocates from the pools in the main loop
+ * (toolhead.c), where no lock is needed. The *_safe variants are for
+ * code that shares a pool with the step timer: on MCU builds they mask
+ * IRQ_PRIO_STEP and below through BASEPRI (board/irq.h), so interrupts
+ * at more urgent levels keep running. On host builds they are no-ops.
+ *
+ * Named pool_irq_* so they do not clash with board/irq.h when both
+ * headers end up in the same translation unit.
+ */
+
+#ifndef CHELPER_POOL_IRQ_H
+#define CHELPER_POOL_IRQ_H
+
+#include <stdint.h>
+
+#if defined(MCU_BUILD) && (defined(__arm__) || defined(__thumb__))
+#include "board/irq.h"
+#endif
+
+/**
+ * @brief Mask the step timer level and return the previous mask
+ * @return Previous BASEPRI
+ */
+static inline uint32_t
+pool_irq_save(void)
+{
+#if defined(MCU_BUILD) && (defined(__arm__) || defined(__thumb__))
+    return irq_mask_level(IRQ_PRIO_STEP);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Restore the interrupt mask
+ * @param state Previous mask from pool_irq_save()
+ */
+static inline void
+pool_irq_restore(uint32_t state)
+{
+#if defined(MCU_BUILD) && (defined(__arm__) || defined(__thumb__))
+    irq_unmask_level(state);
+#else
+    (void)state;
+#endif
+}
+
+#endif /* CHELPER_POOL_IRQ_H */
@@ -0,0 +1,151 @@
+/**
+ * @file    spsc_ring.h
+ * @brief   Lock-free single-producer / single-consumer ring indices
+ *
+ * Shared by queues that have exactly one writer and one reader, such as
+ * an ISR feeding the main loop or the main loop feeding a timer. The
+ * producer only advances head and the consumer only advances tail, so
+ * neither side has to mask interrupts to move data.
+ *
+ * Both indices are free-running 32-bit counters: the fill level is
+ * head - tail even across wrap-around, and the slot of an index is
+ * index & (size - 1). Ring sizes must therefore be powers of two.
+ *
+ * The ring only tracks indices; the element array lives next to it in
+ * the owning structure. Typical use:
+ *
+ *     Producer                        Consumer
+ *     if (spsc_ring_free(r, N))       if (spsc_ring_avail(r))
+ *       buf[spsc_ring_head(r, N)] = x;  x = buf[spsc_ring_tail(r, N)];
+ *       spsc_ring_push(r, 1);           spsc_ring_pop(r, 1);
+ *
+ * spsc_ring_avail()/spsc_ring_free() order the index read before the
+ * element access that follows it, and spsc_ring_push()/spsc_ring_pop()
+ * order the element access before the index update. On Cortex-M this is
+ * a DMB, which also covers DMA engines reading or writing the elements.
+ */
+
+#ifndef CHELPER_SPSC_RING_H
+#define CHELPER_SPSC_RING_H
+
+#include <stdint.h>
+
+/** Memory barrier between element accesses and index updates */
+#if defined(MCU_BUILD) && (defined(__arm__) || defined(__thumb__))
+#define SPSC_RING_BARRIER()     __asm volatile ("dmb" ::: "memory")
+#else
+#define SPSC_RING_BARRIER()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/** Non-zero when size is usable as a ring size */
+#define SPSC_RING_SIZE_OK(size) \
+    ((size) > 0 && ((size) & ((size) - 1)) == 0)
+
+/**
+ * @brief Ring indices
+ */
+typedef struct {
+    volatile uint32_t head;     /**< Elements written (producer only) */
+    volatile uint32_t tail;     /**< Elements read (consumer only) */
+} spsc_ring_t;
+
+/**
+ * @brief Empty the ring
+ * @param r Ring
+ * @note  Touches both indices: call before either side runs, or with
+ *        the other side locked out
+ */
+static inline void
+spsc_ring_init(spsc_ring_t *r)
+{
+    r->head = 0;
+    r->tail = 0;
+}
+
+/**
+ * @brief Number of elements ready to read (consumer side)
+ * @param r Ring
+ * @return Elements between tail and head
+ */
+static inline uint32_t
+spsc_ring_avail(const spsc_ring_t *r)
+{
+    uint32_t head = r->head;
+    SPSC_RING_BARRIER();
+    return head - r->tail;
+}
+
+/**
+ * @brief Number of free slots (producer side)
+ * @param r    Ring
+ * @param size Ring size (power of two)
+ * @return Slots that can be written before the ring is full
+ */
+static inline uint32_t
+spsc_ring_free(const spsc_ring_t *r, uint32_t size)
+{
+    uint32_t tail = r->tail;
+    SPSC_RING_BARRIER();
+    return size - (r->head - tail);
+}
+
+/**
+ * @brief Number of queued elements, for statistics from either side
+ * @param r Ring
+ * @return Snapshot of head - tail
+ */
+static inline uint32_t
+spsc_ring_count(const spsc_ring_t *r)
+{
+    return r->head - r->tail;
+}
+
+/**
+ * @brief Slot the producer writes next
+ * @param r    Ring
+ * @param size Ring size (power of two)
+ * @return Element index
+ */
+static inline uint32_t
+spsc_ring_head(const spsc_ring_t *r, uint32_t size)
+{
+    return r->head & (size - 1);
+}
+
+/**
+ * @brief Slot the consumer reads next
+ * @param r    Ring
+ * @param size Ring size (power of two)
+ * @return Element index
+ */
+static inline uint32_t
+spsc_ring_tail(const spsc_ring_t *r, uint32_t size)
+{
+    return r->tail & (size - 1);
+}
+
+/**
+ * @brief Publish written elements to the consumer
+ * @param r Ring
+ * @param n Elements written starting at spsc_ring_head()
+ */
+static inline void
+spsc_ring_push(spsc_ring_t *r, uint32_t n)
+{
+    SPSC_RING_BARRIER();
+    r->head = r->head + n;
+}
+
+/**
+ * @brief Return read elements' slots to the producer
+ * @param r Ring
+ * @param n Elements read starting at spsc_ring_tail()
+ */
+static inline void
+spsc_ring_pop(spsc_ring_t *r, uint32_t n)
+{
+    SPSC_RING_BARRIER();
+    r->tail = r->tail + n;
+}
+
+#endif /* CHELPER_SPSC_RING_H */
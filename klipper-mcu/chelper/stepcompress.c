@@ -0,0 +1,121 @@
+/**
+ * @file    stepcompress.c
+ * @brief   Step time compression implementation
+ * 
+ * Adapted from Klipper klippy/chelper/stepcompress.c for MCU use.
+ * 
+ * Key adaptations:
+ * - Interval pinned to the first step; the add range is narrowed one
+ *   step at a time, like Klipper's compress_bisect_add() minmax bounds
+ * - Bounded window instead of Klipper's bisection over the whole queue
+ * - 32-bit wrapping clocks, no malloc
+ * - C99 compatible
+ */
+
+#include "stepcompress.h"
+#include <stdint.h>
+
+/**
+ * Offset of step k (1-based) from the segment's base clock
+ */
+static int64_t
+segment_offset(int64_t interval, int64_t add, int64_t k)
+{
+    return k * interval + add * (k * (k - 1) / 2);
+}
+
+/**
+ * Floor and ceiling of n / d for d > 0
+ */
+static int64_t
+div_floor(int64_t n, int64_t d)
+{
+    int64_t q = n / d;
+    return ((n % d != 0) && (n < 0)) ? q - 1 : q;
+}
+
+static int64_t
+div_ceil(int64_t n, int64_t d)
+{
+    return -div_floor(-n, d);
+}
+
+int
+stepcompress_fit(const uint32_t *clocks, int num_clocks, uint32_t last_clock,
+                 uint32_t max_error, struct step_segment *seg)
+{
+    if (num_clocks <= 0) {
+        return 0;
+    }
+    if (num_clocks > STEPCOMPRESS_WINDOW) {
+        num_clocks = STEPCOMPRESS_WINDOW;
+    }
+    
+    /* The first step is hit exactly, which pins the interval */
+    int32_t first = (int32_t)(clocks[0] - last_clock);
+    if (first < 0) {
+        first = 0;
+    }
+    seg->interval = (uint32_t)first;
+    seg->count = 1;
+    seg->add = 0;
+    
+    /*
+     * Feasible add range over the steps accepted so far. Each new step
+     * k narrows it to the adds that keep step k within max_error and
+     * interval k non-negative; the segment ends at the first empty range.
+     */
+    int64_t min_add = INT32_MIN;
+    int64_t max_add = INT32_MAX;
+    int64_t last_num = 0;
+    int64_t last_tri = 1;
+    
+    for (int count = 2; count <= num_clocks; count++) {
+        int64_t want = (int32_t)(clocks[count - 1] - last_clock);
+        int64_t tri = (int64_t)count * (count - 1) / 2;
+        int64_t num = want - (int64_t)count * first;
+        int64_t lo = div_ceil(num - (int64_t)max_error, tri);
+        int64_t hi = div_floor(num + (int64_t)max_error, tri);
+        int64_t lo_interval = div_ceil(-(int64_t)first, count - 1);
+        
+        if (lo < lo_interval) {
+            lo = lo_interval;
+        }
+        if (lo < min_add) {
+            lo = min_add;
+        }
+        if (hi > max_add) {
+            hi = max_add;
+        }
+        if (lo > hi) {
+            break;
+        }
+        
+        min_add = lo;
+        max_add = hi;
+        last_num = num;
+        last_tri = tri;
+        seg->count = (uint32_t)count;
+    }
+    
+    if (seg->count > 1) {
+        /* Within the range, prefer the add that lands the last step exactly */
+        int64_t add = div_floor(2 * last_num + last_tri, 2 * last_tri);
+        if (add < min_add) {
+            add = min_add;
+        }
+        if (add > max_add) {
+            add = max_add;
+        }
+        seg->add = (int32_t)add;
+    }
+    
+    return (int)seg->count;
+}
+
+uint32_t
+stepcompress_end_clock(uint32_t last_clock, const struct step_segment *seg)
+{
+    return last_clock + (uint32_t)segment_offset(seg->interval, seg->add,
+                                                 seg->count);
+}
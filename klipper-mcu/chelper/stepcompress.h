@@ -0,0 +1,67 @@
+/**
+ * @file    stepcompress.h
+ * @brief   Step time compression into (interval, count, add) segments
+ * 
+ * Adapted from Klipper klippy/chelper/stepcompress.c for MCU use.
+ * A run of step clocks is encoded as a segment where the first step
+ * happens `interval` ticks after the previous step and each following
+ * interval grows by `add` ticks. An acceleration ramp of hundreds of
+ * steps then fits in a handful of segments instead of one entry per step.
+ * 
+ * Key adaptations:
+ * - Interval pinned to the first step; the add range is narrowed one
+ *   step at a time, like Klipper's compress_bisect_add() minmax bounds
+ * - Bounded window instead of Klipper's bisection over the whole queue
+ * - 32-bit wrapping clocks, no malloc
+ * - C99 compatible
+ */
+
+#ifndef CHELPER_STEPCOMPRESS_H
+#define CHELPER_STEPCOMPRESS_H
+
+#include <stdint.h>
+
+/**
+ * Maximum number of step clocks considered for a single segment
+ */
+#define STEPCOMPRESS_WINDOW     64
+
+/**
+ * @brief Compressed step segment
+ * 
+ * Step k (1..count) is scheduled at:
+ *   last_clock + k * interval + add * k * (k - 1) / 2
+ */
+struct step_segment {
+    uint32_t interval;          /**< Ticks from previous step to first step */
+    uint32_t count;             /**< Number of steps in segment */
+    int32_t add;                /**< Interval change after each step */
+};
+
+/**
+ * @brief Fit the longest segment matching the leading step clocks
+ * @param clocks     Absolute step clocks (same direction, ascending)
+ * @param num_clocks Number of entries in clocks
+ * @param last_clock Clock of the step preceding clocks[0]
+ * @param max_error  Maximum allowed deviation per step (ticks)
+ * @param seg        Output segment
+ * @return Number of steps covered by seg (0 if num_clocks <= 0)
+ * 
+ * The first step is always reproduced exactly; later steps are kept
+ * within max_error of their requested clock. Each step is checked once
+ * against the feasible add range, so the cost is linear in the window.
+ */
+int stepcompress_fit(const uint32_t *clocks, int num_clocks,
+                     uint32_t last_clock, uint32_t max_error,
+                     struct step_segment *seg);
+
+/**
+ * @brief Clock of the last step of a segment
+ * @param last_clock Clock of the step preceding the segment
+ * @param seg        Segment
+ * @return Clock of the segment's final step
+ */
+uint32_t stepcompress_end_clock(uint32_t last_clock,
+                                const struct step_segment *seg);
+
+#endif /* CHELPER_STEPCOMPRESS_H */
@@ -5,22 +5,31 @@
  * Adapted from Klipper klippy/chelper/trapq.c for MCU use.
  * 
  * Key adaptations:
- * - Static memory pools instead of malloc/free
+ * - Static memory pools instead of malloc/free (O(1) move free list);
+ *   only the main loop (toolhead.c) allocates and frees moves, so the
+ *   pool takes no interrupt lock
  * - Removed Python FFI markers (__visible)
  * - C99 compatible
  */
 
 #include "trapq.h"
+#include "src/trace.h"
 #include <stdint.h>
 #include <string.h>
+#include <math.h>
 
 /* ========== Static Memory Pools ========== */
 
 /**
  * Move pool - pre-allocated array of moves
+ *
+ * Free moves are chained through their list node so alloc and free are
+ * O(1). The used flags only guard against double frees.
  */
 static struct move move_pool[TRAPQ_MAX_MOVES];
 static uint8_t move_pool_used[TRAPQ_MAX_MOVES];
+static struct list_node *move_free_list;
+static trapq_pool_stats_t move_pool_stats;
 
 /**
  * Trapq pool - typically only need 1-2 trapqs
@@ -36,6 +45,14 @@ trapq_pool_init(void)
 {
     memset(move_pool_used, 0, sizeof(move_pool_used));
     memset(trapq_pool_used, 0, sizeof(trapq_pool_used));
+    memset(&move_pool_stats, 0, sizeof(move_pool_stats));
+    
+    /* Chain in reverse so the first alloc returns move_pool[0] */
+    move_free_list = NULL;
+    for (int i = TRAPQ_MAX_MOVES - 1; i >= 0; i--) {
+        move_pool[i].node.next = move_free_list;
+        move_free_list = &move_pool[i].node;
+    }
 }
 
 struct trapq *
@@ -47,6 +64,7 @@ trapq_alloc(void)
             struct trapq *tq = &trapq_pool[i];
             list_init(&tq->moves);
             list_init(&tq->history);
+            tq->last_hit = NULL;
             return tq;
         }
     }
@@ -70,6 +88,7 @@ trapq_free(struct trapq *tq)
         list_del(&m->node);
         move_free(m);
     }
+    tq->last_hit = NULL;
     
     /* Return trapq to pool */
     int idx = tq - trapq_pool;
@@ -81,15 +100,24 @@ trapq_free(struct trapq *tq)
 struct move *
 move_alloc(void)
 {
-    for (int i = 0; i < TRAPQ_MAX_MOVES; i++) {
-        if (!move_pool_used[i]) {
-            move_pool_used[i] = 1;
-            struct move *m = &move_pool[i];
-            memset(m, 0, sizeof(*m));
-            return m;
-        }
+    struct list_node *node = move_free_list;
+    if (node == NULL) {
+        move_pool_stats.failed_allocs++;
+        return NULL;  /* Pool exhausted */
     }
-    return NULL;  /* Pool exhausted */
+    move_free_list = node->next;
+    
+    struct move *m = container_of(node, struct move, node);
+    move_pool_used[m - move_pool] = 1;
+    
+    move_pool_stats.total_allocs++;
+    move_pool_stats.moves_used++;
+    if (move_pool_stats.moves_used > move_pool_stats.moves_peak) {
+        move_pool_stats.moves_peak = move_pool_stats.moves_used;
+    }
+    
+    memset(m, 0, sizeof(*m));
+    return m;
 }
 
 void
@@ -99,21 +127,52 @@ move_free(struct move *m)
         return;
     }
     int idx = m - move_pool;
-    if (idx >= 0 && idx < TRAPQ_MAX_MOVES) {
+    if (idx < 0 || idx >= TRAPQ_MAX_MOVES) {
+        return;
+    }
+    
+    if (move_pool_used[idx]) {
         move_pool_used[idx] = 0;
+        m->node.next = move_free_list;
+        move_free_list = &m->node;
+        move_pool_stats.total_frees++;
+        move_pool_stats.moves_used--;
+    }
+}
+
+uint32_t
+trapq_pool_available(void)
+{
+    return TRAPQ_MAX_MOVES - move_pool_stats.moves_used;
+}
+
+void
+trapq_pool_get_stats(trapq_pool_stats_t *stats)
+{
+    if (stats != NULL) {
+        *stats = move_pool_stats;
     }
 }
 
+void
+trapq_pool_reset_stats(void)
+{
+    uint32_t used = move_pool_stats.moves_used;
+    memset(&move_pool_stats, 0, sizeof(move_pool_stats));
+    move_pool_stats.moves_used = used;
+    move_pool_stats.moves_peak = used;
+}
+
 /* ========== Move Calculation Functions ========== */
 
 /**
  * Calculate distance traveled at time t within a move using trapezoidal profile
  */
-double
-move_get_distance(const struct move *m, double move_time)
+motion_t
+move_get_distance(const struct move *m, motion_t move_time)
 {
-    if (move_time <= 0.0) {
-        return 0.0;
+    if (move_time <= MOTION_C(0.0)) {
+        return MOTION_C(0.0);
     }
     if (move_time >= m->move_t) {
         move_time = m->move_t;
@@ -125,30 +184,30 @@ move_get_distance(const struct move *m, double move_time)
      * For a full trapezoidal profile with accel/cruise/decel phases,
      * we need to handle each phase separately.
      */
-    double accel_t = m->accel_t;
-    double cruise_t = m->cruise_t;
-    double decel_t = m->decel_t;
+    motion_t accel_t = m->accel_t;
+    motion_t cruise_t = m->cruise_t;
+    motion_t decel_t = m->decel_t;
     
-    double dist = 0.0;
-    double t = move_time;
+    motion_t dist = MOTION_C(0.0);
+    motion_t t = move_time;
     
     /* Acceleration phase */
-    if (t > 0.0 && accel_t > 0.0) {
-        double at = (t < accel_t) ? t : accel_t;
+    if (t > MOTION_C(0.0) && accel_t > MOTION_C(0.0)) {
+        motion_t at = (t < accel_t) ? t : accel_t;
         dist += m->start_v * at + m->half_accel * at * at;
         t -= at;
     }
     
     /* Cruise phase */
-    if (t > 0.0 && cruise_t > 0.0) {
-        double ct = (t < cruise_t) ? t : cruise_t;
+    if (t > MOTION_C(0.0) && cruise_t > MOTION_C(0.0)) {
+        motion_t ct = (t < cruise_t) ? t : cruise_t;
         dist += m->cruise_v * ct;
         t -= ct;
     }
     
     /* Deceleration phase */
-    if (t > 0.0 && decel_t > 0.0) {
-        double dt = (t < decel_t) ? t : decel_t;
+    if (t > MOTION_C(0.0) && decel_t > MOTION_C(0.0)) {
+        motion_t dt = (t < decel_t) ? t : decel_t;
         /* Decel starts at cruise_v, decelerates at -half_accel*2 */
         dist += m->cruise_v * dt - m->half_accel * dt * dt;
     }
@@ -156,10 +215,75 @@ move_get_distance(const struct move *m, double move_time)
     return dist;
 }
 
+/**
+ * Solve a*t^2 + v*t = d for the smallest t >= 0
+ * 
+ * Uses the form 2d / (v + sqrt(v^2 + 4ad)) which stays accurate when
+ * a is small and has no division by a.
+ */
+static motion_t
+solve_phase_time(motion_t v, motion_t a, motion_t d)
+{
+    if (d <= MOTION_C(0.0)) {
+        return MOTION_C(0.0);
+    }
+    motion_t disc = v * v + MOTION_C(4.0) * a * d;
+    if (disc < MOTION_C(0.0)) {
+        disc = MOTION_C(0.0);
+    }
+    motion_t denom = v + motion_sqrt(disc);
+    if (denom <= MOTION_C(0.0)) {
+        return MOTION_C(0.0);
+    }
+    return MOTION_C(2.0) * d / denom;
+}
+
+motion_t
+move_get_time(const struct move *m, motion_t move_dist)
+{
+    if (move_dist <= MOTION_C(0.0)) {
+        return MOTION_C(0.0);
+    }
+    
+    motion_t t = MOTION_C(0.0);
+    
+    /* Acceleration phase */
+    if (m->accel_t > MOTION_C(0.0)) {
+        motion_t accel_d = (m->start_v + m->half_accel * m->accel_t) *
+                           m->accel_t;
+        if (move_dist <= accel_d) {
+            return solve_phase_time(m->start_v, m->half_accel, move_dist);
+        }
+        move_dist -= accel_d;
+        t += m->accel_t;
+    }
+    
+    /* Cruise phase */
+    if (m->cruise_t > MOTION_C(0.0)) {
+        motion_t cruise_d = m->cruise_v * m->cruise_t;
+        if (move_dist <= cruise_d) {
+            return t + move_dist / m->cruise_v;
+        }
+        move_dist -= cruise_d;
+        t += m->cruise_t;
+    }
+    
+    /* Deceleration phase */
+    if (m->decel_t > MOTION_C(0.0)) {
+        motion_t dt = solve_phase_time(m->cruise_v, -m->half_accel, move_dist);
+        if (dt > m->decel_t) {
+            dt = m->decel_t;
+        }
+        t += dt;
+    }
+    
+    return (t < m->move_t) ? t : m->move_t;
+}
+
 void
-move_get_coord(const struct move *m, double move_time, struct coord *pos)
+move_get_coord(const struct move *m, motion_t move_time, struct coord *pos)
 {
-    double dist = move_get_distance(m, move_time);
+    motion_t dist = move_get_distance(m, move_time);
     
     pos->x = m->start_pos.x + m->axes_r.x * dist;
     pos->y = m->start_pos.y + m->axes_r.y * dist;
@@ -169,7 +293,7 @@ move_get_coord(const struct move *m, double move_time, struct coord *pos)
 
 /* ========== Trapq Functions ========== */
 
-void
+int
 trapq_append(struct trapq *tq, double print_time,
              double accel_t, double cruise_t, double decel_t,
              const struct coord *start_pos, const struct coord *axes_r,
@@ -177,78 +301,91 @@ trapq_append(struct trapq *tq, double print_time,
 {
     struct move *m = move_alloc();
     if (m == NULL) {
-        /* Pool exhausted - should not happen in normal operation */
-        return;
+        /* Pool exhausted - caller must free finished moves and retry */
+        return -1;
     }
     
     m->print_time = print_time;
-    m->move_t = accel_t + cruise_t + decel_t;
     m->accel_t = accel_t;
     m->cruise_t = cruise_t;
     m->decel_t = decel_t;
+    /* Sum in motion_t so it matches the caller's print_time advance */
+    m->move_t = m->accel_t + m->cruise_t + m->decel_t;
     m->start_v = start_v;
     m->cruise_v = cruise_v;
     m->half_accel = accel * 0.5;
     m->start_pos = *start_pos;
     m->axes_r = *axes_r;
+    m->active_axes = (uint8_t)((axes_r->x != MOTION_C(0.0) ? TRAPQ_AXIS_X : 0) |
+                               (axes_r->y != MOTION_C(0.0) ? TRAPQ_AXIS_Y : 0) |
+                               (axes_r->z != MOTION_C(0.0) ? TRAPQ_AXIS_Z : 0) |
+                               (axes_r->e != MOTION_C(0.0) ? TRAPQ_AXIS_E : 0));
     
     list_add_tail(&m->node, &tq->moves);
+    trace_record(TRACE_MOVE, m->active_axes,
+                 (uint16_t)move_pool_stats.moves_used,
+                 (uint32_t)(print_time * 1000000.0),
+                 (uint32_t)(m->move_t * 1000000.0));
+    return 0;
 }
 
 void
 trapq_finalize_moves(struct trapq *tq, double print_time)
 {
-    struct move *m, *tmp;
-    
-    list_for_each_entry_safe(m, tmp, &tq->moves, struct move, node) {
-        double move_end = m->print_time + m->move_t;
-        if (move_end <= print_time) {
-            /* Move is complete - move to history */
-            list_del(&m->node);
-            list_add_tail(&m->node, &tq->history);
+    /* Moves are time ordered: stop at the first one still running */
+    while (!list_empty(&tq->moves)) {
+        struct move *m = list_first_entry(&tq->moves, struct move, node);
+        if (m->print_time + m->move_t > print_time) {
+            break;
         }
+        list_del(&m->node);
+        list_add_tail(&m->node, &tq->history);
     }
 }
 
 void
 trapq_free_moves(struct trapq *tq, double print_time)
 {
-    struct move *m, *tmp;
-    
-    list_for_each_entry_safe(m, tmp, &tq->history, struct move, node) {
-        double move_end = m->print_time + m->move_t;
-        if (move_end < print_time) {
-            list_del(&m->node);
-            move_free(m);
+    /* History is time ordered: trim from the oldest end */
+    while (!list_empty(&tq->history)) {
+        struct move *m = list_first_entry(&tq->history, struct move, node);
+        if (m->print_time + m->move_t >= print_time) {
+            break;
         }
+        if (tq->last_hit == m) {
+            tq->last_hit = NULL;
+        }
+        list_del(&m->node);
+        move_free(m);
     }
 }
 
 int
-trapq_get_position(const struct trapq *tq, double print_time, struct coord *pos)
+trapq_get_position(struct trapq *tq, double print_time, struct coord *pos)
 {
-    /* Search in active moves first */
-    struct move *m;
-    list_for_each_entry(m, &tq->moves, struct move, node) {
-        double move_end = m->print_time + m->move_t;
-        if (print_time >= m->print_time && print_time <= move_end) {
-            double move_time = print_time - m->print_time;
-            move_get_coord(m, move_time, pos);
-            return 0;
+    /* Start from the last hit, else the newest move */
+    struct move *m = tq->last_hit;
+    if (m == NULL) {
+        m = trapq_last_move(tq);
+        if (m == NULL) {
+            m = list_last_entry(&tq->history, struct move, node);
         }
     }
     
-    /* Search in history */
-    list_for_each_entry(m, &tq->history, struct move, node) {
-        double move_end = m->print_time + m->move_t;
-        if (print_time >= m->print_time && print_time <= move_end) {
-            double move_time = print_time - m->print_time;
-            move_get_coord(m, move_time, pos);
-            return 0;
-        }
+    /* Step through time order towards print_time */
+    while (m != NULL && print_time < m->print_time) {
+        m = trapq_move_prev(tq, m);
+    }
+    while (m != NULL && print_time > m->print_time + m->move_t) {
+        m = trapq_move_next(tq, m);
+    }
+    if (m == NULL || print_time < m->print_time) {
+        return -1;  /* No move at this time */
     }
     
-    return -1;  /* No move at this time */
+    tq->last_hit = m;
+    move_get_coord(m, print_time - m->print_time, pos);
+    return 0;
 }
 
 int
@@ -268,3 +405,29 @@ trapq_last_move(struct trapq *tq)
 {
     return list_last_entry(&tq->moves, struct move, node);
 }
+
+struct move *
+trapq_move_prev(struct trapq *tq, struct move *m)
+{
+    struct list_node *node = m->node.prev;
+    if (node == &tq->moves.root) {
+        node = tq->history.root.prev;
+    }
+    if (node == &tq->history.root) {
+        return NULL;
+    }
+    return list_entry(node, struct move, node);
+}
+
+struct move *
+trapq_move_next(struct trapq *tq, struct move *m)
+{
+    struct list_node *node = m->node.next;
+    if (node == &tq->history.root) {
+        node = tq->moves.root.next;
+    }
+    if (node == &tq->moves.root) {
+        return NULL;
+    }
+    return list_entry(node, struct move, node);
+}
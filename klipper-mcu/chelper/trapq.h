@@ -14,18 +14,31 @@
 #ifndef CHELPER_TRAPQ_H
 #define CHELPER_TRAPQ_H
 
+#include <stdint.h>
+#include "config.h"
 #include "list.h"
+#include "motion_scalar.h"
 
 /**
  * @brief 3D coordinate with extruder position
  */
 struct coord {
-    double x;
-    double y;
-    double z;
-    double e;
+    motion_t x;
+    motion_t y;
+    motion_t z;
+    motion_t e;
 };
 
+/**
+ * @brief Axis flags for move->active_axes and sk->active_axes
+ */
+#define TRAPQ_AXIS_X        (1 << 0)
+#define TRAPQ_AXIS_Y        (1 << 1)
+#define TRAPQ_AXIS_Z        (1 << 2)
+#define TRAPQ_AXIS_E        (1 << 3)
+#define TRAPQ_AXIS_ALL      (TRAPQ_AXIS_X | TRAPQ_AXIS_Y | TRAPQ_AXIS_Z | \
+                             TRAPQ_AXIS_E)
+
 /**
  * @brief Motion segment in the trapezoidal queue
  * 
@@ -35,21 +48,22 @@ struct coord {
 struct move {
     /* Timing */
     double print_time;          /**< Start time of this move (seconds) */
-    double move_t;              /**< Duration of this move (seconds) */
+    motion_t move_t;            /**< Duration of this move (seconds) */
     
     /* Velocity profile */
-    double start_v;             /**< Starting velocity (mm/s) */
-    double half_accel;          /**< Half of acceleration (mm/s²) / 2 */
-    double cruise_v;            /**< Cruise velocity (mm/s) */
+    motion_t start_v;           /**< Starting velocity (mm/s) */
+    motion_t half_accel;        /**< Half of acceleration (mm/s²) / 2 */
+    motion_t cruise_v;          /**< Cruise velocity (mm/s) */
     
     /* Acceleration phase timing */
-    double accel_t;             /**< Acceleration phase duration */
-    double cruise_t;            /**< Cruise phase duration */
-    double decel_t;             /**< Deceleration phase duration */
+    motion_t accel_t;           /**< Acceleration phase duration */
+    motion_t cruise_t;          /**< Cruise phase duration */
+    motion_t decel_t;           /**< Deceleration phase duration */
     
     /* Position and direction */
     struct coord start_pos;     /**< Starting position */
     struct coord axes_r;        /**< Unit direction vector (normalized) */
+    uint8_t active_axes;        /**< TRAPQ_AXIS_* with non-zero axes_r */
     
     /* List linkage */
     struct list_node node;      /**< Node for linking in trapq */
@@ -58,20 +72,38 @@ struct move {
 /**
  * @brief Trapezoidal motion queue
  * 
- * Contains active moves and historical moves for lookahead.
+ * Contains active moves and historical moves for lookahead. Both lists
+ * are kept in time order (history then moves), so finalize and free
+ * only touch the moves they retire.
  */
 struct trapq {
     struct list_head moves;     /**< Active moves to execute */
     struct list_head history;   /**< Completed moves (for lookahead) */
+    struct move *last_hit;      /**< Last move found by trapq_get_position */
 };
 
 /* ========== Memory Pool Configuration ========== */
 
 /**
- * Maximum number of moves in the queue.
- * Each move is ~256 bytes, so 32 moves = ~8KB
+ * Maximum number of moves in the queue (TRAPQ_MAX_MOVES) is set by the
+ * memory budget in config.h. Each move is ~144 bytes with double
+ * precision motion math, ~96 bytes with CONFIG_MOTION_FLOAT.
+ */
+
+/** Static RAM used by the move pool */
+#define TRAPQ_POOL_RAM_BYTES \
+    (TRAPQ_MAX_MOVES * (sizeof(struct move) + 1))
+
+/**
+ * @brief Move pool statistics
  */
-#define TRAPQ_MAX_MOVES     32
+typedef struct {
+    uint32_t total_allocs;      /**< Successful move allocations */
+    uint32_t total_frees;       /**< Moves returned to the pool */
+    uint32_t failed_allocs;     /**< Allocations refused (pool exhausted) */
+    uint32_t moves_used;        /**< Moves currently allocated */
+    uint32_t moves_peak;        /**< High-water mark of moves_used */
+} trapq_pool_stats_t;
 
 /* ========== Function Prototypes ========== */
 
@@ -97,6 +129,8 @@ void trapq_free(struct trapq *tq);
 /**
  * @brief Allocate a move from the pool
  * @return Pointer to move, or NULL if pool exhausted
+ * 
+ * O(1) and safe to call with interrupts enabled.
  */
 struct move *move_alloc(void);
 
@@ -106,6 +140,23 @@ struct move *move_alloc(void);
  */
 void move_free(struct move *m);
 
+/**
+ * @brief Get the number of free moves in the pool
+ * @return Free move count
+ */
+uint32_t trapq_pool_available(void);
+
+/**
+ * @brief Get move pool statistics
+ * @param stats Output statistics structure
+ */
+void trapq_pool_get_stats(trapq_pool_stats_t *stats);
+
+/**
+ * @brief Reset move pool statistics (keeps current usage)
+ */
+void trapq_pool_reset_stats(void);
+
 /**
  * @brief Add a move to the trapq
  * @param tq        Target trapq
@@ -118,18 +169,20 @@ void move_free(struct move *m);
  * @param start_v   Starting velocity
  * @param cruise_v  Cruise velocity
  * @param accel     Acceleration value
+ * @return 0 on success, -1 if the move pool is exhausted
  */
-void trapq_append(struct trapq *tq, double print_time,
-                  double accel_t, double cruise_t, double decel_t,
-                  const struct coord *start_pos, const struct coord *axes_r,
-                  double start_v, double cruise_v, double accel);
+int trapq_append(struct trapq *tq, double print_time,
+                 double accel_t, double cruise_t, double decel_t,
+                 const struct coord *start_pos, const struct coord *axes_r,
+                 double start_v, double cruise_v, double accel);
 
 /**
  * @brief Finalize moves up to the given time
  * @param tq         Target trapq
  * @param print_time Time up to which moves are finalized
  * 
- * Moves completed moves from the active list to history.
+ * Moves completed moves from the active list to history. Stops at the
+ * first unfinished move, so the cost is O(moves finalized).
  */
 void trapq_finalize_moves(struct trapq *tq, double print_time);
 
@@ -137,6 +190,8 @@ void trapq_finalize_moves(struct trapq *tq, double print_time);
  * @brief Free moves from history older than given time
  * @param tq         Target trapq
  * @param print_time Time before which moves are freed
+ * 
+ * Trims history from its oldest end in O(moves freed).
  */
 void trapq_free_moves(struct trapq *tq, double print_time);
 
@@ -146,8 +201,12 @@ void trapq_free_moves(struct trapq *tq, double print_time);
  * @param print_time Time to query
  * @param pos        Output position
  * @return 0 on success, -1 if no move at that time
+ * 
+ * The search starts at the move found by the previous query (or the
+ * newest move) and steps through history and active moves in time
+ * order, so queries near the last one are O(1).
  */
-int trapq_get_position(const struct trapq *tq, double print_time,
+int trapq_get_position(struct trapq *tq, double print_time,
                        struct coord *pos);
 
 /**
@@ -156,7 +215,7 @@ int trapq_get_position(const struct trapq *tq, double print_time,
  * @param move_time  Time offset from move start
  * @param pos        Output position
  */
-void move_get_coord(const struct move *m, double move_time,
+void move_get_coord(const struct move *m, motion_t move_time,
                     struct coord *pos);
 
 /**
@@ -165,7 +224,18 @@ void move_get_coord(const struct move *m, double move_time,
  * @param move_time Time offset from move start
  * @return Distance traveled (mm)
  */
-double move_get_distance(const struct move *m, double move_time);
+motion_t move_get_distance(const struct move *m, motion_t move_time);
+
+/**
+ * @brief Get the time at which a distance is reached within a move
+ * @param m         Move to query
+ * @param move_dist Distance from move start (mm)
+ * @return Time offset from move start, clamped to [0, move_t]
+ * 
+ * Closed-form inverse of move_get_distance() over the accel, cruise
+ * and decel phases.
+ */
+motion_t move_get_time(const struct move *m, motion_t move_dist);
 
 /**
  * @brief Check if trapq has pending moves
@@ -188,4 +258,22 @@ struct move *trapq_first_move(struct trapq *tq);
  */
 struct move *trapq_last_move(struct trapq *tq);
 
+/**
+ * @brief Get the move before m in time
+ * @param tq Trapq containing m
+ * @param m  Move in the active list or in history
+ * @return Previous move (continuing from the active list into history),
+ *         or NULL if m is the oldest move
+ */
+struct move *trapq_move_prev(struct trapq *tq, struct move *m);
+
+/**
+ * @brief Get the move after m in time
+ * @param tq Trapq containing m
+ * @param m  Move in the active list or in history
+ * @return Next move (continuing from history into the active list),
+ *         or NULL if m is the newest move
+ */
+struct move *trapq_move_next(struct trapq *tq, struct move *m);
+
 #endif /* CHELPER_TRAPQ_H */
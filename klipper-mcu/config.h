@@ -35,6 +35,10 @@
 #define TEMP_HOTEND_ADC_CH      0
 #define TEMP_BED_ADC_CH         1
 
+/* 热敏电阻类型: 0=100K 实测曲线 1=100K Beta3950 (THERMISTOR_*) */
+#define TEMP_HOTEND_SENSOR_TYPE 0
+#define TEMP_BED_SENSOR_TYPE    0
+
 /* ========== 加热器 PWM ========== */
 #define HEATER_HOTEND_PIN       GPIO_PB4
 #define HEATER_BED_PIN          GPIO_PB5
@@ -59,6 +63,41 @@
 #define Z_MIN                   0.0f
 #define Z_MAX                   250.0f
 
+/* 运动学: 0=笛卡尔 1=CoreXY 2=三角洲 (KINEMATICS_*) */
+#define KINEMATICS              0
+
+/* 三角洲几何 (KINEMATICS=2): X/Y/Z 电机依次驱动 A/B/C 塔，Z_MAX 为归零高度 */
+#define DELTA_ARM_LENGTH        217.0f      /* mm，连杆长度 */
+#define DELTA_RADIUS            99.0f       /* mm，塔到中心的水平距离 */
+#define DELTA_PRINT_RADIUS      85.0f       /* mm，可打印半径 */
+
+/* 输入整形: 0=关闭 1=ZV 2=MZV 3=EI (INPUT_SHAPER_*) */
+#define SHAPER_TYPE_X           0
+#define SHAPER_FREQ_X           50.0f       /* Hz */
+#define SHAPER_TYPE_Y           0
+#define SHAPER_FREQ_Y           40.0f       /* Hz */
+#define SHAPER_DAMPING_RATIO    0.1f
+
+/* 压力提前 (M572 可在运行时修改提前量) */
+#define PRESSURE_ADVANCE            0.0f    /* 秒，0=关闭 */
+#define PRESSURE_ADVANCE_SMOOTH_TIME 0.040f /* 秒，平滑窗口 */
+
+/* 细小线段合并 (CONFIG_MOVE_COALESCE) */
+#define COALESCE_MAX_SEGMENT    0.5f        /* mm，短于此的线段才参与合并 */
+#define COALESCE_MAX_LENGTH     5.0f        /* mm，合并后的最大弦长 */
+#define COALESCE_TOLERANCE      0.005f      /* mm，中间顶点到合并弦的最大偏差 */
+#define COALESCE_E_RATIO_TOL    0.02f       /* 挤出比 (E/XYZ) 的最大相对偏差 */
+#define COALESCE_MAX_POINTS     8           /* 一次最多合并掉的中间顶点数 */
+
+/* 圆弧分段 (G2/G3) */
+#define ARC_TOLERANCE           0.01f       /* mm，分段弦到圆弧的最大偏差 */
+#define ARC_MAX_SEGMENTS        256         /* 一段圆弧最多分成的线段数 */
+#define ARC_CORRECTION_SEGMENTS 16          /* 增量旋转每隔多少段用精确三角函数校正 */
+
+/* 运动提交 (toolhead_task 按 MOVE_FLUSH_PERIOD 定时刷新；步进按驱动队列水位补充) */
+#define BUFFER_TIME_LOW         0.05        /* 秒，已提交运动少于此时长时前瞻不再等待 */
+#define MOVE_FLUSH_PERIOD       0.02        /* 秒，定时刷新周期 */
+
 /* ========== PID 参数 ========== */
 #define HOTEND_PID_KP           22.2f
 #define HOTEND_PID_KI           1.08f
@@ -68,7 +107,68 @@
 #define BED_PID_KI              0.5f
 #define BED_PID_KD              200.0f
 
+/* ========== 设备表 ========== */
+/*
+ * 步进电机、加热器和风扇由下列表展开: ID 枚举、状态数组、PWM/ADC 通道
+ * 和定时器入口都按表生成，只占用列出的设备，周期循环也只遍历这些项。
+ * 增加挤出机、腔体加热器或风扇只需在表中加一行 (顺序即 ID，
+ * 现有 G-code 依赖 HOTEND=0、BED=1 和 PART=0)。
+ */
+
+/* STEPPER(名称, 步进引脚, 方向引脚, 使能引脚) -> STEPPER_<名称> */
+#define STEPPER_TABLE(STEPPER) \
+    STEPPER(X, STEPPER_X_STEP_PIN, STEPPER_X_DIR_PIN, STEPPER_X_ENABLE_PIN) \
+    STEPPER(Y, STEPPER_Y_STEP_PIN, STEPPER_Y_DIR_PIN, STEPPER_Y_ENABLE_PIN) \
+    STEPPER(Z, STEPPER_Z_STEP_PIN, STEPPER_Z_DIR_PIN, STEPPER_Z_ENABLE_PIN) \
+    STEPPER(E, STEPPER_E_STEP_PIN, STEPPER_E_DIR_PIN, STEPPER_E_ENABLE_PIN)
+
+/*
+ * HEATER(名称, ADC 通道, 热敏电阻类型, PWM 引脚, 最大功率, Kp, Ki, Kd)
+ *   -> HEATER_<名称>、PWM_CHANNEL_HEATER_<名称>、ADC_CHANNEL_<名称>
+ */
+#define HEATER_TABLE(HEATER) \
+    HEATER(HOTEND, TEMP_HOTEND_ADC_CH, TEMP_HOTEND_SENSOR_TYPE, \
+           HEATER_HOTEND_PIN, 1.0f, HOTEND_PID_KP, HOTEND_PID_KI, HOTEND_PID_KD) \
+    HEATER(BED, TEMP_BED_ADC_CH, TEMP_BED_SENSOR_TYPE, \
+           HEATER_BED_PIN, 1.0f, BED_PID_KP, BED_PID_KI, BED_PID_KD)
+
+/* FAN(名称, PWM 引脚) -> FAN_<名称>、PWM_CHANNEL_FAN_<名称> */
+#define FAN_TABLE(FAN) \
+    FAN(PART, FAN_PART_PIN) \
+    FAN(HOTEND, FAN_HOTEND_PIN)
+
 /* ========== 串口配置 ========== */
 #define SERIAL_BAUD             115200
+#define GCODE_QUEUE_SIZE        4           /* 等待命令执行期间预读解析的命令数 */
+#define GCODE_STREAM_BUFFER_SIZE (24 * 1024) /* 流式作业命令缓冲区 (CCM，紧凑记录) */
+#define GCODE_RESPONSE_QUEUE_SIZE 16        /* 待渲染发送的响应条数 */
+#define GCODE_RESPONSE_MAX_ARGS 6           /* 单条格式化响应最多参数数 */
+#define GCODE_RESPONSE_LINE_SIZE 96         /* 单次渲染的最大长度 (含 "\r\n") */
+#define GCODE_RESPONSE_RESERVE  6           /* 执行下一条命令前须空闲的响应条数 */
+
+/* ========== SD 卡配置 ========== */
+#define SDCARD_BUFFER_BLOCKS    4           /* 每个流式缓冲区的扇区数 (两个缓冲区，主 SRAM) */
+#define SDCARD_LIST_MAX         32          /* M20 列出的最多文件数 */
+
+/* ========== 内存预算 ========== */
+/*
+ * 运动缓冲区和内存池的大小统一在此配置，各模块不再单独定义。
+ * 加深前瞻可减少细小线段处的降速，加深步进队列可容忍更长的主循环
+ * 停顿。前瞻队列、trapq 运动段池和内存池在主 SRAM，共用
+ * RAM_BUDGET_BYTES；步进队列、流式命令缓冲区、步进电机状态、调度器
+ * 定时器堆和轨迹记录环 (__ccmram) 在 CCM，共用 CCM_BUDGET_BYTES。
+ * 超出任一预算时 toolhead.c 编译报错。
+ * `make ram-report` 按模块列出实际静态 RAM 占用。
+ */
+#define RAM_BUDGET_BYTES        (64 * 1024) /* 主 SRAM 中运动缓冲区的上限 */
+#define CCM_BUDGET_BYTES        (64 * 1024) /* CCM 中 __ccmram 数据的上限 (整个 CCM) */
+
+#define LOOKAHEAD_SIZE          32          /* 前瞻队列运动段数 */
+#define TRAPQ_MAX_MOVES         64          /* trapq 运动段内存池 */
+#define STEP_QUEUE_SIZE         256         /* 每轴步进时间队列 */
+
+#define MEM_POOL_SMALL_COUNT    16          /* 16 x 64 = 1KB */
+#define MEM_POOL_MEDIUM_COUNT   16          /* 16 x 256 = 4KB */
+#define MEM_POOL_LARGE_COUNT    8           /* 8 x 512 = 4KB */
 
 #endif /* CONFIG_H */
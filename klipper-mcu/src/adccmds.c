@@ -4,6 +4,9 @@
  * 
  * 复用自 Klipper src/adccmds.c
  * 提供 ADC 采样和温度读取功能
+ * 
+ * 采样定时器只遍历已配置且启用的通道列表；列表为空时定时器停止，
+ * 由 adc_enable() 重新启动。
  */
 
 #include "adccmds.h"
@@ -32,6 +35,10 @@ static adc_state_t s_adc_channels[ADC_CHANNEL_COUNT];
 /* ADC 采样定时器 */
 static sched_timer_t s_adc_timer;
 
+/* 已配置且启用的通道，由 adc_active_update() 维护 */
+static uint8_t s_adc_active[ADC_CHANNEL_COUNT];
+static uint8_t s_adc_active_count = 0;
+
 /* 采样间隔（时钟周期，约 100ms） */
 #define ADC_SAMPLE_INTERVAL     100000
 
@@ -43,10 +50,36 @@ static sched_timer_t s_adc_timer;
 
 /* TODO: 需要 HAL 层实现这些函数 */
 extern void adc_setup(uint8_t channel);
-extern uint16_t adc_read(uint8_t channel);
+
+/* HAL 按通道号读取；CONFIG_ADC_SCAN 下直接返回 DMA 扫描的滤波结果 */
+extern int32_t adc_read_channel(uint8_t channel);
 
 /* ========== 私有函数 ========== */
 
+/**
+ * @brief  重建启用通道列表，有通道时确保采样定时器运行
+ */
+static void adc_active_update(void)
+{
+    uint8_t count = 0;
+    uint32_t flag;
+    int i;
+    
+    flag = sched_irq_save();
+    for (i = 0; i < ADC_CHANNEL_COUNT; i++) {
+        if (s_adc_channels[i].configured && s_adc_channels[i].enabled) {
+            s_adc_active[count++] = (uint8_t)i;
+        }
+    }
+    s_adc_active_count = count;
+    
+    if (count != 0 && s_adc_timer.func != NULL && s_adc_timer.heap_pos == 0) {
+        s_adc_timer.waketime = sched_get_time() + ADC_SAMPLE_INTERVAL;
+        sched_add_timer(&s_adc_timer);
+    }
+    sched_irq_restore(flag);
+}
+
 /**
  * @brief  ADC 采样定时器回调
  * @param  waketime 唤醒时间
@@ -54,24 +87,26 @@ extern uint16_t adc_read(uint8_t channel);
  */
 static sched_time_t adc_timer_callback(sched_time_t waketime)
 {
-    int i;
+    uint8_t i;
     uint16_t value;
     
-    /* 遍历所有 ADC 通道 */
-    for (i = 0; i < ADC_CHANNEL_COUNT; i++) {
-        adc_state_t* adc = &s_adc_channels[i];
-        
-        if (!adc->configured || !adc->enabled) {
-            continue;
-        }
+    /* 没有启用的通道: 停止，由 adc_enable() 重新启动 */
+    if (s_adc_active_count == 0) {
+        return 0;
+    }
+    
+    /* 只遍历已启用的通道 */
+    for (i = 0; i < s_adc_active_count; i++) {
+        uint8_t id = s_adc_active[i];
+        adc_state_t* adc = &s_adc_channels[id];
         
-        /* 读取 ADC 值 */
-        value = adc_read(adc->channel);
+        /* 读取 ADC 值 (扫描模式下不等待转换) */
+        value = (uint16_t)adc_read_channel(adc->channel);
         adc->value = value;
         
         /* 调用回调函数 */
         if (adc->callback != NULL) {
-            adc->callback((adc_channel_t)i, value, adc->callback_arg);
+            adc->callback((adc_channel_t)id, value, adc->callback_arg);
         }
     }
     
@@ -101,13 +136,11 @@ int adccmds_init(void)
         s_adc_channels[i].callback_arg = NULL;
     }
     
-    /* 初始化采样定时器 */
+    /* 初始化采样定时器，第一个通道启用时启动 */
     s_adc_timer.func = adc_timer_callback;
-    s_adc_timer.waketime = sched_get_time() + ADC_SAMPLE_INTERVAL;
-    s_adc_timer.next = NULL;
-    
-    /* 启动采样定时器 */
-    sched_add_timer(&s_adc_timer);
+    s_adc_timer.waketime = 0;
+    s_adc_timer.heap_pos = 0;
+    s_adc_active_count = 0;
     
     return 0;
 }
@@ -135,6 +168,7 @@ int adc_config(adc_channel_t id, const adc_config_t* config)
     /* 配置 HAL 层 ADC */
     adc_setup(config->channel);
     
+    adc_active_update();
     return 0;
 }
 
@@ -150,6 +184,7 @@ void adc_enable(adc_channel_t id, int enable)
     }
     
     s_adc_channels[id].enabled = enable ? 1 : 0;
+    adc_active_update();
 }
 
 /**
@@ -225,7 +260,7 @@ int32_t adc_sample_now(adc_channel_t id)
     }
     
     /* 立即读取 ADC */
-    value = adc_read(adc->channel);
+    value = (uint16_t)adc_read_channel(adc->channel);
     adc->value = value;
     
     return value;
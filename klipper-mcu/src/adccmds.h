@@ -14,12 +14,16 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include "config.h"
 
 /* ========== ADC 通道 ID ========== */
 
+/* 每个加热器一个温度通道，由 config.h 的 HEATER_TABLE 生成 */
+#define ADC_HEATER_ENTRY(name, adc_ch, sensor, pin, power, kp, ki, kd) \
+    ADC_CHANNEL_##name,
+
 typedef enum {
-    ADC_CHANNEL_HOTEND = 0,     /* 热端温度 */
-    ADC_CHANNEL_BED,            /* 热床温度 */
+    HEATER_TABLE(ADC_HEATER_ENTRY)
     ADC_CHANNEL_COUNT
 } adc_channel_t;
 
@@ -3,36 +3,154 @@
  * @brief   命令处理实现
  * 
  * 复用自 Klipper src/command.c
- * 提供命令注册和分发功能
+ * 提供命令注册和分发功能，以及 Klipper 格式的二进制消息块
+ * (VLQ 参数、CRC16、序号与 ack) 的校验、分发和发送
  */
 
 #include "command.h"
 #include "sched.h"
+#include "stm32/serial.h"
 #include <stdarg.h>
 #include <string.h>
 
 /* ========== 私有常量 ========== */
 
-/* 最大注册命令数 */
-#define CMD_MAX_HANDLERS        32
-
 /* 响应缓冲区大小 */
 #define CMD_TX_BUF_SIZE         256
 
 /* ========== 私有变量 ========== */
 
-/* 命令处理函数表 */
-static cmd_desc_t s_cmd_handlers[CMD_MAX_HANDLERS];
-static uint8_t s_cmd_count = 0;
+/* 命令分发表，按命令 ID 直接索引 */
+static const cmd_desc_t* s_cmd_table[CMD_ID_MAX + 1];
 
 /* 发送缓冲区 */
 static uint8_t s_tx_buf[CMD_TX_BUF_SIZE];
 static size_t s_tx_len = 0;
 
-/* ========== HAL 接口 ========== */
+/* 下一个期望的主机消息块序号 (含 CMD_MESSAGE_DEST) */
+static uint8_t s_next_sequence = CMD_MESSAGE_DEST;
+
+/* 因 CMD_BUSY 未处理完的消息块内容偏移 */
+static size_t s_frame_resume = 0;
+
+/* 协议统计 */
+static cmd_stats_t s_stats;
+
+/* ========== 私有函数 ========== */
+
+/**
+ * @brief  查找命令描述 (O(1))
+ * @param  id 命令 ID
+ * @retval 命令描述指针，未注册返回 NULL
+ */
+static const cmd_desc_t* command_lookup(uint32_t id)
+{
+    return (id <= CMD_ID_MAX) ? s_cmd_table[id] : NULL;
+}
+
+/**
+ * @brief  填充消息块头尾并发送
+ * @param  content_len s_tx_buf 中已写入的内容长度
+ * @retval 0 成功，负数 失败
+ */
+static int command_send_block(size_t content_len)
+{
+    size_t len = content_len + CMD_MESSAGE_HEADER_SIZE + CMD_MESSAGE_TRAILER_SIZE;
+    
+    if (len > CMD_MESSAGE_MAX) {
+        return -1;
+    }
+    
+    s_tx_buf[CMD_MESSAGE_POS_LEN] = (uint8_t)len;
+    s_tx_buf[CMD_MESSAGE_POS_SEQ] = s_next_sequence;
+    
+    uint16_t crc = cmd_crc16(s_tx_buf, len - CMD_MESSAGE_TRAILER_SIZE);
+    s_tx_buf[len - 3] = (uint8_t)(crc >> 8);
+    s_tx_buf[len - 2] = (uint8_t)(crc & 0xFF);
+    s_tx_buf[len - 1] = CMD_MESSAGE_SYNC;
+    
+    return command_send_response(s_tx_buf, len);
+}
+
+/**
+ * @brief  发送 ack (空内容消息块，seq 为下一个期望序号)
+ */
+static void command_send_ack(void)
+{
+    command_send_block(0);
+}
+
+/**
+ * @brief  分发一段内容中的命令
+ * @param  data 命令数据
+ * @param  len 数据长度
+ * @param  p_done 输出: 已完成命令占用的字节数
+ * @retval 0 全部完成，CMD_BUSY 停在需要重试的命令，负数 失败
+ * 
+ * 未知命令无法得知参数个数，其后的内容全部丢弃。
+ */
+static int command_dispatch(const uint8_t* data, size_t len, size_t* p_done)
+{
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    int ret = 0;
+    
+    while (p < end) {
+        const uint8_t* start = p;
+        uint32_t id;
+        
+        if (cmd_decode_vlq(&p, end, &id) != 0) {
+            ret = -1;
+            break;
+        }
+        
+        const cmd_desc_t* desc = command_lookup(id);
+        if (desc == NULL) {
+            uint32_t err[2] = { id, (uint32_t)-2 };
+            s_stats.unknown_cmds++;
+            command_send_message(CMD_RSP_ERROR, err, 2);
+            p = end;
+            ret = -2;
+            break;
+        }
+        
+        /* 解码参数 */
+        cmd_args_t args;
+        args.data = p;
+        args.count = desc->num_args;
+        for (uint8_t i = 0; i < desc->num_args; i++) {
+            if (cmd_decode_vlq(&p, end, &args.values[i]) != 0) {
+                *p_done = (size_t)(start - data);
+                return -1;
+            }
+        }
+        args.len = (size_t)(p - args.data);
+        
+        int r = (desc->handler != NULL) ? desc->handler(&args) : 0;
+        if (r == CMD_BUSY) {
+            p = start;
+            ret = CMD_BUSY;
+            break;
+        }
+        if (r < 0) {
+            uint32_t err[2] = { id, (uint32_t)r };
+            command_send_message(CMD_RSP_ERROR, err, 2);
+        }
+    }
+    
+    *p_done = (size_t)(p - data);
+    return ret;
+}
 
-/* TODO: 需要 HAL 层实现这些函数 */
-extern void serial_write(const uint8_t* data, size_t len);
+/**
+ * @brief  get_clock: 回复当前调度器时钟
+ */
+static int command_get_clock(const cmd_args_t* args)
+{
+    (void)args;
+    uint32_t clock = sched_get_time();
+    return command_send_message(CMD_RSP_CLOCK, &clock, 1);
+}
 
 /* ========== 公共接口实现 ========== */
 
@@ -43,14 +161,22 @@ extern void serial_write(const uint8_t* data, size_t len);
 int command_init(void)
 {
     /* 清零命令表 */
-    memset(s_cmd_handlers, 0, sizeof(s_cmd_handlers));
-    s_cmd_count = 0;
+    memset(s_cmd_table, 0, sizeof(s_cmd_table));
     
     /* 清零发送缓冲区 */
     memset(s_tx_buf, 0, sizeof(s_tx_buf));
     s_tx_len = 0;
     
-    return 0;
+    /* 复位协议状态 */
+    s_next_sequence = CMD_MESSAGE_DEST;
+    s_frame_resume = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+    
+    /* 内置命令 */
+    static const cmd_desc_t get_clock = {
+        CMD_ID_GET_CLOCK, "get_clock", command_get_clock, 0
+    };
+    return command_register(&get_clock);
 }
 
 /**
@@ -64,57 +190,141 @@ int command_register(const cmd_desc_t* desc)
         return -1;
     }
     
-    if (s_cmd_count >= CMD_MAX_HANDLERS) {
-        return -2;
+    if (desc->num_args > CMD_MAX_ARGS || desc->id > CMD_ID_MAX) {
+        return -1;
     }
     
     /* 检查是否已注册 */
-    for (uint8_t i = 0; i < s_cmd_count; i++) {
-        if (s_cmd_handlers[i].id == desc->id) {
-            return -3;  /* 已存在 */
-        }
+    if (s_cmd_table[desc->id] != NULL) {
+        return -3;  /* 已存在 */
     }
     
-    /* 添加到命令表 */
-    s_cmd_handlers[s_cmd_count] = *desc;
-    s_cmd_count++;
+    /* 登记到分发表 */
+    s_cmd_table[desc->id] = desc;
     
     return 0;
 }
 
 /**
  * @brief  处理接收到的命令
- * @param  data 命令数据
+ * @param  data 命令数据 (一条或多条 VLQ 编码命令)
  * @param  len 数据长度
- * @retval 0 成功，负数 失败
+ * @retval 0 成功，CMD_BUSY 有命令需稍后重试，负数 失败
  */
 int command_process(const uint8_t* data, size_t len)
 {
-    cmd_id_t cmd_id;
-    cmd_args_t args;
+    size_t done;
     
     if (data == NULL || len == 0) {
         return -1;
     }
     
-    /* 提取命令 ID */
-    cmd_id = data[0];
+    return command_dispatch(data, len, &done);
+}
+
+/**
+ * @brief  处理一个完整的二进制消息块
+ * @param  frame 消息块
+ * @param  len 消息块长度
+ * @retval 0 已处理，CMD_BUSY 未处理完，CMD_ERR_* 已丢弃
+ */
+int command_process_frame(const uint8_t* frame, size_t len)
+{
+    if (frame == NULL || len < CMD_MESSAGE_MIN || len > CMD_MESSAGE_MAX ||
+        frame[CMD_MESSAGE_POS_LEN] != len ||
+        frame[len - 1] != CMD_MESSAGE_SYNC ||
+        (frame[CMD_MESSAGE_POS_SEQ] & ~CMD_MESSAGE_SEQ_MASK) != CMD_MESSAGE_DEST) {
+        return CMD_ERR_FRAME;
+    }
+    
+    /* 校验 CRC，失败时回复期望序号让主机重发 */
+    uint16_t crc = cmd_crc16(frame, len - CMD_MESSAGE_TRAILER_SIZE);
+    if (frame[len - 3] != (uint8_t)(crc >> 8) ||
+        frame[len - 2] != (uint8_t)(crc & 0xFF)) {
+        s_stats.crc_errors++;
+        command_send_ack();
+        return CMD_ERR_CRC;
+    }
     
-    /* 设置参数 */
-    args.data = data + 1;
-    args.len = len - 1;
+    /* 重复或越过的块: 丢弃，回复期望序号 */
+    if (frame[CMD_MESSAGE_POS_SEQ] != s_next_sequence) {
+        s_stats.seq_errors++;
+        command_send_ack();
+        return CMD_ERR_SEQ;
+    }
     
-    /* 查找处理函数 */
-    for (uint8_t i = 0; i < s_cmd_count; i++) {
-        if (s_cmd_handlers[i].id == cmd_id) {
-            if (s_cmd_handlers[i].handler != NULL) {
-                s_cmd_handlers[i].handler(&args);
-                return 0;
-            }
+    /* 分发内容，从上次未完成的命令继续 */
+    const uint8_t* content = frame + CMD_MESSAGE_HEADER_SIZE;
+    size_t content_len = len - CMD_MESSAGE_HEADER_SIZE - CMD_MESSAGE_TRAILER_SIZE;
+    size_t done = 0;
+    int ret = 0;
+    if (s_frame_resume < content_len) {
+        ret = command_dispatch(content + s_frame_resume,
+                               content_len - s_frame_resume, &done);
+    }
+    if (ret == CMD_BUSY) {
+        s_frame_resume += done;
+        return CMD_BUSY;
+    }
+    
+    s_frame_resume = 0;
+    s_next_sequence = (uint8_t)(((s_next_sequence + 1) & CMD_MESSAGE_SEQ_MASK) |
+                                CMD_MESSAGE_DEST);
+    s_stats.frames_ok++;
+    command_send_ack();
+    
+    return 0;
+}
+
+/**
+ * @brief  处理串口中已接收的二进制消息块
+ */
+void command_task(void)
+{
+    const char* frame;
+    size_t len;
+    
+    while (serial_line_kind() == SERIAL_LINE_FRAME &&
+           (frame = serial_line_peek(&len)) != NULL) {
+        if (command_process_frame((const uint8_t*)frame, len) == CMD_BUSY) {
+            return;  /* 保留该块，下次从未完成的命令继续 */
         }
+        serial_line_release();
+    }
+}
+
+/**
+ * @brief  发送一条二进制响应消息
+ * @param  id 响应 ID
+ * @param  values 参数
+ * @param  count 参数个数
+ * @retval 0 成功，负数 失败
+ */
+int command_send_message(cmd_id_t id, const uint32_t* values, uint8_t count)
+{
+    if (count > CMD_MAX_ARGS || (values == NULL && count > 0)) {
+        return -1;
+    }
+    
+    /* 最多 (1 + CMD_MAX_ARGS) * 5 字节，不超过单个消息块 */
+    uint8_t* p = s_tx_buf + CMD_MESSAGE_HEADER_SIZE;
+    p += cmd_encode_vlq(p, id);
+    for (uint8_t i = 0; i < count; i++) {
+        p += cmd_encode_vlq(p, values[i]);
     }
     
-    return -2;  /* 未找到处理函数 */
+    return command_send_block((size_t)(p - s_tx_buf) - CMD_MESSAGE_HEADER_SIZE);
+}
+
+/**
+ * @brief  获取协议统计
+ * @param  stats 输出统计结构体指针
+ */
+void command_get_stats(cmd_stats_t* stats)
+{
+    if (stats != NULL) {
+        *stats = s_stats;
+    }
 }
 
 /**
@@ -155,6 +365,99 @@ int command_send_string(const char* str)
 
 /* ========== 编码/解码工具实现 ========== */
 
+/**
+ * @brief  CRC16-CCITT (Klipper 消息块校验)
+ * @param  buf 数据
+ * @param  len 数据长度
+ * @retval CRC 值
+ */
+uint16_t cmd_crc16(const uint8_t* buf, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    
+    while (len--) {
+        uint8_t data = *buf++;
+        data ^= crc & 0xFF;
+        data ^= data << 4;
+        crc = ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^
+               ((uint16_t)data << 3));
+    }
+    
+    return crc;
+}
+
+/**
+ * @brief  VLQ 编码一个 32 位整数
+ * @param  buf 缓冲区 (至少 5 字节)
+ * @param  value 值
+ * @retval 写入的字节数
+ * 
+ * 与 Klipper 相同: 每字节 7 位，高位为续接标志；首字节第 6、5 位
+ * 同为 1 时表示负数，使 -32..95 只占一个字节。
+ */
+size_t cmd_encode_vlq(uint8_t* buf, uint32_t value)
+{
+    int32_t sv = (int32_t)value;
+    uint8_t* p = buf;
+    
+    if (sv < (3L << 5) && sv >= -(1L << 5)) {
+        goto f4;
+    }
+    if (sv < (3L << 12) && sv >= -(1L << 12)) {
+        goto f3;
+    }
+    if (sv < (3L << 19) && sv >= -(1L << 19)) {
+        goto f2;
+    }
+    if (sv < (3L << 26) && sv >= -(1L << 26)) {
+        goto f1;
+    }
+    *p++ = (uint8_t)((value >> 28) | 0x80);
+f1:
+    *p++ = (uint8_t)(((value >> 21) & 0x7F) | 0x80);
+f2:
+    *p++ = (uint8_t)(((value >> 14) & 0x7F) | 0x80);
+f3:
+    *p++ = (uint8_t)(((value >> 7) & 0x7F) | 0x80);
+f4:
+    *p++ = (uint8_t)(value & 0x7F);
+    
+    return (size_t)(p - buf);
+}
+
+/**
+ * @brief  VLQ 解码一个 32 位整数
+ * @param  pp 读指针，成功时前移
+ * @param  end 数据结尾
+ * @param  value 输出值
+ * @retval 0 成功，-1 数据不完整
+ */
+int cmd_decode_vlq(const uint8_t** pp, const uint8_t* end, uint32_t* value)
+{
+    const uint8_t* p = *pp;
+    
+    if (p >= end) {
+        return -1;
+    }
+    
+    uint8_t c = *p++;
+    uint32_t v = c & 0x7F;
+    if ((c & 0x60) == 0x60) {
+        v |= (uint32_t)-0x20;
+    }
+    while (c & 0x80) {
+        if (p >= end) {
+            return -1;
+        }
+        c = *p++;
+        v = (v << 7) | (c & 0x7F);
+    }
+    
+    *pp = p;
+    *value = v;
+    return 0;
+}
+
 /**
  * @brief  从参数中读取 uint8
  * @param  args 参数结构
@@ -4,6 +4,17 @@
  * 
  * 复用自 Klipper src/command.h
  * 提供命令注册和分发功能
+ * 
+ * 二进制协议 (与 Klipper 相同的消息块格式):
+ * 
+ *   <len> <seq> <content ...> <crc16 高> <crc16 低> <0x7E>
+ * 
+ * - len 为整个消息块长度 (5..64)，seq = 0x10 | 序号 (4 位)
+ * - crc16 为 CCITT，覆盖 len..content
+ * - content 为若干条命令，每条为 VLQ 编码的命令 ID 加 VLQ 参数
+ * - MCU 对每个按序收到的消息块回复 ack (空内容，seq 为下一个期望序号)；
+ *   CRC 错误或序号不连续的块被丢弃并回复当前期望序号，
+ *   主机据此从该序号起重发 (重发窗口由主机维护)
  */
 
 #ifndef COMMAND_H
@@ -21,22 +32,85 @@ extern "C" {
 /* 命令 ID 类型 */
 typedef uint8_t cmd_id_t;
 
-/* 命令参数结构 */
+/* 最大命令 ID: 分发表按 ID 直接索引，ID 须在 0..CMD_ID_MAX 内连续分配 */
+#define CMD_ID_MAX              31
+
+/* 单条命令最多参数数 */
+#define CMD_MAX_ARGS            8
+
+/*
+ * 命令参数结构
+ * 
+ * data 直接指向接收行槽中的原始参数字节，不做拷贝，仅在处理函数
+ * 调用期间有效；values 为就地解码的结果。
+ */
 typedef struct {
-    const uint8_t* data;        /* 参数数据指针 */
+    const uint8_t* data;        /* 参数数据指针 (VLQ 编码) */
     size_t len;                 /* 参数数据长度 */
+    uint32_t values[CMD_MAX_ARGS];  /* 解码后的参数 (有符号参数按 int32_t 解释) */
+    uint8_t count;              /* 参数个数 */
 } cmd_args_t;
 
-/* 命令处理函数类型 */
-typedef void (*cmd_handler_fn_t)(const cmd_args_t* args);
+/* 处理函数返回值: 命令暂时无法执行 (如运动队列满)，稍后从该命令重试 */
+#define CMD_BUSY                1
+
+/**
+ * @brief  命令处理函数类型
+ * @retval 0 完成，CMD_BUSY 稍后重试，负数 执行失败
+ */
+typedef int (*cmd_handler_fn_t)(const cmd_args_t* args);
 
 /* 命令描述结构 */
 typedef struct {
     cmd_id_t id;                /* 命令 ID */
     const char* name;           /* 命令名称 */
     cmd_handler_fn_t handler;   /* 处理函数 */
+    uint8_t num_args;           /* VLQ 参数个数 */
 } cmd_desc_t;
 
+/* ========== 二进制协议 ========== */
+
+/* 消息块格式 */
+#define CMD_MESSAGE_MIN         5       /* 最短消息块 (空内容) */
+#define CMD_MESSAGE_MAX         64      /* 最长消息块 */
+#define CMD_MESSAGE_HEADER_SIZE 2       /* len + seq */
+#define CMD_MESSAGE_TRAILER_SIZE 3      /* crc16 + sync */
+#define CMD_MESSAGE_POS_LEN     0
+#define CMD_MESSAGE_POS_SEQ     1
+#define CMD_MESSAGE_DEST        0x10    /* seq 高 4 位固定值 */
+#define CMD_MESSAGE_SEQ_MASK    0x0F
+#define CMD_MESSAGE_SYNC        0x7E    /* 块结束 / 同步字节 */
+
+/* 主机 -> MCU 命令 ID */
+#define CMD_ID_GET_CLOCK            1   /* 无参数，回复 CMD_RSP_CLOCK */
+#define CMD_ID_RESET_STEP_CLOCK     2   /* oid clock */
+#define CMD_ID_SET_NEXT_STEP_DIR    3   /* oid dir */
+#define CMD_ID_QUEUE_STEP           4   /* oid interval count add */
+#define CMD_ID_STEPPER_GET_POSITION 5   /* oid，回复 CMD_RSP_STEPPER_POSITION */
+#define CMD_ID_GCODE_MOVE           6   /* mask x y z e f (见 gcode.h) */
+#define CMD_ID_GCODE_HOME           7   /* axes_mask */
+#define CMD_ID_TRACE_DUMP           8   /* freeze，回复 CMD_RSP_TRACE... CMD_RSP_TRACE_END */
+
+/* MCU -> 主机 响应 ID */
+#define CMD_RSP_CLOCK               1   /* clock */
+#define CMD_RSP_STEPPER_POSITION    2   /* oid position */
+#define CMD_RSP_ERROR               3   /* cmd_id code */
+#define CMD_RSP_TRACE               4   /* seq clock type_id_depth a b (见 trace.h) */
+#define CMD_RSP_TRACE_END           5   /* next_seq lost */
+
+/* command_process_frame() 返回值 */
+#define CMD_ERR_FRAME           (-3)    /* 长度/格式错误 */
+#define CMD_ERR_CRC             (-4)    /* CRC 错误 */
+#define CMD_ERR_SEQ             (-5)    /* 序号不连续 (重发或丢块) */
+
+/* 协议统计 */
+typedef struct {
+    uint32_t frames_ok;         /* 按序处理的消息块 */
+    uint32_t crc_errors;        /* CRC 错误 */
+    uint32_t seq_errors;        /* 序号不连续 */
+    uint32_t unknown_cmds;      /* 未知命令 */
+} cmd_stats_t;
+
 /* ========== 响应缓冲区 ========== */
 
 /* 响应缓冲区大小 */
@@ -52,19 +126,53 @@ int command_init(void);
 
 /**
  * @brief  注册命令处理函数
- * @param  desc 命令描述结构指针
- * @retval 0 成功，负数 失败
+ * @param  desc 命令描述结构指针 (只保存指针，须为静态存储)
+ * @retval 0 成功，-1 参数错误或 ID 超过 CMD_ID_MAX，-3 ID 已注册
  */
 int command_register(const cmd_desc_t* desc);
 
 /**
  * @brief  处理接收到的命令
- * @param  data 命令数据
+ * @param  data 命令数据 (一条或多条 VLQ 编码命令)
  * @param  len 数据长度
- * @retval 0 成功，负数 失败
+ * @retval 0 成功，CMD_BUSY 有命令需稍后重试，负数 失败
  */
 int command_process(const uint8_t* data, size_t len);
 
+/**
+ * @brief  处理一个完整的二进制消息块
+ * @param  frame 消息块 (含 len/seq 头和 crc/sync 尾)
+ * @param  len 消息块长度
+ * @retval 0 已处理并应答，CMD_BUSY 未处理完 (以相同消息块再次调用)，
+ *         CMD_ERR_* 已丢弃
+ * 
+ * 返回 CMD_BUSY 时记住未完成命令的位置，再次调用时从该命令继续，
+ * 已执行的命令不会重复执行。
+ */
+int command_process_frame(const uint8_t* frame, size_t len);
+
+/**
+ * @brief  处理串口中已接收的二进制消息块 (主循环调用)
+ * 
+ * 按顺序处理行槽中的消息块；遇到 CMD_BUSY 时保留该块，下次继续。
+ */
+void command_task(void);
+
+/**
+ * @brief  发送一条二进制响应消息
+ * @param  id 响应 ID (CMD_RSP_*)
+ * @param  values 参数 (VLQ 编码)
+ * @param  count 参数个数
+ * @retval 0 成功，负数 失败
+ */
+int command_send_message(cmd_id_t id, const uint32_t* values, uint8_t count);
+
+/**
+ * @brief  获取协议统计
+ * @param  stats 输出统计结构体指针
+ */
+void command_get_stats(cmd_stats_t* stats);
+
 /**
  * @brief  发送响应数据
  * @param  data 响应数据
@@ -114,6 +222,31 @@ uint32_t cmd_decode_u32(const cmd_args_t* args, size_t offset);
  */
 int32_t cmd_decode_i32(const cmd_args_t* args, size_t offset);
 
+/**
+ * @brief  CRC16-CCITT (Klipper 消息块校验)
+ * @param  buf 数据
+ * @param  len 数据长度
+ * @retval CRC 值
+ */
+uint16_t cmd_crc16(const uint8_t* buf, size_t len);
+
+/**
+ * @brief  VLQ 编码一个 32 位整数 (有符号值按补码传入)
+ * @param  buf 缓冲区 (至少 5 字节)
+ * @param  value 值
+ * @retval 写入的字节数 (1..5)
+ */
+size_t cmd_encode_vlq(uint8_t* buf, uint32_t value);
+
+/**
+ * @brief  VLQ 解码一个 32 位整数
+ * @param  pp 读指针，成功时前移
+ * @param  end 数据结尾
+ * @param  value 输出值
+ * @retval 0 成功，-1 数据不完整
+ */
+int cmd_decode_vlq(const uint8_t** pp, const uint8_t* end, uint32_t* value);
+
 /**
  * @brief  编码 uint8 到缓冲区
  * @param  buf 缓冲区
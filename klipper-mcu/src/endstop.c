@@ -4,11 +4,20 @@
  * 
  * 复用自 Klipper src/endstop.c
  * 提供限位开关状态检测和归零停止功能
+ * 
+ * 只在 endstop_home_start() 到 endstop_home_end() 的归零窗口内检测。
+ * CONFIG_ENDSTOP_EXTI 下由 EXTI 边沿中断检测触发，触发时刻取中断入口
+ * 的调度器时钟；采样定时器只作为兜底 (如归零开始时已处于触发状态)。
  */
 
 #include "endstop.h"
+#include "autoconf.h"
 #include "sched.h"
 #include "stepper.h"
+#include "board/gpio.h"
+#if CONFIG_ENDSTOP_EXTI
+#include "src/stm32/exti.h"
+#endif
 #include <stddef.h>
 
 /* ========== 私有类型定义 ========== */
@@ -20,6 +29,10 @@ typedef struct {
     uint8_t configured;         /* 是否已配置 */
     uint8_t triggered;          /* 触发状态 */
     uint8_t homing;             /* 归零模式 */
+    uint8_t use_exti;           /* 由 EXTI 边沿中断检测 */
+    volatile uint8_t pending;   /* 边沿待消抖确认 */
+    sched_time_t edge_clock;    /* 待确认边沿的时刻 */
+    sched_time_t trigger_clock; /* 触发时刻 */
     stepper_id_t stepper_id;    /* 关联的步进电机 */
     endstop_callback_fn_t callback; /* 触发回调 */
     void* callback_arg;         /* 回调参数 */
@@ -30,17 +43,19 @@ typedef struct {
 /* 限位开关状态数组 */
 static endstop_state_t s_endstops[ENDSTOP_COUNT];
 
-/* 采样定时器 */
+/* 采样定时器，仅在有限位开关处于归零模式时运行 */
 static sched_timer_t s_endstop_timer;
 
-/* 采样间隔（时钟周期） */
-#define ENDSTOP_SAMPLE_INTERVAL     1000    /* 约 1ms */
+/* 处于归零模式的限位开关 (位掩码) */
+static uint8_t s_homing_mask;
 
-/* ========== GPIO 操作 ========== */
+#if CONFIG_ENDSTOP_DEBOUNCE_TICKS
+/* 消抖确认定时器，所有限位开关共用 */
+static sched_timer_t s_debounce_timer;
+#endif
 
-/* TODO: 需要 HAL 层实现这些函数 */
-extern void gpio_in_setup(uint8_t pin, int8_t pull);
-extern uint8_t gpio_in_read(uint8_t pin);
+/* 采样间隔（时钟周期） */
+#define ENDSTOP_SAMPLE_INTERVAL     1000    /* 约 1ms */
 
 /* ========== 私有函数 ========== */
 
@@ -66,6 +81,60 @@ static int endstop_read_state(endstop_state_t* endstop)
     return value ? 1 : 0;
 }
 
+/**
+ * @brief  记录一次触发
+ * @param  endstop 限位开关状态指针
+ * @param  id 限位开关 ID
+ * @param  clock 触发时刻
+ * @note   由 endstop_activate() 或消抖确认定时器调用，先到者生效
+ */
+static void endstop_trigger(endstop_state_t* endstop, endstop_id_t id,
+                            sched_time_t clock)
+{
+    uint32_t flag = sched_irq_save();
+    
+    if (endstop->triggered) {
+        sched_irq_restore(flag);
+        return;
+    }
+    endstop->triggered = 1;
+    endstop->pending = 0;
+    endstop->trigger_clock = clock;
+    sched_irq_restore(flag);
+    
+    /* 如果在归零模式，停止关联的步进电机 */
+    if (endstop->homing) {
+        stepper_stop(endstop->stepper_id);
+    }
+    
+    /* 调用回调函数 */
+    if (endstop->callback != NULL) {
+        endstop->callback(id, endstop->callback_arg);
+    }
+}
+
+/**
+ * @brief  检测到限位开关有效: 启动消抖确认，未启用消抖时直接触发
+ * @param  endstop 限位开关状态指针
+ * @param  clock 检测到有效的时刻
+ * @note   EXTI 边沿与采样定时器都经过这里，消抖规则相同
+ */
+static void endstop_activate(endstop_state_t* endstop, sched_time_t clock)
+{
+#if CONFIG_ENDSTOP_DEBOUNCE_TICKS
+    endstop->edge_clock = clock;
+    endstop->pending = 1;
+    
+    /* 定时器已排队时其到期时间不晚于本次确认 */
+    if (s_debounce_timer.heap_pos == 0) {
+        s_debounce_timer.waketime = clock + CONFIG_ENDSTOP_DEBOUNCE_TICKS;
+        sched_add_timer(&s_debounce_timer);
+    }
+#else
+    endstop_trigger(endstop, (endstop_id_t)(endstop - s_endstops), clock);
+#endif
+}
+
 /**
  * @brief  限位开关采样定时器回调
  * @param  waketime 唤醒时间
@@ -76,11 +145,11 @@ static sched_time_t endstop_timer_callback(sched_time_t waketime)
     int i;
     int state;
     
-    /* 遍历所有限位开关 */
+    /* 遍历归零中的限位开关 */
     for (i = 0; i < ENDSTOP_COUNT; i++) {
         endstop_state_t* endstop = &s_endstops[i];
         
-        if (!endstop->configured) {
+        if (!endstop->configured || !endstop->homing || endstop->pending) {
             continue;
         }
         
@@ -89,17 +158,7 @@ static sched_time_t endstop_timer_callback(sched_time_t waketime)
         
         /* 检测触发 */
         if (state && !endstop->triggered) {
-            endstop->triggered = 1;
-            
-            /* 如果在归零模式，停止关联的步进电机 */
-            if (endstop->homing) {
-                stepper_stop(endstop->stepper_id);
-            }
-            
-            /* 调用回调函数 */
-            if (endstop->callback != NULL) {
-                endstop->callback((endstop_id_t)i, endstop->callback_arg);
-            }
+            endstop_activate(endstop, waketime);
         } else if (!state && endstop->triggered) {
             /* 限位开关释放 */
             endstop->triggered = 0;
@@ -110,6 +169,64 @@ static sched_time_t endstop_timer_callback(sched_time_t waketime)
     return waketime + ENDSTOP_SAMPLE_INTERVAL;
 }
 
+#if CONFIG_ENDSTOP_DEBOUNCE_TICKS
+/**
+ * @brief  消抖确认定时器回调
+ * @param  waketime 唤醒时间
+ * @retval 下一个待确认边沿的到期时间，没有则返回 0
+ * @note   到期时引脚仍有效才算触发，触发时刻取边沿时刻
+ */
+static sched_time_t endstop_debounce_callback(sched_time_t waketime)
+{
+    sched_time_t next = 0;
+    int have_next = 0;
+    int i;
+    
+    for (i = 0; i < ENDSTOP_COUNT; i++) {
+        endstop_state_t* endstop = &s_endstops[i];
+        sched_time_t due;
+        
+        if (!endstop->pending) {
+            continue;
+        }
+        
+        due = endstop->edge_clock + CONFIG_ENDSTOP_DEBOUNCE_TICKS;
+        if (sched_time_diff(due, waketime) > 0) {
+            if (!have_next || sched_time_diff(due, next) < 0) {
+                next = due;
+                have_next = 1;
+            }
+            continue;
+        }
+        
+        if (endstop->homing && endstop_read_state(endstop)) {
+            endstop_trigger(endstop, (endstop_id_t)i, endstop->edge_clock);
+        } else {
+            endstop->pending = 0;   /* 毛刺，丢弃 */
+        }
+    }
+    
+    return have_next ? next : 0;
+}
+#endif
+
+#if CONFIG_ENDSTOP_EXTI
+/**
+ * @brief  EXTI 边沿中断处理 (中断上下文)
+ * @param  arg 限位开关状态指针
+ * @param  time 中断入口处的调度器时钟
+ */
+static void endstop_exti_handler(void* arg, uint32_t time)
+{
+    endstop_state_t* endstop = (endstop_state_t*)arg;
+    
+    if (!endstop->homing || endstop->triggered || endstop->pending) {
+        return;
+    }
+    endstop_activate(endstop, time);
+}
+#endif
+
 /* ========== 公共接口实现 ========== */
 
 /**
@@ -127,18 +244,26 @@ int endstop_init(void)
         s_endstops[i].configured = 0;
         s_endstops[i].triggered = 0;
         s_endstops[i].homing = 0;
+        s_endstops[i].use_exti = 0;
+        s_endstops[i].pending = 0;
+        s_endstops[i].edge_clock = 0;
+        s_endstops[i].trigger_clock = 0;
         s_endstops[i].stepper_id = STEPPER_X;
         s_endstops[i].callback = NULL;
         s_endstops[i].callback_arg = NULL;
     }
     
-    /* 初始化采样定时器 */
+    /* 采样定时器在 endstop_home_start() 时才启动 */
+    sched_del_timer(&s_endstop_timer);
     s_endstop_timer.func = endstop_timer_callback;
-    s_endstop_timer.waketime = sched_get_time() + ENDSTOP_SAMPLE_INTERVAL;
-    s_endstop_timer.next = NULL;
+    s_endstop_timer.heap_pos = 0;
+    s_homing_mask = 0;
     
-    /* 启动采样定时器 */
-    sched_add_timer(&s_endstop_timer);
+#if CONFIG_ENDSTOP_DEBOUNCE_TICKS
+    sched_del_timer(&s_debounce_timer);
+    s_debounce_timer.func = endstop_debounce_callback;
+    s_debounce_timer.heap_pos = 0;
+#endif
     
     return 0;
 }
@@ -164,7 +289,15 @@ int endstop_config(endstop_id_t id, const endstop_config_t* config)
     endstop->configured = 1;
     
     /* 配置 GPIO 为输入，带上拉 */
-    gpio_in_setup(config->pin, 1);  /* 1 = 上拉 */
+    gpio_in_setup(config->pin, GPIO_PULL_UP);
+    
+#if CONFIG_ENDSTOP_EXTI
+    /* 有效电平的起始边沿；EXTI 线被其他端口占用时退回定时采样 */
+    endstop->use_exti = (exti_setup(config->pin,
+                                    config->invert ? EXTI_EDGE_FALLING
+                                                   : EXTI_EDGE_RISING,
+                                    endstop_exti_handler, endstop) == 0);
+#endif
     
     return 0;
 }
@@ -201,6 +334,20 @@ int endstop_is_triggered(endstop_id_t id)
     return s_endstops[id].triggered;
 }
 
+/**
+ * @brief  获取最近一次触发的时刻
+ * @param  id 限位开关 ID
+ * @retval 检测到触发的采样时刻 (系统时钟)
+ */
+sched_time_t endstop_get_trigger_clock(endstop_id_t id)
+{
+    if (id >= ENDSTOP_COUNT) {
+        return 0;
+    }
+    
+    return s_endstops[id].trigger_clock;
+}
+
 /**
  * @brief  启用归零模式
  * @param  id 限位开关 ID
@@ -208,12 +355,29 @@ int endstop_is_triggered(endstop_id_t id)
  */
 void endstop_home_start(endstop_id_t id)
 {
+    endstop_state_t* endstop;
+    
     if (id >= ENDSTOP_COUNT) {
         return;
     }
     
-    s_endstops[id].homing = 1;
-    s_endstops[id].triggered = 0;
+    endstop = &s_endstops[id];
+    endstop->triggered = 0;
+    endstop->pending = 0;
+    endstop->homing = 1;
+    
+#if CONFIG_ENDSTOP_EXTI
+    if (endstop->use_exti) {
+        exti_enable(endstop->pin);
+    }
+#endif
+    
+    /* 第一个进入归零模式的限位开关启动采样定时器 */
+    if (s_homing_mask == 0) {
+        s_endstop_timer.waketime = sched_get_time() + ENDSTOP_SAMPLE_INTERVAL;
+        sched_add_timer(&s_endstop_timer);
+    }
+    s_homing_mask |= (uint8_t)(1 << id);
 }
 
 /**
@@ -222,11 +386,27 @@ void endstop_home_start(endstop_id_t id)
  */
 void endstop_home_end(endstop_id_t id)
 {
+    endstop_state_t* endstop;
+    
     if (id >= ENDSTOP_COUNT) {
         return;
     }
     
-    s_endstops[id].homing = 0;
+    endstop = &s_endstops[id];
+    endstop->homing = 0;
+    endstop->pending = 0;
+    
+#if CONFIG_ENDSTOP_EXTI
+    if (endstop->use_exti) {
+        exti_disable(endstop->pin);
+    }
+#endif
+    
+    /* 最后一个退出归零模式的限位开关停止采样定时器 */
+    s_homing_mask &= (uint8_t)~(1 << id);
+    if (s_homing_mask == 0) {
+        sched_del_timer(&s_endstop_timer);
+    }
 }
 
 /**
@@ -15,6 +15,7 @@ extern "C" {
 
 #include <stdint.h>
 #include "stepper.h"
+#include "sched.h"
 
 /* ========== 限位开关 ID ========== */
 
@@ -69,13 +70,24 @@ int endstop_get_state(endstop_id_t id);
  * @brief  检查限位开关是否已触发
  * @param  id 限位开关 ID
  * @retval 1 已触发，0 未触发
+ * @note   只在归零窗口内更新；其他时候读取实时电平请用 endstop_get_state()
  */
 int endstop_is_triggered(endstop_id_t id);
 
+/**
+ * @brief  获取最近一次触发的时刻
+ * @param  id 限位开关 ID
+ * @retval 触发时刻 (系统时钟)
+ * @note   EXTI 模式下为边沿中断入口时刻 (开启消抖时仍取边沿时刻)，
+ *         定时采样时为采样时刻；早于触发回调锁存，供回调中读取
+ */
+sched_time_t endstop_get_trigger_clock(endstop_id_t id);
+
 /**
  * @brief  启用归零模式
  * @param  id 限位开关 ID
- * @note   归零模式下，触发时自动停止关联的步进电机
+ * @note   归零模式下，触发时自动停止关联的步进电机；同时打开 EXTI
+ *         中断并启动兜底采样定时器，两者只在归零窗口内运行
  */
 void endstop_home_start(endstop_id_t id);
 
@@ -0,0 +1,323 @@
+/**
+ * @file    mcu_link.c
+ * @brief   从 MCU 链路与时钟同步实现
+ *
+ * 移植自 klippy/clocksync.py 和 klippy/serialhdl.py 的时钟同步部分
+ *
+ * 每条链路同一时刻最多一个未回复的 get_clock: 回复到达时以
+ * (发送时刻, 接收时刻, 从 MCU 时钟) 作为一个样本送入 clocksync。
+ * 启动阶段以较短周期采样，达到 MCU_LINK_STARTUP_SAMPLES 后改为
+ * MCU_LINK_SYNC_PERIOD。
+ */
+
+#include "mcu_link.h"
+#include "chelper/clocksync.h"
+#include <string.h>
+
+/* ========== 私有类型定义 ========== */
+
+/* 链路状态 */
+typedef struct {
+    mcu_link_send_fn_t send;    /* 发送函数，NULL 表示未连接 */
+    uint8_t tx_seq;             /* 下一个发出的消息块序号 (含 CMD_MESSAGE_DEST) */
+    uint8_t ack_seq;            /* 从 MCU 最近 ack 的期望序号 */
+    uint8_t pending;            /* 有未回复的 get_clock */
+    sched_time_t sent_time;     /* 未回复 get_clock 的发送时刻 */
+    sched_time_t next_query;    /* 下一次 get_clock 的时刻 */
+    struct clocksync cs;        /* 时钟估计 */
+    mcu_link_stats_t stats;     /* 统计 */
+} mcu_link_state_t;
+
+/* ========== 私有变量 ========== */
+
+static mcu_link_state_t s_links[MCU_LINK_MAX];
+
+/* ========== 私有函数 ========== */
+
+/**
+ * @brief  按链路号取链路状态
+ * @param  link 链路号
+ * @retval 已连接链路的状态指针，否则 NULL
+ */
+static mcu_link_state_t* link_get(uint8_t link)
+{
+    if (link >= MCU_LINK_MAX || s_links[link].send == NULL) {
+        return NULL;
+    }
+    return &s_links[link];
+}
+
+/**
+ * @brief  封装并发送一个只含一条命令的消息块
+ * @param  l      链路状态
+ * @param  id     命令 ID
+ * @param  values 参数
+ * @param  count  参数个数
+ * @retval 0 成功，负数 失败
+ */
+static int link_send_block(mcu_link_state_t* l, cmd_id_t id,
+                           const uint32_t* values, uint8_t count)
+{
+    /* (1 + CMD_MAX_ARGS) 个 VLQ 最多 45 字节，不超过单个消息块 */
+    uint8_t buf[CMD_MESSAGE_MAX];
+    uint8_t* p = buf + CMD_MESSAGE_HEADER_SIZE;
+
+    p += cmd_encode_vlq(p, id);
+    for (uint8_t i = 0; i < count; i++) {
+        p += cmd_encode_vlq(p, values[i]);
+    }
+
+    size_t len = (size_t)(p - buf) + CMD_MESSAGE_TRAILER_SIZE;
+    buf[CMD_MESSAGE_POS_LEN] = (uint8_t)len;
+    buf[CMD_MESSAGE_POS_SEQ] = l->tx_seq;
+
+    uint16_t crc = cmd_crc16(buf, len - CMD_MESSAGE_TRAILER_SIZE);
+    buf[len - 3] = (uint8_t)(crc >> 8);
+    buf[len - 2] = (uint8_t)(crc & 0xFF);
+    buf[len - 1] = CMD_MESSAGE_SYNC;
+
+    int ret = l->send(buf, len);
+    if (ret == 0) {
+        l->tx_seq = CMD_MESSAGE_DEST | ((l->tx_seq + 1) & CMD_MESSAGE_SEQ_MASK);
+    }
+    return ret;
+}
+
+/**
+ * @brief  发送 get_clock 并记录发送时刻
+ * @param  l   链路状态
+ * @param  now 当前时钟
+ */
+static void link_query_clock(mcu_link_state_t* l, sched_time_t now)
+{
+    sched_time_t period = (l->cs.samples < MCU_LINK_STARTUP_SAMPLES)
+                          ? MCU_LINK_STARTUP_PERIOD : MCU_LINK_SYNC_PERIOD;
+    l->next_query = now + period;
+
+    /* 发送时刻尽量贴近写入链路的时刻 */
+    sched_time_t sent = sched_get_time();
+    if (link_send_block(l, CMD_ID_GET_CLOCK, NULL, 0) != 0) {
+        return;
+    }
+    l->sent_time = sent;
+    l->pending = 1;
+    l->stats.queries++;
+}
+
+/* ========== 公共接口实现 ========== */
+
+/**
+ * @brief  初始化所有链路
+ */
+void mcu_link_init(void)
+{
+    memset(s_links, 0, sizeof(s_links));
+}
+
+/**
+ * @brief  连接一条从 MCU 链路
+ * @param  link        链路号
+ * @param  send        发送函数
+ * @param  remote_freq 从 MCU 时钟标称频率 (Hz)
+ * @retval 0 成功，-1 参数错误
+ */
+int mcu_link_attach(uint8_t link, mcu_link_send_fn_t send, uint32_t remote_freq)
+{
+    if (link >= MCU_LINK_MAX || send == NULL || remote_freq == 0) {
+        return -1;
+    }
+
+    mcu_link_state_t* l = &s_links[link];
+    memset(l, 0, sizeof(*l));
+    clocksync_init(&l->cs, (double)CONFIG_STEP_TIMER_FREQ, (double)remote_freq);
+    l->tx_seq = CMD_MESSAGE_DEST;
+    l->ack_seq = CMD_MESSAGE_DEST;
+    l->next_query = sched_get_time();
+    l->send = send;
+    return 0;
+}
+
+/**
+ * @brief  断开链路
+ * @param  link 链路号
+ */
+void mcu_link_detach(uint8_t link)
+{
+    if (link < MCU_LINK_MAX) {
+        memset(&s_links[link], 0, sizeof(s_links[link]));
+    }
+}
+
+/**
+ * @brief  链路任务: 按周期发送 get_clock、检查回复超时
+ */
+void mcu_link_task(void)
+{
+    for (uint8_t i = 0; i < MCU_LINK_MAX; i++) {
+        mcu_link_state_t* l = &s_links[i];
+        if (l->send == NULL) {
+            continue;
+        }
+
+        sched_time_t now = sched_get_time();
+        if (l->pending) {
+            if (sched_time_diff(now, l->sent_time) < (int32_t)MCU_LINK_REPLY_TIMEOUT) {
+                continue;
+            }
+            l->pending = 0;
+            l->stats.timeouts++;
+        }
+        if (sched_time_diff(now, l->next_query) >= 0) {
+            link_query_clock(l, now);
+        }
+    }
+}
+
+/**
+ * @brief  处理从 MCU 发来的一个完整消息块
+ * @param  link    链路号
+ * @param  frame   消息块
+ * @param  len     消息块长度
+ * @param  rx_time 接收完成时的本机时钟
+ * @retval 0 已处理，负数 消息块无效
+ */
+int mcu_link_receive(uint8_t link, const uint8_t* frame, size_t len,
+                     sched_time_t rx_time)
+{
+    mcu_link_state_t* l = link_get(link);
+    if (l == NULL || frame == NULL) {
+        return -1;
+    }
+
+    if (len < CMD_MESSAGE_MIN || len > CMD_MESSAGE_MAX
+        || frame[CMD_MESSAGE_POS_LEN] != len
+        || frame[len - 1] != CMD_MESSAGE_SYNC
+        || (frame[CMD_MESSAGE_POS_SEQ] & ~CMD_MESSAGE_SEQ_MASK) != CMD_MESSAGE_DEST) {
+        l->stats.frame_errors++;
+        return CMD_ERR_FRAME;
+    }
+    uint16_t crc = cmd_crc16(frame, len - CMD_MESSAGE_TRAILER_SIZE);
+    if (frame[len - 3] != (uint8_t)(crc >> 8) || frame[len - 2] != (uint8_t)(crc & 0xFF)) {
+        l->stats.frame_errors++;
+        return CMD_ERR_CRC;
+    }
+
+    const uint8_t* p = frame + CMD_MESSAGE_HEADER_SIZE;
+    const uint8_t* end = frame + len - CMD_MESSAGE_TRAILER_SIZE;
+
+    /*
+     * 空内容为 ack，seq 为从 MCU 期望的下一个序号。期望序号没有前进
+     * 而本机已发出更多消息块，说明从 MCU 丢弃了这些块: 不重发，
+     * 从其期望序号继续
+     */
+    if (p == end) {
+        uint8_t seq = frame[CMD_MESSAGE_POS_SEQ];
+        if (seq == l->ack_seq && l->tx_seq != seq) {
+            l->stats.seq_errors++;
+            l->tx_seq = seq;
+        }
+        l->ack_seq = seq;
+        return 0;
+    }
+
+    /* 从 MCU 每条响应单独成块 (command_send_message) */
+    uint32_t id, value;
+    if (cmd_decode_vlq(&p, end, &id) != 0) {
+        l->stats.frame_errors++;
+        return CMD_ERR_FRAME;
+    }
+    if (id == CMD_RSP_CLOCK) {
+        if (!l->pending || cmd_decode_vlq(&p, end, &value) != 0) {
+            return 0;
+        }
+        l->pending = 0;
+        if (clocksync_add_sample(&l->cs, l->sent_time, rx_time, value) == 0) {
+            l->stats.samples++;
+        } else {
+            l->stats.outliers++;
+        }
+    } else if (id == CMD_RSP_ERROR) {
+        l->stats.remote_errors++;
+    }
+    return 0;
+}
+
+/**
+ * @brief  向从 MCU 发送一条命令
+ * @param  link   链路号
+ * @param  id     命令 ID
+ * @param  values 参数
+ * @param  count  参数个数
+ * @retval 0 成功，负数 失败
+ */
+int mcu_link_send_command(uint8_t link, cmd_id_t id, const uint32_t* values,
+                          uint8_t count)
+{
+    mcu_link_state_t* l = link_get(link);
+    if (l == NULL || count > CMD_MAX_ARGS || (values == NULL && count > 0)) {
+        return -1;
+    }
+    return link_send_block(l, id, values, count);
+}
+
+/**
+ * @brief  检查链路是否已完成启动阶段的时钟同步
+ * @param  link 链路号
+ * @retval 1 已同步，0 未同步
+ */
+int mcu_link_is_synced(uint8_t link)
+{
+    mcu_link_state_t* l = link_get(link);
+    return l != NULL && l->cs.samples >= MCU_LINK_STARTUP_SAMPLES;
+}
+
+/**
+ * @brief  本机时钟换算为从 MCU 时钟
+ * @param  link   链路号
+ * @param  local  本机时钟
+ * @param  remote 输出从 MCU 时钟
+ * @retval 0 成功，-1 链路无时钟估计
+ */
+int mcu_link_local_to_remote(uint8_t link, sched_time_t local, uint32_t* remote)
+{
+    mcu_link_state_t* l = link_get(link);
+    if (l == NULL || !clocksync_is_valid(&l->cs)) {
+        return -1;
+    }
+    *remote = clocksync_local_to_remote(&l->cs, local);
+    return 0;
+}
+
+/**
+ * @brief  从 MCU 时钟换算为本机时钟
+ * @param  link   链路号
+ * @param  remote 从 MCU 时钟
+ * @param  local  输出本机时钟
+ * @retval 0 成功，-1 链路无时钟估计
+ */
+int mcu_link_remote_to_local(uint8_t link, uint32_t remote, sched_time_t* local)
+{
+    mcu_link_state_t* l = link_get(link);
+    if (l == NULL || !clocksync_is_valid(&l->cs)) {
+        return -1;
+    }
+    *local = clocksync_remote_to_local(&l->cs, remote);
+    return 0;
+}
+
+/**
+ * @brief  获取链路统计
+ * @param  link  链路号
+ * @param  stats 输出统计结构体指针
+ */
+void mcu_link_get_stats(uint8_t link, mcu_link_stats_t* stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+    if (link >= MCU_LINK_MAX) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    *stats = s_links[link].stats;
+}
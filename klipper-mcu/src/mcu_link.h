@@ -0,0 +1,156 @@
+/**
+ * @file    mcu_link.h
+ * @brief   从 MCU 链路与时钟同步接口
+ *
+ * 移植自 klippy/clocksync.py 和 klippy/serialhdl.py 的时钟同步部分
+ *
+ * 本机作为主控，通过一条二进制协议链路 (见 command.h) 驱动运行同一
+ * 固件的从 MCU (如工具头板)。链路周期性发送 get_clock 并记录本机
+ * 发送/接收时刻，由 chelper/clocksync 回归出从 MCU 时钟的偏移和漂移，
+ * 从而把本机时钟 (即 print_time 的时间基准) 换算到从 MCU 时钟:
+ *
+ *     uint32_t remote;
+ *     mcu_link_local_to_remote(link, toolhead_print_time_to_clock(t), &remote);
+ *
+ * 链路的物理传输由板级代码提供: 注册发送函数，并在收到完整消息块时
+ * 调用 mcu_link_receive() (接收时刻应在接收中断中取得)。
+ *
+ * 链路不做重发: 从 MCU 丢弃消息块 (ack 的期望序号不前进) 时从其期望
+ * 序号继续，并计入 seq_errors。get_clock 本身可重复，丢失只少一个样本。
+ */
+
+#ifndef MCU_LINK_H
+#define MCU_LINK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "autoconf.h"
+#include "command.h"
+#include "sched.h"
+
+/* ========== 链路配置 ========== */
+
+/* 从 MCU 链路数 */
+#define MCU_LINK_MAX            CONFIG_MCU_LINK_COUNT
+
+/* 稳定后的同步周期 (时钟)，略短于 1 秒避免与秒级任务同相 */
+#define MCU_LINK_SYNC_PERIOD    ((sched_time_t)(CONFIG_STEP_TIMER_FREQ / 1000 * 984))
+
+/* 启动阶段的同步周期 (时钟) */
+#define MCU_LINK_STARTUP_PERIOD ((sched_time_t)(CONFIG_STEP_TIMER_FREQ / 20))
+
+/* 启动阶段样本数，达到后视为已同步 */
+#define MCU_LINK_STARTUP_SAMPLES 8
+
+/* get_clock 回复超时 (时钟) */
+#define MCU_LINK_REPLY_TIMEOUT  ((sched_time_t)(CONFIG_STEP_TIMER_FREQ / 10))
+
+/**
+ * @brief  链路发送函数类型
+ * @param  data 完整消息块
+ * @param  len  消息块长度
+ * @retval 0 成功，负数 失败
+ */
+typedef int (*mcu_link_send_fn_t)(const uint8_t* data, size_t len);
+
+/* 链路统计 */
+typedef struct {
+    uint32_t queries;           /* 已发送的 get_clock */
+    uint32_t samples;           /* 被时钟估计采用的回复 */
+    uint32_t outliers;          /* 被当作离群值丢弃的回复 */
+    uint32_t timeouts;          /* 超时未回复的 get_clock */
+    uint32_t frame_errors;      /* 长度/CRC 错误的消息块 */
+    uint32_t seq_errors;        /* ack 序号不一致 */
+    uint32_t remote_errors;     /* 从 MCU 回复的 CMD_RSP_ERROR */
+} mcu_link_stats_t;
+
+/* ========== 链路接口 ========== */
+
+/**
+ * @brief  初始化所有链路 (均未连接)
+ */
+void mcu_link_init(void);
+
+/**
+ * @brief  连接一条从 MCU 链路并开始时钟同步
+ * @param  link        链路号 (0..MCU_LINK_MAX-1)
+ * @param  send        发送函数
+ * @param  remote_freq 从 MCU 调度器时钟标称频率 (Hz)
+ * @retval 0 成功，-1 参数错误
+ */
+int mcu_link_attach(uint8_t link, mcu_link_send_fn_t send, uint32_t remote_freq);
+
+/**
+ * @brief  断开链路，停止同步并丢弃时钟估计
+ * @param  link 链路号
+ */
+void mcu_link_detach(uint8_t link);
+
+/**
+ * @brief  链路任务 (主循环调用): 按周期发送 get_clock、检查回复超时
+ */
+void mcu_link_task(void);
+
+/**
+ * @brief  处理从 MCU 发来的一个完整消息块
+ * @param  link    链路号
+ * @param  frame   消息块 (含 len/seq 头和 crc/sync 尾)
+ * @param  len     消息块长度
+ * @param  rx_time 消息块接收完成时的本机时钟
+ * @retval 0 已处理，负数 消息块无效
+ */
+int mcu_link_receive(uint8_t link, const uint8_t* frame, size_t len,
+                     sched_time_t rx_time);
+
+/**
+ * @brief  向从 MCU 发送一条命令 (单独成块)
+ * @param  link   链路号
+ * @param  id     命令 ID (CMD_ID_*)
+ * @param  values 参数
+ * @param  count  参数个数
+ * @retval 0 成功，负数 失败
+ */
+int mcu_link_send_command(uint8_t link, cmd_id_t id, const uint32_t* values,
+                          uint8_t count);
+
+/**
+ * @brief  检查链路是否已完成启动阶段的时钟同步
+ * @param  link 链路号
+ * @retval 1 已同步，0 未同步
+ */
+int mcu_link_is_synced(uint8_t link);
+
+/**
+ * @brief  本机时钟换算为从 MCU 时钟
+ * @param  link   链路号
+ * @param  local  本机时钟
+ * @param  remote 输出从 MCU 时钟
+ * @retval 0 成功，-1 链路无时钟估计
+ */
+int mcu_link_local_to_remote(uint8_t link, sched_time_t local, uint32_t* remote);
+
+/**
+ * @brief  从 MCU 时钟换算为本机时钟
+ * @param  link   链路号
+ * @param  remote 从 MCU 时钟
+ * @param  local  输出本机时钟
+ * @retval 0 成功，-1 链路无时钟估计
+ */
+int mcu_link_remote_to_local(uint8_t link, uint32_t remote, sched_time_t* local);
+
+/**
+ * @brief  获取链路统计
+ * @param  link  链路号
+ * @param  stats 输出统计结构体指针
+ */
+void mcu_link_get_stats(uint8_t link, mcu_link_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MCU_LINK_H */
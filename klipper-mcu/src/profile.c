@@ -0,0 +1,140 @@
+/**
+ * @file    profile.c
+ * @brief   DWT 周期计数器性能剖析实现
+ *
+ * 统计在中断中更新，读取和清零在关中断下完成，保证快照一致。
+ * CONFIG_PROFILE 关闭时本文件为空。
+ */
+
+#include "profile.h"
+
+#if CONFIG_PROFILE
+
+#include "sched.h"
+#include <string.h>
+
+/* ========== 私有宏 ========== */
+
+#define DEMCR                   (*(volatile uint32_t*)0xE000EDFC)
+#define DEMCR_TRCENA            (1U << 24)
+#define DWT_CTRL                (*(volatile uint32_t*)0xE0001000)
+#define DWT_CTRL_CYCCNTENA      (1U << 0)
+
+/* ========== 私有变量 ========== */
+
+static profile_stats_t s_stats[PROFILE_SITE_COUNT];
+static profile_lateness_t s_lateness;
+
+static const char* const s_site_names[PROFILE_SITE_COUNT] = {
+    [PROFILE_STEPPER_EVENT]  = "stepper_event",
+    [PROFILE_SERIAL_IRQ]     = "serial_irq",
+    [PROFILE_SCHED_DISPATCH] = "sched_dispatch",
+    [PROFILE_LOOKAHEAD]      = "lookahead_plan",
+};
+
+/* ========== 剖析接口实现 ========== */
+
+/**
+ * @brief  初始化剖析: 使能 DWT 周期计数器并清零统计
+ * @note   sched_init() 在 CONFIG_SCHED_IRQ_STATS 下也会使能 DWT，
+ *         此处不清零 CYCCNT，避免打断正在进行的关中断计时
+ */
+void profile_init(void)
+{
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+    profile_reset();
+}
+
+/**
+ * @brief  清零所有统计
+ */
+void profile_reset(void)
+{
+    uint32_t flag = sched_irq_save();
+    memset(s_stats, 0, sizeof(s_stats));
+    memset(&s_lateness, 0, sizeof(s_lateness));
+    sched_irq_restore(flag);
+}
+
+/**
+ * @brief  记录一次测点耗时
+ * @param  site   测点
+ * @param  cycles 耗时 (CPU 周期)
+ */
+void profile_record(profile_site_t site, uint32_t cycles)
+{
+    if ((unsigned)site >= PROFILE_SITE_COUNT) {
+        return;
+    }
+
+    uint32_t flag = sched_irq_save();
+    profile_stats_t* s = &s_stats[site];
+    if (s->count == 0 || cycles < s->min) {
+        s->min = cycles;
+    }
+    if (cycles > s->max) {
+        s->max = cycles;
+    }
+    s->total += cycles;
+    s->count++;
+    sched_irq_restore(flag);
+}
+
+/**
+ * @brief  记录一次定时器回调延迟
+ * @param  ticks 延迟 (定时器时钟)
+ */
+void profile_record_lateness(uint32_t ticks)
+{
+    uint32_t flag = sched_irq_save();
+    if (ticks > s_lateness.max) {
+        s_lateness.max = ticks;
+    }
+    s_lateness.total += ticks;
+    s_lateness.count++;
+    sched_irq_restore(flag);
+}
+
+/**
+ * @brief  读取测点统计快照
+ * @param  site  测点
+ * @param  stats 输出统计
+ */
+void profile_get(profile_site_t site, profile_stats_t* stats)
+{
+    if ((unsigned)site >= PROFILE_SITE_COUNT) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    uint32_t flag = sched_irq_save();
+    *stats = s_stats[site];
+    sched_irq_restore(flag);
+}
+
+/**
+ * @brief  读取调度器延迟统计快照
+ * @param  lateness 输出统计
+ */
+void profile_get_lateness(profile_lateness_t* lateness)
+{
+    uint32_t flag = sched_irq_save();
+    *lateness = s_lateness;
+    sched_irq_restore(flag);
+}
+
+/**
+ * @brief  获取测点名称
+ * @param  site 测点
+ * @retval 名称字符串
+ */
+const char* profile_site_name(profile_site_t site)
+{
+    if ((unsigned)site >= PROFILE_SITE_COUNT) {
+        return "?";
+    }
+    return s_site_names[site];
+}
+
+#endif /* CONFIG_PROFILE */
@@ -0,0 +1,145 @@
+/**
+ * @file    profile.h
+ * @brief   DWT 周期计数器性能剖析接口
+ *
+ * 在中断和热点函数的入口/出口读取 Cortex-M4 DWT_CYCCNT，按测点累计
+ * 次数、最小/最大/平均 CPU 周期，并记录调度器定时器的最大延迟。
+ *
+ * 由 CONFIG_PROFILE 控制 (make PROFILE=1 或 DEBUG 构建开启)；关闭时
+ * profile_start()/profile_stop() 为空内联函数，不访问 DWT，零开销。
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "autoconf.h"
+
+/* ========== 测点 ========== */
+
+typedef enum {
+    PROFILE_STEPPER_EVENT = 0,  /* 步进定时器回调 stepper_event() */
+    PROFILE_SERIAL_IRQ,         /* 串口中断 serial_irq_handler() */
+    PROFILE_SCHED_DISPATCH,     /* 定时器分发 sched_timer_dispatch() */
+    PROFILE_LOOKAHEAD,          /* 前瞻规划 lookahead_plan() */
+    PROFILE_SITE_COUNT
+} profile_site_t;
+
+/* 单个测点统计 (CPU 周期) */
+typedef struct {
+    uint32_t count;             /* 采样次数 */
+    uint32_t min;               /* 最短耗时，count 为 0 时无意义 */
+    uint32_t max;               /* 最长耗时 */
+    uint64_t total;             /* 累计耗时，avg = total / count */
+} profile_stats_t;
+
+/* 调度器延迟统计 (定时器时钟，实际执行时刻 - 预定唤醒时刻) */
+typedef struct {
+    uint32_t count;             /* 迟到的回调次数 */
+    uint32_t max;               /* 最大延迟 */
+    uint64_t total;             /* 累计延迟 */
+} profile_lateness_t;
+
+/* ========== 剖析接口 ========== */
+
+#if CONFIG_PROFILE
+
+/* DWT 周期计数器 (Cortex-M4 调试单元) */
+#define PROFILE_DWT_CYCCNT      (*(volatile uint32_t*)0xE0001004)
+
+/**
+ * @brief  记录一次测点耗时
+ * @param  site   测点
+ * @param  cycles 耗时 (CPU 周期)
+ * @note   可在中断中调用
+ */
+void profile_record(profile_site_t site, uint32_t cycles);
+
+/**
+ * @brief  记录一次定时器回调延迟
+ * @param  ticks 延迟 (定时器时钟)
+ */
+void profile_record_lateness(uint32_t ticks);
+
+/**
+ * @brief  初始化剖析: 使能 DWT 周期计数器并清零统计
+ */
+void profile_init(void);
+
+/**
+ * @brief  清零所有统计
+ */
+void profile_reset(void);
+
+/**
+ * @brief  读取测点统计快照
+ * @param  site  测点
+ * @param  stats 输出统计
+ */
+void profile_get(profile_site_t site, profile_stats_t* stats);
+
+/**
+ * @brief  读取调度器延迟统计快照
+ * @param  lateness 输出统计
+ */
+void profile_get_lateness(profile_lateness_t* lateness);
+
+/**
+ * @brief  获取测点名称
+ * @param  site 测点
+ * @retval 名称字符串
+ */
+const char* profile_site_name(profile_site_t site);
+
+/**
+ * @brief  测点计时开始
+ * @retval 当前 DWT 周期计数
+ */
+static inline uint32_t profile_start(void)
+{
+    return PROFILE_DWT_CYCCNT;
+}
+
+/**
+ * @brief  测点计时结束并记录
+ * @param  site  测点
+ * @param  start profile_start() 的返回值
+ */
+static inline void profile_stop(profile_site_t site, uint32_t start)
+{
+    profile_record(site, PROFILE_DWT_CYCCNT - start);
+}
+
+#else
+
+static inline uint32_t profile_start(void)
+{
+    return 0;
+}
+
+static inline void profile_stop(profile_site_t site, uint32_t start)
+{
+    (void)site;
+    (void)start;
+}
+
+static inline void profile_record_lateness(uint32_t ticks)
+{
+    (void)ticks;
+}
+
+static inline void profile_init(void)
+{
+}
+
+#endif /* CONFIG_PROFILE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROFILE_H */
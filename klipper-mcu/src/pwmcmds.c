@@ -4,6 +4,10 @@
  * 
  * 复用自 Klipper src/pwmcmds.c
  * 提供 PWM 输出控制功能（用于加热器和风扇）
+ * 
+ * 配置为 use_hardware 且引脚有定时器通道时由 HAL 硬件 PWM 输出，
+ * 占空比修改只写一次比较寄存器；其余引脚退回软件 PWM 定时器。
+ * 软件 PWM 定时器只遍历已启用的软件通道列表，未用通道不增加每拍开销。
  */
 
 #include "pwmcmds.h"
@@ -21,6 +25,7 @@ typedef struct {
     uint16_t max_value;         /* 最大值（分辨率） */
     uint32_t cycle_time;        /* PWM 周期（时钟周期） */
     uint8_t invert;             /* 输出反相 */
+    uint8_t hardware;           /* 由定时器硬件输出 */
 } pwm_state_t;
 
 /* ========== 私有变量 ========== */
@@ -34,6 +39,13 @@ static sched_timer_t s_pwm_timer;
 /* 软件 PWM 状态 */
 static uint8_t s_soft_pwm_enabled = 0;
 
+/* 已启用的软件 PWM 通道，由 pwm_soft_list_update() 维护 */
+static uint8_t s_soft_active[PWM_CHANNEL_COUNT];
+static uint8_t s_soft_active_count = 0;
+
+/* 模块已初始化 (加热器和风扇都会调用 pwm_init) */
+static uint8_t s_pwm_initialized = 0;
+
 /* 默认 PWM 周期（约 1ms，1kHz） */
 #define PWM_DEFAULT_CYCLE_TIME  1000
 
@@ -46,11 +58,51 @@ static uint8_t s_soft_pwm_enabled = 0;
 /* TODO: 需要 HAL 层实现这些函数 */
 extern void gpio_out_setup(uint8_t pin, uint8_t value);
 extern void gpio_out_write(uint8_t pin, uint8_t value);
-extern void pwm_setup(uint8_t pin, uint32_t cycle_time, uint8_t value);
+/* 硬件 PWM (src/stm32/hard_pwm.c)，引脚无定时器通道时 pwm_setup 返回负数 */
+extern int pwm_setup(uint8_t pin, uint32_t cycle_time, uint8_t value);
 extern void pwm_write(uint8_t pin, uint8_t value);
 
 /* ========== 私有函数 ========== */
 
+/**
+ * @brief  计算硬件 PWM 输出值
+ * @param  pwm PWM 通道状态
+ * @param  on 0 时输出关闭电平
+ * @retval 0-255 的比较值 (已处理反相)
+ */
+static uint8_t pwm_hw_value(const pwm_state_t* pwm, int on)
+{
+    uint32_t value = 0;
+    
+    if (on && pwm->max_value != 0) {
+        value = ((uint32_t)pwm->value * PWM_MAX_VALUE + pwm->max_value / 2)
+                / pwm->max_value;
+    }
+    
+    return (uint8_t)(pwm->invert ? PWM_MAX_VALUE - value : value);
+}
+
+/**
+ * @brief  重建已启用的软件 PWM 通道列表
+ */
+static void pwm_soft_list_update(void)
+{
+    uint8_t count = 0;
+    uint32_t flag;
+    int i;
+    
+    /* 定时器回调可能在中断中遍历列表 */
+    flag = sched_irq_save();
+    for (i = 0; i < PWM_CHANNEL_COUNT; i++) {
+        const pwm_state_t* pwm = &s_pwm_channels[i];
+        if (pwm->configured && pwm->enabled && !pwm->hardware) {
+            s_soft_active[count++] = (uint8_t)i;
+        }
+    }
+    s_soft_active_count = count;
+    sched_irq_restore(flag);
+}
+
 /**
  * @brief  软件 PWM 定时器回调
  * @param  waketime 唤醒时间
@@ -59,21 +111,23 @@ extern void pwm_write(uint8_t pin, uint8_t value);
  */
 static sched_time_t pwm_timer_callback(sched_time_t waketime)
 {
-    int i;
+    uint8_t i;
     static uint8_t s_pwm_counter = 0;
     
+    /* 没有软件 PWM 通道时停止定时器 */
+    if (s_soft_active_count == 0) {
+        s_soft_pwm_enabled = 0;
+        return 0;
+    }
+    
     /* 更新 PWM 计数器 (自动溢出回绕) */
     s_pwm_counter++;
     
-    /* 遍历所有 PWM 通道 */
-    for (i = 0; i < PWM_CHANNEL_COUNT; i++) {
-        pwm_state_t* pwm = &s_pwm_channels[i];
+    /* 只遍历已启用的软件通道 */
+    for (i = 0; i < s_soft_active_count; i++) {
+        const pwm_state_t* pwm = &s_pwm_channels[s_soft_active[i]];
         uint8_t output;
         
-        if (!pwm->configured || !pwm->enabled) {
-            continue;
-        }
-        
         /* 计算输出电平 */
         output = (s_pwm_counter < pwm->value) ? 1 : 0;
         
@@ -98,6 +152,11 @@ int pwm_init(void)
 {
     int i;
     
+    /* 重复调用不清除已配置的通道 */
+    if (s_pwm_initialized) {
+        return 0;
+    }
+    
     /* 清零所有状态 */
     for (i = 0; i < PWM_CHANNEL_COUNT; i++) {
         s_pwm_channels[i].pin = 0;
@@ -107,13 +166,16 @@ int pwm_init(void)
         s_pwm_channels[i].max_value = PWM_MAX_VALUE;
         s_pwm_channels[i].cycle_time = PWM_DEFAULT_CYCLE_TIME;
         s_pwm_channels[i].invert = 0;
+        s_pwm_channels[i].hardware = 0;
     }
     
     /* 初始化软件 PWM 定时器 */
     s_pwm_timer.func = pwm_timer_callback;
     s_pwm_timer.waketime = 0;
-    s_pwm_timer.next = NULL;
+    s_pwm_timer.heap_pos = 0;
     s_soft_pwm_enabled = 0;
+    s_soft_active_count = 0;
+    s_pwm_initialized = 1;
     
     return 0;
 }
@@ -142,11 +204,14 @@ int pwm_config(pwm_channel_t id, const pwm_config_t* config)
     /* 配置 GPIO 为输出 */
     gpio_out_setup(config->pin, config->invert ? 1 : 0);
     
-    /* 如果支持硬件 PWM，配置硬件 */
+    /* 如果支持硬件 PWM，配置硬件，失败时使用软件 PWM */
+    pwm->hardware = 0;
     if (config->use_hardware) {
-        pwm_setup(config->pin, config->cycle_time, 0);
+        pwm->hardware = (pwm_setup(config->pin, config->cycle_time,
+                                   pwm_hw_value(pwm, 0)) == 0);
     }
     
+    pwm_soft_list_update();
     return 0;
 }
 
@@ -166,10 +231,17 @@ void pwm_enable(pwm_channel_t id, int enable)
     pwm = &s_pwm_channels[id];
     pwm->enabled = enable ? 1 : 0;
     
+    /* 硬件 PWM 直接切换比较值，不需要软件定时器 */
+    if (pwm->hardware) {
+        pwm_write(pwm->pin, pwm_hw_value(pwm, enable));
+        return;
+    }
+    
     /* 如果禁用，输出低电平 */
     if (!enable) {
         gpio_out_write(pwm->pin, pwm->invert ? 1 : 0);
     }
+    pwm_soft_list_update();
     
     /* 检查是否需要启动软件 PWM */
     if (enable && !s_soft_pwm_enabled) {
@@ -202,7 +274,9 @@ void pwm_set_value(pwm_channel_t id, uint16_t value)
     pwm->value = value;
     
     /* 如果使用硬件 PWM，直接写入 */
-    /* pwm_write(pwm->pin, value); */
+    if (pwm->hardware && pwm->enabled) {
+        pwm_write(pwm->pin, pwm_hw_value(pwm, 1));
+    }
 }
 
 /**
@@ -14,14 +14,18 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include "config.h"
 
 /* ========== PWM 通道 ID ========== */
 
+/* 每个加热器、风扇一个通道，由 config.h 的设备表生成: 先加热器后风扇 */
+#define PWM_HEATER_ENTRY(name, adc_ch, sensor, pin, power, kp, ki, kd) \
+    PWM_CHANNEL_HEATER_##name,
+#define PWM_FAN_ENTRY(name, pin) PWM_CHANNEL_FAN_##name,
+
 typedef enum {
-    PWM_CHANNEL_HEATER_HOTEND = 0,  /* 热端加热器 */
-    PWM_CHANNEL_HEATER_BED,         /* 热床加热器 */
-    PWM_CHANNEL_FAN_PART,           /* 模型风扇 */
-    PWM_CHANNEL_FAN_HOTEND,         /* 热端风扇 */
+    HEATER_TABLE(PWM_HEATER_ENTRY)
+    FAN_TABLE(PWM_FAN_ENTRY)
     PWM_CHANNEL_COUNT
 } pwm_channel_t;
 
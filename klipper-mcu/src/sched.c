@@ -7,13 +7,45 @@
  */
 
 #include "sched.h"
+#include "autoconf.h"
+#include "profile.h"
 #include "board/irq.h"
+#include "board/misc.h"
 #include <stddef.h>
 
+/* ========== HAL 接口 ========== */
+
+#if CONFIG_SCHED_HW_TIMER
+extern void timer_init(void);
+extern void timer_set_waketime(uint32_t waketime);
+extern uint64_t timer_read_time64(void);
+#endif
+
+/* ========== 私有宏 ========== */
+
+/* DWT 周期计数器 (Cortex-M4 调试单元) */
+#define DEMCR                   (*(volatile uint32_t*)0xE000EDFC)
+#define DEMCR_TRCENA            (1U << 24)
+#define DWT_CTRL                (*(volatile uint32_t*)0xE0001000)
+#define DWT_CTRL_CYCCNTENA      (1U << 0)
+#define DWT_CYCCNT              (*(volatile uint32_t*)0xE0001004)
+
+/* 堆下标换算 */
+#define HEAP_PARENT(i)          (((i) - 1) / 2)
+#define HEAP_LEFT(i)            (2 * (i) + 1)
+
 /* ========== 私有变量 ========== */
 
-/* 定时器链表头 */
-static sched_timer_t* s_timer_list = NULL;
+/* 定时器最小堆（按唤醒时间），s_timer_heap[0] 最早到期 */
+static sched_timer_t* s_timer_heap[CONFIG_SCHED_MAX_TIMERS] __ccmram;
+static uint16_t s_timer_count = 0;
+static uint16_t s_timer_peak = 0;
+
+#if CONFIG_SCHED_IRQ_STATS
+/* 关键区起始时刻与最长关键区时间 (CPU 周期) */
+static uint32_t s_irqoff_start = 0;
+static uint32_t s_irqoff_max = 0;
+#endif
 
 /* 系统关闭标志 */
 static volatile int s_shutdown_flag = 0;
@@ -28,7 +60,7 @@ static const char* s_shutdown_reason = NULL;
  * @note   需要 HAL 层实现具体的硬件定时器读取
  * @retval 当前时间戳
  */
-sched_time_t sched_get_time(void)
+__ramfunc sched_time_t sched_get_time(void)
 {
     /* TODO: 从硬件定时器读取当前时间 */
     /* 需要 HAL 层提供 timer_read_time() 函数 */
@@ -41,7 +73,7 @@ sched_time_t sched_get_time(void)
  * @param  time 目标时间
  * @retval 1 已到，0 未到
  */
-int sched_is_before(sched_time_t time)
+__ramfunc int sched_is_before(sched_time_t time)
 {
     sched_time_t now = sched_get_time();
     return sched_time_diff(time, now) <= 0;
@@ -53,45 +85,191 @@ int sched_is_before(sched_time_t time)
  * @param  t2 时间 2
  * @retval t1 - t2 的差值
  */
-int32_t sched_time_diff(sched_time_t t1, sched_time_t t2)
+__ramfunc int32_t sched_time_diff(sched_time_t t1, sched_time_t t2)
 {
     return (int32_t)(t1 - t2);
 }
 
+/**
+ * @brief  获取 64 位扩展系统时间
+ * @retval 当前时间戳
+ */
+__ramfunc sched_time64_t sched_get_time64(void)
+{
+#if CONFIG_SCHED_HW_TIMER
+    return timer_read_time64();
+#else
+    /* 轮询模式: 以上次读数为基准向前扩展，sched_main() 保证每轮都读 */
+    static sched_time64_t s_time64;
+    uint32_t flag = sched_irq_save();
+    sched_time_t now = sched_get_time();
+    s_time64 += (sched_time_t)(now - (sched_time_t)s_time64);
+    sched_time64_t time = s_time64;
+    sched_irq_restore(flag);
+    return time;
+#endif
+}
+
+/**
+ * @brief  将 32 位时刻扩展为离当前最近的 64 位时刻
+ * @param  time 32 位时刻
+ * @retval 64 位时刻
+ */
+sched_time64_t sched_time_extend(sched_time_t time)
+{
+    sched_time64_t now = sched_get_time64();
+    return now + (int64_t)sched_time_diff(time, (sched_time_t)now);
+}
+
 /* ========== 关键区保护实现 ========== */
 
 /**
- * @brief  进入关键区（禁用中断）
- * @retval 之前的中断状态
+ * @brief  进入关键区（屏蔽调度器和步进优先级及以下的中断）
+ * @retval 之前的屏蔽状态 (BASEPRI)
+ * @note   所有访问调度器或步进电机的中断都在 IRQ_PRIO_STEP，
+ *         用 BASEPRI 屏蔽而非 cpsid i
+ */
+__ramfunc uint32_t sched_irq_save(void)
+{
+    uint32_t flag = irq_mask_level(IRQ_PRIO_STEP);
+    
+#if CONFIG_SCHED_IRQ_STATS
+    /* 仅在最外层屏蔽时开始计时 */
+    if (!irq_level_masked(flag, IRQ_PRIO_STEP)) {
+        s_irqoff_start = DWT_CYCCNT;
+    }
+#endif
+    
+    return flag;
+}
+
+/**
+ * @brief  退出关键区（恢复屏蔽状态）
+ * @param  flag 之前的屏蔽状态
+ */
+__ramfunc void sched_irq_restore(uint32_t flag)
+{
+#if CONFIG_SCHED_IRQ_STATS
+    if (!irq_level_masked(flag, IRQ_PRIO_STEP)) {
+        uint32_t cycles = DWT_CYCCNT - s_irqoff_start;
+        if (cycles > s_irqoff_max) {
+            s_irqoff_max = cycles;
+        }
+    }
+#endif
+    
+    irq_unmask_level(flag);
+}
+
+/* ========== 定时器堆实现 ========== */
+
+/**
+ * @brief  把定时器放到堆中 slot 位置并更新其索引
  */
-uint32_t sched_irq_save(void)
+static inline void heap_place(sched_timer_t* timer, uint16_t slot)
 {
-    /* TODO: 需要 HAL 层实现 */
-    extern uint32_t irq_save(void);
-    return irq_save();
+    s_timer_heap[slot] = timer;
+    timer->heap_pos = slot + 1;
+}
+
+/**
+ * @brief  定时器上浮
+ * @param  slot 起始位置
+ */
+static __ramfunc void heap_sift_up(uint16_t slot)
+{
+    sched_timer_t* timer = s_timer_heap[slot];
+    
+    while (slot > 0) {
+        uint16_t parent = HEAP_PARENT(slot);
+        if (sched_time_diff(timer->waketime,
+                            s_timer_heap[parent]->waketime) >= 0) {
+            break;
+        }
+        heap_place(s_timer_heap[parent], slot);
+        slot = parent;
+    }
+    heap_place(timer, slot);
 }
 
 /**
- * @brief  退出关键区（恢复中断）
- * @param  flag 之前的中断状态
+ * @brief  定时器下沉
+ * @param  slot 起始位置
  */
-void sched_irq_restore(uint32_t flag)
+static __ramfunc void heap_sift_down(uint16_t slot)
 {
-    /* TODO: 需要 HAL 层实现 */
-    extern void irq_restore(uint32_t flag);
-    irq_restore(flag);
+    sched_timer_t* timer = s_timer_heap[slot];
+    
+    for (;;) {
+        uint16_t child = HEAP_LEFT(slot);
+        if (child >= s_timer_count) {
+            break;
+        }
+        if (child + 1 < s_timer_count &&
+            sched_time_diff(s_timer_heap[child + 1]->waketime,
+                            s_timer_heap[child]->waketime) < 0) {
+            child++;
+        }
+        if (sched_time_diff(s_timer_heap[child]->waketime,
+                            timer->waketime) >= 0) {
+            break;
+        }
+        heap_place(s_timer_heap[child], slot);
+        slot = child;
+    }
+    heap_place(timer, slot);
+}
+
+/**
+ * @brief  从堆中移除指定位置的定时器
+ * @param  slot 堆中位置
+ */
+static __ramfunc void heap_remove(uint16_t slot)
+{
+    sched_timer_t* timer = s_timer_heap[slot];
+    sched_timer_t* last;
+    
+    timer->heap_pos = 0;
+    s_timer_count--;
+    if (slot == s_timer_count) {
+        return;
+    }
+    
+    /* 末尾元素填补空位，再向上或向下调整 */
+    last = s_timer_heap[s_timer_count];
+    heap_place(last, slot);
+    if (slot > 0 &&
+        sched_time_diff(last->waketime,
+                        s_timer_heap[HEAP_PARENT(slot)]->waketime) < 0) {
+        heap_sift_up(slot);
+    } else {
+        heap_sift_down(slot);
+    }
+}
+
+/**
+ * @brief  按堆顶唤醒时间设置硬件比较中断
+ * @note   须在 sched_irq_save() 关键区内调用；轮询模式下为空操作
+ */
+static inline void sched_arm_wake(void)
+{
+#if CONFIG_SCHED_HW_TIMER
+    if (s_timer_count > 0) {
+        timer_set_waketime(s_timer_heap[0]->waketime);
+    }
+#endif
 }
 
 /* ========== 定时器管理实现 ========== */
 
 /**
- * @brief  添加定时器到链表（按唤醒时间排序）
+ * @brief  添加定时器到堆（按唤醒时间排序）
  * @param  timer 定时器结构体指针
  */
-void sched_add_timer(sched_timer_t* timer)
+__ramfunc void sched_add_timer(sched_timer_t* timer)
 {
     uint32_t flag;
-    sched_timer_t** p_prev;
+    uint16_t old_pos;
     
     if (timer == NULL || timer->func == NULL) {
         return;
@@ -99,29 +277,39 @@ void sched_add_timer(sched_timer_t* timer)
     
     flag = sched_irq_save();
     
-    /* 按唤醒时间排序插入链表 */
-    p_prev = &s_timer_list;
-    while (*p_prev != NULL) {
-        if (sched_time_diff(timer->waketime, (*p_prev)->waketime) < 0) {
-            break;
+    old_pos = timer->heap_pos;
+    if (old_pos != 0) {
+        /* 已在队列中: 按新唤醒时间调整位置 */
+        heap_sift_up(timer->heap_pos - 1);
+        heap_sift_down(timer->heap_pos - 1);
+    } else if (s_timer_count < CONFIG_SCHED_MAX_TIMERS) {
+        s_timer_heap[s_timer_count] = timer;
+        s_timer_count++;
+        if (s_timer_count > s_timer_peak) {
+            s_timer_peak = s_timer_count;
         }
-        p_prev = &((*p_prev)->next);
+        heap_sift_up(s_timer_count - 1);
+    } else {
+        sched_irq_restore(flag);
+        sched_shutdown("Timer heap full");
+        return;
     }
     
-    timer->next = *p_prev;
-    *p_prev = timer;
+    /* 堆顶变化时更新硬件唤醒时间 */
+    if (timer->heap_pos == 1 || old_pos == 1) {
+        sched_arm_wake();
+    }
     
     sched_irq_restore(flag);
 }
 
 /**
- * @brief  从链表移除定时器
+ * @brief  从堆中移除定时器
  * @param  timer 定时器结构体指针
  */
-void sched_del_timer(sched_timer_t* timer)
+__ramfunc void sched_del_timer(sched_timer_t* timer)
 {
     uint32_t flag;
-    sched_timer_t** p_prev;
     
     if (timer == NULL) {
         return;
@@ -129,20 +317,55 @@ void sched_del_timer(sched_timer_t* timer)
     
     flag = sched_irq_save();
     
-    /* 查找并移除 */
-    p_prev = &s_timer_list;
-    while (*p_prev != NULL) {
-        if (*p_prev == timer) {
-            *p_prev = timer->next;
-            timer->next = NULL;
-            break;
+    if (timer->heap_pos != 0) {
+        uint16_t slot = timer->heap_pos - 1;
+        heap_remove(slot);
+        if (slot == 0) {
+            sched_arm_wake();
         }
-        p_prev = &((*p_prev)->next);
     }
     
     sched_irq_restore(flag);
 }
 
+/**
+ * @brief  获取调度器统计
+ * @param  stats 输出统计结构体指针
+ */
+void sched_get_stats(sched_stats_t* stats)
+{
+    uint32_t flag;
+    
+    if (stats == NULL) {
+        return;
+    }
+    
+    flag = sched_irq_save();
+#if CONFIG_SCHED_IRQ_STATS
+    stats->irqoff_max = s_irqoff_max;
+#else
+    stats->irqoff_max = 0;
+#endif
+    stats->timer_count = s_timer_count;
+    stats->timer_peak = s_timer_peak;
+    sched_irq_restore(flag);
+}
+
+/**
+ * @brief  清零关中断时间和定时器峰值统计
+ */
+void sched_reset_stats(void)
+{
+    uint32_t flag;
+    
+    flag = sched_irq_save();
+#if CONFIG_SCHED_IRQ_STATS
+    s_irqoff_max = 0;
+#endif
+    s_timer_peak = s_timer_count;
+    sched_irq_restore(flag);
+}
+
 /* ========== 调度器核心实现 ========== */
 
 /**
@@ -151,41 +374,58 @@ void sched_del_timer(sched_timer_t* timer)
  */
 int sched_init(void)
 {
-    s_timer_list = NULL;
+    for (uint16_t i = 0; i < s_timer_count; i++) {
+        s_timer_heap[i]->heap_pos = 0;
+    }
+    s_timer_count = 0;
+    s_timer_peak = 0;
     s_shutdown_flag = 0;
     s_shutdown_reason = NULL;
     
-    /* TODO: 初始化硬件定时器 */
-    /* 需要 HAL 层提供 timer_init() 函数 */
+#if CONFIG_SCHED_HW_TIMER
+    /* 启动 TIM5 作为调度时钟和唤醒中断 */
+    timer_init();
+#endif
+    
+#if CONFIG_SCHED_IRQ_STATS
+    /* 使能 DWT 周期计数器用于关中断计时 */
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+    s_irqoff_max = 0;
+#endif
     
     return 0;
 }
 
 /**
- * @brief  调度器主循环
- * @note   处理到期的定时器回调
+ * @brief  执行所有到期的定时器
+ * @note   硬件定时器模式下在 TIM5 中断上下文中运行
  */
-void sched_main(void)
+__ramfunc void sched_timer_dispatch(void)
 {
     sched_timer_t* timer;
     sched_time_t waketime;
     sched_time_t next_waketime;
     uint32_t flag;
+    uint32_t prof_start;
     
     /* 检查系统是否已关闭 */
     if (s_shutdown_flag) {
         return;
     }
     
+    prof_start = profile_start();
+    
     /* 处理到期的定时器 */
     for (;;) {
         flag = sched_irq_save();
         
-        timer = s_timer_list;
-        if (timer == NULL) {
+        if (s_timer_count == 0) {
             sched_irq_restore(flag);
             break;
         }
+        timer = s_timer_heap[0];
         
         /* 检查是否到期 */
         if (!sched_is_before(timer->waketime)) {
@@ -193,13 +433,20 @@ void sched_main(void)
             break;
         }
         
-        /* 从链表移除 */
-        s_timer_list = timer->next;
-        timer->next = NULL;
+        /* 从堆顶移除 */
+        heap_remove(0);
         waketime = timer->waketime;
         
         sched_irq_restore(flag);
         
+        /* 记录实际执行时刻相对预定唤醒时刻的延迟 */
+        if (CONFIG_PROFILE) {
+            int32_t late = sched_time_diff(sched_get_time(), waketime);
+            if (late > 0) {
+                profile_record_lateness((uint32_t)late);
+            }
+        }
+        
         /* 执行回调 */
         next_waketime = timer->func(waketime);
         
@@ -209,6 +456,25 @@ void sched_main(void)
             sched_add_timer(timer);
         }
     }
+    
+    /* 按新的堆顶重新设置硬件唤醒 */
+    flag = sched_irq_save();
+    sched_arm_wake();
+    sched_irq_restore(flag);
+    
+    profile_stop(PROFILE_SCHED_DISPATCH, prof_start);
+}
+
+/**
+ * @brief  调度器主循环
+ * @note   轮询模式下处理到期的定时器回调
+ */
+__ramfunc void sched_main(void)
+{
+#if !CONFIG_SCHED_HW_TIMER
+    sched_timer_dispatch();
+    (void)sched_get_time64();
+#endif
 }
 
 /* ========== 系统状态实现 ========== */
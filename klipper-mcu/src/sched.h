@@ -17,9 +17,12 @@ extern "C" {
 
 /* ========== 时间类型定义 ========== */
 
-/* 系统时钟计数类型 */
+/* 系统时钟计数类型 (32 位回绕，时间差须小于半个周期) */
 typedef uint32_t sched_time_t;
 
+/* 64 位扩展时钟 (不回绕)，用于远期调度和长时间任务的时间换算 */
+typedef uint64_t sched_time64_t;
+
 /* ========== 定时器回调 ========== */
 
 /**
@@ -31,11 +34,21 @@ typedef sched_time_t (*sched_timer_fn_t)(sched_time_t waketime);
 
 /* 定时器结构体 */
 typedef struct sched_timer {
-    struct sched_timer* next;   /* 链表下一个节点 */
     sched_time_t waketime;      /* 唤醒时间 */
     sched_timer_fn_t func;      /* 回调函数 */
+    uint16_t heap_pos;          /* 堆中位置 + 1，0 表示未排队 */
 } sched_timer_t;
 
+/* 定时器堆在 CCM 中的占用，计入 CCM_BUDGET_BYTES */
+#define SCHED_CCM_BYTES         (CONFIG_SCHED_MAX_TIMERS * sizeof(sched_timer_t*))
+
+/* 调度器统计 */
+typedef struct {
+    uint32_t irqoff_max;        /* 最长关键区时间 (CPU 周期)，未启用 CONFIG_SCHED_IRQ_STATS 时为 0 */
+    uint16_t timer_count;       /* 当前排队定时器数 */
+    uint16_t timer_peak;        /* 排队定时器数峰值 */
+} sched_stats_t;
+
 /* ========== 任务回调 ========== */
 
 /**
@@ -53,22 +66,43 @@ int sched_init(void);
 
 /**
  * @brief  调度器主循环
- * @note   在 main() 的无限循环中调用
+ * @note   在 main() 的无限循环中调用；CONFIG_SCHED_HW_TIMER 模式下
+ *         定时器在中断中执行，此处不再处理
  */
 void sched_main(void);
 
+/**
+ * @brief  执行所有到期的定时器
+ * @note   CONFIG_SCHED_HW_TIMER 模式下由 TIM5 比较中断调用；
+ *         轮询模式下由 sched_main() 调用
+ */
+void sched_timer_dispatch(void);
+
 /**
  * @brief  添加定时器
  * @param  timer 定时器结构体指针
+ * @note   O(log n)；定时器已在队列中时按新的 waketime 调整位置
  */
 void sched_add_timer(sched_timer_t* timer);
 
 /**
  * @brief  移除定时器
  * @param  timer 定时器结构体指针
+ * @note   O(log n)；定时器未排队时无操作
  */
 void sched_del_timer(sched_timer_t* timer);
 
+/**
+ * @brief  获取调度器统计
+ * @param  stats 输出统计结构体指针
+ */
+void sched_get_stats(sched_stats_t* stats);
+
+/**
+ * @brief  清零关中断时间和定时器峰值统计
+ */
+void sched_reset_stats(void);
+
 /* ========== 时间接口 ========== */
 
 /**
@@ -89,9 +123,27 @@ int sched_is_before(sched_time_t time);
  * @param  t1 时间 1
  * @param  t2 时间 2
  * @retval t1 - t2 的差值（考虑溢出）
+ * @note   仅在两者相差不到半个周期 (2^31 个时钟) 时有效，
+ *         更远的时刻用 sched_time64_t 直接相减
  */
 int32_t sched_time_diff(sched_time_t t1, sched_time_t t2);
 
+/**
+ * @brief  获取 64 位扩展系统时间
+ * @retval 当前时间戳，低 32 位与 sched_get_time() 一致
+ * @note   CONFIG_SCHED_HW_TIMER 下高 32 位由 TIM5 溢出中断维护，
+ *         可在任意上下文调用；轮询模式下由软件扩展，
+ *         依赖 sched_main() 至少每半个周期调用一次
+ */
+sched_time64_t sched_get_time64(void);
+
+/**
+ * @brief  将 32 位时刻扩展为离当前最近的 64 位时刻
+ * @param  time 32 位时刻，须在当前时刻前后半个周期内
+ * @retval 64 位时刻
+ */
+sched_time64_t sched_time_extend(sched_time_t time);
+
 /* ========== 关键区保护 ========== */
 
 /**
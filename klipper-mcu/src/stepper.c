@@ -8,10 +8,21 @@
 
 #include "stepper.h"
 #include "sched.h"
+#include "command.h"
+#include "autoconf.h"
+#include "profile.h"
+#include "trace.h"
+#include "board/gpio.h"
+#include "board/misc.h"
+#include "chelper/spsc_ring.h"
 #include <stddef.h>
 
 /* ========== 私有类型定义 ========== */
 
+#if !SPSC_RING_SIZE_OK(STEPPER_QUEUE_SIZE)
+#error "STEPPER_QUEUE_SIZE must be a power of two"
+#endif
+
 /* 步进电机状态 */
 typedef struct {
     stepper_config_t config;    /* 配置参数 */
@@ -20,61 +31,65 @@ typedef struct {
     uint8_t enabled;            /* 使能状态 */
     uint8_t configured;         /* 是否已配置 */
     
-    /* 运动队列 */
+    /* 当前运动段 */
     uint32_t interval;          /* 步进间隔 */
     uint32_t count;             /* 剩余步数 */
+    int32_t add;                /* 每步后间隔增量 */
     sched_time_t next_step_time; /* 下次步进时间 */
+    sched_time_t last_step_time; /* 上一步时间（队列基准） */
+    sched_timer_t timer;        /* 本电机的步进定时器 */
+    
+    /* 步进引脚 */
+    gpio_fast_t step_out;       /* 预解析的步进引脚 (BSRR 直写) */
+    uint8_t step_level;         /* 步进引脚当前物理电平 */
+    uint8_t unstep_pending;     /* 脉冲已拉起，等待恢复空闲电平 */
+    
+    /* 运动段队列: 主循环写入，步进定时器读取 (单生产者/单消费者) */
+    stepper_move_t queue[STEPPER_QUEUE_SIZE];
+    spsc_ring_t queue_ring;     /* 队列读写索引 */
+    uint8_t low_water;          /* 剩余段数不超过此值时请求补充 */
+    uint8_t high_water;         /* 补充的目标段数 */
 } stepper_state_t;
 
 /* ========== 私有变量 ========== */
 
 /* 步进电机状态数组 */
-static stepper_state_t s_steppers[STEPPER_COUNT];
+static stepper_state_t s_steppers[STEPPER_COUNT] __ccmram;
 
-/* 步进定时器 */
-static sched_timer_t s_stepper_timer;
+/* CCM 预算按 STEPPER_STATE_MAX_BYTES 计算 (C99 没有 _Static_assert) */
+typedef char stepper_state_size_check[(sizeof(stepper_state_t) <= STEPPER_STATE_MAX_BYTES) ? 1 : -1];
 
 /* 最小步进间隔（防止过快） */
 #define MIN_STEP_INTERVAL   100     /* 时钟周期 */
 
-/* 步进脉冲宽度 */
-#define STEP_PULSE_WIDTH    2       /* 微秒 */
-
-/* ========== GPIO 操作宏 ========== */
+/* set_next_step_dir 设定的方向，供其后的 queue_step 使用 (>=0 正向) */
+static int8_t s_next_dir[STEPPER_COUNT];
 
-/* TODO: 需要 HAL 层实现这些函数 */
-extern void gpio_out_write(uint8_t pin, uint8_t value);
-extern uint8_t gpio_in_read(uint8_t pin);
+/* 队列降到低水位的电机位图: 步进定时器置位，后台任务读清 */
+static volatile uint32_t s_refill_mask;
 
 /* ========== 私有函数 ========== */
 
 /**
- * @brief  输出步进脉冲
+ * @brief  输出步进边沿并更新位置
  * @param  stepper 步进电机状态指针
+ * @note   CONFIG_STEPPER_BOTH_EDGE 时翻转电平即为一步；否则拉到有效
+ *         电平，由定时器在 CONFIG_STEPPER_PULSE_TICKS 后调用
+ *         stepper_do_unstep() 恢复，中断内不再忙等
  */
-static void stepper_do_step(stepper_state_t* stepper)
+static __ramfunc void stepper_do_step(stepper_state_t* stepper)
 {
-    uint8_t step_value;
-    
     if (stepper == NULL || !stepper->configured || !stepper->enabled) {
         return;
     }
     
-    /* 计算脉冲电平 */
-    step_value = stepper->config.invert_step ? 0 : 1;
-    
-    /* 输出高电平 */
-    gpio_out_write(stepper->config.step_pin, step_value);
-    
-    /* 简单延时（实际应使用定时器） */
-    /* TODO: 使用精确延时 */
-    volatile int i;
-    for (i = 0; i < 10; i++) {
-        /* 空循环延时 */
-    }
-    
-    /* 输出低电平 */
-    gpio_out_write(stepper->config.step_pin, !step_value);
+#if CONFIG_STEPPER_BOTH_EDGE
+    stepper->step_level = !stepper->step_level;
+#else
+    stepper->step_level = stepper->config.invert_step ? 0 : 1;
+    stepper->unstep_pending = 1;
+#endif
+    gpio_fast_write(stepper->step_out, stepper->step_level);
     
     /* 更新位置 */
     if (stepper->dir == STEPPER_DIR_FORWARD) {
@@ -84,6 +99,240 @@ static void stepper_do_step(stepper_state_t* stepper)
     }
 }
 
+/**
+ * @brief  结束步进脉冲（恢复空闲电平）
+ * @param  stepper 步进电机状态指针
+ */
+static __ramfunc void stepper_do_unstep(stepper_state_t* stepper)
+{
+    stepper->unstep_pending = 0;
+    stepper->step_level = stepper->config.invert_step ? 1 : 0;
+    gpio_fast_write(stepper->step_out, stepper->step_level);
+}
+
+/**
+ * @brief  按 next_step_time 启动（或重设）电机定时器
+ * @param  stepper 步进电机状态指针
+ * @note   定时器已排队时 sched_add_timer() 按新时间调整位置，
+ *         只影响本电机
+ */
+static void stepper_timer_start(stepper_state_t* stepper)
+{
+    uint32_t flag;
+    
+    /* 定时器回调可能在中断中运行，修改须原子完成 */
+    flag = sched_irq_save();
+    
+    /* 脉冲未结束时由 unstep 事件接续下一步 */
+    if (!stepper->unstep_pending) {
+        stepper->timer.waketime = stepper->next_step_time;
+        sched_add_timer(&stepper->timer);
+    }
+    
+    sched_irq_restore(flag);
+}
+
+/**
+ * @brief  从队列装载下一运动段
+ * @param  id 电机 ID
+ * @retval 1 已装载，0 队列空
+ */
+static __ramfunc int stepper_load_next(stepper_id_t id)
+{
+    stepper_state_t* stepper = &s_steppers[id];
+    stepper_move_t move;
+    
+    /* 跳过空段；先复制出运动段再归还槽位，之后主循环可以覆盖 */
+    do {
+        if (spsc_ring_avail(&stepper->queue_ring) == 0) {
+            return 0;
+        }
+        
+        move = stepper->queue[spsc_ring_tail(&stepper->queue_ring,
+                                             STEPPER_QUEUE_SIZE)];
+        spsc_ring_pop(&stepper->queue_ring, 1);
+    } while (move.count == 0);
+    
+    /* 降到低水位时通知后台补充，而不是等后台轮询队列深度 */
+    if (spsc_ring_avail(&stepper->queue_ring) <= stepper->low_water) {
+        s_refill_mask |= 1u << id;
+    }
+    
+    if ((move.dir >= 0) != (stepper->dir == STEPPER_DIR_FORWARD)) {
+        stepper_set_dir(id, move.dir >= 0 ? STEPPER_DIR_FORWARD
+                                          : STEPPER_DIR_BACKWARD);
+    }
+    
+    stepper->interval = move.interval;
+    stepper->count = move.count;
+    stepper->add = move.add;
+    stepper->next_step_time = stepper->last_step_time + move.interval;
+    
+    trace_record(TRACE_STEP, (uint8_t)id,
+                 (uint16_t)spsc_ring_avail(&stepper->queue_ring),
+                 move.interval, move.count);
+    return 1;
+}
+
+/**
+ * @brief  单个电机的步进事件
+ * @param  id 电机 ID
+ * @retval 下次唤醒时间，0 表示该电机空闲
+ * @note   定时器只在本电机 next_step_time 到期时触发，每次唤醒 O(1)
+ */
+static __ramfunc sched_time_t stepper_event(stepper_id_t id)
+{
+    stepper_state_t* stepper = &s_steppers[id];
+    int has_next = 1;
+    
+#if !CONFIG_STEPPER_BOTH_EDGE
+    if (stepper->unstep_pending) {
+        /* 脉冲宽度已满足，恢复电平后等待下一步 */
+        stepper_do_unstep(stepper);
+        return (stepper->count > 0) ? stepper->next_step_time : 0;
+    }
+#endif
+    
+    if (stepper->count == 0) {
+        return 0;
+    }
+    
+    /* 执行步进 */
+    stepper_do_step(stepper);
+    stepper->count--;
+    stepper->last_step_time = stepper->next_step_time;
+    
+    if (stepper->count > 0) {
+        stepper->interval += stepper->add;
+        stepper->next_step_time += stepper->interval;
+    } else {
+        /* 当前段结束，装载队列中的下一段 */
+        has_next = stepper_load_next(id);
+    }
+    
+#if !CONFIG_STEPPER_BOTH_EDGE
+    if (stepper->unstep_pending) {
+        return stepper->last_step_time + CONFIG_STEPPER_PULSE_TICKS;
+    }
+#endif
+    
+    return has_next ? stepper->next_step_time : 0;
+}
+
+/*
+ * 各电机定时器入口（sched_timer_fn_t 不携带上下文参数），按 config.h 的
+ * STEPPER_TABLE 为每个电机生成一个: 只有本电机到期时才被调用，
+ * 增加电机不增加其它电机的每步开销
+ */
+#define STEPPER_TIMER_ENTRY(name, step_pin, dir_pin, enable_pin)    \
+    static __ramfunc sched_time_t                                   \
+    stepper_timer_##name(sched_time_t waketime)                     \
+    {                                                               \
+        (void)waketime;                                             \
+        uint32_t prof_start = profile_start();                      \
+        sched_time_t next = stepper_event(STEPPER_##name);          \
+        profile_stop(PROFILE_STEPPER_EVENT, prof_start);            \
+        return next;                                                \
+    }
+
+STEPPER_TABLE(STEPPER_TIMER_ENTRY)
+
+#define STEPPER_TIMER_FUNC(name, step_pin, dir_pin, enable_pin) \
+    stepper_timer_##name,
+
+static const sched_timer_fn_t s_timer_funcs[STEPPER_COUNT] = {
+    STEPPER_TABLE(STEPPER_TIMER_FUNC)
+};
+
+/* 各电机引脚 (config.h STEPPER_TABLE)，stepper_init() 时配置 */
+#define STEPPER_PIN_ENTRY(name, step, dir, enable)                  \
+    { .step_pin = (step), .dir_pin = (dir), .enable_pin = (enable), \
+      .invert_step = 0, .invert_dir = 0, .invert_enable = 0 },
+
+static const stepper_config_t s_stepper_pins[STEPPER_COUNT] = {
+    STEPPER_TABLE(STEPPER_PIN_ENTRY)
+};
+
+/* ========== 二进制命令 ========== */
+
+/**
+ * @brief  reset_step_clock oid clock: 设置步进队列基准时钟
+ */
+static int stepper_cmd_reset_step_clock(const cmd_args_t* args)
+{
+    if (args->values[0] >= STEPPER_COUNT) {
+        return -1;
+    }
+    
+    stepper_reset_step_clock((stepper_id_t)args->values[0],
+                             (sched_time_t)args->values[1]);
+    return 0;
+}
+
+/**
+ * @brief  set_next_step_dir oid dir: 设置后续运动段方向 (stepper_dir_t)
+ */
+static int stepper_cmd_set_next_step_dir(const cmd_args_t* args)
+{
+    if (args->values[0] >= STEPPER_COUNT) {
+        return -1;
+    }
+    
+    s_next_dir[args->values[0]] =
+        (args->values[1] == STEPPER_DIR_FORWARD) ? 1 : -1;
+    return 0;
+}
+
+/**
+ * @brief  queue_step oid interval count add: 追加运动段
+ * @retval 队列满时返回 CMD_BUSY，由命令层稍后重试
+ */
+static int stepper_cmd_queue_step(const cmd_args_t* args)
+{
+    stepper_id_t id = (stepper_id_t)args->values[0];
+    stepper_move_t move;
+    
+    if (args->values[0] >= STEPPER_COUNT) {
+        return -1;
+    }
+    
+    move.position = 0;
+    move.target = 0;
+    move.interval = args->values[1];
+    move.count = args->values[2];
+    move.add = (int32_t)args->values[3];
+    move.dir = s_next_dir[id];
+    
+    int ret = stepper_queue_move(id, &move);
+    return (ret == -2) ? CMD_BUSY : ret;
+}
+
+/**
+ * @brief  stepper_get_position oid: 回复当前位置
+ */
+static int stepper_cmd_get_position(const cmd_args_t* args)
+{
+    if (args->values[0] >= STEPPER_COUNT) {
+        return -1;
+    }
+    
+    uint32_t rsp[2];
+    rsp[0] = args->values[0];
+    rsp[1] = (uint32_t)stepper_get_position((stepper_id_t)args->values[0]);
+    return command_send_message(CMD_RSP_STEPPER_POSITION, rsp, 2);
+}
+
+/* 步进电机命令表 */
+static const cmd_desc_t s_stepper_cmds[] = {
+    { CMD_ID_RESET_STEP_CLOCK, "reset_step_clock",
+      stepper_cmd_reset_step_clock, 2 },
+    { CMD_ID_SET_NEXT_STEP_DIR, "set_next_step_dir",
+      stepper_cmd_set_next_step_dir, 2 },
+    { CMD_ID_QUEUE_STEP, "queue_step", stepper_cmd_queue_step, 4 },
+    { CMD_ID_STEPPER_GET_POSITION, "stepper_get_position",
+      stepper_cmd_get_position, 1 },
+};
+
 /* ========== 公共接口实现 ========== */
 
 /**
@@ -102,13 +351,32 @@ int stepper_init(void)
         s_steppers[i].configured = 0;
         s_steppers[i].interval = 0;
         s_steppers[i].count = 0;
+        s_steppers[i].add = 0;
         s_steppers[i].next_step_time = 0;
+        s_steppers[i].last_step_time = 0;
+        spsc_ring_init(&s_steppers[i].queue_ring);
+        s_steppers[i].low_water = STEPPER_LOW_WATER;
+        s_steppers[i].high_water = STEPPER_HIGH_WATER;
+        
+        /* 初始化本电机定时器 */
+        s_steppers[i].timer.func = s_timer_funcs[i];
+        s_steppers[i].timer.waketime = 0;
+        s_steppers[i].timer.heap_pos = 0;
+        s_steppers[i].step_level = 0;
+        s_steppers[i].unstep_pending = 0;
+        s_next_dir[i] = 1;
+        
+        /* 按设备表配置引脚 (使能引脚保持禁用) */
+        stepper_config((stepper_id_t)i, &s_stepper_pins[i]);
     }
+    s_refill_mask = 0;
     
-    /* 初始化定时器 */
-    s_stepper_timer.func = stepper_timer_callback;
-    s_stepper_timer.waketime = 0;
-    s_stepper_timer.next = NULL;
+    /* 注册二进制命令 */
+    for (i = 0; i < (int)(sizeof(s_stepper_cmds) / sizeof(s_stepper_cmds[0])); i++) {
+        if (command_register(&s_stepper_cmds[i]) != 0) {
+            return -1;
+        }
+    }
     
     return 0;
 }
@@ -132,11 +400,11 @@ int stepper_config(stepper_id_t id, const stepper_config_t* config)
     stepper->configured = 1;
     
     /* 配置 GPIO 引脚 */
-    /* TODO: 需要 HAL 层实现 gpio_out_setup() */
-    extern void gpio_out_setup(uint8_t pin, uint8_t value);
-    
-    /* 步进引脚初始化为低电平 */
+    /* 步进引脚初始化为空闲电平，并预解析 BSRR 供中断直写 */
     gpio_out_setup(config->step_pin, config->invert_step ? 1 : 0);
+    stepper->step_out = gpio_fast_lookup(config->step_pin);
+    stepper->step_level = config->invert_step ? 1 : 0;
+    stepper->unstep_pending = 0;
     
     /* 方向引脚初始化 */
     gpio_out_setup(config->dir_pin, config->invert_dir ? 1 : 0);
@@ -213,11 +481,27 @@ void stepper_set_dir(stepper_id_t id, stepper_dir_t dir)
  */
 void stepper_step(stepper_id_t id)
 {
+    stepper_state_t* stepper;
+    uint32_t flag;
+    
     if (id >= STEPPER_COUNT) {
         return;
     }
     
-    stepper_do_step(&s_steppers[id]);
+    stepper = &s_steppers[id];
+    flag = sched_irq_save();
+    
+    stepper_do_step(stepper);
+    
+#if !CONFIG_STEPPER_BOTH_EDGE
+    /* 由本电机定时器结束脉冲，随后接续正常步进 */
+    if (stepper->unstep_pending) {
+        stepper->timer.waketime = sched_get_time() + CONFIG_STEPPER_PULSE_TICKS;
+        sched_add_timer(&stepper->timer);
+    }
+#endif
+    
+    sched_irq_restore(flag);
 }
 
 /**
@@ -270,6 +554,7 @@ int stepper_add_move(stepper_id_t id, const stepper_move_t* move)
     /* 设置运动参数 */
     stepper->interval = move->interval;
     stepper->count = move->count;
+    stepper->add = move->add;
     
     /* 设置方向 */
     if (move->dir >= 0) {
@@ -280,26 +565,160 @@ int stepper_add_move(stepper_id_t id, const stepper_move_t* move)
     
     /* 设置下次步进时间 */
     stepper->next_step_time = sched_get_time() + stepper->interval;
+    stepper->last_step_time = stepper->next_step_time - stepper->interval;
     
     /* 添加定时器 */
-    s_stepper_timer.waketime = stepper->next_step_time;
-    sched_add_timer(&s_stepper_timer);
+    stepper_timer_start(stepper);
+    
+    return 0;
+}
+
+/**
+ * @brief  向步进队列追加运动段
+ * @param  id 电机 ID
+ * @param  move 运动段
+ * @retval 0 成功，-1 参数错误，-2 队列满
+ */
+int stepper_queue_move(stepper_id_t id, const stepper_move_t* move)
+{
+    stepper_state_t* stepper;
+    uint32_t flag;
+    int start = 0;
+    
+    if (id >= STEPPER_COUNT || move == NULL) {
+        return -1;
+    }
+    
+    stepper = &s_steppers[id];
+    
+    /* 入队无需关中断: 只有步进定时器从队列取段 */
+    if (spsc_ring_free(&stepper->queue_ring, STEPPER_QUEUE_SIZE) == 0) {
+        return -2;
+    }
+    
+    stepper->queue[spsc_ring_head(&stepper->queue_ring,
+                                  STEPPER_QUEUE_SIZE)] = *move;
+    spsc_ring_push(&stepper->queue_ring, 1);
+    
+    /*
+     * 电机空闲 (定时器已停) 时由主循环装载并启动。运行中的段结束时
+     * 定时器自己装载下一段；关中断排除两者同时发生
+     */
+    if (stepper->count == 0) {
+        flag = sched_irq_save();
+        if (stepper->count == 0) {
+            start = stepper_load_next(id);
+        }
+        sched_irq_restore(flag);
+    }
+    
+    if (start) {
+        stepper_timer_start(stepper);
+    }
+    
+    return 0;
+}
+
+/**
+ * @brief  设置步进队列的基准时钟
+ * @param  id 电机 ID
+ * @param  clock 基准时钟
+ */
+void stepper_reset_step_clock(stepper_id_t id, sched_time_t clock)
+{
+    if (id >= STEPPER_COUNT) {
+        return;
+    }
+    
+    s_steppers[id].last_step_time = clock;
+}
+
+/**
+ * @brief  获取步进队列中待执行的运动段数
+ * @param  id 电机 ID
+ * @retval 运动段数
+ */
+int stepper_queue_count(stepper_id_t id)
+{
+    if (id >= STEPPER_COUNT) {
+        return 0;
+    }
     
+    return (int)spsc_ring_count(&s_steppers[id].queue_ring);
+}
+
+/**
+ * @brief  设置运动段队列的低/高水位
+ * @param  id   电机 ID
+ * @param  low  低水位
+ * @param  high 高水位
+ * @retval 0 成功，-1 参数错误
+ */
+int stepper_set_watermarks(stepper_id_t id, uint8_t low, uint8_t high)
+{
+    if (id >= STEPPER_COUNT || low >= high || high > STEPPER_QUEUE_SIZE) {
+        return -1;
+    }
+    
+    s_steppers[id].low_water = low;
+    s_steppers[id].high_water = high;
     return 0;
 }
 
+/**
+ * @brief  获取补充到高水位还需的运动段数
+ * @param  id 电机 ID
+ * @retval 段数
+ */
+int stepper_queue_want(stepper_id_t id)
+{
+    if (id >= STEPPER_COUNT) {
+        return 0;
+    }
+    
+    int count = (int)spsc_ring_count(&s_steppers[id].queue_ring);
+    int high = s_steppers[id].high_water;
+    return (count < high) ? high - count : 0;
+}
+
+/**
+ * @brief  取出并清除补充请求
+ * @retval 队列降到低水位的电机位图
+ */
+uint32_t stepper_take_refill_mask(void)
+{
+    uint32_t flag = sched_irq_save();
+    uint32_t mask = s_refill_mask;
+    s_refill_mask = 0;
+    sched_irq_restore(flag);
+    return mask;
+}
+
 /**
  * @brief  停止步进电机
  * @param  id 电机 ID
  */
 void stepper_stop(stepper_id_t id)
 {
+    uint32_t flag;
+    
     if (id >= STEPPER_COUNT) {
         return;
     }
     
+    flag = sched_irq_save();
+    
+    sched_del_timer(&s_steppers[id].timer);
+    if (s_steppers[id].unstep_pending) {
+        stepper_do_unstep(&s_steppers[id]);
+    }
     s_steppers[id].count = 0;
     s_steppers[id].interval = 0;
+    
+    /* 丢弃队列中未执行的运动段 (关中断下两端都不会运行) */
+    spsc_ring_init(&s_steppers[id].queue_ring);
+    
+    sched_irq_restore(flag);
 }
 
 /**
@@ -312,9 +731,6 @@ void stepper_stop_all(void)
     for (i = 0; i < STEPPER_COUNT; i++) {
         stepper_stop((stepper_id_t)i);
     }
-    
-    /* 移除定时器 */
-    sched_del_timer(&s_stepper_timer);
 }
 
 /**
@@ -328,51 +744,6 @@ int stepper_is_moving(stepper_id_t id)
         return 0;
     }
     
-    return s_steppers[id].count > 0 ? 1 : 0;
-}
-
-/**
- * @brief  步进电机定时器回调
- * @param  waketime 唤醒时间
- * @retval 下次唤醒时间，0 表示不再调度
- */
-sched_time_t stepper_timer_callback(sched_time_t waketime)
-{
-    int i;
-    sched_time_t next_time = 0;
-    sched_time_t min_next_time = 0;
-    int has_active = 0;
-    
-    (void)waketime;
-    
-    /* 遍历所有步进电机 */
-    for (i = 0; i < STEPPER_COUNT; i++) {
-        stepper_state_t* stepper = &s_steppers[i];
-        
-        if (stepper->count == 0) {
-            continue;
-        }
-        
-        /* 检查是否到达步进时间 */
-        if (sched_is_before(stepper->next_step_time)) {
-            /* 执行步进 */
-            stepper_do_step(stepper);
-            stepper->count--;
-            
-            if (stepper->count > 0) {
-                stepper->next_step_time += stepper->interval;
-            }
-        }
-        
-        /* 计算下次唤醒时间 */
-        if (stepper->count > 0) {
-            next_time = stepper->next_step_time;
-            if (!has_active || sched_time_diff(next_time, min_next_time) < 0) {
-                min_next_time = next_time;
-            }
-            has_active = 1;
-        }
-    }
-    
-    return has_active ? min_next_time : 0;
+    return (s_steppers[id].count > 0 ||
+            spsc_ring_count(&s_steppers[id].queue_ring) > 0) ? 1 : 0;
 }
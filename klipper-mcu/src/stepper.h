@@ -15,17 +15,30 @@ extern "C" {
 
 #include <stdint.h>
 #include "sched.h"
+#include "config.h"
 
 /* ========== 步进电机 ID ========== */
 
+/* 由 config.h 的 STEPPER_TABLE 按顺序生成 (STEPPER_X = 0) */
+#define STEPPER_ID_ENTRY(name, step_pin, dir_pin, enable_pin) STEPPER_##name,
+
 typedef enum {
-    STEPPER_X = 0,
-    STEPPER_Y,
-    STEPPER_Z,
-    STEPPER_E,
+    STEPPER_TABLE(STEPPER_ID_ENTRY)
     STEPPER_COUNT
 } stepper_id_t;
 
+/* ========== 运动段队列 ========== */
+
+/* 每个电机的运动段队列长度 (2 的幂) */
+#define STEPPER_QUEUE_SIZE      32
+
+/*
+ * 默认水位 (运动段数): 队列降到低水位时步进定时器通知后台补充，
+ * 后台每次补充到高水位为止
+ */
+#define STEPPER_LOW_WATER       8
+#define STEPPER_HIGH_WATER      24
+
 /* ========== 步进方向 ========== */
 
 typedef enum {
@@ -51,14 +64,22 @@ typedef struct {
     int32_t target;             /* 目标位置（步数） */
     uint32_t interval;          /* 步进间隔（时钟周期） */
     uint32_t count;             /* 剩余步数 */
+    int32_t add;                /* 每步后间隔增量（时钟周期） */
     int8_t dir;                 /* 当前方向 */
 } stepper_move_t;
 
+/* 单个电机状态 (含运动段队列) 的字节数上限，stepper.c 编译期检查 */
+#define STEPPER_STATE_MAX_BYTES (STEPPER_QUEUE_SIZE * sizeof(stepper_move_t) + 128)
+
+/* 电机状态数组在 CCM 中的占用，计入 CCM_BUDGET_BYTES */
+#define STEPPER_CCM_BYTES       (STEPPER_COUNT * STEPPER_STATE_MAX_BYTES)
+
 /* ========== 步进电机接口 ========== */
 
 /**
  * @brief  初始化步进电机模块
  * @retval 0 成功，负数 失败
+ * @note   同时注册 queue_step 等二进制命令，须在 command_init() 之后调用
  */
 int stepper_init(void);
 
@@ -112,6 +133,56 @@ void stepper_set_position(stepper_id_t id, int32_t position);
  */
 int stepper_add_move(stepper_id_t id, const stepper_move_t* move);
 
+/**
+ * @brief  向步进队列追加运动段
+ * @param  id 电机 ID
+ * @param  move 运动段（interval 为首步相对上一步的时钟间隔，之后每步
+ *              间隔增加 add；position/target 不使用）
+ * @retval 0 成功，-1 参数错误，-2 队列满
+ * @note   由 toolhead 将 itersolve 生成的步进时间转换后调用，
+ *         定时器回调按顺序消费队列；队列空闲时首段间隔相对
+ *         stepper_reset_step_clock() 设置的基准时钟
+ */
+int stepper_queue_move(stepper_id_t id, const stepper_move_t* move);
+
+/**
+ * @brief  设置步进队列的基准时钟
+ * @param  id 电机 ID
+ * @param  clock 基准时钟（视为上一步的时间）
+ * @note   仅应在电机空闲（队列为空）时调用
+ */
+void stepper_reset_step_clock(stepper_id_t id, sched_time_t clock);
+
+/**
+ * @brief  获取步进队列中待执行的运动段数
+ * @param  id 电机 ID
+ * @retval 运动段数（不含正在执行的段）
+ */
+int stepper_queue_count(stepper_id_t id);
+
+/**
+ * @brief  设置运动段队列的低/高水位
+ * @param  id   电机 ID
+ * @param  low  低水位: 取段后剩余段数不超过此值时请求补充
+ * @param  high 高水位: 补充到此段数为止
+ * @retval 0 成功，-1 参数错误 (须 low < high <= STEPPER_QUEUE_SIZE)
+ */
+int stepper_set_watermarks(stepper_id_t id, uint8_t low, uint8_t high);
+
+/**
+ * @brief  获取补充到高水位还需的运动段数
+ * @param  id 电机 ID
+ * @retval 段数，队列已达高水位时为 0
+ */
+int stepper_queue_want(stepper_id_t id);
+
+/**
+ * @brief  取出并清除补充请求
+ * @retval 自上次调用以来队列降到低水位的电机位图 (bit = 电机 ID)
+ * @note   由后台任务调用；步进定时器在取段后置位，关中断读清
+ */
+uint32_t stepper_take_refill_mask(void);
+
 /**
  * @brief  停止步进电机
  * @param  id 电机 ID
@@ -126,17 +197,10 @@ void stepper_stop_all(void);
 /**
  * @brief  检查步进电机是否在运动
  * @param  id 电机 ID
- * @retval 1 运动中，0 停止
+ * @retval 1 运动中（含队列中待执行的运动段），0 停止
  */
 int stepper_is_moving(stepper_id_t id);
 
-/**
- * @brief  步进电机定时器回调（内部使用）
- * @param  waketime 唤醒时间
- * @retval 下次唤醒时间
- */
-sched_time_t stepper_timer_callback(sched_time_t waketime);
-
 #ifdef __cplusplus
 }
 #endif
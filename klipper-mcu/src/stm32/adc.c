@@ -4,6 +4,13 @@
  * 
  * ADC configuration and reading for STM32F407.
  * Supports ADC1 with single conversion mode for temperature reading.
+ *
+ * With CONFIG_ADC_SCAN the configured channels are instead converted
+ * as one scan sequence triggered by TIM2 TRGO. DMA2 stream 0 writes
+ * the results into a circular buffer of two halves, each holding
+ * CONFIG_ADC_OVERSAMPLE scans; the half/complete interrupts average a
+ * finished half per channel. adc_read() then just returns the latest
+ * average instead of converting.
  * Follows Klipper coding style (C99, snake_case).
  */
 
@@ -11,6 +18,8 @@
 #include "gpio.h"
 #include "internal.h"
 #include "board/irq.h"
+#include "sched.h"
+#include <stddef.h>
 
 /* ========== ADC Register Definitions ========== */
 
@@ -44,7 +53,49 @@
 
 /* RCC register for ADC clock enable */
 #define RCC_BASE                0x40023800
+#define RCC_AHB1ENR             (*(volatile uint32_t *)(RCC_BASE + 0x30))
 #define RCC_APB2ENR             (*(volatile uint32_t *)(RCC_BASE + 0x44))
+#define RCC_AHB1ENR_DMA2EN      (1 << 22)
+
+/* TIM2 registers (scan trigger) */
+#define TIM2_CR1                (*(volatile uint32_t *)(TIM2_BASE + 0x00))
+#define TIM2_CR2                (*(volatile uint32_t *)(TIM2_BASE + 0x04))
+#define TIM2_EGR                (*(volatile uint32_t *)(TIM2_BASE + 0x14))
+#define TIM2_CNT                (*(volatile uint32_t *)(TIM2_BASE + 0x24))
+#define TIM2_PSC                (*(volatile uint32_t *)(TIM2_BASE + 0x28))
+#define TIM2_ARR                (*(volatile uint32_t *)(TIM2_BASE + 0x2C))
+
+#define TIM_CR1_CEN             (1 << 0)    /* Counter enable */
+#define TIM_CR2_MMS_UPDATE      (2 << 4)    /* TRGO on update event */
+#define TIM_EGR_UG              (1 << 0)    /* Update generation */
+
+/* DMA2 stream 0 registers (ADC1 is request channel 0) */
+#define ADC_DMA_STREAM_BASE     (DMA2_BASE + 0x10)
+#define ADC_DMA_CR              (*(volatile uint32_t *)(ADC_DMA_STREAM_BASE + 0x00))
+#define ADC_DMA_NDTR            (*(volatile uint32_t *)(ADC_DMA_STREAM_BASE + 0x04))
+#define ADC_DMA_PAR             (*(volatile uint32_t *)(ADC_DMA_STREAM_BASE + 0x08))
+#define ADC_DMA_M0AR            (*(volatile uint32_t *)(ADC_DMA_STREAM_BASE + 0x0C))
+#define ADC_DMA_FCR             (*(volatile uint32_t *)(ADC_DMA_STREAM_BASE + 0x14))
+#define DMA2_LISR               (*(volatile uint32_t *)(DMA2_BASE + 0x00))
+#define DMA2_LIFCR              (*(volatile uint32_t *)(DMA2_BASE + 0x08))
+
+#define DMA_SCR_EN              (1 << 0)    /* Stream enable */
+#define DMA_SCR_TEIE            (1 << 2)    /* Transfer error interrupt enable */
+#define DMA_SCR_HTIE            (1 << 3)    /* Half transfer interrupt enable */
+#define DMA_SCR_TCIE            (1 << 4)    /* Transfer complete interrupt enable */
+#define DMA_SCR_CIRC            (1 << 8)    /* Circular mode */
+#define DMA_SCR_MINC            (1 << 10)   /* Memory increment */
+#define DMA_SCR_PSIZE_16        (1 << 11)   /* Peripheral half-word */
+#define DMA_SCR_MSIZE_16        (1 << 13)   /* Memory half-word */
+#define DMA_SCR_PL_HIGH         (2 << 16)   /* Priority level high */
+
+/* Stream 0 flags sit at bit 0 of LISR/LIFCR */
+#define DMA_S0_FEIF             (1 << 0)    /* FIFO error */
+#define DMA_S0_DMEIF            (1 << 2)    /* Direct mode error */
+#define DMA_S0_TEIF             (1 << 3)    /* Transfer error */
+#define DMA_S0_HTIF             (1 << 4)    /* Half transfer */
+#define DMA_S0_TCIF             (1 << 5)    /* Transfer complete */
+#define DMA_S0_ALL              0x3D
 
 /* ========== ADC Status Register (SR) Bits ========== */
 
@@ -87,7 +138,9 @@
 #define ADC_CR2_JEXTEN_MASK     (0x03 << 20) /* Injected external trigger enable */
 #define ADC_CR2_JSWSTART        (1 << 22)   /* Start injected conversion */
 #define ADC_CR2_EXTSEL_MASK     (0x0F << 24) /* External event for regular */
+#define ADC_CR2_EXTSEL_TIM2_TRGO (0x06 << 24) /* Regular trigger: TIM2 TRGO */
 #define ADC_CR2_EXTEN_MASK      (0x03 << 28) /* Regular external trigger enable */
+#define ADC_CR2_EXTEN_RISING    (0x01 << 28) /* Trigger on rising edge */
 #define ADC_CR2_SWSTART         (1 << 30)   /* Start regular conversion */
 
 /* ========== ADC Common Control Register (CCR) Bits ========== */
@@ -107,6 +160,33 @@ static uint8_t s_adc_initialized = 0;
 /* Channel configuration tracking */
 static uint8_t s_channel_configured[ADC_CHANNEL_MAX] = {0};
 
+#if CONFIG_ADC_SCAN
+
+#if CONFIG_ADC_OVERSAMPLE & (CONFIG_ADC_OVERSAMPLE - 1)
+#error "CONFIG_ADC_OVERSAMPLE must be a power of two"
+#endif
+
+/* Scan order: channel number per sequence slot */
+static uint8_t s_scan_channels[ADC_SCAN_MAX_CHANNELS];
+static uint8_t s_scan_count = 0;
+
+/* Sequence slot per channel, 0xFF if not scanned */
+static uint8_t s_scan_slot[ADC_CHANNEL_MAX];
+
+/* DMA target: two halves of CONFIG_ADC_OVERSAMPLE scans each */
+static uint16_t s_scan_buf[2 * CONFIG_ADC_OVERSAMPLE * ADC_SCAN_MAX_CHANNELS];
+
+/* Latest averaged value per slot */
+static volatile uint16_t s_scan_value[ADC_SCAN_MAX_CHANNELS];
+
+/* Number of DMA transfer errors seen */
+static volatile uint16_t s_scan_errors = 0;
+
+/* Called after each new set of averages */
+static adc_scan_fn_t s_scan_callback = NULL;
+
+#endif /* CONFIG_ADC_SCAN */
+
 /* ========== Private Functions ========== */
 
 /**
@@ -184,6 +264,172 @@ wait_for_conversion(uint32_t timeout_us)
     return 0;
 }
 
+/**
+ * @brief   Run one blocking software-triggered conversion
+ * @param   channel ADC channel (0-18)
+ * @return  ADC value or -2 on timeout
+ */
+static int32_t
+adc_convert_single(uint8_t channel)
+{
+    uint32_t irqflag = irq_disable();
+    
+    /* Clear status flags */
+    ADC1_SR = 0;
+    
+    /* Set channel in sequence register */
+    ADC1_SQR3 = channel;
+    
+    /* Start conversion */
+    ADC1_CR2 |= ADC_CR2_SWSTART;
+    
+    /* Wait for conversion to complete (timeout ~100us) */
+    int result = wait_for_conversion(100);
+    
+    if (result < 0) {
+        irq_restore(irqflag);
+        return -2;  /* Timeout */
+    }
+    
+    /* Read result */
+    uint32_t value = ADC1_DR & 0x0FFF;
+    
+    irq_restore(irqflag);
+    
+    return (int32_t)value;
+}
+
+#if CONFIG_ADC_SCAN
+/**
+ * @brief   Stop the scan trigger, ADC DMA requests and the DMA stream
+ */
+static void
+adc_scan_stop(void)
+{
+    TIM2_CR1 = 0;
+    ADC1_CR2 &= ~(ADC_CR2_EXTEN_MASK | ADC_CR2_EXTSEL_MASK
+                  | ADC_CR2_DMA | ADC_CR2_DDS);
+    ADC1_CR1 &= ~ADC_CR1_SCAN;
+    ADC1_CR2 |= ADC_CR2_EOCS;
+    ADC1_SQR1 = 0;              /* Back to a single-entry sequence */
+    
+    ADC_DMA_CR &= ~DMA_SCR_EN;
+    while (ADC_DMA_CR & DMA_SCR_EN) {
+    }
+    DMA2_LIFCR = DMA_S0_ALL;
+    ADC1_SR = 0;
+}
+
+/**
+ * @brief   Program the scan sequence and start triggered conversions
+ *
+ * Each channel is first converted once in software so adc_read() has a
+ * value before the first DMA half completes.
+ */
+static void
+adc_scan_start(void)
+{
+    uint8_t i;
+    
+    adc_scan_stop();
+    if (s_scan_count == 0) {
+        return;
+    }
+    
+    for (i = 0; i < s_scan_count; i++) {
+        int32_t value = adc_convert_single(s_scan_channels[i]);
+        s_scan_value[i] = (value < 0) ? 0 : (uint16_t)value;
+    }
+    
+    /* Regular sequence: SQ1-6 in SQR3, SQ7-12 in SQR2, SQ13-16 in SQR1 */
+    uint32_t sqr[3] = { 0, 0, 0 };
+    for (i = 0; i < s_scan_count; i++) {
+        sqr[i / 6] |= (uint32_t)s_scan_channels[i] << ((i % 6) * 5);
+    }
+    ADC1_SQR3 = sqr[0];
+    ADC1_SQR2 = sqr[1];
+    ADC1_SQR1 = sqr[2] | ((uint32_t)(s_scan_count - 1) << 20);
+    
+    /* Circular DMA, half-word transfers, half and full interrupts */
+    RCC_AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+    ADC_DMA_PAR = (uint32_t)(uintptr_t)&ADC1_DR;
+    ADC_DMA_M0AR = (uint32_t)(uintptr_t)s_scan_buf;
+    ADC_DMA_NDTR = 2 * CONFIG_ADC_OVERSAMPLE * s_scan_count;
+    ADC_DMA_FCR = 0;                /* Direct mode */
+    ADC_DMA_CR = DMA_SCR_PL_HIGH | DMA_SCR_MSIZE_16 | DMA_SCR_PSIZE_16
+                 | DMA_SCR_MINC | DMA_SCR_CIRC
+                 | DMA_SCR_TCIE | DMA_SCR_HTIE | DMA_SCR_TEIE;
+    ADC_DMA_CR |= DMA_SCR_EN;
+    
+    /* Filtering is not time critical: stay below scheduler and serial */
+    nvic_set_priority(IRQ_DMA2_STREAM0, IRQ_PRIO_HOUSEKEEPING);
+    nvic_clear_pending(IRQ_DMA2_STREAM0);
+    nvic_enable_irq(IRQ_DMA2_STREAM0);
+    
+    ADC1_CR1 |= ADC_CR1_SCAN;
+    ADC1_CR2 = (ADC1_CR2 & ~(ADC_CR2_EOCS | ADC_CR2_EXTSEL_MASK
+                             | ADC_CR2_EXTEN_MASK))
+               | ADC_CR2_DMA | ADC_CR2_DDS
+               | ADC_CR2_EXTSEL_TIM2_TRGO | ADC_CR2_EXTEN_RISING;
+    
+    /* TIM2 update at CONFIG_ADC_SCAN_FREQ drives TRGO */
+    enable_pclock(TIM2_BASE);
+    TIM2_CR1 = 0;
+    TIM2_PSC = (timer_get_clock() / 1000000) - 1;
+    TIM2_ARR = (1000000 / CONFIG_ADC_SCAN_FREQ) - 1;
+    TIM2_CR2 = TIM_CR2_MMS_UPDATE;
+    TIM2_CNT = 0;
+    TIM2_EGR = TIM_EGR_UG;
+    TIM2_CR1 = TIM_CR1_CEN;
+}
+
+/**
+ * @brief   Average one finished buffer half into s_scan_value
+ * @param   half    Start of the half (CONFIG_ADC_OVERSAMPLE scans)
+ */
+static void
+adc_scan_average(const uint16_t *half)
+{
+    uint8_t count = s_scan_count;
+    uint8_t slot;
+    
+    for (slot = 0; slot < count; slot++) {
+        const uint16_t *p = &half[slot];
+        uint32_t sum = 0;
+        uint32_t n;
+        for (n = 0; n < CONFIG_ADC_OVERSAMPLE; n++) {
+            sum += *p;
+            p += count;
+        }
+        s_scan_value[slot] = (uint16_t)((sum + CONFIG_ADC_OVERSAMPLE / 2)
+                                        / CONFIG_ADC_OVERSAMPLE);
+    }
+}
+
+/**
+ * @brief   ADC1 DMA interrupt - filter the half that just completed
+ */
+void
+DMA2_Stream0_IRQHandler(void)
+{
+    uint32_t flags = DMA2_LISR & DMA_S0_ALL;
+    DMA2_LIFCR = flags;
+    
+    if (flags & DMA_S0_HTIF) {
+        adc_scan_average(s_scan_buf);
+    }
+    if (flags & DMA_S0_TCIF) {
+        adc_scan_average(&s_scan_buf[CONFIG_ADC_OVERSAMPLE * s_scan_count]);
+    }
+    if (flags & DMA_S0_TEIF) {
+        s_scan_errors++;
+    }
+    if ((flags & (DMA_S0_HTIF | DMA_S0_TCIF)) && s_scan_callback != NULL) {
+        s_scan_callback(sched_get_time());
+    }
+}
+#endif /* CONFIG_ADC_SCAN */
+
 /* ========== Public Functions ========== */
 
 /**
@@ -232,6 +478,13 @@ adc_init(void)
         __asm__ __volatile__("nop");
     }
     
+#if CONFIG_ADC_SCAN
+    for (int ch = 0; ch < ADC_CHANNEL_MAX; ch++) {
+        s_scan_slot[ch] = 0xFF;
+    }
+    s_scan_count = 0;
+#endif
+    
     s_adc_initialized = 1;
 }
 
@@ -263,6 +516,19 @@ adc_setup(uint8_t gpio, adc_sampletime_t sample_time)
         s_channel_configured[channel] = 1;
     }
     
+#if CONFIG_ADC_SCAN
+    /* Append to the scan sequence and restart it */
+    if (s_scan_slot[channel] == 0xFF) {
+        if (s_scan_count >= ADC_SCAN_MAX_CHANNELS) {
+            return -2;
+        }
+        s_scan_slot[channel] = s_scan_count;
+        s_scan_channels[s_scan_count] = (uint8_t)channel;
+        s_scan_count++;
+        adc_scan_start();
+    }
+#endif
+    
     return 0;
 }
 
@@ -296,31 +562,17 @@ adc_read_channel(uint8_t channel)
         adc_init();
     }
     
-    uint32_t irqflag = irq_disable();
-    
-    /* Clear status flags */
-    ADC1_SR = 0;
-    
-    /* Set channel in sequence register */
-    ADC1_SQR3 = channel;
-    
-    /* Start conversion */
-    ADC1_CR2 |= ADC_CR2_SWSTART;
-    
-    /* Wait for conversion to complete (timeout ~100us) */
-    int result = wait_for_conversion(100);
-    
-    if (result < 0) {
-        irq_restore(irqflag);
-        return -2;  /* Timeout */
+#if CONFIG_ADC_SCAN
+    /* Scanned channels are read from the filtered results */
+    if (s_scan_count != 0) {
+        if (channel >= ADC_CHANNEL_MAX || s_scan_slot[channel] == 0xFF) {
+            return -3;  /* Not part of the running scan */
+        }
+        return s_scan_value[s_scan_slot[channel]];
     }
+#endif
     
-    /* Read result */
-    uint32_t value = ADC1_DR & 0x0FFF;
-    
-    irq_restore(irqflag);
-    
-    return (int32_t)value;
+    return adc_convert_single(channel);
 }
 
 /**
@@ -332,6 +584,21 @@ adc_get_channel(uint8_t gpio)
     return get_adc_channel_from_gpio(gpio);
 }
 
+/**
+ * @brief   Register the scan completion handler
+ */
+void
+adc_scan_set_callback(adc_scan_fn_t fn)
+{
+#if CONFIG_ADC_SCAN
+    uint32_t irqflag = irq_mask_level(IRQ_PRIO_HOUSEKEEPING);
+    s_scan_callback = fn;
+    irq_unmask_level(irqflag);
+#else
+    (void)fn;
+#endif
+}
+
 /**
  * @brief   Check if ADC is ready for conversion
  */
@@ -342,6 +609,13 @@ adc_is_ready(void)
         return 0;
     }
     
+#if CONFIG_ADC_SCAN
+    /* Scan results can always be read */
+    if (s_scan_count != 0) {
+        return 1;
+    }
+#endif
+    
     /* Check if ADC is enabled and not currently converting */
     if ((ADC1_CR2 & ADC_CR2_ADON) && !(ADC1_SR & ADC_SR_STRT)) {
         return 1;
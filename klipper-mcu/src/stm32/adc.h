@@ -21,6 +21,9 @@
 /* Maximum number of ADC channels */
 #define ADC_CHANNEL_MAX         16
 
+/* Maximum number of channels in the DMA scan sequence (CONFIG_ADC_SCAN) */
+#define ADC_SCAN_MAX_CHANNELS   8
+
 /* ADC sample time options */
 typedef enum {
     ADC_SAMPLETIME_3CYCLES      = 0,    /* 3 cycles */
@@ -40,6 +43,15 @@ typedef struct {
     adc_sampletime_t sample_time;       /* Sample time */
 } adc_channel_config_t;
 
+/**
+ * @brief   Scan completion handler type (CONFIG_ADC_SCAN)
+ * @param   time    Scheduler clock when the new averages were stored
+ *
+ * Called from the DMA interrupt each time a fresh set of averages is
+ * available, i.e. every CONFIG_ADC_OVERSAMPLE scans.
+ */
+typedef void (*adc_scan_fn_t)(uint32_t time);
+
 /* ========== ADC Functions ========== */
 
 /**
@@ -58,6 +70,8 @@ void adc_init(void);
  * 
  * Configures the GPIO pin for analog mode and sets up the ADC channel.
  * The channel number is determined from the GPIO pin.
+ * With CONFIG_ADC_SCAN the channel is added to the scan sequence and
+ * the scan is restarted (-2 if the sequence is full).
  */
 int adc_setup(uint8_t gpio, adc_sampletime_t sample_time);
 
@@ -68,6 +82,8 @@ int adc_setup(uint8_t gpio, adc_sampletime_t sample_time);
  * 
  * Performs a single conversion on the specified channel and returns
  * the result. This is a blocking call.
+ * With CONFIG_ADC_SCAN running it instead returns the latest average
+ * of CONFIG_ADC_OVERSAMPLE scans without touching the hardware.
  */
 int32_t adc_read(uint8_t gpio);
 
@@ -77,9 +93,21 @@ int32_t adc_read(uint8_t gpio);
  * @return  ADC value (0-4095) or negative on error
  * 
  * Performs a single conversion on the specified channel number.
+ * While a scan is running, returns the scanned channel's latest
+ * average, or -3 if the channel is not part of the scan.
  */
 int32_t adc_read_channel(uint8_t channel);
 
+/**
+ * @brief   Register the scan completion handler
+ * @param   fn      Handler, or NULL to remove it
+ *
+ * Lets consumers run right after new averages land instead of polling
+ * at an unrelated rate. Without CONFIG_ADC_SCAN the handler is never
+ * called.
+ */
+void adc_scan_set_callback(adc_scan_fn_t fn);
+
 /**
  * @brief   Get ADC channel number from GPIO pin
  * @param   gpio    GPIO pin
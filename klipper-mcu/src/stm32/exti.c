@@ -0,0 +1,203 @@
+/**
+ * @file    exti.c
+ * @brief   STM32F407 external interrupt (EXTI) implementation
+ *
+ * EXTI lines 0-15 are shared by all GPIO ports: SYSCFG_EXTICRx selects
+ * which port drives each line, so only one pin per pin number can be
+ * used at a time. Lines 0-4 have their own vectors, 5-9 and 10-15 share
+ * one vector each. The handler reads the scheduler clock before
+ * anything else so the reported edge time only carries the interrupt
+ * entry latency.
+ * Follows Klipper coding style (C99, snake_case).
+ */
+
+#include "exti.h"
+#include "internal.h"
+#include "board/irq.h"
+#include "sched.h"
+#include <stddef.h>
+
+/* ========== Register Definitions ========== */
+
+#define RCC_BASE                0x40023800
+#define RCC_APB2ENR             (*(volatile uint32_t *)(RCC_BASE + 0x44))
+#define RCC_APB2ENR_SYSCFGEN    (1 << 14)
+
+#define SYSCFG_BASE             0x40013800
+#define SYSCFG_EXTICR           ((volatile uint32_t *)(SYSCFG_BASE + 0x08))
+
+#define EXTI_BASE               0x40013C00
+#define EXTI_IMR                (*(volatile uint32_t *)(EXTI_BASE + 0x00))
+#define EXTI_RTSR               (*(volatile uint32_t *)(EXTI_BASE + 0x08))
+#define EXTI_FTSR               (*(volatile uint32_t *)(EXTI_BASE + 0x0C))
+#define EXTI_PR                 (*(volatile uint32_t *)(EXTI_BASE + 0x14))
+
+/* ========== Private Variables ========== */
+
+typedef struct {
+    exti_handler_fn_t fn;       /* Edge handler, NULL if unused */
+    void *arg;                  /* Handler argument */
+    uint8_t gpio;               /* Pin that owns the line */
+} exti_line_t;
+
+static exti_line_t s_lines[EXTI_GPIO_LINES];
+
+/* ========== Private Functions ========== */
+
+/**
+ * @brief   Get the NVIC vector serving an EXTI line
+ */
+static uint8_t
+exti_line_irq(uint8_t line)
+{
+    if (line <= 4) {
+        return IRQ_EXTI0 + line;
+    }
+    return (line <= 9) ? IRQ_EXTI9_5 : IRQ_EXTI15_10;
+}
+
+/**
+ * @brief   Dispatch pending lines in a vector's range
+ * @param   mask    EXTI lines served by the vector
+ */
+static void
+exti_dispatch(uint32_t mask)
+{
+    uint32_t time = sched_get_time();
+    uint32_t pending = EXTI_PR & EXTI_IMR & mask;
+
+    /* Clear before calling out so an edge during the handler re-pends */
+    EXTI_PR = pending;
+
+    while (pending) {
+        uint8_t line = __builtin_ctz(pending);
+        pending &= pending - 1;
+        if (s_lines[line].fn != NULL) {
+            s_lines[line].fn(s_lines[line].arg, time);
+        }
+    }
+}
+
+/* ========== Public Functions ========== */
+
+/**
+ * @brief   Route a GPIO pin to its EXTI line
+ */
+int
+exti_setup(uint8_t gpio, uint8_t edges, exti_handler_fn_t fn, void *arg)
+{
+    uint8_t line = GPIO_PIN(gpio);
+    uint32_t bit = BIT(line);
+
+    if (fn == NULL) {
+        return -1;
+    }
+    if (s_lines[line].fn != NULL && s_lines[line].gpio != gpio) {
+        return -1;
+    }
+
+    RCC_APB2ENR |= RCC_APB2ENR_SYSCFGEN;
+
+    uint32_t irqflag = irq_disable();
+
+    EXTI_IMR &= ~bit;
+    s_lines[line].fn = fn;
+    s_lines[line].arg = arg;
+    s_lines[line].gpio = gpio;
+
+    /* SYSCFG_EXTICR1-4: 4 bits of port number per line */
+    volatile uint32_t *p_cr = &SYSCFG_EXTICR[line / 4];
+    uint32_t shift = (line % 4) * 4;
+    *p_cr = (*p_cr & ~(0x0FUL << shift)) | ((uint32_t)GPIO_PORT(gpio) << shift);
+
+    if (edges & EXTI_EDGE_RISING) {
+        EXTI_RTSR |= bit;
+    } else {
+        EXTI_RTSR &= ~bit;
+    }
+    if (edges & EXTI_EDGE_FALLING) {
+        EXTI_FTSR |= bit;
+    } else {
+        EXTI_FTSR &= ~bit;
+    }
+    EXTI_PR = bit;
+
+    irq_restore(irqflag);
+
+    uint8_t irq = exti_line_irq(line);
+    nvic_set_priority(irq, EXTI_IRQ_PRIORITY);
+    nvic_clear_pending(irq);
+    nvic_enable_irq(irq);
+
+    return 0;
+}
+
+/**
+ * @brief   Unmask the EXTI line of a pin
+ */
+void
+exti_enable(uint8_t gpio)
+{
+    uint32_t bit = BIT(GPIO_PIN(gpio));
+    uint32_t irqflag = irq_disable();
+    EXTI_PR = bit;
+    EXTI_IMR |= bit;
+    irq_restore(irqflag);
+}
+
+/**
+ * @brief   Mask the EXTI line of a pin
+ */
+void
+exti_disable(uint8_t gpio)
+{
+    uint32_t bit = BIT(GPIO_PIN(gpio));
+    uint32_t irqflag = irq_disable();
+    EXTI_IMR &= ~bit;
+    EXTI_PR = bit;
+    irq_restore(irqflag);
+}
+
+/* ========== Interrupt Handlers ========== */
+
+void
+EXTI0_IRQHandler(void)
+{
+    exti_dispatch(BIT(0));
+}
+
+void
+EXTI1_IRQHandler(void)
+{
+    exti_dispatch(BIT(1));
+}
+
+void
+EXTI2_IRQHandler(void)
+{
+    exti_dispatch(BIT(2));
+}
+
+void
+EXTI3_IRQHandler(void)
+{
+    exti_dispatch(BIT(3));
+}
+
+void
+EXTI4_IRQHandler(void)
+{
+    exti_dispatch(BIT(4));
+}
+
+void
+EXTI9_5_IRQHandler(void)
+{
+    exti_dispatch(0x03E0);      /* Lines 5-9 */
+}
+
+void
+EXTI15_10_IRQHandler(void)
+{
+    exti_dispatch(0xFC00);      /* Lines 10-15 */
+}
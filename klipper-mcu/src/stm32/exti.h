@@ -0,0 +1,66 @@
+/**
+ * @file    exti.h
+ * @brief   STM32F407 external interrupt (EXTI) interface
+ *
+ * Edge interrupts on GPIO input pins. Each handler receives the TIM5
+ * scheduler clock read on entry to the interrupt, so callers get the
+ * edge time without waiting for a polling period.
+ * Follows Klipper coding style (C99, snake_case).
+ */
+
+#ifndef STM32_EXTI_H
+#define STM32_EXTI_H
+
+#include <stdint.h>
+
+/* ========== EXTI Definitions ========== */
+
+/* Edge selection (may be combined) */
+#define EXTI_EDGE_RISING        (1 << 0)
+#define EXTI_EDGE_FALLING       (1 << 1)
+
+/* Number of EXTI lines routed to GPIO pins */
+#define EXTI_GPIO_LINES         16
+
+/*
+ * NVIC priority of the EXTI interrupts. Equal to TIM5 so an edge
+ * handler never preempts scheduler timers (and vice versa).
+ */
+#define EXTI_IRQ_PRIORITY       IRQ_PRIO_STEP
+
+/**
+ * @brief   Edge handler type (called in interrupt context)
+ * @param   arg     User argument from exti_setup()
+ * @param   time    Scheduler clock at interrupt entry
+ */
+typedef void (*exti_handler_fn_t)(void *arg, uint32_t time);
+
+/* ========== EXTI Functions ========== */
+
+/**
+ * @brief   Route a GPIO pin to its EXTI line
+ * @param   gpio    GPIO pin (already configured as input)
+ * @param   edges   EXTI_EDGE_* mask
+ * @param   fn      Handler called on each selected edge
+ * @param   arg     Handler argument
+ * @retval  0 on success, -1 if the line is used by a pin on another port
+ *
+ * The line is left masked; call exti_enable() to start receiving edges.
+ */
+int exti_setup(uint8_t gpio, uint8_t edges, exti_handler_fn_t fn, void *arg);
+
+/**
+ * @brief   Unmask the EXTI line of a pin
+ * @param   gpio    GPIO pin passed to exti_setup()
+ *
+ * Any edge latched while the line was masked is discarded.
+ */
+void exti_enable(uint8_t gpio);
+
+/**
+ * @brief   Mask the EXTI line of a pin
+ * @param   gpio    GPIO pin passed to exti_setup()
+ */
+void exti_disable(uint8_t gpio);
+
+#endif /* STM32_EXTI_H */
@@ -286,37 +286,23 @@ gpio_out_read(uint8_t gpio)
     return (port->ODR >> pin) & 1;
 }
 
-
-/* ========== PWM Functions (Software PWM via GPIO) ========== */
-
 /**
- * @brief   Setup PWM on a GPIO pin (software PWM)
- * @param   pin         GPIO pin
- * @param   cycle_time  PWM cycle time in clock ticks
- * @param   value       Initial duty cycle value (0-255)
- * 
- * @note    This is a simplified software PWM implementation.
- *          For hardware PWM, use timer-based implementation.
+ * @brief   Resolve GPIO pin for fast output
  */
-void
-pwm_setup(uint8_t pin, uint32_t cycle_time, uint8_t value)
+gpio_fast_t
+gpio_fast_lookup(uint8_t gpio)
 {
-    (void)cycle_time;
+    static volatile uint32_t dummy_bsrr;
+    gpio_fast_t out;
     
-    /* Configure pin as output */
-    gpio_out_setup(pin, value ? 1 : 0);
-}
-
-/**
- * @brief   Write PWM duty cycle value
- * @param   pin     GPIO pin
- * @param   value   Duty cycle value (0-255, 0=off, 255=full on)
- * 
- * @note    Simplified implementation - just on/off based on threshold
- */
-void
-pwm_write(uint8_t pin, uint8_t value)
-{
-    /* Simple threshold: >127 = on, <=127 = off */
-    gpio_out_write(pin, value > 127 ? 1 : 0);
+    gpio_regs_t *port = gpio_get_port(gpio);
+    if (!port) {
+        out.bsrr = &dummy_bsrr;
+        out.bit = 0;
+        return out;
+    }
+    
+    out.bsrr = &port->BSRR;
+    out.bit = 1UL << GPIO_PIN(gpio);
+    return out;
 }
@@ -185,6 +185,34 @@ typedef struct {
  */
 gpio_regs_t *gpio_get_port(uint8_t gpio);
 
+/* ========== Fast Output Access ========== */
+
+/*
+ * Pre-resolved output pin for interrupt fast paths. The port lookup and
+ * bit shift are done once at setup so each write is a single BSRR store.
+ */
+typedef struct {
+    volatile uint32_t *bsrr;    /* Port bit set/reset register */
+    uint32_t bit;               /* Pin mask (set half of BSRR) */
+} gpio_fast_t;
+
+/**
+ * @brief   Resolve GPIO pin for fast output
+ * @param   gpio    GPIO pin (already configured as output)
+ * @return  Fast output handle; invalid pins map to a dummy register
+ */
+gpio_fast_t gpio_fast_lookup(uint8_t gpio);
+
+/**
+ * @brief   Write fast output
+ * @param   out     Handle from gpio_fast_lookup()
+ * @param   val     Output value (0 or 1)
+ */
+static inline void gpio_fast_write(gpio_fast_t out, uint8_t val)
+{
+    *out.bsrr = val ? out.bit : (out.bit << 16);
+}
+
 /* ========== Alternate Function Mappings ========== */
 
 /* USART alternate functions */
@@ -219,4 +247,7 @@ gpio_regs_t *gpio_get_port(uint8_t gpio);
 #define GPIO_AF_I2C2            4
 #define GPIO_AF_I2C3            4
 
+/* USB alternate functions */
+#define GPIO_AF_OTG_FS          10
+
 #endif /* STM32_GPIO_H */
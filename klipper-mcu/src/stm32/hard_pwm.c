@@ -0,0 +1,173 @@
+/**
+ * @file    hard_pwm.c
+ * @brief   STM32F407 timer-based hardware PWM
+ *
+ * Drives PWM pins from TIM3/TIM4 output compare channels (PWM mode 1),
+ * so duty changes are a single CCR write and no scheduler timer runs.
+ * Each timer has one period shared by its four channels; the first
+ * pin set up on a timer fixes it. TIM2 (ADC scan trigger) and TIM5
+ * (scheduler clock) are not used here.
+ *
+ * The counter period is PWM_HW_MAX_VALUE ticks, so an 8-bit value maps
+ * straight to CCR: 0 is always off and 255 (CCR > ARR) is always on.
+ * Follows Klipper coding style (C99, snake_case).
+ */
+
+#include "hard_pwm.h"
+#include "gpio.h"
+#include "internal.h"
+#include "board/irq.h"
+#include <stddef.h>
+
+/* ========== Register Definitions ========== */
+
+typedef struct {
+    volatile uint32_t CR1;      /* 0x00 Control register 1 */
+    volatile uint32_t CR2;      /* 0x04 Control register 2 */
+    volatile uint32_t SMCR;     /* 0x08 Slave mode control */
+    volatile uint32_t DIER;     /* 0x0C DMA/interrupt enable */
+    volatile uint32_t SR;       /* 0x10 Status */
+    volatile uint32_t EGR;      /* 0x14 Event generation */
+    volatile uint32_t CCMR1;    /* 0x18 Capture/compare mode 1 */
+    volatile uint32_t CCMR2;    /* 0x1C Capture/compare mode 2 */
+    volatile uint32_t CCER;     /* 0x20 Capture/compare enable */
+    volatile uint32_t CNT;      /* 0x24 Counter */
+    volatile uint32_t PSC;      /* 0x28 Prescaler */
+    volatile uint32_t ARR;      /* 0x2C Auto-reload */
+    volatile uint32_t RCR;      /* 0x30 Repetition counter */
+    volatile uint32_t CCR[4];   /* 0x34-0x40 Capture/compare 1-4 */
+} tim_regs_t;
+
+#define TIM_CR1_CEN             (1 << 0)    /* Counter enable */
+#define TIM_CR1_ARPE            (1 << 7)    /* ARR preload enable */
+#define TIM_EGR_UG              (1 << 0)    /* Update generation */
+#define TIM_CCMR_OC_PWM1        (6 << 4)    /* OCxM = PWM mode 1 */
+#define TIM_CCMR_OC_PE          (1 << 3)    /* OCx preload enable */
+
+/* Output value that means "always on"; ARR is one less */
+#define PWM_HW_MAX_VALUE        255
+
+/* ========== Pin Mapping ========== */
+
+typedef struct {
+    uint8_t gpio;               /* Pin */
+    uint8_t timer;              /* Index into s_pwm_timers */
+    uint8_t channel;            /* Output compare channel (0-3) */
+} pwm_pin_map_t;
+
+/* TIM3 and TIM4 share alternate function 2 on every pin below */
+static const uint32_t s_pwm_timers[] = { TIM3_BASE, TIM4_BASE };
+
+static const pwm_pin_map_t s_pwm_pins[] = {
+    { GPIO(GPIO_PORT_A, 6),  0, 0 },
+    { GPIO(GPIO_PORT_A, 7),  0, 1 },
+    { GPIO(GPIO_PORT_B, 0),  0, 2 },
+    { GPIO(GPIO_PORT_B, 1),  0, 3 },
+    { GPIO(GPIO_PORT_B, 4),  0, 0 },
+    { GPIO(GPIO_PORT_B, 5),  0, 1 },
+    { GPIO(GPIO_PORT_C, 6),  0, 0 },
+    { GPIO(GPIO_PORT_C, 7),  0, 1 },
+    { GPIO(GPIO_PORT_C, 8),  0, 2 },
+    { GPIO(GPIO_PORT_C, 9),  0, 3 },
+    { GPIO(GPIO_PORT_B, 6),  1, 0 },
+    { GPIO(GPIO_PORT_B, 7),  1, 1 },
+    { GPIO(GPIO_PORT_B, 8),  1, 2 },
+    { GPIO(GPIO_PORT_B, 9),  1, 3 },
+    { GPIO(GPIO_PORT_D, 12), 1, 0 },
+    { GPIO(GPIO_PORT_D, 13), 1, 1 },
+    { GPIO(GPIO_PORT_D, 14), 1, 2 },
+    { GPIO(GPIO_PORT_D, 15), 1, 3 },
+};
+
+/* Prescaler each timer was started with (0 = not started) */
+static uint32_t s_pwm_timer_psc[ARRAY_SIZE(s_pwm_timers)];
+
+/* ========== Private Functions ========== */
+
+/**
+ * @brief   Find the timer channel wired to a pin
+ * @return  Mapping entry or NULL if the pin has no PWM channel
+ */
+static const pwm_pin_map_t *
+pwm_lookup(uint8_t pin)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE(s_pwm_pins); i++) {
+        if (s_pwm_pins[i].gpio == pin) {
+            return &s_pwm_pins[i];
+        }
+    }
+    return NULL;
+}
+
+static tim_regs_t *
+pwm_timer(const pwm_pin_map_t *map)
+{
+    return (tim_regs_t *)(uintptr_t)s_pwm_timers[map->timer];
+}
+
+/* ========== Public Functions ========== */
+
+/**
+ * @brief   Set up hardware PWM on a pin
+ */
+int
+pwm_setup(uint8_t pin, uint32_t cycle_time, uint8_t value)
+{
+    const pwm_pin_map_t *map = pwm_lookup(pin);
+    if (map == NULL || cycle_time == 0) {
+        return -1;
+    }
+
+    /* Timer ticks per period, split into PSC x (ARR + 1) */
+    uint64_t ticks = (uint64_t)timer_get_clock() * cycle_time
+                     / CONFIG_STEP_TIMER_FREQ;
+    uint32_t psc = (uint32_t)(ticks / PWM_HW_MAX_VALUE);
+    if (psc == 0) {
+        psc = 1;                /* Fastest rate the 8-bit period allows */
+    } else if (psc > 0x10000) {
+        psc = 0x10000;
+    }
+
+    tim_regs_t *tim = pwm_timer(map);
+    uint32_t irqflag = irq_disable();
+
+    if (s_pwm_timer_psc[map->timer] == 0) {
+        enable_pclock(s_pwm_timers[map->timer]);
+        tim->CR1 = 0;
+        tim->PSC = psc - 1;
+        tim->ARR = PWM_HW_MAX_VALUE - 1;
+        tim->EGR = TIM_EGR_UG;
+        tim->CR1 = TIM_CR1_ARPE | TIM_CR1_CEN;
+        s_pwm_timer_psc[map->timer] = psc;
+    } else if (s_pwm_timer_psc[map->timer] != psc) {
+        irq_restore(irqflag);
+        return -1;
+    }
+
+    /* PWM mode 1 with CCR preload; CCMR1 holds ch1/2, CCMR2 ch3/4 */
+    volatile uint32_t *p_ccmr = (map->channel < 2) ? &tim->CCMR1 : &tim->CCMR2;
+    uint32_t shift = (map->channel & 1) * 8;
+    *p_ccmr = (*p_ccmr & ~(0xFFUL << shift))
+              | ((uint32_t)(TIM_CCMR_OC_PWM1 | TIM_CCMR_OC_PE) << shift);
+    tim->CCR[map->channel] = value;
+    tim->CCER |= 1UL << (map->channel * 4);
+
+    irq_restore(irqflag);
+
+    gpio_af_setup(pin, (map->timer == 0) ? GPIO_AF_TIM3 : GPIO_AF_TIM4);
+
+    return 0;
+}
+
+/**
+ * @brief   Write hardware PWM duty
+ */
+void
+pwm_write(uint8_t pin, uint8_t value)
+{
+    const pwm_pin_map_t *map = pwm_lookup(pin);
+    if (map == NULL) {
+        return;
+    }
+    pwm_timer(map)->CCR[map->channel] = value;
+}
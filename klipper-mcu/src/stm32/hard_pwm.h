@@ -0,0 +1,36 @@
+/**
+ * @file    hard_pwm.h
+ * @brief   STM32F407 timer-based hardware PWM interface
+ *
+ * Backend for src/pwmcmds.c on pins wired to a TIM3/TIM4 channel.
+ * Follows Klipper coding style (C99, snake_case).
+ */
+
+#ifndef STM32_HARD_PWM_H
+#define STM32_HARD_PWM_H
+
+#include <stdint.h>
+
+/* ========== Hardware PWM Functions ========== */
+
+/**
+ * @brief   Set up hardware PWM on a pin
+ * @param   pin         GPIO pin
+ * @param   cycle_time  PWM period in scheduler ticks
+ * @param   value       Initial duty (0-255)
+ * @retval  0 on success, -1 if the pin has no timer channel or its
+ *          timer already runs with a different period
+ *
+ * Channels on one timer share its period; the first pin fixes it.
+ */
+int pwm_setup(uint8_t pin, uint32_t cycle_time, uint8_t value);
+
+/**
+ * @brief   Write hardware PWM duty
+ * @param   pin     GPIO pin set up with pwm_setup()
+ * @param   value   Duty (0-255, 255 = always on), applied at the next
+ *                  period start
+ */
+void pwm_write(uint8_t pin, uint8_t value);
+
+#endif /* STM32_HARD_PWM_H */
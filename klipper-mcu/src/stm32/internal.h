@@ -116,6 +116,15 @@
 #define USART2_BASE             0x40004400
 #define USART3_BASE             0x40004800
 
+/* ========== DMA Definitions ========== */
+
+#define DMA1_BASE               0x40026000
+#define DMA2_BASE               0x40026400
+
+/* ========== SDIO Definitions ========== */
+
+#define SDIO_BASE               0x40012C00
+
 /* ========== Utility Macros ========== */
 
 /* Bit manipulation */
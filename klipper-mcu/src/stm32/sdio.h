@@ -0,0 +1,73 @@
+/**
+ * @file    sdio.h
+ * @brief   STM32F407 SDIO block reader interface
+ *
+ * 4-bit SDIO bus to an SD/SDHC card, reading 512-byte blocks with
+ * DMA2 stream 3. Used by app/sdcard.c to stream print files.
+ * Follows Klipper coding style (C99, snake_case).
+ */
+
+#ifndef STM32_SDIO_H
+#define STM32_SDIO_H
+
+#include <stdint.h>
+
+/* ========== SDIO Definitions ========== */
+
+/* Card block size (bytes) */
+#define SDIO_BLOCK_SIZE         512
+
+/* Return codes */
+#define SDIO_OK                 0       /* Transfer finished */
+#define SDIO_BUSY               1       /* Transfer still running */
+#define SDIO_ERR_NO_CARD        (-1)    /* No card responded */
+#define SDIO_ERR_CMD            (-2)    /* Command timeout/CRC or card error */
+#define SDIO_ERR_DATA           (-3)    /* Data CRC, timeout or overrun */
+#define SDIO_ERR_STATE          (-4)    /* Not initialized or already busy */
+
+/* ========== SDIO Functions ========== */
+
+/**
+ * @brief   Identify the card and switch to 4-bit transfer mode
+ * @return  SDIO_OK on success, negative on error
+ *
+ * Configures PC8-PC12/PD2, runs the identification sequence at 400 kHz
+ * and then raises the bus clock. Blocks until the card leaves its
+ * power-up state (up to about one second). May be called again to
+ * re-identify a swapped card.
+ */
+int sdio_init(void);
+
+/**
+ * @brief   Start reading blocks into memory
+ * @param   block   First block number (LBA)
+ * @param   buf     Destination, 4-byte aligned, in main SRAM (not CCM)
+ * @param   count   Number of blocks (1-127)
+ * @return  SDIO_OK if the transfer was started, negative on error
+ *
+ * Returns as soon as the command is accepted; the data is moved by
+ * DMA. Completion is collected with sdio_read_poll().
+ */
+int sdio_read_start(uint32_t block, void *buf, uint32_t count);
+
+/**
+ * @brief   Check the transfer started by sdio_read_start()
+ * @return  SDIO_BUSY while running, SDIO_OK once the data is in memory,
+ *          negative on error
+ *
+ * After a multi-block read the stop command and the card's busy time
+ * are further SDIO_BUSY steps; no call waits on the card. A new read
+ * may be started once this returned anything but SDIO_BUSY.
+ */
+int sdio_read_poll(void);
+
+/**
+ * @brief   Read blocks and wait for completion
+ * @param   block   First block number (LBA)
+ * @param   buf     Destination, as for sdio_read_start()
+ * @param   count   Number of blocks
+ * @return  SDIO_OK on success, negative on error
+ */
+int sdio_read(uint32_t block, void *buf, uint32_t count);
+
+#endif /* STM32_SDIO_H */
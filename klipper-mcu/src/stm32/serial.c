@@ -3,7 +3,12 @@
  * @brief   STM32F407 USART serial driver implementation
  * 
  * USART configuration and communication for STM32F407.
- * Supports interrupt-driven receive with ring buffer.
+ * Supports interrupt-driven receive with ring buffer, or with
+ * CONFIG_SERIAL_DMA a circular DMA receive buffer drained on IDLE-line,
+ * half-transfer and transfer-complete events plus DMA transmit, so the
+ * CPU takes a few interrupts per line instead of one per byte.
+ * With CONFIG_SERIAL_USB the host link is USB CDC-ACM (usb_cdc.c) and
+ * the USART is left unconfigured.
  * Provides line-buffered input for G-code parsing.
  * Follows Klipper coding style (C99, snake_case).
  */
@@ -12,7 +17,19 @@
 #include "gpio.h"
 #include "internal.h"
 #include "board/irq.h"
+#include "usb_cdc.h"
+#include "command.h"
+#include "profile.h"
+#include "chelper/spsc_ring.h"
 #include <stdarg.h>
+#include <string.h>
+
+/* USART DMA is unused while the host link is USB */
+#if CONFIG_SERIAL_USB
+#define SERIAL_USE_DMA          0
+#else
+#define SERIAL_USE_DMA          CONFIG_SERIAL_DMA
+#endif
 
 /* ========== USART Register Definitions ========== */
 
@@ -34,6 +51,7 @@ typedef struct {
 
 /* RCC registers for clock enable */
 #define RCC_BASE                0x40023800
+#define RCC_AHB1ENR             (*(volatile uint32_t *)(RCC_BASE + 0x30))
 #define RCC_APB1ENR             (*(volatile uint32_t *)(RCC_BASE + 0x40))
 #define RCC_APB2ENR             (*(volatile uint32_t *)(RCC_BASE + 0x44))
 
@@ -91,13 +109,96 @@ typedef struct {
 #define USART_CR3_CTSIE         (1 << 10)   /* CTS interrupt enable */
 #define USART_CR3_ONEBIT        (1 << 11)   /* One sample bit method enable */
 
+/* ========== DMA Register Definitions ========== */
+
+/* DMA stream register structure */
+typedef struct {
+    volatile uint32_t CR;       /* Configuration register */
+    volatile uint32_t NDTR;     /* Number of data register */
+    volatile uint32_t PAR;      /* Peripheral address register */
+    volatile uint32_t M0AR;     /* Memory 0 address register */
+    volatile uint32_t M1AR;     /* Memory 1 address register */
+    volatile uint32_t FCR;      /* FIFO control register */
+} dma_stream_regs_t;
+
+/* DMA controller register structure */
+typedef struct {
+    volatile uint32_t LISR;     /* Low interrupt status (streams 0-3) */
+    volatile uint32_t HISR;     /* High interrupt status (streams 4-7) */
+    volatile uint32_t LIFCR;    /* Low interrupt flag clear */
+    volatile uint32_t HIFCR;    /* High interrupt flag clear */
+    dma_stream_regs_t stream[8];
+} dma_regs_t;
+
+#define DMA1                    ((dma_regs_t *)DMA1_BASE)
+#define DMA2                    ((dma_regs_t *)DMA2_BASE)
+
+/* DMA stream CR bits */
+#define DMA_SCR_EN              (1 << 0)    /* Stream enable */
+#define DMA_SCR_TEIE            (1 << 2)    /* Transfer error interrupt enable */
+#define DMA_SCR_HTIE            (1 << 3)    /* Half transfer interrupt enable */
+#define DMA_SCR_TCIE            (1 << 4)    /* Transfer complete interrupt enable */
+#define DMA_SCR_DIR_P2M         (0 << 6)    /* Peripheral to memory */
+#define DMA_SCR_DIR_M2P         (1 << 6)    /* Memory to peripheral */
+#define DMA_SCR_CIRC            (1 << 8)    /* Circular mode */
+#define DMA_SCR_MINC            (1 << 10)   /* Memory increment */
+#define DMA_SCR_PL_HIGH         (2 << 16)   /* Priority level high */
+#define DMA_SCR_CHSEL(ch)       ((uint32_t)(ch) << 25)
+
+/* Stream flags, relative to the stream's position in LISR/HISR */
+#define DMA_FLAG_FEIF           (1 << 0)    /* FIFO error */
+#define DMA_FLAG_DMEIF          (1 << 2)    /* Direct mode error */
+#define DMA_FLAG_TEIF           (1 << 3)    /* Transfer error */
+#define DMA_FLAG_HTIF           (1 << 4)    /* Half transfer */
+#define DMA_FLAG_TCIF           (1 << 5)    /* Transfer complete */
+#define DMA_FLAG_ALL            0x3D
+
+/* RCC AHB1ENR bits */
+#define RCC_AHB1ENR_DMA1EN      (1 << 21)
+#define RCC_AHB1ENR_DMA2EN      (1 << 22)
+
+/* USART DMA request mapping (RM0090 table 42/43, all on channel 4) */
+typedef struct {
+    dma_regs_t *dma;            /* DMA controller */
+    uint32_t rcc_en;            /* RCC_AHB1ENR enable bit */
+    uint8_t rx_stream;          /* RX stream number */
+    uint8_t rx_irq;             /* RX stream IRQ */
+    uint8_t tx_stream;          /* TX stream number */
+    uint8_t tx_irq;             /* TX stream IRQ */
+    uint8_t channel;            /* Request channel */
+} serial_dma_map_t;
+
+static const serial_dma_map_t s_dma_map[SERIAL_COUNT] = {
+    [SERIAL_USART1] = { DMA2, RCC_AHB1ENR_DMA2EN, 2, IRQ_DMA2_STREAM2,
+                        7, IRQ_DMA2_STREAM7, 4 },
+    [SERIAL_USART2] = { DMA1, RCC_AHB1ENR_DMA1EN, 5, IRQ_DMA1_STREAM5,
+                        6, IRQ_DMA1_STREAM6, 4 },
+    [SERIAL_USART3] = { DMA1, RCC_AHB1ENR_DMA1EN, 1, IRQ_DMA1_STREAM1,
+                        3, IRQ_DMA1_STREAM3, 4 },
+};
+
+#if !SPSC_RING_SIZE_OK(SERIAL_RX_BUFFER_SIZE)
+#error "SERIAL_RX_BUFFER_SIZE must be a power of two"
+#endif
+#if !SPSC_RING_SIZE_OK(SERIAL_LINE_SLOTS)
+#error "SERIAL_LINE_SLOTS must be a power of two"
+#endif
+#if SERIAL_TX_BUFFER_SIZE != SERIAL_RX_BUFFER_SIZE
+#error "SERIAL_TX_BUFFER_SIZE must equal SERIAL_RX_BUFFER_SIZE"
+#endif
+#if (SERIAL_RX_DMA_SIZE & (SERIAL_RX_DMA_SIZE - 1)) != 0
+#error "SERIAL_RX_DMA_SIZE must be a power of two"
+#endif
+
 /* ========== Ring Buffer Structure ========== */
 
+/*
+ * Byte ring with one producer and one consumer (RX: ISR -> main loop,
+ * TX: main loop -> ISR/DMA), so neither side masks interrupts.
+ */
 typedef struct {
     volatile uint8_t buffer[SERIAL_RX_BUFFER_SIZE];
-    volatile size_t head;       /* Write index */
-    volatile size_t tail;       /* Read index */
-    volatile size_t count;      /* Number of bytes in buffer */
+    spsc_ring_t ring;           /* Producer/consumer indices */
 } ring_buffer_t;
 
 /* ========== Private Variables ========== */
@@ -112,10 +213,49 @@ static ring_buffer_t s_rx_buffer;
 /* Transmit ring buffer */
 static ring_buffer_t s_tx_buffer;
 
-/* Line buffer for G-code parsing */
-static char s_line_buffer[SERIAL_LINE_BUFFER_SIZE];
-static volatile size_t s_line_len = 0;
-static volatile uint8_t s_line_ready = 0;
+/*
+ * Line slot ring for G-code parsing.
+ *
+ * Single producer (ISR) / single consumer (main loop): the ISR fills the
+ * slot at the ring head and publishes it, the main loop releases the
+ * slot at the tail, so neither side needs to mask interrupts.
+ */
+static char s_line_slots[SERIAL_LINE_SLOTS][SERIAL_LINE_BUFFER_SIZE];
+static uint8_t s_line_slot_len[SERIAL_LINE_SLOTS];
+static uint8_t s_line_slot_kind[SERIAL_LINE_SLOTS];
+static spsc_ring_t s_line_ring;
+static size_t s_line_len = 0;               /* Length of line in progress */
+static uint8_t s_line_overrun = 0;          /* Dropping until end of line */
+
+/*
+ * Binary message block receive state. Entered when a sync byte arrives
+ * at a line boundary and kept until serial_rx_clear(); s_line_len then
+ * counts the bytes of the block in progress.
+ */
+static uint8_t s_rx_binary = 0;             /* Receiving message blocks */
+static uint8_t s_frame_len = 0;             /* Length of block in progress */
+static uint8_t s_frame_need_sync = 0;       /* Dropping until next sync */
+
+/* Line error counters */
+static serial_stats_t s_stats;
+
+#if SERIAL_USE_DMA
+/* Active DMA mapping */
+static const serial_dma_map_t *s_dma = &s_dma_map[SERIAL_USART1];
+
+/*
+ * Circular DMA receive buffer. While every line slot is full the drain
+ * stops and received bytes wait here; s_rx_dma_unread counts them so a
+ * lap of the DMA write index over unread bytes can be detected.
+ */
+static uint8_t s_rx_dma_buf[SERIAL_RX_DMA_SIZE];
+static uint16_t s_rx_dma_pos = 0;           /* Next index to process */
+static uint16_t s_rx_dma_seen = 0;          /* DMA write index at last drain */
+static uint16_t s_rx_dma_unread = 0;        /* Bytes written, not processed */
+
+/* Bytes handed to the TX DMA stream, 0 when idle */
+static volatile uint16_t s_tx_dma_len = 0;
+#endif
 
 /* Initialization flag */
 static uint8_t s_initialized = 0;
@@ -128,9 +268,7 @@ static uint8_t s_initialized = 0;
 static void
 ring_buffer_init(ring_buffer_t *rb)
 {
-    rb->head = 0;
-    rb->tail = 0;
-    rb->count = 0;
+    spsc_ring_init(&rb->ring);
 }
 
 /**
@@ -140,13 +278,12 @@ ring_buffer_init(ring_buffer_t *rb)
 static int
 ring_buffer_put(ring_buffer_t *rb, uint8_t byte)
 {
-    if (rb->count >= SERIAL_RX_BUFFER_SIZE) {
+    if (spsc_ring_free(&rb->ring, SERIAL_RX_BUFFER_SIZE) == 0) {
         return -1;  /* Buffer full */
     }
     
-    rb->buffer[rb->head] = byte;
-    rb->head = (rb->head + 1) % SERIAL_RX_BUFFER_SIZE;
-    rb->count++;
+    rb->buffer[spsc_ring_head(&rb->ring, SERIAL_RX_BUFFER_SIZE)] = byte;
+    spsc_ring_push(&rb->ring, 1);
     
     return 0;
 }
@@ -158,13 +295,12 @@ ring_buffer_put(ring_buffer_t *rb, uint8_t byte)
 static int
 ring_buffer_get(ring_buffer_t *rb, uint8_t *byte)
 {
-    if (rb->count == 0) {
+    if (spsc_ring_avail(&rb->ring) == 0) {
         return -1;  /* Buffer empty */
     }
     
-    *byte = rb->buffer[rb->tail];
-    rb->tail = (rb->tail + 1) % SERIAL_RX_BUFFER_SIZE;
-    rb->count--;
+    *byte = rb->buffer[spsc_ring_tail(&rb->ring, SERIAL_RX_BUFFER_SIZE)];
+    spsc_ring_pop(&rb->ring, 1);
     
     return 0;
 }
@@ -299,6 +435,77 @@ get_usart_info(serial_port_t port, usart_regs_t **usart, uint8_t *irq)
     }
 }
 
+/**
+ * @brief   Check whether every line slot holds an unparsed line
+ */
+static inline int
+line_slots_full(void)
+{
+    return spsc_ring_free(&s_line_ring, SERIAL_LINE_SLOTS) == 0;
+}
+
+/**
+ * @brief   Slot of the line being assembled
+ */
+static inline uint32_t
+line_slot_fill(void)
+{
+    return spsc_ring_head(&s_line_ring, SERIAL_LINE_SLOTS);
+}
+
+/**
+ * @brief   Assemble a binary message block byte (called from ISR)
+ *
+ * Only framing is checked here; command.c verifies CRC and sequence
+ * and acks so the host can retransmit. A bad length or missing
+ * trailing sync drops bytes until the next sync.
+ */
+static void
+process_rx_frame_byte(uint8_t byte)
+{
+    if (s_frame_need_sync) {
+        if (byte == CMD_MESSAGE_SYNC) {
+            s_frame_need_sync = 0;
+        }
+        return;
+    }
+    
+    if (s_line_len == 0) {
+        if (byte == CMD_MESSAGE_SYNC) {
+            return;     /* Idle sync between blocks */
+        }
+        if (byte < CMD_MESSAGE_MIN || byte > CMD_MESSAGE_MAX) {
+            s_stats.frame_errors++;
+            s_frame_need_sync = 1;
+            return;
+        }
+        s_frame_len = byte;
+        s_line_overrun = line_slots_full();
+    }
+    
+    if (!s_line_overrun) {
+        s_line_slots[line_slot_fill()][s_line_len] = (char)byte;
+    }
+    if (++s_line_len < s_frame_len) {
+        return;
+    }
+    
+    /* Block complete */
+    if (byte != CMD_MESSAGE_SYNC) {
+        s_stats.frame_errors++;
+        s_frame_need_sync = 1;
+    } else if (s_line_overrun) {
+        s_stats.lines_dropped++;
+    } else {
+        uint32_t slot = line_slot_fill();
+        s_line_slot_len[slot] = s_frame_len;
+        s_line_slot_kind[slot] = SERIAL_LINE_FRAME;
+        spsc_ring_push(&s_line_ring, 1);    /* Publish the slot */
+    }
+    s_line_len = 0;
+    s_line_overrun = 0;
+}
+
 /**
  * @brief   Process received byte (called from ISR)
  */
@@ -308,26 +515,287 @@ process_rx_byte(uint8_t byte)
     /* Add to ring buffer */
     ring_buffer_put(&s_rx_buffer, byte);
     
-    /* Line buffer processing for G-code */
-    if (!s_line_ready) {
-        if (byte == '\n' || byte == '\r') {
-            /* Line complete */
-            if (s_line_len > 0) {
-                s_line_buffer[s_line_len] = '\0';
-                s_line_ready = 1;
-            }
-        } else if (byte == '\b' || byte == 0x7F) {
-            /* Backspace - remove last character */
-            if (s_line_len > 0) {
-                s_line_len--;
-            }
-        } else if (s_line_len < SERIAL_LINE_BUFFER_SIZE - 1) {
-            /* Add character to line buffer */
-            s_line_buffer[s_line_len++] = (char)byte;
+    /* A sync byte at a line boundary starts binary message blocks */
+    if (!s_rx_binary && byte == CMD_MESSAGE_SYNC && s_line_len == 0 &&
+        !s_line_overrun) {
+        s_rx_binary = 1;
+    }
+    if (s_rx_binary) {
+        process_rx_frame_byte(byte);
+        return;
+    }
+    
+    /* Line slot processing for G-code */
+    if (line_slots_full()) {
+        /* All slots hold unparsed lines - drop this line */
+        s_line_overrun = 1;
+    }
+    
+    if (byte == '\n' || byte == '\r') {
+        /* Line complete */
+        if (s_line_overrun) {
+            s_line_overrun = 0;
+            s_stats.lines_dropped++;
+        } else if (s_line_len > 0) {
+            uint32_t slot = line_slot_fill();
+            s_line_slots[slot][s_line_len] = '\0';
+            s_line_slot_len[slot] = (uint8_t)s_line_len;
+            s_line_slot_kind[slot] = SERIAL_LINE_TEXT;
+            spsc_ring_push(&s_line_ring, 1);    /* Publish the slot */
         }
+        s_line_len = 0;
+    } else if (s_line_overrun) {
+        /* Discard the rest of the dropped line */
+    } else if (byte == '\b' || byte == 0x7F) {
+        /* Backspace - remove last character */
+        if (s_line_len > 0) {
+            s_line_len--;
+        }
+    } else if (s_line_len < SERIAL_LINE_BUFFER_SIZE - 1) {
+        /* Add character to the slot being filled */
+        s_line_slots[line_slot_fill()][s_line_len++] = (char)byte;
+    }
+}
+
+/**
+ * @brief   Feed received bytes from a transport to the line assembler
+ */
+size_t
+serial_rx_feed(const uint8_t *data, size_t len)
+{
+    size_t i;
+    
+    for (i = 0; i < len; i++) {
+        if (line_slots_full()) {
+            break;  /* Back-pressure: keep the rest for later */
+        }
+        process_rx_byte(data[i]);
+    }
+    
+    return i;
+}
+
+/**
+ * @brief   Count line errors reported in a USART status value
+ */
+static void
+count_line_errors(uint32_t sr)
+{
+    if (sr & USART_SR_ORE) {
+        s_stats.overrun++;
+    }
+    if (sr & USART_SR_FE) {
+        s_stats.framing++;
+    }
+    if (sr & USART_SR_NF) {
+        s_stats.noise++;
+    }
+    if (sr & USART_SR_PE) {
+        s_stats.parity++;
+    }
+}
+
+#if SERIAL_USE_DMA
+/**
+ * @brief   Get a DMA stream's flags
+ */
+static uint32_t
+dma_get_flags(dma_regs_t *dma, uint8_t stream)
+{
+    static const uint8_t shift[4] = { 0, 6, 16, 22 };
+    uint32_t isr = (stream < 4) ? dma->LISR : dma->HISR;
+    return (isr >> shift[stream & 3]) & DMA_FLAG_ALL;
+}
+
+/**
+ * @brief   Clear a DMA stream's flags
+ */
+static void
+dma_clear_flags(dma_regs_t *dma, uint8_t stream, uint32_t flags)
+{
+    static const uint8_t shift[4] = { 0, 6, 16, 22 };
+    uint32_t bits = (flags & DMA_FLAG_ALL) << shift[stream & 3];
+    if (stream < 4) {
+        dma->LIFCR = bits;
+    } else {
+        dma->HIFCR = bits;
+    }
+}
+
+/**
+ * @brief   Disable a DMA stream and wait until it has stopped
+ */
+static void
+dma_stream_stop(dma_regs_t *dma, uint8_t stream)
+{
+    dma_stream_regs_t *s = &dma->stream[stream];
+    s->CR &= ~DMA_SCR_EN;
+    while (s->CR & DMA_SCR_EN) {
+    }
+    dma_clear_flags(dma, stream, DMA_FLAG_ALL);
+}
+
+/**
+ * @brief   Current RX DMA write index
+ */
+static inline uint16_t
+serial_dma_rx_pos(void)
+{
+    uint16_t pos = (uint16_t)(SERIAL_RX_DMA_SIZE -
+                              s_dma->dma->stream[s_dma->rx_stream].NDTR);
+    return pos & (SERIAL_RX_DMA_SIZE - 1);
+}
+
+/**
+ * @brief   Feed bytes the RX DMA has written since the last call to the
+ *          line assembler
+ * 
+ * Called from the USART IDLE interrupt and the RX stream HT/TC
+ * interrupts, which share a priority so they never preempt each other,
+ * and with IRQ_PRIO_COMMS masked when a line slot is released.
+ * Half-transfer events bound the DMA progress between calls to half the
+ * buffer, so the unread count stays exact.
+ * 
+ * While every line slot is full the drain stops and the bytes stay in
+ * the DMA buffer (back-pressure, as serial_rx_feed() does for USB). If
+ * the DMA laps them they are skipped, counted in rx_dma_overflow, and
+ * the line or block in progress is dropped.
+ */
+static void
+serial_dma_rx_drain(void)
+{
+    uint16_t pos = serial_dma_rx_pos();
+    s_rx_dma_unread += (uint16_t)((pos - s_rx_dma_seen) &
+                                  (SERIAL_RX_DMA_SIZE - 1));
+    s_rx_dma_seen = pos;
+    
+    if (s_rx_dma_unread > SERIAL_RX_DMA_SIZE) {
+        s_stats.rx_dma_overflow++;
+        s_rx_dma_pos = pos;
+        s_rx_dma_unread = 0;
+        if (s_rx_binary) {
+            s_line_len = 0;
+            s_frame_need_sync = 1;
+        } else {
+            s_line_overrun = 1;
+        }
+    }
+    
+    while (s_rx_dma_unread > 0) {
+        if (line_slots_full()) {
+            break;  /* Back-pressure: keep the rest in the DMA buffer */
+        }
+        process_rx_byte(s_rx_dma_buf[s_rx_dma_pos]);
+        s_rx_dma_pos = (s_rx_dma_pos + 1) & (SERIAL_RX_DMA_SIZE - 1);
+        s_rx_dma_unread--;
+    }
+}
+
+/**
+ * @brief   Start a TX DMA transfer if idle and data is queued
+ * 
+ * Sends the contiguous run from the ring tail; the rest follows from
+ * the transfer complete interrupt. Safe from the writer without masking
+ * interrupts: while a transfer is in flight only the TX stream ISR
+ * restarts the DMA, and while it is idle that ISR cannot fire.
+ */
+static void
+serial_dma_tx_kick(void)
+{
+    if (s_tx_dma_len != 0) {
+        return;
+    }
+    
+    uint32_t len = spsc_ring_avail(&s_tx_buffer.ring);
+    if (len == 0) {
+        return;
     }
+    
+    uint32_t tail = spsc_ring_tail(&s_tx_buffer.ring, SERIAL_TX_BUFFER_SIZE);
+    uint32_t to_end = SERIAL_TX_BUFFER_SIZE - tail;
+    if (len > to_end) {
+        len = to_end;
+    }
+    
+    dma_stream_regs_t *s = &s_dma->dma->stream[s_dma->tx_stream];
+    dma_clear_flags(s_dma->dma, s_dma->tx_stream, DMA_FLAG_ALL);
+    s->M0AR = (uint32_t)(uintptr_t)&s_tx_buffer.buffer[tail];
+    s->NDTR = (uint32_t)len;
+    s_tx_dma_len = (uint16_t)len;
+    s->CR |= DMA_SCR_EN;
+}
+
+/**
+ * @brief   RX DMA stream interrupt (half / full transfer)
+ */
+static void
+serial_dma_rx_irq(void)
+{
+    uint32_t flags = dma_get_flags(s_dma->dma, s_dma->rx_stream);
+    dma_clear_flags(s_dma->dma, s_dma->rx_stream, flags);
+    serial_dma_rx_drain();
 }
 
+/**
+ * @brief   TX DMA stream interrupt (transfer complete)
+ */
+static void
+serial_dma_tx_irq(void)
+{
+    uint32_t flags = dma_get_flags(s_dma->dma, s_dma->tx_stream);
+    dma_clear_flags(s_dma->dma, s_dma->tx_stream, flags);
+    
+    if (flags & (DMA_FLAG_TCIF | DMA_FLAG_TEIF)) {
+        /* Retire the chunk; on a transfer error it is dropped */
+        spsc_ring_pop(&s_tx_buffer.ring, s_tx_dma_len);
+        s_tx_dma_len = 0;
+        serial_dma_tx_kick();
+    }
+}
+
+/**
+ * @brief   Configure RX and TX DMA streams for the active USART
+ */
+static void
+serial_dma_init(serial_port_t port)
+{
+    s_dma = &s_dma_map[port];
+    RCC_AHB1ENR |= s_dma->rcc_en;
+    
+    dma_regs_t *dma = s_dma->dma;
+    
+    /* RX: circular, peripheral to memory, HT/TC/TE interrupts */
+    dma_stream_stop(dma, s_dma->rx_stream);
+    dma_stream_regs_t *rx = &dma->stream[s_dma->rx_stream];
+    rx->PAR = (uint32_t)(uintptr_t)&s_usart->DR;
+    rx->M0AR = (uint32_t)(uintptr_t)s_rx_dma_buf;
+    rx->NDTR = SERIAL_RX_DMA_SIZE;
+    rx->FCR = 0;                /* Direct mode */
+    rx->CR = DMA_SCR_CHSEL(s_dma->channel) | DMA_SCR_PL_HIGH |
+             DMA_SCR_MINC | DMA_SCR_CIRC | DMA_SCR_DIR_P2M |
+             DMA_SCR_HTIE | DMA_SCR_TCIE | DMA_SCR_TEIE;
+    s_rx_dma_pos = 0;
+    s_rx_dma_seen = 0;
+    s_rx_dma_unread = 0;
+    rx->CR |= DMA_SCR_EN;
+    
+    /* TX: normal mode, memory to peripheral, started per chunk */
+    dma_stream_stop(dma, s_dma->tx_stream);
+    dma_stream_regs_t *tx = &dma->stream[s_dma->tx_stream];
+    tx->PAR = (uint32_t)(uintptr_t)&s_usart->DR;
+    tx->FCR = 0;
+    tx->CR = DMA_SCR_CHSEL(s_dma->channel) | DMA_SCR_PL_HIGH |
+             DMA_SCR_MINC | DMA_SCR_DIR_M2P | DMA_SCR_TCIE | DMA_SCR_TEIE;
+    s_tx_dma_len = 0;
+    
+    /* Same priority as the USART IRQ so RX drains never nest */
+    nvic_set_priority(s_dma->rx_irq, IRQ_PRIO_COMMS);
+    nvic_enable_irq(s_dma->rx_irq);
+    nvic_set_priority(s_dma->tx_irq, IRQ_PRIO_COMMS);
+    nvic_enable_irq(s_dma->tx_irq);
+}
+#endif
+
 /* ========== Interrupt Handler ========== */
 
 /**
@@ -335,12 +803,22 @@ process_rx_byte(uint8_t byte)
  * 
  * Handles receive and transmit interrupts.
  * This function should be called from the USART ISR vector.
+ * In DMA mode only IDLE-line and error events reach here.
  */
 void
 serial_irq_handler(void)
 {
+    uint32_t prof_start = profile_start();
     uint32_t sr = s_usart->SR;
     
+#if SERIAL_USE_DMA
+    if (sr & (USART_SR_IDLE | USART_SR_ORE | USART_SR_FE | USART_SR_NF |
+              USART_SR_PE)) {
+        count_line_errors(sr);
+        (void)s_usart->DR;  /* SR then DR read clears IDLE and errors */
+        serial_dma_rx_drain();
+    }
+#else
     /* Receive data available */
     if (sr & USART_SR_RXNE) {
         uint8_t byte = (uint8_t)(s_usart->DR & 0xFF);
@@ -358,10 +836,14 @@ serial_irq_handler(void)
         }
     }
     
-    /* Handle errors by reading SR and DR to clear flags */
+    /* Count errors, then read SR and DR to clear flags */
     if (sr & (USART_SR_ORE | USART_SR_FE | USART_SR_NF | USART_SR_PE)) {
+        count_line_errors(sr);
         (void)s_usart->DR;  /* Clear error flags by reading DR */
     }
+#endif
+
+    profile_stop(PROFILE_SERIAL_IRQ, prof_start);
 }
 
 /* USART1 ISR - weak symbol, can be overridden */
@@ -391,6 +873,62 @@ USART3_IRQHandler(void)
     }
 }
 
+#if SERIAL_USE_DMA
+/* USART1 RX DMA (DMA2 stream 2) - weak symbol, can be overridden */
+void __attribute__((weak))
+DMA2_Stream2_IRQHandler(void)
+{
+    if (s_usart == USART1) {
+        serial_dma_rx_irq();
+    }
+}
+
+/* USART1 TX DMA (DMA2 stream 7) - weak symbol, can be overridden */
+void __attribute__((weak))
+DMA2_Stream7_IRQHandler(void)
+{
+    if (s_usart == USART1) {
+        serial_dma_tx_irq();
+    }
+}
+
+/* USART2 RX DMA (DMA1 stream 5) - weak symbol, can be overridden */
+void __attribute__((weak))
+DMA1_Stream5_IRQHandler(void)
+{
+    if (s_usart == USART2) {
+        serial_dma_rx_irq();
+    }
+}
+
+/* USART2 TX DMA (DMA1 stream 6) - weak symbol, can be overridden */
+void __attribute__((weak))
+DMA1_Stream6_IRQHandler(void)
+{
+    if (s_usart == USART2) {
+        serial_dma_tx_irq();
+    }
+}
+
+/* USART3 RX DMA (DMA1 stream 1) - weak symbol, can be overridden */
+void __attribute__((weak))
+DMA1_Stream1_IRQHandler(void)
+{
+    if (s_usart == USART3) {
+        serial_dma_rx_irq();
+    }
+}
+
+/* USART3 TX DMA (DMA1 stream 3) - weak symbol, can be overridden */
+void __attribute__((weak))
+DMA1_Stream3_IRQHandler(void)
+{
+    if (s_usart == USART3) {
+        serial_dma_tx_irq();
+    }
+}
+#endif
+
 /* ========== Public Functions ========== */
 
 /**
@@ -426,9 +964,18 @@ serial_init_config(const serial_config_t *config)
     /* Initialize buffers */
     ring_buffer_init(&s_rx_buffer);
     ring_buffer_init(&s_tx_buffer);
+    spsc_ring_init(&s_line_ring);
     s_line_len = 0;
-    s_line_ready = 0;
+    s_line_overrun = 0;
+    s_rx_binary = 0;
+    s_frame_len = 0;
+    s_frame_need_sync = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
     
+#if CONFIG_SERIAL_USB
+    /* Host link is USB CDC; baud rate and USART port do not apply */
+    usb_cdc_init();
+#else
     /* Get USART info */
     get_usart_info(config->port, &s_usart, &s_usart_irq);
     
@@ -449,12 +996,20 @@ serial_init_config(const serial_config_t *config)
     /* Configure: 8 data bits, no parity, 1 stop bit */
     s_usart->CR2 = USART_CR2_STOP_1;
     
+#if SERIAL_USE_DMA
+    /* DMA moves the data; the USART only reports IDLE and errors */
+    serial_dma_init(config->port);
+    s_usart->CR3 = USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_EIE;
+    s_usart->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE | USART_CR1_IDLEIE;
+#else
     /* Enable USART, TX, RX, and RXNE interrupt */
     s_usart->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE | USART_CR1_RXNEIE;
+#endif
     
     /* Enable NVIC interrupt */
-    nvic_set_priority(s_usart_irq, 64);  /* Medium priority */
+    nvic_set_priority(s_usart_irq, IRQ_PRIO_COMMS);
     nvic_enable_irq(s_usart_irq);
+#endif
     
     s_initialized = 1;
     
@@ -475,8 +1030,38 @@ serial_write(const uint8_t *data, size_t len)
         return -2;
     }
     
+#if CONFIG_SERIAL_USB
+    return usb_cdc_write(data, len);
+#else
     size_t written = 0;
     
+#if SERIAL_USE_DMA
+    /* Queue into the TX ring; the DMA drains it in the background */
+    while (written < len) {
+        /* Only the TX ISR frees space, so a stale read is safe */
+        uint32_t timeout = 100000;
+        size_t chunk;
+        while ((chunk = spsc_ring_free(&s_tx_buffer.ring,
+                                       SERIAL_TX_BUFFER_SIZE)) == 0) {
+            if (--timeout == 0) {
+                return (int)written;  /* Timeout */
+            }
+        }
+        
+        if (chunk > len - written) {
+            chunk = len - written;
+        }
+        uint32_t head = s_tx_buffer.ring.head;
+        for (size_t i = 0; i < chunk; i++) {
+            s_tx_buffer.buffer[(head + i) & (SERIAL_TX_BUFFER_SIZE - 1)] =
+                data[written + i];
+        }
+        spsc_ring_push(&s_tx_buffer.ring, (uint32_t)chunk);
+        written += chunk;
+        
+        serial_dma_tx_kick();
+    }
+#else
     for (size_t i = 0; i < len; i++) {
         /* Wait for TXE (transmit data register empty) */
         uint32_t timeout = 100000;
@@ -490,8 +1075,10 @@ serial_write(const uint8_t *data, size_t len)
         s_usart->DR = data[i];
         written++;
     }
+#endif
     
     return (int)written;
+#endif
 }
 
 /**
@@ -535,8 +1122,8 @@ serial_read(uint8_t *data, size_t len)
         return -2;
     }
     
+    /* Lock-free: the ISR only produces into the RX ring */
     size_t read_count = 0;
-    uint32_t irqflag = irq_disable();
     
     while (read_count < len) {
         uint8_t byte;
@@ -547,8 +1134,6 @@ serial_read(uint8_t *data, size_t len)
         }
     }
     
-    irq_restore(irqflag);
-    
     return (int)read_count;
 }
 
@@ -579,30 +1164,22 @@ serial_readline(char *line, size_t maxlen)
         return -2;
     }
     
-    if (!s_line_ready) {
-        return 0;  /* No complete line available */
+    size_t len;
+    const char *slot = serial_line_peek(&len);
+    if (slot == NULL || serial_line_kind() != SERIAL_LINE_TEXT) {
+        return 0;  /* No complete text line available */
     }
     
-    uint32_t irqflag = irq_disable();
-    
     /* Copy line to output buffer */
-    size_t copy_len = s_line_len;
-    if (copy_len >= maxlen) {
-        copy_len = maxlen - 1;
+    if (len >= maxlen) {
+        len = maxlen - 1;
     }
+    memcpy(line, slot, len);
+    line[len] = '\0';
     
-    for (size_t i = 0; i < copy_len; i++) {
-        line[i] = s_line_buffer[i];
-    }
-    line[copy_len] = '\0';
+    serial_line_release();
     
-    /* Reset line buffer */
-    s_line_len = 0;
-    s_line_ready = 0;
-    
-    irq_restore(irqflag);
-    
-    return (int)copy_len;
+    return (int)len;
 }
 
 /**
@@ -611,7 +1188,67 @@ serial_readline(char *line, size_t maxlen)
 int
 serial_line_available(void)
 {
-    return s_line_ready ? 1 : 0;
+    return spsc_ring_avail(&s_line_ring) != 0 ? 1 : 0;
+}
+
+/**
+ * @brief   Get the oldest complete line in place
+ */
+const char *
+serial_line_peek(size_t *len)
+{
+    if (spsc_ring_avail(&s_line_ring) == 0) {
+        return NULL;
+    }
+    
+    uint32_t slot = spsc_ring_tail(&s_line_ring, SERIAL_LINE_SLOTS);
+    if (len != NULL) {
+        *len = s_line_slot_len[slot];
+    }
+    return s_line_slots[slot];
+}
+
+/**
+ * @brief   Get the kind of the oldest complete line
+ */
+int
+serial_line_kind(void)
+{
+    if (spsc_ring_avail(&s_line_ring) == 0) {
+        return -1;
+    }
+    return s_line_slot_kind[spsc_ring_tail(&s_line_ring, SERIAL_LINE_SLOTS)];
+}
+
+/**
+ * @brief   Release the line returned by serial_line_peek()
+ */
+void
+serial_line_release(void)
+{
+    if (spsc_ring_avail(&s_line_ring) != 0) {
+        spsc_ring_pop(&s_line_ring, 1);
+    }
+#if CONFIG_SERIAL_USB
+    /* A slot is free again: deliver held USB data and re-arm OUT */
+    usb_cdc_rx_kick();
+#elif SERIAL_USE_DMA
+    /* A slot is free again: process bytes held in the DMA buffer */
+    if (s_initialized) {
+        uint32_t irqflag = irq_mask_level(IRQ_PRIO_COMMS);
+        serial_dma_rx_drain();
+        irq_unmask_level(irqflag);
+    }
+#endif
+}
+
+/**
+ * @brief   Get number of free line slots
+ */
+int
+serial_line_free_slots(void)
+{
+    return (int)spsc_ring_free(&s_line_ring, SERIAL_LINE_SLOTS);
 }
 
 /**
@@ -620,7 +1257,7 @@ serial_line_available(void)
 size_t
 serial_rx_available(void)
 {
-    return s_rx_buffer.count;
+    return spsc_ring_avail(&s_rx_buffer.ring);
 }
 
 /**
@@ -629,7 +1266,7 @@ serial_rx_available(void)
 size_t
 serial_tx_free(void)
 {
-    return SERIAL_TX_BUFFER_SIZE - s_tx_buffer.count;
+    return spsc_ring_free(&s_tx_buffer.ring, SERIAL_TX_BUFFER_SIZE);
 }
 
 /**
@@ -644,11 +1281,26 @@ serial_flush(void)
     
     /* Wait for transmission complete */
     uint32_t timeout = 1000000;
+#if CONFIG_SERIAL_USB
+    while (usb_cdc_tx_pending() != 0) {
+        if (--timeout == 0) {
+            break;
+        }
+    }
+#else
+#if SERIAL_USE_DMA
+    while (spsc_ring_avail(&s_tx_buffer.ring) != 0) {
+        if (--timeout == 0) {
+            return;
+        }
+    }
+#endif
     while (!(s_usart->SR & USART_SR_TC)) {
         if (--timeout == 0) {
             break;
         }
     }
+#endif
 }
 
 /**
@@ -657,11 +1309,23 @@ serial_flush(void)
 void
 serial_rx_clear(void)
 {
-    uint32_t irqflag = irq_disable();
+    uint32_t irqflag = irq_mask_level(IRQ_PRIO_COMMS);
     ring_buffer_init(&s_rx_buffer);
+    spsc_ring_init(&s_line_ring);
     s_line_len = 0;
-    s_line_ready = 0;
-    irq_restore(irqflag);
+    s_line_overrun = 0;
+    s_rx_binary = 0;
+    s_frame_len = 0;
+    s_frame_need_sync = 0;
+#if SERIAL_USE_DMA
+    if (s_initialized) {
+        /* Skip whatever the DMA has received so far */
+        s_rx_dma_pos = serial_dma_rx_pos();
+        s_rx_dma_seen = s_rx_dma_pos;
+        s_rx_dma_unread = 0;
+    }
+#endif
+    irq_unmask_level(irqflag);
 }
 
 /**
@@ -671,7 +1335,14 @@ void
 serial_rx_enable(void)
 {
     if (s_initialized) {
+#if CONFIG_SERIAL_USB
+        /* USB receive is flow controlled by the OUT endpoint */
+#elif SERIAL_USE_DMA
+        s_usart->CR1 |= USART_CR1_IDLEIE;
+        s_dma->dma->stream[s_dma->rx_stream].CR |= DMA_SCR_HTIE | DMA_SCR_TCIE;
+#else
         s_usart->CR1 |= USART_CR1_RXNEIE;
+#endif
     }
 }
 
@@ -682,10 +1353,44 @@ void
 serial_rx_disable(void)
 {
     if (s_initialized) {
+#if CONFIG_SERIAL_USB
+        /* USB receive is flow controlled by the OUT endpoint */
+#elif SERIAL_USE_DMA
+        /* DMA keeps receiving; only the drain interrupts stop */
+        s_usart->CR1 &= ~USART_CR1_IDLEIE;
+        s_dma->dma->stream[s_dma->rx_stream].CR &= ~(DMA_SCR_HTIE | DMA_SCR_TCIE);
+#else
         s_usart->CR1 &= ~USART_CR1_RXNEIE;
+#endif
     }
 }
 
+/**
+ * @brief   Get line error counters
+ */
+void
+serial_get_stats(serial_stats_t *stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+    
+    uint32_t irqflag = irq_mask_level(IRQ_PRIO_COMMS);
+    *stats = s_stats;
+    irq_unmask_level(irqflag);
+}
+
+/**
+ * @brief   Reset line error counters
+ */
+void
+serial_reset_stats(void)
+{
+    uint32_t irqflag = irq_mask_level(IRQ_PRIO_COMMS);
+    memset(&s_stats, 0, sizeof(s_stats));
+    irq_unmask_level(irqflag);
+}
+
 /* ========== Debug Output Functions ========== */
 
 /**
@@ -5,6 +5,12 @@
  * Provides serial communication functions for STM32F407.
  * Used by gcode.c for G-code input and debug output.
  * Supports line-buffered input for G-code parsing.
+ * With CONFIG_SERIAL_DMA, RX runs from a circular DMA buffer drained on
+ * IDLE-line / half / full transfer events and TX is fed by DMA.
+ * With CONFIG_SERIAL_USB the same API runs over USB CDC-ACM (usb_cdc.c).
+ * A 0x7E sync byte at a line boundary switches the receiver to Klipper
+ * binary message blocks; complete blocks land in the same line slots,
+ * tagged SERIAL_LINE_FRAME, for command.c.
  * Follows Klipper coding style (C99, snake_case).
  */
 
@@ -13,16 +19,23 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include "autoconf.h"
 
 /* ========== Serial Configuration ========== */
 
 /* Default baud rate */
 #define SERIAL_BAUD_DEFAULT     115200
 
-/* Buffer sizes */
-#define SERIAL_RX_BUFFER_SIZE   256     /* Receive buffer size */
-#define SERIAL_TX_BUFFER_SIZE   256     /* Transmit buffer size */
-#define SERIAL_LINE_BUFFER_SIZE 128     /* Line buffer for G-code */
+/* Buffer sizes (ring sizes must be powers of two) */
+#define SERIAL_RX_BUFFER_SIZE   CONFIG_SERIAL_RX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE   CONFIG_SERIAL_TX_BUFFER_SIZE
+#define SERIAL_RX_DMA_SIZE      256     /* Circular DMA RX buffer (power of two) */
+#define SERIAL_LINE_BUFFER_SIZE 128     /* Line slot size for G-code */
+#define SERIAL_LINE_SLOTS       4       /* Complete lines buffered (power of two) */
+
+/* Line slot contents, see serial_line_kind() */
+#define SERIAL_LINE_TEXT        0       /* G-code text line */
+#define SERIAL_LINE_FRAME       1       /* Binary message block */
 
 /* USART selection */
 typedef enum {
@@ -38,6 +51,17 @@ typedef struct {
     uint32_t baud;              /* Baud rate */
 } serial_config_t;
 
+/* Line error counters */
+typedef struct {
+    uint32_t overrun;           /* ORE: byte lost before it was read */
+    uint32_t framing;           /* FE: bad stop bit */
+    uint32_t noise;             /* NF: noise detected on a bit */
+    uint32_t parity;            /* PE: parity mismatch */
+    uint32_t lines_dropped;     /* Lines discarded, all line slots full */
+    uint32_t frame_errors;      /* Binary blocks with bad length or sync */
+    uint32_t rx_dma_overflow;   /* DMA RX buffer lapped while line slots were full */
+} serial_stats_t;
+
 /* ========== Serial Functions ========== */
 
 /**
@@ -117,6 +141,39 @@ int serial_readline(char *line, size_t maxlen);
  */
 int serial_line_available(void);
 
+/**
+ * @brief   Get the oldest complete line without copying it
+ * @param   len     Pointer to store line length (may be NULL)
+ * @retval  Null-terminated line in its receive slot, or NULL if none
+ * 
+ * The line stays valid, and its slot stays owned by the caller, until
+ * serial_line_release() is called. The ISR keeps filling other slots
+ * in the meantime.
+ */
+const char *serial_line_peek(size_t *len);
+
+/**
+ * @brief   Get the kind of the oldest complete line
+ * @retval  SERIAL_LINE_TEXT or SERIAL_LINE_FRAME, -1 if no line is ready
+ *
+ * Frames are returned by serial_line_peek() as raw message blocks
+ * (length byte through trailing sync); text lines are null-terminated.
+ */
+int serial_line_kind(void);
+
+/**
+ * @brief   Release the line returned by serial_line_peek()
+ * 
+ * Hands the slot back to the ISR for reuse.
+ */
+void serial_line_release(void);
+
+/**
+ * @brief   Get number of free line slots
+ * @retval  Lines that can still be received before input is dropped
+ */
+int serial_line_free_slots(void);
+
 /**
  * @brief   Get number of bytes available in receive buffer
  * @retval  Number of bytes available
@@ -149,6 +206,32 @@ void serial_rx_enable(void);
  */
 void serial_rx_disable(void);
 
+/**
+ * @brief   Get line error counters
+ * @param   stats   Output counters
+ * 
+ * Counters accumulate from serial_init_config() or the last
+ * serial_reset_stats(), so receive dropouts are visible to the caller.
+ */
+void serial_get_stats(serial_stats_t *stats);
+
+/**
+ * @brief   Reset line error counters
+ */
+void serial_reset_stats(void);
+
+/**
+ * @brief   Feed received bytes from a transport to the line assembler
+ * @param   data    Received bytes
+ * @param   len     Number of bytes
+ * @retval  Number of bytes consumed
+ * 
+ * Stops early when every line slot holds an unparsed line, leaving the
+ * rest for the transport to feed after serial_line_release(). Must be
+ * called from interrupt context or with interrupts disabled.
+ */
+size_t serial_rx_feed(const uint8_t *data, size_t len);
+
 /* ========== Debug Output ========== */
 
 /**
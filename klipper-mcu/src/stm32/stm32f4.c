@@ -262,11 +262,23 @@ enable_pclock(uint32_t periph_base)
         return;
     }
     
+    /* TIM5 (APB1) */
+    if (periph_base == TIM5_BASE) {
+        RCC_APB1ENR |= (1 << 3);
+        return;
+    }
+    
     /* ADC1 (APB2) */
     if (periph_base == 0x40012000) {
         RCC_APB2ENR |= (1 << 8);
         return;
     }
+    
+    /* SDIO (APB2) */
+    if (periph_base == SDIO_BASE) {
+        RCC_APB2ENR |= (1 << 11);
+        return;
+    }
 }
 
 /**
@@ -341,9 +353,12 @@ SysTick_Handler(void)
     systick_count++;
 }
 
+#if !CONFIG_SCHED_HW_TIMER
 /**
  * @brief   Get high-resolution timer value (microseconds)
  * @return  Timer value in microseconds
+ * @note    With CONFIG_SCHED_HW_TIMER the TIM5 counter is used instead
+ *          (see timer.c)
  */
 uint32_t
 timer_read_time(void)
@@ -354,6 +369,7 @@ timer_read_time(void)
     uint32_t us = (ticks * 1000) / (CONFIG_CLOCK_FREQ / 1000);
     return (ms * 1000) + us;
 }
+#endif
 
 /**
  * @brief   Check if timer value has passed
@@ -0,0 +1,148 @@
+/**
+ * @file    timer.c
+ * @brief   STM32F407 scheduler timer implementation
+ *
+ * TIM5 is a 32-bit general purpose timer on APB1. It is prescaled to
+ * CONFIG_STEP_TIMER_FREQ and left free running so its counter wraps at
+ * the same point as sched_time_t. Channel 1 output compare (frozen
+ * mode, no pin) generates the scheduler wake interrupt, and the update
+ * interrupt at each wrap advances the high word of the 64-bit clock.
+ * Follows Klipper coding style (C99, snake_case).
+ */
+
+#include "timer.h"
+#include "internal.h"
+#include "board/irq.h"
+#include "board/misc.h"
+#include "sched.h"
+
+#if CONFIG_SCHED_HW_TIMER
+
+/* ========== TIM5 Register Definitions ========== */
+
+#define TIM5_CR1                (*(volatile uint32_t *)(TIM5_BASE + 0x00))
+#define TIM5_DIER               (*(volatile uint32_t *)(TIM5_BASE + 0x0C))
+#define TIM5_SR                 (*(volatile uint32_t *)(TIM5_BASE + 0x10))
+#define TIM5_EGR                (*(volatile uint32_t *)(TIM5_BASE + 0x14))
+#define TIM5_CCMR1              (*(volatile uint32_t *)(TIM5_BASE + 0x18))
+#define TIM5_CNT                (*(volatile uint32_t *)(TIM5_BASE + 0x24))
+#define TIM5_PSC                (*(volatile uint32_t *)(TIM5_BASE + 0x28))
+#define TIM5_ARR                (*(volatile uint32_t *)(TIM5_BASE + 0x2C))
+#define TIM5_CCR1               (*(volatile uint32_t *)(TIM5_BASE + 0x34))
+
+/* TIMx bits */
+#define TIM_CR1_CEN             (1 << 0)    /* Counter enable */
+#define TIM_DIER_UIE            (1 << 0)    /* Update interrupt enable */
+#define TIM_DIER_CC1IE          (1 << 1)    /* CC1 interrupt enable */
+#define TIM_SR_UIF              (1 << 0)    /* Update (overflow) flag */
+#define TIM_SR_CC1IF            (1 << 1)    /* CC1 interrupt flag */
+#define TIM_EGR_UG              (1 << 0)    /* Update generation */
+#define TIM_EGR_CC1G            (1 << 1)    /* CC1 event generation */
+
+/* ========== Private Variables ========== */
+
+/* Counter wraps seen so far (high word of the 64-bit clock) */
+static volatile uint32_t s_time_high;
+
+/* ========== Public Functions ========== */
+
+/**
+ * @brief   Start TIM5 as free-running scheduler clock
+ */
+void
+timer_init(void)
+{
+    enable_pclock(TIM5_BASE);
+
+    TIM5_CR1 = 0;
+    TIM5_DIER = 0;
+    TIM5_CCMR1 = 0;                 /* CC1 frozen output compare */
+    TIM5_PSC = (timer_get_clock() / CONFIG_STEP_TIMER_FREQ) - 1;
+    TIM5_ARR = 0xFFFFFFFF;
+    TIM5_CNT = 0;
+
+    /* Latch prescaler, then drop the update flag it sets */
+    TIM5_EGR = TIM_EGR_UG;
+    TIM5_SR = 0;
+
+    s_time_high = 0;
+    TIM5_DIER = TIM_DIER_UIE | TIM_DIER_CC1IE;
+    nvic_set_priority(IRQ_TIM5, IRQ_PRIO_STEP);
+    nvic_clear_pending(IRQ_TIM5);
+    nvic_enable_irq(IRQ_TIM5);
+
+    TIM5_CR1 = TIM_CR1_CEN;
+}
+
+/**
+ * @brief   Read scheduler clock
+ * @return  TIM5 counter value
+ */
+__ramfunc uint32_t
+timer_read_time(void)
+{
+    return TIM5_CNT;
+}
+
+/**
+ * @brief   Read 64-bit scheduler clock
+ * @return  Wrap count in the high word, TIM5 counter in the low word
+ *
+ * Safe from any context. A wrap whose interrupt is still pending (the
+ * caller masks IRQ_PRIO_STEP, or the wrap happened just now) is
+ * detected from UIF: the counter then reads a small value and the
+ * high word is one behind.
+ */
+__ramfunc uint64_t
+timer_read_time64(void)
+{
+    uint32_t high, low, sr;
+    do {
+        high = s_time_high;
+        low = TIM5_CNT;
+        sr = TIM5_SR;
+    } while (high != s_time_high);
+
+    if ((sr & TIM_SR_UIF) && low < 0x80000000) {
+        high++;
+    }
+    return ((uint64_t)high << 32) | low;
+}
+
+/**
+ * @brief   Arm compare interrupt for the next waketime
+ * @param   waketime    Counter value at which to interrupt
+ */
+__ramfunc void
+timer_set_waketime(uint32_t waketime)
+{
+    TIM5_CCR1 = waketime;
+    TIM5_SR = ~TIM_SR_CC1IF;
+
+    /* Compare only matches on equality; force the event if already due */
+    if ((int32_t)(waketime - TIM5_CNT) <= 0) {
+        TIM5_EGR = TIM_EGR_CC1G;
+    }
+}
+
+/**
+ * @brief   TIM5 interrupt handler - count wraps, run due scheduler timers
+ */
+__ramfunc void
+TIM5_IRQHandler(void)
+{
+    uint32_t sr = TIM5_SR;
+
+    if (sr & TIM_SR_UIF) {
+        /* Readers run at or below this priority, so none sees the
+         * high word bumped while UIF is still set */
+        s_time_high++;
+        TIM5_SR = ~TIM_SR_UIF;
+    }
+    if (sr & TIM_SR_CC1IF) {
+        TIM5_SR = ~TIM_SR_CC1IF;
+        sched_timer_dispatch();
+    }
+}
+
+#endif /* CONFIG_SCHED_HW_TIMER */
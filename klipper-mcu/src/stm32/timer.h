@@ -0,0 +1,48 @@
+/**
+ * @file    timer.h
+ * @brief   STM32F407 scheduler timer interface
+ *
+ * TIM5 (32-bit) runs free at CONFIG_STEP_TIMER_FREQ and provides the
+ * scheduler clock. Its CC1 compare interrupt fires at the earliest
+ * timer waketime and dispatches scheduler timers in IRQ context; its
+ * update interrupt counts wraps for the 64-bit clock.
+ * Follows Klipper coding style (C99, snake_case).
+ */
+
+#ifndef STM32_TIMER_H
+#define STM32_TIMER_H
+
+#include <stdint.h>
+
+/* ========== Timer Functions ========== */
+
+/**
+ * @brief   Start TIM5 as free-running scheduler clock
+ *
+ * Counter runs at CONFIG_STEP_TIMER_FREQ; the compare interrupt is
+ * enabled but not armed until timer_set_waketime() is called.
+ */
+void timer_init(void);
+
+/**
+ * @brief   Read scheduler clock
+ * @return  TIM5 counter value (CONFIG_STEP_TIMER_FREQ ticks)
+ */
+uint32_t timer_read_time(void);
+
+/**
+ * @brief   Read 64-bit scheduler clock
+ * @return  Counter extended with the number of wraps since timer_init()
+ */
+uint64_t timer_read_time64(void);
+
+/**
+ * @brief   Arm compare interrupt for the next waketime
+ * @param   waketime    Counter value at which to interrupt
+ *
+ * If waketime is already in the past the interrupt is made pending
+ * immediately so no wake is lost.
+ */
+void timer_set_waketime(uint32_t waketime);
+
+#endif /* STM32_TIMER_H */
@@ -0,0 +1,854 @@
+/**
+ * @file    usb_cdc.c
+ * @brief   STM32F407 OTG_FS USB CDC-ACM transport implementation
+ *
+ * Adapted from Klipper src/stm32/usbotg.c and src/generic/usb_cdc.c
+ * for this firmware.
+ *
+ * Key adaptations:
+ * - Interrupt driven: control requests, OUT data and IN completions are
+ *   all handled in OTG_FS_IRQHandler instead of scheduler tasks
+ * - Received data goes straight to the serial line slots; the bulk OUT
+ *   endpoint NAKs while they are full, so the host is flow controlled
+ *   instead of bytes being dropped
+ * - Single CDC-ACM function with static descriptors
+ * - C99 compatible
+ */
+
+#include "usb_cdc.h"
+#include "serial.h"
+#include "gpio.h"
+#include "internal.h"
+#include "board/irq.h"
+#include <string.h>
+
+#if CONFIG_SERIAL_USB
+
+#if !CONFIG_HAVE_USB
+#error "CONFIG_SERIAL_USB requires CONFIG_HAVE_USB"
+#endif
+
+/* ========== OTG_FS Register Definitions ========== */
+
+#define OTG_FS_BASE             0x50000000
+#define OTG_REG(off)            \
+    (*(volatile uint32_t *)(uintptr_t)(OTG_FS_BASE + (off)))
+
+/* Core global registers */
+#define OTG_GAHBCFG             OTG_REG(0x008)
+#define OTG_GUSBCFG             OTG_REG(0x00C)
+#define OTG_GRSTCTL             OTG_REG(0x010)
+#define OTG_GINTSTS             OTG_REG(0x014)
+#define OTG_GINTMSK             OTG_REG(0x018)
+#define OTG_GRXSTSP             OTG_REG(0x020)
+#define OTG_GRXFSIZ             OTG_REG(0x024)
+#define OTG_DIEPTXF0            OTG_REG(0x028)
+#define OTG_GCCFG               OTG_REG(0x038)
+#define OTG_DIEPTXF(n)          OTG_REG(0x104 + 4 * ((n) - 1))
+
+/* Device mode registers */
+#define OTG_DCFG                OTG_REG(0x800)
+#define OTG_DCTL                OTG_REG(0x804)
+#define OTG_DIEPMSK             OTG_REG(0x810)
+#define OTG_DOEPMSK             OTG_REG(0x814)
+#define OTG_DAINT               OTG_REG(0x818)
+#define OTG_DAINTMSK            OTG_REG(0x81C)
+#define OTG_DIEPCTL(n)          OTG_REG(0x900 + 0x20 * (n))
+#define OTG_DIEPINT(n)          OTG_REG(0x908 + 0x20 * (n))
+#define OTG_DIEPTSIZ(n)         OTG_REG(0x910 + 0x20 * (n))
+#define OTG_DOEPCTL(n)          OTG_REG(0xB00 + 0x20 * (n))
+#define OTG_DOEPINT(n)          OTG_REG(0xB08 + 0x20 * (n))
+#define OTG_DOEPTSIZ(n)         OTG_REG(0xB10 + 0x20 * (n))
+#define OTG_PCGCCTL             OTG_REG(0xE00)
+#define OTG_FIFO(n)             OTG_REG(0x1000 * ((n) + 1))
+
+/* GAHBCFG bits */
+#define OTG_GAHBCFG_GINT        (1 << 0)    /* Global interrupt enable */
+
+/* GUSBCFG bits */
+#define OTG_GUSBCFG_PHYSEL      (1 << 6)    /* Full-speed internal PHY */
+#define OTG_GUSBCFG_TRDT(n)     ((uint32_t)(n) << 10)
+#define OTG_GUSBCFG_FDMOD       (1UL << 30) /* Force device mode */
+
+/* GRSTCTL bits */
+#define OTG_GRSTCTL_CSRST       (1 << 0)    /* Core soft reset */
+#define OTG_GRSTCTL_RXFFLSH     (1 << 4)    /* RX FIFO flush */
+#define OTG_GRSTCTL_TXFFLSH     (1 << 5)    /* TX FIFO flush */
+#define OTG_GRSTCTL_TXFNUM_ALL  (0x10 << 6) /* Flush all TX FIFOs */
+#define OTG_GRSTCTL_AHBIDL      (1UL << 31) /* AHB master idle */
+
+/* GINTSTS / GINTMSK bits */
+#define OTG_GINT_RXFLVL         (1 << 4)    /* RX FIFO non-empty */
+#define OTG_GINT_USBSUSP        (1 << 11)   /* USB suspend */
+#define OTG_GINT_USBRST         (1 << 12)   /* USB reset */
+#define OTG_GINT_ENUMDNE        (1 << 13)   /* Enumeration done */
+#define OTG_GINT_IEPINT         (1 << 18)   /* IN endpoint interrupt */
+#define OTG_GINT_OEPINT         (1 << 19)   /* OUT endpoint interrupt */
+
+/* GRXSTSP fields */
+#define OTG_GRXSTS_EPNUM(s)     ((s) & 0xF)
+#define OTG_GRXSTS_BCNT(s)      (((s) >> 4) & 0x7FF)
+#define OTG_GRXSTS_PKTSTS(s)    (((s) >> 17) & 0xF)
+#define OTG_PKTSTS_OUT_DATA     2           /* OUT data packet received */
+#define OTG_PKTSTS_SETUP_DATA   6           /* SETUP data packet received */
+
+/* GCCFG bits */
+#define OTG_GCCFG_PWRDWN        (1 << 16)   /* Transceiver enable */
+#define OTG_GCCFG_NOVBUSSENS    (1 << 21)   /* VBUS sensing disable */
+
+/* DCFG bits */
+#define OTG_DCFG_DSPD_FS        (3 << 0)    /* Full speed, internal PHY */
+#define OTG_DCFG_DAD_MASK       (0x7F << 4) /* Device address */
+#define OTG_DCFG_DAD(a)         ((uint32_t)((a) & 0x7F) << 4)
+
+/* DCTL bits */
+#define OTG_DCTL_SDIS           (1 << 1)    /* Soft disconnect */
+#define OTG_DCTL_CGINAK         (1 << 8)    /* Clear global IN NAK */
+
+/* DIEPCTL / DOEPCTL bits */
+#define OTG_EPCTL_MPSIZ_MASK    0x7FF
+#define OTG_EPCTL_USBAEP        (1 << 15)   /* Endpoint active */
+#define OTG_EPCTL_EPTYP_BULK    (2 << 18)
+#define OTG_EPCTL_EPTYP_INTR    (3 << 18)
+#define OTG_EPCTL_STALL         (1 << 21)
+#define OTG_EPCTL_TXFNUM(n)     ((uint32_t)(n) << 22)
+#define OTG_EPCTL_CNAK          (1 << 26)   /* Clear NAK */
+#define OTG_EPCTL_SNAK          (1 << 27)   /* Set NAK */
+#define OTG_EPCTL_SD0PID        (1 << 28)   /* Set DATA0 PID */
+#define OTG_EPCTL_EPENA         (1UL << 31) /* Endpoint enable */
+
+/* DIEPINT / DOEPINT bits */
+#define OTG_EPINT_XFRC          (1 << 0)    /* Transfer completed */
+#define OTG_DOEPINT_STUP        (1 << 3)    /* SETUP phase done */
+
+/* DIEPTSIZ / DOEPTSIZ fields */
+#define OTG_EPTSIZ_PKTCNT(n)    ((uint32_t)(n) << 19)
+#define OTG_DOEPTSIZ0_STUPCNT(n) ((uint32_t)(n) << 29)
+
+/* RCC */
+#define RCC_BASE                0x40023800
+#define RCC_AHB2ENR             (*(volatile uint32_t *)(RCC_BASE + 0x34))
+#define RCC_AHB2ENR_OTGFSEN     (1 << 7)
+
+/* FIFO RAM layout (32-bit words, 320 available) */
+#define USB_RX_FIFO_WORDS       128
+#define USB_TX0_FIFO_WORDS      32          /* Whole EP0 reply at once */
+#define USB_TX1_FIFO_WORDS      32
+#define USB_TX2_FIFO_WORDS      16
+
+/* Longest EP0 IN reply (DIEPTSIZ0 XFRSIZ is 7 bits) */
+#define USB_EP0_BUF_SIZE        (USB_TX0_FIFO_WORDS * 4)
+
+#if (USB_CDC_TX_BUFFER_SIZE & (USB_CDC_TX_BUFFER_SIZE - 1)) != 0
+#error "USB_CDC_TX_BUFFER_SIZE must be a power of two"
+#endif
+
+/* ========== USB Protocol Definitions ========== */
+
+/* bmRequestType type field */
+#define USB_REQ_TYPE_MASK       0x60
+#define USB_REQ_TYPE_STANDARD   0x00
+#define USB_REQ_TYPE_CLASS      0x20
+
+/* Standard requests */
+#define USB_REQ_GET_STATUS          0x00
+#define USB_REQ_CLEAR_FEATURE       0x01
+#define USB_REQ_SET_ADDRESS         0x05
+#define USB_REQ_GET_DESCRIPTOR      0x06
+#define USB_REQ_GET_CONFIGURATION   0x08
+#define USB_REQ_SET_CONFIGURATION   0x09
+#define USB_REQ_SET_INTERFACE       0x0B
+
+/* Descriptor types */
+#define USB_DT_DEVICE           0x01
+#define USB_DT_CONFIG           0x02
+#define USB_DT_STRING           0x03
+#define USB_DT_INTERFACE        0x04
+#define USB_DT_ENDPOINT         0x05
+#define USB_DT_CS_INTERFACE     0x24
+
+/* CDC requests */
+#define USB_CDC_SET_LINE_CODING         0x20
+#define USB_CDC_GET_LINE_CODING         0x21
+#define USB_CDC_SET_CONTROL_LINE_STATE  0x22
+#define USB_CDC_SEND_BREAK              0x23
+
+/* ========== Descriptors ========== */
+
+static const uint8_t s_device_desc[] = {
+    18, USB_DT_DEVICE,
+    0x00, 0x02,                 /* bcdUSB 2.00 */
+    0x02, 0x00, 0x00,           /* CDC class, per-interface subclass */
+    USB_CDC_EP0_SIZE,
+    USB_CDC_VENDOR_ID & 0xFF, USB_CDC_VENDOR_ID >> 8,
+    USB_CDC_PRODUCT_ID & 0xFF, USB_CDC_PRODUCT_ID >> 8,
+    0x00, 0x01,                 /* bcdDevice 1.00 */
+    1, 2, 3,                    /* Manufacturer, product, serial strings */
+    1,                          /* One configuration */
+};
+
+#define USB_CONFIG_DESC_SIZE    67
+
+static const uint8_t s_config_desc[USB_CONFIG_DESC_SIZE] = {
+    /* Configuration */
+    9, USB_DT_CONFIG, USB_CONFIG_DESC_SIZE, 0x00,
+    2, 1, 0, 0xC0, 50,          /* 2 interfaces, value 1, 100 mA */
+
+    /* Interface 0: communications (ACM) */
+    9, USB_DT_INTERFACE, 0, 0, 1, 0x02, 0x02, 0x01, 0,
+    5, USB_DT_CS_INTERFACE, 0x00, 0x10, 0x01,   /* Header, CDC 1.10 */
+    4, USB_DT_CS_INTERFACE, 0x02, 0x02,         /* ACM: line coding */
+    5, USB_DT_CS_INTERFACE, 0x06, 0, 1,         /* Union: 0 -> 1 */
+    5, USB_DT_CS_INTERFACE, 0x01, 0x00, 1,      /* Call mgmt: data if 1 */
+    7, USB_DT_ENDPOINT, 0x80 | USB_CDC_EP_ACM, 0x03,
+    USB_CDC_EP_ACM_SIZE, 0x00, 255,
+
+    /* Interface 1: data */
+    9, USB_DT_INTERFACE, 1, 0, 2, 0x0A, 0x00, 0x00, 0,
+    7, USB_DT_ENDPOINT, USB_CDC_EP_BULK, 0x02,
+    USB_CDC_EP_BULK_SIZE, 0x00, 0,
+    7, USB_DT_ENDPOINT, 0x80 | USB_CDC_EP_BULK, 0x02,
+    USB_CDC_EP_BULK_SIZE, 0x00, 0,
+};
+
+static const uint8_t s_lang_desc[] = { 4, USB_DT_STRING, 0x09, 0x04 };
+
+static const char *const s_strings[] = {
+    "Klipper",
+    CONFIG_MCU,
+    "0",
+};
+
+/* ========== Private Variables ========== */
+
+/* Control endpoint state */
+static uint8_t s_setup[8];
+static uint8_t s_ep0_buf[USB_EP0_BUF_SIZE];
+static uint8_t s_ep0_out[8];
+static uint8_t s_ep0_out_len = 0;
+static uint8_t s_line_coding_pending = 0;
+
+/* 115200 8N1 until the host says otherwise (ignored on USB) */
+static uint8_t s_line_coding[7] = { 0x00, 0xC2, 0x01, 0x00, 0, 0, 8 };
+
+static volatile uint8_t s_configured = 0;
+static volatile uint8_t s_dtr = 0;
+
+/* Bulk OUT packet being delivered to the line slots */
+static uint8_t s_rx_pkt[USB_CDC_EP_BULK_SIZE];
+static uint8_t s_rx_len = 0;
+static uint8_t s_rx_pos = 0;
+static uint8_t s_rx_armed = 0;
+
+/*
+ * Transmit ring. Main context only advances s_tx_head; s_tx_tail is
+ * advanced by usb_tx_kick(), which runs in the ISR or with comms interrupts
+ * masked. Indices are free-running.
+ */
+static uint8_t s_tx_buf[USB_CDC_TX_BUFFER_SIZE];
+static volatile uint16_t s_tx_head = 0;
+static volatile uint16_t s_tx_tail = 0;
+static volatile uint8_t s_tx_busy = 0;
+static uint8_t s_tx_zlp = 0;
+
+/* ========== FIFO Access ========== */
+
+/**
+ * @brief   Pop a packet from the RX FIFO
+ * @param   buf     Destination (may be NULL to discard)
+ * @param   len     Packet length from GRXSTSP
+ * @param   max     Bytes to keep
+ */
+static void
+usb_fifo_read(uint8_t *buf, uint16_t len, uint16_t max)
+{
+    for (uint16_t i = 0; i < len; i += 4) {
+        uint32_t word = OTG_FIFO(0);
+        for (uint16_t j = 0; j < 4 && i + j < len; j++) {
+            if (buf != NULL && i + j < max) {
+                buf[i + j] = (uint8_t)(word >> (8 * j));
+            }
+        }
+    }
+}
+
+/**
+ * @brief   Push a packet into an IN endpoint's TX FIFO
+ */
+static void
+usb_fifo_write(uint8_t ep, const uint8_t *data, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i += 4) {
+        uint32_t word = 0;
+        for (uint16_t j = 0; j < 4 && i + j < len; j++) {
+            word |= (uint32_t)data[i + j] << (8 * j);
+        }
+        OTG_FIFO(ep) = word;
+    }
+}
+
+/* ========== Control Endpoint ========== */
+
+/**
+ * @brief   Arm EP0 OUT for SETUP packets and short data / status stages
+ */
+static void
+usb_ep0_out_arm(void)
+{
+    OTG_DOEPTSIZ(0) = OTG_DOEPTSIZ0_STUPCNT(3) | OTG_EPTSIZ_PKTCNT(1) |
+                      USB_CDC_EP0_SIZE;
+    OTG_DOEPCTL(0) |= OTG_EPCTL_EPENA | OTG_EPCTL_CNAK;
+}
+
+/**
+ * @brief   Send a reply on EP0 IN, truncated to the host's wLength
+ *
+ * The whole reply fits in the EP0 TX FIFO, so it is written at once
+ * and no completion handling is needed. len 0 sends a status ZLP.
+ */
+static void
+usb_ep0_send(const uint8_t *data, uint16_t len, uint16_t max)
+{
+    if (len > max) {
+        len = max;
+    }
+    if (len > USB_EP0_BUF_SIZE) {
+        len = USB_EP0_BUF_SIZE;
+    }
+
+    uint16_t pktcnt = len ? (len + USB_CDC_EP0_SIZE - 1) / USB_CDC_EP0_SIZE : 1;
+    OTG_DIEPTSIZ(0) = OTG_EPTSIZ_PKTCNT(pktcnt) | len;
+    OTG_DIEPCTL(0) |= OTG_EPCTL_EPENA | OTG_EPCTL_CNAK;
+    usb_fifo_write(0, data, len);
+}
+
+/**
+ * @brief   Reject a control request
+ *
+ * The core clears the stall when the next SETUP arrives.
+ */
+static void
+usb_ep0_stall(void)
+{
+    OTG_DIEPCTL(0) |= OTG_EPCTL_STALL;
+    OTG_DOEPCTL(0) |= OTG_EPCTL_STALL;
+}
+
+/**
+ * @brief   Send a string descriptor, converting ASCII to UTF-16LE
+ */
+static void
+usb_send_string(const char *str, uint16_t max)
+{
+    uint16_t len = 2;
+    while (*str != '\0' && len + 2 <= USB_EP0_BUF_SIZE) {
+        s_ep0_buf[len++] = (uint8_t)*str++;
+        s_ep0_buf[len++] = 0;
+    }
+    s_ep0_buf[0] = (uint8_t)len;
+    s_ep0_buf[1] = USB_DT_STRING;
+    usb_ep0_send(s_ep0_buf, len, max);
+}
+
+/**
+ * @brief   Activate the CDC endpoints (SET_CONFIGURATION 1)
+ */
+static void
+usb_configure_endpoints(void)
+{
+    OTG_DIEPCTL(USB_CDC_EP_ACM) = OTG_EPCTL_USBAEP | OTG_EPCTL_EPTYP_INTR |
+                                  OTG_EPCTL_TXFNUM(USB_CDC_EP_ACM) |
+                                  OTG_EPCTL_SD0PID | USB_CDC_EP_ACM_SIZE;
+    OTG_DIEPCTL(USB_CDC_EP_BULK) = OTG_EPCTL_USBAEP | OTG_EPCTL_EPTYP_BULK |
+                                   OTG_EPCTL_TXFNUM(USB_CDC_EP_BULK) |
+                                   OTG_EPCTL_SD0PID | USB_CDC_EP_BULK_SIZE;
+    OTG_DOEPCTL(USB_CDC_EP_BULK) = OTG_EPCTL_USBAEP | OTG_EPCTL_EPTYP_BULK |
+                                   OTG_EPCTL_SD0PID | USB_CDC_EP_BULK_SIZE;
+    OTG_DAINTMSK |= (1 << USB_CDC_EP_BULK) | (1 << (16 + USB_CDC_EP_BULK));
+
+    s_tx_busy = 0;
+    s_tx_zlp = 0;
+    s_rx_len = 0;
+    s_rx_pos = 0;
+    s_rx_armed = 0;
+    s_configured = 1;
+}
+
+/**
+ * @brief   Handle a standard control request
+ */
+static void
+usb_standard_request(uint8_t req, uint16_t value, uint16_t length)
+{
+    switch (req) {
+        case USB_REQ_GET_DESCRIPTOR: {
+            uint8_t type = value >> 8;
+            uint8_t index = value & 0xFF;
+            if (type == USB_DT_DEVICE) {
+                usb_ep0_send(s_device_desc, sizeof(s_device_desc), length);
+            } else if (type == USB_DT_CONFIG) {
+                usb_ep0_send(s_config_desc, sizeof(s_config_desc), length);
+            } else if (type == USB_DT_STRING && index == 0) {
+                usb_ep0_send(s_lang_desc, sizeof(s_lang_desc), length);
+            } else if (type == USB_DT_STRING && index <= ARRAY_SIZE(s_strings)) {
+                usb_send_string(s_strings[index - 1], length);
+            } else {
+                usb_ep0_stall();
+            }
+            break;
+        }
+
+        case USB_REQ_SET_ADDRESS:
+            /* The OTG core applies the address after the status stage */
+            OTG_DCFG = (OTG_DCFG & ~OTG_DCFG_DAD_MASK) | OTG_DCFG_DAD(value);
+            usb_ep0_send(NULL, 0, 0);
+            break;
+
+        case USB_REQ_SET_CONFIGURATION:
+            if (value == 1) {
+                usb_configure_endpoints();
+                usb_cdc_rx_kick();
+            } else if (value == 0) {
+                s_configured = 0;
+            } else {
+                usb_ep0_stall();
+                break;
+            }
+            usb_ep0_send(NULL, 0, 0);
+            break;
+
+        case USB_REQ_GET_CONFIGURATION:
+            s_ep0_buf[0] = s_configured;
+            usb_ep0_send(s_ep0_buf, 1, length);
+            break;
+
+        case USB_REQ_GET_STATUS:
+            s_ep0_buf[0] = 0;
+            s_ep0_buf[1] = 0;
+            usb_ep0_send(s_ep0_buf, 2, length);
+            break;
+
+        case USB_REQ_CLEAR_FEATURE:
+        case USB_REQ_SET_INTERFACE:
+            usb_ep0_send(NULL, 0, 0);
+            break;
+
+        default:
+            usb_ep0_stall();
+            break;
+    }
+}
+
+/**
+ * @brief   Handle a CDC class control request
+ */
+static void
+usb_class_request(uint8_t req, uint16_t value, uint16_t length)
+{
+    switch (req) {
+        case USB_CDC_SET_LINE_CODING:
+            /* Status is sent once the data stage arrives */
+            s_line_coding_pending = 1;
+            break;
+
+        case USB_CDC_GET_LINE_CODING:
+            usb_ep0_send(s_line_coding, sizeof(s_line_coding), length);
+            break;
+
+        case USB_CDC_SET_CONTROL_LINE_STATE:
+            s_dtr = value & 0x01;
+            usb_ep0_send(NULL, 0, 0);
+            break;
+
+        case USB_CDC_SEND_BREAK:
+            usb_ep0_send(NULL, 0, 0);
+            break;
+
+        default:
+            usb_ep0_stall();
+            break;
+    }
+}
+
+/**
+ * @brief   Dispatch the SETUP packet in s_setup
+ */
+static void
+usb_handle_setup(void)
+{
+    uint8_t type = s_setup[0];
+    uint8_t req = s_setup[1];
+    uint16_t value = s_setup[2] | (s_setup[3] << 8);
+    uint16_t length = s_setup[6] | (s_setup[7] << 8);
+
+    s_line_coding_pending = 0;
+
+    if ((type & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_STANDARD) {
+        usb_standard_request(req, value, length);
+    } else if ((type & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_CLASS) {
+        usb_class_request(req, value, length);
+    } else {
+        usb_ep0_stall();
+    }
+}
+
+/* ========== Bulk Endpoints ========== */
+
+/**
+ * @brief   Feed the pending OUT packet to the line slots, re-arm when done
+ *
+ * Runs in the ISR or with IRQ_PRIO_COMMS masked.
+ */
+static void
+usb_rx_deliver(void)
+{
+    if (!s_configured) {
+        return;
+    }
+
+    if (s_rx_pos < s_rx_len) {
+        s_rx_pos += (uint8_t)serial_rx_feed(&s_rx_pkt[s_rx_pos],
+                                            s_rx_len - s_rx_pos);
+    }
+
+    if (s_rx_pos >= s_rx_len && !s_rx_armed) {
+        s_rx_len = 0;
+        s_rx_pos = 0;
+        s_rx_armed = 1;
+        OTG_DOEPTSIZ(USB_CDC_EP_BULK) = OTG_EPTSIZ_PKTCNT(1) |
+                                        USB_CDC_EP_BULK_SIZE;
+        OTG_DOEPCTL(USB_CDC_EP_BULK) |= OTG_EPCTL_EPENA | OTG_EPCTL_CNAK;
+    }
+}
+
+/**
+ * @brief   Load the next IN packet if the endpoint is idle
+ *
+ * A transfer ending on a full packet is closed with a zero-length
+ * packet so the host returns the data immediately. Runs in the ISR or
+ * with IRQ_PRIO_COMMS masked.
+ */
+static void
+usb_tx_kick(void)
+{
+    if (!s_configured || s_tx_busy) {
+        return;
+    }
+
+    uint16_t avail = (uint16_t)(s_tx_head - s_tx_tail);
+    if (avail == 0 && !s_tx_zlp) {
+        return;
+    }
+
+    uint16_t len = avail;
+    if (len > USB_CDC_EP_BULK_SIZE) {
+        len = USB_CDC_EP_BULK_SIZE;
+    }
+
+    /* Gather the packet out of the ring */
+    uint8_t pkt[USB_CDC_EP_BULK_SIZE];
+    for (uint16_t i = 0; i < len; i++) {
+        pkt[i] = s_tx_buf[(uint16_t)(s_tx_tail + i) &
+                          (USB_CDC_TX_BUFFER_SIZE - 1)];
+    }
+
+    OTG_DIEPTSIZ(USB_CDC_EP_BULK) = OTG_EPTSIZ_PKTCNT(1) | len;
+    OTG_DIEPCTL(USB_CDC_EP_BULK) |= OTG_EPCTL_EPENA | OTG_EPCTL_CNAK;
+    usb_fifo_write(USB_CDC_EP_BULK, pkt, len);
+
+    s_tx_tail += len;
+    s_tx_zlp = (len == USB_CDC_EP_BULK_SIZE);
+    s_tx_busy = 1;
+}
+
+/* ========== Interrupt Handling ========== */
+
+/**
+ * @brief   Handle a USB bus reset
+ */
+static void
+usb_bus_reset(void)
+{
+    s_configured = 0;
+    s_dtr = 0;
+    s_tx_busy = 0;
+    s_tx_zlp = 0;
+    s_rx_armed = 0;
+
+    for (int ep = 0; ep < 4; ep++) {
+        OTG_DOEPCTL(ep) |= OTG_EPCTL_SNAK;
+    }
+
+    /* FIFO RAM: RX, then one TX FIFO per IN endpoint */
+    OTG_GRXFSIZ = USB_RX_FIFO_WORDS;
+    OTG_DIEPTXF0 = (USB_TX0_FIFO_WORDS << 16) | USB_RX_FIFO_WORDS;
+    OTG_DIEPTXF(USB_CDC_EP_BULK) =
+        (USB_TX1_FIFO_WORDS << 16) | (USB_RX_FIFO_WORDS + USB_TX0_FIFO_WORDS);
+    OTG_DIEPTXF(USB_CDC_EP_ACM) =
+        (USB_TX2_FIFO_WORDS << 16) |
+        (USB_RX_FIFO_WORDS + USB_TX0_FIFO_WORDS + USB_TX1_FIFO_WORDS);
+
+    OTG_GRSTCTL = OTG_GRSTCTL_TXFFLSH | OTG_GRSTCTL_TXFNUM_ALL;
+    while (OTG_GRSTCTL & OTG_GRSTCTL_TXFFLSH) {
+    }
+    OTG_GRSTCTL = OTG_GRSTCTL_RXFFLSH;
+    while (OTG_GRSTCTL & OTG_GRSTCTL_RXFFLSH) {
+    }
+
+    OTG_DAINTMSK = (1 << 0) | (1 << 16);    /* EP0 IN and OUT */
+    OTG_DOEPMSK = OTG_DOEPINT_STUP | OTG_EPINT_XFRC;
+    OTG_DIEPMSK = OTG_EPINT_XFRC;
+    OTG_DCFG &= ~OTG_DCFG_DAD_MASK;
+
+    usb_ep0_out_arm();
+}
+
+/**
+ * @brief   Pop one entry from the RX FIFO
+ */
+static void
+usb_rx_fifo_pop(void)
+{
+    uint32_t sts = OTG_GRXSTSP;
+    uint8_t ep = OTG_GRXSTS_EPNUM(sts);
+    uint16_t len = OTG_GRXSTS_BCNT(sts);
+
+    switch (OTG_GRXSTS_PKTSTS(sts)) {
+        case OTG_PKTSTS_SETUP_DATA:
+            usb_fifo_read(s_setup, len, sizeof(s_setup));
+            break;
+
+        case OTG_PKTSTS_OUT_DATA:
+            if (ep == 0) {
+                usb_fifo_read(s_ep0_out, len, sizeof(s_ep0_out));
+                s_ep0_out_len = (uint8_t)len;
+            } else if (ep == USB_CDC_EP_BULK) {
+                usb_fifo_read(s_rx_pkt, len, sizeof(s_rx_pkt));
+                s_rx_len = (len > sizeof(s_rx_pkt)) ? sizeof(s_rx_pkt)
+                                                    : (uint8_t)len;
+                s_rx_pos = 0;
+            } else {
+                usb_fifo_read(NULL, len, 0);
+            }
+            break;
+
+        default:
+            /* Transfer / setup complete markers carry no data */
+            break;
+    }
+}
+
+/**
+ * @brief   Handle OUT endpoint interrupts
+ */
+static void
+usb_out_ep_irq(void)
+{
+    uint32_t daint = OTG_DAINT;
+
+    if (daint & (1 << 16)) {
+        uint32_t st = OTG_DOEPINT(0);
+        OTG_DOEPINT(0) = st;
+        if (st & OTG_DOEPINT_STUP) {
+            usb_handle_setup();
+        } else if ((st & OTG_EPINT_XFRC) && s_line_coding_pending) {
+            /* SET_LINE_CODING data stage */
+            if (s_ep0_out_len >= sizeof(s_line_coding)) {
+                memcpy(s_line_coding, s_ep0_out, sizeof(s_line_coding));
+            }
+            s_line_coding_pending = 0;
+            usb_ep0_send(NULL, 0, 0);
+        }
+        usb_ep0_out_arm();
+    }
+
+    if (daint & (1 << (16 + USB_CDC_EP_BULK))) {
+        uint32_t st = OTG_DOEPINT(USB_CDC_EP_BULK);
+        OTG_DOEPINT(USB_CDC_EP_BULK) = st;
+        if (st & OTG_EPINT_XFRC) {
+            s_rx_armed = 0;
+            usb_rx_deliver();
+        }
+    }
+}
+
+/**
+ * @brief   Handle IN endpoint interrupts
+ */
+static void
+usb_in_ep_irq(void)
+{
+    uint32_t daint = OTG_DAINT;
+
+    if (daint & (1 << 0)) {
+        OTG_DIEPINT(0) = OTG_DIEPINT(0);
+    }
+
+    if (daint & (1 << USB_CDC_EP_BULK)) {
+        uint32_t st = OTG_DIEPINT(USB_CDC_EP_BULK);
+        OTG_DIEPINT(USB_CDC_EP_BULK) = st;
+        if (st & OTG_EPINT_XFRC) {
+            s_tx_busy = 0;
+            usb_tx_kick();
+        }
+    }
+}
+
+/* OTG_FS ISR - weak symbol, can be overridden */
+void __attribute__((weak))
+OTG_FS_IRQHandler(void)
+{
+    uint32_t sts = OTG_GINTSTS & OTG_GINTMSK;
+
+    if (sts & OTG_GINT_USBRST) {
+        OTG_GINTSTS = OTG_GINT_USBRST;
+        usb_bus_reset();
+    }
+
+    if (sts & OTG_GINT_ENUMDNE) {
+        OTG_GINTSTS = OTG_GINT_ENUMDNE;
+        OTG_DIEPCTL(0) &= ~OTG_EPCTL_MPSIZ_MASK;     /* 64-byte EP0 */
+        OTG_DCTL |= OTG_DCTL_CGINAK;
+    }
+
+    while (OTG_GINTSTS & OTG_GINT_RXFLVL) {
+        usb_rx_fifo_pop();
+    }
+
+    if (sts & OTG_GINT_OEPINT) {
+        usb_out_ep_irq();
+    }
+
+    if (sts & OTG_GINT_IEPINT) {
+        usb_in_ep_irq();
+    }
+
+    if (sts & OTG_GINT_USBSUSP) {
+        OTG_GINTSTS = OTG_GINT_USBSUSP;
+    }
+}
+
+/* ========== Public Functions ========== */
+
+/**
+ * @brief   Initialize the OTG_FS core and connect to the host
+ */
+void
+usb_cdc_init(void)
+{
+    /* OTG_FS clock: 48 MHz from PLLQ (see stm32f4.c) */
+    RCC_AHB2ENR |= RCC_AHB2ENR_OTGFSEN;
+
+    /* PA11 = DM, PA12 = DP */
+    gpio_config_t pin_config = {
+        .mode = GPIO_MODE_AF,
+        .otype = GPIO_OTYPE_PP,
+        .speed = GPIO_SPEED_HIGH,
+        .pupd = GPIO_PUPD_NONE,
+        .af = GPIO_AF_OTG_FS
+    };
+    gpio_configure(GPIO_PA11, &pin_config);
+    gpio_configure(GPIO_PA12, &pin_config);
+
+    /* Core soft reset */
+    while (!(OTG_GRSTCTL & OTG_GRSTCTL_AHBIDL)) {
+    }
+    OTG_GRSTCTL = OTG_GRSTCTL_CSRST;
+    while (OTG_GRSTCTL & OTG_GRSTCTL_CSRST) {
+    }
+
+    /* Device mode, internal full-speed PHY; takes ~25 ms to settle */
+    OTG_GUSBCFG = OTG_GUSBCFG_FDMOD | OTG_GUSBCFG_PHYSEL |
+                  OTG_GUSBCFG_TRDT(6);
+    for (volatile uint32_t i = 0; i < CONFIG_CLOCK_FREQ / 160; i++) {
+        __asm__ __volatile__("nop");
+    }
+
+    /* No VBUS sensing on this board; transceiver on */
+    OTG_GCCFG = OTG_GCCFG_PWRDWN | OTG_GCCFG_NOVBUSSENS;
+    OTG_PCGCCTL = 0;
+    OTG_DCFG = OTG_DCFG_DSPD_FS;
+
+    OTG_GINTSTS = 0xFFFFFFFF;
+    OTG_GINTMSK = OTG_GINT_USBRST | OTG_GINT_ENUMDNE | OTG_GINT_RXFLVL |
+                  OTG_GINT_IEPINT | OTG_GINT_OEPINT | OTG_GINT_USBSUSP;
+    OTG_GAHBCFG = OTG_GAHBCFG_GINT;
+
+    nvic_set_priority(IRQ_OTG_FS, IRQ_PRIO_COMMS);
+    nvic_enable_irq(IRQ_OTG_FS);
+
+    /* Connect: the host sees the DP pull-up and resets the bus */
+    OTG_DCTL &= ~OTG_DCTL_SDIS;
+}
+
+/**
+ * @brief   Queue data for transmission to the host
+ */
+int
+usb_cdc_write(const uint8_t *data, size_t len)
+{
+    size_t written = 0;
+
+    while (written < len) {
+        if (!s_configured) {
+            return (int)len;  /* No host: discard */
+        }
+
+        /* Only usb_tx_kick() advances the tail, so a stale read is safe */
+        uint32_t timeout = 100000;
+        while ((uint16_t)(s_tx_head - s_tx_tail) >= USB_CDC_TX_BUFFER_SIZE) {
+            if (--timeout == 0) {
+                return (int)written;  /* Timeout */
+            }
+        }
+
+        size_t chunk = USB_CDC_TX_BUFFER_SIZE -
+                       (uint16_t)(s_tx_head - s_tx_tail);
+        if (chunk > len - written) {
+            chunk = len - written;
+        }
+        for (size_t i = 0; i < chunk; i++) {
+            s_tx_buf[(uint16_t)(s_tx_head + i) &
+                     (USB_CDC_TX_BUFFER_SIZE - 1)] = data[written + i];
+        }
+        s_tx_head += (uint16_t)chunk;
+        written += chunk;
+
+        uint32_t irqflag = irq_mask_level(IRQ_PRIO_COMMS);
+        usb_tx_kick();
+        irq_unmask_level(irqflag);
+    }
+
+    return (int)written;
+}
+
+/**
+ * @brief   Get number of queued bytes not yet sent
+ */
+size_t
+usb_cdc_tx_pending(void)
+{
+    return (uint16_t)(s_tx_head - s_tx_tail);
+}
+
+/**
+ * @brief   Resume delivery of received data
+ */
+void
+usb_cdc_rx_kick(void)
+{
+    uint32_t irqflag = irq_mask_level(IRQ_PRIO_COMMS);
+    usb_rx_deliver();
+    irq_unmask_level(irqflag);
+}
+
+/**
+ * @brief   Check whether a host has opened the port
+ */
+int
+usb_cdc_connected(void)
+{
+    return (s_configured && s_dtr) ? 1 : 0;
+}
+
+#endif /* CONFIG_SERIAL_USB */
@@ -0,0 +1,76 @@
+/**
+ * @file    usb_cdc.h
+ * @brief   STM32F407 OTG_FS USB CDC-ACM transport interface
+ *
+ * Device-mode driver for the OTG_FS core (PA11/PA12) presenting a
+ * single CDC-ACM serial port to the host. serial.c uses it as the
+ * byte transport when CONFIG_SERIAL_USB is set, so gcode.c and
+ * command.c keep using the serial_* API unchanged.
+ * Follows Klipper coding style (C99, snake_case).
+ */
+
+#ifndef STM32_USB_CDC_H
+#define STM32_USB_CDC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* ========== USB CDC Configuration ========== */
+
+/* USB identifiers (same as Klipper's USB serial devices) */
+#define USB_CDC_VENDOR_ID       0x1d50
+#define USB_CDC_PRODUCT_ID      0x614e
+
+/* Endpoints */
+#define USB_CDC_EP0_SIZE        64      /* Control endpoint packet size */
+#define USB_CDC_EP_ACM          2       /* Notification IN endpoint */
+#define USB_CDC_EP_ACM_SIZE     16
+#define USB_CDC_EP_BULK         1       /* Data OUT/IN endpoint pair */
+#define USB_CDC_EP_BULK_SIZE    64
+
+/* Transmit ring size (power of two) */
+#define USB_CDC_TX_BUFFER_SIZE  512
+
+/* ========== USB CDC Functions ========== */
+
+/**
+ * @brief   Initialize the OTG_FS core and connect to the host
+ *
+ * Enables the OTG_FS clock (48 MHz from PLLQ), configures PA11/PA12,
+ * resets the core into device mode and enables the OTG_FS interrupt.
+ * Enumeration then completes in the interrupt handler.
+ */
+void usb_cdc_init(void);
+
+/**
+ * @brief   Queue data for transmission to the host
+ * @param   data    Data buffer to write
+ * @param   len     Number of bytes to write
+ * @retval  Number of bytes queued
+ *
+ * Blocks while the transmit ring is full. Data written while no host
+ * has configured the device is discarded.
+ */
+int usb_cdc_write(const uint8_t *data, size_t len);
+
+/**
+ * @brief   Get number of queued bytes not yet sent
+ */
+size_t usb_cdc_tx_pending(void);
+
+/**
+ * @brief   Resume delivery of received data
+ *
+ * Received packets are fed to serial_rx_feed() until the line slots
+ * are full; the OUT endpoint is then left NAKing the host. Call this
+ * after a line slot is released to feed the rest and re-arm.
+ */
+void usb_cdc_rx_kick(void);
+
+/**
+ * @brief   Check whether a host has opened the port
+ * @retval  1 if configured and DTR is set, 0 otherwise
+ */
+int usb_cdc_connected(void);
+
+#endif /* STM32_USB_CDC_H */
@@ -0,0 +1,185 @@
+/**
+ * @file    trace.c
+ * @brief   运动轨迹记录环实现
+ *
+ * 写入端 (主循环和中断) 在关中断下取得序号并填入记录；导出端按
+ * 序号逐条复制，发现已被新记录覆盖时跳到最旧的有效记录并计入 lost。
+ * CONFIG_MOTION_TRACE 关闭时本文件为空。
+ */
+
+#include "trace.h"
+
+#if CONFIG_MOTION_TRACE
+
+#include "sched.h"
+#include "command.h"
+#include "board/misc.h"
+#include "stm32/serial.h"
+#include "chelper/spsc_ring.h"
+
+#if !SPSC_RING_SIZE_OK(TRACE_SIZE)
+#error "CONFIG_MOTION_TRACE_SIZE must be a power of two"
+#endif
+
+/* ========== 私有变量 ========== */
+
+/* 记录环只由 CPU 访问，放在 CCM 中不占主 SRAM */
+static trace_record_t s_ring[TRACE_SIZE] __ccmram;
+
+static uint32_t s_head;                 /* 下一条记录的序号 */
+static volatile uint8_t s_frozen;       /* 导出期间暂停记录 */
+
+/* 导出状态 (仅主循环访问) */
+static uint8_t s_dumping;
+static uint32_t s_dump_seq;             /* 下一条待发送记录 */
+static uint32_t s_dump_end;             /* 导出截止序号 (不含) */
+static uint32_t s_dump_lost;            /* 已被覆盖的待发送记录 */
+
+/* ========== 私有函数 ========== */
+
+/**
+ * @brief  trace_dump freeze: 导出环中的所有记录
+ */
+static int trace_cmd_dump(const cmd_args_t* args)
+{
+    trace_dump_start(args->values[0] != 0);
+    return 0;
+}
+
+/* 轨迹命令表 */
+static const cmd_desc_t s_trace_cmds[] = {
+    { CMD_ID_TRACE_DUMP, "trace_dump", trace_cmd_dump, 1 },
+};
+
+/* ========== 公共接口实现 ========== */
+
+/**
+ * @brief  追加一条记录
+ * @param  type  记录类型
+ * @param  id    电机/限位编号或轴位图
+ * @param  depth 队列深度
+ * @param  a     类型相关参数
+ * @param  b     类型相关参数
+ */
+__ramfunc void trace_record(trace_type_t type, uint8_t id, uint16_t depth,
+                            uint32_t a, uint32_t b)
+{
+    if (s_frozen) {
+        return;
+    }
+
+    uint32_t flag = sched_irq_save();
+    trace_record_t* r = &s_ring[s_head & (TRACE_SIZE - 1)];
+    r->clock = sched_get_time();
+    r->type = (uint8_t)type;
+    r->id = id;
+    r->depth = depth;
+    r->a = a;
+    r->b = b;
+    s_head++;
+    sched_irq_restore(flag);
+}
+
+/**
+ * @brief  初始化记录环并注册 trace_dump 命令
+ */
+void trace_init(void)
+{
+    s_head = 0;
+    s_frozen = 0;
+    s_dumping = 0;
+
+    for (int i = 0; i < (int)(sizeof(s_trace_cmds) / sizeof(s_trace_cmds[0])); i++) {
+        command_register(&s_trace_cmds[i]);
+    }
+}
+
+/**
+ * @brief  开始导出当前环中的所有记录
+ * @param  freeze 非零时导出结束前暂停记录
+ */
+void trace_dump_start(int freeze)
+{
+    uint32_t flag = sched_irq_save();
+    s_dump_end = s_head;
+    sched_irq_restore(flag);
+
+    s_dump_seq = (s_dump_end > TRACE_SIZE) ? s_dump_end - TRACE_SIZE : 0;
+    s_dump_lost = 0;
+    s_frozen = freeze ? 1 : 0;
+    s_dumping = 1;
+}
+
+/**
+ * @brief  读取一条记录
+ * @param  seq    记录序号
+ * @param  record 输出记录
+ * @retval 0 成功，-1 尚未写入或已被覆盖
+ */
+int trace_get(uint32_t seq, trace_record_t* record)
+{
+    int ret = -1;
+
+    uint32_t flag = sched_irq_save();
+    if (seq < s_head && s_head - seq <= TRACE_SIZE) {
+        *record = s_ring[seq & (TRACE_SIZE - 1)];
+        ret = 0;
+    }
+    sched_irq_restore(flag);
+    return ret;
+}
+
+/**
+ * @brief  获取下一条记录的序号
+ * @retval 序号
+ */
+uint32_t trace_next_seq(void)
+{
+    return s_head;
+}
+
+/**
+ * @brief  导出任务: 串口发送缓冲区有空间时发送待导出记录
+ * @note   每条记录单独成块，最长 CMD_MESSAGE_MAX 字节
+ */
+void trace_task(void)
+{
+    if (!s_dumping) {
+        return;
+    }
+
+    while (s_dump_seq != s_dump_end) {
+        if (serial_tx_free() < CMD_MESSAGE_MAX) {
+            return;
+        }
+
+        trace_record_t r;
+        if (trace_get(s_dump_seq, &r) != 0) {
+            /* 已被覆盖: 跳到仍在环中的最旧记录 */
+            uint32_t oldest = s_head - TRACE_SIZE;
+            s_dump_lost += oldest - s_dump_seq;
+            s_dump_seq = oldest;
+            continue;
+        }
+
+        uint32_t values[5];
+        values[0] = s_dump_seq;
+        values[1] = r.clock;
+        values[2] = (uint32_t)r.type | ((uint32_t)r.id << 8)
+                    | ((uint32_t)r.depth << 16);
+        values[3] = r.a;
+        values[4] = r.b;
+        command_send_message(CMD_RSP_TRACE, values, 5);
+        s_dump_seq++;
+    }
+
+    if (serial_tx_free() < CMD_MESSAGE_MAX) {
+        return;
+    }
+    uint32_t end[2] = { s_dump_end, s_dump_lost };
+    command_send_message(CMD_RSP_TRACE_END, end, 2);
+    s_dumping = 0;
+    s_frozen = 0;
+}
+
+#endif /* CONFIG_MOTION_TRACE */
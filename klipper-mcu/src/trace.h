@@ -0,0 +1,132 @@
+/**
+ * @file    trace.h
+ * @brief   运动轨迹记录环接口
+ *
+ * 在 RAM 中循环保存最近的运动事件，用于诊断停顿和丢步 (层偏移):
+ * trapq 运动段 (trapq_append)、步进驱动装载的运动段 (步进定时器)、
+ * 归零限位触发 (home_endstop_callback)，每条记录附带当时的队列深度。
+ *
+ * 记录为定长二进制结构，写入只有几次存储和一次关中断，热点路径中
+ * 不做任何格式化。主机发送 trace_dump (CMD_ID_TRACE_DUMP) 后由
+ * trace_task() 在串口发送缓冲区有空间时逐条以 CMD_RSP_TRACE 发出，
+ * 最后以 CMD_RSP_TRACE_END 结束:
+ *
+ *     trace     seq clock (type | id << 8 | depth << 16) a b
+ *     trace_end next_seq lost
+ *
+ * seq 为记录的全局序号，lost 为导出期间已被覆盖而未能发出的记录数。
+ *
+ * 由 CONFIG_MOTION_TRACE 控制 (make MOTION_TRACE=1 或 DEBUG 构建开启)；
+ * 关闭时记录函数为空内联函数，零开销。
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "autoconf.h"
+
+/* ========== 记录格式 ========== */
+
+/* 记录类型 */
+typedef enum {
+    TRACE_MOVE = 1,     /* trapq 运动段: id=活动轴位图 a=开始时间 b=时长 (微秒) */
+    TRACE_STEP,         /* 步进驱动装载运动段: id=电机 depth=队列剩余段数 a=interval b=count */
+    TRACE_ENDSTOP,      /* 归零限位触发: id=限位 depth=已停止电机位图 a=触发时钟 b=0 */
+} trace_type_t;
+
+/* 单条记录 (16 字节) */
+typedef struct {
+    uint32_t clock;             /* 记录时的调度器时钟 */
+    uint8_t type;               /* trace_type_t */
+    uint8_t id;                 /* 电机/限位编号或轴位图 */
+    uint16_t depth;             /* 记录时的队列深度 */
+    uint32_t a;                 /* 类型相关参数 */
+    uint32_t b;
+} trace_record_t;
+
+/* ========== 记录接口 ========== */
+
+#if CONFIG_MOTION_TRACE
+
+/* 记录环长度 (条，2 的幂) */
+#define TRACE_SIZE              CONFIG_MOTION_TRACE_SIZE
+
+/* 记录环在 CCM 中的占用，计入 CCM_BUDGET_BYTES */
+#define TRACE_CCM_BYTES         (TRACE_SIZE * sizeof(trace_record_t))
+
+/**
+ * @brief  追加一条记录，环满时覆盖最旧的记录
+ * @param  type  记录类型
+ * @param  id    电机/限位编号或轴位图
+ * @param  depth 队列深度
+ * @param  a     类型相关参数
+ * @param  b     类型相关参数
+ * @note   可在中断中调用；导出时 (trace_dump freeze=1) 暂停记录
+ */
+void trace_record(trace_type_t type, uint8_t id, uint16_t depth,
+                  uint32_t a, uint32_t b);
+
+/**
+ * @brief  初始化记录环并注册 trace_dump 命令
+ */
+void trace_init(void);
+
+/**
+ * @brief  导出任务 (主循环调用): 串口发送缓冲区有空间时发送待导出记录
+ */
+void trace_task(void);
+
+/**
+ * @brief  开始导出当前环中的所有记录
+ * @param  freeze 非零时导出结束前暂停记录，保留触发导出时的现场
+ */
+void trace_dump_start(int freeze);
+
+/**
+ * @brief  读取一条记录
+ * @param  seq    记录序号
+ * @param  record 输出记录
+ * @retval 0 成功，-1 尚未写入或已被覆盖
+ */
+int trace_get(uint32_t seq, trace_record_t* record);
+
+/**
+ * @brief  获取下一条记录的序号 (即已写入的记录总数)
+ * @retval 序号
+ */
+uint32_t trace_next_seq(void);
+
+#else
+
+#define TRACE_CCM_BYTES         0
+
+static inline void trace_record(trace_type_t type, uint8_t id, uint16_t depth,
+                                uint32_t a, uint32_t b)
+{
+    (void)type;
+    (void)id;
+    (void)depth;
+    (void)a;
+    (void)b;
+}
+
+static inline void trace_init(void)
+{
+}
+
+static inline void trace_task(void)
+{
+}
+
+#endif /* CONFIG_MOTION_TRACE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRACE_H */
@@ -0,0 +1,99 @@
+/**
+ * @file    bench.h
+ * @brief   微基准测试计时与输出
+ *
+ * 主机上用 CLOCK_MONOTONIC 计时；定义 BENCH_DWT 时改用 Cortex-M4 的
+ * DWT 周期计数器，同一组基准可在目标板上运行 (printf 需重定向到串口)，
+ * 结果额外给出每次操作的 CPU 周期数。
+ *
+ * 每项基准按批计时: 被测调用之外的准备和清理不计入。
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifdef BENCH_DWT
+
+#include "autoconf.h"
+
+#define BENCH_DEMCR             (*(volatile uint32_t *)0xE000EDFC)
+#define BENCH_DEMCR_TRCENA      (1U << 24)
+#define BENCH_DWT_CTRL          (*(volatile uint32_t *)0xE0001000)
+#define BENCH_DWT_CYCCNTENA     (1U << 0)
+#define BENCH_DWT_CYCCNT        (*(volatile uint32_t *)0xE0001004)
+
+/* 计时单位: CPU 周期 (单批不超过 2^32 周期，168MHz 下约 25 秒) */
+typedef uint32_t bench_time_t;
+
+static inline void
+bench_init(void)
+{
+    BENCH_DEMCR |= BENCH_DEMCR_TRCENA;
+    BENCH_DWT_CYCCNT = 0;
+    BENCH_DWT_CTRL |= BENCH_DWT_CYCCNTENA;
+}
+
+static inline bench_time_t
+bench_now(void)
+{
+    return BENCH_DWT_CYCCNT;
+}
+
+static inline double
+bench_to_ns(bench_time_t t)
+{
+    return (double)t * 1e9 / CONFIG_CLOCK_FREQ;
+}
+
+#else
+
+#include <time.h>
+
+/* 计时单位: 纳秒 */
+typedef uint64_t bench_time_t;
+
+static inline void
+bench_init(void)
+{
+}
+
+static inline bench_time_t
+bench_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static inline double
+bench_to_ns(bench_time_t t)
+{
+    return (double)t;
+}
+
+#endif /* BENCH_DWT */
+
+/**
+ * @brief   输出一项基准结果
+ * @param   name    基准名称
+ * @param   total   各批计时之和 (bench_now() 单位)
+ * @param   ops     操作次数
+ * @param   unit    操作单位 (如 "call"、"step")
+ */
+static inline void
+bench_report(const char *name, bench_time_t total, unsigned long ops,
+             const char *unit)
+{
+    double ns = (ops > 0) ? bench_to_ns(total) / (double)ops : 0.0;
+#ifdef BENCH_DWT
+    printf("  %-36s %10.1f ns/%-5s %8.1f cycles/%-5s (%lu)\n", name, ns, unit,
+           (double)total / (double)(ops > 0 ? ops : 1), unit, ops);
+#else
+    printf("  %-36s %10.1f ns/%-5s (%lu)\n", name, ns, unit, ops);
+#endif
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,243 @@
+/**
+ * @file    bench_motion.c
+ * @brief   运动路径微基准
+ *
+ * 测量热路径上各环节的单次耗时:
+ * - trapq_append()             每个运动段
+ * - toolhead_move()            每个运动 (N 个运动一批，含前瞻规划和提交)
+ * - itersolve_generate_steps() 每步
+ * - gcode_parse_line()         每行
+ *
+ * 使用主机编译器 (gcc -O2) 编译，与单元测试共用 stubs.c
+ *
+ * 编译: make bench_motion
+ * 运行: ./bench_motion
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+#include "gcode.h"
+#include "toolhead.h"
+#include "config.h"
+#include "chelper/trapq.h"
+#include "chelper/itersolve.h"
+#include "chelper/kin_cartesian.h"
+
+/* ========== 基准参数 ========== */
+
+#define BENCH_ROUNDS            2000        /* trapq/itersolve 批数 */
+#define BENCH_APPEND_BATCH      (TRAPQ_MAX_MOVES - 4)
+#define BENCH_MOVE_COUNTS       { 16, 64, 256 }
+#define BENCH_MOVE_REPEAT       20          /* 每种运动数重复批数 */
+#define BENCH_STEP_MOVE_MM      100.0       /* itersolve 基准的运动长度 */
+#define BENCH_STEP_FLUSH        0.002       /* itersolve 每次刷新推进的时间 (秒) */
+#define BENCH_PARSE_ROUNDS      20000
+
+/* 测试桩: 推进模拟时钟并执行到期定时器 */
+extern void test_advance_time(uint32_t ticks);
+extern void test_reset_queued_steps(void);
+
+/* ========== 基准实现 ========== */
+
+/**
+ * @brief   trapq_append: 每批追加到接近内存池上限，批间释放
+ */
+static void
+bench_trapq_append(void)
+{
+    struct coord start = {0.0, 0.0, 0.0, 0.0};
+    struct coord axes_r = {0.6, 0.8, 0.0, 0.0};
+    bench_time_t total = 0;
+    unsigned long ops = 0;
+
+    struct trapq *tq = trapq_alloc();
+    if (tq == NULL) {
+        printf("  trapq_append: trapq_alloc failed\n");
+        return;
+    }
+
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        double t = 1.0;
+        bench_time_t t0 = bench_now();
+        for (int i = 0; i < BENCH_APPEND_BATCH; i++) {
+            trapq_append(tq, t, 0.01, 0.02, 0.01, &start, &axes_r,
+                         0.0, 100.0, 5000.0);
+            t += 0.04;
+        }
+        total += bench_now() - t0;
+        ops += BENCH_APPEND_BATCH;
+
+        trapq_finalize_moves(tq, t + 1.0);
+        trapq_free_moves(tq, t + 1.0);
+    }
+
+    trapq_free(tq);
+    bench_report("trapq_append", total, ops, "move");
+}
+
+/**
+ * @brief   toolhead_move: N 个折线运动连续入队
+ * @param   count   每批运动数
+ *
+ * 计时只覆盖 toolhead_move(): 合并检查、前瞻入队，以及累计足够运动时
+ * 的惰性规划、提交到 trapq 和步进生成 (到驱动队列高水位为止)。
+ * 等待 trapq 空间、批尾刷新和等待运动完成不计时。批尾刷新同时回收
+ * trapq 历史，运动段内存池与其他基准共用。
+ */
+static void
+bench_lookahead(int count)
+{
+    char name[48];
+    bench_time_t total = 0;
+    unsigned long ops = 0;
+
+    for (int r = 0; r < BENCH_MOVE_REPEAT; r++) {
+        test_reset_queued_steps();
+
+        struct coord pos = {10.0, 10.0, 0.0, 0.0};
+        toolhead_set_position(&pos);
+
+        for (int i = 0; i < count; i++) {
+            /* 每段 2mm，方向交替偏转 30 度，每个拐角都需限速 */
+            double angle = (i & 1) ? 0.5236 : -0.5236;
+            pos.x += 2.0 * cos(angle);
+            pos.y += 2.0 * sin(angle);
+            pos.e += 0.1;
+            if (pos.x > X_MAX - 10.0) {
+                pos.x = 10.0;
+            }
+
+            while (!toolhead_can_accept_move()) {
+                test_advance_time((uint32_t)(MOVE_FLUSH_PERIOD * 1000000));
+                toolhead_task();
+            }
+
+            bench_time_t t0 = bench_now();
+            toolhead_move(&pos, 100.0f);
+            total += bench_now() - t0;
+        }
+
+        ops += (unsigned long)count;
+        toolhead_flush();
+        toolhead_wait_moves();
+    }
+
+    snprintf(name, sizeof(name), "toolhead_move (N=%d)", count);
+    bench_report(name, total, ops, "move");
+}
+
+/**
+ * @brief   itersolve_generate_steps: 单轴匀加速-匀速-匀减速运动
+ */
+static void
+bench_itersolve(void)
+{
+    static struct step_queue sq;
+    struct coord start = {0.0, 0.0, 0.0, 0.0};
+    struct coord axes_r = {1.0, 0.0, 0.0, 0.0};
+    struct step_time step;
+    bench_time_t total = 0;
+    unsigned long ops = 0;
+
+    struct trapq *tq = trapq_alloc();
+    struct stepper_kinematics *sk = itersolve_alloc();
+    if (tq == NULL || sk == NULL) {
+        printf("  itersolve_generate_steps: allocation failed\n");
+        return;
+    }
+    cartesian_stepper_setup(sk, CARTESIAN_AXIS_X, STEPS_PER_MM_X);
+    itersolve_set_trapq(sk, tq);
+    itersolve_set_step_queue(sk, &sq);
+
+    /* 100mm: 0.05s 加速到 100mm/s，匀速 0.95s，0.05s 减速 */
+    const double accel_t = 0.05, cruise_t = 0.95, decel_t = 0.05;
+    const double v = BENCH_STEP_MOVE_MM / (cruise_t + accel_t);
+
+    for (int r = 0; r < BENCH_ROUNDS / 20; r++) {
+        double t0_print = 1.0 + r * 2.0;
+        double t_end = t0_print + accel_t + cruise_t + decel_t;
+
+        start.x = 0.0;
+        itersolve_set_position(sk, 0.0);
+        step_queue_init(&sq);
+        itersolve_set_flush_time(sk, t0_print);
+        trapq_append(tq, t0_print, accel_t, cruise_t, decel_t, &start, &axes_r,
+                     0.0, v, v / accel_t);
+
+        for (double flush = t0_print; flush < t_end + BENCH_STEP_FLUSH;
+             flush += BENCH_STEP_FLUSH) {
+            bench_time_t t0 = bench_now();
+            int n = itersolve_generate_steps(sk, flush);
+            total += bench_now() - t0;
+            ops += (unsigned long)(n > 0 ? n : 0);
+            while (step_queue_pop(&sq, &step) == 0) {
+            }
+        }
+
+        trapq_finalize_moves(tq, t_end + 1.0);
+        trapq_free_moves(tq, t_end + 1.0);
+    }
+
+    itersolve_free(sk);
+    trapq_free(tq);
+    bench_report("itersolve_generate_steps", total, ops, "step");
+}
+
+/**
+ * @brief   gcode_parse_line: 切片软件输出的典型行
+ */
+static void
+bench_gcode_parse(void)
+{
+    static const char *const lines[] = {
+        "G1 X101.234 Y87.652 E2.34567",
+        "G1 X102.118 Y88.001 E2.38821 F2400",
+        "G0 F9000 X120.5 Y110.25 Z0.3",
+        "G1 Z0.6 F600",
+        "G2 X110 Y100 I-5.0 J-5.0 E3.1",
+        "M104 S210",
+        "M106 S255",
+        "G1 X98.76 Y92.5 E4.00012 ; perimeter",
+    };
+    const int n_lines = (int)(sizeof(lines) / sizeof(lines[0]));
+    gcode_cmd_t cmd;
+    bench_time_t total = 0;
+    unsigned long ops = 0;
+
+    gcode_init();
+    for (int r = 0; r < BENCH_PARSE_ROUNDS; r++) {
+        bench_time_t t0 = bench_now();
+        for (int i = 0; i < n_lines; i++) {
+            gcode_parse_line(lines[i], &cmd);
+        }
+        total += bench_now() - t0;
+        ops += (unsigned long)n_lines;
+    }
+
+    bench_report("gcode_parse_line", total, ops, "line");
+}
+
+/* ========== 主函数 ========== */
+
+int
+main(void)
+{
+    static const int move_counts[] = BENCH_MOVE_COUNTS;
+
+    bench_init();
+    toolhead_init();
+
+    printf("========== Motion Benchmarks ==========\n");
+    bench_trapq_append();
+    for (unsigned int i = 0; i < sizeof(move_counts) / sizeof(move_counts[0]); i++) {
+        bench_lookahead(move_counts[i]);
+    }
+    bench_itersolve();
+    bench_gcode_parse();
+
+    return 0;
+}
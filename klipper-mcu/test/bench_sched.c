@@ -0,0 +1,141 @@
+/**
+ * @file    bench_sched.c
+ * @brief   调度器定时器堆微基准
+ *
+ * 在不同的排队定时器数下测量 src/sched.c:
+ * - sched_add_timer() + sched_del_timer()  插入并移除一个定时器
+ * - sched_timer_dispatch()                 每个到期回调 (移除堆顶并重新插入)
+ *
+ * 硬件定时器接口由本文件提供，board/irq.h 使用 test/host 下的主机版本。
+ *
+ * 编译: make bench_sched
+ * 运行: ./bench_sched
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include "bench.h"
+#include "autoconf.h"
+#include "sched.h"
+
+/* ========== 基准参数 ========== */
+
+#define BENCH_TIMER_COUNTS      { 1, 4, 8, CONFIG_SCHED_MAX_TIMERS - 1 }
+#define BENCH_ADD_BATCH         256
+#define BENCH_ADD_ROUNDS        2000
+#define BENCH_DISPATCH_ROUNDS   20000
+#define BENCH_TIMER_PERIOD      1000        /* 定时器周期基数 (时钟) */
+#define BENCH_TIME_STEP         BENCH_TIMER_PERIOD  /* 每次分发推进的时钟 */
+
+/* ========== 硬件定时器桩 ========== */
+
+static uint32_t s_bench_time;
+static unsigned long s_fired;
+
+void timer_init(void) { }
+void timer_set_waketime(uint32_t waketime) { (void)waketime; }
+uint32_t timer_read_time(void) { return s_bench_time; }
+uint64_t timer_read_time64(void) { return s_bench_time; }
+
+/* ========== 基准实现 ========== */
+
+static sched_timer_t s_timers[CONFIG_SCHED_MAX_TIMERS];
+
+static sched_time_t
+bench_timer_event(sched_time_t waketime)
+{
+    s_fired++;
+    /* 各定时器周期不同，堆顶不断变化 */
+    return waketime + BENCH_TIMER_PERIOD + 37 * (s_fired % 8);
+}
+
+/**
+ * @brief   排入 count 个周期定时器，唤醒时间错开
+ */
+static void
+bench_fill_timers(int count)
+{
+    sched_init();
+    s_bench_time = 0;
+    s_fired = 0;
+    for (int i = 0; i < count; i++) {
+        s_timers[i].func = bench_timer_event;
+        s_timers[i].waketime = 100 + (uint32_t)((i * 7919) % BENCH_TIMER_PERIOD);
+        s_timers[i].heap_pos = 0;
+        sched_add_timer(&s_timers[i]);
+    }
+}
+
+/**
+ * @brief   已有 count - 1 个定时器时插入并移除第 count 个
+ */
+static void
+bench_add_del(int count)
+{
+    char name[48];
+    sched_timer_t *probe = &s_timers[count - 1];
+    bench_time_t total = 0;
+    unsigned long ops = 0;
+
+    bench_fill_timers(count - 1);
+    probe->func = bench_timer_event;
+    probe->heap_pos = 0;
+
+    for (int r = 0; r < BENCH_ADD_ROUNDS; r++) {
+        bench_time_t t0 = bench_now();
+        for (int i = 0; i < BENCH_ADD_BATCH; i++) {
+            /* 唤醒时间遍布整个周期，插入位置从堆顶到堆底都有 */
+            probe->waketime = 100 + (uint32_t)((i * 389) % BENCH_TIMER_PERIOD);
+            sched_add_timer(probe);
+            sched_del_timer(probe);
+        }
+        total += bench_now() - t0;
+        ops += BENCH_ADD_BATCH;
+    }
+
+    snprintf(name, sizeof(name), "sched_add_timer+del (%d timers)", count);
+    bench_report(name, total, ops, "pair");
+}
+
+/**
+ * @brief   count 个周期定时器的分发开销
+ */
+static void
+bench_dispatch(int count)
+{
+    char name[48];
+    bench_time_t total = 0;
+
+    bench_fill_timers(count);
+
+    for (int r = 0; r < BENCH_DISPATCH_ROUNDS; r++) {
+        s_bench_time += BENCH_TIME_STEP;
+        bench_time_t t0 = bench_now();
+        sched_timer_dispatch();
+        total += bench_now() - t0;
+    }
+
+    snprintf(name, sizeof(name), "sched_timer_dispatch (%d timers)", count);
+    bench_report(name, total, s_fired, "timer");
+}
+
+/* ========== 主函数 ========== */
+
+int
+main(void)
+{
+    static const int counts[] = BENCH_TIMER_COUNTS;
+
+    bench_init();
+
+    printf("========== Scheduler Benchmarks ==========\n");
+    for (unsigned int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        bench_add_del(counts[i]);
+    }
+    for (unsigned int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        bench_dispatch(counts[i]);
+    }
+
+    return 0;
+}
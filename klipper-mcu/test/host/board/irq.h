@@ -0,0 +1,84 @@
+/**
+ * @file    irq.h
+ * @brief   主机版中断控制 (替代 board/irq.h)
+ *
+ * 仅供在主机上编译 src/ 代码的基准程序使用: 把 test/host 放在头文件
+ * 搜索路径最前面，"board/irq.h" 即解析到这里。单线程运行，关中断
+ * 和 BASEPRI 屏蔽只需保持与目标相同的返回值约定。
+ */
+
+#ifndef BOARD_IRQ_H
+#define BOARD_IRQ_H
+
+#include <stdint.h>
+
+static uint32_t s_host_primask;
+
+static inline uint32_t irq_disable(void)
+{
+    uint32_t primask = s_host_primask;
+    s_host_primask = 1;
+    return primask;
+}
+
+static inline void irq_enable(void)
+{
+    s_host_primask = 0;
+}
+
+static inline void irq_restore(uint32_t flag)
+{
+    s_host_primask = flag;
+}
+
+static inline int irq_enabled(void)
+{
+    return !s_host_primask;
+}
+
+static inline void irq_wait(void)
+{
+}
+
+static inline uint32_t critical_enter(void)
+{
+    return irq_disable();
+}
+
+static inline void critical_exit(uint32_t flag)
+{
+    irq_restore(flag);
+}
+
+/* 优先级规划与 BASEPRI 屏蔽: 单线程下只需保持嵌套语义 */
+
+#define IRQ_PRIO_BITS           4
+#define IRQ_PRIO(level)         ((uint8_t)((level) << (8 - IRQ_PRIO_BITS)))
+
+#define IRQ_PRIO_STEP           IRQ_PRIO(1)
+#define IRQ_PRIO_COMMS          IRQ_PRIO(4)
+#define IRQ_PRIO_HOUSEKEEPING   IRQ_PRIO(8)
+#define IRQ_PRIO_LOWEST         IRQ_PRIO(15)
+
+static uint32_t s_host_basepri;
+
+static inline uint32_t irq_mask_level(uint8_t prio)
+{
+    uint32_t basepri = s_host_basepri;
+    if (basepri == 0 || prio < basepri) {
+        s_host_basepri = prio;
+    }
+    return basepri;
+}
+
+static inline void irq_unmask_level(uint32_t flag)
+{
+    s_host_basepri = flag;
+}
+
+static inline int irq_level_masked(uint32_t flag, uint8_t prio)
+{
+    return flag != 0 && flag <= prio;
+}
+
+#endif /* BOARD_IRQ_H */
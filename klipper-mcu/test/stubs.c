@@ -17,6 +17,11 @@ uint32_t sched_get_time(void)
     return s_mock_time++;
 }
 
+uint64_t sched_get_time64(void)
+{
+    return s_mock_time++;
+}
+
 void sched_main(void)
 {
     /* 模拟调度器主循环 - 什么都不做 */
@@ -29,6 +34,62 @@ int sched_init(void)
     return 0;
 }
 
+int32_t sched_time_diff(uint32_t t1, uint32_t t2)
+{
+    return (int32_t)(t1 - t2);
+}
+
+/* 定时器桩: 记录排队的定时器，只在 test_advance_time() 中到期 */
+typedef struct {
+    uint32_t waketime;
+    uint32_t (*func)(uint32_t waketime);
+    uint16_t heap_pos;
+} stub_sched_timer_t;
+
+#define STUB_MAX_TIMERS 8
+static stub_sched_timer_t *s_timers[STUB_MAX_TIMERS];
+
+void sched_add_timer(stub_sched_timer_t *timer)
+{
+    if (timer->heap_pos == 0) {
+        for (int i = 0; i < STUB_MAX_TIMERS; i++) {
+            if (s_timers[i] == NULL) {
+                s_timers[i] = timer;
+                break;
+            }
+        }
+    }
+    timer->heap_pos = 1;
+}
+
+void sched_del_timer(stub_sched_timer_t *timer)
+{
+    for (int i = 0; i < STUB_MAX_TIMERS; i++) {
+        if (s_timers[i] == timer) {
+            s_timers[i] = NULL;
+        }
+    }
+    timer->heap_pos = 0;
+}
+
+/* 测试辅助函数: 推进时钟并执行到期的定时器 (每个最多一次) */
+void test_advance_time(uint32_t ticks)
+{
+    s_mock_time += ticks;
+    for (int i = 0; i < STUB_MAX_TIMERS; i++) {
+        stub_sched_timer_t *timer = s_timers[i];
+        if (timer == NULL || (int32_t)(timer->waketime - s_mock_time) > 0) {
+            continue;
+        }
+        uint32_t next = timer->func(timer->waketime);
+        if (next == 0) {
+            sched_del_timer(timer);
+        } else {
+            timer->waketime = next;
+        }
+    }
+}
+
 /* ========== 步进电机桩函数 ========== */
 
 static int32_t s_stepper_pos[4] = {0, 0, 0, 0};
@@ -80,10 +141,77 @@ void stepper_set_position(int id, int32_t pos)
     }
 }
 
+/* 步进队列桩: 记录 toolhead 送入的步数 */
+typedef struct {
+    int32_t position;
+    int32_t target;
+    uint32_t interval;
+    uint32_t count;
+    int32_t add;
+    int8_t dir;
+} stub_stepper_move_t;
+
+static int32_t s_queued_steps[4] = {0, 0, 0, 0};
+static uint32_t s_queued_moves[4] = {0, 0, 0, 0};
+
+int stepper_queue_move(int id, const stub_stepper_move_t *move)
+{
+    if (id < 0 || id >= 4 || move == NULL) {
+        return -1;
+    }
+    s_queued_steps[id] += (move->dir >= 0) ? (int32_t)move->count
+                                           : -(int32_t)move->count;
+    s_queued_moves[id]++;
+    return 0;
+}
+
+void stepper_reset_step_clock(int id, uint32_t clock)
+{
+    (void)id;
+    (void)clock;
+}
+
+/* 桩队列不保存运动段: 总是低于高水位，没有取段事件 */
+int stepper_queue_want(int id)
+{
+    return (id >= 0 && id < 4) ? 1 : 0;
+}
+
+uint32_t stepper_take_refill_mask(void)
+{
+    return 0;
+}
+
+/* 测试辅助函数: 读取/清零已入队的步数 (带方向) */
+int32_t test_get_queued_steps(int id)
+{
+    if (id >= 0 && id < 4) {
+        return s_queued_steps[id];
+    }
+    return 0;
+}
+
+uint32_t test_get_queued_moves(int id)
+{
+    if (id >= 0 && id < 4) {
+        return s_queued_moves[id];
+    }
+    return 0;
+}
+
+void test_reset_queued_steps(void)
+{
+    for (int i = 0; i < 4; i++) {
+        s_queued_steps[i] = 0;
+        s_queued_moves[i] = 0;
+    }
+}
+
 /* ========== 限位开关桩函数 ========== */
 
 static int s_endstop_triggered[3] = {0, 0, 0};
 static int s_endstop_homing[3] = {0, 0, 0};
+static uint32_t s_endstop_trigger_clock[3] = {0, 0, 0};
 static void (*s_endstop_callback[3])(int, void*) = {NULL, NULL, NULL};
 static void *s_endstop_callback_arg[3] = {NULL, NULL, NULL};
 
@@ -104,6 +232,7 @@ int endstop_is_triggered(int id)
         /* 模拟: 在归零模式下，经过一段时间后触发 */
         if (s_endstop_homing[id]) {
             s_endstop_triggered[id] = 1;
+            s_endstop_trigger_clock[id] = s_mock_time;
             if (s_endstop_callback[id] != NULL) {
                 s_endstop_callback[id](id, s_endstop_callback_arg[id]);
             }
@@ -113,6 +242,14 @@ int endstop_is_triggered(int id)
     return 0;
 }
 
+uint32_t endstop_get_trigger_clock(int id)
+{
+    if (id >= 0 && id < 3) {
+        return s_endstop_trigger_clock[id];
+    }
+    return 0;
+}
+
 void endstop_home_start(int id)
 {
     if (id >= 0 && id < 3) {
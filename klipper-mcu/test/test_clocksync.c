@@ -0,0 +1,279 @@
+/**
+ * @file    test_clocksync.c
+ * @brief   多 MCU 时钟同步估计单元测试
+ *
+ * 测试 chelper/clocksync.c 的偏移/漂移回归、32 位回绕、离群值过滤
+ * 和双向换算。从 MCU 时钟按固定频偏模拟，链路延迟带确定性抖动。
+ * 使用主机编译器 (gcc) 编译运行
+ *
+ * 编译: gcc -o test_clocksync test_clocksync.c ../chelper/clocksync.c -I.. -lm
+ * 运行: ./test_clocksync
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "chelper/clocksync.h"
+
+/* ========== 测试框架 ========== */
+
+static int g_tests_run = 0;
+static int g_tests_passed = 0;
+static int g_tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        return 0; \
+    } \
+} while (0)
+
+#define TEST_ASSERT_EQ(a, b, msg) do { \
+    if ((a) != (b)) { \
+        printf("  FAIL: %s - expected %d, got %d (line %d)\n", msg, (int)(b), (int)(a), __LINE__); \
+        return 0; \
+    } \
+} while (0)
+
+#define RUN_TEST(test_func) do { \
+    g_tests_run++; \
+    printf("Running %s...\n", #test_func); \
+    if (test_func()) { \
+        g_tests_passed++; \
+        printf("  PASS\n"); \
+    } else { \
+        g_tests_failed++; \
+    } \
+} while (0)
+
+/* ========== 模拟链路 ========== */
+
+#define SIM_FREQ        1000000.0   /* 两侧标称时钟 (Hz) */
+#define SIM_MIN_DELAY   40          /* 单向最小延迟 (时钟) */
+#define SIM_JITTER      40          /* 单向延迟抖动上限 (时钟) */
+
+/* 模拟状态: 从 MCU 时钟 = remote0 + (本机时钟 - local0) * (1 + ppm) */
+typedef struct {
+    double local;               /* 本机时钟 (未回绕) */
+    double local0;
+    double remote0;
+    double ppm;
+    uint32_t rng;
+} sim_t;
+
+static uint32_t
+sim_rand(sim_t *sim)
+{
+    sim->rng = sim->rng * 1103515245u + 12345u;
+    return (sim->rng >> 16) & 0x7FFF;
+}
+
+static uint32_t
+sim_delay(sim_t *sim)
+{
+    return SIM_MIN_DELAY + sim_rand(sim) % (SIM_JITTER + 1);
+}
+
+/* 本机时刻 local 对应的从 MCU 时钟 (32 位回绕) */
+static uint32_t
+sim_remote_at(const sim_t *sim, double local)
+{
+    double r = sim->remote0 + (local - sim->local0) * (1.0 + sim->ppm * 1e-6);
+    return (uint32_t)(uint64_t)llround(r);
+}
+
+static void
+sim_init(sim_t *sim, double local0, double remote0, double ppm)
+{
+    sim->local = local0;
+    sim->local0 = local0;
+    sim->remote0 = remote0;
+    sim->ppm = ppm;
+    sim->rng = 1;
+}
+
+/**
+ * @brief  一次 get_clock 往返，extra_delay 加在从 MCU 读时钟之前
+ * @retval clocksync_add_sample() 的返回值
+ */
+static int
+sim_exchange(sim_t *sim, struct clocksync *cs, uint32_t extra_delay)
+{
+    double sent = sim->local;
+    double read = sent + sim_delay(sim) + extra_delay;
+    double recv = read + sim_delay(sim);
+    return clocksync_add_sample(cs, (uint32_t)(uint64_t)sent,
+                                (uint32_t)(uint64_t)recv,
+                                sim_remote_at(sim, read));
+}
+
+/**
+ * @brief  启动阶段 8 次 50ms 采样，之后 count 次约 1s 采样
+ */
+static void
+sim_run(sim_t *sim, struct clocksync *cs, int count)
+{
+    for (int i = 0; i < 8; i++) {
+        sim_exchange(sim, cs, 0);
+        sim->local += 50000.0;
+    }
+    for (int i = 0; i < count; i++) {
+        sim_exchange(sim, cs, 0);
+        sim->local += 984000.0;
+    }
+}
+
+/* 本机时刻 local 上的换算误差 (从 MCU 时钟) */
+static int32_t
+sim_error(const sim_t *sim, const struct clocksync *cs, double local)
+{
+    uint32_t est = clocksync_local_to_remote(cs, (uint32_t)(uint64_t)local);
+    return (int32_t)(est - sim_remote_at(sim, local));
+}
+
+/* ========== 测试用例 ========== */
+
+/**
+ * @brief  首个样本: 按标称频率和半个往返延迟给出估计
+ */
+static int
+test_first_sample(void)
+{
+    struct clocksync cs;
+    clocksync_init(&cs, SIM_FREQ, SIM_FREQ);
+    TEST_ASSERT(!clocksync_is_valid(&cs), "no estimate before first sample");
+
+    TEST_ASSERT_EQ(clocksync_add_sample(&cs, 1000, 1100, 500050), 0,
+                   "first sample accepted");
+    TEST_ASSERT(clocksync_is_valid(&cs), "estimate after first sample");
+
+    /* 从 MCU 在 1050 读到 500050 */
+    TEST_ASSERT_EQ(clocksync_local_to_remote(&cs, 1050), 500050,
+                   "remote clock at mid round trip");
+    TEST_ASSERT_EQ(clocksync_local_to_remote(&cs, 2050), 501050,
+                   "nominal ratio before regression");
+    TEST_ASSERT_EQ(clocksync_remote_to_local(&cs, 500050), 1050,
+                   "inverse at mid round trip");
+    return 1;
+}
+
+/**
+ * @brief  频偏跟踪: 100ppm 频偏、带抖动的链路上误差在数个时钟内
+ */
+static int
+test_drift_tracking(void)
+{
+    sim_t sim;
+    struct clocksync cs;
+    sim_init(&sim, 5000000.0, 123456789.0, 100.0);
+    clocksync_init(&cs, SIM_FREQ, SIM_FREQ);
+
+    sim_run(&sim, &cs, 120);
+
+    double ratio = 1.0 + 100e-6;
+    TEST_ASSERT(fabs(cs.freq - ratio) < 2e-6, "frequency ratio converges");
+
+    /* 当前时刻和 0.5 秒后 (运动提前量) 的换算 */
+    int32_t err_now = sim_error(&sim, &cs, sim.local);
+    int32_t err_ahead = sim_error(&sim, &cs, sim.local + 500000.0);
+    TEST_ASSERT(abs(err_now) <= 5, "offset within 5us now");
+    TEST_ASSERT(abs(err_ahead) <= 5, "offset within 5us 0.5s ahead");
+    TEST_ASSERT(clocksync_get_stddev(&cs) < 200.0, "prediction stddev settles");
+    return 1;
+}
+
+/**
+ * @brief  回绕: 两侧时钟在同步过程中跨过 2^32
+ */
+static int
+test_wraparound(void)
+{
+    sim_t sim;
+    struct clocksync cs;
+    sim_init(&sim, 4294967296.0 - 30e6, 4294967296.0 - 10e6, -50.0);
+    clocksync_init(&cs, SIM_FREQ, SIM_FREQ);
+
+    sim_run(&sim, &cs, 60);
+
+    TEST_ASSERT(sim.local > 4294967296.0, "local clock wrapped");
+    TEST_ASSERT(abs(sim_error(&sim, &cs, sim.local)) <= 5,
+                "offset within 5us across wrap");
+    TEST_ASSERT(fabs(cs.freq - (1.0 - 50e-6)) < 2e-6,
+                "frequency ratio across wrap");
+    return 1;
+}
+
+/**
+ * @brief  离群值: 从 MCU 晚读时钟 (往返过慢) 的回复被丢弃，估计不变
+ */
+static int
+test_outlier_rejected(void)
+{
+    sim_t sim;
+    struct clocksync cs;
+    sim_init(&sim, 0.0, 777.0, 20.0);
+    clocksync_init(&cs, SIM_FREQ, SIM_FREQ);
+
+    sim_run(&sim, &cs, 60);
+    struct clocksync before = cs;
+
+    TEST_ASSERT_EQ(sim_exchange(&sim, &cs, 5000), 1, "delayed reply dropped");
+    TEST_ASSERT_EQ(cs.rejected, 1, "rejection counted");
+    TEST_ASSERT(cs.samples == before.samples, "sample count unchanged");
+    TEST_ASSERT(cs.clock_avg == before.clock_avg, "regression unchanged");
+
+    sim.local += 984000.0;
+    TEST_ASSERT_EQ(sim_exchange(&sim, &cs, 0), 0, "normal reply accepted");
+    TEST_ASSERT(abs(sim_error(&sim, &cs, sim.local)) <= 5,
+                "offset still within 5us");
+    return 1;
+}
+
+/**
+ * @brief  双向换算: 本机 -> 从 MCU -> 本机 误差不超过 1 个时钟
+ */
+static int
+test_roundtrip(void)
+{
+    sim_t sim;
+    struct clocksync cs;
+    sim_init(&sim, 100.0, 3000000000.0, 250.0);
+    clocksync_init(&cs, SIM_FREQ, SIM_FREQ);
+
+    sim_run(&sim, &cs, 40);
+
+    for (int i = 0; i < 16; i++) {
+        uint32_t local = (uint32_t)(uint64_t)sim.local + (uint32_t)i * 123457u;
+        uint32_t remote = clocksync_local_to_remote(&cs, local);
+        uint32_t back = clocksync_remote_to_local(&cs, remote);
+        TEST_ASSERT(abs((int32_t)(back - local)) <= 1, "local -> remote -> local");
+    }
+    return 1;
+}
+
+/* ========== 主函数 ========== */
+
+int
+main(void)
+{
+    printf("========================================\n");
+    printf("  Clock Sync Unit Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_first_sample);
+    RUN_TEST(test_drift_tracking);
+    RUN_TEST(test_wraparound);
+    RUN_TEST(test_outlier_rejected);
+    RUN_TEST(test_roundtrip);
+
+    /* 输出结果 */
+    printf("\n========================================\n");
+    printf("  Test Results\n");
+    printf("========================================\n");
+    printf("Total:  %d\n", g_tests_run);
+    printf("Passed: %d\n", g_tests_passed);
+    printf("Failed: %d\n", g_tests_failed);
+    printf("========================================\n");
+
+    return (g_tests_failed > 0) ? 1 : 0;
+}
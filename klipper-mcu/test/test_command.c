@@ -0,0 +1,563 @@
+/**
+ * @file    test_command.c
+ * @brief   二进制命令协议单元测试
+ *
+ * 测试 command.c 的 VLQ 编解码、CRC、消息块校验、序号/ack 和
+ * CMD_BUSY 续处理
+ * 使用主机编译器 (gcc) 编译运行
+ *
+ * 编译: gcc -o test_command test_command.c ../src/command.c -I../src -I.. -DTEST_BUILD
+ * 运行: ./test_command
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command.h"
+#include "sched.h"
+#include "stm32/serial.h"
+
+/* ========== 测试框架 ========== */
+
+static int g_tests_run = 0;
+static int g_tests_passed = 0;
+static int g_tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        return 0; \
+    } \
+} while (0)
+
+#define TEST_ASSERT_EQ(a, b, msg) do { \
+    if ((a) != (b)) { \
+        printf("  FAIL: %s - expected %d, got %d (line %d)\n", msg, (int)(b), (int)(a), __LINE__); \
+        return 0; \
+    } \
+} while (0)
+
+#define RUN_TEST(test_func) do { \
+    g_tests_run++; \
+    printf("Running %s...\n", #test_func); \
+    if (test_func()) { \
+        g_tests_passed++; \
+        printf("  PASS\n"); \
+    } else { \
+        g_tests_failed++; \
+    } \
+} while (0)
+
+/* ========== 串口/调度器桩函数 ========== */
+
+/* 记录发送的消息块 */
+#define MAX_WRITES  8
+static uint8_t g_writes[MAX_WRITES][CMD_MESSAGE_MAX];
+static size_t g_write_len[MAX_WRITES];
+static int g_write_count = 0;
+
+int
+serial_write(const uint8_t *data, size_t len)
+{
+    if (g_write_count < MAX_WRITES && len <= CMD_MESSAGE_MAX) {
+        memcpy(g_writes[g_write_count], data, len);
+        g_write_len[g_write_count] = len;
+    }
+    g_write_count++;
+    return (int)len;
+}
+
+/* 模拟单个接收行槽 */
+static uint8_t g_slot[CMD_MESSAGE_MAX];
+static size_t g_slot_len = 0;
+static int g_slot_kind = -1;
+static int g_releases = 0;
+
+int
+serial_line_kind(void)
+{
+    return g_slot_kind;
+}
+
+const char *
+serial_line_peek(size_t *len)
+{
+    if (g_slot_kind < 0) {
+        return NULL;
+    }
+    if (len != NULL) {
+        *len = g_slot_len;
+    }
+    return (const char *)g_slot;
+}
+
+void
+serial_line_release(void)
+{
+    g_slot_kind = -1;
+    g_releases++;
+}
+
+sched_time_t
+sched_get_time(void)
+{
+    return 123456789;
+}
+
+/* ========== 测试命令 ========== */
+
+#define TEST_CMD_RECORD     20      /* record a b */
+#define TEST_CMD_BUSY       21      /* 首次调用返回 CMD_BUSY */
+#define TEST_CMD_FAIL       22      /* 返回错误 */
+
+static int g_record_calls = 0;
+static uint32_t g_record_a = 0;
+static uint32_t g_record_b = 0;
+static int g_busy_left = 0;
+static int g_busy_calls = 0;
+
+static int
+cmd_record(const cmd_args_t *args)
+{
+    g_record_calls++;
+    g_record_a = args->values[0];
+    g_record_b = args->values[1];
+    return 0;
+}
+
+static int
+cmd_busy(const cmd_args_t *args)
+{
+    (void)args;
+    g_busy_calls++;
+    if (g_busy_left > 0) {
+        g_busy_left--;
+        return CMD_BUSY;
+    }
+    return 0;
+}
+
+static int
+cmd_fail(const cmd_args_t *args)
+{
+    (void)args;
+    return -7;
+}
+
+static const cmd_desc_t g_test_cmds[] = {
+    { TEST_CMD_RECORD, "record", cmd_record, 2 },
+    { TEST_CMD_BUSY, "busy", cmd_busy, 0 },
+    { TEST_CMD_FAIL, "fail", cmd_fail, 0 },
+};
+
+/* ========== 辅助函数 ========== */
+
+/**
+ * @brief   复位命令层和桩状态
+ */
+static void
+reset(void)
+{
+    command_init();
+    for (size_t i = 0; i < sizeof(g_test_cmds) / sizeof(g_test_cmds[0]); i++) {
+        command_register(&g_test_cmds[i]);
+    }
+    g_write_count = 0;
+    g_record_calls = 0;
+    g_busy_left = 0;
+    g_busy_calls = 0;
+    g_slot_kind = -1;
+    g_releases = 0;
+}
+
+/**
+ * @brief   组装消息块
+ * @retval  消息块长度
+ */
+static size_t
+build_frame(uint8_t *frame, uint8_t seq, const uint8_t *content, size_t len)
+{
+    size_t total = len + CMD_MESSAGE_HEADER_SIZE + CMD_MESSAGE_TRAILER_SIZE;
+
+    frame[CMD_MESSAGE_POS_LEN] = (uint8_t)total;
+    frame[CMD_MESSAGE_POS_SEQ] = seq;
+    if (len > 0) {
+        memcpy(frame + CMD_MESSAGE_HEADER_SIZE, content, len);
+    }
+    uint16_t crc = cmd_crc16(frame, total - CMD_MESSAGE_TRAILER_SIZE);
+    frame[total - 3] = (uint8_t)(crc >> 8);
+    frame[total - 2] = (uint8_t)(crc & 0xFF);
+    frame[total - 1] = CMD_MESSAGE_SYNC;
+
+    return total;
+}
+
+/**
+ * @brief   检查第 n 次发送是否为给定序号的 ack
+ */
+static int
+is_ack(int n, uint8_t seq)
+{
+    return n < g_write_count && g_write_len[n] == CMD_MESSAGE_MIN &&
+           g_writes[n][CMD_MESSAGE_POS_SEQ] == seq &&
+           g_writes[n][CMD_MESSAGE_MIN - 1] == CMD_MESSAGE_SYNC;
+}
+
+/* ========== 测试用例 ========== */
+
+/**
+ * @brief   测试 VLQ 编解码往返及编码长度
+ */
+static int
+test_vlq_roundtrip(void)
+{
+    static const struct {
+        int32_t value;
+        size_t len;
+    } cases[] = {
+        { 0, 1 }, { 95, 1 }, { 96, 2 }, { -32, 1 }, { -33, 2 },
+        { 12287, 2 }, { 12288, 3 }, { -4096, 2 }, { -4097, 3 },
+        { 1000000, 3 }, { 100000000, 4 }, { 0x7FFFFFFF, 5 },
+        { (int32_t)0x80000000, 5 },
+    };
+    uint8_t buf[8];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        size_t n = cmd_encode_vlq(buf, (uint32_t)cases[i].value);
+        TEST_ASSERT_EQ(n, cases[i].len, "encoded length");
+
+        const uint8_t *p = buf;
+        uint32_t v = 0;
+        int ret = cmd_decode_vlq(&p, buf + n, &v);
+        TEST_ASSERT_EQ(ret, 0, "decode should succeed");
+        TEST_ASSERT((int32_t)v == cases[i].value, "decoded value should round trip");
+        TEST_ASSERT(p == buf + n, "decode should consume the encoding");
+    }
+
+    /* 截断的编码 */
+    size_t n = cmd_encode_vlq(buf, 1000000);
+    const uint8_t *p = buf;
+    uint32_t v;
+    int ret = cmd_decode_vlq(&p, buf + n - 1, &v);
+    TEST_ASSERT_EQ(ret, -1, "truncated VLQ should fail");
+    TEST_ASSERT(p == buf, "failed decode should not advance");
+
+    return 1;
+}
+
+/**
+ * @brief   测试 CRC16 参考值
+ */
+static int
+test_crc16(void)
+{
+    const uint8_t check[] = "123456789";
+    uint16_t crc = cmd_crc16(check, 9);
+
+    TEST_ASSERT_EQ(crc, 0x6F91, "CRC-16/MCRF4XX check value");
+    crc = cmd_crc16(check, 0);
+    TEST_ASSERT_EQ(crc, 0xFFFF, "empty CRC is the seed");
+
+    return 1;
+}
+
+/**
+ * @brief   测试按 ID 索引的分发表注册规则
+ */
+static int
+test_register_table(void)
+{
+    static const cmd_desc_t dup = { TEST_CMD_RECORD, "dup", cmd_record, 0 };
+    static const cmd_desc_t high = { CMD_ID_MAX + 1, "high", cmd_record, 0 };
+    static const cmd_desc_t last = { CMD_ID_MAX, "last", cmd_record, 2 };
+    static const cmd_desc_t wide = { 30, "wide", cmd_record, CMD_MAX_ARGS + 1 };
+    uint8_t content[4];
+    int ret;
+
+    reset();
+    ret = command_register(&dup);
+    TEST_ASSERT_EQ(ret, -3, "duplicate ID should be rejected");
+    ret = command_register(&high);
+    TEST_ASSERT_EQ(ret, -1, "ID above CMD_ID_MAX should be rejected");
+    ret = command_register(&wide);
+    TEST_ASSERT_EQ(ret, -1, "too many arguments should be rejected");
+    ret = command_register(NULL);
+    TEST_ASSERT_EQ(ret, -1, "NULL descriptor should be rejected");
+    ret = command_register(&last);
+    TEST_ASSERT_EQ(ret, 0, "CMD_ID_MAX should be accepted");
+
+    /* 最高 ID 可分发，参数视图指向原始数据 */
+    size_t len = cmd_encode_vlq(content, CMD_ID_MAX);
+    content[len++] = 9;
+    content[len++] = 8;
+    ret = command_process(content, len);
+    TEST_ASSERT_EQ(ret, 0, "highest ID should dispatch");
+    TEST_ASSERT_EQ(g_record_a, 9, "first argument");
+    TEST_ASSERT_EQ(g_record_b, 8, "second argument");
+
+    return 1;
+}
+
+/**
+ * @brief   测试消息块分发、参数解码和 ack
+ */
+static int
+test_frame_dispatch(void)
+{
+    uint8_t content[16];
+    uint8_t frame[CMD_MESSAGE_MAX];
+    size_t len = 0;
+    cmd_stats_t stats;
+
+    reset();
+    len += cmd_encode_vlq(content + len, TEST_CMD_RECORD);
+    len += cmd_encode_vlq(content + len, 5000);
+    len += cmd_encode_vlq(content + len, (uint32_t)-7);
+    size_t flen = build_frame(frame, CMD_MESSAGE_DEST, content, len);
+
+    int ret = command_process_frame(frame, flen);
+    TEST_ASSERT_EQ(ret, 0, "frame should be processed");
+    TEST_ASSERT_EQ(g_record_calls, 1, "handler should run once");
+    TEST_ASSERT_EQ(g_record_a, 5000, "first argument");
+    TEST_ASSERT((int32_t)g_record_b == -7, "negative second argument");
+    TEST_ASSERT_EQ(g_write_count, 1, "one ack should be sent");
+    TEST_ASSERT(is_ack(0, CMD_MESSAGE_DEST | 1), "ack carries next sequence");
+
+    command_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.frames_ok, 1, "frames_ok counter");
+
+    return 1;
+}
+
+/**
+ * @brief   测试 CRC 错误和序号错误时丢弃并回复期望序号
+ */
+static int
+test_frame_errors(void)
+{
+    uint8_t content[4];
+    uint8_t frame[CMD_MESSAGE_MAX];
+    size_t len = cmd_encode_vlq(content, TEST_CMD_RECORD);
+    content[len++] = 1;
+    content[len++] = 2;
+    cmd_stats_t stats;
+    int ret;
+
+    reset();
+
+    /* CRC 错误 */
+    size_t flen = build_frame(frame, CMD_MESSAGE_DEST, content, len);
+    frame[flen - 2] ^= 0x01;
+    ret = command_process_frame(frame, flen);
+    TEST_ASSERT_EQ(ret, CMD_ERR_CRC, "bad CRC should be rejected");
+    TEST_ASSERT_EQ(g_record_calls, 0, "bad frame should not dispatch");
+    TEST_ASSERT(is_ack(0, CMD_MESSAGE_DEST), "nak carries expected sequence");
+
+    /* 长度/尾部同步错误: 不回复 */
+    flen = build_frame(frame, CMD_MESSAGE_DEST, content, len);
+    frame[flen - 1] = 0;
+    ret = command_process_frame(frame, flen);
+    TEST_ASSERT_EQ(ret, CMD_ERR_FRAME, "missing sync should be rejected");
+    ret = command_process_frame(frame, CMD_MESSAGE_MIN - 1);
+    TEST_ASSERT_EQ(ret, CMD_ERR_FRAME, "short frame should be rejected");
+    TEST_ASSERT_EQ(g_write_count, 1, "framing errors are not acked");
+
+    /* 正常块后重发同一序号 */
+    flen = build_frame(frame, CMD_MESSAGE_DEST, content, len);
+    ret = command_process_frame(frame, flen);
+    TEST_ASSERT_EQ(ret, 0, "good frame should be processed");
+    ret = command_process_frame(frame, flen);
+    TEST_ASSERT_EQ(ret, CMD_ERR_SEQ, "duplicate should be rejected");
+    TEST_ASSERT_EQ(g_record_calls, 1, "duplicate should not dispatch");
+    TEST_ASSERT(is_ack(g_write_count - 1, CMD_MESSAGE_DEST | 1),
+                "duplicate is acked with expected sequence");
+
+    command_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.crc_errors, 1, "crc_errors counter");
+    TEST_ASSERT_EQ(stats.seq_errors, 1, "seq_errors counter");
+
+    return 1;
+}
+
+/**
+ * @brief   测试序号回绕
+ */
+static int
+test_sequence_wrap(void)
+{
+    uint8_t frame[CMD_MESSAGE_MAX];
+    int ret;
+
+    reset();
+    for (int i = 0; i < 20; i++) {
+        uint8_t seq = (uint8_t)(CMD_MESSAGE_DEST | (i & CMD_MESSAGE_SEQ_MASK));
+        size_t flen = build_frame(frame, seq, NULL, 0);
+        g_write_count = 0;
+        ret = command_process_frame(frame, flen);
+        TEST_ASSERT_EQ(ret, 0, "in-order empty frame should be accepted");
+    }
+    TEST_ASSERT(is_ack(0, CMD_MESSAGE_DEST | (20 & CMD_MESSAGE_SEQ_MASK)),
+                "sequence should wrap within SEQ_MASK");
+
+    return 1;
+}
+
+/**
+ * @brief   测试 CMD_BUSY 后从未完成的命令继续
+ */
+static int
+test_frame_busy_resume(void)
+{
+    uint8_t content[16];
+    uint8_t frame[CMD_MESSAGE_MAX];
+    size_t len = 0;
+    int ret;
+
+    reset();
+    len += cmd_encode_vlq(content + len, TEST_CMD_RECORD);
+    len += cmd_encode_vlq(content + len, 1);
+    len += cmd_encode_vlq(content + len, 2);
+    len += cmd_encode_vlq(content + len, TEST_CMD_BUSY);
+    len += cmd_encode_vlq(content + len, TEST_CMD_RECORD);
+    len += cmd_encode_vlq(content + len, 3);
+    len += cmd_encode_vlq(content + len, 4);
+    size_t flen = build_frame(frame, CMD_MESSAGE_DEST, content, len);
+
+    g_busy_left = 1;
+    ret = command_process_frame(frame, flen);
+    TEST_ASSERT_EQ(ret, CMD_BUSY, "busy command should stall the frame");
+    TEST_ASSERT_EQ(g_record_calls, 1, "commands before busy should run");
+    TEST_ASSERT_EQ(g_write_count, 0, "stalled frame should not be acked");
+
+    ret = command_process_frame(frame, flen);
+    TEST_ASSERT_EQ(ret, 0, "frame should complete on retry");
+    TEST_ASSERT_EQ(g_busy_calls, 2, "busy command should be retried");
+    TEST_ASSERT_EQ(g_record_calls, 2, "earlier commands should not rerun");
+    TEST_ASSERT_EQ(g_record_a, 3, "later command should run");
+    TEST_ASSERT(is_ack(0, CMD_MESSAGE_DEST | 1), "completed frame is acked");
+
+    return 1;
+}
+
+/**
+ * @brief   测试 get_clock 响应、未知命令和失败命令的错误响应
+ */
+static int
+test_responses(void)
+{
+    uint8_t content[8];
+    uint8_t frame[CMD_MESSAGE_MAX];
+    size_t len;
+    const uint8_t *p;
+    uint32_t v;
+    cmd_stats_t stats;
+
+    reset();
+    len = cmd_encode_vlq(content, CMD_ID_GET_CLOCK);
+    size_t flen = build_frame(frame, CMD_MESSAGE_DEST, content, len);
+    command_process_frame(frame, flen);
+    TEST_ASSERT_EQ(g_write_count, 2, "response then ack");
+
+    /* 响应块: len seq id clock crc sync */
+    const uint8_t *rsp = g_writes[0];
+    TEST_ASSERT_EQ(rsp[CMD_MESSAGE_POS_LEN], g_write_len[0], "response length byte");
+    uint16_t crc = cmd_crc16(rsp, g_write_len[0] - CMD_MESSAGE_TRAILER_SIZE);
+    TEST_ASSERT_EQ(rsp[g_write_len[0] - 3], crc >> 8, "response CRC high");
+    TEST_ASSERT_EQ(rsp[g_write_len[0] - 2], crc & 0xFF, "response CRC low");
+    p = rsp + CMD_MESSAGE_HEADER_SIZE;
+    cmd_decode_vlq(&p, rsp + g_write_len[0], &v);
+    TEST_ASSERT_EQ(v, CMD_RSP_CLOCK, "response id");
+    cmd_decode_vlq(&p, rsp + g_write_len[0], &v);
+    TEST_ASSERT_EQ(v, 123456789, "clock value");
+
+    /* 未知命令 */
+    g_write_count = 0;
+    len = cmd_encode_vlq(content, 99);
+    flen = build_frame(frame, CMD_MESSAGE_DEST | 1, content, len);
+    command_process_frame(frame, flen);
+    TEST_ASSERT_EQ(g_write_count, 2, "error response then ack");
+    p = g_writes[0] + CMD_MESSAGE_HEADER_SIZE;
+    cmd_decode_vlq(&p, g_writes[0] + g_write_len[0], &v);
+    TEST_ASSERT_EQ(v, CMD_RSP_ERROR, "error response id");
+    cmd_decode_vlq(&p, g_writes[0] + g_write_len[0], &v);
+    TEST_ASSERT_EQ(v, 99, "error names the command");
+    command_get_stats(&stats);
+    TEST_ASSERT_EQ(stats.unknown_cmds, 1, "unknown_cmds counter");
+
+    /* 失败命令 */
+    g_write_count = 0;
+    len = cmd_encode_vlq(content, TEST_CMD_FAIL);
+    flen = build_frame(frame, CMD_MESSAGE_DEST | 2, content, len);
+    command_process_frame(frame, flen);
+    p = g_writes[0] + CMD_MESSAGE_HEADER_SIZE;
+    cmd_decode_vlq(&p, g_writes[0] + g_write_len[0], &v);
+    TEST_ASSERT_EQ(v, CMD_RSP_ERROR, "failure response id");
+    cmd_decode_vlq(&p, g_writes[0] + g_write_len[0], &v);
+    TEST_ASSERT_EQ(v, TEST_CMD_FAIL, "failure names the command");
+    cmd_decode_vlq(&p, g_writes[0] + g_write_len[0], &v);
+    TEST_ASSERT((int32_t)v == -7, "failure carries the handler code");
+
+    return 1;
+}
+
+/**
+ * @brief   测试 command_task 从行槽取块，忙时保留行槽
+ */
+static int
+test_command_task(void)
+{
+    uint8_t content[4];
+    size_t len;
+
+    reset();
+
+    /* 文本行不处理 */
+    g_slot_kind = SERIAL_LINE_TEXT;
+    command_task();
+    TEST_ASSERT_EQ(g_releases, 0, "text line is left for gcode_process");
+
+    /* 忙的块保留行槽 */
+    len = cmd_encode_vlq(content, TEST_CMD_BUSY);
+    g_slot_len = build_frame(g_slot, CMD_MESSAGE_DEST, content, len);
+    g_slot_kind = SERIAL_LINE_FRAME;
+    g_busy_left = 1;
+    command_task();
+    TEST_ASSERT_EQ(g_releases, 0, "busy frame keeps its slot");
+
+    command_task();
+    TEST_ASSERT_EQ(g_releases, 1, "completed frame releases its slot");
+    TEST_ASSERT(is_ack(0, CMD_MESSAGE_DEST | 1), "completed frame is acked");
+
+    return 1;
+}
+
+/* ========== 主函数 ========== */
+
+int
+main(void)
+{
+    printf("========================================\n");
+    printf("  Command Protocol Unit Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_vlq_roundtrip);
+    RUN_TEST(test_crc16);
+    RUN_TEST(test_register_table);
+    RUN_TEST(test_frame_dispatch);
+    RUN_TEST(test_frame_errors);
+    RUN_TEST(test_sequence_wrap);
+    RUN_TEST(test_frame_busy_resume);
+    RUN_TEST(test_responses);
+    RUN_TEST(test_command_task);
+
+    /* 输出结果 */
+    printf("\n========================================\n");
+    printf("  Test Results\n");
+    printf("========================================\n");
+    printf("Total:  %d\n", g_tests_run);
+    printf("Passed: %d\n", g_tests_passed);
+    printf("Failed: %d\n", g_tests_failed);
+    printf("========================================\n");
+
+    return (g_tests_failed > 0) ? 1 : 0;
+}
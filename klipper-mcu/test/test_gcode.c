@@ -5,7 +5,7 @@
  * 测试 gcode.c 的解析功能
  * 使用主机编译器 (gcc) 编译运行
  * 
- * 编译: gcc -o test_gcode test_gcode.c ../app/gcode.c -I../app -I.. -DTEST_BUILD
+ * 编译: gcc -o test_gcode test_gcode.c ../app/gcode.c -I../app -I.. -I../src -DTEST_BUILD
  * 运行: ./test_gcode
  */
 
@@ -13,7 +13,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #include "gcode.h"
+#include "config.h"
+#include "toolhead.h"
+#include "sdcard.h"
+#include "command.h"
+#include "stm32/serial.h"
 
 /* ========== 测试框架 ========== */
 
@@ -53,6 +59,282 @@ static int g_tests_failed = 0;
     } \
 } while (0)
 
+/* ========== Toolhead 桩函数 ========== */
+
+/* 模拟运动队列是否有空间 (覆盖 gcode.c 中的弱符号) */
+static int g_toolhead_accept = 1;
+
+int
+toolhead_can_accept_move(void)
+{
+    return g_toolhead_accept;
+}
+
+/* 记录最近一次压力提前设置 (覆盖 gcode.c 中的弱符号) */
+static int g_pa_calls = 0;
+static float g_pa_value = -1.0f;
+static float g_pa_smooth = -1.0f;
+
+int
+toolhead_set_pressure_advance(float pressure_advance, float smooth_time)
+{
+    g_pa_calls++;
+    g_pa_value = pressure_advance;
+    g_pa_smooth = smooth_time;
+    return 0;
+}
+
+/* 模拟运动配置和速度倍率 (覆盖 gcode.c 中的弱符号) */
+static toolhead_config_t g_config = { 200.0f, 3000.0f, 1500.0f, 5.0f };
+static int g_set_config_calls = 0;
+static float g_speed_factor = 1.0f;
+
+int
+toolhead_get_config(toolhead_config_t *p_config)
+{
+    *p_config = g_config;
+    return 0;
+}
+
+int
+toolhead_set_config(const toolhead_config_t *p_config)
+{
+    g_set_config_calls++;
+    g_config = *p_config;
+    return 0;
+}
+
+int
+toolhead_set_speed_factor(float factor)
+{
+    if (factor < 0.01f || factor > 10.0f) {
+        return TOOLHEAD_ERR_PARAM;
+    }
+    g_speed_factor = factor;
+    return 0;
+}
+
+float
+toolhead_get_speed_factor(void)
+{
+    return g_speed_factor;
+}
+
+/* 记录最近一次运动目标 (覆盖 gcode.c 中的弱符号) */
+static int g_move_calls = 0;
+static struct coord g_move_pos;
+static float g_move_speed = 0.0f;
+
+int
+toolhead_move(const struct coord *p_end_pos, float speed)
+{
+    g_move_calls++;
+    g_move_pos = *p_end_pos;
+    g_move_speed = speed;
+    return 0;
+}
+
+/* 模拟运动是否全部完成与热端是否到温 (覆盖 gcode.c 中的弱符号) */
+static int g_moves_done = 1;
+static int g_at_target = 1;
+
+int
+toolhead_moves_done(void)
+{
+    return g_moves_done;
+}
+
+int
+heater_is_at_target(int id)
+{
+    (void)id;
+    return g_at_target;
+}
+
+/* 模拟 PID 自整定 (覆盖 gcode.c 中的弱符号) */
+static int g_tune_id = -1;
+static float g_tune_target = 0.0f;
+static int g_tune_cycles = 0;
+static int g_tune_state = 0;        /* 1 = 运行中，2 = 完成，3 = 失败 */
+static float g_pid_kp = 0.0f;
+static int g_set_pid_calls = 0;
+
+int
+heater_autotune_start(int id, float target, uint8_t cycles)
+{
+    g_tune_id = id;
+    g_tune_target = target;
+    g_tune_cycles = cycles;
+    g_tune_state = 1;
+    return 0;
+}
+
+int
+heater_autotune_status(float *p_kp, float *p_ki, float *p_kd)
+{
+    if (g_tune_state == 2) {
+        *p_kp = 0.2f;
+        *p_ki = 0.04f;
+        *p_kd = 0.25f;
+    }
+    return g_tune_state;
+}
+
+int
+heater_set_pid(int id, float kp, float ki, float kd)
+{
+    (void)id; (void)ki; (void)kd;
+    g_pid_kp = kp;
+    g_set_pid_calls++;
+    return 0;
+}
+
+/* 记录最近一次圆弧参数 (覆盖 gcode.c 中的弱符号) */
+static int g_arc_calls = 0;
+static struct coord g_arc_pos;
+static float g_arc_i = 0.0f;
+static float g_arc_j = 0.0f;
+static int g_arc_cw = -1;
+
+int
+toolhead_arc(const struct coord *p_end_pos, float offset_i, float offset_j,
+             int clockwise, float speed)
+{
+    (void)speed;
+    g_arc_calls++;
+    g_arc_pos = *p_end_pos;
+    g_arc_i = offset_i;
+    g_arc_j = offset_j;
+    g_arc_cw = clockwise;
+    return 0;
+}
+
+/* SD 卡文件表 (覆盖 gcode.c 中的弱符号)，默认没有卡 */
+static sdcard_entry_t g_sd_files[SDCARD_LIST_MAX];
+static int g_sd_count = SDCARD_ERR_NO_CARD;
+
+int
+sdcard_list(void)
+{
+    return g_sd_count;
+}
+
+const sdcard_entry_t *
+sdcard_list_entry(int idx)
+{
+    return (idx >= 0 && idx < g_sd_count) ? &g_sd_files[idx] : NULL;
+}
+
+/* ========== 命令层桩函数 ========== */
+
+/* 记录 gcode_init 注册的二进制命令 (覆盖 gcode.c 中的弱符号) */
+static cmd_desc_t g_cmds[8];
+static int g_cmd_count = 0;
+
+int
+command_register(const cmd_desc_t *desc)
+{
+    for (int i = 0; i < g_cmd_count; i++) {
+        if (g_cmds[i].id == desc->id) {
+            g_cmds[i] = *desc;
+            return 0;
+        }
+    }
+    if (g_cmd_count >= 8) {
+        return -2;
+    }
+    g_cmds[g_cmd_count++] = *desc;
+    return 0;
+}
+
+static const cmd_desc_t *
+find_cmd(cmd_id_t id)
+{
+    for (int i = 0; i < g_cmd_count; i++) {
+        if (g_cmds[i].id == id) {
+            return &g_cmds[i];
+        }
+    }
+    return NULL;
+}
+
+/* ========== 串口行来源桩函数 ========== */
+
+/* 按序号生成的串口行 (覆盖 gcode.c 中的弱符号)，每次只有一行待处理 */
+static const char *(*g_line_source)(int seq) = NULL;
+static int g_line_next = 0;         /* 下一行序号 */
+static int g_line_end = 0;          /* 行来源的总行数 */
+
+int
+serial_line_kind(void)
+{
+    return (g_line_next < g_line_end) ? SERIAL_LINE_TEXT : -1;
+}
+
+const char *
+serial_line_peek(size_t *len)
+{
+    if (g_line_next >= g_line_end) {
+        return NULL;
+    }
+    const char *line = g_line_source(g_line_next);
+    if (len != NULL) {
+        *len = strlen(line);
+    }
+    return line;
+}
+
+void
+serial_line_release(void)
+{
+    g_line_next++;
+}
+
+/* 从头发送 count 行 */
+static void
+feed_lines(const char *(*source)(int seq), int count)
+{
+    g_line_source = source;
+    g_line_next = 0;
+    g_line_end = count;
+}
+
+/* 取出全部响应，返回 "ok" 行数，错误行数累加到 *p_errors */
+static int
+drain_responses(int *p_errors)
+{
+    char buf[GCODE_RESPONSE_LINE_SIZE + 1];
+    int oks = 0;
+    int len;
+    
+    while ((len = gcode_respond_take(buf, sizeof(buf) - 1)) > 0) {
+        buf[len] = '\0';
+        for (const char *p = buf; (p = strstr(p, "ok\r\n")) != NULL; p += 4) {
+            oks++;
+        }
+        if ((p_errors != NULL) && (strncmp(buf, "error", 5) == 0)) {
+            (*p_errors)++;
+        }
+    }
+    return oks;
+}
+
+/* 直接执行 M991 (不经过队列)，读出缓冲区状态 */
+static void
+query_stream(unsigned int *p_mode, unsigned int *p_queued, unsigned int *p_free)
+{
+    char buf[GCODE_RESPONSE_LINE_SIZE + 1];
+    gcode_cmd_t cmd;
+    
+    drain_responses(NULL);
+    gcode_parse_line("M991", &cmd);
+    gcode_execute(&cmd);
+    int len = gcode_respond_take(buf, sizeof(buf) - 1);
+    buf[len] = '\0';
+    *p_mode = *p_queued = *p_free = 0;
+    sscanf(buf, "stream:%u queued:%u free:%u", p_mode, p_queued, p_free);
+}
+
 /* ========== 测试用例 ========== */
 
 /**
@@ -458,6 +740,112 @@ test_whitespace_handling(void)
     return 1;
 }
 
+/**
+ * @brief   测试定点小数解析
+ */
+static int
+test_number_parsing(void)
+{
+    gcode_cmd_t cmd;
+    int ret;
+    
+    ret = gcode_parse_line("G1 X123.456 Y-0.001 Z.5 E+2. F007", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "numbers should parse");
+    TEST_ASSERT(cmd.x == 123.456f, "X123.456 should be exact to float");
+    TEST_ASSERT(cmd.y == -0.001f, "Y-0.001 should be exact to float");
+    TEST_ASSERT(cmd.z == 0.5f, "leading dot");
+    TEST_ASSERT(cmd.e == 2.0f, "plus sign and trailing dot");
+    TEST_ASSERT(cmd.f == 7.0f, "leading zeros");
+    
+    /* 超过 9 位有效数字: 截断小数，整数位补回 */
+    ret = gcode_parse_line("G1 X1234567.891 Y12345678901", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "long numbers should parse");
+    TEST_ASSERT(fabsf(cmd.x - 1234567.891f) < 0.2f, "long fraction is truncated");
+    TEST_ASSERT(fabsf(cmd.y - 12345678901.0f) < 2000.0f, "long integer keeps magnitude");
+    
+    /* 无参数间空格、值前空格，注释中的参数不解析 */
+    ret = gcode_parse_line("g1x10.5 y 20;X99 E5", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "compact line should parse");
+    TEST_ASSERT_FLOAT_EQ(cmd.x, 10.5f, "X without spaces");
+    TEST_ASSERT_FLOAT_EQ(cmd.y, 20.0f, "space before value");
+    TEST_ASSERT(!cmd.has_e, "parameters in comment are ignored");
+    
+    /* 无数字的参数被跳过 */
+    ret = gcode_parse_line("G1 X- Y5", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "sign without digits should parse");
+    TEST_ASSERT(!cmd.has_x, "X without digits is skipped");
+    TEST_ASSERT_FLOAT_EQ(cmd.y, 5.0f, "Y after bad X");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试通用参数表
+ */
+static int
+test_extended_params(void)
+{
+    gcode_cmd_t cmd;
+    int ret;
+    
+    ret = gcode_parse_line("G1 X10 i2.5 J-3 R4 P500 T1 A7", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "extended parameters should parse");
+    TEST_ASSERT(gcode_has_param(&cmd, 'I'), "I should be present");
+    TEST_ASSERT_FLOAT_EQ(gcode_get_param(&cmd, 'I', 0.0f), 2.5f, "I value");
+    TEST_ASSERT_FLOAT_EQ(gcode_get_param(&cmd, 'J', 0.0f), -3.0f, "J value");
+    TEST_ASSERT_FLOAT_EQ(gcode_get_param(&cmd, 'R', 0.0f), 4.0f, "R value");
+    TEST_ASSERT_FLOAT_EQ(gcode_get_param(&cmd, 'P', 0.0f), 500.0f, "P value");
+    TEST_ASSERT_FLOAT_EQ(gcode_get_param(&cmd, 'T', 0.0f), 1.0f, "T value");
+    TEST_ASSERT_FLOAT_EQ(gcode_get_param(&cmd, 'A', 0.0f), 7.0f, "A value");
+    TEST_ASSERT(!gcode_has_param(&cmd, 'K'), "K should be absent");
+    TEST_ASSERT_FLOAT_EQ(gcode_get_param(&cmd, 'K', 9.0f), 9.0f, "absent K returns default");
+    TEST_ASSERT(!gcode_has_param(&cmd, '*'), "non-letter is never present");
+    
+    /* 命名字段与参数表一致 */
+    TEST_ASSERT(cmd.has_x, "X named flag");
+    TEST_ASSERT_FLOAT_EQ(cmd.x, 10.0f, "X named field");
+    TEST_ASSERT(cmd.param_mask & GCODE_PARAM_BIT('X'), "X in bitmap");
+    TEST_ASSERT_FLOAT_EQ(gcode_get_param(&cmd, 'X', 0.0f), 10.0f, "X in table");
+    
+    gcode_cmd_clear(&cmd);
+    gcode_set_param(&cmd, 's', 42.0f);
+    TEST_ASSERT(cmd.has_s, "set_param updates named flag");
+    TEST_ASSERT_FLOAT_EQ(cmd.s, 42.0f, "set_param updates named field");
+    TEST_ASSERT(gcode_has_param(&cmd, 'S'), "set_param updates bitmap");
+    TEST_ASSERT_EQ(cmd.param_mask, GCODE_PARAM_BIT('S'), "only S is set");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试字符串参数 (M23 文件名)
+ */
+static int
+test_string_param(void)
+{
+    gcode_cmd_t cmd;
+    int ret;
+    
+    ret = gcode_parse_line("M23 /test.gco", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M23 should parse");
+    TEST_ASSERT(strcmp(cmd.str, "test.gco") == 0, "leading '/' stripped");
+    TEST_ASSERT_EQ(cmd.param_mask, 0, "string is not scanned for letters");
+    
+    ret = gcode_parse_line("M23 PART.GCO ; comment", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M23 with comment should parse");
+    TEST_ASSERT(strcmp(cmd.str, "PART.GCO") == 0, "comment not part of name");
+    
+    ret = gcode_parse_line("M23 ABCDEFGHIJKLMNOPQRSTUVWXYZ", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "long name should parse");
+    TEST_ASSERT_EQ((int)strlen(cmd.str), GCODE_STR_SIZE - 1, "long name truncated");
+    
+    ret = gcode_parse_line("G1 X10", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "G1 should parse");
+    TEST_ASSERT_EQ(cmd.str[0], '\0', "other commands have no string");
+    
+    return 1;
+}
+
 /* ========== 命令执行测试 ========== */
 
 /**
@@ -504,6 +892,141 @@ test_execute_g0_g1(void)
     return 1;
 }
 
+/**
+ * @brief   测试运动队列满时运动命令被延后
+ */
+static int
+test_can_execute_backpressure(void)
+{
+    gcode_cmd_t move, temp;
+    
+    gcode_parse_line("G1 X10 F3000", &move);
+    gcode_parse_line("M104 S200", &temp);
+    
+    g_toolhead_accept = 1;
+    TEST_ASSERT_EQ(gcode_can_execute(&move), 1, "G1 should run when queue has room");
+    
+    g_toolhead_accept = 0;
+    TEST_ASSERT_EQ(gcode_can_execute(&move), 0, "G1 should wait when queue is full");
+    TEST_ASSERT_EQ(gcode_can_execute(&temp), 1, "non-move commands should not wait");
+    TEST_ASSERT_EQ(gcode_can_execute(NULL), 0, "NULL cmd should not execute");
+    
+    g_toolhead_accept = 1;
+    return 1;
+}
+
+/**
+ * @brief   测试 G2/G3 圆弧命令执行
+ * 
+ * I/J 直接传给 toolhead，R 形式换算为圆心偏移，缺少参数或半径
+ * 不足以连接两端点时报错。
+ */
+static int
+test_execute_g2_g3(void)
+{
+    gcode_cmd_t cmd;
+    struct coord start;
+    int ret;
+    
+    /* 相对坐标，结果与之前测试留下的位置无关 */
+    gcode_init();
+    gcode_parse_line("G91", &cmd);
+    gcode_execute(&cmd);
+    toolhead_get_position(&start);
+    g_arc_calls = 0;
+    
+    /* I/J 形式 */
+    gcode_parse_line("G2 X10 Y0 I5 J0 F1200", &cmd);
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "G2 with I/J should succeed");
+    TEST_ASSERT_EQ(g_arc_calls, 1, "G2 should queue one arc");
+    TEST_ASSERT_EQ(g_arc_cw, 1, "G2 should be clockwise");
+    TEST_ASSERT_FLOAT_EQ(g_arc_i, 5.0f, "I offset");
+    TEST_ASSERT_FLOAT_EQ(g_arc_j, 0.0f, "J offset");
+    float moved = (float)(g_arc_pos.x - start.x);
+    TEST_ASSERT_FLOAT_EQ(moved, 10.0f, "relative arc target X");
+    
+    /* R 形式: 相对 (10,10) 逆时针短弧，圆心偏移 (0,10) */
+    gcode_parse_line("G3 X10 Y10 R10", &cmd);
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "G3 with R should succeed");
+    TEST_ASSERT_EQ(g_arc_cw, 0, "G3 should be counter-clockwise");
+    TEST_ASSERT_FLOAT_EQ(g_arc_i, 0.0f, "R form centre I");
+    TEST_ASSERT_FLOAT_EQ(g_arc_j, 10.0f, "R form centre J");
+    
+    /* 负 R 取长弧，圆心在弦的另一侧 */
+    gcode_parse_line("G3 X10 Y10 R-10", &cmd);
+    gcode_execute(&cmd);
+    TEST_ASSERT_FLOAT_EQ(g_arc_i, 10.0f, "negative R centre I");
+    TEST_ASSERT_FLOAT_EQ(g_arc_j, 0.0f, "negative R centre J");
+    
+    /* 缺少圆心参数、半径过小 */
+    g_arc_calls = 0;
+    gcode_parse_line("G2 X10 Y10", &cmd);
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_ERR_PARAM, "arc without I/J/R should fail");
+    gcode_parse_line("G2 X10 Y10 R1", &cmd);
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_ERR_PARAM, "too small R should fail");
+    TEST_ASSERT_EQ(g_arc_calls, 0, "invalid arcs should not be queued");
+    
+    /* 圆弧与直线一样受队列背压 */
+    g_toolhead_accept = 0;
+    gcode_parse_line("G2 X10 Y0 I5", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 0, "G2 should wait for queue room");
+    g_toolhead_accept = 1;
+    
+    gcode_parse_line("G90", &cmd);
+    gcode_execute(&cmd);
+    
+    return 1;
+}
+
+/**
+ * @brief   测试二进制 gcode_move 命令按 G1 执行
+ */
+static int
+test_binary_gcode_move(void)
+{
+    cmd_args_t args;
+    int ret;
+    
+    gcode_init();
+    const cmd_desc_t *move = find_cmd(CMD_ID_GCODE_MOVE);
+    TEST_ASSERT(move != NULL, "gcode_init should register gcode_move");
+    TEST_ASSERT_EQ(move->num_args, 6, "gcode_move takes mask x y z e f");
+    TEST_ASSERT(find_cmd(CMD_ID_GCODE_HOME) != NULL,
+                "gcode_init should register gcode_home");
+    
+    /* X=12.5mm Y=-3mm F=6000，Z/E 未给出 */
+    memset(&args, 0, sizeof(args));
+    args.count = 6;
+    args.values[0] = (1 << 0) | (1 << 1) | (1 << 4);
+    args.values[1] = 12500;
+    args.values[2] = (uint32_t)-3000;
+    args.values[5] = 6000;
+    
+    g_toolhead_accept = 1;
+    g_move_calls = 0;
+    ret = move->handler(&args);
+    TEST_ASSERT_EQ(ret, 0, "gcode_move should succeed");
+    TEST_ASSERT_EQ(g_move_calls, 1, "gcode_move should queue one move");
+    float x = (float)g_move_pos.x;
+    float y = (float)g_move_pos.y;
+    TEST_ASSERT_FLOAT_EQ(x, 12.5f, "X from micrometres");
+    TEST_ASSERT_FLOAT_EQ(y, -3.0f, "negative Y");
+    TEST_ASSERT_FLOAT_EQ(g_move_speed, 100.0f, "F6000 should be 100 mm/s");
+    
+    /* 队列满时返回 CMD_BUSY 且不执行 */
+    g_toolhead_accept = 0;
+    ret = move->handler(&args);
+    TEST_ASSERT_EQ(ret, CMD_BUSY, "full queue should report busy");
+    TEST_ASSERT_EQ(g_move_calls, 1, "busy move should not be queued");
+    
+    g_toolhead_accept = 1;
+    return 1;
+}
+
 /**
  * @brief   测试 G28 归零命令执行
  * @note    验收标准: 4.1.3 - 支持 G28 (归零)
@@ -598,6 +1121,99 @@ test_execute_m104_m109(void)
     return 1;
 }
 
+/**
+ * @brief   测试等待类命令不阻塞执行
+ * 
+ * M109 执行后通过 gcode_wait_done() 轮询到温；G28/M400/M572 和同步
+ * 读卡的 M20/M21/M23 在运动完成前不可执行；普通命令不受影响。
+ */
+static int
+test_wait_commands(void)
+{
+    gcode_cmd_t cmd;
+    int ret;
+    
+    /* M109 只设置目标，到温前保持等待 */
+    g_at_target = 0;
+    gcode_parse_line("M109 S210", &cmd);
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M109 should start without blocking");
+    TEST_ASSERT_EQ(gcode_wait_done(&cmd), 0, "M109 should wait for temperature");
+    g_at_target = 1;
+    TEST_ASSERT_EQ(gcode_wait_done(&cmd), 1, "M109 should finish at target");
+    
+    gcode_parse_line("M104 S200", &cmd);
+    TEST_ASSERT_EQ(gcode_wait_done(&cmd), 1, "M104 should not wait");
+    
+    /* 同步命令在运动完成前延后 */
+    g_moves_done = 0;
+    gcode_parse_line("M400", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 0, "M400 should wait for moves");
+    gcode_parse_line("G28", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 0, "G28 should wait for moves");
+    gcode_parse_line("M572 S0.05", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 0, "M572 should wait for moves");
+    gcode_parse_line("M20", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 0, "M20 should wait for moves");
+    gcode_parse_line("M21", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 0, "M21 should wait for moves");
+    gcode_parse_line("M23 TEST.GCO", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 0, "M23 should wait for moves");
+    gcode_parse_line("M24", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 1, "M24 should not wait");
+    gcode_parse_line("M106 S128", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 1, "M106 should not wait");
+    
+    g_moves_done = 1;
+    gcode_parse_line("M400", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 1, "M400 should run when idle");
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M400 should execute");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试 M303 自整定命令
+ */
+static int
+test_m303_autotune(void)
+{
+    gcode_cmd_t cmd;
+    
+    /* E-1 为热床，U1 完成后应用结果 */
+    gcode_parse_line("M303 E-1 S65 C8 U1", &cmd);
+    TEST_ASSERT_EQ(gcode_execute(&cmd), GCODE_OK, "M303 should start");
+    TEST_ASSERT_EQ(g_tune_id, 1, "E-1 should select the bed");
+    TEST_ASSERT(fabsf(g_tune_target - 65.0f) < 0.01f, "S should be the target");
+    TEST_ASSERT_EQ(g_tune_cycles, 8, "C should be the cycle count");
+    TEST_ASSERT_EQ(gcode_wait_done(&cmd), 0, "M303 should wait while tuning");
+    
+    g_tune_state = 2;
+    g_set_pid_calls = 0;
+    TEST_ASSERT_EQ(gcode_wait_done(&cmd), 1, "M303 should finish");
+    TEST_ASSERT_EQ(g_set_pid_calls, 1, "U1 should apply the result");
+    TEST_ASSERT(fabsf(g_pid_kp - 0.2f) < 0.0001f, "Kp should be applied");
+    
+    /* 默认热端，未给 U 不应用 */
+    gcode_parse_line("M303", &cmd);
+    TEST_ASSERT_EQ(gcode_execute(&cmd), GCODE_OK, "M303 should start");
+    TEST_ASSERT_EQ(g_tune_id, 0, "default heater should be the hotend");
+    TEST_ASSERT_EQ(g_tune_cycles, 5, "default cycle count should be 5");
+    g_tune_state = 2;
+    g_set_pid_calls = 0;
+    TEST_ASSERT_EQ(gcode_wait_done(&cmd), 1, "M303 should finish");
+    TEST_ASSERT_EQ(g_set_pid_calls, 0, "result should not be applied without U1");
+    
+    /* 整定中止 */
+    gcode_parse_line("M303 S200", &cmd);
+    gcode_execute(&cmd);
+    g_tune_state = 3;
+    TEST_ASSERT(gcode_wait_done(&cmd) < 0, "aborted autotune should report error");
+    
+    return 1;
+}
+
 /**
  * @brief   测试 M106/M107 风扇命令执行
  * @note    验收标准: 4.1.6 - 支持 M106/M107 (风扇)
@@ -651,6 +1267,88 @@ test_execute_m114(void)
     return 1;
 }
 
+/**
+ * @brief   测试 M572 压力提前命令执行
+ */
+static int
+test_execute_m572(void)
+{
+    gcode_cmd_t cmd;
+    int ret;
+    
+    g_pa_calls = 0;
+    ret = gcode_parse_line("M572 S0.05", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M572 should parse successfully");
+    
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M572 should execute successfully");
+    TEST_ASSERT_EQ(g_pa_calls, 1, "M572 should set pressure advance");
+    TEST_ASSERT_FLOAT_EQ(g_pa_value, 0.05f, "M572 advance should be S");
+    TEST_ASSERT_FLOAT_EQ(g_pa_smooth, 0.04f, "M572 should use configured smooth time");
+    
+    /* 缺少 S 参数 */
+    ret = gcode_parse_line("M572", &cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M572 without S should parse");
+    
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_ERR_PARAM, "M572 without S should be rejected");
+    TEST_ASSERT_EQ(g_pa_calls, 1, "rejected M572 should not change pressure advance");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试 M204 加速度和 M220 速度倍率命令执行
+ * 
+ * 两者都不等待运动完成，分发表不带 GCODE_FLAG_SYNC。
+ */
+static int
+test_execute_m204_m220(void)
+{
+    gcode_cmd_t cmd;
+    int ret;
+    
+    g_config.max_accel = 3000.0f;
+    g_config.max_accel_to_decel = 1500.0f;
+    g_set_config_calls = 0;
+    g_moves_done = 0;
+    
+    gcode_parse_line("M204 S6000", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 1, "M204 should not wait for moves");
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M204 S should execute successfully");
+    TEST_ASSERT_FLOAT_EQ(g_config.max_accel, 6000.0f, "M204 S should set accel");
+    TEST_ASSERT_FLOAT_EQ(g_config.max_accel_to_decel, 3000.0f,
+                         "M204 should keep accel_to_decel ratio");
+    
+    /* P/T 取较小值 */
+    gcode_parse_line("M204 P2000 T4000", &cmd);
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M204 P T should execute successfully");
+    TEST_ASSERT_FLOAT_EQ(g_config.max_accel, 2000.0f, "M204 should use min of P/T");
+    
+    /* 缺少参数或非正加速度 */
+    gcode_parse_line("M204", &cmd);
+    TEST_ASSERT_EQ(gcode_execute(&cmd), GCODE_ERR_PARAM, "M204 without value should fail");
+    gcode_parse_line("M204 S0", &cmd);
+    TEST_ASSERT_EQ(gcode_execute(&cmd), GCODE_ERR_PARAM, "M204 S0 should fail");
+    TEST_ASSERT_EQ(g_set_config_calls, 2, "rejected M204 should not change config");
+    
+    gcode_parse_line("M220 S150", &cmd);
+    TEST_ASSERT_EQ(gcode_can_execute(&cmd), 1, "M220 should not wait for moves");
+    ret = gcode_execute(&cmd);
+    TEST_ASSERT_EQ(ret, GCODE_OK, "M220 should execute successfully");
+    TEST_ASSERT_FLOAT_EQ(g_speed_factor, 1.5f, "M220 S should set percent factor");
+    
+    gcode_parse_line("M220 S0", &cmd);
+    TEST_ASSERT_EQ(gcode_execute(&cmd), GCODE_ERR_PARAM, "M220 S0 should fail");
+    TEST_ASSERT_FLOAT_EQ(g_speed_factor, 1.5f, "rejected M220 should keep factor");
+    
+    g_speed_factor = 1.0f;
+    g_moves_done = 1;
+    return 1;
+}
+
 /**
  * @brief   测试未知命令执行
  */
@@ -690,16 +1388,507 @@ test_execute_unknown_command(void)
 static int
 test_gcode_respond(void)
 {
-    /* 测试正常响应 (在 TEST_BUILD 模式下不会实际输出) */
-    gcode_respond("ok");
-    gcode_respond("error: test");
+    char buf[GCODE_RESPONSE_LINE_SIZE];
     
-    /* 测试 NULL 指针 (不应崩溃) */
+    /* 清空之前测试留下的响应 */
+    while (gcode_respond_take(buf, sizeof(buf)) > 0) {
+    }
+    
+    /* 文本响应原样输出，按入队顺序取出 */
+    gcode_respond("error: test");
     gcode_respond(NULL);
+    TEST_ASSERT_EQ(gcode_respond_space(), GCODE_RESPONSE_QUEUE_SIZE - 1,
+                   "NULL message should not be queued");
+    int len = gcode_respond_take(buf, sizeof(buf));
+    TEST_ASSERT_EQ(len, 13, "text response length");
+    TEST_ASSERT(memcmp(buf, "error: test\r\n", 13) == 0, "text response");
+    TEST_ASSERT_EQ(gcode_respond_take(buf, sizeof(buf)), 0, "queue should be empty");
+    
+    /* 格式化延后到取出时，浮点按 float 保存 */
+    gcode_respond_fmt("X:%.2f Y:%.2f n=%u %s %03d %x", 1.5, -2.004, 42u,
+                      "abc", -7, 255u);
+    len = gcode_respond_take(buf, sizeof(buf));
+    buf[len] = '\0';
+    TEST_ASSERT(strcmp(buf, "X:1.50 Y:-2.00 n=42 abc -07 ff\r\n") == 0,
+                "formatted response");
+    
+    /* M114 的四个坐标 */
+    gcode_cmd_t cmd;
+    gcode_parse_line("M114", &cmd);
+    gcode_execute(&cmd);
+    len = gcode_respond_take(buf, sizeof(buf));
+    TEST_ASSERT(len > 0 && strncmp(buf, "X:", 2) == 0, "M114 response");
+    
+    /* 连续的 ok 合并为一条，一次渲染 */
+    gcode_respond_ok();
+    gcode_respond_ok();
+    gcode_respond_ok();
+    TEST_ASSERT_EQ(gcode_respond_space(), GCODE_RESPONSE_QUEUE_SIZE - 1,
+                   "consecutive ok should coalesce");
+    len = gcode_respond_take(buf, sizeof(buf));
+    TEST_ASSERT_EQ(len, 12, "coalesced ok length");
+    TEST_ASSERT(memcmp(buf, "ok\r\nok\r\nok\r\n", 12) == 0, "coalesced ok");
+    
+    /* 缓冲区放不下时剩余的 ok 留到下次 */
+    gcode_respond_ok();
+    gcode_respond_ok();
+    len = gcode_respond_take(buf, 6);
+    TEST_ASSERT_EQ(len, 4, "partial ok batch");
+    len = gcode_respond_take(buf, sizeof(buf));
+    TEST_ASSERT_EQ(len, 4, "remaining ok");
+    
+    /* 队列满时腾出最早的一条，不会越界 */
+    for (int i = 0; i < GCODE_RESPONSE_QUEUE_SIZE + 2; i++) {
+        gcode_respond("line");
+    }
+    TEST_ASSERT_EQ(gcode_respond_space(), 0, "queue should be full");
+    while (gcode_respond_take(buf, sizeof(buf)) > 0) {
+    }
+    TEST_ASSERT_EQ(gcode_respond_space(), GCODE_RESPONSE_QUEUE_SIZE,
+                   "queue should drain");
+    
+    return 1;
+}
+
+/* ========== 命令缓冲区测试 ========== */
+
+/* 参数齐全的最长行 (除 G/M/N 外的 23 个字母)，打包后是最大的记录 */
+static const char g_big_line[] =
+    "G1 A1.5 B2.5 C3.5 D4.5 E5.25 F1200 H7.5 I8.5 J9.5 K10.5 L11.5 O12.5 "
+    "P13.5 Q14 R15 S16 T17 U18 V19 W20 X21.25 Y22.5 Z23.75";
+
+/* 回绕测试作业: M991 S1，G1 X1 ~ X(n-2)，M991 S0 */
+#define WRAP_JOB_LINES      3000
+
+/* 参数个数轮换 (记录 16 ~ 28 字节)，每 7 行一条 23 个参数的长记录，
+ * 总量约为缓冲区的四倍，写指针多次经过末尾的回绕标记 */
+static const char *
+line_wrap_job(int seq)
+{
+    static char line[SERIAL_LINE_BUFFER_SIZE];
+    
+    if (seq == 0) {
+        return "M991 S1";
+    }
+    if (seq == WRAP_JOB_LINES - 1) {
+        return "M991 S0";
+    }
+    switch (seq % 7) {
+        case 0:
+            snprintf(line, sizeof(line), "G1 X%d Y2 Z3 E4 F600 A1 B2 C3 D4 H5 "
+                     "I6 J7 K8 L9 O10 P11 Q12 R13 S14 T15 U16 V17 W18", seq);
+            break;
+        case 1:
+        case 5:
+            snprintf(line, sizeof(line), "G1 X%d", seq);
+            break;
+        case 2:
+        case 6:
+            snprintf(line, sizeof(line), "G1 X%d Y2", seq);
+            break;
+        case 3:
+            snprintf(line, sizeof(line), "G1 X%d Y2 E4", seq);
+            break;
+        default:
+            snprintf(line, sizeof(line), "G1 X%d Y2 E4 F600", seq);
+            break;
+    }
+    return line;
+}
+
+/* 缓冲区满测试作业: M991 S1，G1 X1 ~ X(n-2) (每条 28 字节)，M991 S0 */
+#define FULL_JOB_LINES      1200
+
+static const char *
+line_full_job(int seq)
+{
+    static char line[SERIAL_LINE_BUFFER_SIZE];
+    
+    if (seq == 0) {
+        return "M991 S1";
+    }
+    if (seq == FULL_JOB_LINES - 1) {
+        return "M991 S0";
+    }
+    snprintf(line, sizeof(line), "G1 X%d Y1 E1 F600", seq);
+    return line;
+}
+
+/* 短行之间夹一条最长行 */
+static const char *
+line_big_job(int seq)
+{
+    static const char *const lines[] = { "G1 X1", g_big_line, "G1 X3" };
+    return lines[seq];
+}
+
+/* 逐条列出的行 */
+static const char *const *g_script = NULL;
+
+static const char *
+line_script(int seq)
+{
+    return g_script[seq];
+}
+
+static void
+feed_script(const char *const *lines, int count)
+{
+    g_script = lines;
+    feed_lines(line_script, count);
+}
+
+/* 调用 gcode_process() 直到 n 次运动全部执行，检查 X 依次为 1 ~ n */
+static int
+run_moves_in_order(int n, int *p_oks, int *p_errors)
+{
+    int executed = 0;
+    
+    for (int i = 0; (i < 4 * n + 16) && (executed < n); i++) {
+        int calls = g_move_calls;
+        gcode_process();
+        *p_oks += drain_responses(p_errors);
+        if (g_move_calls != calls) {
+            executed++;
+            if ((int)g_move_pos.x != executed) {
+                printf("    move %d executed as X%d\n", executed, (int)g_move_pos.x);
+                return 0;
+            }
+        }
+    }
+    return (executed == n);
+}
+
+/**
+ * @brief   测试流式模式下命令缓冲区回绕
+ */
+static int
+test_queue_stream_wrap(void)
+{
+    gcode_cmd_t cmd;
+    int oks = 0;
+    int errors = 0;
+    unsigned int mode, queued, free_bytes;
+    
+    gcode_parse_line("G90", &cmd);
+    gcode_execute(&cmd);
+    drain_responses(NULL);
+    g_toolhead_accept = 1;
+    g_move_calls = 0;
+    
+    /* 每次调用执行一条、补入若干条，缓冲区始终接近满 */
+    feed_lines(line_wrap_job, WRAP_JOB_LINES);
+    TEST_ASSERT(run_moves_in_order(WRAP_JOB_LINES - 2, &oks, &errors),
+                "moves should execute in order across wrap-around");
+    for (int i = 0; i < 4; i++) {
+        gcode_process();
+        oks += drain_responses(&errors);
+    }
+    TEST_ASSERT_EQ(g_line_next, WRAP_JOB_LINES, "all lines should be consumed");
+    TEST_ASSERT_EQ(oks, WRAP_JOB_LINES, "each line should be acked once");
+    TEST_ASSERT_EQ(errors, 0, "no errors expected");
+    
+    query_stream(&mode, &queued, &free_bytes);
+    TEST_ASSERT_EQ(mode, 0, "M991 S0 should leave stream mode");
+    TEST_ASSERT_EQ(queued, 0, "buffer should be empty");
+    TEST_ASSERT_EQ(free_bytes, GCODE_STREAM_BUFFER_SIZE, "wrap skips should be released");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试缓冲区满时的背压
+ */
+static int
+test_queue_stream_full(void)
+{
+    gcode_cmd_t cmd;
+    int oks = 0;
+    int errors = 0;
+    unsigned int mode, queued, free_bytes;
+    
+    gcode_parse_line("G90", &cmd);
+    gcode_execute(&cmd);
+    drain_responses(NULL);
+    g_move_calls = 0;
+    
+    /* 运动队列满，G1 X1 停在队首，后续命令只入缓冲区 */
+    g_toolhead_accept = 0;
+    feed_lines(line_full_job, FULL_JOB_LINES);
+    for (int i = 0; i < 10; i++) {
+        gcode_process();
+        oks += drain_responses(&errors);
+    }
+    
+    int consumed = g_line_next;
+    TEST_ASSERT(consumed < FULL_JOB_LINES, "full buffer should leave the line in its slot");
+    TEST_ASSERT(consumed > GCODE_STREAM_BUFFER_SIZE / 28, "buffer should fill up");
+    TEST_ASSERT_EQ(g_move_calls, 0, "blocked moves should not execute");
+    /* M991 S1 执行前按普通模式预读的命令完成后才应答 */
+    TEST_ASSERT_EQ(oks, consumed - (GCODE_QUEUE_SIZE - 1), "buffered lines should be acked");
+    
+    query_stream(&mode, &queued, &free_bytes);
+    TEST_ASSERT_EQ(mode, 1, "should be in stream mode");
+    TEST_ASSERT_EQ((int)queued, consumed - 2, "M991 S1 done, G1 X1 at head");
+    /* 再放不下一条 28 字节记录 (最多加上不足一条的末尾跳过) */
+    TEST_ASSERT(free_bytes < 2 * 28, "no room for another record");
+    
+    /* 不断开链路: 运动恢复后继续接收剩余行 */
+    g_toolhead_accept = 1;
+    oks = 0;
+    TEST_ASSERT(run_moves_in_order(FULL_JOB_LINES - 2, &oks, &errors),
+                "moves should execute in order after the buffer drains");
+    for (int i = 0; i < 4; i++) {
+        gcode_process();
+        oks += drain_responses(&errors);
+    }
+    TEST_ASSERT_EQ(g_line_next, FULL_JOB_LINES, "all lines should be consumed");
+    TEST_ASSERT_EQ(oks, FULL_JOB_LINES - consumed + (GCODE_QUEUE_SIZE - 1),
+                   "remaining lines should be acked once");
+    TEST_ASSERT_EQ(errors, 0, "no errors expected");
+    
+    query_stream(&mode, &queued, &free_bytes);
+    TEST_ASSERT_EQ(mode, 0, "M991 S0 should leave stream mode");
+    TEST_ASSERT_EQ(free_bytes, GCODE_STREAM_BUFFER_SIZE, "buffer should be empty");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试最长行经过缓冲区后参数不变
+ */
+static int
+test_queue_big_line(void)
+{
+    gcode_cmd_t cmd;
+    int oks = 0;
+    
+    TEST_ASSERT(strlen(g_big_line) < SERIAL_LINE_BUFFER_SIZE, "line should fit a serial slot");
+    
+    gcode_parse_line("G90", &cmd);
+    gcode_execute(&cmd);
+    drain_responses(NULL);
+    g_toolhead_accept = 1;
+    g_move_calls = 0;
+    
+    feed_lines(line_big_job, 3);
+    for (int i = 0; (i < 8) && (g_move_calls < 2); i++) {
+        gcode_process();
+        oks += drain_responses(NULL);
+    }
+    TEST_ASSERT_EQ(g_move_calls, 2, "big line should execute after the first move");
+    TEST_ASSERT_FLOAT_EQ((float)g_move_pos.x, 21.25f, "X");
+    TEST_ASSERT_FLOAT_EQ((float)g_move_pos.y, 22.5f, "Y");
+    TEST_ASSERT_FLOAT_EQ((float)g_move_pos.z, 23.75f, "Z");
+    TEST_ASSERT_FLOAT_EQ((float)g_move_pos.e, 5.25f, "E");
+    TEST_ASSERT_FLOAT_EQ(g_move_speed, 20.0f, "F1200 -> 20 mm/s");
+    
+    for (int i = 0; (i < 8) && (g_move_calls < 3); i++) {
+        gcode_process();
+        oks += drain_responses(NULL);
+    }
+    TEST_ASSERT_EQ(g_move_calls, 3, "following line should execute");
+    TEST_ASSERT_FLOAT_EQ((float)g_move_pos.x, 3.0f, "X after big line");
+    TEST_ASSERT_FLOAT_EQ((float)g_move_pos.z, 23.75f, "Z kept");
+    TEST_ASSERT_EQ(oks, 3, "each line acked on completion");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试进入和退出流式模式的应答时机
+ */
+static int
+test_queue_stream_mode(void)
+{
+    static const char *const enter[] = { "M991 S1" };
+    static const char *const job[] = { "G1 X1", "G999", "G1 X2", "M991 S0" };
+    static const char *const after[] = { "G1 X3" };
+    gcode_cmd_t cmd;
+    int oks = 0;
+    int errors = 0;
+    unsigned int mode, queued, free_bytes;
+    
+    gcode_parse_line("G90", &cmd);
+    gcode_execute(&cmd);
+    drain_responses(NULL);
+    g_move_calls = 0;
+    g_toolhead_accept = 0;
+    
+    feed_script(enter, 1);
+    gcode_process();
+    TEST_ASSERT_EQ(drain_responses(NULL), 1, "M991 S1 acked on completion");
+    
+    /* 流式模式: 入缓冲区即应答，解析错误立即报告 */
+    feed_script(job, 4);
+    for (int i = 0; i < 4; i++) {
+        gcode_process();
+        oks += drain_responses(&errors);
+    }
+    TEST_ASSERT_EQ(g_move_calls, 0, "moves still blocked");
+    TEST_ASSERT_EQ(oks, 3, "lines acked before execution");
+    TEST_ASSERT_EQ(errors, 1, "parse error reported at once");
+    
+    /* 执行时不再应答，M991 S0 之后恢复为完成后应答 */
+    g_toolhead_accept = 1;
+    oks = 0;
+    for (int i = 0; i < 4; i++) {
+        gcode_process();
+        oks += drain_responses(&errors);
+    }
+    TEST_ASSERT_EQ(g_move_calls, 2, "buffered moves executed");
+    TEST_ASSERT_EQ(oks, 0, "already acked lines not acked again");
+    query_stream(&mode, &queued, &free_bytes);
+    TEST_ASSERT_EQ(mode, 0, "M991 S0 should leave stream mode");
+    
+    g_toolhead_accept = 0;
+    feed_script(after, 1);
+    for (int i = 0; i < 4; i++) {
+        gcode_process();
+        oks += drain_responses(&errors);
+    }
+    TEST_ASSERT_EQ(oks, 0, "normal mode waits for completion");
+    
+    g_toolhead_accept = 1;
+    gcode_process();
+    oks += drain_responses(&errors);
+    TEST_ASSERT_EQ(g_move_calls, 3, "move executed");
+    TEST_ASSERT_EQ(oks, 1, "acked on completion");
+    TEST_ASSERT_EQ(errors, 1, "no further errors");
     
     return 1;
 }
 
+/**
+ * @brief   测试 M20 长列表按响应队列空位分批输出
+ * 
+ * 文件行比响应队列多，串口每轮只取走 3 行时各行仍须按序全部送达。
+ */
+static int
+test_m20_long_list(void)
+{
+    static const char *const list[] = { "M20" };
+    char buf[GCODE_RESPONSE_LINE_SIZE + 1];
+    char expect[GCODE_RESPONSE_LINE_SIZE];
+    int lines = 0;
+    
+    drain_responses(NULL);
+    g_sd_count = SDCARD_LIST_MAX;
+    for (int i = 0; i < SDCARD_LIST_MAX; i++) {
+        snprintf(g_sd_files[i].name, SDCARD_NAME_SIZE, "F%02d.GCO", i);
+        g_sd_files[i].size = 100u + (uint32_t)i;
+    }
+    
+    feed_script(list, 1);
+    for (int i = 0; (i < 200) && (lines < SDCARD_LIST_MAX + 3); i++) {
+        gcode_process();
+        for (int n = 0; n < 3; n++) {
+            int len = gcode_respond_take(buf, sizeof(buf) - 1);
+            if (len == 0) {
+                break;
+            }
+            buf[len] = '\0';
+            if (lines == 0) {
+                strcpy(expect, "Begin file list\r\n");
+            } else if (lines <= SDCARD_LIST_MAX) {
+                snprintf(expect, sizeof(expect), "F%02d.GCO %u\r\n",
+                         lines - 1, 100u + (unsigned int)(lines - 1));
+            } else if (lines == SDCARD_LIST_MAX + 1) {
+                strcpy(expect, "End file list\r\n");
+            } else {
+                strcpy(expect, "ok\r\n");
+            }
+            TEST_ASSERT(strcmp(buf, expect) == 0, "list lines in order");
+            lines++;
+        }
+    }
+    TEST_ASSERT_EQ(lines, SDCARD_LIST_MAX + 3, "every list line delivered");
+    TEST_ASSERT_EQ(drain_responses(NULL), 0, "nothing after ok");
+    
+    g_sd_count = SDCARD_ERR_NO_CARD;
+    return 1;
+}
+
+/* ========== 解析性能测试 ========== */
+
+/* 切片软件 (PrusaSlicer) 输出的典型片段，未指定文件时使用 */
+static const char *const g_bench_sample[] = {
+    ";LAYER_CHANGE",
+    ";Z:0.4",
+    "G1 Z.4 F9000",
+    "G1 E-.8 F2100",
+    "G1 X109.643 Y98.748 F10800",
+    "G1 E.8 F2100",
+    ";TYPE:External perimeter",
+    ";WIDTH:0.449999",
+    "G1 F1800",
+    "G1 X110.357 Y98.748 E.02823",
+    "G1 X111.161 Y98.859 E.03209",
+    "G1 X111.911 Y99.171 E.03209",
+    "G1 X112.556 Y99.665 E.03209",
+    "G1 X113.05 Y100.31 E.03209",
+    "G1 X113.362 Y101.06 E.03209",
+    "G1 X113.473 Y101.864 E.03209",
+    "G1 X113.473 Y108.136 E.24791",
+    "G1 X113.362 Y108.94 E.03209 ; perimeter",
+    "M106 S255",
+    "G1 X101.864 Y113.473 E.45334",
+    "M104 S215",
+    "G1 X98.748 Y110.357 E.17422",
+};
+
+/**
+ * @brief   测量 gcode_parse_line() 吞吐量
+ * 
+ * 设置环境变量 GCODE_BENCH_FILE 为切片文件路径时解析该文件，
+ * 否则循环解析内置片段。结果只作报告，不影响测试结论。
+ */
+static void
+benchmark_parse(void)
+{
+    static char lines[4096][96];
+    int count = 0;
+    const char *path = getenv("GCODE_BENCH_FILE");
+    
+    if (path != NULL) {
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+            printf("cannot open %s\n", path);
+            return;
+        }
+        while (count < 4096 && fgets(lines[count], sizeof(lines[0]), fp) != NULL) {
+            lines[count][strcspn(lines[count], "\r\n")] = '\0';
+            count++;
+        }
+        fclose(fp);
+    } else {
+        path = "built-in sample";
+        for (size_t i = 0; i < sizeof(g_bench_sample) / sizeof(g_bench_sample[0]); i++) {
+            strcpy(lines[count++], g_bench_sample[i]);
+        }
+    }
+    if (count == 0) {
+        return;
+    }
+    
+    /* 至少解析 200000 行 */
+    int passes = (200000 + count - 1) / count;
+    volatile int sink = 0;
+    gcode_cmd_t cmd;
+    clock_t start = clock();
+    for (int pass = 0; pass < passes; pass++) {
+        for (int i = 0; i < count; i++) {
+            sink += gcode_parse_line(lines[i], &cmd);
+        }
+    }
+    double elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+    double total = (double)passes * count;
+    
+    printf("parse %s: %.0f lines in %.3f s, %.0f lines/s\n", path, total,
+           elapsed, (elapsed > 0.0) ? total / elapsed : 0.0);
+    (void)sink;
+}
+
 /* ========== 主函数 ========== */
 
 int
@@ -729,19 +1918,37 @@ main(void)
     RUN_TEST(test_invalid_command);
     RUN_TEST(test_cmd_clear);
     RUN_TEST(test_whitespace_handling);
+    RUN_TEST(test_number_parsing);
+    RUN_TEST(test_extended_params);
+    RUN_TEST(test_string_param);
     
     /* 运行执行测试 */
     printf("\n--- Execution Tests ---\n");
     RUN_TEST(test_execute_null_pointer);
     RUN_TEST(test_execute_g0_g1);
+    RUN_TEST(test_can_execute_backpressure);
+    RUN_TEST(test_binary_gcode_move);
+    RUN_TEST(test_execute_g2_g3);
     RUN_TEST(test_execute_g28);
     RUN_TEST(test_execute_g90_g91);
     RUN_TEST(test_execute_m104_m109);
+    RUN_TEST(test_wait_commands);
+    RUN_TEST(test_m303_autotune);
     RUN_TEST(test_execute_m106_m107);
     RUN_TEST(test_execute_m114);
+    RUN_TEST(test_execute_m572);
+    RUN_TEST(test_execute_m204_m220);
     RUN_TEST(test_execute_unknown_command);
     RUN_TEST(test_gcode_respond);
     
+    /* 运行命令缓冲区测试 */
+    printf("\n--- Queue Tests ---\n");
+    RUN_TEST(test_queue_stream_wrap);
+    RUN_TEST(test_queue_stream_full);
+    RUN_TEST(test_queue_big_line);
+    RUN_TEST(test_queue_stream_mode);
+    RUN_TEST(test_m20_long_list);
+    
     /* 输出结果 */
     printf("\n========================================\n");
     printf("  Test Results\n");
@@ -751,5 +1958,8 @@ main(void)
     printf("Failed: %d\n", g_tests_failed);
     printf("========================================\n");
     
+    printf("\n--- Parse Benchmark ---\n");
+    benchmark_parse();
+    
     return (g_tests_failed > 0) ? 1 : 0;
 }
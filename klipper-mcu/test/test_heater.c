@@ -18,6 +18,7 @@
 #include <string.h>
 #include <math.h>
 #include "heater.h"
+#include "sched.h"
 
 /* ========== 测试框架 ========== */
 
@@ -250,11 +251,13 @@ void test_reset_all(void)
 
 /* ========== 调度器桩函数 ========== */
 
-typedef struct {
-    void* func;
-    uint32_t waketime;
-    void* next;
-} sched_timer_t;
+/* 最近一次排队的定时器 (heater.c 只用一个控制定时器) */
+static sched_timer_t *s_mock_timer = NULL;
+static int s_mock_timer_adds = 0;
+
+/* ADC 平均完成回调 */
+typedef void (*mock_scan_fn_t)(uint32_t time);
+static mock_scan_fn_t s_mock_scan_cb = NULL;
 
 uint32_t sched_get_time(void)
 {
@@ -263,7 +266,23 @@ uint32_t sched_get_time(void)
 
 void sched_add_timer(sched_timer_t* timer)
 {
-    (void)timer;
+    s_mock_timer = timer;
+    s_mock_timer_adds++;
+}
+
+uint32_t sched_irq_save(void)
+{
+    return 0;
+}
+
+void sched_irq_restore(uint32_t flag)
+{
+    (void)flag;
+}
+
+void adc_scan_set_callback(mock_scan_fn_t fn)
+{
+    s_mock_scan_cb = fn;
 }
 
 /* ========== 测试用例 ========== */
@@ -451,6 +470,36 @@ test_temperature_bounds(void)
     return 1;
 }
 
+/**
+ * @brief   测试稠密查表在整个 ADC 量程内单调且不越界
+ */
+static int
+test_ntc_lut_sweep(void)
+{
+    heater_init();
+    
+    float prev = HEATER_TEMP_MAX;
+    int monotonic = 1;
+    int in_range = 1;
+    
+    for (int32_t adc = 0; adc <= 4095; adc++) {
+        test_set_adc_value(0, adc);
+        float temp = heater_get_temp(HEATER_HOTEND);
+        if (temp > prev + 0.001f) {
+            monotonic = 0;
+        }
+        if (temp < HEATER_TEMP_MIN || temp > HEATER_TEMP_MAX) {
+            in_range = 0;
+        }
+        prev = temp;
+    }
+    
+    TEST_ASSERT(monotonic, "temperature should not rise with ADC value");
+    TEST_ASSERT(in_range, "temperature should stay within bounds");
+    
+    return 1;
+}
+
 /**
  * @brief   测试热床温度读取
  * @note    验收标准: 3.1.1 - 复用 Klipper src/adccmds.c
@@ -566,6 +615,36 @@ test_heater_task(void)
     return 1;
 }
 
+/**
+ * @brief   测试未设目标温度的加热器不参与控制循环
+ */
+static int
+test_idle_heater_skipped(void)
+{
+    test_reset_all();
+    heater_init();
+    
+    /* 只加热热床，热端保持关闭 */
+    heater_set_temp(HEATER_BED, 60.0f);
+    test_set_adc_value(0, 2804);  /* 约 30°C */
+    test_set_adc_value(1, 2804);
+    heater_task();
+    
+    TEST_ASSERT(heater_get_output(HEATER_BED) > 0.0f, "active bed should be driven");
+    TEST_ASSERT_FLOAT_EQ(heater_get_output(HEATER_HOTEND), 0.0f, 0.001f,
+                         "idle hotend should not be driven");
+    TEST_ASSERT_FLOAT_EQ(test_get_pwm_duty(0), 0.0f, 0.001f,
+                         "idle hotend PWM should stay off");
+    
+    /* 目标清零后热床退出控制循环，输出保持为 0 */
+    heater_set_temp(HEATER_BED, 0.0f);
+    heater_task();
+    TEST_ASSERT_FLOAT_EQ(test_get_pwm_duty(1), 0.0f, 0.001f,
+                         "bed PWM should be off after target cleared");
+    
+    return 1;
+}
+
 /**
  * @brief   测试多次初始化 (幂等性)
  */
@@ -835,6 +914,185 @@ test_heater_get_output(void)
     return 1;
 }
 
+/* ========== 控制循环与自整定测试 ========== */
+
+/* 热端模型: 一阶惯性 + 纯滞后，步长约等于控制周期 */
+#define PLANT_DT                0.1f
+#define PLANT_DELAY_STEPS       10          /* 1s 传热滞后 */
+#define PLANT_HEAT_RATE         4.0f        /* 满功率升温 °C/s */
+#define PLANT_LOSS_RATE         0.01f       /* 散热系数 1/s */
+#define PLANT_AMBIENT           25.0f
+
+/**
+ * @brief   求温度对应的 ADC 值 (二分查找，ADC 越大温度越低)
+ */
+static int32_t
+test_temp_to_adc(float temp)
+{
+    int32_t lo = 0;
+    int32_t hi = 4095;
+    
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        test_set_adc_value(0, mid);
+        if (heater_get_temp(HEATER_HOTEND) <= temp) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief   测试控制定时器由 ADC 完成驱动并有兜底超时
+ */
+static int
+test_control_timer(void)
+{
+    test_reset_all();
+    s_mock_timer = NULL;
+    s_mock_scan_cb = NULL;
+    heater_init();
+    
+    TEST_ASSERT(s_mock_timer != NULL && s_mock_timer->func != NULL,
+                "init should start the control timer");
+    TEST_ASSERT(s_mock_scan_cb != NULL, "init should hook ADC completion");
+    
+    heater_set_temp(HEATER_HOTEND, 200.0f);
+    test_set_adc_value(0, 2804);  /* 30°C */
+    
+    /* 攒够一个控制周期的 ADC 平均后才把定时器提前 */
+    int adds = s_mock_timer_adds;
+    uint32_t k;
+    for (k = 1; k <= 20; k++) {
+        s_mock_scan_cb(1000u * k);
+        if (s_mock_timer_adds != adds) {
+            break;
+        }
+    }
+    TEST_ASSERT(k > 1 && k <= 20, "control should run every few ADC averages");
+    TEST_ASSERT_EQ(s_mock_timer->waketime, 1000u * k,
+                   "control should be scheduled at ADC completion");
+    TEST_ASSERT_FLOAT_EQ(heater_get_output(HEATER_HOTEND), 0.0f, 0.001f,
+                         "PID should not run before the timer fires");
+    
+    uint32_t next = s_mock_timer->func(s_mock_timer->waketime);
+    TEST_ASSERT(heater_get_output(HEATER_HOTEND) > 0.9f,
+                "timer should run PID on fresh data");
+    TEST_ASSERT(next > 1000u * k, "timer should re-arm as watchdog");
+    
+    /* 没有新数据就到期: 关闭输出但保留目标 */
+    s_mock_timer->func(next);
+    TEST_ASSERT_FLOAT_EQ(heater_get_output(HEATER_HOTEND), 0.0f, 0.001f,
+                         "heater should turn off when ADC stops updating");
+    TEST_ASSERT_FLOAT_EQ(heater_get_target(HEATER_HOTEND), 200.0f, 0.01f,
+                         "target should be kept");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试继电器自整定在模拟热端上得到合理参数
+ */
+static int
+test_autotune_relay(void)
+{
+    float delay_line[PLANT_DELAY_STEPS] = {0};
+    int delay_pos = 0;
+    float temp = PLANT_AMBIENT;
+    float kp = 0.0f, ki = 0.0f, kd = 0.0f;
+    int state = HEATER_AUTOTUNE_IDLE;
+    
+    test_reset_all();
+    heater_init();
+    test_set_adc_value(0, test_temp_to_adc(temp));
+    
+    TEST_ASSERT_EQ(heater_autotune_start(HEATER_HOTEND, 200.0f, 5), 0,
+                   "autotune should start below target");
+    TEST_ASSERT_EQ(heater_autotune_start(HEATER_BED, 60.0f, 5), -1,
+                   "only one autotune may run");
+    
+    for (int step = 0; step < 20000; step++) {
+        heater_task();
+        state = heater_autotune_status(&kp, &ki, &kd);
+        if (state != HEATER_AUTOTUNE_RUNNING) {
+            break;
+        }
+        
+        float duty = delay_line[delay_pos];
+        delay_line[delay_pos] = test_get_pwm_duty(0);
+        delay_pos = (delay_pos + 1) % PLANT_DELAY_STEPS;
+        
+        temp += (duty * PLANT_HEAT_RATE
+                 - (temp - PLANT_AMBIENT) * PLANT_LOSS_RATE) * PLANT_DT;
+        TEST_ASSERT(temp < 215.0f, "relay should keep overshoot small");
+        test_set_adc_value(0, test_temp_to_adc(temp));
+    }
+    
+    TEST_ASSERT_EQ(state, HEATER_AUTOTUNE_DONE, "autotune should finish");
+    TEST_ASSERT(kp > 0.0f && ki > 0.0f && kd > 0.0f, "gains should be positive");
+    
+    /* Ziegler-Nichols: Kd / Kp = Tu / 8，模型振荡周期约 10s */
+    float tu = 8.0f * kd / kp;
+    TEST_ASSERT(tu > 5.0f && tu < 20.0f, "oscillation period should match plant");
+    TEST_ASSERT_FLOAT_EQ(kp / ki, tu / 2.0f, 0.01f, "Ti should be Tu / 2");
+    
+    TEST_ASSERT_FLOAT_EQ(heater_get_target(HEATER_HOTEND), 0.0f, 0.01f,
+                         "heater should turn off after autotune");
+    TEST_ASSERT_EQ(test_is_pwm_enabled(0), 0, "PWM should be disabled");
+    
+    printf("    Kp=%.3f Ki=%.4f Kd=%.3f (Tu=%.1fs)\n", kp, ki, kd, tu);
+    
+    /* 应用结果 */
+    pid_params_t pid;
+    TEST_ASSERT_EQ(heater_set_pid(HEATER_HOTEND, kp, ki, kd), 0, "set PID");
+    TEST_ASSERT_EQ(heater_get_pid(HEATER_HOTEND, &pid), 0, "get PID");
+    TEST_ASSERT_FLOAT_EQ(pid.kp, kp, 0.0001f, "Kp should be applied");
+    TEST_ASSERT_EQ(heater_set_pid(HEATER_COUNT, kp, ki, kd), -1,
+                   "invalid ID should be rejected");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试自整定的中止条件
+ */
+static int
+test_autotune_abort(void)
+{
+    test_reset_all();
+    heater_init();
+    
+    /* 过冲超过限值 */
+    test_set_adc_value(0, 1670);  /* 100°C */
+    TEST_ASSERT_EQ(heater_autotune_start(HEATER_HOTEND, 150.0f, 5), 0,
+                   "autotune should start");
+    heater_task();
+    TEST_ASSERT(test_get_pwm_duty(0) > 0.9f, "relay should heat at full power");
+    test_set_adc_value(0, 696);   /* 160°C */
+    heater_task();
+    test_set_adc_value(0, 475);   /* 180°C */
+    heater_task();
+    TEST_ASSERT_EQ(heater_autotune_status(NULL, NULL, NULL),
+                   HEATER_AUTOTUNE_FAILED, "overshoot should abort");
+    TEST_ASSERT_EQ(test_is_pwm_enabled(0), 0, "heater should turn off on abort");
+    
+    /* 已在目标以上不能开始 */
+    TEST_ASSERT_EQ(heater_autotune_start(HEATER_HOTEND, 150.0f, 5), -1,
+                   "autotune must start below target");
+    
+    /* M104 打断整定 */
+    test_set_adc_value(0, 1670);
+    TEST_ASSERT_EQ(heater_autotune_start(HEATER_HOTEND, 150.0f, 5), 0,
+                   "autotune should restart");
+    heater_set_temp(HEATER_HOTEND, 0.0f);
+    TEST_ASSERT_EQ(heater_autotune_status(NULL, NULL, NULL),
+                   HEATER_AUTOTUNE_IDLE, "set_temp should cancel autotune");
+    
+    return 1;
+}
+
 /* ========== 主函数 ========== */
 
 int
@@ -859,12 +1117,14 @@ main(void)
     RUN_TEST(test_ntc_low_temperature);
     RUN_TEST(test_ntc_interpolation);
     RUN_TEST(test_temperature_bounds);
+    RUN_TEST(test_ntc_lut_sweep);
     
     printf("\n--- Heater Functionality Tests ---\n");
     RUN_TEST(test_bed_temperature);
     RUN_TEST(test_target_temperature);
     RUN_TEST(test_is_at_target);
     RUN_TEST(test_heater_task);
+    RUN_TEST(test_idle_heater_skipped);
     
     printf("\n--- PID Control Tests (验收标准 3.2.1-3.2.3) ---\n");
     RUN_TEST(test_pid_output_range);
@@ -878,6 +1138,11 @@ main(void)
     printf("\n--- PWM Control Tests (验收标准 3.3.1, 3.3.2) ---\n");
     RUN_TEST(test_pwm_enable_disable);
     
+    printf("\n--- Control Loop & Autotune Tests ---\n");
+    RUN_TEST(test_control_timer);
+    RUN_TEST(test_autotune_relay);
+    RUN_TEST(test_autotune_abort);
+    
     /* 输出结果 */
     printf("\n========================================\n");
     printf("  Test Results\n");
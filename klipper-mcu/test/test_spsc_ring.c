@@ -0,0 +1,268 @@
+/**
+ * @file    test_spsc_ring.c
+ * @brief   单生产者/单消费者环形索引单元测试
+ *
+ * 测试 chelper/spsc_ring.h 的空、满、批量读写，以及 32 位自由计数
+ * 索引回绕后填充量和槽位计算不变。
+ * 使用主机编译器 (gcc) 编译运行
+ *
+ * 编译: gcc -o test_spsc_ring test_spsc_ring.c -I..
+ * 运行: ./test_spsc_ring
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "chelper/spsc_ring.h"
+
+/* ========== 测试框架 ========== */
+
+static int g_tests_run = 0;
+static int g_tests_passed = 0;
+static int g_tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        return 0; \
+    } \
+} while (0)
+
+#define TEST_ASSERT_EQ(a, b, msg) do { \
+    if ((a) != (b)) { \
+        printf("  FAIL: %s - expected %d, got %d (line %d)\n", msg, (int)(b), (int)(a), __LINE__); \
+        return 0; \
+    } \
+} while (0)
+
+#define RUN_TEST(test_func) do { \
+    g_tests_run++; \
+    printf("Running %s...\n", #test_func); \
+    if (test_func()) { \
+        g_tests_passed++; \
+        printf("  PASS\n"); \
+    } else { \
+        g_tests_failed++; \
+    } \
+} while (0)
+
+/* ========== 测试环 ========== */
+
+#define RING_SIZE       8
+
+typedef struct {
+    spsc_ring_t ring;
+    uint32_t buf[RING_SIZE];
+} test_ring_t;
+
+/* 生产者: 有空槽时写入一个值 */
+static int
+ring_put(test_ring_t *q, uint32_t value)
+{
+    if (spsc_ring_free(&q->ring, RING_SIZE) == 0) {
+        return 0;
+    }
+    q->buf[spsc_ring_head(&q->ring, RING_SIZE)] = value;
+    spsc_ring_push(&q->ring, 1);
+    return 1;
+}
+
+/* 消费者: 有数据时读出一个值 */
+static int
+ring_get(test_ring_t *q, uint32_t *p_value)
+{
+    if (spsc_ring_avail(&q->ring) == 0) {
+        return 0;
+    }
+    *p_value = q->buf[spsc_ring_tail(&q->ring, RING_SIZE)];
+    spsc_ring_pop(&q->ring, 1);
+    return 1;
+}
+
+/* ========== 测试用例 ========== */
+
+/**
+ * @brief   测试环大小检查
+ */
+static int
+test_size_ok(void)
+{
+    TEST_ASSERT(SPSC_RING_SIZE_OK(1), "1 is a power of two");
+    TEST_ASSERT(SPSC_RING_SIZE_OK(RING_SIZE), "8 is a power of two");
+    TEST_ASSERT(SPSC_RING_SIZE_OK(1024), "1024 is a power of two");
+    TEST_ASSERT(!SPSC_RING_SIZE_OK(0), "0 is not a ring size");
+    TEST_ASSERT(!SPSC_RING_SIZE_OK(6), "6 is not a power of two");
+
+    return 1;
+}
+
+/**
+ * @brief   测试空环
+ */
+static int
+test_empty(void)
+{
+    test_ring_t q;
+    uint32_t value = 0;
+
+    spsc_ring_init(&q.ring);
+    TEST_ASSERT_EQ(spsc_ring_avail(&q.ring), 0, "empty ring has nothing to read");
+    TEST_ASSERT_EQ(spsc_ring_count(&q.ring), 0, "empty ring count");
+    TEST_ASSERT_EQ(spsc_ring_free(&q.ring, RING_SIZE), RING_SIZE, "empty ring is all free");
+    TEST_ASSERT(!ring_get(&q, &value), "read from empty ring should fail");
+
+    /* 读空后回到空状态 */
+    TEST_ASSERT(ring_put(&q, 42), "put");
+    TEST_ASSERT(ring_get(&q, &value), "get");
+    TEST_ASSERT_EQ(value, 42, "value");
+    TEST_ASSERT_EQ(spsc_ring_avail(&q.ring), 0, "drained ring is empty");
+    TEST_ASSERT(!ring_get(&q, &value), "read after drain should fail");
+
+    return 1;
+}
+
+/**
+ * @brief   测试满环
+ */
+static int
+test_full(void)
+{
+    test_ring_t q;
+    uint32_t value;
+
+    spsc_ring_init(&q.ring);
+    for (uint32_t i = 0; i < RING_SIZE; i++) {
+        TEST_ASSERT(ring_put(&q, 100 + i), "put until full");
+    }
+    TEST_ASSERT_EQ(spsc_ring_free(&q.ring, RING_SIZE), 0, "full ring has no free slot");
+    TEST_ASSERT_EQ(spsc_ring_avail(&q.ring), RING_SIZE, "full ring avail");
+    TEST_ASSERT(!ring_put(&q, 999), "put into full ring should fail");
+
+    /* 满时 head 与 tail 指向同一槽位，但计数区分满和空 */
+    TEST_ASSERT_EQ(spsc_ring_head(&q.ring, RING_SIZE), spsc_ring_tail(&q.ring, RING_SIZE),
+                   "full ring head slot == tail slot");
+
+    /* 读出一个后只空出一个槽位 */
+    TEST_ASSERT(ring_get(&q, &value), "get");
+    TEST_ASSERT_EQ(value, 100, "oldest value first");
+    TEST_ASSERT_EQ(spsc_ring_free(&q.ring, RING_SIZE), 1, "one slot freed");
+    TEST_ASSERT(ring_put(&q, 100 + RING_SIZE), "put into freed slot");
+    TEST_ASSERT(!ring_put(&q, 999), "full again");
+
+    for (uint32_t i = 1; i <= RING_SIZE; i++) {
+        TEST_ASSERT(ring_get(&q, &value), "get");
+        TEST_ASSERT_EQ(value, 100 + i, "FIFO order");
+    }
+    TEST_ASSERT_EQ(spsc_ring_avail(&q.ring), 0, "drained");
+
+    return 1;
+}
+
+/**
+ * @brief   测试批量读写跨越数组末尾
+ */
+static int
+test_batch(void)
+{
+    test_ring_t q;
+
+    spsc_ring_init(&q.ring);
+
+    /* 先推进到槽位 5，批量写 6 个会跨过数组末尾 */
+    spsc_ring_push(&q.ring, 5);
+    spsc_ring_pop(&q.ring, 5);
+    TEST_ASSERT_EQ(spsc_ring_head(&q.ring, RING_SIZE), 5, "head slot");
+
+    for (uint32_t i = 0; i < 6; i++) {
+        q.buf[(spsc_ring_head(&q.ring, RING_SIZE) + i) & (RING_SIZE - 1)] = i;
+    }
+    spsc_ring_push(&q.ring, 6);
+    TEST_ASSERT_EQ(spsc_ring_avail(&q.ring), 6, "batch published");
+    TEST_ASSERT_EQ(spsc_ring_free(&q.ring, RING_SIZE), 2, "free after batch");
+    TEST_ASSERT_EQ(spsc_ring_head(&q.ring, RING_SIZE), 3, "head slot wrapped");
+
+    for (uint32_t i = 0; i < 6; i++) {
+        uint32_t slot = (spsc_ring_tail(&q.ring, RING_SIZE) + i) & (RING_SIZE - 1);
+        TEST_ASSERT_EQ(q.buf[slot], i, "batch order");
+    }
+    spsc_ring_pop(&q.ring, 6);
+    TEST_ASSERT_EQ(spsc_ring_avail(&q.ring), 0, "batch consumed");
+
+    return 1;
+}
+
+/**
+ * @brief   测试 32 位索引回绕
+ */
+static int
+test_index_wraparound(void)
+{
+    test_ring_t q;
+    uint32_t next_put = 0;
+    uint32_t next_get = 0;
+    uint32_t value;
+
+    /* 索引从回绕点前开始，生产和消费交错跑过 0xFFFFFFFF */
+    q.ring.head = 0xFFFFFFF0u;
+    q.ring.tail = 0xFFFFFFF0u;
+
+    for (int round = 0; round < 20; round++) {
+        int puts = (round % 3) + 1 + (round % RING_SIZE);
+        int gets = (round % 4) + 1;
+
+        for (int i = 0; i < puts; i++) {
+            if (!ring_put(&q, next_put)) {
+                break;
+            }
+            next_put++;
+        }
+        TEST_ASSERT_EQ(spsc_ring_count(&q.ring), next_put - next_get, "count across wrap");
+        TEST_ASSERT(spsc_ring_count(&q.ring) <= RING_SIZE, "never over-filled");
+        TEST_ASSERT_EQ(spsc_ring_free(&q.ring, RING_SIZE),
+                       RING_SIZE - (next_put - next_get), "free across wrap");
+
+        for (int i = 0; i < gets; i++) {
+            if (!ring_get(&q, &value)) {
+                break;
+            }
+            TEST_ASSERT_EQ(value, next_get, "FIFO order across wrap");
+            next_get++;
+        }
+    }
+    TEST_ASSERT(q.ring.head < 0xFFFFFFF0u, "head index wrapped past zero");
+
+    while (ring_get(&q, &value)) {
+        TEST_ASSERT_EQ(value, next_get, "drain order");
+        next_get++;
+    }
+    TEST_ASSERT_EQ(next_get, next_put, "every value read once");
+    TEST_ASSERT_EQ(spsc_ring_avail(&q.ring), 0, "empty after drain");
+
+    return 1;
+}
+
+/* ========== 主函数 ========== */
+
+int
+main(void)
+{
+    printf("========================================\n");
+    printf("  SPSC Ring Unit Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_size_ok);
+    RUN_TEST(test_empty);
+    RUN_TEST(test_full);
+    RUN_TEST(test_batch);
+    RUN_TEST(test_index_wraparound);
+
+    /* 输出结果 */
+    printf("\n========================================\n");
+    printf("  Test Results\n");
+    printf("========================================\n");
+    printf("Total:  %d\n", g_tests_run);
+    printf("Passed: %d\n", g_tests_passed);
+    printf("Failed: %d\n", g_tests_failed);
+    printf("========================================\n");
+
+    return (g_tests_failed > 0) ? 1 : 0;
+}
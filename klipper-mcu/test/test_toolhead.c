@@ -22,6 +22,21 @@
 #include <math.h>
 #include "toolhead.h"
 #include "chelper/trapq.h"
+#include "chelper/stepcompress.h"
+#include "chelper/itersolve.h"
+#include "chelper/kin_cartesian.h"
+#include "chelper/kin_shaper.h"
+#include "chelper/kin_corexy.h"
+#include "chelper/kin_delta.h"
+
+/* 步进时间容差: 单精度运动计算时放宽 */
+#if CONFIG_MOTION_FLOAT
+#define STEP_TIME_TOLERANCE     5e-6
+#define STEP_COUNT_TOLERANCE    1
+#else
+#define STEP_TIME_TOLERANCE     1e-7
+#define STEP_COUNT_TOLERANCE    0
+#endif
 
 /* ========== 测试框架 ========== */
 
@@ -463,6 +478,53 @@ test_home_all_axes(void)
     return 1;
 }
 
+/**
+ * @brief   测试非阻塞归零: 由 toolhead_task() 推进状态机
+ * @note    归零期间不接受新运动，也不能重复启动
+ */
+static int
+test_home_async(void)
+{
+    struct coord pos;
+    int ret;
+    int loops;
+    
+    pos.x = 100.0;
+    pos.y = 100.0;
+    pos.z = 50.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    
+    ret = toolhead_home_start(AXIS_X_MASK | AXIS_Y_MASK);
+    TEST_ASSERT_EQ(ret, TOOLHEAD_OK, "home start should return OK");
+    
+    ret = toolhead_home_status();
+    TEST_ASSERT_EQ(ret, TOOLHEAD_ERR_BUSY, "homing should be in progress");
+    ret = toolhead_can_accept_move();
+    TEST_ASSERT_EQ(ret, 0, "no moves accepted while homing");
+    ret = toolhead_home_start(AXIS_Z_MASK);
+    TEST_ASSERT_EQ(ret, TOOLHEAD_ERR_BUSY, "second home start should be BUSY");
+    
+    for (loops = 0; loops < 1000; loops++) {
+        if (toolhead_home_status() != TOOLHEAD_ERR_BUSY) {
+            break;
+        }
+        toolhead_task();
+    }
+    ret = toolhead_home_status();
+    TEST_ASSERT_EQ(ret, TOOLHEAD_OK, "homing should finish via toolhead_task");
+    
+    toolhead_get_position(&pos);
+    TEST_ASSERT_DOUBLE_EQ(pos.x, 5.0, "X should be 5.0 after home");
+    TEST_ASSERT_DOUBLE_EQ(pos.y, 5.0, "Y should be 5.0 after home");
+    TEST_ASSERT_DOUBLE_EQ(pos.z, 50.0, "Z should be unchanged");
+    
+    ret = toolhead_can_accept_move();
+    TEST_ASSERT_EQ(ret, 1, "moves accepted after homing");
+    
+    return 1;
+}
+
 /**
  * @brief   测试 toolhead_move 空指针处理
  */
@@ -680,6 +742,1364 @@ test_move_complete_callback(void)
     return 1;
 }
 
+/* 步进队列桩辅助函数 (stubs.c) */
+extern int32_t test_get_queued_steps(int id);
+extern uint32_t test_get_queued_moves(int id);
+extern void test_reset_queued_steps(void);
+
+/* 调度器桩辅助函数 (stubs.c) */
+extern void test_advance_time(uint32_t ticks);
+
+/**
+ * @brief   推进一个定时刷新周期并运行 toolhead_task
+ */
+static void
+run_flush_period(void)
+{
+    test_advance_time((uint32_t)(MOVE_FLUSH_PERIOD * CONFIG_STEP_TIMER_FREQ));
+    toolhead_task();
+}
+
+/**
+ * @brief   测试运动生成的步进送入步进驱动队列
+ */
+static int
+test_move_queues_steps(void)
+{
+    struct coord pos;
+    
+    /* 初始化 */
+    toolhead_init();
+    
+    pos.x = 10.0;
+    pos.y = 10.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    test_reset_queued_steps();
+    
+    /* X 正向 2mm，Y 反向 1mm */
+    pos.x = 12.0;
+    pos.y = 9.0;
+    toolhead_move(&pos, 50.0f);
+    toolhead_wait_moves();
+    
+    TEST_ASSERT_EQ(test_get_queued_steps(0), 160, "X should queue 2mm * 80 steps");
+    TEST_ASSERT_EQ(test_get_queued_steps(1), -80, "Y should queue -1mm * 80 steps");
+    TEST_ASSERT_EQ(test_get_queued_moves(2), 0, "Z should queue no steps");
+    TEST_ASSERT(test_get_queued_moves(0) < 160 / 4, "X steps should be compressed");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试运动段数超过 trapq 内存池时不丢失运动
+ */
+static int
+test_move_pool_reclaim(void)
+{
+    struct coord pos;
+    trapq_pool_stats_t stats;
+    int moves = TRAPQ_MAX_MOVES * 2;
+    
+    /* 初始化 */
+    toolhead_init();
+    
+    pos.x = 10.0;
+    pos.y = 10.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    test_reset_queued_steps();
+    
+    /* 连续短运动，中途不等待 */
+    for (int i = 0; i < moves; i++) {
+        pos.x += 1.0;
+        TEST_ASSERT_EQ(toolhead_move(&pos, 50.0f), TOOLHEAD_OK,
+                       "move should be accepted");
+    }
+    toolhead_wait_moves();
+    
+    TEST_ASSERT_EQ(test_get_queued_steps(0), moves * 80,
+                   "every move should reach the X stepper");
+    
+    trapq_pool_get_stats(&stats);
+    TEST_ASSERT(stats.total_allocs >= (uint32_t)moves,
+                "each move should allocate a pool entry");
+    TEST_ASSERT(stats.moves_peak <= TRAPQ_MAX_MOVES,
+                "peak usage should stay within the pool");
+    TEST_ASSERT_EQ(stats.moves_used, TRAPQ_MAX_MOVES - trapq_pool_available(),
+                   "available count should match usage");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试队列深度上报
+ */
+static int
+test_queue_depth(void)
+{
+    struct coord pos;
+    toolhead_queue_depth_t depth;
+    
+    /* 初始化并排空前面测试留下的运动 */
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    TEST_ASSERT_EQ(toolhead_get_queue_depth(NULL), TOOLHEAD_ERR_NULL,
+                   "NULL depth should return TOOLHEAD_ERR_NULL");
+    TEST_ASSERT_EQ(toolhead_get_queue_depth(&depth), TOOLHEAD_OK,
+                   "queue depth should be available");
+    TEST_ASSERT_EQ(depth.lookahead_used, 0, "lookahead should start empty");
+    TEST_ASSERT(depth.trapq_used <= 1, "finished moves should be reclaimed");
+    TEST_ASSERT_EQ(depth.trapq_size, TRAPQ_MAX_MOVES, "trapq size should match");
+    TEST_ASSERT(depth.move_space > depth.trapq_size,
+                "empty queues should accept more than one trapq worth");
+    TEST_ASSERT_EQ(toolhead_can_accept_move(), 1, "empty queue should accept");
+    
+    pos.x = 10.0;
+    pos.y = 10.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    for (int i = 0; i < 3; i++) {
+        pos.x += 1.0;
+        toolhead_move(&pos, 50.0f);
+    }
+    
+    uint16_t space = depth.move_space;
+    toolhead_get_queue_depth(&depth);
+    TEST_ASSERT_EQ(depth.lookahead_used, 3, "moves should wait in lookahead");
+    TEST_ASSERT_EQ(depth.move_space, space - 3, "space should shrink per move");
+    TEST_ASSERT_EQ(toolhead_can_accept_move(), 1, "queue should still accept");
+    
+    toolhead_wait_moves();
+    run_flush_period();
+    toolhead_get_queue_depth(&depth);
+    TEST_ASSERT_EQ(depth.lookahead_used, 0, "lookahead should drain");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试定时刷新: 空闲后的单条运动不等待后续命令即开始执行
+ */
+static int
+test_flush_timer(void)
+{
+    struct coord pos;
+    toolhead_queue_depth_t depth;
+    
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    /* 时钟越过已规划的全部运动，工具头进入空闲 */
+    test_advance_time((uint32_t)((toolhead_get_print_time() + 1.0) *
+                                 CONFIG_STEP_TIMER_FREQ));
+    toolhead_get_position(&pos);
+    test_reset_queued_steps();
+    
+    pos.x += 1.0;
+    TEST_ASSERT_EQ(toolhead_move(&pos, 50.0f), TOOLHEAD_OK, "move should be accepted");
+    toolhead_get_queue_depth(&depth);
+    TEST_ASSERT_EQ(depth.lookahead_used, 1, "lone move should wait in lookahead");
+    
+    /* 调度提前量 (0.1s) 内必须提交并生成步进 */
+    int periods = 0;
+    while (depth.lookahead_used > 0 && periods < 10) {
+        run_flush_period();
+        toolhead_get_queue_depth(&depth);
+        periods++;
+    }
+    TEST_ASSERT_EQ(depth.lookahead_used, 0, "flush timer should commit the move");
+    TEST_ASSERT(periods * MOVE_FLUSH_PERIOD <= 0.1 + 1e-9,
+                "move should start within the lead time");
+    TEST_ASSERT_EQ(test_get_queued_steps(0), 80, "X steps should reach the driver");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试短线段圆弧的前瞻规划
+ * 
+ * 多边形逼近的圆在每个结点都不应停下，且相邻运动段的速度连续。
+ */
+static int
+test_lookahead_polygon(void)
+{
+    struct coord pos;
+    int segments = 24;
+    double radius = 20.0;
+    
+    /* 初始化并回收之前的运动 */
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    pos.x = 100.0 + radius;
+    pos.y = 100.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    double t0 = toolhead_get_print_time();
+    
+    for (int i = 1; i <= segments; i++) {
+        double a = 2.0 * 3.14159265358979 * i / segments;
+        pos.x = 100.0 + radius * cos(a);
+        pos.y = 100.0 + radius * sin(a);
+        TEST_ASSERT_EQ(toolhead_move(&pos, 100.0f), TOOLHEAD_OK,
+                       "segment should be accepted");
+    }
+    toolhead_wait_moves();
+    
+    /* 检查 trapq 中本次的运动段 */
+    struct trapq *tq = toolhead_get_trapq();
+    struct move *m;
+    int count = 0;
+    double prev_end_v = 0.0;
+    double min_junction_v = 1e9;
+    list_for_each_entry(m, &tq->moves, struct move, node) {
+        if (m->print_time < t0) {
+            continue;
+        }
+        double start_v = m->start_v;
+        double end_v = m->cruise_v - 2.0 * m->half_accel * m->decel_t;
+        TEST_ASSERT(fabs(start_v - prev_end_v) < 1e-3,
+                    "velocity should be continuous across junctions");
+        if (count > 0 && start_v < min_junction_v) {
+            min_junction_v = start_v;
+        }
+        prev_end_v = end_v;
+        count++;
+    }
+    
+    TEST_ASSERT_EQ(count, segments, "every segment should reach trapq");
+    TEST_ASSERT(fabs(prev_end_v) < 1e-3, "last segment should end at rest");
+    TEST_ASSERT(min_junction_v > 5.0, "junctions should not stop the head");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试运动中修改加速度和速度倍率
+ * 
+ * 前瞻队列中尚未确定的运动按新限制重新规划，不停机: 相邻运动段的
+ * 速度保持连续，修改前入队的部分运动段已使用新的加速度。
+ */
+static int
+test_lookahead_replan(void)
+{
+    toolhead_config_t orig, config;
+    struct coord pos;
+    int segments = 24;
+    int changed_at = 12;
+    double radius = 20.0;
+    
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    /* 非法参数不改变配置 */
+    toolhead_get_config(&orig);
+    config = orig;
+    config.max_accel = 0.0f;
+    TEST_ASSERT_EQ(toolhead_set_config(&config), TOOLHEAD_ERR_PARAM,
+                   "zero accel should be rejected");
+    TEST_ASSERT_EQ(toolhead_set_speed_factor(0.0f), TOOLHEAD_ERR_PARAM,
+                   "zero speed factor should be rejected");
+    TEST_ASSERT_FLOAT_EQ(toolhead_get_speed_factor(), 1.0f,
+                         "speed factor should default to 1");
+    
+    pos.x = 100.0 + radius;
+    pos.y = 100.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    double t0 = toolhead_get_print_time();
+    
+    for (int i = 1; i <= segments; i++) {
+        if (i == changed_at) {
+            config = orig;
+            config.max_accel = 1000.0f;
+            config.max_accel_to_decel = 500.0f;
+            TEST_ASSERT_EQ(toolhead_set_config(&config), TOOLHEAD_OK,
+                           "set_config should succeed while moving");
+            TEST_ASSERT_EQ(toolhead_set_speed_factor(0.5f), TOOLHEAD_OK,
+                           "speed factor should be accepted while moving");
+        }
+        double a = 2.0 * 3.14159265358979 * i / segments;
+        pos.x = 100.0 + radius * cos(a);
+        pos.y = 100.0 + radius * sin(a);
+        TEST_ASSERT_EQ(toolhead_move(&pos, 100.0f), TOOLHEAD_OK,
+                       "segment should be accepted");
+    }
+    toolhead_wait_moves();
+    
+    struct trapq *tq = toolhead_get_trapq();
+    struct move *m;
+    int count = 0;
+    int new_accel = 0;
+    double prev_end_v = 0.0;
+    double min_junction_v = 1e9;
+    list_for_each_entry(m, &tq->moves, struct move, node) {
+        if (m->print_time < t0) {
+            continue;
+        }
+        double accel = 2.0 * m->half_accel;
+        double start_v = m->start_v;
+        double end_v = m->cruise_v - accel * m->decel_t;
+        TEST_ASSERT(fabs(start_v - prev_end_v) < 1e-3,
+                    "velocity should stay continuous across the change");
+        TEST_ASSERT(fabs(accel - orig.max_accel) < 1e-3 ||
+                    fabs(accel - 1000.0) < 1e-3,
+                    "each segment should use one accel limit");
+        if (fabs(accel - 1000.0) < 1e-3) {
+            new_accel++;
+            TEST_ASSERT(m->cruise_v <= 50.0 + 1e-3,
+                        "replanned segments should obey the speed factor");
+        } else {
+            TEST_ASSERT(new_accel == 0, "old limits should only cover a prefix");
+        }
+        if (count > 0 && start_v < min_junction_v) {
+            min_junction_v = start_v;
+        }
+        prev_end_v = end_v;
+        count++;
+    }
+    
+    TEST_ASSERT_EQ(count, segments, "every segment should reach trapq");
+    TEST_ASSERT(new_accel > segments - changed_at + 1,
+                "queued segments should be replanned with the new accel");
+    TEST_ASSERT(min_junction_v > 5.0, "the change should not stop the head");
+    
+    /* 恢复配置 */
+    toolhead_set_config(&orig);
+    toolhead_set_speed_factor(1.0f);
+    
+    return 1;
+}
+
+/**
+ * @brief   统计 trapq 中 t0 之后开始的运动段数
+ */
+static int
+count_moves_since(double t0)
+{
+    struct trapq *tq = toolhead_get_trapq();
+    struct move *m;
+    int count = 0;
+    list_for_each_entry(m, &tq->moves, struct move, node) {
+        if (m->print_time >= t0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief   测试惰性提交按限幅和速度倍率后的速度计时
+ * 
+ * 往返的 10mm 运动在结点处停下，前面的运动段已确定。请求速度超过
+ * max_velocity 或乘了速度倍率时，累计的运动时间按实际巡航速度计算，
+ * 几段之后就应提交到 trapq，而不是等前瞻队列接近满。
+ */
+static int
+test_lazy_flush_time(void)
+{
+    struct coord pos;
+    
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    pos.x = 100.0;
+    pos.y = 100.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    
+    /* 请求 1000mm/s，限幅到 MAX_VELOCITY: 每段至少 0.05s */
+    double t0 = toolhead_get_print_time();
+    for (int i = 1; i <= 8; i++) {
+        pos.x = (i % 2) ? 110.0 : 100.0;
+        TEST_ASSERT_EQ(toolhead_move(&pos, 1000.0f), TOOLHEAD_OK,
+                       "move should be accepted");
+    }
+    TEST_ASSERT(count_moves_since(t0) > 0,
+                "clamped moves should be committed after 0.4s of motion");
+    toolhead_wait_moves();
+    
+    /* 速度倍率 0.25: 请求 200mm/s 实际 50mm/s，每段 0.1s 以上 */
+    TEST_ASSERT_EQ(toolhead_set_speed_factor(0.25f), TOOLHEAD_OK,
+                   "speed factor should be accepted");
+    t0 = toolhead_get_print_time();
+    for (int i = 1; i <= 4; i++) {
+        pos.x = (i % 2) ? 105.0 : 100.0;
+        TEST_ASSERT_EQ(toolhead_move(&pos, 200.0f), TOOLHEAD_OK,
+                       "move should be accepted");
+    }
+    TEST_ASSERT(count_moves_since(t0) > 0,
+                "scaled moves should be committed after 0.4s of motion");
+    toolhead_wait_moves();
+    toolhead_set_speed_factor(1.0f);
+    
+    return 1;
+}
+
+/**
+ * @brief   测试细小共线线段合并
+ * 
+ * 共线且挤出比相同的细小线段应合并，拐角和挤出比变化处不合并，
+ * 合并后的步数与逐段执行一致。
+ */
+static int
+test_move_coalesce(void)
+{
+    struct coord pos;
+    int segments = 16;
+    
+    /* 初始化并回收之前的运动 */
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    pos.x = 50.0;
+    pos.y = 50.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    test_reset_queued_steps();
+    double t0 = toolhead_get_print_time();
+    
+    /* 16 x 0.25mm 共线挤出线段 */
+    for (int i = 0; i < segments; i++) {
+        pos.x += 0.25;
+        pos.e += 0.0625;
+        TEST_ASSERT_EQ(toolhead_move(&pos, 50.0f), TOOLHEAD_OK,
+                       "segment should be accepted");
+    }
+    toolhead_get_position(&pos);
+    TEST_ASSERT_DOUBLE_EQ(pos.x, 54.0, "commanded X should include held segment");
+    toolhead_wait_moves();
+    
+    int expected = (segments + COALESCE_MAX_POINTS) / (COALESCE_MAX_POINTS + 1);
+    TEST_ASSERT_EQ(count_moves_since(t0), expected,
+                   "collinear segments should be merged");
+    TEST_ASSERT_EQ(test_get_queued_steps(0), 4 * 80, "X steps should be kept");
+    TEST_ASSERT_EQ(test_get_queued_steps(3), 93, "E steps should be kept");
+    
+    /* 直角拐角和挤出比变化处必须断开 */
+    t0 = toolhead_get_print_time();
+    pos.x += 0.25;
+    toolhead_move(&pos, 50.0f);
+    pos.y += 0.25;
+    toolhead_move(&pos, 50.0f);
+    pos.y += 0.25;
+    pos.e += 0.05;
+    toolhead_move(&pos, 50.0f);
+    toolhead_wait_moves();
+    
+    TEST_ASSERT_EQ(count_moves_since(t0), 3,
+                   "corners and extrusion changes should not merge");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试圆弧分段
+ * 
+ * 分段数由弦偏差决定，分段端点都在圆上，终点精确；整圆回到起点；
+ * 有点超出限位的圆弧整段拒绝，不入队任何线段。
+ */
+static int
+test_move_arc(void)
+{
+    struct coord pos;
+    
+    /* 初始化并回收之前的运动 */
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    pos.x = 60.0;
+    pos.y = 50.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    test_reset_queued_steps();
+    double t0 = toolhead_get_print_time();
+    
+    /* 逆时针 1/4 圆，圆心 (50, 50)，半径 10 */
+    pos.x = 50.0;
+    pos.y = 60.0;
+    pos.z = 1.0;
+    int ret = toolhead_arc(&pos, -10.0f, 0.0f, 0, 50.0f);
+    TEST_ASSERT_EQ(ret, TOOLHEAD_OK, "quarter arc should be accepted");
+    toolhead_get_position(&pos);
+    TEST_ASSERT_DOUBLE_EQ(pos.x, 50.0, "arc should end at target X");
+    TEST_ASSERT_DOUBLE_EQ(pos.y, 60.0, "arc should end at target Y");
+    TEST_ASSERT_DOUBLE_EQ(pos.z, 1.0, "arc should end at target Z");
+    toolhead_wait_moves();
+    
+    double max_seg = 2.0 * acos(1.0 - ARC_TOLERANCE / 10.0);
+    int expected = (int)ceil((3.14159265358979 / 2.0) / max_seg);
+    int count = count_moves_since(t0);
+    TEST_ASSERT_EQ(count, expected, "segment count should follow tolerance");
+    
+    struct trapq *tq = toolhead_get_trapq();
+    struct move *m;
+    list_for_each_entry(m, &tq->moves, struct move, node) {
+        if (m->print_time < t0) {
+            continue;
+        }
+        double dx = (double)m->start_pos.x - 50.0;
+        double dy = (double)m->start_pos.y - 50.0;
+        TEST_ASSERT(fabs(sqrt(dx * dx + dy * dy) - 10.0) < 0.001,
+                    "segment start should lie on the arc");
+        TEST_ASSERT(dx >= -0.001 && dy >= -0.001,
+                    "segment start should stay in the first quadrant");
+    }
+    
+    /* 顺时针整圆回到起点 */
+    pos.x = 60.0;
+    pos.y = 50.0;
+    toolhead_set_position(&pos);
+    test_reset_queued_steps();
+    ret = toolhead_arc(&pos, -10.0f, 0.0f, 1, 50.0f);
+    TEST_ASSERT_EQ(ret, TOOLHEAD_OK, "full circle should be accepted");
+    toolhead_wait_moves();
+    TEST_ASSERT_EQ(test_get_queued_steps(0), 0, "full circle X steps cancel");
+    TEST_ASSERT_EQ(test_get_queued_steps(1), 0, "full circle Y steps cancel");
+    TEST_ASSERT(test_get_queued_moves(0) > 0, "full circle should move X");
+    
+    /* 端点在限位内但圆弧越过 X 下限 */
+    pos.x = 15.0;
+    pos.y = 50.0;
+    toolhead_set_position(&pos);
+    t0 = toolhead_get_print_time();
+    ret = toolhead_arc(&pos, -10.0f, 0.0f, 0, 50.0f);
+    TEST_ASSERT_EQ(ret, TOOLHEAD_ERR_LIMIT, "arc outside limits should fail");
+    toolhead_wait_moves();
+    count = count_moves_since(t0);
+    TEST_ASSERT_EQ(count, 0, "rejected arc should queue nothing");
+    toolhead_get_position(&pos);
+    TEST_ASSERT_DOUBLE_EQ(pos.x, 15.0, "rejected arc should not move");
+    
+    /* 零半径 */
+    ret = toolhead_arc(&pos, 0.0f, 0.0f, 0, 50.0f);
+    TEST_ASSERT_EQ(ret, TOOLHEAD_ERR_PARAM, "zero radius should fail");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试分段数超过 trapq 内存池的圆弧
+ * 
+ * 返回时只入队 trapq 容得下的分段，期间不接收新运动；其余分段
+ * 由 toolhead_task() 随运动段释放陆续入队，最终走完整圆。
+ */
+static int
+test_move_arc_resume(void)
+{
+    struct coord pos;
+    
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    pos.x = 170.0;
+    pos.y = 110.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    test_reset_queued_steps();
+    
+    /* 半径 60 的整圆约 172 段 */
+    int ret = toolhead_arc(&pos, -60.0f, 0.0f, 0, 100.0f);
+    TEST_ASSERT_EQ(ret, TOOLHEAD_OK, "large arc should be accepted");
+    TEST_ASSERT_EQ(toolhead_can_accept_move(), 0,
+                   "moves should wait while arc segments are pending");
+    TEST_ASSERT_EQ(toolhead_has_moves(), 1, "pending arc should count as moves");
+    toolhead_get_position(&pos);
+    TEST_ASSERT_DOUBLE_EQ(pos.x, 170.0, "commanded position should be the arc end");
+    
+    trapq_pool_stats_t stats;
+    trapq_pool_get_stats(&stats);
+    TEST_ASSERT(stats.moves_used <= TRAPQ_MAX_MOVES, "arc should fit the pool");
+    
+    /* 主循环推进: 剩余分段陆续入队 */
+    for (int i = 0; i < 10000 && !toolhead_can_accept_move(); i++) {
+        run_flush_period();
+    }
+    TEST_ASSERT_EQ(toolhead_can_accept_move(), 1, "arc should finish queueing");
+    
+    toolhead_wait_moves();
+    TEST_ASSERT_EQ(test_get_queued_steps(0), 0, "full circle X steps cancel");
+    TEST_ASSERT_EQ(test_get_queued_steps(1), 0, "full circle Y steps cancel");
+    TEST_ASSERT(test_get_queued_moves(0) > 0, "full circle should move X");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试匀速步进压缩为单个运动段
+ */
+static int
+test_stepcompress_constant(void)
+{
+    uint32_t clocks[32];
+    struct step_segment seg;
+    
+    for (int i = 0; i < 32; i++) {
+        clocks[i] = 1000 + (uint32_t)(i + 1) * 200;
+    }
+    
+    int n = stepcompress_fit(clocks, 32, 1000, 25, &seg);
+    TEST_ASSERT_EQ(n, 32, "all steps should fit one segment");
+    TEST_ASSERT_EQ(seg.interval, 200, "interval should be 200");
+    TEST_ASSERT_EQ(seg.add, 0, "add should be 0");
+    TEST_ASSERT_EQ(stepcompress_end_clock(1000, &seg), clocks[31],
+                   "end clock should match last step");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试加速段压缩误差不超过上限
+ */
+static int
+test_stepcompress_accel(void)
+{
+    uint32_t clocks[STEPCOMPRESS_WINDOW];
+    struct step_segment seg;
+    const double accel = 3000.0 * 80.0;     /* steps/s^2 */
+    
+    /* 从静止匀加速: t = sqrt(2 * n / a) */
+    for (int i = 0; i < STEPCOMPRESS_WINDOW; i++) {
+        clocks[i] = (uint32_t)(sqrt(2.0 * (i + 1) / accel) * 1000000.0 + 0.5);
+    }
+    
+    uint32_t last = 0;
+    int done = 0;
+    int segments = 0;
+    while (done < STEPCOMPRESS_WINDOW) {
+        int n = stepcompress_fit(&clocks[done], STEPCOMPRESS_WINDOW - done,
+                                 last, 25, &seg);
+        TEST_ASSERT(n > 0, "fit should cover at least one step");
+        
+        for (int k = 1; k <= n; k++) {
+            int64_t t = (int64_t)last + (int64_t)k * seg.interval +
+                        (int64_t)seg.add * k * (k - 1) / 2;
+            int64_t err = t - (int64_t)clocks[done + k - 1];
+            TEST_ASSERT(err <= 25 && err >= -25, "step error within bound");
+        }
+        
+        last = stepcompress_end_clock(last, &seg);
+        done += n;
+        segments++;
+    }
+    TEST_ASSERT(segments < STEPCOMPRESS_WINDOW / 4, "ramp should compress");
+    
+    return 1;
+}
+
+/**
+ * @brief   测试 trapq 按时间顺序归档/释放，位置查询跨越历史和活动队列
+ */
+static int
+test_trapq_cursor(void)
+{
+    struct coord axes_r = {1.0, 0.0, 0.0, 0.0};
+    struct coord pos;
+    
+    toolhead_init();
+    
+    struct trapq *tq = trapq_alloc();
+    TEST_ASSERT(tq != NULL, "trapq alloc should succeed");
+    
+    /* 四段首尾相接的 10mm/s 匀速运动，每段 0.1s */
+    for (int i = 0; i < 4; i++) {
+        struct coord start = {(double)i, 0.0, 0.0, 0.0};
+        trapq_append(tq, 1.0 + 0.1 * i, 0.0, 0.1, 0.0, &start, &axes_r,
+                     10.0, 10.0, 0.0);
+    }
+    
+    /* 前后跳转查询 */
+    TEST_ASSERT_EQ(trapq_get_position(tq, 1.35, &pos), 0, "late query should hit");
+    TEST_ASSERT_FLOAT_EQ(pos.x, 3.5, "position in last move");
+    TEST_ASSERT_EQ(trapq_get_position(tq, 1.05, &pos), 0, "early query should hit");
+    TEST_ASSERT_FLOAT_EQ(pos.x, 0.5, "position in first move");
+    
+    /* 归档前两段后仍可在历史中查到 */
+    trapq_finalize_moves(tq, 1.21);
+    struct move *first = trapq_first_move(tq);
+    TEST_ASSERT(first != NULL && fabs(first->print_time - 1.2) < 1e-9,
+                "finalize should stop at first unfinished move");
+    TEST_ASSERT_EQ(trapq_get_position(tq, 1.25, &pos), 0, "active query should hit");
+    TEST_ASSERT_FLOAT_EQ(pos.x, 2.5, "position in active move");
+    TEST_ASSERT_EQ(trapq_get_position(tq, 1.05, &pos), 0, "history query should hit");
+    TEST_ASSERT_FLOAT_EQ(pos.x, 0.5, "position in history move");
+    
+    /* 释放最旧一段 (包括上次命中的段) */
+    uint32_t avail = trapq_pool_available();
+    trapq_free_moves(tq, 1.15);
+    TEST_ASSERT_EQ(trapq_pool_available(), avail + 1, "only the oldest move is freed");
+    TEST_ASSERT_EQ(trapq_get_position(tq, 1.05, &pos), -1, "freed move has no position");
+    TEST_ASSERT_EQ(trapq_get_position(tq, 1.15, &pos), 0, "kept history should hit");
+    TEST_ASSERT_FLOAT_EQ(pos.x, 1.5, "position in kept history move");
+    TEST_ASSERT_EQ(trapq_get_position(tq, 2.0, &pos), -1, "query past the queue fails");
+    
+    trapq_free(tq);
+    
+    return 1;
+}
+
+/**
+ * @brief   测试分多次刷新生成的步进与一次刷新完全一致 (itersolve 游标续接)
+ */
+static int
+test_itersolve_cursor(void)
+{
+    static struct step_queue sq_once, sq_split;
+    struct coord axes_r = {1.0, 0.0, 0.0, 0.0};
+    struct step_time a, b;
+    
+    toolhead_init();
+    
+    struct trapq *tq = trapq_alloc();
+    struct stepper_kinematics *sk_once = itersolve_alloc();
+    struct stepper_kinematics *sk_split = itersolve_alloc();
+    TEST_ASSERT(tq != NULL && sk_once != NULL && sk_split != NULL,
+                "allocations should succeed");
+    
+    /* 六段首尾相接的梯形运动 */
+    double t = 1.0;
+    for (int i = 0; i < 6; i++) {
+        struct coord start = {3.0 * i, 0.0, 0.0, 0.0};
+        trapq_append(tq, t, 0.01, 0.02, 0.01, &start, &axes_r,
+                     50.0, 100.0, 5000.0);
+        t += 0.04;
+    }
+    
+    cartesian_stepper_setup(sk_once, CARTESIAN_AXIS_X, 10.0);
+    cartesian_stepper_setup(sk_split, CARTESIAN_AXIS_X, 10.0);
+    step_queue_init(&sq_once);
+    step_queue_init(&sq_split);
+    itersolve_set_trapq(sk_once, tq);
+    itersolve_set_trapq(sk_split, tq);
+    itersolve_set_step_queue(sk_once, &sq_once);
+    itersolve_set_step_queue(sk_split, &sq_split);
+    
+    int n_once = itersolve_generate_steps(sk_once, t);
+    int n_split = 0;
+    for (double flush = 1.0; flush < t + 0.005; flush += 0.007) {
+        n_split += itersolve_generate_steps(sk_split, flush);
+    }
+    n_split += itersolve_generate_steps(sk_split, t);
+    
+    TEST_ASSERT(n_once > 0 && n_once < STEP_QUEUE_SIZE, "steps should fit the queue");
+    TEST_ASSERT_EQ(n_split, n_once, "split flushes should emit same step count");
+    while (step_queue_pop(&sq_once, &a) == 0) {
+        TEST_ASSERT(step_queue_pop(&sq_split, &b) == 0, "queues should match");
+        TEST_ASSERT(fabs(a.time - b.time) < STEP_TIME_TOLERANCE,
+                    "step times should match");
+    }
+    
+    /* 查询位置从游标处开始，越过已处理的运动段 */
+    double pos = itersolve_calc_position(sk_split, 1.05);
+    TEST_ASSERT(fabs(pos - (3.0 + (50.0 * 0.01 + 2500.0 * 0.0001)) * 10.0) < 1e-3,
+                "position lookup should find earlier move");
+    
+    itersolve_free(sk_once);
+    itersolve_free(sk_split);
+    trapq_free(tq);
+    
+    return 1;
+}
+
+static int s_calc_calls;
+
+static motion_t
+counting_z_calc_position(struct stepper_kinematics *sk, struct move *m,
+                         motion_t move_time)
+{
+    s_calc_calls++;
+    return (m->start_pos.z + m->axes_r.z * move_get_distance(m, move_time)) *
+           sk->scale;
+}
+
+/**
+ * @brief   测试不涉及本轴的运动段跳过步进求解
+ */
+static int
+test_itersolve_skip_idle_axis(void)
+{
+    static struct step_queue sq;
+    struct coord start = {0.0, 0.0, 0.2, 0.0};
+    struct coord xy_r = {0.6, 0.8, 0.0, 0.0};
+    struct coord z_r = {0.0, 0.0, 1.0, 0.0};
+    
+    toolhead_init();
+    
+    struct trapq *tq = trapq_alloc();
+    struct stepper_kinematics *sk = itersolve_alloc();
+    TEST_ASSERT(tq != NULL && sk != NULL, "allocations should succeed");
+    
+    trapq_append(tq, 1.0, 0.01, 0.1, 0.01, &start, &xy_r, 0.0, 50.0, 5000.0);
+    struct move *m = trapq_last_move(tq);
+    TEST_ASSERT_EQ(m->active_axes, TRAPQ_AXIS_X | TRAPQ_AXIS_Y,
+                   "XY move should flag only X and Y");
+    
+    sk->scale = 400.0;
+    sk->step_dist = 1.0 / 400.0;
+    sk->active_axes = TRAPQ_AXIS_Z;
+    itersolve_set_calc_callback(sk, counting_z_calc_position);
+    step_queue_init(&sq);
+    itersolve_set_trapq(sk, tq);
+    itersolve_set_step_queue(sk, &sq);
+    itersolve_set_position(sk, start.z * 400.0);
+    
+    s_calc_calls = 0;
+    TEST_ASSERT_EQ(itersolve_generate_steps(sk, 1.2), 0, "Z should not step");
+    TEST_ASSERT_EQ(s_calc_calls, 0, "idle Z should not be solved");
+    
+    /* 抬升 Z 的运动段照常求解 */
+    trapq_append(tq, 1.2, 0.0, 0.1, 0.0, &start, &z_r, 2.0, 2.0, 0.0);
+    TEST_ASSERT(itersolve_generate_steps(sk, 1.3) > 0, "Z move should step");
+    TEST_ASSERT(s_calc_calls > 0, "active Z should be solved");
+    
+    itersolve_free(sk);
+    trapq_free(tq);
+    
+    return 1;
+}
+
+/**
+ * @brief   测试解析步进求解与迭代求解结果一致
+ */
+static int
+test_linear_solver_matches_iterative(void)
+{
+    static struct step_queue sq_linear, sq_iter;
+    struct coord start = {10.0, 20.0, 0.0, 0.0};
+    struct coord axes_r;
+    struct coord end = {40.0, 5.0, 0.0, 0.0};
+    struct step_time a, b;
+    
+    toolhead_init();
+    
+    struct trapq *tq = trapq_alloc();
+    struct stepper_kinematics *sk_linear = itersolve_alloc();
+    struct stepper_kinematics *sk_iter = itersolve_alloc();
+    TEST_ASSERT(tq != NULL && sk_linear != NULL && sk_iter != NULL,
+                "allocations should succeed");
+    
+    /* 加速-匀速-减速完整梯形 */
+    cartesian_calc_direction(&start, &end, &axes_r);
+    trapq_append(tq, 1.0, 0.02, 0.3, 0.03, &start, &axes_r,
+                 0.0, 60.0, 3000.0);
+    
+    cartesian_stepper_setup(sk_linear, CARTESIAN_AXIS_Y, 80.0);
+    cartesian_stepper_setup(sk_iter, CARTESIAN_AXIS_Y, 80.0);
+    itersolve_set_solver(sk_iter, ITERSOLVE_SOLVER_ITERATIVE);
+    
+    step_queue_init(&sq_linear);
+    step_queue_init(&sq_iter);
+    itersolve_set_trapq(sk_linear, tq);
+    itersolve_set_trapq(sk_iter, tq);
+    itersolve_set_step_queue(sk_linear, &sq_linear);
+    itersolve_set_step_queue(sk_iter, &sq_iter);
+    itersolve_set_position(sk_linear, start.y * 80.0);
+    itersolve_set_position(sk_iter, start.y * 80.0);
+    
+    int n_linear = itersolve_generate_steps(sk_linear, 1.2);
+    int n_iter = itersolve_generate_steps(sk_iter, 1.2);
+    TEST_ASSERT_EQ(n_linear, n_iter, "both solvers should emit same step count");
+    TEST_ASSERT(n_linear > 0, "steps should be generated");
+    
+    while (step_queue_pop(&sq_linear, &a) == 0) {
+        TEST_ASSERT(step_queue_pop(&sq_iter, &b) == 0, "queues should match");
+        TEST_ASSERT(a.dir == b.dir && a.dir == -1, "Y should step backward");
+        TEST_ASSERT(fabs(a.time - b.time) < STEP_TIME_TOLERANCE,
+                    "step times should match");
+    }
+    
+    itersolve_free(sk_linear);
+    itersolve_free(sk_iter);
+    trapq_free(tq);
+    
+    return 1;
+}
+
+/**
+ * @brief   把一段匀加速-匀速-匀减速运动加入 trapq
+ */
+static void
+append_trapezoid(struct trapq *tq, double print_time,
+                 const struct coord *start, const struct coord *end,
+                 double cruise_v, double accel)
+{
+    struct coord axes_r;
+    double dist = cartesian_calc_direction(start, end, &axes_r);
+    double accel_t = cruise_v / accel;
+    double cruise_t = (dist - cruise_v * accel_t) / cruise_v;
+    
+    trapq_append(tq, print_time, accel_t, cruise_t, accel_t, start, &axes_r,
+                 0.0, cruise_v, accel);
+}
+
+/**
+ * @brief   取出全部步进，统计方向并检查每步都落在整数步位置
+ * @return  净步数，步进不在整数位置时返回 INT32_MIN
+ */
+static int32_t
+drain_checked_steps(struct stepper_kinematics *sk, struct step_queue *sq,
+                    struct move *m, double flush_time, int *p_reversals)
+{
+    struct step_time step;
+    int32_t net = 0;
+    int last_dir = 0;
+    int n;
+    
+    *p_reversals = 0;
+    do {
+        n = itersolve_generate_steps(sk, flush_time);
+        while (step_queue_pop(sq, &step) == 0) {
+            double pos = sk->calc_position_cb(sk, m,
+                                              step.time - m->print_time);
+            if (fabs(pos - floor(pos + 0.5)) > 0.01) {
+                return INT32_MIN;
+            }
+            if (last_dir != 0 && step.dir != last_dir) {
+                (*p_reversals)++;
+            }
+            last_dir = step.dir;
+            net += step.dir;
+        }
+    } while (n > 0);
+    
+    return net;
+}
+
+/**
+ * @brief   测试 CoreXY 电机位置和线性求解
+ */
+static int
+test_corexy_steps(void)
+{
+    static struct step_queue sq_a, sq_b;
+    struct coord start = {10.0, 20.0, 0.0, 0.0};
+    struct coord end = {40.0, 5.0, 0.0, 0.0};
+    int reversals;
+    
+    toolhead_init();
+    
+    struct trapq *tq = trapq_alloc();
+    struct stepper_kinematics *sk_a = itersolve_alloc();
+    struct stepper_kinematics *sk_b = itersolve_alloc();
+    TEST_ASSERT(tq != NULL && sk_a != NULL && sk_b != NULL,
+                "allocations should succeed");
+    
+    append_trapezoid(tq, 1.0, &start, &end, 60.0, 3000.0);
+    struct move *m = trapq_first_move(tq);
+    
+    corexy_stepper_setup(sk_a, '+', 80.0);
+    corexy_stepper_setup(sk_b, '-', 80.0);
+    TEST_ASSERT_EQ(sk_a->solver, ITERSOLVE_SOLVER_LINEAR,
+                   "CoreXY should use the linear solver");
+    TEST_ASSERT_DOUBLE_EQ(sk_a->calc_position_cb(sk_a, m, 0.0), 2400.0,
+                          "A should follow x + y");
+    TEST_ASSERT_DOUBLE_EQ(sk_b->calc_position_cb(sk_b, m, 0.0), -800.0,
+                          "B should follow x - y");
+    
+    step_queue_init(&sq_a);
+    step_queue_init(&sq_b);
+    itersolve_set_trapq(sk_a, tq);
+    itersolve_set_trapq(sk_b, tq);
+    itersolve_set_step_queue(sk_a, &sq_a);
+    itersolve_set_step_queue(sk_b, &sq_b);
+    itersolve_set_position(sk_a, 2400.0);
+    itersolve_set_position(sk_b, -800.0);
+    
+    double flush = 1.0 + m->move_t;
+    int32_t net_a = drain_checked_steps(sk_a, &sq_a, m, flush, &reversals);
+    int32_t net_b = drain_checked_steps(sk_b, &sq_b, m, flush, &reversals);
+    TEST_ASSERT(abs(net_a - 1200) <= STEP_COUNT_TOLERANCE,
+                "A should step (dx + dy) * 80");
+    TEST_ASSERT(abs(net_b - 3600) <= STEP_COUNT_TOLERANCE,
+                "B should step (dx - dy) * 80");
+    
+    itersolve_free(sk_a);
+    itersolve_free(sk_b);
+    trapq_free(tq);
+    
+    return 1;
+}
+
+/**
+ * @brief   测试三角洲塔的闭式求解，包括滑车在运动段中反向
+ */
+static int
+test_delta_steps(void)
+{
+    static struct step_queue sq;
+    /* 经过 A 塔附近: 滑车先升后降 */
+    struct coord start = {-70.0, 30.0, 5.0, 0.0};
+    struct coord end = {-30.0, -80.0, 5.0, 0.0};
+    double tower_x, tower_y;
+    int reversals;
+    
+    toolhead_init();
+    
+    struct trapq *tq = trapq_alloc();
+    struct stepper_kinematics *sk = itersolve_alloc();
+    TEST_ASSERT(tq != NULL && sk != NULL, "allocations should succeed");
+    
+    append_trapezoid(tq, 1.0, &start, &end, 100.0, 3000.0);
+    struct move *m = trapq_first_move(tq);
+    
+    delta_tower_position(DELTA_TOWER_A, 99.0, &tower_x, &tower_y);
+    TEST_ASSERT(tower_x < 0.0 && tower_y < 0.0, "A tower should be front left");
+    delta_stepper_setup(sk, 217.0 * 217.0, tower_x, tower_y, 80.0);
+    
+    double dx = tower_x - start.x, dy = tower_y - start.y;
+    double start_pos = (sqrt(217.0 * 217.0 - dx * dx - dy * dy) + 5.0) * 80.0;
+    dx = tower_x - end.x;
+    dy = tower_y - end.y;
+    double end_pos = (sqrt(217.0 * 217.0 - dx * dx - dy * dy) + 5.0) * 80.0;
+    TEST_ASSERT(fabs(sk->calc_position_cb(sk, m, 0.0) - start_pos) < 0.01,
+                "carriage height should follow the rod length");
+    
+    step_queue_init(&sq);
+    itersolve_set_trapq(sk, tq);
+    itersolve_set_step_queue(sk, &sq);
+    itersolve_set_position(sk, start_pos);
+    
+    int32_t net = drain_checked_steps(sk, &sq, m, 1.0 + m->move_t, &reversals);
+    TEST_ASSERT(net != INT32_MIN, "every step should land on a step position");
+    /* 上行停在 floor 之上、下行停在 ceil 之下，反向后误差小于两步 */
+    TEST_ASSERT(fabs(net - (end_pos - start_pos)) < 2.0,
+                "net steps should match the carriage travel");
+    TEST_ASSERT_EQ(reversals, 1, "carriage should reverse once");
+    
+    /* 纯 Z 运动: 滑车与 Z 同步 */
+    struct coord up = {-30.0, -80.0, 10.0, 0.0};
+    append_trapezoid(tq, 3.0, &end, &up, 20.0, 3000.0);
+    struct move *mz = list_last_entry(&tq->moves, struct move, node);
+    net = drain_checked_steps(sk, &sq, mz, 3.0 + mz->move_t, &reversals);
+    TEST_ASSERT(abs(net - 400) <= 1, "Z move should lift the carriage 5mm");
+    TEST_ASSERT_EQ(reversals, 0, "Z move should not reverse");
+    
+    itersolve_free(sk);
+    trapq_free(tq);
+    
+    return 1;
+}
+
+/**
+ * @brief   测试输入整形的位置卷积和步进生成
+ * 
+ * 匀速段整形前后位置一致；整形后的运动在运动段前后各延伸一小段，
+ * 总步数不变。
+ */
+static int
+test_input_shaper_steps(void)
+{
+    static struct step_queue sq;
+    struct coord start = {10.0, 20.0, 0.0, 0.0};
+    struct coord axes_r = {1.0, 0.0, 0.0, 0.0};
+    struct step_time step;
+    
+    toolhead_init();
+    
+    struct trapq *tq = trapq_alloc();
+    struct stepper_kinematics *sk = itersolve_alloc();
+    struct stepper_kinematics *ss = input_shaper_alloc();
+    TEST_ASSERT(tq != NULL && sk != NULL && ss != NULL,
+                "allocations should succeed");
+    
+    /* X: 0.6mm 加速, 18mm 匀速, 0.6mm 减速 */
+    trapq_append(tq, 1.0, 0.02, 0.3, 0.02, &start, &axes_r,
+                 0.0, 60.0, 3000.0);
+    struct move *m = trapq_first_move(tq);
+    
+    cartesian_stepper_setup(sk, CARTESIAN_AXIS_X, 80.0);
+    itersolve_set_trapq(sk, tq);
+    itersolve_set_position(sk, start.x * 80.0);
+    TEST_ASSERT_EQ(input_shaper_set_sk(ss, sk), 0, "shaper should wrap sk");
+    TEST_ASSERT_EQ(input_shaper_set_shaper(ss, INPUT_SHAPER_MZV, 40.0, 0.1), 0,
+                   "MZV should be accepted");
+    TEST_ASSERT_EQ(input_shaper_set_shaper(ss, INPUT_SHAPER_EI, 0.0, 0.1), -1,
+                   "zero frequency should be rejected");
+    
+    double pre = ss->gen_steps_pre_active;
+    double post = ss->gen_steps_post_active;
+    TEST_ASSERT(pre > 0.0 && post > 0.0, "shaper should look both ways");
+    
+    /* 匀速段: 中心化的脉冲使整形位置等于原位置 */
+    double ref = sk->calc_position_cb(sk, m, 0.17);
+    double shaped = ss->calc_position_cb(ss, m, 0.17);
+    TEST_ASSERT(fabs(shaped - ref) < 1e-2, "cruise should not be shifted");
+    
+    /* 运动段前后的活动范围 */
+    TEST_ASSERT(fabs(ss->calc_position_cb(ss, m, -pre - 0.001) - 800.0) < 1e-3,
+                "shaped motion should not start before pre-active time");
+    TEST_ASSERT(ss->calc_position_cb(ss, m, -pre * 0.5) > 800.01,
+                "shaped motion should start before the move");
+    TEST_ASSERT(fabs(ss->calc_position_cb(ss, m, m->move_t + post + 0.001) -
+                     1536.0 - 800.0) < 1e-2,
+                "shaped motion should settle at the move end");
+    
+    /* 生成全部步进 */
+    step_queue_init(&sq);
+    itersolve_set_step_queue(ss, &sq);
+    double flush = 1.0 + m->move_t + post;
+    int count = 0;
+    double first = 0.0, last = 0.0, prev = 0.0;
+    int n;
+    do {
+        n = itersolve_generate_steps(ss, flush);
+        while (step_queue_pop(&sq, &step) == 0) {
+            TEST_ASSERT_EQ(step.dir, 1, "X should only step forward");
+            TEST_ASSERT(count == 0 || step.time >= prev,
+                        "step times should not go backward");
+            if (count == 0) {
+                first = step.time;
+            }
+            prev = last = step.time;
+            count++;
+        }
+    } while (n > 0);
+    
+    TEST_ASSERT_EQ(count, 1536, "shaping should keep the step count");
+    TEST_ASSERT(first < 1.0, "first step should lead the move");
+    TEST_ASSERT(last > 1.0 + m->move_t, "last step should trail the move");
+    
+    input_shaper_free(ss);
+    itersolve_free(sk);
+    trapq_free(tq);
+    
+    return 1;
+}
+
+/**
+ * @brief   测试运动规划器中启用和关闭输入整形
+ */
+static int
+test_toolhead_input_shaper(void)
+{
+    struct coord pos;
+    
+    /* 初始化并回收之前的运动 */
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    TEST_ASSERT_EQ(toolhead_set_input_shaper(2, INPUT_SHAPER_ZV, 40.0f, 0.1f),
+                   TOOLHEAD_ERR_PARAM, "Z should not be shaped");
+    TEST_ASSERT_EQ(toolhead_set_input_shaper(0, INPUT_SHAPER_ZV, 0.0f, 0.1f),
+                   TOOLHEAD_ERR_PARAM, "zero frequency should be rejected");
+    TEST_ASSERT_EQ(toolhead_set_input_shaper(0, INPUT_SHAPER_MZV, 40.0f, 0.1f),
+                   TOOLHEAD_OK, "X shaper should be accepted");
+    TEST_ASSERT_EQ(toolhead_set_input_shaper(1, INPUT_SHAPER_EI, 35.0f, 0.1f),
+                   TOOLHEAD_OK, "Y shaper should be accepted");
+    
+    pos.x = 50.0;
+    pos.y = 50.0;
+    pos.z = 0.0;
+    pos.e = 0.0;
+    toolhead_set_position(&pos);
+    test_reset_queued_steps();
+    
+    /* 直角拐角: 两轴的整形运动在拐角处重叠 */
+    pos.x += 10.0;
+    toolhead_move(&pos, 100.0f);
+    pos.y += 10.0;
+    toolhead_move(&pos, 100.0f);
+    toolhead_wait_moves();
+    
+    TEST_ASSERT_EQ(test_get_queued_steps(0), 800, "X should reach its target");
+    TEST_ASSERT_EQ(test_get_queued_steps(1), 800, "Y should reach its target");
+    
+    /* 关闭后步进位置保持连续 */
+    TEST_ASSERT_EQ(toolhead_set_input_shaper(0, INPUT_SHAPER_NONE, 0.0f, 0.0f),
+                   TOOLHEAD_OK, "disabling X shaper should succeed");
+    TEST_ASSERT_EQ(toolhead_set_input_shaper(1, INPUT_SHAPER_NONE, 0.0f, 0.0f),
+                   TOOLHEAD_OK, "disabling Y shaper should succeed");
+    pos.x -= 1.0;
+    toolhead_move(&pos, 50.0f);
+    toolhead_wait_moves();
+    
+    TEST_ASSERT_EQ(test_get_queued_steps(0), 720, "X should step back 1mm");
+    
+    return 1;
+}
+
+/**
+ * @brief   走一段带挤出的折线并回抽，返回 E 轴入队的步进段数
+ */
+static uint32_t
+run_extrude_path(void)
+{
+    struct coord pos = {50.0, 50.0, 0.0, 0.0};
+    
+    toolhead_set_position(&pos);
+    test_reset_queued_steps();
+    
+    pos.x += 10.0;
+    pos.e += 1.0;
+    toolhead_move(&pos, 100.0f);
+    pos.y += 10.0;
+    pos.e += 1.0;
+    toolhead_move(&pos, 100.0f);
+    pos.e -= 0.5;
+    toolhead_move(&pos, 25.0f);
+    toolhead_wait_moves();
+    
+    return test_get_queued_moves(3);
+}
+
+/**
+ * @brief   测试压力提前: 步数不变，加减速处出现额外的提前/回退
+ */
+static int
+test_toolhead_pressure_advance(void)
+{
+    toolhead_init();
+    toolhead_wait_moves();
+    run_flush_period();
+    
+    TEST_ASSERT_EQ(toolhead_set_pressure_advance(-0.1f, 0.04f),
+                   TOOLHEAD_ERR_PARAM, "negative advance should be rejected");
+    TEST_ASSERT_EQ(toolhead_set_pressure_advance(0.05f, 0.5f),
+                   TOOLHEAD_ERR_PARAM, "long smooth time should be rejected");
+    
+    uint32_t plain_moves = run_extrude_path();
+    TEST_ASSERT_EQ(test_get_queued_steps(3), 140, "E should reach 1.5mm");
+    
+    TEST_ASSERT_EQ(toolhead_set_pressure_advance(0.05f, 0.04f), TOOLHEAD_OK,
+                   "pressure advance should be accepted");
+    uint32_t pa_moves = run_extrude_path();
+    TEST_ASSERT_EQ(test_get_queued_steps(3), 140,
+                   "pressure advance should keep the E step count");
+    TEST_ASSERT(pa_moves > plain_moves,
+                "pressure advance should reverse E while decelerating");
+    TEST_ASSERT_EQ(test_get_queued_steps(0), 800, "X should be unaffected");
+    
+    TEST_ASSERT_EQ(toolhead_set_pressure_advance(0.0f, 0.04f), TOOLHEAD_OK,
+                   "disabling pressure advance should succeed");
+    run_extrude_path();
+    TEST_ASSERT_EQ(test_get_queued_steps(3), 140, "E should step linearly again");
+    
+    return 1;
+}
+
+/**
+ * @brief   梯形运动的双精度参考步进时间
+ * @param   dist    距起点的距离 (mm)
+ * @return  相对运动开始的时间 (秒)
+ */
+static double
+ref_step_time(double dist, double accel_t, double cruise_t,
+              double cruise_v, double accel)
+{
+    double accel_d = 0.5 * accel * accel_t * accel_t;
+    double cruise_d = cruise_v * cruise_t;
+    
+    if (dist <= accel_d) {
+        return sqrt(2.0 * dist / accel);
+    }
+    dist -= accel_d;
+    if (dist <= cruise_d) {
+        return accel_t + dist / cruise_v;
+    }
+    dist -= cruise_d;
+    return accel_t + cruise_t
+           + (cruise_v - sqrt(cruise_v * cruise_v - 2.0 * accel * dist)) / accel;
+}
+
+/**
+ * @brief   测试 motion_t 步进时间相对双精度参考的误差
+ */
+static int
+test_step_time_precision(void)
+{
+    static struct step_queue sq;
+    struct coord start = {0.003, 0.0, 0.0, 0.0};
+    struct coord axes_r = {1.0, 0.0, 0.0, 0.0};
+    struct step_time st;
+    double max_err = 0.0;
+    int steps = 0;
+    int n;
+    
+    toolhead_init();
+    
+    struct trapq *tq = trapq_alloc();
+    struct stepper_kinematics *sk = itersolve_alloc();
+    TEST_ASSERT(tq != NULL && sk != NULL, "allocations should succeed");
+    
+    /* 2.5mm 加速 + 15mm 匀速 + 2.5mm 减速 */
+    trapq_append(tq, 1.0, 0.05, 0.15, 0.05, &start, &axes_r,
+                 0.0, 100.0, 2000.0);
+    
+    cartesian_stepper_setup(sk, CARTESIAN_AXIS_X, 80.0);
+    step_queue_init(&sq);
+    itersolve_set_trapq(sk, tq);
+    itersolve_set_step_queue(sk, &sq);
+    itersolve_set_position(sk, start.x * 80.0);
+    
+    /* 队列容量小于总步数，分批生成 */
+    do {
+        n = itersolve_generate_steps(sk, 1.3);
+        while (step_queue_pop(&sq, &st) == 0) {
+            steps++;
+            double dist = steps / 80.0 - start.x;
+            double ref = 1.0 + ref_step_time(dist, 0.05, 0.15, 100.0, 2000.0);
+            double err = fabs(st.time - ref);
+            if (err > max_err) {
+                max_err = err;
+            }
+        }
+    } while (n > 0);
+    
+    printf("  (%d steps, max error %.3g s)\n", steps, max_err);
+    TEST_ASSERT_EQ(steps, 1600, "every step of the move should be emitted");
+    TEST_ASSERT(max_err < STEP_TIME_TOLERANCE, "step time error within bound");
+    
+    itersolve_free(sk);
+    trapq_free(tq);
+    
+    return 1;
+}
+
+/**
+ * @brief   测试打印时间与 64 位时钟换算 (超过 32 位回绕周期)
+ */
+static int
+test_print_time_clock64(void)
+{
+    toolhead_init();
+    
+    /* 1MHz 下 32 位时钟约 4295 秒回绕 */
+    double t = 10000.25;
+    uint64_t base = toolhead_print_time_to_clock64(0.0);
+    uint64_t clock = toolhead_print_time_to_clock64(t);
+    
+    TEST_ASSERT(clock - base == (uint64_t)(t * CONFIG_STEP_TIMER_FREQ),
+                "64-bit clock should not wrap");
+    TEST_ASSERT((uint32_t)clock == toolhead_print_time_to_clock(t),
+                "low word should match 32-bit clock");
+    TEST_ASSERT_DOUBLE_EQ(toolhead_clock64_to_print_time(clock), t,
+                          "clock64 -> print_time round trip");
+    TEST_ASSERT_DOUBLE_EQ(toolhead_clock64_to_print_time(base), 0.0,
+                          "base clock is print_time 0");
+    
+    return 1;
+}
+
 /**
  * @brief   测试重复初始化
  */
@@ -749,6 +2169,7 @@ main(void)
     RUN_TEST(test_home_basic);
     RUN_TEST(test_home_multiple_axes);
     RUN_TEST(test_home_all_axes);
+    RUN_TEST(test_home_async);
     
     /* 运行运动测试 */
     printf("\n--- Move Tests ---\n");
@@ -759,9 +2180,41 @@ main(void)
     RUN_TEST(test_move_out_of_bounds);
     RUN_TEST(test_wait_and_flush);
     RUN_TEST(test_move_complete_callback);
+    RUN_TEST(test_move_queues_steps);
+    RUN_TEST(test_move_pool_reclaim);
+    RUN_TEST(test_queue_depth);
+    RUN_TEST(test_flush_timer);
+    RUN_TEST(test_lookahead_polygon);
+    RUN_TEST(test_lookahead_replan);
+    RUN_TEST(test_lazy_flush_time);
+    RUN_TEST(test_move_coalesce);
+    RUN_TEST(test_move_arc);
+    RUN_TEST(test_move_arc_resume);
+    
+    /* 运行步进压缩测试 */
+    printf("\n--- Step Compression Tests ---\n");
+    RUN_TEST(test_stepcompress_constant);
+    RUN_TEST(test_stepcompress_accel);
+    RUN_TEST(test_trapq_cursor);
+    RUN_TEST(test_itersolve_cursor);
+    RUN_TEST(test_itersolve_skip_idle_axis);
+    RUN_TEST(test_linear_solver_matches_iterative);
+    RUN_TEST(test_step_time_precision);
+    
+    /* 运行运动学测试 */
+    printf("\n--- Kinematics Tests ---\n");
+    RUN_TEST(test_corexy_steps);
+    RUN_TEST(test_delta_steps);
+    
+    /* 运行输入整形与压力提前测试 */
+    printf("\n--- Input Shaper / Pressure Advance Tests ---\n");
+    RUN_TEST(test_input_shaper_steps);
+    RUN_TEST(test_toolhead_input_shaper);
+    RUN_TEST(test_toolhead_pressure_advance);
     
     /* 运行其他测试 */
     printf("\n--- Other Tests ---\n");
+    RUN_TEST(test_print_time_clock64);
     RUN_TEST(test_reinit);
     
     /* 输出结果 */
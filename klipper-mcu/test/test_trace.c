@@ -0,0 +1,303 @@
+/**
+ * @file    test_trace.c
+ * @brief   运动轨迹记录环单元测试
+ *
+ * 测试 src/trace.c 的记录读取、环满覆盖最旧记录、trace_dump 按序号
+ * 顺序导出、导出期间被覆盖时计入 lost，以及 freeze 暂停记录。
+ * 串口和调度器接口由桩函数代替，发送的消息块按顺序记录。
+ * 使用主机编译器 (gcc) 编译运行
+ *
+ * 编译: gcc -o test_trace test_trace.c ../src/trace.c -I.. -I../src -DCONFIG_MOTION_TRACE=1
+ * 运行: ./test_trace
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "sched.h"
+#include "command.h"
+#include "stm32/serial.h"
+
+/* ========== 测试框架 ========== */
+
+static int g_tests_run = 0;
+static int g_tests_passed = 0;
+static int g_tests_failed = 0;
+
+#define TEST_ASSERT(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  FAIL: %s (line %d)\n", msg, __LINE__); \
+        return 0; \
+    } \
+} while (0)
+
+#define TEST_ASSERT_EQ(a, b, msg) do { \
+    if ((a) != (b)) { \
+        printf("  FAIL: %s - expected %d, got %d (line %d)\n", msg, (int)(b), (int)(a), __LINE__); \
+        return 0; \
+    } \
+} while (0)
+
+#define RUN_TEST(test_func) do { \
+    g_tests_run++; \
+    printf("Running %s...\n", #test_func); \
+    if (test_func()) { \
+        g_tests_passed++; \
+        printf("  PASS\n"); \
+    } else { \
+        g_tests_failed++; \
+    } \
+} while (0)
+
+/* ========== 串口/调度器/命令层桩函数 ========== */
+
+/* 调度器时钟，每次读取加一，便于核对记录时刻 */
+static sched_time_t g_clock = 0;
+
+sched_time_t
+sched_get_time(void)
+{
+    return g_clock++;
+}
+
+uint32_t
+sched_irq_save(void)
+{
+    return 0;
+}
+
+void
+sched_irq_restore(uint32_t flag)
+{
+    (void)flag;
+}
+
+/* 串口发送缓冲区空闲字节数 */
+static size_t g_tx_free = 0;
+
+size_t
+serial_tx_free(void)
+{
+    return g_tx_free;
+}
+
+int
+command_register(const cmd_desc_t *desc)
+{
+    (void)desc;
+    return 0;
+}
+
+/* 记录发送的消息 */
+#define MAX_MESSAGES    (2 * TRACE_SIZE)
+
+typedef struct {
+    cmd_id_t id;
+    uint32_t values[5];
+} message_t;
+
+static message_t g_msgs[MAX_MESSAGES];
+static int g_msg_count = 0;
+
+int
+command_send_message(cmd_id_t id, const uint32_t *values, uint8_t count)
+{
+    if (g_msg_count < MAX_MESSAGES) {
+        g_msgs[g_msg_count].id = id;
+        memset(g_msgs[g_msg_count].values, 0, sizeof(g_msgs[g_msg_count].values));
+        memcpy(g_msgs[g_msg_count].values, values, count * sizeof(uint32_t));
+    }
+    g_msg_count++;
+    return 0;
+}
+
+/* ========== 辅助函数 ========== */
+
+/* 清空记录环和发送记录 */
+static void
+reset(void)
+{
+    trace_init();
+    g_msg_count = 0;
+    g_tx_free = 0;
+}
+
+/* 写入 n 条记录，a 为记录序号 */
+static void
+record_n(uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t seq = trace_next_seq();
+        trace_record(TRACE_STEP, (uint8_t)(seq & 0x7), (uint16_t)(seq & 0xFF),
+                     seq, ~seq);
+    }
+}
+
+/* 检查导出: 记录 first ~ end-1 依序发出，最后一条为结束消息 */
+static int
+check_dump(uint32_t first, uint32_t end, uint32_t lost)
+{
+    int count = (int)(end - first);
+
+    TEST_ASSERT_EQ(g_msg_count, count + 1, "one message per record plus end");
+    for (int i = 0; i < count; i++) {
+        const message_t *m = &g_msgs[i];
+        uint32_t seq = first + (uint32_t)i;
+        TEST_ASSERT_EQ(m->id, CMD_RSP_TRACE, "record message");
+        TEST_ASSERT_EQ(m->values[0], seq, "records in seq order");
+        TEST_ASSERT_EQ(m->values[3], seq, "record payload a");
+        TEST_ASSERT_EQ(m->values[4], ~seq, "record payload b");
+        TEST_ASSERT_EQ(m->values[2] & 0xFF, TRACE_STEP, "record type");
+        TEST_ASSERT_EQ((m->values[2] >> 8) & 0xFF, seq & 0x7, "record id");
+        TEST_ASSERT_EQ(m->values[2] >> 16, seq & 0xFF, "record depth");
+    }
+    TEST_ASSERT_EQ(g_msgs[count].id, CMD_RSP_TRACE_END, "end message");
+    TEST_ASSERT_EQ(g_msgs[count].values[0], end, "end next_seq");
+    TEST_ASSERT_EQ(g_msgs[count].values[1], lost, "end lost");
+
+    return 1;
+}
+
+/* ========== 测试用例 ========== */
+
+/**
+ * @brief   测试记录写入与读取
+ */
+static int
+test_record_get(void)
+{
+    trace_record_t r;
+
+    reset();
+    g_clock = 1000;
+    record_n(3);
+    TEST_ASSERT_EQ(trace_next_seq(), 3, "three records");
+
+    TEST_ASSERT_EQ(trace_get(1, &r), 0, "record 1 readable");
+    TEST_ASSERT_EQ(r.clock, 1001, "clock taken at record time");
+    TEST_ASSERT_EQ(r.type, TRACE_STEP, "type");
+    TEST_ASSERT_EQ(r.id, 1, "id");
+    TEST_ASSERT_EQ(r.depth, 1, "depth");
+    TEST_ASSERT_EQ(r.a, 1, "a");
+    TEST_ASSERT_EQ(r.b, ~1u, "b");
+    TEST_ASSERT_EQ(trace_get(3, &r), -1, "unwritten record");
+
+    return 1;
+}
+
+/**
+ * @brief   测试环满时覆盖最旧的记录
+ */
+static int
+test_ring_overwrite(void)
+{
+    trace_record_t r;
+
+    reset();
+    record_n(TRACE_SIZE + 10);
+    TEST_ASSERT_EQ(trace_next_seq(), TRACE_SIZE + 10, "seq keeps counting");
+
+    TEST_ASSERT_EQ(trace_get(0, &r), -1, "oldest records overwritten");
+    TEST_ASSERT_EQ(trace_get(9, &r), -1, "last overwritten record");
+    TEST_ASSERT_EQ(trace_get(10, &r), 0, "oldest surviving record");
+    TEST_ASSERT_EQ(r.a, 10, "oldest surviving payload");
+    TEST_ASSERT_EQ(trace_get(TRACE_SIZE + 9, &r), 0, "newest record");
+    TEST_ASSERT_EQ(r.a, TRACE_SIZE + 9, "newest payload");
+
+    return 1;
+}
+
+/**
+ * @brief   测试 trace_dump 按序号顺序导出环中的记录
+ */
+static int
+test_dump_order(void)
+{
+    reset();
+    record_n(TRACE_SIZE + 5);
+
+    trace_dump_start(0);
+    g_tx_free = 1024;
+    trace_task();
+    TEST_ASSERT(check_dump(5, TRACE_SIZE + 5, 0), "dump of a wrapped ring");
+
+    /* 导出结束后再调用不再发送 */
+    trace_task();
+    TEST_ASSERT_EQ(g_msg_count, TRACE_SIZE + 1, "dump finished");
+
+    return 1;
+}
+
+/**
+ * @brief   测试发送缓冲区满时分段导出，导出期间被覆盖的记录计入 lost
+ */
+static int
+test_dump_overwritten(void)
+{
+    reset();
+    record_n(TRACE_SIZE + 5);
+
+    /* 发送缓冲区满: 一条也不发 */
+    trace_dump_start(0);
+    trace_task();
+    TEST_ASSERT_EQ(g_msg_count, 0, "no room, nothing sent");
+
+    /* 导出未开始时又写入 20 条，覆盖了最旧的 20 条待发送记录 */
+    record_n(20);
+    g_tx_free = 1024;
+    trace_task();
+    TEST_ASSERT(check_dump(25, TRACE_SIZE + 5, 20), "overwritten records skipped");
+
+    return 1;
+}
+
+/**
+ * @brief   测试 freeze 导出期间暂停记录
+ */
+static int
+test_dump_freeze(void)
+{
+    reset();
+    record_n(10);
+
+    trace_dump_start(1);
+    record_n(5);
+    TEST_ASSERT_EQ(trace_next_seq(), 10, "frozen ring ignores records");
+
+    g_tx_free = 1024;
+    trace_task();
+    TEST_ASSERT(check_dump(0, 10, 0), "frozen dump");
+
+    record_n(1);
+    TEST_ASSERT_EQ(trace_next_seq(), 11, "recording resumes after dump");
+
+    return 1;
+}
+
+/* ========== 主函数 ========== */
+
+int
+main(void)
+{
+    printf("========================================\n");
+    printf("  Motion Trace Unit Tests\n");
+    printf("========================================\n\n");
+
+    RUN_TEST(test_record_get);
+    RUN_TEST(test_ring_overwrite);
+    RUN_TEST(test_dump_order);
+    RUN_TEST(test_dump_overwritten);
+    RUN_TEST(test_dump_freeze);
+
+    /* 输出结果 */
+    printf("\n========================================\n");
+    printf("  Test Results\n");
+    printf("========================================\n");
+    printf("Total:  %d\n", g_tests_run);
+    printf("Passed: %d\n", g_tests_passed);
+    printf("Failed: %d\n", g_tests_failed);
+    printf("========================================\n");
+
+    return (g_tests_failed > 0) ? 1 : 0;
+}